@@ -0,0 +1,79 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <core/mem/allocer.h>
+
+/*
+ * ==========================================================================
+ * 1. Types
+ * ==========================================================================
+ */
+
+struct ArenaChunk;
+
+/**
+ * @brief A bump arena that can be rolled back to a checkpoint.
+ * * Allocation is a pointer bump inside the current chunk. arena_mark
+ * records the current top and arena_release frees everything allocated
+ * after it at once, handing whole chunks back to the backing allocator.
+ * Freeing or growing the most recent allocation works in place, so a
+ * single growing vector does not leave garbage behind.
+ *
+ * Releases must nest: a mark is invalidated by releasing an older one.
+ */
+struct Arena {
+	allocer_t backing;
+	usize chunk_size;
+
+	struct ArenaChunk *head;
+	/* One emptied chunk kept back, so mark/release in a loop is cheap. */
+	struct ArenaChunk *spare;
+
+	usize used;
+	usize peak;
+	usize reserved;
+};
+
+struct ArenaMark {
+	struct ArenaChunk *chunk;
+	usize used;
+};
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+void arena_init(struct Arena *a, allocer_t backing, usize chunk_size);
+void arena_deinit(struct Arena *a);
+
+/**
+ * @brief The arena as a generic allocator (e.g. for vec_init / map_init).
+ */
+allocer_t arena_allocer(struct Arena *a);
+
+void *arena_alloc(struct Arena *a, layout_t l);
+
+struct ArenaMark arena_mark(struct Arena *a);
+
+/**
+ * @brief Free everything allocated since `mark` was taken.
+ */
+void arena_release(struct Arena *a, struct ArenaMark mark);
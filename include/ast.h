@@ -71,6 +71,8 @@ typedef enum NodeKind {
 	ND_VAR_DECL,
 	ND_BREAK,
 	ND_CONTINUE,
+
+	ND_FUNC,
 } NodeKind;
 
 /*
@@ -86,6 +88,7 @@ struct Node {
 };
 
 defVec(struct Node *, NodeVec);
+defVec(struct SemaSymbol *, SymbolVec);
 
 /*
  * ==========================================================================
@@ -120,7 +123,7 @@ struct NodeInitList {
 
 struct NodeVar {
 	struct Node base;
-	struct SemaSymbol *var;
+	const struct SemaSymbol *var;
 };
 
 struct NodeUnary {
@@ -164,6 +167,13 @@ struct NodeVarDecl {
 	struct Node *init;
 };
 
+struct NodeFunc {
+	struct Node base;
+	struct SemaSymbol *sym;
+	SymbolVec params;
+	struct Node *body;
+};
+
 /*
  * ==========================================================================
  * 4. Helpers (Downcasting)
@@ -179,6 +189,7 @@ struct NodeVarDecl {
 #define as_var(n) ((struct NodeVar *)(n))
 #define as_call(n) ((struct NodeCall *)(n))
 #define as_decl(n) ((struct NodeVarDecl *)(n))
+#define as_func(n) ((struct NodeFunc *)(n))
 
 #define as_lit_int(n) ((struct NodeLitInt *)(n))
 #define as_lit_float(n) ((struct NodeLitFloat *)(n))
@@ -0,0 +1,171 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <ast.h>
+
+struct Context;
+
+/*
+ * ==========================================================================
+ * 1. File Format
+ * ==========================================================================
+ * A checked AST saved after parser_parse, laid out so it can be used
+ * straight out of an mmap: every reference is a 32-bit index or byte offset
+ * relative to its section, never a pointer. Sections are 8-byte aligned and
+ * follow the header in this order:
+ *
+ *   strings  NUL-terminated names, referenced by byte offset
+ *   types    AstFileType[], referenced by index; children precede parents
+ *   symbols  AstFileSymbol[], referenced by index
+ *   nodes    AstFileNode[], post-order: children precede parents
+ *   lists    u32[]; a list at index i is { len, elem0, elem1, ... }
+ *
+ * `roots` is a list index holding the top-level nodes. Bump
+ * AST_FILE_VERSION whenever NodeKind, TypeKind or a record layout changes.
+ */
+
+#define AST_FILE_MAGIC "CACTAST"
+#define AST_FILE_VERSION 1
+#define AST_FILE_NONE 0xffffffffu
+
+struct AstFileSection {
+	u64 offset;
+	u64 count;
+};
+
+struct AstFileHeader {
+	char magic[8];
+	u32 version;
+	u32 roots;
+	u64 file_size;
+
+	struct AstFileSection strings;
+	struct AstFileSection types;
+	struct AstFileSection symbols;
+	struct AstFileSection nodes;
+	struct AstFileSection lists;
+};
+
+struct AstFileType {
+	u32 kind;
+	i32 size;
+	i32 align;
+	/* ARRAY: element type. FUNC: return type. */
+	u32 base;
+	/* ARRAY: length. FUNC: list of parameter types. */
+	u32 extra;
+	u32 reserved;
+};
+
+struct AstFileSymbol {
+	u32 name;
+	u32 type;
+	u8 is_const;
+	u8 is_global;
+	u8 reserved[2];
+	i32 stack_offset;
+};
+
+/**
+ * @brief One AST node. The meaning of a/b/c depends on `kind`:
+ * * LIT_*: a (and b for the high half of a double) hold the value bits.
+ * * VAR: a = symbol. VAR_DECL: a = symbol, b = init node.
+ * * FUNC_CALL: a = callee name (string), b = argument list.
+ * * Unary kinds: a = operand. Binary kinds: a = lhs, b = rhs.
+ * * BLOCK / INIT_LIST: a = list of nodes.
+ * * IF: a = cond, b = then, c = else. WHILE: a = cond, b = body.
+ * * FUNC: a = symbol, b = list of parameter symbols, c = body.
+ * Unused or absent references are AST_FILE_NONE.
+ */
+struct AstFileNode {
+	u32 kind;
+	u32 type;
+	u64 span_start;
+	u32 span_len;
+	u32 a;
+	u32 b;
+	u32 c;
+};
+
+/*
+ * ==========================================================================
+ * 2. Reader
+ * ==========================================================================
+ */
+
+/**
+ * @brief A read-only view of an AST file (usually an mmap of it).
+ * * All accessors index directly into the mapping; nothing is copied.
+ */
+struct AstFile {
+	const u8 *base;
+	usize size;
+	bool mapped;
+
+	const struct AstFileHeader *hdr;
+	const char *strings;
+	const struct AstFileType *types;
+	const struct AstFileSymbol *symbols;
+	const struct AstFileNode *nodes;
+	const u32 *lists;
+};
+
+/**
+ * @brief Validate a buffer in place and set up the section views.
+ * * Checks the header, section bounds, and that every index, offset and
+ * list stays in range, so accessors never need bounds checks afterwards.
+ * @return false (with a message in `err`) if the buffer is malformed.
+ */
+bool astfile_check(struct AstFile *f, const void *base, usize size,
+		   const char **err);
+
+/**
+ * @brief mmap an AST file read-only and check it. No deserialization.
+ */
+bool astfile_map(struct AstFile *f, const char *path, const char **err);
+
+void astfile_unmap(struct AstFile *f);
+
+static inline const char *astfile_str(const struct AstFile *f, u32 off)
+{
+	return f->strings + off;
+}
+
+static inline u32 astfile_list_len(const struct AstFile *f, u32 list)
+{
+	return f->lists[list];
+}
+
+static inline const u32 *astfile_list(const struct AstFile *f, u32 list)
+{
+	return f->lists + list + 1;
+}
+
+/*
+ * ==========================================================================
+ * 3. Writer
+ * ==========================================================================
+ */
+
+/**
+ * @brief Serialize the result of parser_parse to `path`.
+ * * Types, symbols and names are deduplicated; `ctx` provides the interner
+ * used to resolve symbol names.
+ */
+bool astfile_write(const char *path, struct Context *ctx, NodeVec globals);
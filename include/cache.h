@@ -0,0 +1,98 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <core/mem/allocer.h>
+#include <std/strings/str.h>
+
+/*
+ * ==========================================================================
+ * 1. Types
+ * ==========================================================================
+ */
+
+/**
+ * @brief A 128-bit content address.
+ * * Derived from the source bytes, the input path (diagnostics embed it), the
+ * compiler binary itself and every output-affecting command line flag.
+ */
+struct CacheKey {
+	u64 lo;
+	u64 hi;
+};
+
+/**
+ * @brief A handle on an on-disk compilation cache directory.
+ */
+struct Cache {
+	const char *dir;
+	u64 max_bytes;
+};
+
+/**
+ * @brief The replayable result of one compilation.
+ * * `diag` is exactly what the compiler wrote to stderr, `output` its
+ * messages (the AST summary, IR for --emit-ir=-), `code` the file it
+ * generated for -o, -S, -c or --emit=c, empty if none.
+ */
+struct CacheEntry {
+	bool success;
+	str_t diag;
+	str_t output;
+	str_t code;
+};
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+/**
+ * @brief Open (and create if needed) a cache directory.
+ * * @param max_bytes Size bound; least recently used entries are evicted
+ * after every store once the directory grows beyond it.
+ * @return false if the directory cannot be created.
+ */
+bool cache_open(struct Cache *c, const char *dir, u64 max_bytes);
+
+/**
+ * @brief Fast non-cryptographic 128-bit hash over a sequence of byte ranges.
+ * * Feed every component with cache_key_feed, starting from a zeroed key.
+ */
+void cache_key_feed(struct CacheKey *key, str_t bytes);
+
+/**
+ * @brief Feed the contents of the file at `path`.
+ * @return false if it cannot be read; the key is then unusable.
+ */
+bool cache_key_feed_file(struct CacheKey *key, const char *path);
+
+/**
+ * @brief Look up a key. On a hit the entry is filled (its strings are
+ * allocated from `alc`) and its access time refreshed for LRU purposes.
+ */
+bool cache_lookup(struct Cache *c, struct CacheKey key, allocer_t alc,
+		  struct CacheEntry *out);
+
+/**
+ * @brief Store a result atomically (write to a temp file, then rename),
+ * then evict old entries if the directory is over its size bound.
+ */
+bool cache_store(struct Cache *c, struct CacheKey key,
+		 const struct CacheEntry *e);
@@ -0,0 +1,285 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <ir.h>
+
+/*
+ * ==========================================================================
+ * 1. Storage
+ * ==========================================================================
+ * Every analysis keeps its arrays in one flat buffer, indexed by block or
+ * value id. Recomputing reuses the buffer, which only grows.
+ */
+
+struct IrBuf {
+	u64 *data;
+	usize cap;
+	usize used;
+};
+
+void ir_buf_deinit(struct IrBuf *b);
+
+/*
+ * ==========================================================================
+ * 2. Control Flow Graph
+ * ==========================================================================
+ */
+
+#define IR_UNREACHABLE UINT32_MAX
+
+struct IrCfg {
+	/* Block slots, including the unused slot 0. */
+	u32 nblocks;
+
+	/* Edges of bb: succs[succ_start[bb] .. succ_start[bb + 1]) and
+	 * preds[pred_start[bb] .. pred_start[bb + 1]). A CONDBR with both
+	 * targets equal is one edge. */
+	u32 *succ_start;
+	u32 *succs;
+	u32 *pred_start;
+	u32 *preds;
+
+	/* Reachable blocks in reverse postorder, the entry first, and each
+	 * block's position there (IR_UNREACHABLE if it has none). */
+	u32 *rpo;
+	u32 nrpo;
+	u32 *rpo_index;
+
+	struct IrBuf buf;
+};
+
+void ir_cfg_build(struct IrCfg *cfg, const struct IrFunc *fn);
+
+static inline bool ir_cfg_reachable(const struct IrCfg *cfg, u32 bb)
+{
+	return cfg->rpo_index[bb] != IR_UNREACHABLE;
+}
+
+/*
+ * ==========================================================================
+ * 3. Dominators
+ * ==========================================================================
+ * Cooper, Harvey and Kennedy's iterative algorithm over reverse
+ * postorder. Dominance queries take O(1) from a preorder numbering of
+ * the tree.
+ */
+
+struct IrDomTree {
+	/* Immediate dominator; the root's is itself, unreachable blocks'
+	 * IR_NONE. */
+	u32 *idom;
+
+	/* Children of bb: children[child_start[bb] .. child_start[bb + 1]),
+	 * in reverse postorder. */
+	u32 *child_start;
+	u32 *children;
+
+	/* a dominates b iff pre[a] <= pre[b] and post[b] <= post[a];
+	 * pre[bb] is 0 for unreachable blocks. */
+	u32 *pre;
+	u32 *post;
+
+	struct IrBuf buf;
+};
+
+void ir_domtree_build(struct IrDomTree *dt, const struct IrCfg *cfg);
+
+static inline bool ir_dominates(const struct IrDomTree *dt, u32 a, u32 b)
+{
+	return dt->pre[b] && dt->pre[a] <= dt->pre[b] &&
+	       dt->post[b] <= dt->post[a];
+}
+
+/*
+ * Post-dominators: the dominator tree of the reversed CFG, rooted at a
+ * virtual exit in the unused block slot 0. Its predecessors are the
+ * blocks that return and, for each part of the function that never
+ * returns, the last of its blocks in reverse postorder, so every
+ * reachable block is in the tree.
+ */
+struct IrPostDomTree {
+	/* idom[bb] is the immediate post-dominator; 0 is the exit. */
+	struct IrDomTree tree;
+
+	/* The reversed CFG. */
+	struct IrBuf buf;
+};
+
+void ir_postdomtree_build(struct IrPostDomTree *pdt, const struct IrCfg *cfg);
+
+static inline bool ir_postdominates(const struct IrPostDomTree *pdt, u32 a,
+				    u32 b)
+{
+	return ir_dominates(&pdt->tree, a, b);
+}
+
+/*
+ * Dominance frontiers: the blocks where bb's dominance ends, each a join
+ * that bb dominates a predecessor of but not strictly the join itself.
+ */
+struct IrDomFrontier {
+	/* Frontier of bb: blocks[start[bb] .. start[bb + 1]). */
+	u32 *start;
+	u32 *blocks;
+
+	/* Starts, and the blocks, sized once they are counted. */
+	struct IrBuf buf;
+	struct IrBuf list;
+};
+
+void ir_domfrontier_build(struct IrDomFrontier *df, const struct IrCfg *cfg,
+			  const struct IrDomTree *dt);
+
+/*
+ * ==========================================================================
+ * 4. Loops
+ * ==========================================================================
+ * Natural loops: a header that dominates the source of a back edge to
+ * it, and every block that reaches that source without passing the
+ * header. Loops sharing a header are one loop. Loop 0 is the function
+ * itself, the root of the loop nest; inner loops are numbered before
+ * the loops around them.
+ */
+
+struct IrLoop {
+	u32 header;
+	/* Enclosing loop; 0 for an outermost loop. */
+	u32 parent;
+	/* 1 for an outermost loop. */
+	u32 depth;
+	/* The one block outside the loop that branches to the header, if
+	 * it branches nowhere else; IR_NONE otherwise. */
+	u32 preheader;
+	/* Blocks of the loop and the loops in it, blocks[begin .. end) of
+	 * IrLoops, the header first and the rest in reverse postorder. */
+	u32 begin;
+	u32 end;
+	/* Blocks outside the loop with a predecessor inside it,
+	 * exits[exit_begin .. exit_end) of IrLoops. */
+	u32 exit_begin;
+	u32 exit_end;
+};
+
+struct IrLoops {
+	/* loops[0 .. nloops]. */
+	struct IrLoop *loops;
+	u32 nloops;
+	/* Innermost loop of each block, or 0. */
+	u32 *loop_of;
+
+	/* Reachable blocks grouped by loop, each loop's a range that holds
+	 * those of the loops in it, and each block's position there
+	 * (IR_UNREACHABLE if it has none). */
+	u32 *blocks;
+	u32 *pos;
+
+	/* Loops directly in l: children[child_start[l] ..
+	 * child_start[l + 1]), in reverse postorder of their headers. */
+	u32 *child_start;
+	u32 *children;
+
+	u32 *exits;
+
+	/* Everything but the exits, which are sized once they are
+	 * counted. */
+	struct IrBuf buf;
+	struct IrBuf exit_buf;
+};
+
+void ir_loops_build(struct IrLoops *li, const struct IrCfg *cfg,
+		    const struct IrDomTree *dt);
+
+/** @brief Loop depth of `bb`: 0 outside any loop. */
+static inline u32 ir_loop_depth(const struct IrLoops *li, u32 bb)
+{
+	u32 l = li->loop_of[bb];
+	return l ? li->loops[l].depth : 0;
+}
+
+/** @brief Whether `bb` lies in loop `l`, directly or in a nested loop. */
+static inline bool ir_loop_contains(const struct IrLoops *li, u32 l, u32 bb)
+{
+	u32 pos = li->pos[bb];
+	return pos != IR_UNREACHABLE && pos >= li->loops[l].begin &&
+	       pos < li->loops[l].end;
+}
+
+/*
+ * ==========================================================================
+ * 5. Liveness
+ * ==========================================================================
+ * Live-in and live-out sets of the values used outside the block that
+ * defines them; a value used only where it is defined is never live
+ * across a block boundary and gets no bit. A PHI's operand is live out
+ * of its incoming block, not into the PHI's block.
+ */
+
+struct IrLiveness {
+	/* Dense number of each value that has a bit, else IR_UNREACHABLE. */
+	u32 *index;
+	IrValue *values;
+	u32 nvalues;
+
+	/* Bitsets of `words` words per block. */
+	u32 words;
+	u64 *live_in;
+	u64 *live_out;
+
+	/* Numbering, and the bitsets, sized once the numbering is done. */
+	struct IrBuf buf;
+	struct IrBuf bits;
+};
+
+void ir_liveness_build(struct IrLiveness *lv, const struct IrFunc *fn,
+		       const struct IrCfg *cfg);
+
+/** @brief Whether `v` is live on entry to `bb`. */
+bool ir_live_in(const struct IrLiveness *lv, u32 bb, IrValue v);
+
+/** @brief Whether `v` is live on exit from `bb`. */
+bool ir_live_out(const struct IrLiveness *lv, u32 bb, IrValue v);
+
+/*
+ * ==========================================================================
+ * 6. Call Graph
+ * ==========================================================================
+ * Calls between functions with bodies, grouped into strongly connected
+ * components with Tarjan's algorithm. A component is every function on
+ * one cycle of calls: the recursive ones, which cannot be inlined into
+ * each other.
+ */
+
+struct IrCallGraph {
+	u32 nfuncs;
+
+	/* Functions with bodies, each component after every component it
+	 * calls, so callees come before their callers; and each function's
+	 * component, numbered in that order (IR_UNREACHABLE if extern). */
+	u32 *order;
+	u32 norder;
+	u32 *scc;
+
+	/* CALL instructions naming each function; the inliner keeps this
+	 * up to date as it copies and deletes them. */
+	u32 *sites;
+
+	struct IrBuf buf;
+};
+
+void ir_callgraph_build(struct IrCallGraph *cg, const struct IrModule *m);
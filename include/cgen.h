@@ -0,0 +1,48 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <ast.h>
+#include <ir.h>
+
+struct Context;
+
+/*
+ * ==========================================================================
+ * 1. C Output
+ * ==========================================================================
+ * A checked program as C (C11 or later) that behaves as the VM does. It
+ * includes the runtime's header, cactrt.h, and links with libcactrt.a:
+ *
+ *     cc -O2 -I<cactrt.h dir> prog.c <libcactrt.a>
+ *
+ * * Types have exact widths; array parameters are pointers.
+ * * int arithmetic wraps and division checks for zero, through inline
+ *   helpers of cactrt.h; every function checks the stack on entry.
+ * * Operands are evaluated left to right, as in CACT: where C leaves the
+ *   order open and it matters, they go through temporaries (cact_t<n>).
+ * * Names C cannot take as they are (keywords, reserved names) become
+ *   u_<name>; only `main` is external.
+ */
+
+/**
+ * @brief Writes `globals`, checked and lowered into `m`, as C to `path`
+ * ("-": stdout). Global initializers come from `m`, already folded.
+ * @return false, with the error logged, if `path` cannot be written.
+ */
+bool cgen_write(const char *path, struct Context *ctx, NodeVec globals,
+		const struct IrModule *m);
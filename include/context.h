@@ -17,21 +17,55 @@
 #pragma once
 
 #include <core/mem/allocer.h>
+#include <arena.h>
 #include <std/map.h>
 #include <std/strings/intern.h>
 #include <std/fs/srcmanager.h>
 #include <token.h>
+#include <stdio.h>
 
-defMap(symbol_t, TokenKind, KeywordMap);
+struct Stream;
+struct Document;
+struct SemaSymbol;
+
+/* Statements and blocks (each `else if` arm is one level deeper). */
+#define CTX_DEFAULT_MAX_NESTING 1024
+/* Expressions, operator chains, initializer lists and array dimensions. */
+#define CTX_DEFAULT_MAX_EXPR_DEPTH 4096
 
 struct Context {
+	/* Long-lived: AST, types, symbols. Freed only at exit. */
 	allocer_t alc;
 
+	/* Short-lived temporaries; users mark and release around their use. */
+	struct Arena scratch;
+
+	/* Scope symbol tables, released by sema_scope_leave. */
+	struct Arena scopes;
+
+	/* Innermost local binding of each name, indexed by symbol id (see
+	 * sema_lookup); system-allocated, NULL where no local is in scope. */
+	struct SemaSymbol **locals;
+	usize locals_cap;
+
 	srcmanager_t mgr;
 
 	interner_t itn;
 
-	KeywordMap kw_map;
+	/* Where diagnostics are written (stderr unless captured). */
+	FILE *diag;
+
+	/* Set when compiling streamed input: locations resolve through it,
+	 * since the SourceManager never sees that text. */
+	struct Stream *stream;
+	/* Set while serving a Document, whose text versions are not
+	 * SourceManager files either. */
+	struct Document *doc;
+
+	/* Parser nesting limits; deeper input is rejected before it can
+	 * overflow the stack of the parser or of any recursive AST walk. */
+	u32 max_nesting;
+	u32 max_expr_depth;
 
 	bool had_error;
 	bool panic_mode;
@@ -0,0 +1,168 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <std/vec.h>
+#include <std/map.h>
+#include <std/strings/str.h>
+#include <std/fs/srcmanager.h>
+#include <ast.h>
+#include <arena.h>
+
+struct Context;
+struct Scope;
+
+/*
+ * ==========================================================================
+ * 1. Types
+ * ==========================================================================
+ */
+
+/**
+ * @brief One top-level declaration or function of a Document.
+ * * [start, end) is a byte range of the current text. Items tile the file:
+ * each one owns the trivia in front of it, so `start` is the previous
+ * item's `end`.
+ */
+struct DocItem {
+	usize start;
+	usize end;
+	/* Position label: strictly increasing along the file, with gaps. */
+	u64 order;
+
+	struct Node *node;
+	/* Span position of byte 0 of the text version it was parsed from. */
+	usize base;
+
+	/* Globals defined by / resolved from this item. */
+	SymbolVec defs;
+	SymbolVec uses;
+
+	bool had_error;
+};
+
+defVec(struct DocItem, DocItemVec);
+
+/**
+ * @brief A text version of a Document, kept while some item's AST has
+ * spans into it.
+ */
+struct DocVersion {
+	char *text;
+	usize len;
+	/* Span position of text[0]. */
+	usize base;
+	/* ASTs, item vectors and local symbols of the items parsed from it. */
+	struct Arena *arena;
+	bool live;
+};
+
+defVec(struct DocVersion, DocVersionVec);
+defMap(struct SemaSymbol *, u64, SymOrderMap);
+
+struct IncrStats {
+	usize reparsed;
+	usize rechecked;
+	usize reused;
+};
+
+/**
+ * @brief A compiled file that can be edited and brought up to date
+ * incrementally.
+ * * An edit re-lexes and reparses only the top-level items it touches,
+ * stopping as soon as the new item boundaries line up with the old ones
+ * again. Every other item keeps its AST; an item is only rechecked when it
+ * uses a global whose type changed or that disappeared, collides with a
+ * newly added name, or had errors before. Globals that survive an edit keep
+ * their SemaSymbol, so references from untouched items stay valid.
+ *
+ * All items share one global scope that lives as long as the Document. A
+ * global is only in effect from the item defining it on; the `order` label
+ * of that item decides visibility, so nothing has to be re-declared when
+ * an item in the middle changes.
+ *
+ * Each edit makes a new text version with a span range of its own. Tokens
+ * of untouched items keep the spans of the version they were parsed from,
+ * so a version is freed, with the ASTs parsed from it, once no item refers
+ * to it any more. Types and global symbols stay in `ctx->alc`: untouched
+ * items point at those of other items. The versions
+ * are not SourceManager files: like a Stream, the Document registers one
+ * empty file for its span base and resolves locations itself (set
+ * `ctx->doc`), so no other file may be added while it is open.
+ */
+struct Document {
+	struct Context *ctx;
+	const char *path;
+
+	/* The current version. */
+	str_t text;
+	usize base;
+	usize file_id;
+	/* Versions still referenced, in increasing `base` order. */
+	DocVersionVec versions;
+
+	DocItemVec items;
+	struct Scope *globals;
+	/* Order label of each global's defining item; dead ones map to ~0. */
+	SymOrderMap orders;
+	/* Errors in trailing text that did not form an item. */
+	bool tail_error;
+
+	struct IncrStats last;
+};
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+/**
+ * @brief Compile `text` from scratch and remember its item structure.
+ * @return true if the file has no errors.
+ */
+bool doc_open(struct Document *d, struct Context *ctx, const char *path,
+	      str_t text);
+
+/**
+ * @brief Replace bytes [start, end) of the current text with `text` and
+ * bring the AST and types up to date. Statistics end up in `d->last`.
+ * @return true if the whole file is free of errors afterwards.
+ */
+bool doc_edit(struct Document *d, usize start, usize end, str_t text);
+
+bool doc_had_error(struct Document *d);
+
+/**
+ * @brief Free the text versions and the ASTs parsed from them.
+ */
+void doc_close(struct Document *d);
+
+/**
+ * @brief The current top-level nodes, in source order.
+ * * `out` is allocated in `ctx->scratch`: take a mark before the call and
+ * release it when done with the nodes.
+ */
+void doc_globals(struct Document *d, NodeVec *out);
+
+/**
+ * @brief Resolve a span position to file/line/column and its line text.
+ * @return false if `offset` is in no live version.
+ */
+bool doc_lookup(struct Document *d, usize offset, srcloc_t *loc,
+		str_t *line);
@@ -0,0 +1,413 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <std/vec.h>
+#include <arena.h>
+#include <stdio.h>
+
+/*
+ * ==========================================================================
+ * 1. Types and Opcodes
+ * ==========================================================================
+ * The IR is in SSA form: every value is defined once, by an instruction,
+ * a constant, a parameter or a global's address. Values and blocks are
+ * named by 32-bit ids that index dense per-function arrays; id 0 is
+ * IR_NONE in both spaces and is never a real value or block.
+ *
+ * Locals start out in memory (ALLOCA + LOAD/STORE, allocas at the top of
+ * the entry block); only the result of `&&` / `||` is built with a PHI
+ * until mem2reg turns scalar locals into SSA values.
+ * Arithmetic on i32 wraps. i32 division or remainder by zero is a runtime
+ * error, so passes keep (and do not speculate) those instructions unless
+ * the divisor is a nonzero constant.
+ */
+
+#define IR_NONE 0u
+
+typedef u32 IrValue;
+
+typedef enum IrType {
+	IrType_VOID,
+	IrType_I1,
+	IrType_I32,
+	IrType_F32,
+	IrType_F64,
+	/* An address; arrays only ever appear behind one. */
+	IrType_PTR,
+	IrType_COUNT
+} IrType;
+
+/**
+ * @brief Opcodes: X(ID, NAME). Operands are in the function's `args`
+ * pool; immediates in IrInst.imm.
+ * * CONST      imm = value; not in a block
+ * * PARAM      imm.index = parameter number; not in a block
+ * * GLOBAL     imm.index = global number; its address; not in a block
+ * * ALLOCA     imm.mem = { size, align } in bytes; entry block only
+ * * LOAD       (ptr)
+ * * STORE      (ptr, value)
+ * * ZERO       (ptr); imm.mem.size bytes are cleared
+ * * INDEX      (ptr, i32 index); imm.mem.size = stride: ptr + index*stride
+ * * arith      (lhs, rhs) of the result type; MOD is i32 only. i32 DIV
+ *              and MOD: imm.index = IrFunc.id of the function it was
+ *              written in, which a division by zero names; it survives
+ *              inlining
+ * * NEG, NOT   (operand); NOT is i1 only
+ * * compares   (lhs, rhs) of one type; result i1. Addresses compare as
+ *              signed 64-bit integers
+ * * CALL       (args...); imm.index = callee function
+ * * PHI        (block, value) pairs, one per predecessor
+ * * BR         imm.target[0]
+ * * CONDBR     (i1 cond); imm.target = { then, else }
+ * * RET        (value) or () in a void function
+ */
+#define IR_OPS(X)            \
+	X(CONST, "const")    \
+	X(PARAM, "param")    \
+	X(GLOBAL, "global")  \
+	X(ALLOCA, "alloca")  \
+	X(LOAD, "load")      \
+	X(STORE, "store")    \
+	X(ZERO, "zero")      \
+	X(INDEX, "index")    \
+	X(ADD, "add")        \
+	X(SUB, "sub")        \
+	X(MUL, "mul")        \
+	X(DIV, "div")        \
+	X(MOD, "mod")        \
+	X(NEG, "neg")        \
+	X(NOT, "not")        \
+	X(EQ, "eq")          \
+	X(NE, "ne")          \
+	X(LT, "lt")          \
+	X(LE, "le")          \
+	X(GT, "gt")          \
+	X(GE, "ge")          \
+	X(CALL, "call")      \
+	X(PHI, "phi")        \
+	X(BR, "br")          \
+	X(CONDBR, "condbr")  \
+	X(RET, "ret")        \
+	X(NOP, "nop")
+
+typedef enum IrOp {
+#define X(ID, NAME) IrOp_##ID,
+	IR_OPS(X)
+#undef X
+	IrOp_COUNT
+} IrOp;
+
+/* The bits of a scalar constant; its type is the instruction's. */
+union IrConstBits {
+	i32 i;
+	f32 f;
+	f64 d;
+	bool b;
+};
+
+/* A constant of a scalar type. */
+struct IrConst {
+	IrType ty;
+	union {
+		i32 i;
+		f32 f;
+		f64 d;
+		bool b;
+	};
+};
+
+/*
+ * ==========================================================================
+ * 2. Functions, Blocks and Instructions
+ * ==========================================================================
+ */
+
+struct IrInst {
+	u8 op;
+	/* Type of the result; VOID if the instruction has none. */
+	u8 ty;
+	u16 reserved;
+
+	/* Owning block and siblings in it; IR_NONE outside any block. */
+	u32 block;
+	IrValue prev;
+	IrValue next;
+
+	/* Operands: args[first_arg .. first_arg + nargs) of the function. */
+	u32 first_arg;
+	u32 nargs;
+
+	union {
+		union IrConstBits k;
+		u32 index;
+		struct {
+			u32 size;
+			u32 align;
+		} mem;
+		u32 target[2];
+	} imm;
+};
+
+struct IrBlock {
+	IrValue first;
+	IrValue last;
+};
+
+defVec(struct IrInst, IrInstVec);
+defVec(struct IrBlock, IrBlockVec);
+defVec(u32, IrU32Vec);
+
+struct SemaSymbol;
+
+/* A variable of the source program and the ALLOCA that holds it. */
+struct IrLocal {
+	struct SemaSymbol *sym;
+	IrValue addr;
+};
+
+defVec(struct IrLocal, IrLocalVec);
+
+struct IrFunc {
+	const char *name;
+	/* Index in IrModule.names, kept while functions are renumbered. */
+	u32 id;
+	IrType ret;
+
+	/* PARAM values, in order. */
+	IrU32Vec params;
+
+	/* Declared only, e.g. the builtins; has no blocks. */
+	bool is_extern;
+
+	/* Indexed by IrValue / block id; slot 0 is unused. */
+	IrInstVec insts;
+	IrU32Vec args;
+	IrBlockVec blocks;
+
+	/* The ALLOCA that new ones are placed after, or IR_NONE. */
+	IrValue last_alloca;
+
+	/* Source variables in ALLOCAs, so that a backend can report where
+	 * each one ended up (SemaSymbol.stack_offset). Passes that drop an
+	 * ALLOCA leave its entry pointing at a NOP. */
+	IrLocalVec locals;
+};
+
+struct IrGlobal {
+	const char *name;
+	/* Element type and count; scalars have count 1. */
+	IrType elem;
+	u32 count;
+	bool is_const;
+	/* count elements of `elem` as in memory, or NULL if all zero. */
+	void *init;
+};
+
+defVec(struct IrFunc, IrFuncVec);
+defVec(struct IrGlobal, IrGlobalVec);
+defVec(const char *, IrNameVec);
+
+/**
+ * @brief A whole program. Names, initializers and the tables below live
+ * in `arena`; each function's arrays are allocated on their own so that
+ * passes can grow them without leaving copies behind.
+ */
+struct IrModule {
+	struct Arena arena;
+	IrGlobalVec globals;
+	IrFuncVec funcs;
+	/* Name of every function ever created, by IrFunc.id, also of those
+	 * inlined and deleted since: runtime errors are reported by id. */
+	IrNameVec names;
+};
+
+/*
+ * ==========================================================================
+ * 3. Construction
+ * ==========================================================================
+ */
+
+void ir_module_init(struct IrModule *m);
+void ir_module_deinit(struct IrModule *m);
+
+/** @brief Copies `name` into the module. */
+const char *ir_strdup(struct IrModule *m, const char *name);
+
+u32 ir_global_new(struct IrModule *m, const char *name, IrType elem,
+		  u32 count, bool is_const);
+u32 ir_func_new(struct IrModule *m, const char *name, IrType ret,
+		bool is_extern);
+IrValue ir_param_new(struct IrFunc *fn, IrType ty);
+
+u32 ir_block_new(struct IrFunc *fn);
+
+IrValue ir_const(struct IrFunc *fn, struct IrConst k);
+IrValue ir_const_i32(struct IrFunc *fn, i32 v);
+IrValue ir_const_bool(struct IrFunc *fn, bool v);
+IrValue ir_global_addr(struct IrFunc *fn, u32 global);
+
+/**
+ * @brief Appends instructions to the end of `block`.
+ */
+struct IrBuilder {
+	struct IrFunc *fn;
+	u32 block;
+};
+
+IrValue ir_emit(struct IrBuilder *b, IrOp op, IrType ty, const IrValue *args,
+		u32 nargs);
+IrValue ir_emit_binary(struct IrBuilder *b, IrOp op, IrType ty, IrValue lhs,
+		       IrValue rhs);
+IrValue ir_emit_load(struct IrBuilder *b, IrType ty, IrValue ptr);
+void ir_emit_store(struct IrBuilder *b, IrValue ptr, IrValue val);
+IrValue ir_emit_index(struct IrBuilder *b, IrValue ptr, IrValue index,
+		      u32 stride);
+void ir_emit_br(struct IrBuilder *b, u32 target);
+void ir_emit_condbr(struct IrBuilder *b, IrValue cond, u32 then_bb,
+		    u32 else_bb);
+void ir_emit_ret(struct IrBuilder *b, IrValue val);
+IrValue ir_emit_phi(struct IrBuilder *b, IrType ty, const u32 *blocks,
+		    const IrValue *vals, u32 n);
+
+/** @brief A new ALLOCA at the top of the entry block. */
+IrValue ir_alloca(struct IrFunc *fn, u32 size, u32 align);
+
+/** @brief Unlinks `v` from its block; its id stays allocated as a NOP. */
+void ir_remove(struct IrFunc *fn, IrValue v);
+
+/**
+ * @brief Moves `v` from its block into `bb` after `after`, or first if
+ * `after` is IR_NONE; its uses must stay dominated by it.
+ */
+void ir_move_after(struct IrFunc *fn, IrValue v, u32 bb, IrValue after);
+
+/** @brief Moves `v` to just before `term`, the terminator of its block. */
+void ir_move_before(struct IrFunc *fn, IrValue v, IrValue term);
+
+/**
+ * @brief Replaces every operand `v` with `repl[v]` where that is not
+ * IR_NONE, following chains of replacements; one pass over the function.
+ */
+void ir_replace_uses(struct IrFunc *fn, IrValue *repl);
+
+/**
+ * @brief Deletes blocks not reachable from the entry and renumbers the
+ * rest in order; PHIs lose the incoming edges of deleted blocks.
+ */
+void ir_remove_unreachable(struct IrFunc *fn);
+
+/** @brief Drops the incoming edge from `from` in the PHIs of `bb`. */
+void ir_drop_incoming(struct IrFunc *fn, u32 bb, u32 from);
+
+/**
+ * @brief `n` zeroed bytes of scratch memory for a pass or backend, from
+ * the system allocator; aborts when out of memory.
+ */
+void *ir_grab(usize n);
+
+/** @brief Frees what ir_grab(n) returned; NULL is ignored. */
+void ir_drop(void *p, usize n);
+
+/*
+ * ==========================================================================
+ * 4. Queries
+ * ==========================================================================
+ */
+
+static inline struct IrInst *ir_inst(const struct IrFunc *fn, IrValue v)
+{
+	return &fn->insts.data[v];
+}
+
+static inline IrValue *ir_args(const struct IrFunc *fn, IrValue v)
+{
+	return &fn->args.data[fn->insts.data[v].first_arg];
+}
+
+/** @brief The value of a CONST instruction. */
+static inline struct IrConst ir_const_value(const struct IrFunc *fn,
+					    IrValue v)
+{
+	const struct IrInst *inst = &fn->insts.data[v];
+	struct IrConst k = { .ty = (IrType)inst->ty };
+	k.d = inst->imm.k.d;
+	return k;
+}
+
+static inline u32 ir_block_count(const struct IrFunc *fn)
+{
+	return (u32)vec_len(fn->blocks) - 1;
+}
+
+#define ir_foreach_inst(fn, bb, v)                                \
+	for (IrValue v = (fn)->blocks.data[(bb)].first; v != IR_NONE; \
+	     v = (fn)->insts.data[v].next)
+
+/* Operand indices of `v` that are values (a PHI's blocks are skipped). */
+#define ir_foreach_operand(fn, v, i)                        \
+	for (u32 i = ir_inst(fn, v)->op == IrOp_PHI ? 1 : 0; \
+	     i < ir_inst(fn, v)->nargs;                      \
+	     i += ir_inst(fn, v)->op == IrOp_PHI ? 2 : 1)
+
+bool ir_is_terminator(IrOp op);
+
+/**
+ * @brief Whether `v` does something besides computing its result: writes
+ * memory, calls, branches, or may trap (an i32 division by anything but a
+ * nonzero constant). Those stay even when nothing uses them.
+ */
+bool ir_has_effect(const struct IrFunc *fn, IrValue v);
+
+/** @brief The last instruction of `bb` if it is a terminator, else NONE. */
+IrValue ir_terminator(const struct IrFunc *fn, u32 bb);
+
+/** @brief Successor blocks of `bb`; returns how many (0 to 2). */
+u32 ir_succs(const struct IrFunc *fn, u32 bb, u32 out[2]);
+
+/**
+ * @brief Lays out the ALLOCAs of `fn` in one frame, in order, each at its
+ * alignment: `offsets[v]` receives the offset of ALLOCA v.
+ * @return the frame size, rounded up to 16 bytes.
+ */
+u32 ir_frame_layout(const struct IrFunc *fn, u32 *offsets);
+
+u32 ir_type_size(IrType ty);
+const char *ir_type_name(IrType ty);
+const char *ir_op_name(IrOp op);
+
+/*
+ * ==========================================================================
+ * 5. Printing and Verification
+ * ==========================================================================
+ */
+
+void ir_print_func(FILE *out, const struct IrModule *m,
+		   const struct IrFunc *fn);
+void ir_print_module(FILE *out, const struct IrModule *m);
+
+/**
+ * @brief Checks structural and SSA invariants: every block ends in one
+ * terminator, PHIs lead their block and match its predecessors, operand
+ * types fit their opcode, calls match the callee, and every use is
+ * dominated by its definition.
+ * @return false after printing each violation to `err`.
+ */
+bool ir_verify_func(const struct IrModule *m, const struct IrFunc *fn,
+		    FILE *err);
+bool ir_verify_module(const struct IrModule *m, FILE *err);
@@ -0,0 +1,108 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <ir.h>
+#include <vm.h>
+#include <x86.h>
+
+/*
+ * ==========================================================================
+ * 1. Tiering
+ * ==========================================================================
+ * The interpreter counts calls per function and backward jumps per
+ * function. A function is compiled on its JIT_HOT_CALLS-th call; a frame
+ * that has taken JIT_HOT_LOOPS backward jumps moves to native code at
+ * the loop header it jumps to. Native code calls functions that are not
+ * compiled (yet) back in the interpreter.
+ */
+
+#define JIT_HOT_CALLS 64
+#define JIT_HOT_LOOPS 1024
+
+/**
+ * @brief Native code as the VM calls it: a function on the arguments in
+ * `regs` (`mem` unused), or a loop entry on a running frame's registers
+ * and ALLOCA storage. Returns the bits of the result (union VmReg).
+ */
+typedef u64 (*JitEntry)(union VmReg *regs, u8 *mem);
+
+/* Variables native code shares with the VM, in X86Var order. */
+struct JitVars {
+	u8 *stack_limit;
+	/* The memory stack: a native frame takes its ALLOCA storage here. */
+	u8 *mem_top;
+	u8 *mem_end;
+};
+
+/**
+ * @brief What native code needs from the VM. `ctx` is passed back to
+ * `call` and to the traps.
+ * * `call` runs function `func` in the interpreter on `args` and returns
+ * the bits of its result.
+ * * `runtime` holds the helpers by X86Runtime: the builtins with their C
+ * signatures, and the traps DIV_ZERO and OVERFLOW, called as
+ * trap(id, ctx) with the IrFunc.id to report, which do not return.
+ */
+struct JitHost {
+	void *ctx;
+	u64 (*call)(void *ctx, u32 func, union VmReg *args);
+	void (*runtime[X86_RT_COUNT])(void);
+	u8 *mem_end;
+};
+
+struct Jit;
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+/**
+ * @brief A JIT for `p`, compiled from `m`.
+ * @return NULL where there is no JIT for the host (anything but x86-64
+ * System V) or its memory cannot be mapped.
+ */
+struct Jit *jit_new(const struct VmProgram *p, const struct IrModule *m,
+		    const struct JitHost *host);
+void jit_free(struct Jit *j);
+
+struct JitVars *jit_vars(struct Jit *j);
+
+/**
+ * @brief Calls fn(arg) on the JIT's own machine stack, which is as deep
+ * as the VM's stacks so that native recursion runs out no sooner than
+ * interpreted recursion. Traps must longjmp within fn.
+ */
+void jit_enter(struct Jit *j, void (*fn)(void *), void *arg);
+
+/**
+ * @brief Compiles function `func` (once); from then on native code calls
+ * it directly.
+ * @return its entry, or NULL if it cannot be compiled (externs, or code
+ * space exhausted); it is then never tried again.
+ */
+JitEntry jit_compile(struct Jit *j, u32 func);
+
+/**
+ * @brief The entry at the header of a loop, block `block` of `func`,
+ * compiling `func` if needed.
+ * @return NULL if the header has no entry.
+ */
+JitEntry jit_loop_entry(struct Jit *j, u32 func, u32 block);
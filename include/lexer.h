@@ -20,6 +20,8 @@
 #include <context.h>
 #include <std/fs/srcmanager.h>
 #include <token.h>
+
+struct Stream;
 /*
  * ==========================================================================
  * 1. Type Definition
@@ -39,6 +41,13 @@ struct Lexer {
 	const char *content_start;
 	usize content_len;
 	usize cursor;
+
+	/* Streaming input: content_start is the stream's window, which begins
+	 * `window_base` bytes into the file. Both are NULL/0 otherwise. A
+	 * Document points content_start at its current text version and
+	 * window_base at that version's span range (stream stays NULL). */
+	struct Stream *stream;
+	usize window_base;
 };
 
 /*
@@ -56,6 +65,21 @@ struct Lexer {
  */
 void lexer_init(struct Lexer *lex, struct Context *ctx, usize file_id);
 
+/**
+ * @brief Initialize a Lexer that pulls its text from a Stream on demand.
+ * * `file_id` names the (empty) file registered for the stream; spans are
+ * relative to its base offset just like for a file read up front.
+ */
+void lexer_init_stream(struct Lexer *lex, struct Context *ctx, usize file_id,
+		       struct Stream *s);
+
+/**
+ * @brief Let the stream drop the text before the line containing `offset`.
+ * * Only call this between tokens, e.g. after a top-level item has been
+ * parsed. No-op for lexers over a whole file.
+ */
+void lexer_release(struct Lexer *lex, usize offset);
+
 /**
  * @brief Get the next Token from the stream.
  * * This function skips whitespace and comments, then parses the next valid token.
@@ -0,0 +1,33 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+#include <ast.h>
+#include <ir.h>
+
+struct Context;
+
+/**
+ * @brief Lowers checked top-level items into the empty module `m`.
+ * * The builtins become extern functions ahead of the program's own.
+ * * Locals live in ALLOCAs; const scalars with constant initializers are
+ *   folded into their uses. Global initializers must be constant.
+ * * Errors the checker does not catch (call arguments, initializer
+ *   elements, non-constant global initializers) are reported through
+ *   ctx_error.
+ * @return false if an error was reported; `m` is then incomplete.
+ */
+bool ir_lower(struct IrModule *m, struct Context *ctx, NodeVec globals);
@@ -0,0 +1,54 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <ir.h>
+
+/*
+ * ==========================================================================
+ * 1. Native Output
+ * ==========================================================================
+ * Ahead-of-time compilation to x86-64 (System V). Object files are
+ * written directly; executables are linked from one by the system C
+ * compiler, `cc`, together with the runtime library: $CACTC_RUNTIME if
+ * set, else lib/libcactrt.a next to the compiler's own bin/ directory
+ * (where `make` and `make install` put it).
+ */
+
+typedef enum NativeKind {
+	/* GNU assembly (-S). */
+	NativeKind_ASM,
+	/* An ELF relocatable object (-c). */
+	NativeKind_OBJ,
+	/* An executable linked with the runtime. */
+	NativeKind_EXE,
+} NativeKind;
+
+/**
+ * @brief Writes `m` as `kind` to `path`; assembly and objects go to
+ * stdout if `path` is "-".
+ * @return false, with the error logged, if anything fails.
+ */
+bool native_write(const struct IrModule *m, const char *path,
+		  NativeKind kind);
+
+/**
+ * @brief Writes the path of the runtime library into `buf`.
+ * @return false if it is not there.
+ */
+bool native_runtime(char *buf, usize size);
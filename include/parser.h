@@ -36,9 +36,17 @@ struct Parser {
 	struct Token curr;
 	struct Token prev;
 
+	/* AST nodes and lists. Types go to ctx->alc, where the symbols that
+	 * refer to them live too. */
 	allocer_t alc;
+	/* Lists still being parsed, in ctx->scratch (see SEAL_LIST). */
+	allocer_t tmp;
 
 	bool panic_mode;
+
+	/* Current nesting, checked against ctx->max_nesting / max_expr_depth. */
+	u32 stmt_depth;
+	u32 expr_depth;
 };
 
 /*
@@ -62,3 +70,21 @@ void parser_init(struct Parser *p, struct Context *ctx, struct Lexer *lex);
  * Returns an empty vector (or valid vector with 0 len) on error.
  */
 NodeVec parser_parse(struct Parser *p);
+
+/**
+ * @brief Open and close the global scope.
+ * * Builtin functions are not installed into it: lookups fall back to the
+ * shared prelude (see prelude.h). parser_parse does this itself; callers
+ * driving parser_parse_item directly (e.g. incremental reparsing)
+ * bracket their items with parser_begin_unit / parser_end_unit.
+ */
+void parser_begin_unit(struct Parser *p);
+void parser_end_unit(struct Parser *p);
+
+/**
+ * @brief Parse and check the next top-level declaration or function.
+ * * Tokens that cannot start an item are reported and skipped. Scratch
+ * space used on the way is released before it returns.
+ * @return The item, or NULL once the end of input is reached.
+ */
+struct Node *parser_parse_item(struct Parser *p);
@@ -0,0 +1,281 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <cfg.h>
+#include <ir.h>
+#include <stdio.h>
+
+/*
+ * ==========================================================================
+ * 1. Analyses
+ * ==========================================================================
+ * X(ID, NAME, DEPENDS): an analysis is only up to date while the ones it
+ * was computed from are.
+ */
+
+#define IR_ANALYSES(X)                                                  \
+	X(CFG, "cfg", 0)                                                \
+	X(DOMTREE, "domtree", IR_ANALYSIS(CFG))                         \
+	X(POSTDOMTREE, "postdomtree", IR_ANALYSIS(CFG))                 \
+	X(DOMFRONTIER, "domfrontier",                                   \
+	  IR_ANALYSIS(CFG) | IR_ANALYSIS(DOMTREE))                      \
+	X(LOOPS, "loops", IR_ANALYSIS(CFG) | IR_ANALYSIS(DOMTREE))      \
+	X(LIVENESS, "liveness", IR_ANALYSIS(CFG))
+
+typedef enum IrAnalysis {
+#define X(ID, NAME, DEPENDS) IrAnalysis_##ID,
+	IR_ANALYSES(X)
+#undef X
+	IrAnalysis_COUNT
+} IrAnalysis;
+
+/* A set of analyses, one bit each. */
+typedef u32 IrAnalysisSet;
+
+#define IR_ANALYSIS(ID) (1u << IrAnalysis_##ID)
+
+#define IR_PRESERVE_NONE 0u
+#define IR_PRESERVE_ALL ((1u << IrAnalysis_COUNT) - 1)
+/* What a pass keeps that changes instructions but no block or edge. */
+#define IR_PRESERVE_CFG                                               \
+	(IR_ANALYSIS(CFG) | IR_ANALYSIS(DOMTREE) | IR_ANALYSIS(POSTDOMTREE) | \
+	 IR_ANALYSIS(DOMFRONTIER) | IR_ANALYSIS(LOOPS))
+
+/*
+ * ==========================================================================
+ * 2. Pass Manager
+ * ==========================================================================
+ * Runs passes over one function at a time and caches the analyses they
+ * ask for. A pass returns the analyses it preserved; the others, and
+ * those computed from them, are dropped and recomputed on the next
+ * request.
+ */
+
+struct PassManager {
+	struct IrModule *m;
+	struct IrFunc *fn;
+
+	/* Analyses of `fn` that are up to date. */
+	IrAnalysisSet valid;
+	struct IrCfg cfg;
+	struct IrDomTree domtree;
+	struct IrPostDomTree postdomtree;
+	struct IrDomFrontier domfrontier;
+	struct IrLoops loops;
+	struct IrLiveness liveness;
+
+	/* The module's call graph, for the inliner, and the options the
+	 * pipeline runs with. */
+	struct IrCallGraph *calls;
+	const struct IrOptOptions *opts;
+
+	/* Time analyses took within the running pass, which is charged the
+	 * rest. */
+	double analysis_us;
+};
+
+/* Each up to date on return. */
+const struct IrCfg *pm_cfg(struct PassManager *pm);
+const struct IrDomTree *pm_domtree(struct PassManager *pm);
+const struct IrPostDomTree *pm_postdomtree(struct PassManager *pm);
+const struct IrDomFrontier *pm_domfrontier(struct PassManager *pm);
+const struct IrLoops *pm_loops(struct PassManager *pm);
+const struct IrLiveness *pm_liveness(struct PassManager *pm);
+
+/**
+ * @brief Drops the analyses not in `preserved`, and those computed from
+ * them; for a pass that needs a fresh analysis of its own changes.
+ */
+void pm_invalidate(struct PassManager *pm, IrAnalysisSet preserved);
+
+/** @brief Frees the analyses' storage. */
+void pm_deinit(struct PassManager *pm);
+
+/*
+ * ==========================================================================
+ * 3. Passes
+ * ==========================================================================
+ * X(ID, NAME, FN, REQUIRES). A pass transforms pm->fn with the analyses
+ * in REQUIRES up to date (it may ask for others), and returns what it
+ * preserved: IR_PRESERVE_ALL if it changed nothing.
+ * * simplifycfg  folds constant branches, bypasses empty blocks, merges
+ *                straight-line block pairs and deletes unreachable ones
+ * * sccp         propagates constants along the edges that can be taken,
+ *                folding branches and loads of const globals on the way
+ * * gvn          replaces pure instructions and loads that repeat one in
+ *                a dominating block, and loads of what was just stored
+ * * dce          deletes instructions whose results nothing uses and
+ *                that have no effect
+ * * mem2reg      turns scalar locals that are only loaded and stored
+ *                into SSA values, with PHIs where their stores meet
+ * * loop-simplify gives every loop a preheader and exits that only the
+ *                loop branches to, for the loop passes that follow
+ * * licm         moves loop-invariant instructions and loads to the
+ *                preheader and keeps a location the loop stores to in an
+ *                ALLOCA for the loop, for mem2reg to promote
+ * * loop-reduce  steps addresses that move with an induction variable as
+ *                pointers of their own, and has a loop's exit test compare
+ *                one of them when that leaves the variable unused
+ * * inline       copies the bodies of small callees, already optimized,
+ *                into pm->fn in place of the calls to them
+ */
+
+#define IR_PASSES(X)                                                  \
+	X(SIMPLIFYCFG, "simplifycfg", ir_simplify_cfg, IR_ANALYSIS(CFG)) \
+	X(DCE, "dce", ir_dce, 0)                                         \
+	X(MEM2REG, "mem2reg", ir_mem2reg, IR_ANALYSIS(DOMFRONTIER))      \
+	X(SCCP, "sccp", ir_sccp, IR_ANALYSIS(CFG))                       \
+	X(GVN, "gvn", ir_gvn, IR_ANALYSIS(DOMTREE))                      \
+	X(LOOPSIMPLIFY, "loop-simplify", ir_loop_simplify, IR_ANALYSIS(LOOPS)) \
+	X(LICM, "licm", ir_licm, IR_ANALYSIS(LOOPS))                     \
+	X(LOOPREDUCE, "loop-reduce", ir_loop_reduce, IR_ANALYSIS(LOOPS)) \
+	X(INLINE, "inline", ir_inline, 0)
+
+typedef enum IrPass {
+#define X(ID, NAME, FN, REQUIRES) IrPass_##ID,
+	IR_PASSES(X)
+#undef X
+	IrPass_COUNT
+} IrPass;
+
+#define X(ID, NAME, FN, REQUIRES) IrAnalysisSet FN(struct PassManager *pm);
+IR_PASSES(X)
+#undef X
+
+/** @brief The pass called `name`, or IrPass_COUNT. */
+IrPass ir_pass_lookup(const char *name);
+
+/*
+ * ==========================================================================
+ * 4. Pipelines
+ * ==========================================================================
+ */
+
+#define IR_OPT_MAX_LEVEL 2
+
+/* Default for IrOptOptions.inline_limit. */
+#define IR_INLINE_LIMIT 40
+/* No caller grows past this many instructions, so no larger limit helps. */
+#define IR_INLINE_CALLER_MAX 20000
+
+struct IrOptOptions {
+	/* 0 .. IR_OPT_MAX_LEVEL, as -O0 .. -O2; 0 runs nothing. */
+	u32 level;
+	/* Print each function to `dump` after every run of this pass, or
+	 * of any pass for "all"; NULL for none. */
+	const char *print_after;
+	FILE *dump;
+	/* Verify each function after every pass, reporting to `err`. */
+	bool verify_each;
+	FILE *err;
+	/* Largest cost of a call the inliner takes, about the instructions
+	 * it adds; 0 inlines nothing. */
+	u32 inline_limit;
+	/* Report what the inliner did and did not do, and the functions it
+	 * left unused, to `remarks`; NULL for none. */
+	FILE *remarks;
+};
+
+/**
+ * @brief Runs the pipeline of `opts->level` over every function with a
+ * body, callees before their callers, and at -O2 then deletes the
+ * functions main no longer calls.
+ * @return false if verification failed; the module is then unusable.
+ */
+bool ir_optimize(struct IrModule *m, const struct IrOptOptions *opts);
+
+/**
+ * @brief Deletes the functions with bodies that no chain of calls from
+ * main reaches, renumbering the calls to the rest; nothing without main.
+ */
+void ir_prune_funcs(struct IrModule *m, FILE *remarks);
+
+/*
+ * ==========================================================================
+ * 5. Memory
+ * ==========================================================================
+ * The alias model of gvn and licm. Every address is based on one ALLOCA,
+ * global or array parameter: different ALLOCAs and globals never overlap,
+ * and an array parameter points into the caller's memory, so into a
+ * global array or a caller's local array but never into a local of this
+ * function or a scalar global. Lowering only reaches array elements
+ * through INDEX, so a GLOBAL loaded or stored directly is a scalar.
+ */
+
+typedef enum IrRootKind {
+	IrRoot_UNKNOWN,
+	IrRoot_ALLOCA,
+	IrRoot_SCALAR,
+	IrRoot_ARRAY,
+	IrRoot_PARAM,
+	/* An ALLOCA made after the function's values were counted. */
+	IrRoot_NEW,
+} IrRootKind;
+
+struct IrRoot {
+	IrRootKind kind;
+	/* The ALLOCA, or nvalues + the global; 0 for the others. */
+	u32 id;
+	/* Whether every index on the way is constant, and the offset in
+	 * bytes they add up to. */
+	bool fixed;
+	i64 off;
+};
+
+/* Kinds of memory access, as far as the model tells them apart. */
+typedef enum IrMem {
+	/* To the ALLOCA or global with the same id. */
+	IrMem_SAME,
+	/* A call to a function of the program; the builtins touch no
+	 * memory of it. */
+	IrMem_CALL,
+	/* Through an array parameter. */
+	IrMem_PARAM,
+	/* To a global array. */
+	IrMem_ARRAY,
+	/* Through an address of unknown root. */
+	IrMem_UNKNOWN,
+	IrMem_COUNT
+} IrMem;
+
+/* A set of kinds of access, one bit each. */
+typedef u32 IrMemSet;
+
+#define IR_MEM(KIND) (1u << IrMem_##KIND)
+
+/**
+ * @brief What `addr` in `fn` is based on; `nvalues` is the number of
+ * values the function had when its roots were first asked for.
+ */
+struct IrRoot ir_root_of(const struct IrFunc *fn, u32 nvalues, IrValue addr);
+
+/** @brief The kinds an access through `r` is of. */
+IrMemSet ir_mem_kinds(struct IrRoot r);
+
+/**
+ * @brief The kinds of access that may touch what `r` addresses; SAME
+ * only if to the same root. `escaped` is from ir_find_escapes.
+ */
+IrMemSet ir_mem_overlaps(struct IrRoot r, const bool *escaped);
+
+/**
+ * @brief Marks in `escaped`, one flag per value, the ALLOCAs whose address
+ * or an element's is passed to a call, and so may be accessed by it.
+ */
+void ir_find_escapes(const struct IrFunc *fn, u32 nvalues, bool *escaped);
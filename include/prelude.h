@@ -0,0 +1,98 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <std/strings/intern.h>
+#include <token.h>
+
+struct SemaSymbol;
+
+/*
+ * ==========================================================================
+ * 1. Prelude Names
+ * ==========================================================================
+ */
+
+/**
+ * @brief Builtin functions: name, return type, parameter type.
+ * * A `void` parameter means the function takes no arguments.
+ */
+#define PRELUDE_BUILTINS(X)           \
+	X(print_int, void, int)       \
+	X(print_float, void, float)   \
+	X(print_double, void, double) \
+	X(print_bool, void, bool)     \
+	X(get_int, int, void)         \
+	X(get_float, float, void)     \
+	X(get_double, double, void)
+
+typedef enum PreludeKeyword {
+#define TOK(ID)
+#define PUNCT(ID, STR)
+#define KW(ID, STR) PreludeKeyword_##ID,
+#include <token.def>
+	PreludeKeyword_COUNT,
+} PreludeKeyword;
+
+typedef enum PreludeBuiltin {
+#define PRELUDE_ENUM(NAME, RET, PARAM) PreludeBuiltin_##NAME,
+	PRELUDE_BUILTINS(PRELUDE_ENUM)
+#undef PRELUDE_ENUM
+	PreludeBuiltin_COUNT,
+} PreludeBuiltin;
+
+/*
+ * Every Context interns the prelude names first, so they get the same
+ * symbol ids everywhere: keywords are 0..PreludeKeyword_COUNT-1 and the
+ * builtins follow. Code can then recognise them by id alone.
+ */
+#define PRELUDE_BUILTIN_SYM(B) \
+	((symbol_t){ .id = (u32)PreludeKeyword_COUNT + (u32)(B) })
+#define PRELUDE_SYMBOLS ((u32)PreludeKeyword_COUNT + (u32)PreludeBuiltin_COUNT)
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+/**
+ * @brief Intern the prelude names into a fresh interner.
+ * * Must run before anything else is interned. The first call also builds
+ * the builtin symbols, so prelude_lookup never writes.
+ */
+void prelude_intern(interner_t *itn);
+
+/**
+ * @brief The token kind of a keyword symbol, or TokenKind_IDENT.
+ */
+static inline TokenKind prelude_keyword(symbol_t sym)
+{
+	extern const TokenKind prelude_keyword_kinds[PreludeKeyword_COUNT];
+
+	if (sym.id < (u32)PreludeKeyword_COUNT)
+		return prelude_keyword_kinds[sym.id];
+	return TokenKind_IDENT;
+}
+
+/**
+ * @brief The builtin function named `sym`, or NULL.
+ * * Builtins live outside every Scope: their symbols and signatures are
+ * built once per process and shared, read-only, by all compilations.
+ */
+const struct SemaSymbol *prelude_lookup(symbol_t sym);
@@ -0,0 +1,111 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <ir.h>
+#include <cfg.h>
+
+/*
+ * ==========================================================================
+ * 1. Live Intervals
+ * ==========================================================================
+ * Instructions are numbered in block order, two positions apart: a value
+ * is read at its user's position and written one after its definer's,
+ * so an operand's last use and the result of the same instruction may
+ * share a register. Block b's label sits at block_start[b]; its
+ * terminator at block_end[b]. Parameters are defined at position 0.
+ *
+ * Each value gets one interval, from its definition to its last use,
+ * widened over every block it is live into or out of. PHIs also cover
+ * the terminators of their predecessors, where their copies are made.
+ */
+
+/* Where a value lives for its whole interval. */
+typedef enum RaLocKind {
+	/* No result, or a result nothing reads. */
+	RaLoc_NONE,
+	RaLoc_REG,
+	/* An 8-byte spill slot, numbered from 0. */
+	RaLoc_SLOT,
+	/* Recomputed at each use: CONST, GLOBAL and ALLOCA. */
+	RaLoc_REMAT,
+} RaLocKind;
+
+struct RaLoc {
+	u8 kind;
+	u8 reg;
+	u32 slot;
+};
+
+/**
+ * @brief A register file. Registers are small numbers (< 64) of the
+ * target's choosing, listed in order of preference. Values live across a
+ * call only get `callee_saved` registers.
+ */
+struct RaTarget {
+	const u8 *int_regs;
+	u32 nint;
+	const u8 *float_regs;
+	u32 nfloat;
+	u64 callee_saved;
+};
+
+struct RaFunc {
+	/* Per value. */
+	struct RaLoc *loc;
+	u32 *start;
+	u32 *end;
+	/* Per block. */
+	u32 *block_start;
+	u32 *block_end;
+
+	u32 nslots;
+	/* Bit per register handed out. */
+	u64 used_regs;
+
+	usize cap;
+	u32 *buf;
+
+	/* Liveness comes from cfg.h; kept here so its storage is reused. */
+	struct IrCfg cfg;
+	struct IrLiveness liveness;
+};
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+/**
+ * @brief Linear scan over `fn`: every value that needs one gets a
+ * register, or a spill slot when none is free; slots are reused once
+ * their value dies. CALL and ZERO count as calls.
+ * * `ra` may be reused across functions; its storage only grows.
+ */
+void ra_run(struct RaFunc *ra, const struct IrFunc *fn,
+	    const struct RaTarget *t);
+void ra_deinit(struct RaFunc *ra);
+
+/** @brief Whether `v`'s interval covers position `pos`. */
+static inline bool ra_live_at(const struct RaFunc *ra, IrValue v, u32 pos)
+{
+	return ra->loc[v].kind != RaLoc_NONE &&
+	       ra->loc[v].kind != RaLoc_REMAT && ra->start[v] <= pos &&
+	       pos <= ra->end[v];
+}
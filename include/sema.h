@@ -18,10 +18,22 @@
 #include <type.h>
 #include <ast.h>
 #include <std/map.h>
+#include <arena.h>
 #include <std/strings/intern.h>
 
 struct SemaSymbol;
 
+/* The value of a constant expression; `ty` is a scalar type. */
+struct SemaConst {
+	struct Type *ty;
+	union {
+		bool b;
+		i32 i;
+		f32 f;
+		f64 d;
+	};
+};
+
 defMap(symbol_t, struct SemaSymbol *, SymbolMap);
 
 struct SemaSymbol {
@@ -30,18 +42,55 @@ struct SemaSymbol {
 	bool is_const;
 	bool is_global;
 	int stack_offset;
+
+	/* A const scalar whose initializer is constant has this value. */
+	bool has_value;
+	struct SemaConst value;
+
+	/* Local binding of the same name this one hides while in scope. */
+	struct SemaSymbol *shadowed;
 };
 
 struct Scope {
 	struct Scope *parent;
+	struct Scope *global;
 
 	SymbolMap symbols;
+
+	/* Locals defined here, unbound again when the scope is left. */
+	SymbolVec locals;
+
+	/* Scope arena top before this scope; restored on leave. */
+	struct ArenaMark mark;
+};
+
+/**
+ * @brief Hooks that let a client observe and steer how globals are bound.
+ * * `on_define` sees every global defined and `on_use` every global a
+ * lookup resolves to. `reuse` may hand back an existing symbol for a name
+ * about to be defined, so references to it from elsewhere stay valid.
+ * `visible` hides globals that live in the global scope but are not in
+ * effect at the point being checked; hidden globals are neither found by
+ * lookups nor reported as redefinitions.
+ */
+struct SemaTracker {
+	void (*on_define)(struct SemaTracker *t, struct SemaSymbol *sym);
+	void (*on_use)(struct SemaTracker *t, struct SemaSymbol *sym);
+	struct SemaSymbol *(*reuse)(struct SemaTracker *t, symbol_t name);
+	bool (*visible)(struct SemaTracker *t, struct SemaSymbol *sym);
 };
 
 struct Sema {
 	struct Context *ctx;
 	struct Scope *curr_scope;
 	struct Type *curr_func_ret;
+	/* Loops enclosing the statement being checked. */
+	u32 loop_depth;
+
+	/* Incremental checking hooks (see incr.h), NULL when unused. */
+	struct SemaTracker *tracker;
+	/* Local symbols; globals always go to ctx->alc. */
+	allocer_t alc;
 };
 
 void sema_init(struct Sema *s, struct Context *ctx);
@@ -52,10 +101,37 @@ void sema_scope_leave(struct Sema *s);
 struct SemaSymbol *sema_define_var(struct Sema *s, symbol_t name,
 				   struct Type *ty, bool is_const);
 
-struct SemaSymbol *sema_lookup(struct Sema *s, symbol_t name);
+/* Builtins come back too, so the result is read-only. */
+const struct SemaSymbol *sema_lookup(struct Sema *s, symbol_t name);
 
 void sema_analyze_binary(struct Sema *s, struct NodeBinary *node);
 
 void sema_analyze_assign(struct Sema *s, struct NodeBinary *node);
 
 void sema_analyze_return(struct Sema *s, struct NodeUnary *node);
+
+void sema_analyze_unary(struct Sema *s, struct NodeUnary *node);
+
+/* Also types the subscript: the element type of the array indexed. */
+void sema_analyze_index(struct Sema *s, struct NodeBinary *node);
+
+/* Also types the call. `fn` is what its name resolved to, if anything. */
+void sema_analyze_call(struct Sema *s, struct NodeCall *node,
+		       const struct SemaSymbol *fn);
+
+void sema_analyze_cond(struct Sema *s, struct Node *cond);
+
+/* `break` and `continue`. */
+void sema_analyze_jump(struct Sema *s, struct Node *node);
+
+/* Checks the initializer, and gives a const scalar its value. */
+void sema_analyze_var_decl(struct Sema *s, struct NodeVarDecl *node);
+
+/**
+ * @brief Fold a constant expression: literals, const scalars with a value
+ * and operators on them. i32 arithmetic wraps; division by zero is not
+ * constant. A comparison with NaN folds like IEEE does: != to true, ==
+ * and the ordered comparisons to false.
+ * @return false if `n` is not constant.
+ */
+bool sema_const_eval(const struct Node *n, struct SemaConst *out);
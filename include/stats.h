@@ -0,0 +1,268 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <core/mem/allocer.h>
+#include <arena.h>
+#include <vmem.h>
+#include <stdio.h>
+
+/*
+ * ==========================================================================
+ * 1. Phases
+ * ==========================================================================
+ */
+
+/*
+ * X-Macro list of compiler phases, in pipeline order.
+ * X(ID, NAME)
+ */
+#define STATS_PHASES(X)             \
+	X(INIT, "init")             \
+	X(READ, "read")             \
+	X(LEX, "lex")               \
+	X(PARSE, "parse")           \
+	X(SEMA, "sema")             \
+	X(LOWER, "lower")           \
+	X(OPT, "opt")               \
+	X(EMIT, "emit")             \
+	X(RUN, "run")
+
+typedef enum StatsPhase {
+#define X(ID, NAME) StatsPhase_##ID,
+	STATS_PHASES(X)
+#undef X
+	StatsPhase_COUNT
+} StatsPhase;
+
+/*
+ * ==========================================================================
+ * 2. Types
+ * ==========================================================================
+ */
+
+struct PhaseStats {
+	/* Exclusive time: nested phases are not counted twice. */
+	double wall_us;
+	double cpu_us;
+	/* Minor page faults. */
+	u64 faults;
+
+	/* Arena bytes requested while the phase was innermost. */
+	u64 bytes;
+	u64 allocs;
+};
+
+/**
+ * @brief An optimization pass or analysis, summed over every function it
+ * ran on. Time is exclusive: analyses a pass asks for are charged to
+ * the analysis.
+ */
+struct PassStats {
+	const char *name;
+	bool analysis;
+
+	u64 runs;
+	/* Analyses only: requests the cache answered without running. */
+	u64 hits;
+	double wall_us;
+
+	/* Passes only: runs that changed the function, and instructions and
+	 * blocks in the function before and after each run. */
+	u64 changed;
+	u64 insts_before;
+	u64 insts_after;
+	u64 blocks_before;
+	u64 blocks_after;
+};
+
+#define STATS_MAX_PASSES 32
+
+/**
+ * @brief Allocator wrapper that counts what passes through it.
+ * * Requests are forwarded to `inner`; sizes are also attributed to the
+ * innermost running phase.
+ */
+struct CountingAlloc {
+	allocer_t inner;
+	/* Whether requests are also charged to the current phase. */
+	bool per_phase;
+
+	u64 total;
+	u64 allocs;
+	u64 live;
+	u64 peak;
+};
+
+/**
+ * @brief Process-wide compile statistics.
+ * * Counters are always maintained (they are plain increments). Timing and
+ * per-phase allocation accounting only run after stats_enable().
+ */
+struct Stats {
+	bool enabled;
+
+	struct PhaseStats phases[StatsPhase_COUNT];
+
+	/* Phase stack; the innermost phase is charged for elapsed time. */
+	StatsPhase stack[16];
+	usize depth;
+	double last_wall;
+	double last_cpu;
+	u64 last_faults;
+
+	/* Leaf phase entered through stats_leaf_begin, or StatsPhase_COUNT. */
+	StatsPhase leaf;
+	/* Sampling state (xorshift); random picks avoid aliasing with the
+	 * regular token/lookup pattern of generated code. */
+	u64 leaf_rng;
+	/* Cost of one clock read, subtracted from every sample. */
+	double clock_cost;
+
+	u64 tokens;
+	u64 nodes;
+	u64 types;
+	u64 symbols;
+	/* Highest interned symbol id seen, plus one. */
+	u64 strings;
+
+	/* Set by main when the arena is wrapped in counting allocators. */
+	struct CountingAlloc *arena;
+	struct CountingAlloc *arena_backing;
+	/* The Context's short-lived arenas. */
+	const struct Arena *scratch;
+	const struct Arena *scopes;
+	/* Reservation backing the long-lived arena, NULL with --arena=malloc. */
+	const struct VMem *vmem;
+	/* Streamed input only: bytes read and the largest text window held. */
+	u64 stream_read;
+	u64 stream_peak;
+
+	/* Optimizer passes and analyses, in order of first use. */
+	struct PassStats passes[STATS_MAX_PASSES];
+	u32 npasses;
+};
+
+extern struct Stats compile_stats;
+
+/*
+ * ==========================================================================
+ * 3. Public API
+ * ==========================================================================
+ */
+
+/**
+ * @brief Start timing; everything up to the first stats_push is "init".
+ */
+void stats_enable(void);
+
+void stats_push_slow(StatsPhase phase);
+void stats_pop_slow(void);
+
+/**
+ * @brief Enter a (possibly nested) phase. Free when stats are disabled.
+ */
+static inline void stats_push(StatsPhase phase)
+{
+	if (compile_stats.enabled)
+		stats_push_slow(phase);
+}
+
+static inline void stats_pop(void)
+{
+	if (compile_stats.enabled)
+		stats_pop_slow();
+}
+
+/*
+ * Leaf phases (lexing, semantic checks) are entered once per token or
+ * node, far too often to read the clock every time. Only one call in
+ * STATS_LEAF_SAMPLE is timed; its time, scaled up, is moved from the
+ * enclosing phase to the leaf.
+ */
+#define STATS_LEAF_SAMPLE 32 /* power of two */
+
+/*
+ * A sample longer than this was preempted or hit a page fault; scaling it
+ * up would swamp the estimate, so its time stays with the enclosing phase.
+ */
+#define STATS_LEAF_OUTLIER_US 20.0
+
+double stats_leaf_begin_slow(StatsPhase phase);
+void stats_leaf_end_slow(double start);
+
+/**
+ * @brief Enter a frequent leaf phase; pass the result to stats_leaf_end.
+ */
+static inline double stats_leaf_begin(StatsPhase phase)
+{
+	return compile_stats.enabled ? stats_leaf_begin_slow(phase) : 0;
+}
+
+static inline void stats_leaf_end(double start)
+{
+	if (compile_stats.enabled)
+		stats_leaf_end_slow(start);
+}
+
+static inline void stats_leaf_cleanup(double *start)
+{
+	stats_leaf_end(*start);
+}
+
+/**
+ * @brief Charge the rest of the enclosing block to a leaf phase.
+ */
+#define STATS_LEAF(phase)                                              \
+	double _stats_leaf __attribute__((cleanup(stats_leaf_cleanup))) = \
+		stats_leaf_begin(phase)
+
+/**
+ * @brief The entry of pass or analysis `name` (a string that outlives the
+ * stats), created on first use.
+ */
+struct PassStats *stats_pass(const char *name, bool analysis);
+
+/** @brief Monotonic wall clock, in microseconds. */
+double stats_now_us(void);
+
+/**
+ * @brief Stop the clock and charge the remaining time.
+ */
+void stats_finish(void);
+
+/**
+ * @brief Wrap `inner` so that every request is counted in `c`.
+ */
+allocer_t counting_allocer(struct CountingAlloc *c, allocer_t inner,
+			   bool per_phase);
+
+/**
+ * @brief Human-readable per-phase time table (like GCC's -ftime-report).
+ */
+void stats_print_time(FILE *out);
+
+/**
+ * @brief Human-readable memory usage and object counts.
+ */
+void stats_print_mem(FILE *out);
+
+/**
+ * @brief Everything above as one JSON object, for regression tracking.
+ */
+void stats_write_json(FILE *out, const char *input_file);
@@ -0,0 +1,94 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <core/mem/allocer.h>
+#include <std/fs/srcmanager.h>
+#include <std/strings/str.h>
+
+/*
+ * ==========================================================================
+ * 1. Types
+ * ==========================================================================
+ */
+
+/**
+ * @brief Source text read incrementally from a file descriptor.
+ * * Only a window of the input is kept in memory. The lexer asks for
+ * more with stream_fill when it reaches the end of the window, and the
+ * driver drops text it no longer needs with stream_release once a
+ * top-level item is complete. The window always starts at a line start,
+ * so diagnostics can still print the whole offending line.
+ *
+ * Offsets taken by the API are global span positions, as carried by
+ * tokens; `file_base` is where the stream's byte 0 sits in that space.
+ */
+struct Stream {
+	int fd;
+	const char *name;
+	allocer_t alc;
+	usize chunk;
+
+	char *buf;
+	usize len;
+	usize cap;
+
+	/* Stream offset of buf[0]. Only changes when the buffer is compacted. */
+	usize base;
+	/* First live byte in buf (a line start) and its 1-based line. */
+	usize head;
+	usize line;
+
+	usize file_base;
+	bool eof;
+
+	usize read;
+	usize peak;
+};
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+void stream_init(struct Stream *s, allocer_t alc, int fd, const char *name,
+		 usize chunk);
+void stream_deinit(struct Stream *s);
+
+/**
+ * @brief Append up to one chunk of input to the window.
+ * * May move `buf`; offsets into it stay valid.
+ * @return false once the input is exhausted.
+ */
+bool stream_fill(struct Stream *s);
+
+/**
+ * @brief Forget the text before the line containing `offset`.
+ * * The buffer is compacted only once the dead prefix outweighs the live
+ * text, so releasing after every item costs O(input) in total.
+ * @return How many bytes buf moved down by (0 if it was not compacted).
+ */
+usize stream_release(struct Stream *s, usize offset);
+
+/**
+ * @brief Resolve a span position to file/line/column and its line text.
+ * * Reads ahead to the end of the line if needed.
+ * @return false if `offset` has already been released.
+ */
+bool stream_lookup(struct Stream *s, usize offset, srcloc_t *loc, str_t *line);
@@ -0,0 +1,91 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+
+/*
+ * ==========================================================================
+ * 1. Scoped Events
+ * ==========================================================================
+ */
+
+/**
+ * @brief A running span, closed when it goes out of scope.
+ */
+struct TraceSpan {
+	const char *name;
+	const char *detail;
+	/* 0 when tracing was off at the start of the span. */
+	u64 start;
+};
+
+/* Runtime switch, set by trace_start. */
+extern bool trace_on;
+
+u64 trace_now(void);
+void trace_record(const char *name, const char *detail, u64 start, u64 end);
+
+static inline void trace_span_end(struct TraceSpan *s)
+{
+	if (s->start)
+		trace_record(s->name, s->detail, s->start, trace_now());
+}
+
+#define TRACE_CAT_(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT_(a, b)
+
+/*
+ * TRACE_SCOPE(name) records the rest of the enclosing block as one event.
+ * TRACE_SCOPE_ARG also attaches a string (e.g. a function name); it is only
+ * evaluated while tracing, must stay valid until the scope ends and is
+ * copied when the event is recorded. `name` must live until trace_write.
+ *
+ * Both compile to nothing unless CACT_TRACE is defined (`make TRACE=0`
+ * leaves it out). When compiled in but not started, a scope costs one
+ * predictable branch.
+ */
+#ifdef CACT_TRACE
+#define TRACE_SCOPE_ARG(name, detail)                                        \
+	__attribute__((cleanup(trace_span_end))) struct TraceSpan           \
+	TRACE_CAT(_trace_span_, __LINE__) = {                                \
+		(name), trace_on ? (detail) : NULL,                         \
+		trace_on ? trace_now() : 0                                  \
+	}
+#else
+#define TRACE_SCOPE_ARG(name, detail) ((void)0)
+#endif
+
+#define TRACE_SCOPE(name) TRACE_SCOPE_ARG(name, NULL)
+
+/*
+ * ==========================================================================
+ * 2. Collection
+ * ==========================================================================
+ */
+
+/**
+ * @brief Start recording. Every thread gets its own ring buffer of
+ * `capacity` events; once full, the oldest events are overwritten.
+ */
+void trace_start(usize capacity);
+
+/**
+ * @brief Write all recorded events in Chrome trace-event format, loadable
+ * in chrome://tracing or ui.perfetto.dev.
+ */
+bool trace_write(const char *path);
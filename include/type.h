@@ -47,14 +47,12 @@ struct Type {
 	} data;
 };
 
-extern struct Type *ty_void;
-extern struct Type *ty_bool;
-extern struct Type *ty_int;
-extern struct Type *ty_float;
-extern struct Type *ty_double;
-
-void types_init(allocer_t alc);
-void types_deinit(allocer_t alc);
+/* Statically allocated; shared by all compilations. */
+extern struct Type *const ty_void;
+extern struct Type *const ty_bool;
+extern struct Type *const ty_int;
+extern struct Type *const ty_float;
+extern struct Type *const ty_double;
 
 struct Type *type_array_of(allocer_t alc, struct Type *base, int len);
 struct Type *type_func_new(allocer_t alc, struct Type *ret);
@@ -0,0 +1,219 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <std/vec.h>
+#include <ir.h>
+#include <stdio.h>
+
+/*
+ * ==========================================================================
+ * 1. Bytecode
+ * ==========================================================================
+ * A register machine. Code is a stream of u32 words: an opcode followed
+ * by its operands. Register operands index the current frame; every
+ * frame starts with the parameters, then the function's constants, then
+ * the registers of its values. Opcodes are specialised by type, so the
+ * interpreter never looks at a type at run time. Booleans are i32 0 / 1
+ * in registers and one byte in memory.
+ */
+
+/**
+ * @brief Opcodes: X(ID, WORDS), WORDS counting the opcode itself.
+ * * a b c      registers; `t`/`f` code offsets; `k` immediates
+ * * ALLOCA     (a, k): a = frame storage + k
+ * * ZERO       (a, k): k bytes at a are cleared
+ * * INDEX      (a, b, c, k): a = b + c * k
+ * * INDEX_K    (a, b, k): a = b + k
+ * * DIV_I32, MOD_I32 (a, b, c, k): k names the function (VmProgram.names)
+ *              a division by zero is reported in
+ * * J<cmp>_I32 (b, c, t, f): compare and branch
+ * * JNZ        (c, t, f)
+ * * CALL       (a, func, n, args[n]); `a` is unused for void callees
+ * * builtins   print_*(a) / get_*(a) of the prelude
+ */
+#define VM_OPS(X)          \
+	X(MOV, 3)          \
+	X(ALLOCA, 3)       \
+	X(ZERO, 3)         \
+	X(INDEX, 5)        \
+	X(INDEX_K, 4)      \
+	X(LOAD_I8, 3)      \
+	X(LOAD_32, 3)      \
+	X(LOAD_64, 3)      \
+	X(STORE_I8, 3)     \
+	X(STORE_32, 3)     \
+	X(STORE_64, 3)     \
+	X(ADD_I32, 4)      \
+	X(SUB_I32, 4)      \
+	X(MUL_I32, 4)      \
+	X(DIV_I32, 5)      \
+	X(MOD_I32, 5)      \
+	X(ADD_F32, 4)      \
+	X(SUB_F32, 4)      \
+	X(MUL_F32, 4)      \
+	X(DIV_F32, 4)      \
+	X(ADD_F64, 4)      \
+	X(SUB_F64, 4)      \
+	X(MUL_F64, 4)      \
+	X(DIV_F64, 4)      \
+	X(NEG_I32, 3)      \
+	X(NEG_F32, 3)      \
+	X(NEG_F64, 3)      \
+	X(NOT, 3)          \
+	X(EQ_I32, 4)       \
+	X(NE_I32, 4)       \
+	X(LT_I32, 4)       \
+	X(LE_I32, 4)       \
+	X(GT_I32, 4)       \
+	X(GE_I32, 4)       \
+	X(EQ_F32, 4)       \
+	X(NE_F32, 4)       \
+	X(LT_F32, 4)       \
+	X(LE_F32, 4)       \
+	X(GT_F32, 4)       \
+	X(GE_F32, 4)       \
+	X(EQ_F64, 4)       \
+	X(NE_F64, 4)       \
+	X(LT_F64, 4)       \
+	X(LE_F64, 4)       \
+	X(GT_F64, 4)       \
+	X(GE_F64, 4)       \
+	X(EQ_PTR, 4)       \
+	X(NE_PTR, 4)       \
+	X(LT_PTR, 4)       \
+	X(LE_PTR, 4)       \
+	X(GT_PTR, 4)       \
+	X(GE_PTR, 4)       \
+	X(JMP, 2)          \
+	X(JNZ, 4)          \
+	X(JEQ_I32, 5)      \
+	X(JNE_I32, 5)      \
+	X(JLT_I32, 5)      \
+	X(JLE_I32, 5)      \
+	X(JGT_I32, 5)      \
+	X(JGE_I32, 5)      \
+	X(CALL, 4)         \
+	X(RET, 2)          \
+	X(RET_VOID, 1)     \
+	X(PRINT_INT, 2)    \
+	X(PRINT_FLOAT, 2)  \
+	X(PRINT_DOUBLE, 2) \
+	X(PRINT_BOOL, 2)   \
+	X(GET_INT, 2)      \
+	X(GET_FLOAT, 2)    \
+	X(GET_DOUBLE, 2)
+
+typedef enum VmOp {
+#define X(ID, WORDS) VmOp_##ID,
+	VM_OPS(X)
+#undef X
+	VmOp_COUNT
+} VmOp;
+
+union VmReg {
+	i32 i;
+	f32 f;
+	f64 d;
+	u8 *p;
+	u64 bits;
+};
+
+struct VmFunc {
+	const char *name;
+	/* Offset of the first instruction in VmProgram.code. */
+	u32 entry;
+	u32 nparams;
+	/* Registers [nparams, nparams + nconsts) start out as a copy of
+	 * VmProgram.consts[first_const ..]. */
+	u32 first_const;
+	u32 nconsts;
+	/* Frame size in registers, and bytes of ALLOCA storage (laid out
+	 * by ir_frame_layout). */
+	u32 nregs;
+	u32 frame_bytes;
+	/* Code offset of block b is VmProgram.block_at[first_block + b]. */
+	u32 first_block;
+	u32 nblocks;
+	/* Register holding IR value v for the whole call (parameters and
+	 * values live across blocks), or UINT32_MAX: VmProgram.value_reg
+	 * [first_value + v]. Lets the JIT enter a running frame. */
+	u32 first_value;
+	bool is_void;
+};
+
+defVec(u32, VmCodeVec);
+defVec(struct VmFunc, VmFuncVec);
+defVec(union VmReg, VmRegVec);
+
+/**
+ * @brief An executable program. Globals live in `globals`, which
+ * constants holding their addresses point into.
+ */
+struct VmProgram {
+	VmCodeVec code;
+	VmFuncVec funcs;
+	VmRegVec consts;
+	VmCodeVec block_at;
+	VmCodeVec value_reg;
+	u8 *globals;
+	usize globals_size;
+	/* Address of each global in `globals`. */
+	u8 **global_at;
+	usize nglobals;
+	/* Index of `main` in funcs. */
+	u32 main;
+	/* IrModule.names of the module compiled, which must outlive it. */
+	const char *const *names;
+};
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+/**
+ * @brief Translates a verified module. Functions are numbered as in the
+ * module; the prelude's builtins become their dedicated opcodes.
+ * @return false if the module has no `main`.
+ */
+bool vm_compile(struct VmProgram *p, const struct IrModule *m);
+void vm_program_deinit(struct VmProgram *p);
+
+/* How vm_run uses the JIT (jit.h). */
+typedef enum VmJit {
+	/* Interpret everything. */
+	VmJit_OFF,
+	/* Compile functions and loops once they run often. */
+	VmJit_TIERED,
+	/* Compile every function before it first runs. */
+	VmJit_EAGER,
+} VmJit;
+
+/**
+ * @brief Runs `main` with the builtins on stdin / stdout.
+ * * `m` is the module `p` was compiled from; the JIT compiles from it.
+ * Where there is no JIT for the host, everything is interpreted.
+ * * Division by zero and call stacks deeper than the VM's stacks stop the
+ * program with a message on `err`.
+ * @return false on such a runtime error; otherwise `*status` is the value
+ * `main` returned.
+ */
+bool vm_run(const struct VmProgram *p, const struct IrModule *m, VmJit jit,
+	    i32 *status, FILE *err);
@@ -0,0 +1,79 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <core/mem/allocer.h>
+
+/*
+ * ==========================================================================
+ * 1. Types
+ * ==========================================================================
+ */
+
+typedef enum VMemPages {
+	/* Regular pages, with transparent huge pages requested (MADV_HUGEPAGE). */
+	VMemPages_TRANSPARENT,
+	/* Explicit huge pages (MAP_HUGETLB); falls back to transparent ones. */
+	VMemPages_HUGETLB,
+} VMemPages;
+
+/**
+ * @brief One big reservation of address space, handed out front to back.
+ * * The whole range is reserved up front without backing memory and is
+ * committed in 2 MiB steps as allocation reaches it, so a generous
+ * reservation costs nothing until used. Being contiguous and 2 MiB aligned,
+ * it can be backed by huge pages, which cuts page faults and TLB misses on
+ * large inputs. Requests that no longer fit go to `fallback`.
+ *
+ * Meant as the backing allocator of an arena: individual frees are no-ops
+ * except for the most recent block, memory returns at vmem_deinit.
+ */
+struct VMem {
+	u8 *base;
+	usize reserved;
+	usize committed;
+	usize used;
+	/* Offset of the most recent block, for in-place growth. */
+	usize last;
+
+	bool hugetlb;
+	allocer_t fallback;
+};
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+/**
+ * @brief A reservation size suited to compiling `input_bytes` of source.
+ */
+usize vmem_size_for_input(u64 input_bytes);
+
+/**
+ * @brief Reserve `size` bytes of address space.
+ * @return false if the reservation failed; the VMem then forwards
+ * everything to `fallback`.
+ */
+bool vmem_init(struct VMem *v, usize size, VMemPages pages,
+	       allocer_t fallback);
+
+void vmem_deinit(struct VMem *v);
+
+allocer_t vmem_allocer(struct VMem *v);
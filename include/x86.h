@@ -0,0 +1,392 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <core/type.h>
+#include <std/vec.h>
+#include <stdio.h>
+
+/*
+ * ==========================================================================
+ * 1. Machine Instructions
+ * ==========================================================================
+ * x86-64 code is produced as a list of X86Inst, close to one machine
+ * instruction each, then encoded to bytes. Jumps name local labels;
+ * references to functions, globals and runtime helpers name symbols,
+ * which the encoder leaves as relocations for its user to resolve.
+ */
+
+typedef enum X86Reg {
+	X86_RAX,
+	X86_RCX,
+	X86_RDX,
+	X86_RBX,
+	X86_RSP,
+	X86_RBP,
+	X86_RSI,
+	X86_RDI,
+	X86_R8,
+	X86_R9,
+	X86_R10,
+	X86_R11,
+	X86_R12,
+	X86_R13,
+	X86_R14,
+	X86_R15,
+	X86_XMM0,
+	X86_XMM15 = X86_XMM0 + 15,
+	/* Base of a memory operand relative to the next instruction. */
+	X86_RIP,
+	X86_NOREG = 0xff,
+} X86Reg;
+
+#define X86_IS_XMM(r) ((r) >= X86_XMM0 && (r) <= X86_XMM15)
+
+/* Condition codes, numbered as in the Jcc / SETcc encodings. */
+typedef enum X86Cond {
+	X86_CC_O,
+	X86_CC_NO,
+	X86_CC_B,
+	X86_CC_AE,
+	X86_CC_E,
+	X86_CC_NE,
+	X86_CC_BE,
+	X86_CC_A,
+	X86_CC_S,
+	X86_CC_NS,
+	X86_CC_P,
+	X86_CC_NP,
+	X86_CC_L,
+	X86_CC_GE,
+	X86_CC_LE,
+	X86_CC_G,
+} X86Cond;
+
+/**
+ * @brief Opcodes: X(ID, MNEMONIC). Integer instructions take their
+ * operand size from X86Inst.size (1, 4 or 8 bytes), which completes the
+ * AT&T mnemonic (movl, movzbl); SSE instructions name it (SS: f32, SD:
+ * f64).
+ * * MOVZX8     r32 <- r/m8
+ * * MOVSXD     r64 <- r/m32
+ * * IMUL       r <- r * r/m, or r <- r * imm
+ * * MOVD       between a general register and an XMM register; size 4
+ *              or 8 (MOVQ)
+ * * LABEL      defines operand 0's label; emits nothing
+ */
+#define X86_OPS(X)                     \
+	X(MOV, "mov")                  \
+	X(MOVZX8, "movzb")             \
+	X(MOVSXD, "movsl")             \
+	X(LEA, "lea")                  \
+	X(ADD, "add")                  \
+	X(SUB, "sub")                  \
+	X(AND, "and")                  \
+	X(OR, "or")                    \
+	X(XOR, "xor")                  \
+	X(CMP, "cmp")                  \
+	X(TEST, "test")                \
+	X(IMUL, "imul")                \
+	X(IDIV, "idiv")                \
+	X(NEG, "neg")                  \
+	X(CDQ, "cltd")                 \
+	X(SETCC, "set")                \
+	X(JMP, "jmp")                  \
+	X(JCC, "j")                    \
+	X(CALL, "call")                \
+	X(RET, "ret")                  \
+	X(PUSH, "push")                \
+	X(POP, "pop")                  \
+	X(REP_STOSB, "rep stosb")      \
+	X(MOVSS, "movss")              \
+	X(MOVSD, "movsd")              \
+	X(MOVAPS, "movaps")            \
+	X(ADDSS, "addss")              \
+	X(SUBSS, "subss")              \
+	X(MULSS, "mulss")              \
+	X(DIVSS, "divss")              \
+	X(ADDSD, "addsd")              \
+	X(SUBSD, "subsd")              \
+	X(MULSD, "mulsd")              \
+	X(DIVSD, "divsd")              \
+	X(UCOMISS, "ucomiss")          \
+	X(UCOMISD, "ucomisd")          \
+	X(XORPS, "xorps")              \
+	X(MOVD, "movd")                \
+	X(LABEL, "")
+
+typedef enum X86Op {
+#define X(ID, MNEMONIC) X86_##ID,
+	X86_OPS(X)
+#undef X
+	X86Op_COUNT
+} X86Op;
+
+/**
+ * @brief What a symbol names; resolved by whoever places the code.
+ * * FUNC: a function of the IR module; GLOBAL: a global; RUNTIME: a
+ *   helper outside the program (X86_RT_*); VAR: a variable of the code's
+ *   host (the JIT's X86_VAR_*).
+ */
+typedef enum X86SymKind {
+	X86Sym_FUNC,
+	X86Sym_GLOBAL,
+	X86Sym_RUNTIME,
+	X86Sym_VAR,
+} X86SymKind;
+
+struct X86Sym {
+	u8 kind;
+	/* Refers to a pointer-sized slot holding the symbol's address
+	 * (a GOT entry) rather than to the symbol itself. */
+	bool indirect;
+	u32 index;
+};
+
+typedef enum X86OperandKind {
+	X86Opnd_NONE,
+	X86Opnd_REG,
+	X86Opnd_IMM,
+	/* [base + index * scale + disp], or [rip + sym + disp]. */
+	X86Opnd_MEM,
+	/* A branch target: a label, or a symbol (direct call / jump). */
+	X86Opnd_LABEL,
+	X86Opnd_SYM,
+} X86OperandKind;
+
+struct X86Operand {
+	u8 kind;
+	u8 reg;
+	/* MEM: index register (or X86_NOREG) and scale 1, 2, 4 or 8. */
+	u8 index;
+	u8 scale;
+	union {
+		i64 imm;
+		i32 disp;
+		u32 label;
+	};
+	struct X86Sym sym;
+};
+
+struct X86Inst {
+	u8 op;
+	u8 size;
+	/* Condition of JCC and SETCC. */
+	u8 cond;
+	struct X86Operand dst;
+	struct X86Operand src;
+};
+
+defVec(struct X86Inst, X86InstVec);
+
+static inline struct X86Operand x86_reg(X86Reg r)
+{
+	return (struct X86Operand){ .kind = X86Opnd_REG, .reg = (u8)r };
+}
+
+static inline struct X86Operand x86_imm(i64 v)
+{
+	return (struct X86Operand){ .kind = X86Opnd_IMM, .imm = v };
+}
+
+static inline struct X86Operand x86_mem(X86Reg base, i32 disp)
+{
+	return (struct X86Operand){ .kind = X86Opnd_MEM,
+				    .reg = (u8)base,
+				    .index = X86_NOREG,
+				    .scale = 1,
+				    .disp = disp };
+}
+
+static inline struct X86Operand x86_mem_index(X86Reg base, X86Reg index,
+					      u8 scale, i32 disp)
+{
+	return (struct X86Operand){ .kind = X86Opnd_MEM,
+				    .reg = (u8)base,
+				    .index = (u8)index,
+				    .scale = scale,
+				    .disp = disp };
+}
+
+/* [rip + sym], or the GOT-style slot of `sym` when `indirect`. */
+static inline struct X86Operand x86_mem_sym(struct X86Sym sym)
+{
+	return (struct X86Operand){ .kind = X86Opnd_MEM,
+				    .reg = X86_RIP,
+				    .index = X86_NOREG,
+				    .scale = 1,
+				    .sym = sym };
+}
+
+static inline struct X86Operand x86_label(u32 label)
+{
+	return (struct X86Operand){ .kind = X86Opnd_LABEL, .label = label };
+}
+
+static inline struct X86Operand x86_sym(struct X86Sym sym)
+{
+	return (struct X86Operand){ .kind = X86Opnd_SYM, .sym = sym };
+}
+
+/* Runtime helpers a program's code may call. */
+#define X86_RUNTIME(X)                \
+	X(PRINT_INT, "print_int")     \
+	X(PRINT_FLOAT, "print_float") \
+	X(PRINT_DOUBLE, "print_double") \
+	X(PRINT_BOOL, "print_bool")   \
+	X(GET_INT, "get_int")         \
+	X(GET_FLOAT, "get_float")     \
+	X(GET_DOUBLE, "get_double")   \
+	X(DIV_ZERO, "__cact_div_zero") \
+	X(OVERFLOW, "__cact_overflow")
+
+typedef enum X86Runtime {
+#define X(ID, NAME) X86_RT_##ID,
+	X86_RUNTIME(X)
+#undef X
+	X86_RT_COUNT
+} X86Runtime;
+
+/*
+ * ==========================================================================
+ * 2. Encoding
+ * ==========================================================================
+ */
+
+/* A 32-bit field at `at` to set to S + addend - P, P being `at`. */
+struct X86Reloc {
+	u32 at;
+	i32 addend;
+	struct X86Sym sym;
+};
+
+defVec(u8, X86ByteVec);
+defVec(struct X86Reloc, X86RelocVec);
+
+/**
+ * @brief Machine code of one function or stub. Offsets are relative to
+ * the start of `bytes`.
+ */
+struct X86Code {
+	X86ByteVec bytes;
+	X86RelocVec relocs;
+};
+
+void x86_code_init(struct X86Code *c);
+void x86_code_deinit(struct X86Code *c);
+
+/**
+ * @brief Appends the encoding of `insts` to `c`. Jumps may only name
+ * labels the list defines; `label_at` receives the offset of each.
+ * @return false if an instruction has no encoding (a bug in its maker).
+ */
+bool x86_encode(struct X86Code *c, const struct X86Inst *insts, u32 n,
+		u32 *label_at);
+
+/*
+ * ==========================================================================
+ * 3. Code Generation
+ * ==========================================================================
+ * IR functions become System V functions: i1, i32 and pointers travel in
+ * general registers, f32 and f64 in SSE registers, extra arguments on the
+ * stack. Values get their locations from a linear scan (regalloc.h).
+ *
+ * Block b is label b; higher labels are local to the generator.
+ */
+
+typedef enum X86Mode {
+	/* Code for an object file: ALLOCAs on the machine stack, direct
+	 * calls and rip-relative globals. */
+	X86Mode_AOT,
+	/* Code for the JIT: ALLOCAs in the VM's memory stack (based in
+	 * r15), calls and globals through slots, stack checks on entry,
+	 * and entries from the interpreter at loop headers. */
+	X86Mode_JIT,
+} X86Mode;
+
+/* Variables of the JIT that its code reads (X86Sym_VAR). AOT code only
+ * reads STACK_LIMIT, which the runtime defines. */
+typedef enum X86Var {
+	/* Lowest machine stack pointer allowed. */
+	X86_VAR_STACK_LIMIT,
+	/* Top and end of the VM's memory stack. */
+	X86_VAR_MEM_TOP,
+	X86_VAR_MEM_END,
+	X86_VAR_COUNT
+} X86Var;
+
+struct X86Gen {
+	const struct IrModule *m;
+	X86Mode mode;
+
+	/* JIT: where an entry at a loop header finds each value in the
+	 * register array it is passed, or UINT32_MAX. Set per function. */
+	const u32 *osr_slots;
+
+	/* Output of x86_gen_func. */
+	X86InstVec insts;
+	u32 nlabels;
+	/* JIT, per block: the label of its entry, or 0. Such an entry is
+	 * called as f(regs, mem), mem being the frame's ALLOCA storage. */
+	u32 *osr_label;
+
+	/* Private. */
+	void *impl;
+};
+
+void x86_gen_init(struct X86Gen *g, const struct IrModule *m, X86Mode mode);
+void x86_gen_deinit(struct X86Gen *g);
+
+/**
+ * @brief Generates function `func` of the module (not an extern). AOT
+ * also fills in the stack_offset of every local that keeps its ALLOCA.
+ */
+void x86_gen_func(struct X86Gen *g, u32 func);
+
+/*
+ * ==========================================================================
+ * 4. Assembly
+ * ==========================================================================
+ * A module as GNU assembler input (AT&T syntax), to be linked with the
+ * runtime (runtime/cactrt.c). The program's `main` is its only global
+ * symbol besides `__cact_func_names`, the table of function names by
+ * IrFunc.id that runtime errors are reported with; every other name is
+ * local, so a program's own `printf` does not replace the C library's.
+ */
+
+/**
+ * @brief Writes the assembly of `m` to `out`, filling in the
+ * stack_offset of every local that keeps its ALLOCA.
+ * @return false on a write error.
+ */
+bool x86_write_asm(FILE *out, const struct IrModule *m);
+
+/*
+ * ==========================================================================
+ * 5. Object Files
+ * ==========================================================================
+ * The same module as an ELF64 relocatable object, encoded in process: no
+ * assembler runs. Symbols, sections and behaviour match the assembly;
+ * globals without initializer bytes take no room in the file (.bss).
+ */
+
+/**
+ * @brief Writes `m` to `out` as an ELF object, filling in stack_offset
+ * as x86_write_asm does.
+ * @return false on a write error, or if an instruction does not encode.
+ */
+bool x86_write_elf(FILE *out, const struct IrModule *m);
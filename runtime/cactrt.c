@@ -0,0 +1,104 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * The runtime of native CACT programs (`cactc -o`, `--emit=c`): the
+ * builtins, and the runtime errors the generated code jumps to (cactrt.h).
+ * Its behaviour matches the VM's (src/vm.c) line for line, so a program
+ * prints the same output and exits with the same status however it is run.
+ */
+
+#include "cactrt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+/* Bytes of machine stack kept free below the limit for the error path. */
+#define STACK_MARGIN ((uintptr_t)256 << 10)
+
+/* Used where the stack size is unlimited. */
+#define STACK_DEFAULT ((uintptr_t)64 << 20)
+
+uintptr_t __cact_stack_limit;
+
+__attribute__((constructor)) static void init_stack_limit(void)
+{
+	struct rlimit rl;
+	uintptr_t size = STACK_DEFAULT;
+	if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+		size = (uintptr_t)rl.rlim_cur;
+	uintptr_t sp = (uintptr_t)__builtin_frame_address(0);
+	__cact_stack_limit = size + STACK_MARGIN < sp
+				     ? sp - size + STACK_MARGIN
+				     : 0;
+}
+
+void print_int(int32_t v)
+{
+	printf("%d\n", v);
+}
+
+void print_float(float v)
+{
+	printf("%f\n", (double)v);
+}
+
+void print_double(double v)
+{
+	printf("%f\n", v);
+}
+
+void print_bool(bool v)
+{
+	fputs(v ? "true\n" : "false\n", stdout);
+}
+
+int32_t get_int(void)
+{
+	int32_t v;
+	return scanf("%d", &v) == 1 ? v : 0;
+}
+
+float get_float(void)
+{
+	float v;
+	return scanf("%f", &v) == 1 ? v : 0;
+}
+
+double get_double(void)
+{
+	double v;
+	return scanf("%lf", &v) == 1 ? v : 0;
+}
+
+CACT_NORETURN static void stop(const char *what, uint32_t func)
+{
+	fflush(stdout);
+	fprintf(stderr, "Runtime error: %s in '%s'\n", what,
+		__cact_func_names[func]);
+	exit(1);
+}
+
+void __cact_div_zero(uint32_t func)
+{
+	stop("division by zero", func);
+}
+
+void __cact_overflow(uint32_t func)
+{
+	stop("stack overflow", func);
+}
@@ -0,0 +1,116 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * The interface of the runtime (libcactrt.a), and what the C written by
+ * `cactc --emit=c` needs besides: CACT's int arithmetic wraps and its
+ * division checks for zero, which plain C operators do not promise.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if __STDC_VERSION__ >= 202311L
+#define CACT_NORETURN [[noreturn]]
+#elif __STDC_VERSION__ >= 201112L
+#define CACT_NORETURN _Noreturn
+#else
+#define CACT_NORETURN
+#endif
+
+/*
+ * ==========================================================================
+ * 1. Builtins
+ * ==========================================================================
+ */
+
+void print_int(int32_t v);
+void print_float(float v);
+void print_double(double v);
+void print_bool(bool v);
+
+/* Input that does not parse reads as zero. */
+int32_t get_int(void);
+float get_float(void);
+double get_double(void);
+
+/*
+ * ==========================================================================
+ * 2. Runtime Errors
+ * ==========================================================================
+ * Both print "Runtime error: ... in '<function>'" and exit with status 1,
+ * as the VM does.
+ */
+
+/* Names of the program's functions, by index; the program defines it. */
+extern const char *const __cact_func_names[];
+
+/* Lowest stack pointer a function may start with; checked on entry. */
+extern uintptr_t __cact_stack_limit;
+
+CACT_NORETURN void __cact_div_zero(uint32_t func);
+CACT_NORETURN void __cact_overflow(uint32_t func);
+
+/*
+ * ==========================================================================
+ * 3. Generated C
+ * ==========================================================================
+ */
+
+/* First statement of every function; `func` indexes __cact_func_names. */
+#define CACT_ENTER(func)                                    \
+	do {                                                \
+		char cact_sp;                               \
+		if ((uintptr_t)&cact_sp < __cact_stack_limit) \
+			__cact_overflow(func);              \
+	} while (0)
+
+static inline int32_t cact_add(int32_t a, int32_t b)
+{
+	return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static inline int32_t cact_sub(int32_t a, int32_t b)
+{
+	return (int32_t)((uint32_t)a - (uint32_t)b);
+}
+
+static inline int32_t cact_mul(int32_t a, int32_t b)
+{
+	return (int32_t)((uint32_t)a * (uint32_t)b);
+}
+
+static inline int32_t cact_neg(int32_t a)
+{
+	return (int32_t)(0u - (uint32_t)a);
+}
+
+/* INT32_MIN / -1 wraps instead of trapping. */
+static inline int32_t cact_div(int32_t a, int32_t b, uint32_t func)
+{
+	if (b == 0)
+		__cact_div_zero(func);
+	return b == -1 ? cact_neg(a) : a / b;
+}
+
+static inline int32_t cact_mod(int32_t a, int32_t b, uint32_t func)
+{
+	if (b == 0)
+		__cact_div_zero(func);
+	return b == -1 ? 0 : a % b;
+}
@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+#
+#    Copyright 2025 Karesis
+#
+#    Licensed under the Apache License, Version 2.0 (the "License");
+#    you may not use this file except in compliance with the License.
+#    You may obtain a copy of the License at
+#
+#        http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS,
+#    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#    See the License for the specific language governing permissions and
+#    limitations under the License.
+#
+"""Throughput benchmarks for cactc on generated corpora.
+
+For every corpus kind (see gen_corpus.py) this measures lexer, parser,
+sema and end-to-end throughput plus peak RSS, then compares the numbers
+with a stored baseline. A throughput more than --tolerance below the
+baseline, or an RSS more than --tolerance above it, is a regression and
+makes the script exit with status 1.
+
+Phase times come from --stats-json; end-to-end time and RSS from separate
+uninstrumented runs. Each number is the best of --runs runs.
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+GEN = os.path.join(ROOT, "scripts", "gen_corpus.py")
+
+KINDS = ["mixed", "functions", "nesting", "exprs", "arrays", "inits",
+         "comments"]
+
+# metric -> True if higher is better
+METRICS = {
+    "lex_mbps": True,
+    "lex_mtokps": True,
+    "parse_mbps": True,
+    "sema_mbps": True,
+    "lower_mbps": True,
+    "e2e_mbps": True,
+    "e2e_mtokps": True,
+    "rss_mb": False,
+}
+
+
+class Colors:
+    OKGREEN = '\033[92m'
+    WARNING = '\033[93m'
+    FAIL = '\033[91m'
+    ENDC = '\033[0m'
+
+
+def corpus(kind, size, seed, cache_dir):
+    """Generate (or reuse) the corpus for one kind."""
+    os.makedirs(cache_dir, exist_ok=True)
+    path = os.path.join(cache_dir, f"{kind}-{size}-s{seed}.cact")
+    if (not os.path.exists(path) or
+            os.path.getmtime(path) < os.path.getmtime(GEN)):
+        subprocess.run([sys.executable, GEN, f"--kind={kind}",
+                        f"--size={size}", f"--seed={seed}", "-o", path],
+                       check=True)
+    return path
+
+
+def run_plain(compiler, path):
+    """Wall seconds and peak RSS (MiB) of one uninstrumented compile."""
+    start = time.perf_counter()
+    proc = subprocess.Popen([compiler, path], stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.perf_counter() - start
+    if os.waitstatus_to_exitcode(status) != 0:
+        sys.exit(f"error: {compiler} failed on {path}")
+    # ru_maxrss is in KiB on Linux.
+    return wall, usage.ru_maxrss / 1024.0
+
+
+def run_stats(compiler, path):
+    """Per-phase seconds and the token count from --stats-json."""
+    with tempfile.NamedTemporaryFile(suffix=".json") as tmp:
+        subprocess.run([compiler, f"--stats-json={tmp.name}", path],
+                       stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                       check=True)
+        stats = json.load(open(tmp.name))
+    phases = {p["name"]: p["wall_us"] / 1e6 for p in stats["phases"]}
+    return phases, stats["counts"]["tokens"]
+
+
+def measure(compiler, path, runs):
+    size_mb = os.path.getsize(path) / (1 << 20)
+    best = {}
+
+    def keep(metric, value, higher_better):
+        old = best.get(metric)
+        if old is None or (value > old if higher_better else value < old):
+            best[metric] = value
+
+    for _ in range(runs):
+        wall, rss = run_plain(compiler, path)
+        phases, tokens = run_stats(compiler, path)
+        mtok = tokens / 1e6
+        # Guard against phases too short to register on tiny inputs.
+        lex = max(phases.get("lex", 0), 1e-9)
+        parse = max(phases.get("parse", 0), 1e-9)
+        sema = max(phases.get("sema", 0), 1e-9)
+        lower = max(phases.get("lower", 0), 1e-9)
+
+        keep("lex_mbps", size_mb / lex, True)
+        keep("lex_mtokps", mtok / lex, True)
+        keep("parse_mbps", size_mb / parse, True)
+        keep("sema_mbps", size_mb / sema, True)
+        keep("lower_mbps", size_mb / lower, True)
+        keep("e2e_mbps", size_mb / wall, True)
+        keep("e2e_mtokps", mtok / wall, True)
+        keep("rss_mb", rss, False)
+    return best
+
+
+def compare(results, baseline, tolerance):
+    """Print the table; return the list of regressions."""
+    regressions = []
+    header = f"{'corpus':<10}" + "".join(f"{m:>16}" for m in METRICS)
+    print(header)
+    print("-" * len(header))
+    for kind, res in results.items():
+        base = baseline.get(kind, {})
+        row = f"{kind:<10}"
+        for metric, higher_better in METRICS.items():
+            value = res[metric]
+            cell = f"{value:.1f}"
+            bad = False
+            if metric in base and base[metric] > 0:
+                delta = value / base[metric] - 1
+                cell += f" ({delta * 100:+.0f}%)"
+                bad = (-delta if higher_better else delta) > tolerance
+                if bad:
+                    regressions.append((kind, metric, base[metric], value))
+            cell = f"{cell:>16}"
+            row += f"{Colors.FAIL}{cell}{Colors.ENDC}" if bad else cell
+        print(row)
+    return regressions
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--compiler", default=os.path.join(ROOT, "build", "bin",
+                                                       "cactc"))
+    ap.add_argument("--kinds", default=",".join(KINDS),
+                    help="comma-separated corpus kinds")
+    ap.add_argument("--size", default="4M", help="corpus size, e.g. 4M")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--runs", type=int, default=5)
+    ap.add_argument("--tolerance", type=float, default=0.10,
+                    help="allowed relative slowdown (default: 0.10)")
+    ap.add_argument("--baseline", default=os.path.join(ROOT, "tests",
+                                                       "bench",
+                                                       "baseline.json"))
+    ap.add_argument("--corpus-dir", default=os.path.join(ROOT, "build",
+                                                         "bench"))
+    ap.add_argument("--update", action="store_true",
+                    help="store this run as the new baseline")
+    args = ap.parse_args()
+
+    if not os.path.isfile(args.compiler):
+        print(f"{Colors.FAIL}Error: Compiler not found at "
+              f"{args.compiler}{Colors.ENDC}")
+        print("Please run 'make' first.")
+        sys.exit(1)
+
+    results = {}
+    for kind in args.kinds.split(","):
+        path = corpus(kind, args.size, args.seed, args.corpus_dir)
+        results[kind] = measure(args.compiler, path, args.runs)
+
+    config = {"size": args.size, "seed": args.seed}
+    baseline = {}
+    if os.path.exists(args.baseline) and not args.update:
+        stored = json.load(open(args.baseline))
+        if stored.get("config") == config:
+            baseline = stored["results"]
+        else:
+            print(f"{Colors.WARNING}Baseline was taken with "
+                  f"{stored.get('config')}, not {config}; not comparing."
+                  f"{Colors.ENDC}")
+
+    regressions = compare(results, baseline, args.tolerance)
+
+    if args.update or not os.path.exists(args.baseline):
+        os.makedirs(os.path.dirname(args.baseline), exist_ok=True)
+        with open(args.baseline, "w") as f:
+            json.dump({"config": config, "results": results}, f, indent=2)
+            f.write("\n")
+        print(f"\nBaseline written to {os.path.relpath(args.baseline)}")
+        return
+
+    if regressions:
+        print(f"\n{Colors.FAIL}{len(regressions)} regression(s) beyond "
+              f"{args.tolerance * 100:.0f}%:{Colors.ENDC}")
+        for kind, metric, base, value in regressions:
+            print(f"  {kind}/{metric}: {base:.1f} -> {value:.1f}")
+        sys.exit(1)
+    print(f"\n{Colors.OKGREEN}No regressions beyond "
+          f"{args.tolerance * 100:.0f}%.{Colors.ENDC}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+#    Copyright 2025 Karesis
+#
+#    Licensed under the Apache License, Version 2.0 (the "License");
+#    you may not use this file except in compliance with the License.
+#    You may obtain a copy of the License at
+#
+#        http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS,
+#    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#    See the License for the specific language governing permissions and
+#    limitations under the License.
+#
+"""Execution benchmarks for `cactc --run` on compute-heavy programs.
+
+Every tests/bench/run/NAME.cact is run with --run and its stdout checked
+against NAME.out; a mismatch fails the script. The best wall time of
+--runs runs and the time spent in the VM alone (the "run" phase of
+--stats-json) are compared with a stored baseline, and a slowdown of more
+than --tolerance is a regression that makes the script exit with status 1.
+"""
+import argparse
+import glob
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# metric -> True if higher is better
+METRICS = {
+    "wall_ms": False,
+    "vm_ms": False,
+}
+
+
+class Colors:
+    OKGREEN = '\033[92m'
+    WARNING = '\033[93m'
+    FAIL = '\033[91m'
+    ENDC = '\033[0m'
+
+
+def run_once(compiler, path, expected):
+    """Wall and VM milliseconds of one run; exits on wrong output."""
+    with tempfile.NamedTemporaryFile(suffix=".json") as tmp:
+        start = time.perf_counter()
+        proc = subprocess.run([compiler, "--run", f"--stats-json={tmp.name}",
+                               path], stdout=subprocess.PIPE,
+                              stderr=subprocess.DEVNULL,
+                              stdin=subprocess.DEVNULL)
+        wall = time.perf_counter() - start
+        stats = json.load(open(tmp.name))
+    if proc.returncode != 0 or proc.stdout.decode() != expected:
+        sys.exit(f"error: wrong result for {os.path.relpath(path)} "
+                 f"(status {proc.returncode})")
+    phases = {p["name"]: p["wall_us"] / 1e3 for p in stats["phases"]}
+    return wall * 1e3, phases.get("run", 0.0)
+
+
+def measure(compiler, path, runs):
+    expected = open(os.path.splitext(path)[0] + ".out").read()
+    best = {}
+    for _ in range(runs):
+        wall, vm = run_once(compiler, path, expected)
+        best["wall_ms"] = min(best.get("wall_ms", wall), wall)
+        best["vm_ms"] = min(best.get("vm_ms", vm), vm)
+    return best
+
+
+def compare(results, baseline, tolerance):
+    """Print the table; return the list of regressions."""
+    regressions = []
+    header = f"{'program':<10}" + "".join(f"{m:>16}" for m in METRICS)
+    print(header)
+    print("-" * len(header))
+    for name, res in results.items():
+        base = baseline.get(name, {})
+        row = f"{name:<10}"
+        for metric, higher_better in METRICS.items():
+            value = res[metric]
+            cell = f"{value:.1f}"
+            bad = False
+            if metric in base and base[metric] > 0:
+                delta = value / base[metric] - 1
+                cell += f" ({delta * 100:+.0f}%)"
+                bad = (-delta if higher_better else delta) > tolerance
+                if bad:
+                    regressions.append((name, metric, base[metric], value))
+            cell = f"{cell:>16}"
+            row += f"{Colors.FAIL}{cell}{Colors.ENDC}" if bad else cell
+        print(row)
+    return regressions
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--compiler", default=os.path.join(ROOT, "build", "bin",
+                                                       "cactc"))
+    ap.add_argument("--programs", default="",
+                    help="comma-separated program names (default: all)")
+    ap.add_argument("--runs", type=int, default=5)
+    ap.add_argument("--tolerance", type=float, default=0.10,
+                    help="allowed relative slowdown (default: 0.10)")
+    ap.add_argument("--dir", default=os.path.join(ROOT, "tests", "bench",
+                                                  "run"))
+    ap.add_argument("--baseline", default=os.path.join(ROOT, "tests",
+                                                       "bench",
+                                                       "run_baseline.json"))
+    ap.add_argument("--update", action="store_true",
+                    help="store this run as the new baseline")
+    args = ap.parse_args()
+
+    if not os.path.isfile(args.compiler):
+        print(f"{Colors.FAIL}Error: Compiler not found at "
+              f"{args.compiler}{Colors.ENDC}")
+        print("Please run 'make' first.")
+        sys.exit(1)
+
+    paths = sorted(glob.glob(os.path.join(args.dir, "*.cact")))
+    if args.programs:
+        wanted = args.programs.split(",")
+        paths = [p for p in paths
+                 if os.path.splitext(os.path.basename(p))[0] in wanted]
+
+    results = {}
+    for path in paths:
+        name = os.path.splitext(os.path.basename(path))[0]
+        results[name] = measure(args.compiler, path, args.runs)
+
+    baseline = {}
+    if os.path.exists(args.baseline) and not args.update:
+        baseline = json.load(open(args.baseline))["results"]
+
+    regressions = compare(results, baseline, args.tolerance)
+
+    if args.update or not os.path.exists(args.baseline):
+        os.makedirs(os.path.dirname(args.baseline), exist_ok=True)
+        with open(args.baseline, "w") as f:
+            json.dump({"results": results}, f, indent=2)
+            f.write("\n")
+        print(f"\nBaseline written to {os.path.relpath(args.baseline)}")
+        return
+
+    if regressions:
+        print(f"\n{Colors.FAIL}{len(regressions)} regression(s) beyond "
+              f"{args.tolerance * 100:.0f}%:{Colors.ENDC}")
+        for name, metric, base, value in regressions:
+            print(f"  {name}/{metric}: {base:.1f} -> {value:.1f}")
+        sys.exit(1)
+    print(f"\n{Colors.OKGREEN}No regressions beyond "
+          f"{args.tolerance * 100:.0f}%.{Colors.ENDC}")
+
+
+if __name__ == "__main__":
+    main()
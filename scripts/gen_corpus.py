@@ -0,0 +1,326 @@
+#!/usr/bin/env python3
+#
+#    Copyright 2025 Karesis
+#
+#    Licensed under the Apache License, Version 2.0 (the "License");
+#    you may not use this file except in compliance with the License.
+#    You may obtain a copy of the License at
+#
+#        http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS,
+#    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#    See the License for the specific language governing permissions and
+#    limitations under the License.
+#
+"""Generate large, valid CACT programs for benchmarking.
+
+The output only depends on --kind, --size and --seed, so a corpus can be
+regenerated anywhere instead of being checked in. Every program passes
+semantic analysis, and it terminates when run: functions only call
+functions defined before them, and every loop counts up to a small bound.
+
+    python3 scripts/gen_corpus.py --kind=mixed --size=4M -o big.cact
+"""
+import argparse
+import random
+import sys
+
+KINDS = ["mixed", "functions", "nesting", "exprs", "arrays", "inits",
+         "comments", "cfg"]
+
+TYPES = ["int", "float", "double", "bool"]
+NUMERIC = ["int", "float", "double"]
+
+WORDS = ("the value is kept in range by the loop below and checked again "
+         "after every call so that later passes can rely on it").split()
+
+
+def parse_size(text):
+    units = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+    if text[-1].upper() in units:
+        return int(float(text[:-1]) * units[text[-1].upper()])
+    return int(text)
+
+
+class Func:
+    def __init__(self, name, ret, params):
+        self.name = name
+        self.ret = ret
+        self.params = params  # [(type, name)]
+
+
+class Gen:
+    def __init__(self, kind, seed):
+        self.kind = kind
+        self.rng = random.Random(seed)
+        self.out = []
+        self.size = 0
+        self.globals = []  # [(type, name, dims)]
+        self.funcs = []
+        self.counter = 0
+
+    # --- Output ---------------------------------------------------------
+
+    def emit(self, text):
+        self.out.append(text)
+        self.size += len(text)
+
+    def fresh(self, prefix):
+        self.counter += 1
+        return f"{prefix}{self.counter}"
+
+    def want(self, kind):
+        """Whether a feature is in play for this corpus kind."""
+        return self.kind == kind or self.kind == "mixed"
+
+    # --- Expressions ----------------------------------------------------
+
+    def literal(self, ty):
+        r = self.rng
+        if ty == "int":
+            return str(r.randint(0, 999))
+        if ty == "float":
+            return f"{r.randint(0, 99)}.{r.randint(0, 99)}f"
+        if ty == "double":
+            return f"{r.randint(0, 999)}.{r.randint(0, 999)}"
+        return r.choice(["true", "false"])
+
+    def leaf(self, ty, scope):
+        r = self.rng
+        names = [n for t, n in scope if t == ty]
+        arrays = [(n, d) for t, n, d in self.globals if t == ty and d]
+        pick = r.random()
+        if arrays and pick < 0.15:
+            name, dims = r.choice(arrays)
+            return name + "".join(f"[{r.randrange(d)}]" for d in dims)
+        if names and pick < 0.7:
+            return r.choice(names)
+        return self.literal(ty)
+
+    def call(self, ty, scope, depth):
+        cands = [f for f in self.funcs if f.ret == ty]
+        if not cands:
+            return None
+        f = self.rng.choice(cands[-16:])
+        args = ", ".join(self.expr(t, scope, depth + 1) for t, _ in f.params)
+        return f"{f.name}({args})"
+
+    def expr(self, ty, scope, depth=0, terms=None):
+        r = self.rng
+        if terms is None:
+            terms = r.randint(1, 4)
+        if depth > 3 or terms <= 1:
+            if depth < 3 and r.random() < 0.08:
+                c = self.call(ty, scope, depth)
+                if c:
+                    return c
+            return self.leaf(ty, scope)
+
+        if ty == "bool":
+            if r.random() < 0.5:
+                op = r.choice(["&&", "||"])
+                return (f"({self.expr('bool', scope, depth + 1, terms - 1)}"
+                        f" {op} {self.expr('bool', scope, depth + 1, 1)})")
+            t = r.choice(NUMERIC)
+            op = r.choice(["<", "<=", ">", ">=", "==", "!="])
+            return (f"{self.expr(t, scope, depth + 1, terms // 2)} {op} "
+                    f"{self.expr(t, scope, depth + 1, terms - terms // 2)}")
+
+        ops = ["+", "-", "*"]
+        parts = [self.expr(ty, scope, depth + 1, 1)]
+        for _ in range(terms - 1):
+            op = r.choice(ops)
+            rhs = self.expr(ty, scope, depth + 1, 1)
+            if r.random() < 0.1:
+                # Division only by a non-zero constant keeps runs defined.
+                op, rhs = "/", str(r.randint(1, 9)) if ty == "int" else \
+                    self.literal(ty).replace("0.", "1.")
+            parts.append(f"{op} {rhs}")
+        text = " ".join(parts)
+        return f"({text})" if depth > 0 else text
+
+    def long_expr(self, ty, scope):
+        return self.expr(ty, scope, 0, self.rng.randint(40, 200))
+
+    # --- Statements -----------------------------------------------------
+
+    def comment(self, indent):
+        r = self.rng
+        words = " ".join(r.choice(WORDS) for _ in range(r.randint(4, 14)))
+        if r.random() < 0.5:
+            return f"{indent}// {words}\n"
+        lines = "\n".join(f"{indent} * " +
+                          " ".join(r.choice(WORDS) for _ in range(10))
+                          for _ in range(r.randint(1, 4)))
+        return f"{indent}/*\n{lines}\n{indent} */\n"
+
+    def block(self, scope, ret, indent, depth, budget):
+        r = self.rng
+        scope = list(scope)
+        lines = []
+        # Deep corpora nest exactly once per block: a spine of depth
+        # max_depth rather than a tree that grows exponentially.
+        deep = self.kind == "nesting"
+        max_depth = 24 if deep else 4
+        spine = r.randrange(budget) if deep and depth < max_depth else -1
+        for k in range(budget):
+            if self.want("comments") and r.random() < (
+                    0.6 if self.kind == "comments" else 0.15):
+                lines.append(self.comment(indent))
+
+            control = 0.5 if self.kind == "cfg" else 0.2
+            if k == spine or (not deep and depth < max_depth and
+                              r.random() < control):
+                lines.append(self.control(scope, ret, indent, depth))
+                continue
+
+            pick = r.random()
+            if pick < 0.45:
+                ty = r.choice(TYPES)
+                name = self.fresh("v")
+                init = (self.long_expr(ty, scope)
+                        if self.want("exprs") and r.random() < 0.2
+                        else self.expr(ty, scope))
+                lines.append(f"{indent}{ty} {name} = {init};\n")
+                scope.append((ty, name))
+            elif pick < 0.75 and any(n[0] != "i" for _, n in scope):
+                # Loop counters ("i..") are only ever incremented.
+                ty, name = r.choice([v for v in scope if v[1][0] != "i"])
+                lines.append(f"{indent}{name} = {self.expr(ty, scope)};\n")
+            else:
+                arrs = [g for g in self.globals if g[2]]
+                if arrs:
+                    ty, name, dims = r.choice(arrs)
+                    idx = "".join(f"[{r.randrange(d)}]" for d in dims)
+                    lines.append(f"{indent}{name}{idx} = "
+                                 f"{self.expr(ty, scope)};\n")
+        return "".join(lines)
+
+    def control(self, scope, ret, indent, depth):
+        r = self.rng
+        inner = indent + "\t"
+        budget = r.randint(1, 5)
+        if r.random() < 0.5:
+            cond = self.expr("bool", scope)
+            body = self.block(scope, ret, inner, depth + 1, budget)
+            text = f"{indent}if ({cond}) {{\n{body}{indent}}}"
+            if r.random() < 0.4:
+                # Only the then-branch carries the spine on.
+                other = self.block(scope, ret, inner,
+                                   99 if self.kind == "nesting" else depth + 1,
+                                   budget)
+                text += f" else {{\n{other}{indent}}}"
+            return text + "\n"
+
+        i = self.fresh("i")
+        body = self.block(scope + [("int", i)], ret, inner, depth + 1,
+                          budget)
+        extra = ""
+        if r.random() < 0.2:
+            extra = (f"{inner}if ({i} == {r.randint(1, 5)}) {{\n"
+                     f"{inner}\t{r.choice(['break', 'continue'])};\n"
+                     f"{inner}}}\n")
+        # The increment comes first so that `continue` cannot spin.
+        return (f"{indent}int {i} = 0;\n"
+                f"{indent}while ({i} < {r.randint(2, 8)}) {{\n"
+                f"{inner}{i} = {i} + 1;\n{extra}{body}{indent}}}\n")
+
+    # --- Top-level items ------------------------------------------------
+
+    def init_list(self, ty, dims, flat):
+        r = self.rng
+        if flat or len(dims) == 1:
+            n = 1
+            for d in dims:
+                n *= d
+            vals = [self.literal(ty) for _ in range(r.randint(n // 2, n))]
+            rows = [", ".join(vals[i:i + 12]) for i in range(0, len(vals), 12)]
+            return "{" + ",\n\t".join(rows) + "}"
+        return "{" + ", ".join(self.init_list(ty, dims[1:], False)
+                               for _ in range(dims[0])) + "}"
+
+    def global_decl(self):
+        r = self.rng
+        ty = r.choice(TYPES)
+        name = self.fresh("g")
+        dims = []
+        if self.want("arrays") or self.want("inits"):
+            if r.random() < 0.6:
+                big = self.kind == "inits"
+                dims = [r.randint(2, 64 if big else 8)
+                        for _ in range(r.randint(1, 3))]
+        if dims:
+            decl = f"{ty} {name}" + "".join(f"[{d}]" for d in dims)
+            if r.random() < (0.9 if self.kind == "inits" else 0.5):
+                decl += " = " + self.init_list(ty, dims, r.random() < 0.3)
+            self.emit(decl + ";\n")
+        else:
+            const = "const " if r.random() < 0.3 else ""
+            self.emit(f"{const}{ty} {name} = {self.literal(ty)};\n")
+        self.globals.append((ty, name, dims))
+
+    def function(self, size=0):
+        """A function; for --kind=cfg, one that fills `size` by itself."""
+        r = self.rng
+        ret = r.choice(TYPES + ["void"])
+        params = [(r.choice(TYPES), self.fresh("p"))
+                  for _ in range(r.randint(0, 4))]
+        name = self.fresh("f")
+        sig = ", ".join(f"{t} {n}" for t, n in params)
+
+        if self.want("comments") and r.random() < 0.5:
+            self.emit(self.comment(""))
+        budget = r.randint(2, 6) if self.kind == "functions" else \
+            r.randint(4, 14)
+        body = self.block(params, ret, "\t", 0, budget)
+        if self.kind == "cfg":
+            chunks = [body]
+            grown = len(body)
+            while self.size + grown < size:
+                chunks.append(self.block(params, ret, "\t", 0, 16))
+                grown += len(chunks[-1])
+            body = "".join(chunks)
+        tail = "" if ret == "void" else \
+            f"\treturn {self.expr(ret, params)};\n"
+        self.emit(f"{ret} {name}({sig})\n{{\n{body}{tail}}}\n\n")
+        self.funcs.append(Func(name, ret, params))
+
+    def run(self, size):
+        r = self.rng
+        if self.kind == "cfg":
+            for _ in range(8):
+                self.global_decl()
+            self.function(size)
+        while self.size < size:
+            if r.random() < (0.5 if self.want("inits") else 0.25):
+                self.global_decl()
+            else:
+                self.function()
+
+        calls = [f for f in self.funcs if not f.params][-8:]
+        body = "".join(f"\t{f.name}();\n" for f in calls)
+        self.emit(f"int main()\n{{\n{body}\treturn 0;\n}}\n")
+        return "".join(self.out)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--kind", choices=KINDS, default="mixed")
+    ap.add_argument("--size", default="1M",
+                    help="approximate output size, e.g. 512K or 8M")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("-o", "--output", default="-")
+    args = ap.parse_args()
+
+    text = Gen(args.kind, args.seed).run(parse_size(args.size))
+    if args.output == "-":
+        sys.stdout.write(text)
+    else:
+        with open(args.output, "w") as f:
+            f.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,476 @@
+#!/usr/bin/env python3
+#
+#    Copyright 2025 Karesis
+#
+#    Licensed under the Apache License, Version 2.0 (the "License");
+#    you may not use this file except in compliance with the License.
+#    You may obtain a copy of the License at
+#
+#        http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS,
+#    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#    See the License for the specific language governing permissions and
+#    limitations under the License.
+#
+"""Driver tests: the compiler's modes besides code generation.
+
+Every check runs cactc as a user would, in a fresh temporary directory,
+and reports what it found different from what the mode promises:
+
+  cache  --cache-dir answers a repeated compilation from the cache with
+         the same output and code, and misses when the source, the
+         flags or the compiler binary change; past --cache-size the
+         least recently used entries go first.
+  ast    --load-ast of what --emit-ast saved reports what the compilation
+         did; corrupted files are rejected with an error, never a crash.
+  stream A program read from stdin compiles as it does from a file, even
+         where a token or an error straddles two chunks of input.
+  serve  After every edit --serve reports errors exactly when compiling
+         the edited text does, and dumps the same AST summary.
+  trace  --trace writes valid Chrome trace JSON whose details name the
+         program's functions, also once the module that held them is gone.
+"""
+import argparse
+import glob
+import json
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+class Colors:
+    OKGREEN = '\033[92m'
+    WARNING = '\033[93m'
+    FAIL = '\033[91m'
+    ENDC = '\033[0m'
+
+
+CHECKS = {}
+
+
+def check(fn):
+    CHECKS[fn.__name__.removeprefix("check_")] = fn
+    return fn
+
+
+def run(cmd, stdin=b""):
+    proc = subprocess.run(cmd, input=stdin, stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE, timeout=120)
+    return proc.returncode, proc.stdout, proc.stderr
+
+
+def write(tmp, name, text):
+    path = os.path.join(tmp, name)
+    with open(path, "w") as f:
+        f.write(text)
+    return path
+
+
+# --- cache ----------------------------------------------------------------
+
+
+def entries(cache):
+    """Entry name -> inode; a store renames a new file into place."""
+    return {name: os.stat(os.path.join(cache, name)).st_ino
+            for name in os.listdir(cache) if name.endswith(".cce")}
+
+
+def wide(n, tag):
+    """A program whose AST summary, the cached output, is about 17n bytes."""
+    return "".join(f"int {tag}{k};\n" for k in range(n)) + \
+        "int main() { return 0; }\n"
+
+
+@check
+def check_cache(compiler, tmp):
+    problems = []
+    cache = os.path.join(tmp, "cache")
+    flag = f"--cache-dir={cache}"
+    good = write(tmp, "good.cact", "int main() { return 1 + 2; }\n")
+    bad = write(tmp, "bad.cact", "int main() { return x; }\n")
+
+    for path in (good, bad):
+        first = run([compiler, flag, path])
+        before = entries(cache)
+        again = run([compiler, flag, path])
+        if again != first:
+            problems.append(f"{os.path.basename(path)}: the cached result "
+                            "differs from the compiled one")
+        if entries(cache) != before:
+            problems.append(f"{os.path.basename(path)}: a repeated "
+                            "compilation missed the cache")
+    if run([compiler, good])[0] != 0 or run([compiler, bad])[0] == 0:
+        problems.append("the exit status is not the uncached one")
+
+    before = entries(cache)
+    run([compiler, flag, "--emit-ir=-", good])
+    if len(entries(cache)) != len(before) + 1:
+        problems.append("another flag hit the cache")
+
+    # Code is stored with the messages and written again on a hit.
+    dest = os.path.join(tmp, "code")
+    for mode in (["-S"], ["--emit=c"], ["-c", "-o", dest], ["-o", dest]):
+        name = " ".join(m for m in mode if m != dest)
+        uncached = run([compiler] + mode + [good])
+        if uncached[0] != 0:
+            if mode != ["-o", dest]:
+                problems.append(f"{name}: compiling failed")
+            continue
+        code = open(dest, "rb").read() if dest in mode else None
+        for attempt in ("stored", "cached"):
+            before = entries(cache)
+            if dest in mode:
+                os.remove(dest)
+            result = run([compiler, flag] + mode + [good])
+            if result != uncached or \
+                    (code and open(dest, "rb").read() != code):
+                problems.append(f"{name}: the {attempt} result differs "
+                                "from the uncached one")
+            stored = set(entries(cache)) - set(before)
+            if attempt == "stored" and len(stored) != 1:
+                problems.append(f"{name}: the compilation was not stored")
+            if attempt == "cached" and entries(cache) != before:
+                problems.append(f"{name}: a repeated compilation missed "
+                                "the cache")
+        if mode == ["-o", dest] and run([dest])[0] != 3:
+            problems.append("-o: the cached executable does not run")
+
+    # Trailing bytes leave an ELF executable runnable.
+    rebuilt = os.path.join(tmp, "cactc")
+    shutil.copy(compiler, rebuilt)
+    with open(rebuilt, "ab") as f:
+        f.write(b"\0")
+    before = entries(cache)
+    run([rebuilt, flag, good])
+    if len(entries(cache)) != len(before) + 1:
+        problems.append("a changed compiler binary hit the cache")
+
+    for size in ("abc", "-5", "0", "1x"):
+        if run([compiler, flag, f"--cache-size={size}", good])[0] == 0:
+            problems.append(f"--cache-size={size} was accepted")
+
+    # Three ~400 KiB entries in 1 MiB: B goes, as A was used after it.
+    small = os.path.join(tmp, "small")
+    flags = [f"--cache-dir={small}", "--cache-size=1"]
+    names = {}
+    for tag in "abac":
+        path = write(tmp, f"{tag}.cact", wide(24000, tag))
+        before = set(entries(small)) if os.path.isdir(small) else set()
+        run([compiler] + flags + [path])
+        for name in set(entries(small)) - before:
+            names[tag] = name
+    left = set(entries(small))
+    if len(names) != 3 or left != {names["a"], names["c"]}:
+        kept = sorted(t for t, n in names.items() if n in left)
+        problems.append(f"eviction kept {kept}, expected ['a', 'c']")
+    return problems
+
+
+# --- ast ------------------------------------------------------------------
+
+CORRUPTIONS = 300
+
+
+def summary(stdout):
+    """The top-level node lines both modes print."""
+    lines = stdout.decode().splitlines()
+    return [l for l in lines if l.startswith(("[INFO] Parsed", "  - "))]
+
+
+def corrupt(data, rng):
+    data = bytearray(data)
+    how = rng.randrange(4)
+    if how == 0:
+        return bytes(data[:rng.randrange(len(data))])
+    if how == 1:
+        return bytes(data) + bytes(rng.randrange(256)
+                                   for _ in range(rng.randrange(1, 64)))
+    # Header fields, or anywhere.
+    end = 104 if how == 2 else len(data)
+    for _ in range(rng.randrange(1, 9)):
+        data[rng.randrange(end)] = rng.randrange(256)
+    return bytes(data)
+
+
+@check
+def check_ast(compiler, tmp):
+    problems = []
+    saved = []
+    for path in sorted(glob.glob(os.path.join(ROOT, "tests", "samples",
+                                              "*_true_*.cact")) +
+                       glob.glob(os.path.join(ROOT, "tests", "bench", "run",
+                                              "*.cact"))):
+        name = os.path.basename(path)
+        if "false" in name:
+            continue
+        ast = os.path.join(tmp, name + ".ast")
+        compiled = run([compiler, f"--emit-ast={ast}", path])
+        loaded = run([compiler, f"--load-ast={ast}"])
+        if loaded[0] != 0 or summary(loaded[1]) != summary(compiled[1]):
+            problems.append(f"{name}: the loaded AST differs")
+        saved.append(ast)
+
+    rng = random.Random(1)
+    bad = os.path.join(tmp, "bad.ast")
+    for i in range(CORRUPTIONS):
+        with open(rng.choice(saved), "rb") as f:
+            data = corrupt(f.read(), rng)
+        with open(bad, "wb") as f:
+            f.write(data)
+        status, _, err = run([compiler, f"--load-ast={bad}"])
+        if status == 0:
+            continue
+        if status != 1 or b"Invalid AST file" not in err:
+            problems.append(f"corruption {i}: exit status {status}")
+    return problems
+
+
+# --- stream ---------------------------------------------------------------
+
+# The size of the reads main.c makes of streamed input.
+CHUNK = 64 << 10
+
+
+def around_chunk(line, at):
+    """A program whose `line` starts `at` bytes past the first chunk."""
+    head = "int main() {\n\tint value_straddling_the_chunk = 1;\n"
+    pad = CHUNK + at - len(head) - 1
+    body = "\t" + " " * (pad - pad // 64) + "\n" * (pad // 64)
+    return head + body + line + "\n\treturn 0;\n}\n"
+
+
+@check
+def check_stream(compiler, tmp):
+    problems = []
+    paths = sorted(glob.glob(os.path.join(ROOT, "tests", "samples",
+                                          "*.cact")) +
+                   glob.glob(os.path.join(ROOT, "tests", "bench", "run",
+                                          "*.cact")))
+    for at in range(-4, 5):
+        for kind, line in (("token", "\tvalue_straddling_the_chunk = 2;"),
+                           ("error", "\tundefined_name = 2;"),
+                           ("lexical", "\tint x = 0x;")):
+            paths.append(write(tmp, f"{kind}{at + 4}.cact",
+                               around_chunk(line, at)))
+    corpus = os.path.join(tmp, "corpus.cact")
+    subprocess.run([sys.executable, os.path.join(ROOT, "scripts",
+                                                 "gen_corpus.py"),
+                    "--kind=mixed", "--size=1M", "-o", corpus], check=True)
+    paths.append(corpus)
+
+    for path in paths:
+        with open(path, "rb") as f:
+            source = f.read()
+        status, out, err = run([compiler, "-"], source)
+        name = path.encode()
+        streamed = (status, out.replace(b"<stdin>", name),
+                    err.replace(b"<stdin>", name))
+        if streamed != run([compiler, path]):
+            problems.append(f"{os.path.basename(path)}: stdin and file "
+                            "differ")
+    return problems
+
+
+# --- serve ----------------------------------------------------------------
+
+EDITS = 400
+
+# Each is valid alone, or breaks a rule only sema or only the parser knows.
+SNIPPETS = [
+    "x", "1", "}", " ", ";", "(", "/* c */", "return 0;", "int q = 3;\n",
+    "int g0 = 2;\n", "const int g0 = 3;\n", "const int g0 = 0;\n",
+    "float g0 = 1.0f;\n", "bool g0 = true;\n", "int f5;\n",
+    "int f5(int a, int b) { return a; }\n", "int f5(int a) { return a; }\n",
+    "int u() { return f5(1, 2); }\n", "int u() { return f5(1); }\n",
+    "int u() { return f5(1.0f, 2); }\n", "int k = 1 / g0;\n",
+    "int v() { if (1) return 1; return 0; }\n",
+    "bool w() { return true < false; }\n",
+    "int s[2] = {1, 2, 3};\n", "void z() { break; }\n",
+]
+
+
+def document(funcs):
+    text = ["const int g0 = 1;\n"]
+    for i in range(funcs):
+        text.append(f"int f{i}(int a, int b)\n{{\n\tint x = a;\n"
+                    f"\twhile (x < b) {{ x = x + {i % 7 + 1}; }}\n"
+                    f"\treturn x + g0;\n}}\n\n")
+        if i:
+            text.append(f"int h{i}() {{ return f{i - 1}(1, 2) + "
+                        f"f{i}(3, 4); }}\n")
+    return "".join(text) + "int k = 4 / g0;\nint main() { return h1(); }\n"
+
+
+def boundaries(text):
+    """Offsets of lines that start outside every brace."""
+    depth, found = 0, [0]
+    for i, c in enumerate(text):
+        depth += {"{": 1, "}": -1}.get(c, 0)
+        if c == "\n" and depth == 0:
+            found.append(i + 1)
+    return found
+
+
+@check
+def check_serve(compiler, tmp):
+    problems = []
+    rng = random.Random(1)
+    text = document(20)
+    path = write(tmp, "doc.cact", text)
+    serve = subprocess.Popen([compiler, "--serve", path],
+                             stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                             stderr=subprocess.DEVNULL)
+
+    def ask(command):
+        serve.stdin.write(command)
+        serve.stdin.flush()
+        return serve.stdout.readline().decode()
+
+    serve.stdout.readline()
+    undo = []
+    for i in range(EDITS):
+        undoing = bool(undo) and rng.random() < 0.7
+        if undoing:
+            # Take most broken edits back, or errors would pile up.
+            start, end, new = undo.pop()
+        else:
+            new = rng.choice(SNIPPETS) if rng.random() < 0.8 else ""
+            if new.endswith("\n") and rng.random() < 0.5:
+                # A whole item between two others: may stay valid.
+                start = end = rng.choice(boundaries(text))
+            else:
+                start = rng.randrange(len(text) + 1)
+                end = min(len(text),
+                          start + rng.choice([0, 0, 1, 3, 10]))
+        data = new.encode()
+        answer = ask(f"edit {start} {end} {len(data)}\n".encode() + data)
+        inverse = (start, start + len(new), text[start:end])
+        text = text[:start] + new + text[end:]
+        got = re.search(r"errors=(\d)", answer)
+        if not got:
+            problems.append(f"edit {i}: no answer, {answer!r}")
+            break
+
+        status, out, _ = run([compiler, write(tmp, "full.cact", text)])
+        if status == 0:
+            undo.clear()
+        elif not undoing:
+            undo.append(inverse)
+        if (got.group(1) == "1") != (status != 0):
+            problems.append(f"edit {i}: serve reports errors="
+                            f"{got.group(1)}, compiling exits {status}")
+        elif status == 0:
+            head = ask(b"dump\n")
+            count = int(re.search(r"Parsed (\d+)", head).group(1))
+            dumped = [head] + [serve.stdout.readline().decode()
+                               for _ in range(count)]
+            if summary("".join(dumped).encode()) != summary(out):
+                problems.append(f"edit {i}: the dumped AST differs")
+    serve.stdin.write(b"quit\n")
+    serve.stdin.close()
+    serve.wait()
+    return problems
+
+
+# --- trace ----------------------------------------------------------------
+
+TRACED = """int dv(int a, int b) { return a / b; }
+
+int main()
+{
+\tint i = 0;
+\tint s = 0;
+\twhile (i < 3) {
+\t\ts = s + dv(10, i + 1);
+\t\ti = i + 1;
+\t}
+\tprint_int(s);
+\treturn 0;
+}
+"""
+
+TRACE_MODES = [
+    ["-O0"], ["-O2"], ["-O0", "--run", "--jit=off"],
+    ["-O0", "--run", "--jit=eager"], ["-O2", "--run", "--jit=eager"],
+    ["-O2", "-S", "-o", "out.s"],
+]
+
+
+@check
+def check_trace(compiler, tmp):
+    problems = []
+    path = write(tmp, "dv.cact", TRACED)
+    known = {path, "dv", "main"}
+    for mode in TRACE_MODES:
+        name = " ".join(mode)
+        trace = os.path.join(tmp, "trace.json")
+        mode = [os.path.join(tmp, a) if a == "out.s" else a for a in mode]
+        traced = run([compiler, f"--trace={trace}"] + mode + [path])
+        if b"built without tracing" in traced[2]:
+            return problems
+        if traced[:2] != run([compiler] + mode + [path])[:2]:
+            problems.append(f"{name}: tracing changed the result")
+        try:
+            with open(trace) as f:
+                events = json.load(f)["traceEvents"]
+        except (OSError, ValueError, KeyError) as e:
+            problems.append(f"{name}: no valid trace, {e}")
+            continue
+        if not any(e.get("args") for e in events):
+            problems.append(f"{name}: no event has a detail")
+        for e in events:
+            detail = e.get("args", {}).get("detail")
+            if e["dur"] < 0 or (detail is not None and detail not in known):
+                problems.append(f"{name}: bad event {e}")
+                break
+    return problems
+
+
+# --- Main -----------------------------------------------------------------
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--compiler", default=os.path.join(ROOT, "build", "bin",
+                                                       "cactc"))
+    ap.add_argument("--checks", default=",".join(CHECKS),
+                    help="comma-separated check names")
+    args = ap.parse_args()
+
+    if not os.path.isfile(args.compiler):
+        print(f"{Colors.FAIL}Error: Compiler not found at "
+              f"{args.compiler}{Colors.ENDC}")
+        print("Please run 'make' first.")
+        sys.exit(1)
+
+    compiler = os.path.abspath(args.compiler)
+    failed = 0
+    names = args.checks.split(",")
+    for name in names:
+        with tempfile.TemporaryDirectory() as tmp:
+            problems = CHECKS[name](compiler, tmp)
+        if not problems:
+            print(f"{Colors.OKGREEN}[PASS]{Colors.ENDC} {name}")
+            continue
+        failed += 1
+        print(f"{Colors.FAIL}[FAIL]{Colors.ENDC} {name}")
+        for why in problems:
+            print(f"    {Colors.WARNING}{why}{Colors.ENDC}")
+
+    if failed:
+        print(f"\n{Colors.FAIL}{failed} of {len(names)} checks failed."
+              f"{Colors.ENDC}")
+        sys.exit(1)
+    print(f"\n{Colors.OKGREEN}All {len(names)} checks passed.{Colors.ENDC}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#
+#    Copyright 2025 Karesis
+#
+#    Licensed under the Apache License, Version 2.0 (the "License");
+#    you may not use this file except in compliance with the License.
+#    You may obtain a copy of the License at
+#
+#        http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS,
+#    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#    See the License for the specific language governing permissions and
+#    limitations under the License.
+#
+"""Native backend tests: `cactc -o` must agree with `cactc --run`.
+
+Every valid sample in tests/samples and every program in tests/bench/run
+and tests/native is compiled to an executable four times: through the
+object writer (`-o`), through the assembly (`-S`, assembled and linked by
+cc), through C (`--emit=c`, compiled by cc -O2 against runtime/cactrt.h)
+and through the object writer again after `-O2 -fverify-each`. All are
+run on the same input as the VM (the `.in` file next to it, or nothing),
+as is the VM itself at `-O2` with every function compiled by the JIT;
+their stdout, runtime error and exit status must match. Where a `.out`
+file is next to the program, the VM's stdout must also be its contents.
+"""
+import argparse
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+class Colors:
+    OKGREEN = '\033[92m'
+    WARNING = '\033[93m'
+    FAIL = '\033[91m'
+    ENDC = '\033[0m'
+
+
+def programs():
+    samples = sorted(glob.glob(os.path.join(ROOT, "tests", "samples",
+                                            "*.cact")))
+    samples = [p for p in samples if "true" in os.path.basename(p)
+               and "false" not in os.path.basename(p)]
+    bench = sorted(glob.glob(os.path.join(ROOT, "tests", "bench", "run",
+                                          "*.cact")))
+    native = sorted(glob.glob(os.path.join(ROOT, "tests", "native",
+                                           "*.cact")))
+    return samples + bench + native
+
+
+def run(cmd, stdin):
+    proc = subprocess.run(cmd, input=stdin, stdout=subprocess.PIPE,
+                          stderr=subprocess.PIPE, timeout=60)
+    errors = [l for l in proc.stderr.decode().splitlines()
+              if l.startswith("Runtime error")]
+    return proc.returncode, proc.stdout.decode(), errors
+
+
+def build(compiler, path, tmpdir, how):
+    """Compiles `path` to an executable; its path, or an error."""
+    exe = os.path.join(tmpdir, "prog")
+    runtime = os.path.join(os.path.dirname(os.path.dirname(
+        os.path.abspath(compiler))), "lib", "libcactrt.a")
+    if how == "assembly":
+        asm = os.path.join(tmpdir, "prog.s")
+        cmds = [[compiler, "-S", "-o", asm, path],
+                ["cc", "-o", exe, asm, runtime]]
+    elif how == "C":
+        src = os.path.join(tmpdir, "prog.c")
+        cmds = [[compiler, "--emit=c", "-o", src, path],
+                ["cc", "-O2", "-I", os.path.join(ROOT, "runtime"), "-o",
+                 exe, src, runtime]]
+    elif how == "optimized":
+        cmds = [[compiler, "-O2", "-fverify-each", "-o", exe, path]]
+    else:
+        cmds = [[compiler, "-o", exe, path]]
+    for cmd in cmds:
+        proc = subprocess.run(cmd, stdout=subprocess.DEVNULL,
+                              stderr=subprocess.PIPE)
+        if proc.returncode != 0:
+            return None, f"{cmd[0]} failed:\n" + proc.stderr.decode()
+    return exe, None
+
+
+def check(compiler, path, tmpdir):
+    """None if native and VM agree, else what differs."""
+    inp = os.path.splitext(path)[0] + ".in"
+    stdin = open(inp, "rb").read() if os.path.exists(inp) else b""
+    vm = run([compiler, "--run", path], stdin)
+    out = os.path.splitext(path)[0] + ".out"
+    if os.path.exists(out) and vm[1] != open(out).read():
+        return "VM: output differs from " + os.path.relpath(out, ROOT)
+    for how in ("object", "assembly", "C", "optimized", "JIT"):
+        if how == "JIT":
+            native = run([compiler, "-O2", "--jit=eager", "--run", path],
+                         stdin)
+        else:
+            exe, error = build(compiler, path, tmpdir, how)
+            if error:
+                return f"{how}: {error}"
+            native = run([exe], stdin)
+        if vm != native:
+            names = ("exit status", "output", "runtime error")
+            return f"{how}: " + ", ".join(
+                n for n, a, b in zip(names, vm, native) if a != b) + \
+                f" differ (VM {vm[0]}, native {native[0]})"
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--compiler", default=os.path.join(ROOT, "build", "bin",
+                                                       "cactc"))
+    args = ap.parse_args()
+
+    if not os.path.isfile(args.compiler):
+        print(f"{Colors.FAIL}Error: Compiler not found at "
+              f"{args.compiler}{Colors.ENDC}")
+        print("Please run 'make' first.")
+        sys.exit(1)
+
+    failed = 0
+    paths = programs()
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for path in paths:
+            name = os.path.relpath(path, ROOT)
+            problem = check(args.compiler, path, tmpdir)
+            if problem is None:
+                print(f"{Colors.OKGREEN}[PASS]{Colors.ENDC} {name}")
+                continue
+            failed += 1
+            print(f"{Colors.FAIL}[FAIL]{Colors.ENDC} {name}\n"
+                  f"    {Colors.WARNING}{problem}{Colors.ENDC}")
+
+    if failed:
+        print(f"\n{Colors.FAIL}{failed} of {len(paths)} programs differ."
+              f"{Colors.ENDC}")
+        sys.exit(1)
+    print(f"\n{Colors.OKGREEN}All {len(paths)} programs agree.{Colors.ENDC}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,335 @@
+#!/usr/bin/env python3
+#
+#    Copyright 2025 Karesis
+#
+#    Licensed under the Apache License, Version 2.0 (the "License");
+#    you may not use this file except in compliance with the License.
+#    You may obtain a copy of the License at
+#
+#        http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Unless required by applicable law or agreed to in writing, software
+#    distributed under the License is distributed on an "AS IS" BASIS,
+#    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#    See the License for the specific language governing permissions and
+#    limitations under the License.
+#
+"""Complexity guard tests: cactc must scale linearly on pathological input.
+
+Every shape below (deep nesting, long chains, many declarations, error
+storms, nesting beyond the -fmax-* limits) is generated at sizes N, 2N and
+4N. For linear cost the second increment, N to 2N more, costs twice the
+first; the shape fails if CPU time grows by more than --max-time-ratio
+times, or memory by more than --max-mem-ratio times, or if any run crashes
+or exits with an unexpected status.
+
+CPU time is the best of --runs runs. Memory is what the arenas hand out
+after reading the input, from --stats-json, so it is exact and does not
+depend on the machine.
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Copies of each deep construct, so a shape's cost is measurable while its
+# depth stays within the default limits.
+COPIES = 800
+
+
+class Colors:
+    OKGREEN = '\033[92m'
+    WARNING = '\033[93m'
+    FAIL = '\033[91m'
+    ENDC = '\033[0m'
+
+
+# --- Shapes ---------------------------------------------------------------
+#
+# Each generator maps a size to a program whose text grows linearly with it.
+
+
+def functions(body, copies=COPIES):
+    """`copies` functions whose body is body(k); main returns 0."""
+    return "".join(f"int f{k}() {{\n\tint x = 0;\n{body(k)}\n\treturn x;\n}}\n"
+                   for k in range(copies)) + "int main() { return 0; }\n"
+
+
+def blocks(n):
+    return functions(lambda k: "{ x = x + 1; " * n + "}" * n)
+
+
+def ifs(n):
+    return functions(lambda k: "if (x < 1) " * n + "x = x + 1;")
+
+
+def whiles(n):
+    return functions(lambda k: "while (x < 1) { " * n + "x = 1; " + "}" * n)
+
+
+def else_ifs(n):
+    return functions(lambda k: "if (x == 0) { x = 1; }" + "".join(
+        f" else if (x == {i}) {{ x = {i}; }}" for i in range(1, n)))
+
+
+def parens(n):
+    return functions(lambda k: "x = " + "(" * n + "x" + ")" * n + ";")
+
+
+def unary(n):
+    return functions(lambda k: "x = " + "- " * n + "1;")
+
+
+def chain(n):
+    return functions(lambda k: "x = x" + " + 1" * n + ";")
+
+
+def assigns(n):
+    return functions(lambda k: "print_int(" + "x = " * n + "1);")
+
+
+def calls(n):
+    return ("int g(int v) { return v; }\n" +
+            functions(lambda k: "x = " + "g(" * n + "1" + ")" * n + ";"))
+
+
+def indices(n):
+    return ("int a[2];\n" +
+            functions(lambda k: "x = " + "a[" * n + "0" + "]" * n + ";"))
+
+
+def subscripts(n):
+    return ("int a" + "[1]" * n + ";\n" +
+            functions(lambda k: "x = a" + "[0]" * n + ";"))
+
+
+def init_lists(n):
+    return "".join(f"int b{k}" + "[1]" * n + " = " + "{" * n + "1" + "}" * n +
+                   ";\n" for k in range(COPIES)) + "int main() { return 0; }\n"
+
+
+def locals_(n):
+    decls = "".join(f"\tint v{i} = v{i - 1} + 1;\n" for i in range(1, n))
+    return f"int main() {{\n\tint v0 = 0;\n{decls}\treturn v{n - 1};\n}}\n"
+
+
+def globals_(n):
+    return ("".join(f"int g{i} = {i};\n" for i in range(n)) +
+            f"int main() {{ return g{n - 1}; }}\n")
+
+
+def calls_flat(n):
+    return ("int f0() { return 0; }\n" +
+            "".join(f"int f{i}() {{ return f{i - 1}() + 1; }}\n"
+                    for i in range(1, n)) +
+            f"int main() {{ return f{n - 1}(); }}\n")
+
+
+def init_flat(n):
+    return (f"int a[{n}] = {{" + ", ".join(str(i % 100) for i in range(n)) +
+            "};\nint main() { return a[0]; }\n")
+
+
+def comments(n):
+    return ("".join(f"// comment {i} with a few more words in it\n"
+                    f"/* and a block comment {i} */\n" for i in range(n)) +
+            "int main() { return 0; }\n")
+
+
+def storm(n):
+    return "int main() {\n" + ") ] @ 1 + ;\n" * n + "}\n"
+
+
+def undefined(n):
+    return ("int main() {\n" + "".join(f"\tx{i} = y{i} + 1;\n"
+                                       for i in range(n)) + "}\n")
+
+
+def deep_blocks(n):
+    return "int main() { " + "{ " * n + "}" * n + " return 0; }\n"
+
+
+def deep_ifs(n):
+    return "int main() { int x = 0; " + "if (x < 1) " * n + "x = 1; }\n"
+
+
+def deep_else_ifs(n):
+    return ("int main() { int x = 0; if (x == 0) { x = 1; }" +
+            " else if (x == 1) { x = 2; }" * n + " return x; }\n")
+
+
+def deep_parens(n):
+    return "int main() { int x = " + "(" * n + "1" + ")" * n + "; }\n"
+
+
+def deep_chain(n):
+    return "int main() { int x = 1" + " + 1" * n + "; return x; }\n"
+
+
+def deep_inits(n):
+    return "int a[2] = " + "{" * n + "1" + "}" * n + ";\n"
+
+
+# name -> (generator, N, expected exit status)
+SHAPES = {
+    # Nesting within the default limits.
+    "blocks": (blocks, 128, 0),
+    "ifs": (ifs, 128, 0),
+    "whiles": (whiles, 64, 0),
+    "else_ifs": (else_ifs, 128, 0),
+    "parens": (parens, 256, 0),
+    "unary": (unary, 256, 0),
+    "chain": (chain, 256, 0),
+    "assigns": (assigns, 256, 0),
+    "calls": (calls, 256, 0),
+    "indices": (indices, 256, 0),
+    "subscripts": (subscripts, 256, 0),
+    "init_lists": (init_lists, 256, 0),
+    # Many things side by side.
+    "locals": (locals_, 80000, 0),
+    "globals": (globals_, 80000, 0),
+    "functions": (calls_flat, 80000, 0),
+    "init_flat": (init_flat, 400000, 0),
+    "comments": (comments, 200000, 0),
+    # Errors: one diagnostic, then cheap recovery.
+    "storm": (storm, 200000, 1),
+    "undefined": (undefined, 80000, 1),
+    # Nesting beyond the limits.
+    "deep_blocks": (deep_blocks, 200000, 1),
+    "deep_ifs": (deep_ifs, 200000, 1),
+    "deep_else_ifs": (deep_else_ifs, 80000, 1),
+    "deep_parens": (deep_parens, 200000, 1),
+    "deep_chain": (deep_chain, 200000, 1),
+    "deep_inits": (deep_inits, 200000, 1),
+}
+
+
+# --- Measurement ----------------------------------------------------------
+
+
+def run(compiler, path, args=()):
+    """(exit status, CPU seconds) of one compile; status < 0 is a signal."""
+    proc = subprocess.Popen([compiler, *args, path], stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+    _, status, usage = os.wait4(proc.pid, 0)
+    return (os.waitstatus_to_exitcode(status),
+            usage.ru_utime + usage.ru_stime)
+
+
+def measure(compiler, path, runs):
+    """(exit status, best CPU seconds, arena bytes) for one input."""
+    best = None
+    for _ in range(runs):
+        status, cpu = run(compiler, path)
+        if status < 0:
+            return status, cpu, 0
+        best = cpu if best is None else min(best, cpu)
+
+    with tempfile.NamedTemporaryFile(suffix=".json") as tmp:
+        run(compiler, path, [f"--stats-json={tmp.name}"])
+        stats = json.load(open(tmp.name))
+    # The source buffer is as big as the input whatever the compiler does
+    # with it; count what is built from it.
+    arena = stats["arena"]
+    mem = sum(p["bytes"] for p in stats["phases"]
+              if p["name"] not in ("init", "read"))
+    mem += arena["scope_peak"] + arena["scratch_peak"]
+    return status, best, mem
+
+
+def growth(x1, x2, x4, floor):
+    """How much more the second increment costs than the first (2 = linear)."""
+    return (x4 - x2) / max(x2 - x1, floor)
+
+
+def check_shape(args, tmp, name, runs):
+    """Measure one shape at N, 2N and 4N; (table row, list of problems)."""
+    gen, base, expect = SHAPES[name]
+    n = max(1, int(base * args.scale))
+    results = []
+    for size in (n, 2 * n, 4 * n):
+        path = os.path.join(tmp, f"{name}-{size}.cact")
+        with open(path, "w") as f:
+            f.write(gen(size))
+        status, cpu, mem = measure(args.compiler, path, runs)
+        if status < 0:
+            problem = f"killed by signal {-status} at size {size}"
+        elif status != expect:
+            problem = f"exit status {status} at size {size}, expected {expect}"
+        else:
+            results.append((cpu, mem))
+            continue
+        return f"{name:<14}{n:>8}  {Colors.FAIL}{problem}{Colors.ENDC}", \
+            [problem]
+
+    (t1, m1), (t2, m2), (t4, m4) = results
+    # Timer noise can make the first increment vanish; never divide by
+    # less than 2% of the largest run.
+    tg = growth(t1, t2, t4, 0.02 * t4 + 1e-3)
+    mg = growth(m1, m2, m4, 1)
+    problems = []
+    tcell = f"{tg:>8.2f}"
+    mcell = f"{mg:>8.2f}"
+    if tg > args.max_time_ratio:
+        tcell = f"{Colors.FAIL}{tcell}{Colors.ENDC}"
+        problems.append(f"time grows {tg:.2f}x")
+    if mg > args.max_mem_ratio:
+        mcell = f"{Colors.FAIL}{mcell}{Colors.ENDC}"
+        problems.append(f"memory grows {mg:.2f}x")
+    times = ", ".join(f"{t * 1e3:.0f}" for t in (t1, t2, t4))
+    mems = ", ".join(f"{m / 1024:.0f}" for m in (m1, m2, m4))
+    return f"{name:<14}{n:>8}{times:>26}{tcell}{mems:>30}{mcell}", problems
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--compiler", default=os.path.join(ROOT, "build", "bin",
+                                                       "cactc"))
+    ap.add_argument("--shapes", default=",".join(SHAPES),
+                    help="comma-separated shape names")
+    ap.add_argument("--scale", type=float, default=1.0,
+                    help="multiply every N by this factor")
+    ap.add_argument("--runs", type=int, default=3)
+    ap.add_argument("--max-time-ratio", type=float, default=3.0,
+                    help="allowed time growth (linear: 2, quadratic: 4)")
+    ap.add_argument("--max-mem-ratio", type=float, default=2.5,
+                    help="allowed memory growth (linear: 2)")
+    args = ap.parse_args()
+
+    if not os.path.isfile(args.compiler):
+        print(f"{Colors.FAIL}Error: Compiler not found at "
+              f"{args.compiler}{Colors.ENDC}")
+        print("Please run 'make' first.")
+        sys.exit(1)
+
+    failures = []
+    print(f"{'shape':<14}{'N':>8}{'time ms (N, 2N, 4N)':>26}"
+          f"{'growth':>8}{'memory KiB (N, 2N, 4N)':>30}{'growth':>8}")
+    print("-" * 94)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        for name in args.shapes.split(","):
+            row, problems = check_shape(args, tmp, name, args.runs)
+            if problems:
+                # A busy machine can spoil a best-of-few; only a shape
+                # that fails again with more runs is reported.
+                print(f"{row}  {Colors.WARNING}(retrying){Colors.ENDC}")
+                row, problems = check_shape(args, tmp, name, args.runs * 3)
+            print(row)
+            failures += [(name, why) for why in problems]
+
+    if failures:
+        print(f"\n{Colors.FAIL}{len(failures)} problem(s) found:"
+              f"{Colors.ENDC}")
+        for name, why in failures:
+            print(f"  {name}: {why}")
+        sys.exit(1)
+    print(f"\n{Colors.OKGREEN}All shapes scale linearly.{Colors.ENDC}")
+
+
+if __name__ == "__main__":
+    main()
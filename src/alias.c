@@ -0,0 +1,111 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * alias: what an address is based on, and which accesses may meet there.
+ * gvn and licm both ask this, so a fact one of them relies on is one the
+ * other respects.
+ */
+
+#include <pass.h>
+
+struct IrRoot ir_root_of(const struct IrFunc *fn, u32 nvalues, IrValue addr)
+{
+	struct IrRoot r = { .fixed = true };
+	bool indexed = false;
+	while (ir_inst(fn, addr)->op == IrOp_INDEX) {
+		const struct IrInst *inst = ir_inst(fn, addr);
+		const IrValue *args = ir_args(fn, addr);
+		const struct IrInst *index = ir_inst(fn, args[1]);
+		if (index->op == IrOp_CONST)
+			r.off += (i64)index->imm.k.i * inst->imm.mem.size;
+		else
+			r.fixed = false;
+		addr = args[0];
+		indexed = true;
+	}
+	const struct IrInst *inst = ir_inst(fn, addr);
+	switch (inst->op) {
+	case IrOp_ALLOCA:
+		r.kind = addr < nvalues ? IrRoot_ALLOCA : IrRoot_NEW;
+		r.id = addr < nvalues ? addr : 0;
+		break;
+	case IrOp_GLOBAL:
+		r.kind = indexed ? IrRoot_ARRAY : IrRoot_SCALAR;
+		r.id = nvalues + inst->imm.index;
+		break;
+	case IrOp_PARAM:
+		r.kind = IrRoot_PARAM;
+		break;
+	default:
+		r.kind = IrRoot_UNKNOWN;
+	}
+	return r;
+}
+
+IrMemSet ir_mem_kinds(struct IrRoot r)
+{
+	switch (r.kind) {
+	case IrRoot_ALLOCA:
+	case IrRoot_SCALAR:
+	case IrRoot_NEW:
+		return IR_MEM(SAME);
+	case IrRoot_ARRAY:
+		return IR_MEM(SAME) | IR_MEM(ARRAY);
+	case IrRoot_PARAM:
+		return IR_MEM(PARAM);
+	default:
+		return IR_MEM(UNKNOWN);
+	}
+}
+
+IrMemSet ir_mem_overlaps(struct IrRoot r, const bool *escaped)
+{
+	IrMemSet any = IR_MEM(UNKNOWN);
+	switch (r.kind) {
+	case IrRoot_ALLOCA:
+		return any | IR_MEM(SAME) | (escaped[r.id] ? IR_MEM(CALL) : 0);
+	case IrRoot_NEW:
+		return any | IR_MEM(SAME);
+	case IrRoot_SCALAR:
+		return any | IR_MEM(SAME) | IR_MEM(CALL);
+	case IrRoot_ARRAY:
+		return any | IR_MEM(SAME) | IR_MEM(CALL) | IR_MEM(PARAM);
+	case IrRoot_PARAM:
+		return any | IR_MEM(CALL) | IR_MEM(PARAM) | IR_MEM(ARRAY);
+	default:
+		return (1u << IrMem_COUNT) - 1;
+	}
+}
+
+void ir_find_escapes(const struct IrFunc *fn, u32 nvalues, bool *escaped)
+{
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			if (ir_inst(fn, v)->op != IrOp_CALL)
+				continue;
+			const IrValue *args = ir_args(fn, v);
+			ir_foreach_operand(fn, v, i)
+			{
+				struct IrRoot r =
+					ir_root_of(fn, nvalues, args[i]);
+				if (r.kind == IrRoot_ALLOCA)
+					escaped[r.id] = true;
+			}
+		}
+	}
+}
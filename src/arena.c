@@ -0,0 +1,208 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <arena.h>
+#include <core/msg.h>
+#include <string.h>
+
+struct ArenaChunk {
+	struct ArenaChunk *prev;
+	usize cap;
+	usize used;
+	/* Arena bytes in use in all older chunks. */
+	usize before;
+	/* Offset of the most recent allocation, for in-place free/grow. */
+	usize last;
+	_Alignas(16) u8 data[];
+};
+
+/*
+ * ==========================================================================
+ * 1. Chunks
+ * ==========================================================================
+ */
+
+static void chunk_free(struct Arena *a, struct ArenaChunk *c)
+{
+	a->reserved -= c->cap;
+	allocer_free(a->backing, c,
+		     layout(sizeof(struct ArenaChunk) + c->cap, 16));
+}
+
+static struct ArenaChunk *chunk_new(struct Arena *a, usize min_cap)
+{
+	struct ArenaChunk *c = a->spare;
+	if (c && c->cap >= min_cap) {
+		a->spare = NULL;
+	} else {
+		usize cap = a->chunk_size > min_cap ? a->chunk_size : min_cap;
+		c = allocer_alloc(a->backing,
+				  layout(sizeof(struct ArenaChunk) + cap, 16));
+		massert(c, "OOM arena chunk");
+		c->cap = cap;
+		a->reserved += cap;
+	}
+
+	c->prev = a->head;
+	c->used = 0;
+	c->last = 0;
+	c->before = a->used;
+	a->head = c;
+	return c;
+}
+
+/* Keep the bigger of `c` and the current spare, free the other. */
+static void chunk_retire(struct Arena *a, struct ArenaChunk *c)
+{
+	if (a->spare && a->spare->cap >= c->cap) {
+		chunk_free(a, c);
+		return;
+	}
+	if (a->spare)
+		chunk_free(a, a->spare);
+	a->spare = c;
+}
+
+/*
+ * ==========================================================================
+ * 2. Allocation
+ * ==========================================================================
+ */
+
+void *arena_alloc(struct Arena *a, layout_t l)
+{
+	usize align = l.align ? l.align : 1;
+	struct ArenaChunk *c = a->head;
+
+	usize off = c ? (c->used + align - 1) & ~(align - 1) : 0;
+	if (!c || off + l.size > c->cap) {
+		c = chunk_new(a, l.size + align);
+		off = 0;
+	}
+
+	a->used += off + l.size - c->used;
+	if (a->used > a->peak)
+		a->peak = a->used;
+
+	c->last = off;
+	c->used = off + l.size;
+	memset(c->data + off, 0, l.size);
+	return c->data + off;
+}
+
+static bool is_last(struct Arena *a, void *ptr)
+{
+	struct ArenaChunk *c = a->head;
+	return c && ptr == c->data + c->last;
+}
+
+static void *vt_alloc(void *self, layout_t l)
+{
+	return arena_alloc(self, l);
+}
+
+static void vt_free(void *self, void *ptr, layout_t l)
+{
+	struct Arena *a = self;
+	(void)l;
+
+	/* Only the newest allocation can be given back before a release. */
+	if (ptr && is_last(a, ptr)) {
+		struct ArenaChunk *c = a->head;
+		a->used -= c->used - c->last;
+		c->used = c->last;
+	}
+}
+
+static void *vt_realloc(void *self, void *ptr, layout_t old, usize new_size)
+{
+	struct Arena *a = self;
+
+	if (ptr && is_last(a, ptr)) {
+		struct ArenaChunk *c = a->head;
+		if (c->last + new_size <= c->cap) {
+			if (new_size > old.size)
+				memset(c->data + c->last + old.size, 0,
+				       new_size - old.size);
+			a->used = a->used - (c->used - c->last) + new_size;
+			if (a->used > a->peak)
+				a->peak = a->used;
+			c->used = c->last + new_size;
+			return ptr;
+		}
+	}
+
+	void *res = arena_alloc(a, layout(new_size, old.align));
+	if (ptr)
+		memcpy(res, ptr, old.size < new_size ? old.size : new_size);
+	return res;
+}
+
+static const allocer_vtable_t ARENA_VTABLE = {
+	.alloc = vt_alloc,
+	.free = vt_free,
+	.realloc = vt_realloc,
+};
+
+allocer_t arena_allocer(struct Arena *a)
+{
+	return (allocer_t){ .self = a, .vtable = &ARENA_VTABLE };
+}
+
+/*
+ * ==========================================================================
+ * 3. Lifecycle & Checkpoints
+ * ==========================================================================
+ */
+
+void arena_init(struct Arena *a, allocer_t backing, usize chunk_size)
+{
+	*a = (struct Arena){ .backing = backing, .chunk_size = chunk_size };
+}
+
+void arena_deinit(struct Arena *a)
+{
+	arena_release(a, (struct ArenaMark){ 0 });
+	if (a->spare)
+		chunk_free(a, a->spare);
+	a->spare = NULL;
+}
+
+struct ArenaMark arena_mark(struct Arena *a)
+{
+	return (struct ArenaMark){ a->head, a->head ? a->head->used : 0 };
+}
+
+void arena_release(struct Arena *a, struct ArenaMark mark)
+{
+	while (a->head != mark.chunk) {
+		struct ArenaChunk *c = a->head;
+		massert(c, "arena_release: mark does not belong to this arena");
+		a->head = c->prev;
+		chunk_retire(a, c);
+	}
+
+	struct ArenaChunk *c = a->head;
+	if (!c) {
+		a->used = 0;
+		return;
+	}
+	massert(mark.used <= c->used, "arena_release: stale mark");
+	c->used = mark.used;
+	/* Disable in-place reuse: the newest allocation may be gone. */
+	c->last = c->cap + 1;
+	a->used = c->before + c->used;
+}
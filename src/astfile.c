@@ -0,0 +1,663 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <astfile.h>
+#include <context.h>
+#include <sema.h>
+#include <type.h>
+#include <trace.h>
+#include <core/msg.h>
+#include <std/map.h>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * ==========================================================================
+ * 1. Writer State
+ * ==========================================================================
+ */
+
+static u64 _ptr_hash(const void *key)
+{
+	uintptr_t addr = (uintptr_t)*(const void *const *)key;
+	return (u64)addr * 0x9e3779b97f4a7c15ull;
+}
+
+static bool _ptr_eq(const void *lhs, const void *rhs)
+{
+	return *(const void *const *)lhs == *(const void *const *)rhs;
+}
+
+static const map_ops_t MAP_OPS_PTR = { .hash = _ptr_hash, .equals = _ptr_eq };
+
+static u64 _sym_hash(const void *key)
+{
+	return (u64)((const symbol_t *)key)->id * 2654435761u;
+}
+
+static bool _sym_eq(const void *lhs, const void *rhs)
+{
+	return ((const symbol_t *)lhs)->id == ((const symbol_t *)rhs)->id;
+}
+
+static const map_ops_t MAP_OPS_SYM = { .hash = _sym_hash, .equals = _sym_eq };
+
+defMap(const void *, u32, PtrIndexMap);
+defMap(symbol_t, u32, NameIndexMap);
+
+struct AstWriter {
+	struct Context *ctx;
+
+	vec(char) strings;
+	vec(struct AstFileType) types;
+	vec(struct AstFileSymbol) symbols;
+	vec(struct AstFileNode) nodes;
+	vec(u32) lists;
+
+	/* Stack of pending list elements, see list_close(). */
+	vec(u32) scratch;
+
+	PtrIndexMap type_ids;
+	PtrIndexMap sym_ids;
+	NameIndexMap name_ids;
+};
+
+static u32 write_name(struct AstWriter *w, symbol_t name)
+{
+	u32 *found = map_get(w->name_ids, name);
+	if (found)
+		return *found;
+
+	str_t s = intern_resolve(&w->ctx->itn, name);
+	u32 off = (u32)vec_len(w->strings);
+	for (usize i = 0; i < s.len; ++i)
+		massert(vec_push(w->strings, s.ptr[i]), "OOM ast strings");
+	massert(vec_push(w->strings, '\0'), "OOM ast strings");
+
+	map_put(w->name_ids, name, off);
+	return off;
+}
+
+/**
+ * @brief Lists are built in two steps because writing an element may itself
+ * emit lists: elements are first pushed on `scratch`, then list_close()
+ * copies everything above `mark` into `lists` as one contiguous list.
+ */
+static u32 list_close(struct AstWriter *w, usize mark)
+{
+	u32 idx = (u32)vec_len(w->lists);
+	u32 len = (u32)(vec_len(w->scratch) - mark);
+
+	massert(vec_push(w->lists, len), "OOM ast lists");
+	for (usize i = mark; i < vec_len(w->scratch); ++i)
+		massert(vec_push(w->lists, vec_at(w->scratch, i)),
+			"OOM ast lists");
+
+	w->scratch.len = mark;
+	return idx;
+}
+
+static u32 write_type(struct AstWriter *w, struct Type *ty)
+{
+	if (!ty)
+		return AST_FILE_NONE;
+
+	const void *key = ty;
+	u32 *found = map_get(w->type_ids, key);
+	if (found)
+		return *found;
+
+	struct AstFileType rec = {
+		.kind = (u32)ty->kind,
+		.size = ty->size,
+		.align = ty->align,
+		.base = AST_FILE_NONE,
+		.extra = AST_FILE_NONE,
+	};
+
+	if (ty->kind == TypeKind_ARRAY) {
+		rec.base = write_type(w, ty->data.array.base);
+		rec.extra = (u32)ty->data.array.len;
+	} else if (ty->kind == TypeKind_FUNC) {
+		rec.base = write_type(w, ty->data.func.ret);
+
+		usize mark = vec_len(w->scratch);
+		for (usize i = 0; i < vec_len(ty->data.func.params); ++i) {
+			u32 param =
+				write_type(w, vec_at(ty->data.func.params, i));
+			massert(vec_push(w->scratch, param), "OOM ast");
+		}
+		rec.extra = list_close(w, mark);
+	}
+
+	u32 idx = (u32)vec_len(w->types);
+	massert(vec_push(w->types, rec), "OOM ast types");
+	map_put(w->type_ids, key, idx);
+	return idx;
+}
+
+static u32 write_symbol(struct AstWriter *w, const struct SemaSymbol *sym)
+{
+	if (!sym)
+		return AST_FILE_NONE;
+
+	const void *key = sym;
+	u32 *found = map_get(w->sym_ids, key);
+	if (found)
+		return *found;
+
+	struct AstFileSymbol rec = {
+		.name = write_name(w, sym->name),
+		.type = write_type(w, sym->ty),
+		.is_const = sym->is_const,
+		.is_global = sym->is_global,
+		.stack_offset = sym->stack_offset,
+	};
+
+	u32 idx = (u32)vec_len(w->symbols);
+	massert(vec_push(w->symbols, rec), "OOM ast symbols");
+	map_put(w->sym_ids, key, idx);
+	return idx;
+}
+
+/*
+ * ==========================================================================
+ * 2. Node Serialization
+ * ==========================================================================
+ */
+
+static u32 write_node(struct AstWriter *w, struct Node *n);
+
+static u32 write_node_list(struct AstWriter *w, NodeVec *list)
+{
+	usize mark = vec_len(w->scratch);
+	for (usize i = 0; i < vec_len(*list); ++i) {
+		u32 child = write_node(w, vec_at(*list, i));
+		massert(vec_push(w->scratch, child), "OOM ast");
+	}
+	return list_close(w, mark);
+}
+
+static u32 write_node(struct AstWriter *w, struct Node *n)
+{
+	if (!n)
+		return AST_FILE_NONE;
+
+	struct AstFileNode rec = {
+		.kind = (u32)n->kind,
+		.type = write_type(w, n->ty),
+		.a = AST_FILE_NONE,
+		.b = AST_FILE_NONE,
+		.c = AST_FILE_NONE,
+	};
+
+	if (n->tok) {
+		rec.span_start = n->tok->span.start;
+		rec.span_len = (u32)(n->tok->span.end - n->tok->span.start);
+	}
+
+	switch (n->kind) {
+	case ND_LIT_INT:
+		memcpy(&rec.a, &as_lit_int(n)->val, sizeof(u32));
+		break;
+	case ND_LIT_FLOAT:
+		memcpy(&rec.a, &as_lit_float(n)->val, sizeof(u32));
+		break;
+	case ND_LIT_DOUBLE: {
+		u64 bits;
+		memcpy(&bits, &as_lit_double(n)->val, sizeof(bits));
+		rec.a = (u32)bits;
+		rec.b = (u32)(bits >> 32);
+		break;
+	}
+	case ND_LIT_BOOL:
+		rec.a = as_lit_bool(n)->val ? 1 : 0;
+		break;
+	case ND_INIT_LIST:
+		rec.a = write_node_list(w, &as_init_list(n)->inits);
+		break;
+	case ND_VAR:
+		rec.a = write_symbol(w, as_var(n)->var);
+		break;
+	case ND_FUNC_CALL: {
+		struct NodeCall *call = as_call(n);
+		rec.a = write_name(w, intern_cstr(&w->ctx->itn,
+						  call->func_name));
+		rec.b = write_node_list(w, &call->args);
+		break;
+	}
+	case ND_NEG:
+	case ND_LOG_NOT:
+	case ND_CAST:
+	case ND_RETURN:
+	case ND_EXPR_STMT:
+		rec.a = write_node(w, as_unary(n)->lhs);
+		break;
+	case ND_ARRAY_ACCESS:
+	case ND_ADD:
+	case ND_SUB:
+	case ND_MUL:
+	case ND_DIV:
+	case ND_MOD:
+	case ND_EQ:
+	case ND_NE:
+	case ND_LT:
+	case ND_LE:
+	case ND_GT:
+	case ND_GE:
+	case ND_LOG_AND:
+	case ND_LOG_OR:
+	case ND_ASSIGN:
+		rec.a = write_node(w, as_binary(n)->lhs);
+		rec.b = write_node(w, as_binary(n)->rhs);
+		break;
+	case ND_BLOCK:
+		rec.a = write_node_list(w, &as_block(n)->stmts);
+		break;
+	case ND_IF:
+		rec.a = write_node(w, as_if(n)->cond);
+		rec.b = write_node(w, as_if(n)->then_branch);
+		rec.c = write_node(w, as_if(n)->else_branch);
+		break;
+	case ND_WHILE:
+		rec.a = write_node(w, as_while(n)->cond);
+		rec.b = write_node(w, as_while(n)->body);
+		break;
+	case ND_VAR_DECL:
+		rec.a = write_symbol(w, as_decl(n)->var);
+		rec.b = write_node(w, as_decl(n)->init);
+		break;
+	case ND_BREAK:
+	case ND_CONTINUE:
+		break;
+	case ND_FUNC: {
+		struct NodeFunc *fn = as_func(n);
+		rec.a = write_symbol(w, fn->sym);
+
+		usize mark = vec_len(w->scratch);
+		vec_foreach(param, fn->params)
+		{
+			massert(vec_push(w->scratch, write_symbol(w, *param)),
+				"OOM ast");
+		}
+		rec.b = list_close(w, mark);
+		rec.c = write_node(w, fn->body);
+		break;
+	}
+	}
+
+	u32 idx = (u32)vec_len(w->nodes);
+	massert(vec_push(w->nodes, rec), "OOM ast nodes");
+	return idx;
+}
+
+/*
+ * ==========================================================================
+ * 3. Output
+ * ==========================================================================
+ */
+
+static u64 align8(u64 x)
+{
+	return (x + 7) & ~(u64)7;
+}
+
+static u64 place(struct AstFileSection *sec, u64 at, usize count,
+		 usize elem_size)
+{
+	sec->offset = at;
+	sec->count = count;
+	return align8(at + count * elem_size);
+}
+
+static bool write_section(FILE *f, const void *data, usize bytes)
+{
+	static const u8 zeros[8] = { 0 };
+	if (bytes && fwrite(data, 1, bytes, f) != bytes)
+		return false;
+	usize pad = (usize)(align8(bytes) - bytes);
+	return pad == 0 || fwrite(zeros, 1, pad, f) == pad;
+}
+
+bool astfile_write(const char *path, struct Context *ctx, NodeVec globals)
+{
+	TRACE_SCOPE("astfile_write");
+	struct AstWriter w = { .ctx = ctx };
+
+	/* The writer's tables are only needed until the file is written. */
+	struct ArenaMark mark = arena_mark(&ctx->scratch);
+	allocer_t alc = arena_allocer(&ctx->scratch);
+
+	massert(vec_init(w.strings, alc, 256), "OOM ast");
+	massert(vec_init(w.types, alc, 16), "OOM ast");
+	massert(vec_init(w.symbols, alc, 64), "OOM ast");
+	massert(vec_init(w.nodes, alc, 256), "OOM ast");
+	massert(vec_init(w.lists, alc, 64), "OOM ast");
+	massert(vec_init(w.scratch, alc, 64), "OOM ast");
+	massert(map_init(w.type_ids, alc, MAP_OPS_PTR), "OOM ast");
+	massert(map_init(w.sym_ids, alc, MAP_OPS_PTR), "OOM ast");
+	massert(map_init(w.name_ids, alc, MAP_OPS_SYM), "OOM ast");
+
+	/* Offset 0 is the empty string; the blob always ends in NUL. */
+	massert(vec_push(w.strings, '\0'), "OOM ast");
+
+	struct AstFileHeader h = { 0 };
+	memcpy(h.magic, AST_FILE_MAGIC, sizeof(AST_FILE_MAGIC));
+	h.version = AST_FILE_VERSION;
+	h.roots = write_node_list(&w, &globals);
+
+	u64 at = align8(sizeof(h));
+	at = place(&h.strings, at, vec_len(w.strings), 1);
+	at = place(&h.types, at, vec_len(w.types), sizeof(struct AstFileType));
+	at = place(&h.symbols, at, vec_len(w.symbols),
+		   sizeof(struct AstFileSymbol));
+	at = place(&h.nodes, at, vec_len(w.nodes), sizeof(struct AstFileNode));
+	at = place(&h.lists, at, vec_len(w.lists), sizeof(u32));
+	h.file_size = at;
+
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		log_error("Could not write AST file '%s'", path);
+		arena_release(&ctx->scratch, mark);
+		return false;
+	}
+
+	bool ok = write_section(f, &h, sizeof(h)) &&
+		  write_section(f, w.strings.data, vec_len(w.strings)) &&
+		  write_section(f, w.types.data,
+				vec_len(w.types) * sizeof(struct AstFileType)) &&
+		  write_section(f, w.symbols.data,
+				vec_len(w.symbols) *
+					sizeof(struct AstFileSymbol)) &&
+		  write_section(f, w.nodes.data,
+				vec_len(w.nodes) * sizeof(struct AstFileNode)) &&
+		  write_section(f, w.lists.data, vec_len(w.lists) * sizeof(u32));
+	ok = fclose(f) == 0 && ok;
+
+	map_deinit(w.name_ids);
+	map_deinit(w.sym_ids);
+	map_deinit(w.type_ids);
+	vec_deinit(w.scratch);
+	vec_deinit(w.lists);
+	vec_deinit(w.nodes);
+	vec_deinit(w.symbols);
+	vec_deinit(w.types);
+	vec_deinit(w.strings);
+	arena_release(&ctx->scratch, mark);
+
+	if (!ok)
+		log_error("Failed writing AST file '%s'", path);
+	return ok;
+}
+
+/*
+ * ==========================================================================
+ * 4. In-place Validation
+ * ==========================================================================
+ */
+
+#define CHECK(cond, msg)              \
+	do {                          \
+		if (!(cond)) {        \
+			*err = msg;   \
+			return false; \
+		}                     \
+	} while (0)
+
+static bool section_ok(const struct AstFileSection *sec, usize size,
+		       usize elem_size)
+{
+	if (sec->offset % 8 != 0 || sec->offset > size)
+		return false;
+	if (sec->count >= AST_FILE_NONE)
+		return false;
+	return sec->count * elem_size <= size - sec->offset;
+}
+
+static bool list_ok(const struct AstFile *f, u32 list)
+{
+	u64 n = f->hdr->lists.count;
+	return list < n && (u64)list + 1 + f->lists[list] <= n;
+}
+
+/* A reference to an earlier record (or NONE when `optional`). */
+static bool ref_ok(u32 ref, u64 limit, bool optional)
+{
+	return ref < limit || (optional && ref == AST_FILE_NONE);
+}
+
+static bool check_types(const struct AstFile *f, const char **err)
+{
+	for (u32 i = 0; i < f->hdr->types.count; ++i) {
+		const struct AstFileType *t = &f->types[i];
+		CHECK(t->kind <= TypeKind_FUNC, "bad type kind");
+
+		if (t->kind == TypeKind_ARRAY) {
+			CHECK(ref_ok(t->base, i, false), "bad array base");
+		} else if (t->kind == TypeKind_FUNC) {
+			CHECK(ref_ok(t->base, i, false), "bad return type");
+			CHECK(list_ok(f, t->extra), "bad param list");
+			const u32 *params = astfile_list(f, t->extra);
+			for (u32 k = 0; k < astfile_list_len(f, t->extra); ++k)
+				CHECK(ref_ok(params[k], i, false),
+				      "bad param type");
+		}
+	}
+	return true;
+}
+
+static bool check_symbols(const struct AstFile *f, const char **err)
+{
+	for (u32 i = 0; i < f->hdr->symbols.count; ++i) {
+		const struct AstFileSymbol *s = &f->symbols[i];
+		CHECK(s->name < f->hdr->strings.count, "bad symbol name");
+		CHECK(ref_ok(s->type, f->hdr->types.count, true),
+		      "bad symbol type");
+	}
+	return true;
+}
+
+static bool check_node_list(const struct AstFile *f, u32 list, u32 limit,
+			    const char **err)
+{
+	CHECK(list_ok(f, list), "bad node list");
+	const u32 *elems = astfile_list(f, list);
+	for (u32 k = 0; k < astfile_list_len(f, list); ++k)
+		CHECK(ref_ok(elems[k], limit, false), "bad node in list");
+	return true;
+}
+
+static bool check_nodes(const struct AstFile *f, const char **err)
+{
+	u64 nsyms = f->hdr->symbols.count;
+
+	for (u32 i = 0; i < f->hdr->nodes.count; ++i) {
+		const struct AstFileNode *n = &f->nodes[i];
+		CHECK(n->kind <= ND_FUNC, "bad node kind");
+		CHECK(ref_ok(n->type, f->hdr->types.count, true),
+		      "bad node type");
+
+		/* Children always precede their parent, so no cycles. */
+		switch ((NodeKind)n->kind) {
+		case ND_LIT_INT:
+		case ND_LIT_FLOAT:
+		case ND_LIT_DOUBLE:
+		case ND_LIT_BOOL:
+		case ND_BREAK:
+		case ND_CONTINUE:
+			break;
+		case ND_INIT_LIST:
+		case ND_BLOCK:
+			if (!check_node_list(f, n->a, i, err))
+				return false;
+			break;
+		case ND_VAR:
+			CHECK(ref_ok(n->a, nsyms, true), "bad var symbol");
+			break;
+		case ND_FUNC_CALL:
+			CHECK(n->a < f->hdr->strings.count, "bad callee name");
+			if (!check_node_list(f, n->b, i, err))
+				return false;
+			break;
+		case ND_NEG:
+		case ND_LOG_NOT:
+		case ND_CAST:
+		case ND_RETURN:
+		case ND_EXPR_STMT:
+			CHECK(ref_ok(n->a, i, true), "bad operand");
+			break;
+		case ND_ARRAY_ACCESS:
+		case ND_ADD:
+		case ND_SUB:
+		case ND_MUL:
+		case ND_DIV:
+		case ND_MOD:
+		case ND_EQ:
+		case ND_NE:
+		case ND_LT:
+		case ND_LE:
+		case ND_GT:
+		case ND_GE:
+		case ND_LOG_AND:
+		case ND_LOG_OR:
+		case ND_ASSIGN:
+			CHECK(ref_ok(n->a, i, true) && ref_ok(n->b, i, true),
+			      "bad operand");
+			break;
+		case ND_IF:
+			CHECK(ref_ok(n->a, i, true) && ref_ok(n->b, i, true) &&
+				      ref_ok(n->c, i, true),
+			      "bad if");
+			break;
+		case ND_WHILE:
+			CHECK(ref_ok(n->a, i, true) && ref_ok(n->b, i, true),
+			      "bad while");
+			break;
+		case ND_VAR_DECL:
+			CHECK(ref_ok(n->a, nsyms, true) &&
+				      ref_ok(n->b, i, true),
+			      "bad declaration");
+			break;
+		case ND_FUNC: {
+			CHECK(ref_ok(n->a, nsyms, true), "bad func symbol");
+			CHECK(list_ok(f, n->b), "bad param list");
+			const u32 *params = astfile_list(f, n->b);
+			for (u32 k = 0; k < astfile_list_len(f, n->b); ++k)
+				CHECK(ref_ok(params[k], nsyms, true),
+				      "bad param symbol");
+			CHECK(ref_ok(n->c, i, true), "bad func body");
+			break;
+		}
+		}
+	}
+	return true;
+}
+
+bool astfile_check(struct AstFile *f, const void *base, usize size,
+		   const char **err)
+{
+	const struct AstFileHeader *h = base;
+
+	CHECK((uintptr_t)base % 8 == 0, "misaligned buffer");
+	CHECK(size >= sizeof(*h), "file too small");
+	CHECK(memcmp(h->magic, AST_FILE_MAGIC, sizeof(AST_FILE_MAGIC)) == 0,
+	      "not a CACT AST file");
+	CHECK(h->version == AST_FILE_VERSION, "unsupported AST file version");
+	CHECK(h->file_size == size, "truncated AST file");
+
+	CHECK(section_ok(&h->strings, size, 1), "bad string section");
+	CHECK(section_ok(&h->types, size, sizeof(struct AstFileType)),
+	      "bad type section");
+	CHECK(section_ok(&h->symbols, size, sizeof(struct AstFileSymbol)),
+	      "bad symbol section");
+	CHECK(section_ok(&h->nodes, size, sizeof(struct AstFileNode)),
+	      "bad node section");
+	CHECK(section_ok(&h->lists, size, sizeof(u32)), "bad list section");
+
+	f->base = base;
+	f->size = size;
+	f->hdr = h;
+	f->strings = (const char *)f->base + h->strings.offset;
+	f->types = (const void *)(f->base + h->types.offset);
+	f->symbols = (const void *)(f->base + h->symbols.offset);
+	f->nodes = (const void *)(f->base + h->nodes.offset);
+	f->lists = (const void *)(f->base + h->lists.offset);
+
+	/* With a trailing NUL every in-range offset is a valid C string. */
+	CHECK(h->strings.count > 0 && f->strings[h->strings.count - 1] == '\0',
+	      "unterminated string table");
+
+	if (!check_types(f, err) || !check_symbols(f, err) ||
+	    !check_nodes(f, err))
+		return false;
+
+	return check_node_list(f, h->roots, (u32)h->nodes.count, err);
+}
+
+#undef CHECK
+
+/*
+ * ==========================================================================
+ * 5. Mapping
+ * ==========================================================================
+ */
+
+bool astfile_map(struct AstFile *f, const char *path, const char **err)
+{
+	f->mapped = false;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		*err = "cannot open file";
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		*err = "cannot stat file";
+		return false;
+	}
+
+	void *base = mmap(NULL, (usize)st.st_size, PROT_READ, MAP_PRIVATE, fd,
+			  0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		*err = "mmap failed";
+		return false;
+	}
+
+	if (!astfile_check(f, base, (usize)st.st_size, err)) {
+		munmap(base, (usize)st.st_size);
+		return false;
+	}
+
+	f->mapped = true;
+	return true;
+}
+
+void astfile_unmap(struct AstFile *f)
+{
+	if (f->mapped)
+		munmap((void *)f->base, f->size);
+	f->mapped = false;
+}
@@ -0,0 +1,329 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <cache.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * ==========================================================================
+ * 1. Hashing
+ * ==========================================================================
+ */
+
+#define HASH_P0 0xa0761d6478bd642full
+#define HASH_P1 0xe7037ed1a0b428dbull
+#define HASH_P2 0x8ebc6af09c88c6e3ull
+
+static inline u64 hash_mix(u64 a, u64 b)
+{
+	__uint128_t r = (__uint128_t)a * b;
+	return (u64)r ^ (u64)(r >> 64);
+}
+
+static inline u64 hash_read(const u8 *p, usize n)
+{
+	u64 v = 0;
+	memcpy(&v, p, n);
+	return v;
+}
+
+void cache_key_feed(struct CacheKey *key, str_t bytes)
+{
+	const u8 *p = (const u8 *)bytes.ptr;
+	usize n = bytes.len;
+	u64 lo = key->lo ^ HASH_P0;
+	u64 hi = key->hi ^ HASH_P1;
+
+	while (n >= 8) {
+		u64 w = hash_read(p, 8);
+		lo = hash_mix(lo ^ w, HASH_P1);
+		hi = hash_mix(hi ^ w ^ lo, HASH_P2);
+		p += 8;
+		n -= 8;
+	}
+	if (n > 0) {
+		u64 w = hash_read(p, n);
+		lo = hash_mix(lo ^ w, HASH_P1);
+		hi = hash_mix(hi ^ w ^ lo, HASH_P2);
+	}
+
+	/* Fold in the length so ("ab","c") and ("a","bc") differ. */
+	key->lo = hash_mix(lo ^ bytes.len, HASH_P2);
+	key->hi = hash_mix(hi ^ key->lo, HASH_P0);
+}
+
+bool cache_key_feed_file(struct CacheKey *key, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	char buf[64 << 10];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		cache_key_feed(key, str_from_parts(buf, (usize)n));
+	close(fd);
+	return n == 0;
+}
+
+/*
+ * ==========================================================================
+ * 2. On-disk Layout
+ * ==========================================================================
+ * One file per entry, named by the hex key:
+ *
+ *   <dir>/<32 hex digits>.cce = CacheHeader | diag | output | code bytes
+ */
+
+#define CACHE_MAGIC "CACTCCE1"
+#define CACHE_FORMAT_VERSION 2
+#define CACHE_EXT ".cce"
+
+struct CacheHeader {
+	char magic[8];
+	u32 version;
+	u32 success;
+	u64 key_lo;
+	u64 key_hi;
+	u64 diag_len;
+	u64 output_len;
+	u64 code_len;
+};
+
+static void entry_path(struct Cache *c, struct CacheKey key, char *buf,
+		       usize size)
+{
+	snprintf(buf, size, "%s/%016llx%016llx" CACHE_EXT, c->dir,
+		 (unsigned long long)key.hi, (unsigned long long)key.lo);
+}
+
+static bool mkdir_p(const char *dir)
+{
+	char buf[4096];
+	usize len = strlen(dir);
+	if (len == 0 || len >= sizeof(buf))
+		return false;
+	memcpy(buf, dir, len + 1);
+
+	for (usize i = 1; i <= len; ++i) {
+		if (buf[i] != '/' && buf[i] != '\0')
+			continue;
+		char saved = buf[i];
+		buf[i] = '\0';
+		if (mkdir(buf, 0755) != 0 && errno != EEXIST)
+			return false;
+		buf[i] = saved;
+	}
+	return true;
+}
+
+bool cache_open(struct Cache *c, const char *dir, u64 max_bytes)
+{
+	c->dir = dir;
+	c->max_bytes = max_bytes;
+	return mkdir_p(dir);
+}
+
+/*
+ * ==========================================================================
+ * 3. Lookup
+ * ==========================================================================
+ */
+
+bool cache_lookup(struct Cache *c, struct CacheKey key, allocer_t alc,
+		  struct CacheEntry *out)
+{
+	char path[4096];
+	entry_path(c, key, path, sizeof(path));
+
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return false;
+
+	struct CacheHeader h;
+	bool ok = fread(&h, sizeof(h), 1, f) == 1 &&
+		  memcmp(h.magic, CACHE_MAGIC, 8) == 0 &&
+		  h.version == CACHE_FORMAT_VERSION && h.key_lo == key.lo &&
+		  h.key_hi == key.hi;
+
+	struct stat st;
+	ok = ok && fstat(fileno(f), &st) == 0 &&
+	     (u64)st.st_size >= sizeof(h);
+	if (ok) {
+		/* A truncated or foreign file is treated as a miss. The lengths
+		 * are untrusted: bound each by what is left of the file instead
+		 * of adding them, which could wrap. */
+		u64 rest = (u64)st.st_size - sizeof(h);
+		ok = h.diag_len <= rest && h.output_len <= rest - h.diag_len &&
+		     h.code_len == rest - h.diag_len - h.output_len;
+	}
+
+	char *blob = NULL;
+	usize blob_len =
+		ok ? (usize)(h.diag_len + h.output_len + h.code_len) : 0;
+	if (ok) {
+		blob = allocer_alloc(alc, layout(blob_len + 1, 1));
+		ok = blob && (blob_len == 0 ||
+			      fread(blob, 1, blob_len, f) == blob_len);
+	}
+	fclose(f);
+
+	if (!ok)
+		return false;
+
+	out->success = h.success != 0;
+	out->diag = str_from_parts(blob, h.diag_len);
+	out->output = str_from_parts(blob + h.diag_len, h.output_len);
+	out->code = str_from_parts(blob + h.diag_len + h.output_len,
+				   h.code_len);
+
+	/* Refresh mtime: it is the recency clock used by eviction. */
+	utimensat(AT_FDCWD, path, NULL, 0);
+	return true;
+}
+
+/*
+ * ==========================================================================
+ * 4. Store & Eviction
+ * ==========================================================================
+ */
+
+struct CacheFile {
+	char name[64];
+	u64 size;
+	struct timespec mtime;
+};
+
+static int cmp_oldest_first(const void *lhs, const void *rhs)
+{
+	const struct CacheFile *a = lhs;
+	const struct CacheFile *b = rhs;
+	if (a->mtime.tv_sec != b->mtime.tv_sec)
+		return a->mtime.tv_sec < b->mtime.tv_sec ? -1 : 1;
+	if (a->mtime.tv_nsec != b->mtime.tv_nsec)
+		return a->mtime.tv_nsec < b->mtime.tv_nsec ? -1 : 1;
+	return 0;
+}
+
+static void cache_evict(struct Cache *c)
+{
+	DIR *d = opendir(c->dir);
+	if (!d)
+		return;
+
+	allocer_t sys = allocer_system();
+	usize cap = 64, len = 0;
+	struct CacheFile *files =
+		allocer_alloc(sys, layout(cap * sizeof(*files), 8));
+	u64 total = 0;
+
+	struct dirent *de;
+	while (files && (de = readdir(d)) != NULL) {
+		usize n = strlen(de->d_name);
+		if (n >= sizeof(files->name) || n <= strlen(CACHE_EXT) ||
+		    strcmp(de->d_name + n - strlen(CACHE_EXT), CACHE_EXT) != 0)
+			continue;
+
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", c->dir, de->d_name);
+		struct stat st;
+		if (stat(path, &st) != 0)
+			continue;
+
+		if (len == cap) {
+			struct CacheFile *grown = allocer_realloc(
+				sys, files, layout(cap * sizeof(*files), 8),
+				cap * 2 * sizeof(*files));
+			/* Evict by what was listed so far. */
+			if (!grown)
+				break;
+			files = grown;
+			cap *= 2;
+		}
+		memcpy(files[len].name, de->d_name, n + 1);
+		files[len].size = (u64)st.st_size;
+		files[len].mtime = st.st_mtim;
+		total += (u64)st.st_size;
+		len++;
+	}
+	closedir(d);
+
+	if (files && total > c->max_bytes) {
+		qsort(files, len, sizeof(*files), cmp_oldest_first);
+		for (usize i = 0; i < len && total > c->max_bytes; ++i) {
+			char path[4096];
+			snprintf(path, sizeof(path), "%s/%s", c->dir,
+				 files[i].name);
+			if (unlink(path) == 0)
+				total -= files[i].size;
+		}
+	}
+
+	if (files)
+		allocer_free(sys, files, layout(cap * sizeof(*files), 8));
+}
+
+bool cache_store(struct Cache *c, struct CacheKey key,
+		 const struct CacheEntry *e)
+{
+	char path[4096];
+	char tmp[4160];
+	entry_path(c, key, path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.tmp.%ld", path, (long)getpid());
+
+	FILE *f = fopen(tmp, "wb");
+	if (!f) {
+		log_warn("cache: cannot write '%s'", tmp);
+		return false;
+	}
+
+	struct CacheHeader h = { 0 };
+	memcpy(h.magic, CACHE_MAGIC, 8);
+	h.version = CACHE_FORMAT_VERSION;
+	h.success = e->success ? 1 : 0;
+	h.key_lo = key.lo;
+	h.key_hi = key.hi;
+	h.diag_len = e->diag.len;
+	h.output_len = e->output.len;
+	h.code_len = e->code.len;
+
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+		  fwrite(e->diag.ptr, 1, e->diag.len, f) == e->diag.len &&
+		  fwrite(e->output.ptr, 1, e->output.len, f) == e->output.len &&
+		  fwrite(e->code.ptr, 1, e->code.len, f) == e->code.len;
+	ok = fflush(f) == 0 && ok;
+	ok = fsync(fileno(f)) == 0 && ok;
+	ok = fclose(f) == 0 && ok;
+
+	/* rename(2) is atomic: readers see either no entry or a whole one. */
+	if (!ok || rename(tmp, path) != 0) {
+		unlink(tmp);
+		return false;
+	}
+
+	cache_evict(c);
+	return true;
+}
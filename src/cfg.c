@@ -0,0 +1,860 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <cfg.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Storage
+ * ==========================================================================
+ */
+
+/* Makes room for `words` words and starts carving from the beginning. */
+static void buf_reset(struct IrBuf *b, usize words)
+{
+	b->used = 0;
+	if (words <= b->cap)
+		return;
+	allocer_t sys = allocer_system();
+	usize cap = b->cap ? b->cap : 64;
+	while (cap < words)
+		cap *= 2;
+	if (b->data)
+		allocer_free(sys, b->data, layout(b->cap * sizeof(u64), 8));
+	b->data = allocer_alloc(sys, layout(cap * sizeof(u64), 8));
+	massert(b->data, "OOM cfg");
+	b->cap = cap;
+}
+
+/* `n` zeroed u32s. */
+static u32 *carve(struct IrBuf *b, usize n)
+{
+	usize words = (n + 1) / 2;
+	massert(b->used + words <= b->cap, "cfg: storage overflow");
+	u32 *p = (u32 *)(b->data + b->used);
+	if (words)
+		memset(p, 0, words * sizeof(u64));
+	b->used += words;
+	return p;
+}
+
+static u64 *carve_bits(struct IrBuf *b, usize words)
+{
+	return (u64 *)carve(b, 2 * words);
+}
+
+/* Words for `n` u32s. */
+static usize u32s(usize n)
+{
+	return (n + 1) / 2;
+}
+
+void ir_buf_deinit(struct IrBuf *b)
+{
+	if (b->data)
+		allocer_free(allocer_system(), b->data,
+			     layout(b->cap * sizeof(u64), 8));
+	*b = (struct IrBuf){ 0 };
+}
+
+/*
+ * ==========================================================================
+ * 2. Control Flow Graph
+ * ==========================================================================
+ */
+
+void ir_cfg_build(struct IrCfg *cfg, const struct IrFunc *fn)
+{
+	u32 n = (u32)vec_len(fn->blocks);
+	u32 nedges = 0;
+	for (u32 bb = 1; bb < n; ++bb) {
+		u32 succ[2];
+		nedges += ir_succs(fn, bb, succ);
+	}
+
+	/* succ/pred starts, edges twice, rpo, rpo_index; DFS stack, next. */
+	buf_reset(&cfg->buf, 4 * u32s(n + 1) + 2 * u32s(nedges) +
+				     4 * u32s(n));
+	cfg->nblocks = n;
+	cfg->succ_start = carve(&cfg->buf, n + 1);
+	cfg->pred_start = carve(&cfg->buf, n + 1);
+	cfg->succs = carve(&cfg->buf, nedges);
+	cfg->preds = carve(&cfg->buf, nedges);
+	cfg->rpo = carve(&cfg->buf, n);
+	cfg->rpo_index = carve(&cfg->buf, n);
+
+	for (u32 bb = 1; bb < n; ++bb) {
+		u32 succ[2];
+		u32 k = ir_succs(fn, bb, succ);
+		cfg->succ_start[bb + 1] = cfg->succ_start[bb];
+		for (u32 i = 0; i < k; ++i) {
+			cfg->succs[cfg->succ_start[bb + 1]++] = succ[i];
+			cfg->pred_start[succ[i] + 1]++;
+		}
+	}
+	for (u32 bb = 1; bb <= n; ++bb)
+		cfg->pred_start[bb] += cfg->pred_start[bb - 1];
+
+	/* `fill` borrows rpo_index, cleared again below. */
+	u32 *fill = cfg->rpo_index;
+	for (u32 bb = 1; bb < n; ++bb) {
+		for (u32 e = cfg->succ_start[bb]; e < cfg->succ_start[bb + 1];
+		     ++e) {
+			u32 s = cfg->succs[e];
+			cfg->preds[cfg->pred_start[s] + fill[s]++] = bb;
+		}
+	}
+
+	/* Iterative DFS; `next` is how many successors have been pushed. */
+	u32 *stack = carve(&cfg->buf, n);
+	u32 *next = carve(&cfg->buf, n);
+	for (u32 bb = 0; bb < n; ++bb)
+		cfg->rpo_index[bb] = IR_UNREACHABLE;
+	u32 top = 0, done = 0;
+	if (n > 1) {
+		stack[top++] = 1;
+		cfg->rpo_index[1] = 0;
+	}
+	while (top) {
+		u32 bb = stack[top - 1];
+		u32 e = cfg->succ_start[bb] + next[bb];
+		if (e < cfg->succ_start[bb + 1]) {
+			next[bb]++;
+			u32 s = cfg->succs[e];
+			if (cfg->rpo_index[s] == IR_UNREACHABLE) {
+				cfg->rpo_index[s] = 0;
+				stack[top++] = s;
+			}
+			continue;
+		}
+		cfg->rpo[done++] = bb;
+		top--;
+	}
+
+	/* Postorder to reverse postorder. */
+	for (u32 i = 0; i < done / 2; ++i) {
+		u32 t = cfg->rpo[i];
+		cfg->rpo[i] = cfg->rpo[done - 1 - i];
+		cfg->rpo[done - 1 - i] = t;
+	}
+	cfg->nrpo = done;
+	for (u32 i = 0; i < done; ++i)
+		cfg->rpo_index[cfg->rpo[i]] = i;
+}
+
+/*
+ * ==========================================================================
+ * 3. Dominators
+ * ==========================================================================
+ * One builder serves the CFG and its reverse: it only needs the nodes in
+ * reverse postorder from the root and each node's predecessors.
+ */
+
+struct Graph {
+	u32 n;
+	u32 root;
+	const u32 *rpo;
+	u32 nrpo;
+	const u32 *rpo_index;
+	const u32 *pred_start;
+	const u32 *preds;
+};
+
+static u32 intersect(const struct Graph *g, const u32 *idom, u32 a, u32 b)
+{
+	while (a != b) {
+		while (g->rpo_index[a] > g->rpo_index[b])
+			a = idom[a];
+		while (g->rpo_index[b] > g->rpo_index[a])
+			b = idom[b];
+	}
+	return a;
+}
+
+static void dom_build(struct IrDomTree *dt, const struct Graph *g)
+{
+	u32 n = g->n;
+	/* idom, child_start, children, pre, post; fill, stack. */
+	buf_reset(&dt->buf, 6 * u32s(n) + u32s(n + 1));
+	dt->idom = carve(&dt->buf, n);
+	dt->child_start = carve(&dt->buf, n + 1);
+	dt->children = carve(&dt->buf, n);
+	dt->pre = carve(&dt->buf, n);
+	dt->post = carve(&dt->buf, n);
+	if (!g->nrpo)
+		return;
+
+	/* IR_UNREACHABLE until known, as the root may be 0. */
+	for (u32 bb = 0; bb < n; ++bb)
+		dt->idom[bb] = IR_UNREACHABLE;
+	dt->idom[g->root] = g->root;
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (u32 i = 1; i < g->nrpo; ++i) {
+			u32 bb = g->rpo[i];
+			u32 idom = IR_UNREACHABLE;
+			for (u32 p = g->pred_start[bb];
+			     p < g->pred_start[bb + 1]; ++p) {
+				u32 pred = g->preds[p];
+				if (dt->idom[pred] == IR_UNREACHABLE)
+					continue;
+				if (idom != IR_UNREACHABLE)
+					pred = intersect(g, dt->idom, pred,
+							 idom);
+				idom = pred;
+			}
+			if (dt->idom[bb] != idom) {
+				dt->idom[bb] = idom;
+				changed = true;
+			}
+		}
+	}
+	for (u32 bb = 0; bb < n; ++bb)
+		if (dt->idom[bb] == IR_UNREACHABLE)
+			dt->idom[bb] = IR_NONE;
+
+	/* Children in reverse postorder. */
+	for (u32 i = 1; i < g->nrpo; ++i)
+		dt->child_start[dt->idom[g->rpo[i]] + 1]++;
+	for (u32 bb = 1; bb <= n; ++bb)
+		dt->child_start[bb] += dt->child_start[bb - 1];
+	u32 *fill = carve(&dt->buf, n);
+	for (u32 i = 1; i < g->nrpo; ++i) {
+		u32 bb = g->rpo[i], d = dt->idom[bb];
+		dt->children[dt->child_start[d] + fill[d]++] = bb;
+	}
+
+	u32 *stack = carve(&dt->buf, n);
+	u32 top = 0, clock = 0;
+	memset(fill, 0, n * sizeof(u32));
+	stack[top++] = g->root;
+	dt->pre[g->root] = ++clock;
+	while (top) {
+		u32 bb = stack[top - 1];
+		u32 c = dt->child_start[bb] + fill[bb];
+		if (c < dt->child_start[bb + 1]) {
+			fill[bb]++;
+			stack[top++] = dt->children[c];
+			dt->pre[dt->children[c]] = ++clock;
+			continue;
+		}
+		dt->post[bb] = clock;
+		top--;
+	}
+}
+
+void ir_domtree_build(struct IrDomTree *dt, const struct IrCfg *cfg)
+{
+	struct Graph g = {
+		.n = cfg->nblocks,
+		.root = cfg->nrpo ? cfg->rpo[0] : IR_NONE,
+		.rpo = cfg->rpo,
+		.nrpo = cfg->nrpo,
+		.rpo_index = cfg->rpo_index,
+		.pred_start = cfg->pred_start,
+		.preds = cfg->preds,
+	};
+	dom_build(dt, &g);
+}
+
+/*
+ * The reverse CFG is searched from the exit, whose successors are the
+ * returning blocks. When the search runs out, the last block in reverse
+ * postorder that it has not reached cannot reach a return: it becomes a
+ * successor of the exit too, and the search goes on.
+ */
+void ir_postdomtree_build(struct IrPostDomTree *pdt, const struct IrCfg *cfg)
+{
+	u32 n = cfg->nblocks;
+	u32 nedges = cfg->succ_start[n];
+	/* exits, rpo, rpo_index, pred_start, preds; DFS stack, next. */
+	buf_reset(&pdt->buf, 6 * u32s(n) + u32s(n + 1) + u32s(nedges + n));
+	u32 *exits = carve(&pdt->buf, n);
+	u32 *rpo = carve(&pdt->buf, n);
+	u32 *rpo_index = carve(&pdt->buf, n);
+	u32 *pred_start = carve(&pdt->buf, n + 1);
+	u32 *preds = carve(&pdt->buf, nedges + n);
+	u32 *stack = carve(&pdt->buf, n);
+	u32 *next = carve(&pdt->buf, n);
+
+	u32 nexits = 0;
+	for (u32 i = 0; i < cfg->nrpo; ++i) {
+		u32 bb = cfg->rpo[i];
+		if (cfg->succ_start[bb] == cfg->succ_start[bb + 1])
+			exits[nexits++] = bb;
+	}
+
+	for (u32 bb = 0; bb < n; ++bb)
+		rpo_index[bb] = IR_UNREACHABLE;
+	u32 top = 0, done = 0, scan = cfg->nrpo;
+	if (cfg->nrpo) {
+		stack[top++] = 0;
+		rpo_index[0] = 0;
+	}
+	while (top) {
+		u32 bb = stack[top - 1];
+		u32 s = IR_UNREACHABLE;
+		if (bb == 0) {
+			while (next[0] == nexits && scan > 0) {
+				u32 last = cfg->rpo[--scan];
+				if (rpo_index[last] == IR_UNREACHABLE)
+					exits[nexits++] = last;
+			}
+			if (next[0] < nexits)
+				s = exits[next[0]++];
+		} else {
+			u32 e = cfg->pred_start[bb] + next[bb];
+			if (e < cfg->pred_start[bb + 1]) {
+				next[bb]++;
+				s = cfg->preds[e];
+				if (!ir_cfg_reachable(cfg, s))
+					continue;
+			}
+		}
+		if (s == IR_UNREACHABLE) {
+			rpo[done++] = bb;
+			top--;
+		} else if (rpo_index[s] == IR_UNREACHABLE) {
+			rpo_index[s] = 0;
+			stack[top++] = s;
+		}
+	}
+	for (u32 i = 0; i < done / 2; ++i) {
+		u32 t = rpo[i];
+		rpo[i] = rpo[done - 1 - i];
+		rpo[done - 1 - i] = t;
+	}
+	for (u32 i = 0; i < done; ++i)
+		rpo_index[rpo[i]] = i;
+
+	/* A block's predecessors here are its successors, and the exit. */
+	for (u32 i = 0; i < cfg->nrpo; ++i) {
+		u32 bb = cfg->rpo[i];
+		pred_start[bb + 1] =
+			cfg->succ_start[bb + 1] - cfg->succ_start[bb];
+	}
+	for (u32 i = 0; i < nexits; ++i)
+		pred_start[exits[i] + 1]++;
+	for (u32 bb = 1; bb <= n; ++bb)
+		pred_start[bb] += pred_start[bb - 1];
+	for (u32 i = 0; i < cfg->nrpo; ++i) {
+		u32 bb = cfg->rpo[i], k = pred_start[bb];
+		for (u32 e = cfg->succ_start[bb]; e < cfg->succ_start[bb + 1];
+		     ++e)
+			preds[k++] = cfg->succs[e];
+	}
+	for (u32 i = 0; i < nexits; ++i)
+		preds[pred_start[exits[i] + 1] - 1] = 0;
+
+	struct Graph g = {
+		.n = n,
+		.root = 0,
+		.rpo = rpo,
+		.nrpo = done,
+		.rpo_index = rpo_index,
+		.pred_start = pred_start,
+		.preds = preds,
+	};
+	dom_build(&pdt->tree, &g);
+}
+
+/*
+ * Cooper, Harvey and Kennedy's walk: from each predecessor of a join up
+ * the tree to the join's immediate dominator, the join is in the
+ * frontier of every block passed. A walk that reaches a block an
+ * earlier one passed has nothing left to add.
+ */
+static void frontier_walk(const struct IrCfg *cfg, const struct IrDomTree *dt,
+			  u32 *seen, u32 *count, u32 *start, u32 *blocks)
+{
+	for (u32 i = 0; i < cfg->nrpo; ++i) {
+		u32 bb = cfg->rpo[i];
+		if (cfg->pred_start[bb + 1] - cfg->pred_start[bb] < 2)
+			continue;
+		for (u32 p = cfg->pred_start[bb]; p < cfg->pred_start[bb + 1];
+		     ++p) {
+			u32 runner = cfg->preds[p];
+			if (!ir_cfg_reachable(cfg, runner))
+				continue;
+			for (; runner != dt->idom[bb];
+			     runner = dt->idom[runner]) {
+				if (seen[runner] == bb)
+					break;
+				seen[runner] = bb;
+				if (blocks)
+					blocks[start[runner] +
+					       count[runner]] = bb;
+				count[runner]++;
+			}
+		}
+	}
+}
+
+void ir_domfrontier_build(struct IrDomFrontier *df, const struct IrCfg *cfg,
+			  const struct IrDomTree *dt)
+{
+	u32 n = cfg->nblocks;
+	/* start; seen, count. */
+	buf_reset(&df->buf, u32s(n + 1) + 2 * u32s(n));
+	df->start = carve(&df->buf, n + 1);
+	u32 *seen = carve(&df->buf, n);
+	u32 *count = carve(&df->buf, n);
+
+	frontier_walk(cfg, dt, seen, count, NULL, NULL);
+	for (u32 bb = 0; bb < n; ++bb)
+		df->start[bb + 1] = df->start[bb] + count[bb];
+
+	buf_reset(&df->list, u32s(df->start[n]));
+	df->blocks = carve(&df->list, df->start[n]);
+	memset(seen, 0, n * sizeof(u32));
+	memset(count, 0, n * sizeof(u32));
+	frontier_walk(cfg, dt, seen, count, df->start, df->blocks);
+}
+
+/*
+ * ==========================================================================
+ * 4. Loops
+ * ==========================================================================
+ * Headers are visited in postorder, so inner loops are found first. A
+ * backward walk from the latches collects the body; a block already in
+ * a loop stands for that loop's outermost known ancestor, which becomes
+ * a child of the new loop. The blocks are then laid out so that each
+ * loop's are one range that holds its children's.
+ */
+
+/* The outermost loop found so far that contains loop `l`. */
+static u32 outermost(const struct IrLoops *li, u32 l)
+{
+	while (li->loops[l].parent)
+		l = li->loops[l].parent;
+	return l;
+}
+
+/*
+ * Adds `bb` to loop `l`, or the outermost loop around it that has no
+ * parent yet as a child of `l`, and pushes the block to walk on from.
+ * Each block is pushed at most once per loop.
+ */
+static u32 claim(struct IrLoops *li, u32 l, u32 bb, u32 *stack, u32 top)
+{
+	u32 inner = li->loop_of[bb];
+	if (!inner) {
+		li->loop_of[bb] = l;
+		stack[top++] = bb;
+		return top;
+	}
+	inner = outermost(li, inner);
+	if (inner != l) {
+		li->loops[inner].parent = l;
+		stack[top++] = li->loops[inner].header;
+	}
+	return top;
+}
+
+static void find_loops(struct IrLoops *li, const struct IrCfg *cfg,
+		       const struct IrDomTree *dt, u32 *stack)
+{
+	for (u32 i = cfg->nrpo; i-- > 0;) {
+		u32 h = cfg->rpo[i];
+		bool header = false;
+		for (u32 p = cfg->pred_start[h]; p < cfg->pred_start[h + 1];
+		     ++p)
+			header |= ir_dominates(dt, h, cfg->preds[p]);
+		if (!header)
+			continue;
+
+		u32 l = ++li->nloops, top = 0;
+		li->loops[l] = (struct IrLoop){ .header = h };
+		li->loop_of[h] = l;
+		for (u32 p = cfg->pred_start[h]; p < cfg->pred_start[h + 1];
+		     ++p) {
+			u32 latch = cfg->preds[p];
+			if (ir_dominates(dt, h, latch))
+				top = claim(li, l, latch, stack, top);
+		}
+		while (top) {
+			u32 bb = stack[--top];
+			for (u32 p = cfg->pred_start[bb];
+			     p < cfg->pred_start[bb + 1]; ++p) {
+				u32 pred = cfg->preds[p];
+				if (ir_cfg_reachable(cfg, pred))
+					top = claim(li, l, pred, stack, top);
+			}
+		}
+	}
+}
+
+/*
+ * A loop's range holds its own blocks, then its children's ranges.
+ * Parents are numbered after their children, so sizes add up in
+ * ascending order and ranges are handed out in descending order.
+ */
+static void lay_out(struct IrLoops *li, const struct IrCfg *cfg, u32 *size,
+		    u32 *fill)
+{
+	struct IrLoop *loops = li->loops;
+	for (u32 i = 0; i < cfg->nrpo; ++i)
+		size[li->loop_of[cfg->rpo[i]]]++;
+	for (u32 l = 0; l <= li->nloops; ++l)
+		fill[l] = size[l];
+	for (u32 l = 1; l <= li->nloops; ++l)
+		size[loops[l].parent] += size[l];
+
+	loops[0].end = size[0];
+	for (u32 l = li->nloops; l >= 1; --l) {
+		struct IrLoop *p = &loops[loops[l].parent];
+		loops[l].depth = p->depth + 1;
+		/* fill[parent] is where its next child goes. */
+		loops[l].begin = p->begin + fill[loops[l].parent];
+		loops[l].end = loops[l].begin + size[l];
+		fill[loops[l].parent] += size[l];
+		li->child_start[loops[l].parent + 1]++;
+	}
+	for (u32 l = 1; l <= li->nloops + 1; ++l)
+		li->child_start[l] += li->child_start[l - 1];
+
+	/* Blocks in reverse postorder at the start of their loop's range;
+	 * `size` counts them off again. */
+	memset(size, 0, ((usize)li->nloops + 1) * sizeof(u32));
+	for (u32 i = 0; i < cfg->nrpo; ++i) {
+		u32 bb = cfg->rpo[i], l = li->loop_of[bb];
+		u32 pos = loops[l].begin + size[l]++;
+		li->blocks[pos] = bb;
+		li->pos[bb] = pos;
+	}
+
+	memset(fill, 0, ((usize)li->nloops + 1) * sizeof(u32));
+	for (u32 l = li->nloops; l >= 1; --l) {
+		u32 p = loops[l].parent;
+		li->children[li->child_start[p] + fill[p]++] = l;
+	}
+}
+
+/* Counts the exits of each loop, or lists them once `exits` is set. */
+static u32 find_exits(struct IrLoops *li, const struct IrCfg *cfg, u32 *seen,
+		      u32 *exits)
+{
+	u32 total = 0;
+	for (u32 l = 1; l <= li->nloops; ++l) {
+		struct IrLoop *loop = &li->loops[l];
+		loop->exit_begin = total;
+		for (u32 k = loop->begin; k < loop->end; ++k) {
+			u32 bb = li->blocks[k];
+			for (u32 e = cfg->succ_start[bb];
+			     e < cfg->succ_start[bb + 1]; ++e) {
+				u32 s = cfg->succs[e];
+				if (seen[s] == l || ir_loop_contains(li, l, s))
+					continue;
+				seen[s] = l;
+				if (exits)
+					exits[total] = s;
+				total++;
+			}
+		}
+		loop->exit_end = total;
+	}
+	return total;
+}
+
+static u32 find_preheader(const struct IrLoops *li, const struct IrCfg *cfg,
+			  u32 l)
+{
+	u32 h = li->loops[l].header, outside = IR_NONE;
+	for (u32 p = cfg->pred_start[h]; p < cfg->pred_start[h + 1]; ++p) {
+		u32 pred = cfg->preds[p];
+		if (!ir_cfg_reachable(cfg, pred) ||
+		    ir_loop_contains(li, l, pred))
+			continue;
+		if (outside)
+			return IR_NONE;
+		outside = pred;
+	}
+	if (!outside ||
+	    cfg->succ_start[outside + 1] - cfg->succ_start[outside] != 1)
+		return IR_NONE;
+	return outside;
+}
+
+void ir_loops_build(struct IrLoops *li, const struct IrCfg *cfg,
+		    const struct IrDomTree *dt)
+{
+	u32 n = cfg->nblocks;
+	usize loop_words = sizeof(struct IrLoop) / sizeof(u32);
+	/* Loops (at most one per block, and the root), loop_of, blocks,
+	 * pos, child_start, children; stack, size, fill. */
+	buf_reset(&li->buf, u32s(loop_words * ((usize)n + 1)) +
+				    7 * u32s((usize)n + 2));
+	li->loops = (struct IrLoop *)carve(&li->buf,
+					   loop_words * ((usize)n + 1));
+	li->loop_of = carve(&li->buf, n);
+	li->blocks = carve(&li->buf, n);
+	li->pos = carve(&li->buf, n);
+	li->child_start = carve(&li->buf, n + 2);
+	li->children = carve(&li->buf, n);
+	u32 *stack = carve(&li->buf, n + 2);
+	u32 *size = carve(&li->buf, n + 2);
+	li->nloops = 0;
+
+	find_loops(li, cfg, dt, stack);
+	for (u32 bb = 0; bb < n; ++bb)
+		li->pos[bb] = IR_UNREACHABLE;
+	lay_out(li, cfg, size, stack);
+
+	memset(stack, 0, n * sizeof(u32));
+	u32 total = find_exits(li, cfg, stack, NULL);
+	buf_reset(&li->exit_buf, u32s(total));
+	li->exits = carve(&li->exit_buf, total);
+	memset(stack, 0, n * sizeof(u32));
+	find_exits(li, cfg, stack, li->exits);
+
+	for (u32 l = 1; l <= li->nloops; ++l)
+		li->loops[l].preheader = find_preheader(li, cfg, l);
+}
+
+/*
+ * ==========================================================================
+ * 5. Liveness
+ * ==========================================================================
+ * Blocks are visited in postorder, which settles acyclic code in one
+ * round; loops take a round more per nesting level.
+ */
+
+static void set_bit(u64 *set, u32 i)
+{
+	set[i / 64] |= 1ull << (i % 64);
+}
+
+static bool test_bit(const u64 *set, u32 i)
+{
+	return (set[i / 64] >> (i % 64)) & 1;
+}
+
+void ir_liveness_build(struct IrLiveness *lv, const struct IrFunc *fn,
+		       const struct IrCfg *cfg)
+{
+	u32 nvals = (u32)vec_len(fn->insts);
+	u32 n = cfg->nblocks;
+
+	/* Number the values used outside their block. */
+	buf_reset(&lv->buf, 2 * u32s(nvals));
+	lv->index = carve(&lv->buf, nvals);
+	lv->values = carve(&lv->buf, nvals);
+	lv->nvalues = 0;
+	for (IrValue v = 0; v < nvals; ++v)
+		lv->index[v] = IR_UNREACHABLE;
+	for (u32 bb = 1; bb < n; ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			bool phi = ir_inst(fn, v)->op == IrOp_PHI;
+			const IrValue *args = ir_args(fn, v);
+			ir_foreach_operand(fn, v, i)
+			{
+				IrValue u = args[i];
+				const struct IrInst *def = ir_inst(fn, u);
+				bool local = def->block == bb && !phi;
+				/* Constants and globals are not in a block. */
+				if (!def->block && def->op != IrOp_PARAM)
+					continue;
+				if (local || lv->index[u] != IR_UNREACHABLE)
+					continue;
+				lv->index[u] = lv->nvalues;
+				lv->values[lv->nvalues++] = u;
+			}
+		}
+	}
+
+	u32 W = lv->words = (lv->nvalues + 63) / 64;
+	usize set = (usize)n * W;
+	buf_reset(&lv->bits, 4 * set);
+	lv->live_in = carve_bits(&lv->bits, set);
+	lv->live_out = carve_bits(&lv->bits, set);
+	u64 *gen = carve_bits(&lv->bits, set);
+	u64 *kill = carve_bits(&lv->bits, set);
+	if (!W)
+		return;
+
+	for (u32 bb = 1; bb < n; ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			if (lv->index[v] != IR_UNREACHABLE)
+				set_bit(kill + (usize)bb * W, lv->index[v]);
+			if (ir_inst(fn, v)->op == IrOp_PHI)
+				continue;
+			const IrValue *args = ir_args(fn, v);
+			ir_foreach_operand(fn, v, i)
+			{
+				IrValue u = args[i];
+				if (lv->index[u] != IR_UNREACHABLE &&
+				    ir_inst(fn, u)->block != bb)
+					set_bit(gen + (usize)bb * W,
+						lv->index[u]);
+			}
+		}
+	}
+
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (u32 i = cfg->nrpo; i-- > 0;) {
+			u32 bb = cfg->rpo[i];
+			u64 *lo = lv->live_out + (usize)bb * W;
+			u64 *li = lv->live_in + (usize)bb * W;
+			for (u32 e = cfg->succ_start[bb];
+			     e < cfg->succ_start[bb + 1]; ++e) {
+				u32 s = cfg->succs[e];
+				const u64 *in = lv->live_in + (usize)s * W;
+				for (u32 w = 0; w < W; ++w)
+					lo[w] |= in[w];
+				ir_foreach_inst(fn, s, phi)
+				{
+					if (ir_inst(fn, phi)->op != IrOp_PHI)
+						break;
+					const IrValue *args = ir_args(fn, phi);
+					u32 nargs = ir_inst(fn, phi)->nargs;
+					for (u32 a = 0; a < nargs; a += 2) {
+						u32 k = lv->index[args[a + 1]];
+						if (args[a] == bb &&
+						    k != IR_UNREACHABLE)
+							set_bit(lo, k);
+					}
+				}
+			}
+			const u64 *g = gen + (usize)bb * W;
+			const u64 *k = kill + (usize)bb * W;
+			for (u32 w = 0; w < W; ++w) {
+				u64 in = g[w] | (lo[w] & ~k[w]);
+				changed |= in != li[w];
+				li[w] = in;
+			}
+		}
+	}
+}
+
+bool ir_live_in(const struct IrLiveness *lv, u32 bb, IrValue v)
+{
+	u32 k = lv->index[v];
+	return k != IR_UNREACHABLE &&
+	       test_bit(lv->live_in + (usize)bb * lv->words, k);
+}
+
+bool ir_live_out(const struct IrLiveness *lv, u32 bb, IrValue v)
+{
+	u32 k = lv->index[v];
+	return k != IR_UNREACHABLE &&
+	       test_bit(lv->live_out + (usize)bb * lv->words, k);
+}
+
+/*
+ * ==========================================================================
+ * 6. Call Graph
+ * ==========================================================================
+ */
+
+static bool calls_body(const struct IrModule *m, const struct IrFunc *fn,
+		       IrValue v)
+{
+	const struct IrInst *inst = ir_inst(fn, v);
+	return inst->op == IrOp_CALL &&
+	       !m->funcs.data[inst->imm.index].is_extern;
+}
+
+void ir_callgraph_build(struct IrCallGraph *cg, const struct IrModule *m)
+{
+	u32 n = (u32)vec_len(m->funcs);
+	u32 ncalls = 0;
+	for (u32 f = 0; f < n; ++f) {
+		const struct IrFunc *fn = &m->funcs.data[f];
+		for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb)
+			ir_foreach_inst(fn, bb, v)
+				ncalls += calls_body(m, fn, v);
+	}
+
+	/* order, scc, sites; the edges; Tarjan's numbering, low links,
+	 * component stack, DFS stack and next edge. */
+	buf_reset(&cg->buf, 8 * u32s(n) + u32s(n + 1) + u32s(ncalls));
+	cg->nfuncs = n;
+	cg->order = carve(&cg->buf, n);
+	cg->scc = carve(&cg->buf, n);
+	cg->sites = carve(&cg->buf, n);
+	u32 *start = carve(&cg->buf, n + 1);
+	u32 *callees = carve(&cg->buf, ncalls);
+
+	for (u32 f = 0; f < n; ++f) {
+		const struct IrFunc *fn = &m->funcs.data[f];
+		start[f + 1] = start[f];
+		for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+			ir_foreach_inst(fn, bb, v)
+			{
+				if (!calls_body(m, fn, v))
+					continue;
+				u32 callee = ir_inst(fn, v)->imm.index;
+				callees[start[f + 1]++] = callee;
+				cg->sites[callee]++;
+			}
+		}
+	}
+
+	/* Iterative Tarjan; index[f] is 0 until f is visited. A component
+	 * is complete when its root is left, after all it calls. */
+	u32 *index = carve(&cg->buf, n);
+	u32 *low = carve(&cg->buf, n);
+	u32 *members = carve(&cg->buf, n);
+	u32 *stack = carve(&cg->buf, n);
+	u32 *next = carve(&cg->buf, n);
+	for (u32 f = 0; f < n; ++f)
+		cg->scc[f] = IR_UNREACHABLE;
+	u32 visited = 0, nscc = 0, nmembers = 0;
+	cg->norder = 0;
+	for (u32 root = 0; root < n; ++root) {
+		if (m->funcs.data[root].is_extern || index[root])
+			continue;
+		u32 top = 0;
+		index[root] = low[root] = ++visited;
+		members[nmembers++] = root;
+		next[root] = start[root];
+		stack[top++] = root;
+		while (top) {
+			u32 f = stack[top - 1];
+			if (next[f] < start[f + 1]) {
+				u32 g = callees[next[f]++];
+				if (!index[g]) {
+					index[g] = low[g] = ++visited;
+					members[nmembers++] = g;
+					next[g] = start[g];
+					stack[top++] = g;
+				} else if (cg->scc[g] == IR_UNREACHABLE &&
+					   index[g] < low[f]) {
+					low[f] = index[g];
+				}
+				continue;
+			}
+			if (--top && low[f] < low[stack[top - 1]])
+				low[stack[top - 1]] = low[f];
+			if (low[f] != index[f])
+				continue;
+			u32 g;
+			do {
+				g = members[--nmembers];
+				cg->scc[g] = nscc;
+				cg->order[cg->norder++] = g;
+			} while (g != f);
+			nscc++;
+		}
+	}
+}
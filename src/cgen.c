@@ -0,0 +1,1095 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <cgen.h>
+#include <context.h>
+#include <sema.h>
+#include <prelude.h>
+#include <type.h>
+#include <trace.h>
+#include <std/map.h>
+#include <std/allocers/system.h>
+#include <core/msg.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. State
+ * ==========================================================================
+ */
+
+static u64 _sym_hash(const void *key)
+{
+	return (u64)((const symbol_t *)key)->id * 2654435761u;
+}
+
+static bool _sym_eq(const void *lhs, const void *rhs)
+{
+	return ((const symbol_t *)lhs)->id == ((const symbol_t *)rhs)->id;
+}
+
+static const map_ops_t MAP_OPS_SYM = { .hash = _sym_hash, .equals = _sym_eq };
+
+/* An operand already evaluated into temporary cact_t<temp>. */
+struct CGenSubst {
+	const struct Node *n;
+	u32 temp;
+};
+
+defMap(symbol_t, u32, CGenFuncMap);
+defVec(struct NodeFunc *, CGenFuncVec);
+defVec(const struct Type *, CGenTypeVec);
+defVec(struct CGenSubst, CGenSubstVec);
+
+typedef struct CGen {
+	struct Context *ctx;
+	FILE *out;
+
+	/* The program's functions, and their indices by name. */
+	CGenFuncVec funcs;
+	CGenFuncMap func_index;
+
+	/* The function being written; its body goes to `out` first, so that
+	 * the temporaries it needs can be declared above it. */
+	struct NodeFunc *fn;
+	bool is_main;
+	u32 depth;
+	/* Types of the temporaries cact_t1, cact_t2, ... */
+	CGenTypeVec temps;
+	CGenSubstVec subst;
+} CGen;
+
+static const char *name_of(CGen *g, symbol_t name)
+{
+	return intern_resolve_cstr(&g->ctx->itn, name);
+}
+
+static void indent(CGen *g)
+{
+	for (u32 i = 0; i < g->depth; ++i)
+		fputc('\t', g->out);
+}
+
+/*
+ * ==========================================================================
+ * 2. Names and Types
+ * ==========================================================================
+ */
+
+static const char *const C_KEYWORDS[] = {
+	"alignas", "alignof", "asm", "auto", "bool", "break", "case", "char",
+	"const", "constexpr", "continue", "default", "do", "double", "else",
+	"enum", "extern", "false", "float", "for", "goto", "if", "inline",
+	"int", "long", "nullptr", "register", "restrict", "return", "short",
+	"signed", "sizeof", "static", "static_assert", "struct", "switch",
+	"thread_local", "true", "typedef", "typeof", "typeof_unqual", "union",
+	"unsigned", "void", "volatile", "while",
+};
+
+static bool ends_with(const char *s, const char *suffix)
+{
+	usize n = strlen(s), k = strlen(suffix);
+	return n >= k && memcmp(s + n - k, suffix, k) == 0;
+}
+
+/*
+ * Names C does not leave to the program: keywords, names C or this
+ * backend reserve, and the forms of names <stdint.h> defines. Names
+ * starting with `u_` count too, so that renaming stays one-to-one.
+ */
+static bool is_reserved(const char *s)
+{
+	if (s[0] == '_' || strncmp(s, "u_", 2) == 0 ||
+	    strncmp(s, "cact_", 5) == 0 || strncmp(s, "CACT_", 5) == 0)
+		return true;
+	if (ends_with(s, "_t") || ends_with(s, "_MAX") ||
+	    ends_with(s, "_MIN") || ends_with(s, "_C") ||
+	    ends_with(s, "_WIDTH"))
+		return true;
+	for (usize i = 0; i < sizeof(C_KEYWORDS) / sizeof(*C_KEYWORDS); ++i)
+		if (strcmp(s, C_KEYWORDS[i]) == 0)
+			return true;
+	return false;
+}
+
+/* The C name of a variable or function of the program. */
+static void put_name(CGen *g, const struct SemaSymbol *sym)
+{
+	const char *s = name_of(g, sym->name);
+	bool rename = is_reserved(s) || prelude_lookup(sym->name);
+	/* A local would hide the function of the same name from calls. */
+	if (!sym->is_global && map_get(g->func_index, sym->name))
+		rename = true;
+	fprintf(g->out, rename ? "u_%s" : "%s", s);
+}
+
+static const char *scalar_type(const struct Type *ty)
+{
+	switch (ty->kind) {
+	case TypeKind_BOOL:
+		return "bool";
+	case TypeKind_INT:
+		return "int32_t";
+	case TypeKind_FLOAT:
+		return "float";
+	case TypeKind_DOUBLE:
+		return "double";
+	default:
+		return "void";
+	}
+}
+
+/*
+ * A declaration of `sym`, or of temporary `temp`, or an abstract one
+ * (both unset). With `decay`, an array is a pointer to its first
+ * element, as a parameter is.
+ */
+static void put_decl(CGen *g, const struct Type *ty, bool decay,
+		     const struct SemaSymbol *sym, u32 temp)
+{
+	const struct Type *elem = ty;
+	while (elem->kind == TypeKind_ARRAY)
+		elem = elem->data.array.base;
+	fprintf(g->out, "%s ", scalar_type(elem));
+
+	const struct Type *dims = ty;
+	bool pointer = decay && ty->kind == TypeKind_ARRAY;
+	if (pointer) {
+		dims = ty->data.array.base;
+		fputs(dims->kind == TypeKind_ARRAY ? "(*" : "*", g->out);
+	}
+	if (sym)
+		put_name(g, sym);
+	else if (temp)
+		fprintf(g->out, "cact_t%u", temp);
+	if (pointer && dims->kind == TypeKind_ARRAY)
+		fputc(')', g->out);
+	for (; dims->kind == TypeKind_ARRAY; dims = dims->data.array.base)
+		fprintf(g->out, "[%d]", dims->data.array.len);
+}
+
+/* Shortest decimal that reads back as `v`; non-finite values as the
+ * constant expressions that make them. */
+static void put_float(CGen *g, double v, bool single)
+{
+	const char *f = single ? "f" : "";
+	if (isnan(v)) {
+		fprintf(g->out, signbit(v) ? "(-(0.0%s / 0.0%s))"
+					   : "(0.0%s / 0.0%s)",
+			f, f);
+		return;
+	}
+	if (isinf(v)) {
+		fprintf(g->out, "(%s1.0%s / 0.0%s)", v < 0 ? "-" : "", f, f);
+		return;
+	}
+	char buf[40];
+	for (int digits = 1; digits <= 17; ++digits) {
+		snprintf(buf, sizeof(buf), "%.*g", digits, v);
+		if (single ? strtof(buf, NULL) == (float)v
+			   : strtod(buf, NULL) == v)
+			break;
+	}
+	fputs(buf, g->out);
+	if (!strpbrk(buf, ".e"))
+		fputs(".0", g->out);
+	fputs(f, g->out);
+}
+
+static void put_int(CGen *g, i32 v)
+{
+	if (v == INT32_MIN)
+		fputs("(-2147483647 - 1)", g->out);
+	else
+		fprintf(g->out, "%d", v);
+}
+
+/*
+ * ==========================================================================
+ * 3. Expressions
+ * ==========================================================================
+ * Printed with as few parentheses as C's precedence allows. int
+ * arithmetic goes through the helpers of cactrt.h, which are calls.
+ */
+
+typedef enum Prec {
+	Prec_PRIMARY,
+	Prec_UNARY,
+	Prec_MUL,
+	Prec_ADD,
+	Prec_REL,
+	Prec_EQ,
+	Prec_AND,
+	Prec_OR,
+	Prec_ASSIGN,
+	Prec_TOP,
+} Prec;
+
+static bool is_int_op(const struct Node *n)
+{
+	return n->ty == ty_int &&
+	       (n->kind == ND_NEG || (n->kind >= ND_ADD && n->kind <= ND_MOD));
+}
+
+static Prec prec_of(const struct Node *n)
+{
+	if (is_int_op(n))
+		return Prec_PRIMARY;
+	switch (n->kind) {
+	case ND_NEG:
+	case ND_LOG_NOT:
+		return Prec_UNARY;
+	case ND_MUL:
+	case ND_DIV:
+	case ND_MOD:
+		return Prec_MUL;
+	case ND_ADD:
+	case ND_SUB:
+		return Prec_ADD;
+	case ND_LT:
+	case ND_LE:
+	case ND_GT:
+	case ND_GE:
+		return Prec_REL;
+	case ND_EQ:
+	case ND_NE:
+		return Prec_EQ;
+	case ND_LOG_AND:
+		return Prec_AND;
+	case ND_LOG_OR:
+		return Prec_OR;
+	case ND_ASSIGN:
+		return Prec_ASSIGN;
+	default:
+		return Prec_PRIMARY;
+	}
+}
+
+/* Calls and assignments; their order against other operands matters. */
+static bool has_effect(const struct Node *n)
+{
+	switch (n->kind) {
+	case ND_FUNC_CALL:
+	case ND_ASSIGN:
+		return true;
+	case ND_NEG:
+	case ND_LOG_NOT:
+		return has_effect(as_unary(n)->lhs);
+	case ND_INIT_LIST:
+		for (usize i = 0; i < vec_len(as_init_list(n)->inits); ++i)
+			if (has_effect(vec_at(as_init_list(n)->inits, i)))
+				return true;
+		return false;
+	default:
+		if (n->kind >= ND_ARRAY_ACCESS && n->kind <= ND_LOG_OR &&
+		    n->kind != ND_NEG && n->kind != ND_LOG_NOT &&
+		    n->kind != ND_CAST)
+			return has_effect(as_binary(n)->lhs) ||
+			       has_effect(as_binary(n)->rhs);
+		return false;
+	}
+}
+
+/*
+ * Values no call or assignment can change, and that cannot trap: they
+ * may be evaluated at any point. An array variable is its address.
+ */
+static bool is_constant(const struct Node *n)
+{
+	switch (n->kind) {
+	case ND_LIT_INT:
+	case ND_LIT_FLOAT:
+	case ND_LIT_DOUBLE:
+	case ND_LIT_BOOL:
+		return true;
+	case ND_VAR:
+		return n->ty->kind == TypeKind_ARRAY ||
+		       as_var(n)->var->is_const;
+	case ND_NEG:
+	case ND_LOG_NOT:
+		return is_constant(as_unary(n)->lhs);
+	case ND_DIV:
+	case ND_MOD:
+		if (n->ty == ty_int)
+			return false;
+		[[fallthrough]];
+	case ND_ADD:
+	case ND_SUB:
+	case ND_MUL:
+	case ND_EQ:
+	case ND_NE:
+	case ND_LT:
+	case ND_LE:
+	case ND_GT:
+	case ND_GE:
+	case ND_LOG_AND:
+	case ND_LOG_OR:
+		return is_constant(as_binary(n)->lhs) &&
+		       is_constant(as_binary(n)->rhs);
+	default:
+		return false;
+	}
+}
+
+static void expr(CGen *g, const struct Node *n, Prec max);
+
+/* An array passed on: a pointer, cast where the array is const. */
+static void operand(CGen *g, const struct Node *n, Prec max)
+{
+	const struct Node *root = n;
+	while (root->kind == ND_ARRAY_ACCESS)
+		root = as_binary(root)->lhs;
+	if (n->ty->kind != TypeKind_ARRAY || root->kind != ND_VAR ||
+	    !as_var(root)->var->is_const) {
+		expr(g, n, max);
+		return;
+	}
+	fputc('(', g->out);
+	put_decl(g, n->ty, true, NULL, 0);
+	fputc(')', g->out);
+	expr(g, n, Prec_UNARY);
+}
+
+/*
+ * C leaves the order of most operands open; CACT evaluates them left to
+ * right. Where that can matter, because an operand calls or assigns and
+ * another reads memory, every operand up to the last that calls or
+ * assigns is evaluated into a temporary first, in a comma expression.
+ * @return whether it opened a parenthesis, which the caller closes.
+ */
+static bool hoist(CGen *g, const struct Node *const *ops, u32 n)
+{
+	u32 last = UINT32_MAX, reads = 0;
+	for (u32 i = 0; i < n; ++i) {
+		if (has_effect(ops[i]))
+			last = i;
+		reads += !is_constant(ops[i]);
+	}
+	if (last == UINT32_MAX || reads < 2)
+		return false;
+
+	fputc('(', g->out);
+	for (u32 i = 0; i <= last; ++i) {
+		if (is_constant(ops[i]))
+			continue;
+		massert(vec_push(g->temps, ops[i]->ty), "OOM cgen");
+		u32 temp = (u32)vec_len(g->temps);
+		fprintf(g->out, "cact_t%u = ", temp);
+		operand(g, ops[i], Prec_ASSIGN);
+		fputs(", ", g->out);
+		struct CGenSubst s = { ops[i], temp };
+		massert(vec_push(g->subst, s), "OOM cgen");
+	}
+	return true;
+}
+
+/* Subscripts of an element access, outermost first. */
+static u32 subscripts(const struct Node *n, const struct Node **out, u32 cap)
+{
+	u32 count = 0;
+	for (const struct Node *a = n; a->kind == ND_ARRAY_ACCESS;
+	     a = as_binary(a)->lhs)
+		++count;
+	u32 i = count;
+	for (const struct Node *a = n; a->kind == ND_ARRAY_ACCESS;
+	     a = as_binary(a)->lhs)
+		if (--i < cap)
+			out[i] = as_binary(a)->rhs;
+	return count;
+}
+
+/* Operands in evaluation order, in scratch memory. */
+static const struct Node **operands(CGen *g, const struct Node *n, u32 *count)
+{
+	const struct Node *lhs = n;
+	u32 extra = 0;
+	switch (n->kind) {
+	case ND_FUNC_CALL:
+		*count = (u32)vec_len(as_call(n)->args);
+		break;
+	case ND_ASSIGN:
+		lhs = as_binary(n)->lhs;
+		extra = 1;
+		[[fallthrough]];
+	case ND_ARRAY_ACCESS:
+		*count = subscripts(lhs, NULL, 0) + extra;
+		break;
+	default:
+		*count = 2;
+	}
+
+	const struct Node **ops =
+		arena_alloc(&g->ctx->scratch,
+			    layout((*count + 1) * sizeof(*ops), 8));
+	massert(ops, "OOM cgen");
+	switch (n->kind) {
+	case ND_FUNC_CALL:
+		for (u32 i = 0; i < *count; ++i)
+			ops[i] = vec_at(as_call(n)->args, i);
+		break;
+	case ND_ASSIGN:
+	case ND_ARRAY_ACCESS:
+		subscripts(lhs, ops, *count);
+		if (extra)
+			ops[*count - 1] = as_binary(n)->rhs;
+		break;
+	default:
+		ops[0] = as_binary(n)->lhs;
+		ops[1] = as_binary(n)->rhs;
+	}
+	return ops;
+}
+
+static void put_call(CGen *g, const struct NodeCall *n)
+{
+	symbol_t name = intern_cstr(&g->ctx->itn, n->func_name);
+	u32 *index = map_get(g->func_index, name);
+	if (index)
+		put_name(g, vec_at(g->funcs, *index)->sym);
+	else
+		fputs(n->func_name, g->out);
+	fputc('(', g->out);
+	for (usize i = 0; i < vec_len(n->args); ++i) {
+		if (i)
+			fputs(", ", g->out);
+		operand(g, vec_at(n->args, i), Prec_ASSIGN);
+	}
+	fputc(')', g->out);
+}
+
+static void put_access(CGen *g, const struct Node *n)
+{
+	if (n->kind != ND_ARRAY_ACCESS) {
+		expr(g, n, Prec_PRIMARY);
+		return;
+	}
+	put_access(g, as_binary(n)->lhs);
+	fputc('[', g->out);
+	expr(g, as_binary(n)->rhs, Prec_TOP);
+	fputc(']', g->out);
+}
+
+static void put_int_op(CGen *g, const struct Node *n)
+{
+	static const char *const NAMES[] = {
+		[ND_ADD] = "cact_add", [ND_SUB] = "cact_sub",
+		[ND_MUL] = "cact_mul", [ND_DIV] = "cact_div",
+		[ND_MOD] = "cact_mod",
+	};
+	if (n->kind == ND_NEG) {
+		fputs("cact_neg(", g->out);
+		expr(g, as_unary(n)->lhs, Prec_ASSIGN);
+		fputc(')', g->out);
+		return;
+	}
+	fprintf(g->out, "%s(", NAMES[n->kind]);
+	expr(g, as_binary(n)->lhs, Prec_ASSIGN);
+	fputs(", ", g->out);
+	expr(g, as_binary(n)->rhs, Prec_ASSIGN);
+	if (n->kind == ND_DIV || n->kind == ND_MOD)
+		fprintf(g->out, ", cact_fn_%s", name_of(g, g->fn->sym->name));
+	fputc(')', g->out);
+}
+
+static const char *binary_op(NodeKind kind)
+{
+	switch (kind) {
+	case ND_ADD:
+		return "+";
+	case ND_SUB:
+		return "-";
+	case ND_MUL:
+		return "*";
+	case ND_DIV:
+		return "/";
+	case ND_EQ:
+		return "==";
+	case ND_NE:
+		return "!=";
+	case ND_LT:
+		return "<";
+	case ND_LE:
+		return "<=";
+	case ND_GT:
+		return ">";
+	case ND_GE:
+		return ">=";
+	case ND_LOG_AND:
+		return "&&";
+	default:
+		return "||";
+	}
+}
+
+/* A binary operator: left-associative, `&&` parenthesized within `||`. */
+static void put_binary(CGen *g, const struct Node *n)
+{
+	Prec p = prec_of(n);
+	const struct Node *lhs = as_binary(n)->lhs, *rhs = as_binary(n)->rhs;
+	Prec lmax = p, rmax = p - 1;
+	if (n->kind == ND_LOG_OR) {
+		lmax = lhs->kind == ND_LOG_AND ? Prec_EQ : p;
+		rmax = Prec_EQ;
+	}
+	expr(g, lhs, lmax);
+	fprintf(g->out, " %s ", binary_op(n->kind));
+	expr(g, rhs, rmax);
+}
+
+static void put_node(CGen *g, const struct Node *n)
+{
+	switch (n->kind) {
+	case ND_LIT_INT:
+		put_int(g, as_lit_int(n)->val);
+		return;
+	case ND_LIT_FLOAT:
+		put_float(g, as_lit_float(n)->val, true);
+		return;
+	case ND_LIT_DOUBLE:
+		put_float(g, as_lit_double(n)->val, false);
+		return;
+	case ND_LIT_BOOL:
+		fputs(as_lit_bool(n)->val ? "true" : "false", g->out);
+		return;
+	case ND_VAR:
+		put_name(g, as_var(n)->var);
+		return;
+	case ND_FUNC_CALL:
+		put_call(g, as_call(n));
+		return;
+	case ND_ARRAY_ACCESS:
+		put_access(g, n);
+		return;
+	case ND_NEG:
+	case ND_LOG_NOT: {
+		const struct Node *lhs = as_unary(n)->lhs;
+		fputc(n->kind == ND_NEG ? '-' : '!', g->out);
+		/* Not `--x`. */
+		expr(g, lhs, lhs->kind == ND_NEG ? Prec_PRIMARY : Prec_UNARY);
+		return;
+	}
+	case ND_ASSIGN:
+		put_access(g, as_binary(n)->lhs);
+		fputs(" = ", g->out);
+		expr(g, as_binary(n)->rhs, Prec_ASSIGN);
+		return;
+	default:
+		put_binary(g, n);
+		return;
+	}
+}
+
+static void expr(CGen *g, const struct Node *n, Prec max)
+{
+	for (usize i = vec_len(g->subst); i-- > 0;) {
+		if (g->subst.data[i].n == n) {
+			fprintf(g->out, "cact_t%u", g->subst.data[i].temp);
+			return;
+		}
+	}
+
+	bool ordered = n->kind == ND_FUNC_CALL || n->kind == ND_ASSIGN ||
+		       n->kind == ND_ARRAY_ACCESS ||
+		       (n->kind >= ND_ADD && n->kind <= ND_GE);
+	usize subst = vec_len(g->subst);
+	bool paren = false;
+	if (ordered) {
+		struct ArenaMark mark = arena_mark(&g->ctx->scratch);
+		u32 count;
+		const struct Node **ops = operands(g, n, &count);
+		paren = hoist(g, ops, count);
+		arena_release(&g->ctx->scratch, mark);
+	}
+	if (!paren && prec_of(n) > max) {
+		paren = true;
+		fputc('(', g->out);
+	}
+
+	if (is_int_op(n))
+		put_int_op(g, n);
+	else
+		put_node(g, n);
+
+	if (paren)
+		fputc(')', g->out);
+	g->subst.len = subst;
+}
+
+/*
+ * ==========================================================================
+ * 4. Initializers
+ * ==========================================================================
+ */
+
+/* As written: C flattens braced lists the way CACT does. */
+static void put_init(CGen *g, const struct Node *n)
+{
+	if (n->kind != ND_INIT_LIST) {
+		expr(g, n, Prec_ASSIGN);
+		return;
+	}
+	NodeVec items = as_init_list(n)->inits;
+	if (!vec_len(items)) {
+		fputs("{0}", g->out);
+		return;
+	}
+	fputc('{', g->out);
+	for (usize i = 0; i < vec_len(items); ++i) {
+		if (i)
+			fputs(", ", g->out);
+		put_init(g, vec_at(items, i));
+	}
+	fputc('}', g->out);
+}
+
+/*
+ * With calls among the elements, which C initializers would evaluate in
+ * no particular order: one assignment per element instead, following
+ * the lowering's traversal (lower.c, init_fill).
+ */
+static void store_element(CGen *g, const struct SemaSymbol *sym,
+			  const struct Node *n, u32 pos)
+{
+	if (n->kind == ND_INIT_LIST)
+		n = vec_at(as_init_list(n)->inits, 0);
+	const struct Type *elem = sym->ty;
+	while (elem->kind == TypeKind_ARRAY)
+		elem = elem->data.array.base;
+
+	indent(g);
+	put_name(g, sym);
+	for (const struct Type *t = sym->ty; t->kind == TypeKind_ARRAY;
+	     t = t->data.array.base) {
+		u32 per = (u32)(t->data.array.base->size / elem->size);
+		fprintf(g->out, "[%u]", pos / per % (u32)t->data.array.len);
+	}
+	fputs(" = ", g->out);
+	expr(g, n, Prec_ASSIGN);
+	fputs(";\n", g->out);
+}
+
+static void store_fill(CGen *g, const struct SemaSymbol *sym,
+		       const struct Type *ty, NodeVec items, usize *i, u32 pos)
+{
+	const struct Type *et = ty->data.array.base;
+	const struct Type *elem = et;
+	while (elem->kind == TypeKind_ARRAY)
+		elem = elem->data.array.base;
+	u32 per = (u32)(et->size / elem->size);
+
+	for (int k = 0; k < ty->data.array.len && *i < vec_len(items); ++k) {
+		const struct Node *item = vec_at(items, *i);
+		u32 at = pos + (u32)k * per;
+		if (et->kind != TypeKind_ARRAY) {
+			(*i)++;
+			store_element(g, sym, item, at);
+		} else if (item->kind == ND_INIT_LIST) {
+			(*i)++;
+			usize j = 0;
+			store_fill(g, sym, et, as_init_list(item)->inits, &j,
+				   at);
+		} else {
+			store_fill(g, sym, et, items, i, at);
+		}
+	}
+}
+
+/* A constant scalar of type `ty` from its bytes in memory. */
+static void put_const(CGen *g, const struct Type *ty, const u8 *bytes)
+{
+	switch (ty->kind) {
+	case TypeKind_BOOL:
+		fputs(bytes[0] ? "true" : "false", g->out);
+		return;
+	case TypeKind_INT: {
+		i32 v;
+		memcpy(&v, bytes, sizeof(v));
+		put_int(g, v);
+		return;
+	}
+	case TypeKind_FLOAT: {
+		float v;
+		memcpy(&v, bytes, sizeof(v));
+		put_float(g, v, true);
+		return;
+	}
+	default: {
+		double v;
+		memcpy(&v, bytes, sizeof(v));
+		put_float(g, v, false);
+		return;
+	}
+	}
+}
+
+static bool all_zero(const u8 *bytes, usize n)
+{
+	for (usize i = 0; i < n; ++i)
+		if (bytes[i])
+			return false;
+	return true;
+}
+
+/* Fully braced; trailing zero elements are left out. */
+static void put_const_init(CGen *g, const struct Type *ty, const u8 *bytes)
+{
+	if (ty->kind != TypeKind_ARRAY) {
+		put_const(g, ty, bytes);
+		return;
+	}
+	const struct Type *et = ty->data.array.base;
+	usize per = (usize)et->size;
+	int used = ty->data.array.len;
+	while (used > 0 && all_zero(bytes + (usize)(used - 1) * per, per))
+		--used;
+	if (!used) {
+		fputs("{0}", g->out);
+		return;
+	}
+	fputc('{', g->out);
+	for (int k = 0; k < used; ++k) {
+		if (k)
+			fputs(", ", g->out);
+		put_const_init(g, et, bytes + (usize)k * per);
+	}
+	fputc('}', g->out);
+}
+
+/*
+ * ==========================================================================
+ * 5. Statements
+ * ==========================================================================
+ */
+
+static void stmt(CGen *g, const struct Node *n);
+
+/* A `{` block; the parser also groups `int a, b;` in an ND_BLOCK. */
+static bool is_scope(const struct Node *n)
+{
+	return n->kind == ND_BLOCK && n->tok &&
+	       n->tok->kind == TokenKind_L_BRACE;
+}
+
+static void put_local(CGen *g, const struct NodeVarDecl *d)
+{
+	const struct SemaSymbol *sym = d->var;
+	bool stores = d->init && d->init->kind == ND_INIT_LIST &&
+		      sym->ty->kind == TypeKind_ARRAY && has_effect(d->init);
+
+	indent(g);
+	if (sym->is_const && !stores)
+		fputs("const ", g->out);
+	put_decl(g, sym->ty, false, sym, 0);
+	if (!d->init) {
+		fputs(";\n", g->out);
+		return;
+	}
+	if (!stores) {
+		fputs(" = ", g->out);
+		put_init(g, d->init);
+		fputs(";\n", g->out);
+		return;
+	}
+	fputs(" = {0};\n", g->out);
+	usize i = 0;
+	store_fill(g, sym, sym->ty, as_init_list(d->init)->inits, &i, 0);
+}
+
+/* A statement as the body of `if` or `while`, braced. */
+static void put_body(CGen *g, const struct Node *n)
+{
+	fputs("{\n", g->out);
+	g->depth++;
+	if (is_scope(n)) {
+		for (usize i = 0; i < vec_len(as_block(n)->stmts); ++i)
+			stmt(g, vec_at(as_block(n)->stmts, i));
+	} else {
+		stmt(g, n);
+	}
+	g->depth--;
+	indent(g);
+	fputc('}', g->out);
+}
+
+static void put_if(CGen *g, const struct NodeIf *n)
+{
+	fputs("if (", g->out);
+	expr(g, n->cond, Prec_TOP);
+	fputs(") ", g->out);
+	put_body(g, n->then_branch);
+	if (!n->else_branch)
+		return;
+	fputs(" else ", g->out);
+	if (n->else_branch->kind == ND_IF)
+		put_if(g, as_if(n->else_branch));
+	else
+		put_body(g, n->else_branch);
+}
+
+static void put_expr_stmt(CGen *g, const struct Node *n)
+{
+	indent(g);
+	if (!n) {
+		fputs(";\n", g->out);
+		return;
+	}
+	if (n->kind != ND_FUNC_CALL && n->kind != ND_ASSIGN) {
+		fputs("(void)", g->out);
+		expr(g, n, Prec_UNARY);
+	} else {
+		expr(g, n, Prec_TOP);
+	}
+	fputs(";\n", g->out);
+}
+
+static void stmt(CGen *g, const struct Node *n)
+{
+	if (!n)
+		return;
+
+	switch (n->kind) {
+	case ND_BLOCK:
+		if (!is_scope(n)) {
+			for (usize i = 0; i < vec_len(as_block(n)->stmts); ++i)
+				stmt(g, vec_at(as_block(n)->stmts, i));
+			return;
+		}
+		indent(g);
+		put_body(g, n);
+		fputc('\n', g->out);
+		return;
+	case ND_VAR_DECL:
+		put_local(g, as_decl(n));
+		return;
+	case ND_IF:
+		indent(g);
+		put_if(g, as_if(n));
+		fputc('\n', g->out);
+		return;
+	case ND_WHILE:
+		indent(g);
+		fputs("while (", g->out);
+		expr(g, as_while(n)->cond, Prec_TOP);
+		fputs(") ", g->out);
+		put_body(g, as_while(n)->body);
+		fputc('\n', g->out);
+		return;
+	case ND_RETURN:
+		indent(g);
+		if (as_unary(n)->lhs) {
+			fputs("return ", g->out);
+			expr(g, as_unary(n)->lhs, Prec_TOP);
+			fputs(";\n", g->out);
+		} else {
+			fputs(g->is_main ? "return 0;\n" : "return;\n", g->out);
+		}
+		return;
+	case ND_BREAK:
+		indent(g);
+		fputs("break;\n", g->out);
+		return;
+	case ND_CONTINUE:
+		indent(g);
+		fputs("continue;\n", g->out);
+		return;
+	case ND_EXPR_STMT:
+		put_expr_stmt(g, as_unary(n)->lhs);
+		return;
+	default:
+		put_expr_stmt(g, n);
+		return;
+	}
+}
+
+/*
+ * ==========================================================================
+ * 6. Top Level
+ * ==========================================================================
+ */
+
+static void put_signature(CGen *g, const struct NodeFunc *f)
+{
+	if (g->is_main) {
+		fputs("int main(void)", g->out);
+		return;
+	}
+	fprintf(g->out, "static %s ",
+		scalar_type(f->sym->ty->data.func.ret));
+	put_name(g, f->sym);
+	fputc('(', g->out);
+	if (!vec_len(f->params))
+		fputs("void", g->out);
+	for (usize i = 0; i < vec_len(f->params); ++i) {
+		const struct SemaSymbol *p = vec_at(f->params, i);
+		if (i)
+			fputs(", ", g->out);
+		put_decl(g, p->ty, true, p, 0);
+	}
+	fputc(')', g->out);
+}
+
+static void put_func(CGen *g, struct NodeFunc *f)
+{
+	TRACE_SCOPE_ARG("cgen_func", name_of(g, f->sym->name));
+	FILE *file = g->out;
+	char *body = NULL;
+	size_t len = 0;
+	g->out = open_memstream(&body, &len);
+	massert(g->out, "OOM cgen");
+	g->fn = f;
+	g->is_main = strcmp(name_of(g, f->sym->name), "main") == 0;
+	g->temps.len = 0;
+	g->depth = 1;
+
+	fprintf(g->out, "\tCACT_ENTER(cact_fn_%s);\n",
+		name_of(g, f->sym->name));
+	NodeVec stmts = as_block(f->body)->stmts;
+	for (usize i = 0; i < vec_len(stmts); ++i)
+		stmt(g, vec_at(stmts, i));
+	/* Falling off the end returns zero. */
+	const struct Node *last =
+		vec_len(stmts) ? vec_at(stmts, vec_len(stmts) - 1) : NULL;
+	bool returns = f->sym->ty->data.func.ret != ty_void || g->is_main;
+	if (returns && (!last || last->kind != ND_RETURN))
+		fputs("\treturn 0;\n", g->out);
+	massert(fclose(g->out) == 0, "OOM cgen");
+
+	g->out = file;
+	fputc('\n', g->out);
+	put_signature(g, f);
+	fputs("\n{\n", g->out);
+	for (usize i = 0; i < vec_len(g->temps); ++i) {
+		fputc('\t', g->out);
+		put_decl(g, vec_at(g->temps, i), true, NULL, (u32)i + 1);
+		fputs(";\n", g->out);
+	}
+	if (vec_len(g->temps))
+		fputc('\n', g->out);
+	fwrite(body, 1, len, g->out);
+	fputs("}\n", g->out);
+	free(body);
+}
+
+/* Globals come in the order ir_lower made them. */
+static void put_global(CGen *g, const struct NodeVarDecl *d,
+		       const struct IrGlobal *ir)
+{
+	const struct SemaSymbol *sym = d->var;
+	massert(strcmp(ir->name, name_of(g, sym->name)) == 0,
+		"cgen: globals out of order");
+	fputs(sym->is_const ? "static const " : "static ", g->out);
+	put_decl(g, sym->ty, false, sym, 0);
+	if (ir->init) {
+		fputs(" = ", g->out);
+		put_const_init(g, sym->ty, ir->init);
+	} else if (sym->is_const) {
+		fputs(sym->ty->kind == TypeKind_ARRAY ? " = {0}" : " = 0",
+		      g->out);
+	}
+	fputs(";\n", g->out);
+}
+
+static void put_program(CGen *g, NodeVec globals, const struct IrModule *m)
+{
+	fputs("/* Generated by cactc --emit=c. */\n\n#include <cactrt.h>\n",
+	      g->out);
+
+	u32 nfuncs = (u32)vec_len(g->funcs);
+	if (nfuncs) {
+		fputs("\n/* Function numbers for runtime errors. */\nenum {\n",
+		      g->out);
+		for (u32 i = 0; i < nfuncs; ++i)
+			fprintf(g->out, "\tcact_fn_%s,\n",
+				name_of(g, vec_at(g->funcs, i)->sym->name));
+		fputs("};\n\nconst char *const __cact_func_names[] = {\n",
+		      g->out);
+		for (u32 i = 0; i < nfuncs; ++i)
+			fprintf(g->out, "\t\"%s\",\n",
+				name_of(g, vec_at(g->funcs, i)->sym->name));
+		fputs("};\n", g->out);
+	}
+
+	u32 next = 0;
+	for (usize i = 0; i < vec_len(globals); ++i) {
+		const struct Node *n = vec_at(globals, i);
+		if (!n || n->kind == ND_FUNC)
+			continue;
+		if (next == 0)
+			fputc('\n', g->out);
+		if (n->kind == ND_VAR_DECL) {
+			put_global(g, as_decl(n), &m->globals.data[next++]);
+			continue;
+		}
+		for (usize j = 0; j < vec_len(as_block(n)->stmts); ++j)
+			put_global(g, as_decl(vec_at(as_block(n)->stmts, j)),
+				   &m->globals.data[next++]);
+	}
+
+	if (nfuncs)
+		fputc('\n', g->out);
+	for (u32 i = 0; i < nfuncs; ++i) {
+		struct NodeFunc *f = vec_at(g->funcs, i);
+		g->is_main = strcmp(name_of(g, f->sym->name), "main") == 0;
+		put_signature(g, f);
+		fputs(";\n", g->out);
+	}
+	for (u32 i = 0; i < nfuncs; ++i)
+		put_func(g, vec_at(g->funcs, i));
+}
+
+bool cgen_write(const char *path, struct Context *ctx, NodeVec globals,
+		const struct IrModule *m)
+{
+	TRACE_SCOPE("cgen");
+	bool to_stdout = strcmp(path, "-") == 0;
+	FILE *out = to_stdout ? stdout : fopen(path, "w");
+	if (!out) {
+		log_error("Could not write C to '%s'", path);
+		return false;
+	}
+
+	allocer_t sys = allocer_system();
+	CGen g = { .ctx = ctx, .out = out };
+	massert(vec_init(g.funcs, sys, 16), "OOM cgen");
+	massert(map_init(g.func_index, sys, MAP_OPS_SYM), "OOM cgen");
+	massert(vec_init(g.temps, sys, 16), "OOM cgen");
+	massert(vec_init(g.subst, sys, 16), "OOM cgen");
+	for (usize i = 0; i < vec_len(globals); ++i) {
+		struct Node *n = vec_at(globals, i);
+		if (!n || n->kind != ND_FUNC)
+			continue;
+		u32 index = (u32)vec_len(g.funcs);
+		massert(vec_push(g.funcs, as_func(n)), "OOM cgen");
+		massert(map_put(g.func_index, as_func(n)->sym->name, index),
+			"OOM cgen");
+	}
+
+	put_program(&g, globals, m);
+
+	vec_deinit(g.subst);
+	vec_deinit(g.temps);
+	map_deinit(g.func_index);
+	vec_deinit(g.funcs);
+	bool ok = !ferror(out);
+	if (!to_stdout)
+		ok = fclose(out) == 0 && ok;
+	if (!ok)
+		log_error("Could not write C to '%s'", path);
+	return ok;
+}
@@ -0,0 +1,323 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <pass.h>
+
+/*
+ * ==========================================================================
+ * 1. Helpers
+ * ==========================================================================
+ */
+
+static bool has_phis(const struct IrFunc *fn, u32 bb)
+{
+	IrValue first = fn->blocks.data[bb].first;
+	return first && ir_inst(fn, first)->op == IrOp_PHI;
+}
+
+/* Renames the incoming block `from` to `to` in the PHIs of `bb`. */
+static void rename_incoming(struct IrFunc *fn, u32 bb, u32 from, u32 to)
+{
+	ir_foreach_inst(fn, bb, v)
+	{
+		struct IrInst *inst = ir_inst(fn, v);
+		if (inst->op != IrOp_PHI)
+			break;
+		IrValue *args = ir_args(fn, v);
+		for (u32 i = 0; i < inst->nargs; i += 2)
+			if (args[i] == from)
+				args[i] = to;
+	}
+}
+
+static void make_br(struct IrFunc *fn, IrValue term, u32 target)
+{
+	struct IrInst *inst = ir_inst(fn, term);
+	inst->op = IrOp_BR;
+	inst->nargs = 0;
+	inst->imm.target[0] = target;
+	inst->imm.target[1] = IR_NONE;
+}
+
+/*
+ * ==========================================================================
+ * 2. simplifycfg
+ * ==========================================================================
+ * Rounds of rewrites, each on a fresh CFG, until none applies. Blocks a
+ * round leaves unreachable are deleted and the rest renumbered.
+ */
+
+/* CONDBR on a constant, or to one block twice, becomes BR. */
+static bool fold_branches(struct IrFunc *fn)
+{
+	bool changed = false;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		IrValue term = ir_terminator(fn, bb);
+		if (!term || ir_inst(fn, term)->op != IrOp_CONDBR)
+			continue;
+		const struct IrInst *inst = ir_inst(fn, term);
+		u32 then_bb = inst->imm.target[0];
+		u32 else_bb = inst->imm.target[1];
+		const struct IrInst *cond = ir_inst(fn, ir_args(fn, term)[0]);
+		if (then_bb == else_bb) {
+			make_br(fn, term, then_bb);
+		} else if (cond->op == IrOp_CONST) {
+			u32 taken = cond->imm.k.b ? then_bb : else_bb;
+			u32 lost = taken == then_bb ? else_bb : then_bb;
+			ir_drop_incoming(fn, lost, bb);
+			make_br(fn, term, taken);
+		} else {
+			continue;
+		}
+		changed = true;
+	}
+	return changed;
+}
+
+/* The target of `bb` if it holds nothing but a BR elsewhere, else 0. */
+static u32 forwards_to(const struct IrFunc *fn, u32 bb)
+{
+	IrValue first = fn->blocks.data[bb].first;
+	if (!first || ir_inst(fn, first)->op != IrOp_BR)
+		return IR_NONE;
+	u32 target = ir_inst(fn, first)->imm.target[0];
+	return target != bb ? target : IR_NONE;
+}
+
+static bool is_pred(const struct IrCfg *cfg, u32 pred, u32 bb)
+{
+	for (u32 p = cfg->pred_start[bb]; p < cfg->pred_start[bb + 1]; ++p)
+		if (cfg->preds[p] == pred)
+			return true;
+	return false;
+}
+
+/*
+ * Branches to an empty block go to its target instead. Where the target
+ * has PHIs this needs one predecessor, which takes the empty block's
+ * place as the incoming block, and must not already be an incoming one.
+ * A block whose edges changed this round waits for a fresh CFG.
+ */
+static bool bypass_empty(struct IrFunc *fn, const struct IrCfg *cfg)
+{
+	bool *touched = ir_grab(cfg->nblocks);
+	bool changed = false;
+	for (u32 i = 1; i < cfg->nrpo; ++i) {
+		u32 bb = cfg->rpo[i];
+		u32 target = forwards_to(fn, bb);
+		if (!target || touched[bb] || touched[target])
+			continue;
+		u32 npreds = cfg->pred_start[bb + 1] - cfg->pred_start[bb];
+		if (has_phis(fn, target)) {
+			u32 pred = cfg->preds[cfg->pred_start[bb]];
+			if (npreds != 1 || is_pred(cfg, pred, target))
+				continue;
+			rename_incoming(fn, target, bb, pred);
+		}
+		for (u32 p = cfg->pred_start[bb]; p < cfg->pred_start[bb + 1];
+		     ++p) {
+			struct IrInst *term =
+				ir_inst(fn, ir_terminator(fn, cfg->preds[p]));
+			for (u32 k = 0; k < 2; ++k)
+				if (term->imm.target[k] == bb)
+					term->imm.target[k] = target;
+		}
+		/* Unreachable now, and left to ir_remove_unreachable. */
+		make_br(fn, fn->blocks.data[bb].first, bb);
+		touched[bb] = touched[target] = true;
+		changed = true;
+	}
+	ir_drop(touched, cfg->nblocks);
+	return changed;
+}
+
+/*
+ * A block whose only predecessor branches nowhere else joins it: its
+ * PHIs have one incoming value each and give way to it.
+ */
+static bool merge_blocks(struct IrFunc *fn, const struct IrCfg *cfg,
+			 IrValue *repl)
+{
+	bool changed = false;
+	for (u32 i = 0; i < cfg->nrpo; ++i) {
+		u32 bb = cfg->rpo[i];
+		IrValue term = ir_terminator(fn, bb);
+		while (term && ir_inst(fn, term)->op == IrOp_BR) {
+			u32 next = ir_inst(fn, term)->imm.target[0];
+			u32 npreds = cfg->pred_start[next + 1] -
+				     cfg->pred_start[next];
+			if (next == bb || next == 1 || npreds != 1)
+				break;
+
+			IrValue v = fn->blocks.data[next].first;
+			while (v && ir_inst(fn, v)->op == IrOp_PHI) {
+				IrValue after = ir_inst(fn, v)->next;
+				repl[v] = ir_args(fn, v)[1];
+				ir_remove(fn, v);
+				v = after;
+			}
+			ir_remove(fn, term);
+			struct IrBlock *to = &fn->blocks.data[bb];
+			struct IrBlock *from = &fn->blocks.data[next];
+			ir_foreach_inst(fn, next, w)
+				ir_inst(fn, w)->block = bb;
+			if (from->first) {
+				ir_inst(fn, from->first)->prev = to->last;
+				if (to->last)
+					ir_inst(fn, to->last)->next =
+						from->first;
+				else
+					to->first = from->first;
+				to->last = from->last;
+			}
+			*from = (struct IrBlock){ 0 };
+
+			term = ir_terminator(fn, bb);
+			u32 succ[2];
+			u32 n = ir_succs(fn, bb, succ);
+			for (u32 k = 0; k < n; ++k)
+				rename_incoming(fn, succ[k], next, bb);
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+/* A PHI whose incoming values are one value, or itself, is that value. */
+static bool fold_phis(struct IrFunc *fn, IrValue *repl)
+{
+	bool changed = false;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		IrValue v = fn->blocks.data[bb].first;
+		while (v && ir_inst(fn, v)->op == IrOp_PHI) {
+			IrValue next = ir_inst(fn, v)->next;
+			const IrValue *args = ir_args(fn, v);
+			IrValue same = IR_NONE;
+			bool unique = true;
+			for (u32 i = 1; i < ir_inst(fn, v)->nargs; i += 2) {
+				IrValue u = args[i];
+				while (repl[u])
+					u = repl[u];
+				if (u == v || u == same)
+					continue;
+				unique = !same;
+				same = u;
+				if (!unique)
+					break;
+			}
+			if (unique && same) {
+				repl[v] = same;
+				ir_remove(fn, v);
+				changed = true;
+			}
+			v = next;
+		}
+	}
+	return changed;
+}
+
+IrAnalysisSet ir_simplify_cfg(struct PassManager *pm)
+{
+	struct IrFunc *fn = pm->fn;
+	usize bytes = vec_len(fn->insts) * sizeof(IrValue);
+	IrValue *repl = ir_grab(bytes);
+
+	bool changed = false;
+	for (bool again = true; again;) {
+		again = false;
+		/* bypass_empty must not see the edges just folded away. */
+		if (fold_branches(fn)) {
+			ir_remove_unreachable(fn);
+			pm_invalidate(pm, IR_PRESERVE_NONE);
+			again = true;
+		}
+		if (bypass_empty(fn, pm_cfg(pm))) {
+			ir_remove_unreachable(fn);
+			pm_invalidate(pm, IR_PRESERVE_NONE);
+			again = true;
+		}
+		if (merge_blocks(fn, pm_cfg(pm), repl)) {
+			ir_remove_unreachable(fn);
+			pm_invalidate(pm, IR_PRESERVE_NONE);
+			again = true;
+		}
+		changed |= again;
+	}
+	while (fold_phis(fn, repl))
+		changed = true;
+	if (changed)
+		ir_replace_uses(fn, repl);
+
+	ir_drop(repl, bytes);
+	return changed ? IR_PRESERVE_NONE : IR_PRESERVE_ALL;
+}
+
+/*
+ * ==========================================================================
+ * 3. dce
+ * ==========================================================================
+ * Marks what has an effect, then what that uses, transitively; the rest
+ * goes.
+ */
+
+IrAnalysisSet ir_dce(struct PassManager *pm)
+{
+	struct IrFunc *fn = pm->fn;
+	u32 n = (u32)vec_len(fn->insts);
+	/* live[v]; the worklist after it. */
+	usize bytes = 2 * (usize)n * sizeof(u32);
+	u32 *live = ir_grab(bytes);
+	u32 *work = live + n;
+	u32 top = 0;
+
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			if (ir_has_effect(fn, v)) {
+				live[v] = 1;
+				work[top++] = v;
+			}
+		}
+	}
+	while (top) {
+		IrValue v = work[--top];
+		const IrValue *args = ir_args(fn, v);
+		ir_foreach_operand(fn, v, i)
+		{
+			IrValue u = args[i];
+			if (!live[u] && ir_inst(fn, u)->block) {
+				live[u] = 1;
+				work[top++] = u;
+			}
+		}
+	}
+
+	bool changed = false;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		IrValue v = fn->blocks.data[bb].first;
+		while (v) {
+			IrValue next = ir_inst(fn, v)->next;
+			if (!live[v]) {
+				ir_remove(fn, v);
+				changed = true;
+			}
+			v = next;
+		}
+	}
+
+	ir_drop(live, bytes);
+	return changed ? IR_PRESERVE_CFG : IR_PRESERVE_ALL;
+}
@@ -16,46 +16,38 @@
 
 #include <context.h>
 #include <type.h>
+#include <prelude.h>
+#include <stream.h>
+#include <incr.h>
 #include <core/msg.h>
-#include <core/hash.h>
+#include <std/allocers/system.h>
 #include <stdarg.h>
 #include <stdio.h>
 
-/*
- * ==========================================================================
- * 1. Map Operations for symbol_t
- * ==========================================================================
- */
-
-static u64 _sym_hash(const void *key)
-{
-	const symbol_t *s = (const symbol_t *)key;
-	return (u64)s->id * 2654435761u;
-}
-
-static bool _sym_eq(const void *lhs, const void *rhs)
-{
-	return ((const symbol_t *)lhs)->id == ((const symbol_t *)rhs)->id;
-}
-
-static const map_ops_t MAP_OPS_SYMBOL = {
-	.hash = _sym_hash,
-	.equals = _sym_eq,
-};
+#define SCRATCH_CHUNK_SIZE (64 * 1024)
+#define SCOPES_CHUNK_SIZE (16 * 1024)
 
 /*
  * ==========================================================================
- * 2. Lifecycle
+ * 1. Lifecycle
  * ==========================================================================
  */
 
 void context_init(struct Context *ctx, allocer_t alc)
 {
 	ctx->alc = alc;
+	ctx->diag = stderr;
+	ctx->stream = NULL;
+	ctx->doc = NULL;
+	ctx->locals = NULL;
+	ctx->locals_cap = 0;
+	ctx->max_nesting = CTX_DEFAULT_MAX_NESTING;
+	ctx->max_expr_depth = CTX_DEFAULT_MAX_EXPR_DEPTH;
 	ctx->had_error = false;
 	ctx->panic_mode = false;
 
-	types_init(alc);
+	arena_init(&ctx->scratch, allocer_system(), SCRATCH_CHUNK_SIZE);
+	arena_init(&ctx->scopes, allocer_system(), SCOPES_CHUNK_SIZE);
 
 	if (!srcmanager_init(&ctx->mgr, alc)) {
 		log_panic("Failed to init SourceManager");
@@ -65,43 +57,27 @@ void context_init(struct Context *ctx, allocer_t alc)
 		log_panic("Failed to initialize Interner");
 	}
 
-	if (!map_init(ctx->kw_map, alc, MAP_OPS_SYMBOL)) {
-		log_panic("Failed to initialize KeywordMap");
-	}
-
-	symbol_t sym;
-	TokenKind kind;
-
-#define TOK(ID)
-#define PUNCT(ID, STR)
-
-#define KW(ID, STR)                                                              \
-	do {                                                                     \
-		/* a. 将关键字字符串驻留，获得唯一的 Symbol ID */                \
-		sym = intern(&ctx->itn, str_from_cstr(STR));                     \
-		/* b. 获取对应的枚举值 (假设 token.h 中定义了 TokenKind_##ID) */ \
-		kind = TokenKind_##ID;                                           \
-		/* c. 存入 Map */                                                \
-		map_put(ctx->kw_map, sym, kind);                                 \
-	} while (0);
-
-#include "token.def"
+	/* Keywords and builtins get fixed ids; see prelude.h. */
+	prelude_intern(&ctx->itn);
 }
 
 void context_deinit(struct Context *ctx)
 {
-	map_deinit(ctx->kw_map);
-
 	intern_deinit(&ctx->itn);
 
 	srcmanager_deinit(&ctx->mgr);
 
-	types_deinit(ctx->alc);
+	arena_deinit(&ctx->scopes);
+	arena_deinit(&ctx->scratch);
+
+	if (ctx->locals)
+		allocer_free(allocer_system(), ctx->locals,
+			     layout(ctx->locals_cap * sizeof(*ctx->locals), 8));
 }
 
 /*
  * ==========================================================================
- * 3. Error Reporting
+ * 2. Error Reporting
  * ==========================================================================
  */
 
@@ -115,34 +91,42 @@ void ctx_error(struct Context *ctx, const struct Token *tok, const char *fmt,
 	ctx->had_error = true;
 
 	srcloc_t loc = { 0 };
+	str_t line_content = { 0 };
 	bool has_loc = false;
 
-	if (tok) {
+	if (tok && ctx->stream) {
+		has_loc = stream_lookup(ctx->stream, tok->span.start, &loc,
+					&line_content);
+	} else if (tok && ctx->doc) {
+		has_loc = doc_lookup(ctx->doc, tok->span.start, &loc,
+				     &line_content);
+	} else if (tok) {
 		has_loc = srcmanager_lookup(&ctx->mgr, tok->span.start, &loc);
+		if (has_loc)
+			line_content = srcmanager_get_line_content(
+				&ctx->mgr, tok->span.start);
 	}
 
 	if (has_loc) {
-		fprintf(stderr, "%s:%zu:%zu: Error: ", loc.filename, loc.line,
-			loc.col);
+		fprintf(ctx->diag, "%s:%zu:%zu: Error: ", loc.filename,
+			loc.line, loc.col);
 	} else {
-		fprintf(stderr, "Error: ");
+		fprintf(ctx->diag, "Error: ");
 	}
 
 	va_list ap;
 	va_start(ap, fmt);
-	vfprintf(stderr, fmt, ap);
+	vfprintf(ctx->diag, fmt, ap);
 	va_end(ap);
-	fprintf(stderr, "\n");
+	fprintf(ctx->diag, "\n");
 
 	if (has_loc) {
-		str_t line_content =
-			srcmanager_get_line_content(&ctx->mgr, tok->span.start);
-
 		if (line_content.len > 0) {
-			fprintf(stderr, "    %.*s\n", (int)line_content.len,
+			fprintf(ctx->diag, "    %.*s\n", (int)line_content.len,
 				line_content.ptr);
 
-			fprintf(stderr, "    %*s^\n", (int)(loc.col - 1), "");
+			fprintf(ctx->diag, "    %*s^\n", (int)(loc.col - 1),
+				"");
 		}
 	}
 }
@@ -0,0 +1,478 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * gvn: value numbering down the dominator tree. A pure instruction that
+ * repeats one in a dominating block, the same operation on the same
+ * operands, is replaced by it; constants count as equal when their bits
+ * are. Both tables are scoped: what a block adds is gone once the walk
+ * leaves the part of the tree it dominates.
+ *
+ * Loads are numbered by address too, as are the values stored, while no
+ * store or call in between may have written there. Memory facts only
+ * flow into a block from its one predecessor; a join starts afresh.
+ */
+
+#include <pass.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Memory
+ * ==========================================================================
+ * What a store can change follows from the roots of pass.h alone. Each
+ * fact and each write is stamped from one clock; a fact is still true
+ * while its stamp is newer than every write that may overlap it.
+ */
+
+/* The last write of each kind; stores to one root are in root_kill. A
+ * join counts as a write to an unknown address. */
+struct Kills {
+	u32 by[IrMem_COUNT];
+};
+
+/*
+ * ==========================================================================
+ * 2. Scoped Tables
+ * ==========================================================================
+ * Chained hash tables whose entries form a stack: a lookup finds the
+ * newest entry with the key first, and leaving a scope pops what it
+ * pushed, each entry then being the head of its chain.
+ */
+
+struct Entry {
+	u32 next;
+	u32 bucket;
+	/* The instruction that leads its expression, or, for memory, the
+	 * address and type read. */
+	IrValue key;
+	u32 ty;
+	IrValue value;
+	/* Memory only: when the fact was made, and what it reads. */
+	u32 stamp;
+	struct IrRoot root;
+};
+
+defVec(struct Entry, EntryVec);
+
+struct Table {
+	u32 *heads;
+	u32 mask;
+	/* entries.data[0] is unused, so that 0 ends a chain. */
+	EntryVec entries;
+};
+
+/* Undone on leaving the scope that set it. */
+struct RootKill {
+	u32 id;
+	u32 old;
+};
+
+defVec(struct RootKill, RootKillVec);
+
+struct Gvn {
+	const struct IrModule *m;
+	struct IrFunc *fn;
+	const struct IrCfg *cfg;
+	u32 nvalues;
+	/* The value each one was found equal to. */
+	IrValue *repl;
+
+	struct Table exprs;
+	struct Table mem;
+
+	u32 clock;
+	struct Kills kills;
+	/* Last store to each ALLOCA and global. */
+	u32 *root_kill;
+	RootKillVec root_log;
+	/* ALLOCAs whose address a call may see. */
+	bool *escaped;
+	bool changed;
+};
+
+static void table_init(struct Table *t, u32 n)
+{
+	u32 size = 16;
+	while (size < n)
+		size *= 2;
+	t->heads = ir_grab(size * sizeof(u32));
+	t->mask = size - 1;
+	massert(vec_init(t->entries, allocer_system(), 64), "OOM gvn");
+	struct Entry none = { 0 };
+	massert(vec_push(t->entries, none), "OOM gvn");
+}
+
+static void table_deinit(struct Table *t)
+{
+	ir_drop(t->heads, (t->mask + 1) * sizeof(u32));
+	vec_deinit(t->entries);
+}
+
+static void table_push(struct Table *t, u64 hash, struct Entry e)
+{
+	e.bucket = (u32)hash & t->mask;
+	e.next = t->heads[e.bucket];
+	massert(vec_push(t->entries, e), "OOM gvn");
+	t->heads[e.bucket] = (u32)vec_len(t->entries) - 1;
+}
+
+static void table_pop_to(struct Table *t, u32 mark)
+{
+	while (vec_len(t->entries) > mark) {
+		struct Entry *e = &t->entries.data[--t->entries.len];
+		t->heads[e->bucket] = e->next;
+	}
+}
+
+static u64 mix(u64 h, u64 x)
+{
+	h = (h ^ x) * 0x9e3779b97f4a7c15ull;
+	return h ^ (h >> 32);
+}
+
+/*
+ * ==========================================================================
+ * 3. Expressions
+ * ==========================================================================
+ */
+
+/* A DIV or MOD that a dominating copy did not trap in will not either. */
+static bool is_pure(IrOp op)
+{
+	switch (op) {
+	case IrOp_CONST:
+	case IrOp_INDEX:
+	case IrOp_ADD:
+	case IrOp_SUB:
+	case IrOp_MUL:
+	case IrOp_DIV:
+	case IrOp_MOD:
+	case IrOp_NEG:
+	case IrOp_NOT:
+	case IrOp_EQ:
+	case IrOp_NE:
+	case IrOp_LT:
+	case IrOp_LE:
+	case IrOp_GT:
+	case IrOp_GE:
+	case IrOp_PHI:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* The immediate that is part of an expression, its unused bytes clear. */
+static u64 imm_bits(const struct IrInst *inst)
+{
+	u64 bits = 0;
+	if (inst->op == IrOp_INDEX)
+		bits = inst->imm.mem.size;
+	else if (inst->op == IrOp_CONST)
+		memcpy(&bits, &inst->imm.k, ir_type_size((IrType)inst->ty));
+	return bits;
+}
+
+static u64 expr_hash(const struct IrFunc *fn, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(fn, v);
+	u64 h = 0xcbf29ce484222325ull;
+	h = mix(h, inst->op);
+	h = mix(h, inst->ty);
+	h = mix(h, imm_bits(inst));
+	if (inst->op == IrOp_PHI)
+		h = mix(h, inst->block);
+	const IrValue *args = ir_args(fn, v);
+	for (u32 i = 0; i < inst->nargs; ++i)
+		h = mix(h, args[i]);
+	return h;
+}
+
+static bool expr_eq(const struct IrFunc *fn, IrValue a, IrValue b)
+{
+	const struct IrInst *x = ir_inst(fn, a);
+	const struct IrInst *y = ir_inst(fn, b);
+	if (x->op != y->op || x->ty != y->ty || x->nargs != y->nargs)
+		return false;
+	if ((x->op == IrOp_PHI && x->block != y->block) ||
+	    imm_bits(x) != imm_bits(y))
+		return false;
+	return memcmp(ir_args(fn, a), ir_args(fn, b),
+		      x->nargs * sizeof(IrValue)) == 0;
+}
+
+/* The value numbered before that `v` repeats, or IR_NONE after numbering
+ * `v` itself. */
+static IrValue number(struct Gvn *g, IrValue v)
+{
+	struct IrFunc *fn = g->fn;
+	u64 h = expr_hash(fn, v);
+	for (u32 e = g->exprs.heads[(u32)h & g->exprs.mask]; e;
+	     e = g->exprs.entries.data[e].next) {
+		IrValue leader = g->exprs.entries.data[e].key;
+		if (expr_eq(fn, leader, v))
+			return leader;
+	}
+	table_push(&g->exprs, h, (struct Entry){ .key = v, .value = v });
+	return IR_NONE;
+}
+
+static IrValue find(const struct Gvn *g, IrValue v)
+{
+	while (v < g->nvalues && g->repl[v])
+		v = g->repl[v];
+	return v;
+}
+
+/* Operands by their numbers, and commutative integer ones in order. */
+static void canonicalize(struct Gvn *g, IrValue v)
+{
+	struct IrFunc *fn = g->fn;
+	IrValue *args = ir_args(fn, v);
+	ir_foreach_operand(fn, v, i)
+		args[i] = find(g, args[i]);
+
+	const struct IrInst *inst = ir_inst(fn, v);
+	bool commutes = inst->op == IrOp_ADD || inst->op == IrOp_MUL ||
+			inst->op == IrOp_EQ || inst->op == IrOp_NE;
+	if (!commutes || args[0] < args[1])
+		return;
+	/* Not floats: which NaN comes out depends on the order. */
+	IrType ty = (IrType)ir_inst(fn, args[0])->ty;
+	if (ty == IrType_I32 || ty == IrType_I1) {
+		IrValue t = args[0];
+		args[0] = args[1];
+		args[1] = t;
+	}
+}
+
+/*
+ * ==========================================================================
+ * 4. Loads and Stores
+ * ==========================================================================
+ */
+
+static struct IrRoot root_of(const struct Gvn *g, IrValue addr)
+{
+	return ir_root_of(g->fn, g->nvalues, addr);
+}
+
+static bool still_true(const struct Gvn *g, const struct Entry *e)
+{
+	u32 t = e->stamp;
+	IrMemSet overlaps = ir_mem_overlaps(e->root, g->escaped);
+	if ((overlaps & IR_MEM(SAME)) && t <= g->root_kill[e->root.id])
+		return false;
+	for (u32 k = IrMem_SAME + 1; k < IrMem_COUNT; ++k)
+		if ((overlaps & (1u << k)) && t <= g->kills.by[k])
+			return false;
+	return true;
+}
+
+static u64 mem_hash(IrValue addr, u32 ty)
+{
+	return mix(mix(0xcbf29ce484222325ull, addr), ty);
+}
+
+/* Newer facts shadow older ones, so the first match decides. */
+static IrValue mem_lookup(const struct Gvn *g, IrValue addr, u32 ty)
+{
+	for (u32 e = g->mem.heads[(u32)mem_hash(addr, ty) & g->mem.mask]; e;
+	     e = g->mem.entries.data[e].next) {
+		const struct Entry *it = &g->mem.entries.data[e];
+		if (it->key == addr && it->ty == ty)
+			return still_true(g, it) ? it->value : IR_NONE;
+	}
+	return IR_NONE;
+}
+
+static void mem_record(struct Gvn *g, IrValue addr, u32 ty, IrValue value,
+		       struct IrRoot root)
+{
+	if (root.kind == IrRoot_UNKNOWN)
+		return;
+	struct Entry e = { .key = addr, .ty = ty, .value = value,
+			   .stamp = ++g->clock, .root = root };
+	table_push(&g->mem, mem_hash(addr, ty), e);
+}
+
+static void kill_root(struct Gvn *g, u32 id)
+{
+	struct RootKill undo = { id, g->root_kill[id] };
+	massert(vec_push(g->root_log, undo), "OOM gvn");
+	g->root_kill[id] = ++g->clock;
+}
+
+/* A write through an address based on `root`. */
+static void clobber(struct Gvn *g, struct IrRoot root)
+{
+	IrMemSet kinds = ir_mem_kinds(root);
+	if (kinds & IR_MEM(SAME))
+		kill_root(g, root.id);
+	for (u32 k = IrMem_SAME + 1; k < IrMem_COUNT; ++k)
+		if (kinds & (1u << k))
+			g->kills.by[k] = ++g->clock;
+}
+
+/*
+ * ==========================================================================
+ * 5. The Walk
+ * ==========================================================================
+ */
+
+static void replace(struct Gvn *g, IrValue v, IrValue with)
+{
+	g->repl[v] = with;
+	ir_remove(g->fn, v);
+	g->changed = true;
+}
+
+static void visit_block(struct Gvn *g, u32 bb)
+{
+	struct IrFunc *fn = g->fn;
+	IrValue v = fn->blocks.data[bb].first;
+	while (v) {
+		IrValue next = ir_inst(fn, v)->next;
+		canonicalize(g, v);
+		const struct IrInst *inst = ir_inst(fn, v);
+		const IrValue *args = ir_args(fn, v);
+		IrValue same;
+		switch (inst->op) {
+		case IrOp_LOAD:
+			same = mem_lookup(g, args[0], inst->ty);
+			if (same)
+				replace(g, v, same);
+			else
+				mem_record(g, args[0], inst->ty, v,
+					   root_of(g, args[0]));
+			break;
+		case IrOp_STORE: {
+			struct IrRoot root = root_of(g, args[0]);
+			clobber(g, root);
+			mem_record(g, args[0], ir_inst(fn, args[1])->ty, args[1],
+				   root);
+			break;
+		}
+		case IrOp_ZERO:
+			clobber(g, root_of(g, args[0]));
+			break;
+		case IrOp_CALL:
+			/* The builtins touch no memory of the program. */
+			if (!g->m->funcs.data[inst->imm.index].is_extern)
+				g->kills.by[IrMem_CALL] = ++g->clock;
+			break;
+		default:
+			if (is_pure((IrOp)inst->op) && (same = number(g, v)))
+				replace(g, v, same);
+		}
+		v = next;
+	}
+}
+
+/* A block in the walk, and what to restore on leaving it. */
+struct Frame {
+	u32 bb;
+	u32 child;
+	u32 exprs;
+	u32 mem;
+	u32 roots;
+	struct Kills kills;
+};
+
+static struct Frame enter(struct Gvn *g, const struct IrDomTree *dt, u32 bb)
+{
+	struct Frame f = {
+		.bb = bb,
+		.child = dt->child_start[bb],
+		.exprs = (u32)vec_len(g->exprs.entries),
+		.mem = (u32)vec_len(g->mem.entries),
+		.roots = (u32)vec_len(g->root_log),
+		.kills = g->kills,
+	};
+	const struct IrCfg *cfg = g->cfg;
+	if (cfg->pred_start[bb + 1] - cfg->pred_start[bb] != 1)
+		g->kills.by[IrMem_UNKNOWN] = ++g->clock;
+	visit_block(g, bb);
+	return f;
+}
+
+static void leave(struct Gvn *g, const struct Frame *f)
+{
+	table_pop_to(&g->exprs, f->exprs);
+	table_pop_to(&g->mem, f->mem);
+	while (vec_len(g->root_log) > f->roots) {
+		struct RootKill undo = g->root_log.data[--g->root_log.len];
+		g->root_kill[undo.id] = undo.old;
+	}
+	g->kills = f->kills;
+}
+
+IrAnalysisSet ir_gvn(struct PassManager *pm)
+{
+	struct IrFunc *fn = pm->fn;
+	const struct IrDomTree *dt = pm_domtree(pm);
+	struct Gvn g = { .m = pm->m, .fn = fn, .cfg = pm_cfg(pm) };
+	u32 n = g.nvalues = (u32)vec_len(fn->insts);
+	u32 nroots = n + (u32)vec_len(pm->m->globals);
+	g.repl = ir_grab(n * sizeof(IrValue));
+	g.root_kill = ir_grab(nroots * sizeof(u32));
+	g.escaped = ir_grab(n);
+	massert(vec_init(g.root_log, allocer_system(), 64), "OOM gvn");
+	table_init(&g.exprs, n);
+	table_init(&g.mem, n / 4);
+	ir_find_escapes(fn, n, g.escaped);
+
+	/* Constants are in no block, so they are numbered for all of it. */
+	for (IrValue v = 1; v < n; ++v) {
+		IrValue same;
+		if (ir_inst(fn, v)->op == IrOp_CONST && (same = number(&g, v)))
+			g.repl[v] = same;
+	}
+
+	u32 nblocks = g.cfg->nblocks;
+	usize bytes = (usize)nblocks * sizeof(struct Frame);
+	struct Frame *stack = ir_grab(bytes);
+	u32 top = 0;
+	stack[top++] = enter(&g, dt, 1);
+	while (top) {
+		struct Frame *f = &stack[top - 1];
+		if (f->child < dt->child_start[f->bb + 1]) {
+			u32 child = dt->children[f->child++];
+			stack[top] = enter(&g, dt, child);
+			++top;
+			continue;
+		}
+		leave(&g, f);
+		--top;
+	}
+	ir_drop(stack, bytes);
+
+	/* PHIs met their back edges' values before those were numbered. */
+	if (g.changed)
+		ir_replace_uses(fn, g.repl);
+
+	table_deinit(&g.exprs);
+	table_deinit(&g.mem);
+	vec_deinit(g.root_log);
+	ir_drop(g.escaped, n);
+	ir_drop(g.root_kill, nroots * sizeof(u32));
+	ir_drop(g.repl, n * sizeof(IrValue));
+	return g.changed ? IR_PRESERVE_CFG : IR_PRESERVE_ALL;
+}
@@ -0,0 +1,699 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <incr.h>
+#include <string.h>
+#include <context.h>
+#include <lexer.h>
+#include <parser.h>
+#include <sema.h>
+#include <type.h>
+#include <trace.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+/*
+ * ==========================================================================
+ * 1. Helpers
+ * ==========================================================================
+ */
+
+/* Labels of consecutive items when they are (re)numbered from scratch. */
+#define ORDER_GAP ((u64)1 << 32)
+/* Label of globals whose defining item is gone: visible to no one. */
+#define ORDER_DEAD UINT64_MAX
+/* Arena chunks of a version: an edit usually reparses one item. */
+#define VERSION_CHUNK_SIZE (8 * 1024)
+#define ARENA_LAYOUT layout(sizeof(struct Arena), _Alignof(struct Arena))
+
+/* A replaced global, as it looked before the edit. */
+struct OldDef {
+	struct SemaSymbol *sym;
+	struct Type *ty;
+	bool is_const;
+	bool has_value;
+	struct SemaConst value;
+};
+
+defVec(struct OldDef, OldDefVec);
+
+static u64 _ptr_hash(const void *key)
+{
+	uintptr_t addr = (uintptr_t)*(const void *const *)key;
+	return (u64)addr * 0x9e3779b97f4a7c15ull;
+}
+
+static bool _ptr_eq(const void *lhs, const void *rhs)
+{
+	return *(const void *const *)lhs == *(const void *const *)rhs;
+}
+
+static const map_ops_t MAP_OPS_PTR = { .hash = _ptr_hash, .equals = _ptr_eq };
+
+static u64 order_of(struct Document *d, struct SemaSymbol *sym)
+{
+	/* Builtins are not tracked and precede everything. */
+	u64 *order = map_get(d->orders, sym);
+	return order ? *order : 0;
+}
+
+static void set_order(struct Document *d, struct SemaSymbol *sym, u64 order)
+{
+	massert(map_put(d->orders, sym, order), "OOM incr");
+}
+
+/**
+ * @brief A label strictly between `lo` and `hi`, or `lo` itself when the
+ * gap is used up (`*relabel` then asks for a renumbering).
+ */
+static u64 order_between(u64 lo, u64 hi, bool *relabel)
+{
+	if (hi == ORDER_DEAD)
+		return lo + ORDER_GAP;
+	if (hi - lo >= 2)
+		return lo + (hi - lo) / 2;
+	*relabel = true;
+	return lo;
+}
+
+static void relabel(struct Document *d)
+{
+	u64 order = 0;
+	vec_foreach(it, d->items)
+	{
+		order += ORDER_GAP;
+		it->order = order;
+		vec_foreach(sym, it->defs)
+		{
+			set_order(d, *sym, order);
+		}
+	}
+}
+
+static usize file_base(struct Document *d)
+{
+	return srcmanager_get_file(&d->ctx->mgr, d->file_id)->base_offset;
+}
+
+/**
+ * @brief Make head + mid + tail the current text, in a span range after
+ * that of every earlier version.
+ */
+static void new_version(struct Document *d, str_t head, str_t mid,
+			str_t tail)
+{
+	usize len = head.len + mid.len + tail.len;
+	char *buf = allocer_alloc(allocer_system(), layout(len + 1, 1));
+	massert(buf, "OOM document text");
+
+	memcpy(buf, head.ptr, head.len);
+	memcpy(buf + head.len, mid.ptr, mid.len);
+	memcpy(buf + head.len + mid.len, tail.ptr, tail.len);
+	buf[len] = '\0';
+
+	/* One byte apart: the end of a version is a position of its own. */
+	usize base = file_base(d);
+	if (vec_len(d->versions) > 0)
+		base = d->base + d->text.len + 1;
+
+	allocer_t sys = allocer_system();
+	struct Arena *arena = allocer_alloc(sys, ARENA_LAYOUT);
+	massert(arena, "OOM document");
+	arena_init(arena, sys, VERSION_CHUNK_SIZE);
+
+	struct DocVersion v = { buf, len, base, arena, true };
+	massert(vec_push(d->versions, v), "OOM document");
+	d->text = str_from_parts(buf, len);
+	d->base = base;
+}
+
+/**
+ * @brief The version whose span range holds `offset`, if any is left.
+ */
+static struct DocVersion *find_version(struct Document *d, usize offset)
+{
+	usize lo = 0, hi = vec_len(d->versions);
+	while (lo < hi) {
+		usize mid = lo + (hi - lo) / 2;
+		if (vec_at(d->versions, mid).base <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return NULL;
+
+	struct DocVersion *v = &vec_at(d->versions, lo - 1);
+	return offset <= v->base + v->len ? v : NULL;
+}
+
+static void free_version(struct DocVersion *v)
+{
+	allocer_t sys = allocer_system();
+	allocer_free(sys, v->text, layout(v->len + 1, 1));
+	arena_deinit(v->arena);
+	allocer_free(sys, v->arena, ARENA_LAYOUT);
+}
+
+/* Where items parsed from the current version allocate. */
+static allocer_t version_allocer(struct Document *d)
+{
+	usize n = vec_len(d->versions);
+	return arena_allocer(vec_at(d->versions, n - 1).arena);
+}
+
+/**
+ * @brief Free the versions no item was parsed from any more.
+ */
+static void drop_versions(struct Document *d)
+{
+	vec_foreach(v, d->versions)
+	{
+		v->live = v->base == d->base;
+	}
+	vec_foreach(it, d->items)
+	{
+		find_version(d, it->base)->live = true;
+	}
+
+	usize n = 0;
+	vec_foreach(v, d->versions)
+	{
+		if (v->live)
+			vec_at(d->versions, n++) = *v;
+		else
+			free_version(v);
+	}
+	d->versions.len = n;
+}
+
+/**
+ * @brief Start a parser at `offset` of the current text, checking against
+ * the document's global scope.
+ */
+static void item_parser_init(struct Document *d, struct Parser *p,
+			     struct Lexer *lex, usize offset)
+{
+	d->ctx->had_error = false;
+	d->ctx->panic_mode = false;
+	lexer_init(lex, d->ctx, d->file_id);
+	lex->content_start = d->text.ptr;
+	lex->content_len = d->text.len;
+	lex->window_base = d->base - file_base(d);
+	lex->cursor = offset;
+	parser_init(p, d->ctx, lex);
+	p->alc = version_allocer(d);
+	p->sema.alc = p->alc;
+	p->sema.curr_scope = d->globals;
+}
+
+/* Binds the globals of the item being parsed. */
+struct ItemTracker {
+	struct SemaTracker base;
+	struct Document *d;
+	struct DocItem *it;
+	/* Symbols of replaced items, reused by name. */
+	SymbolVec *pool;
+};
+
+static void track_define(struct SemaTracker *t, struct SemaSymbol *sym)
+{
+	struct ItemTracker *tr = (struct ItemTracker *)t;
+	massert(vec_push(tr->it->defs, sym), "OOM incr");
+	set_order(tr->d, sym, tr->it->order);
+}
+
+static void track_use(struct SemaTracker *t, struct SemaSymbol *sym)
+{
+	SymbolVec *uses = &((struct ItemTracker *)t)->it->uses;
+
+	/* Cheap dedup: the same global is often used many times in a row. */
+	usize n = vec_len(*uses);
+	if (n == 0 || vec_at(*uses, n - 1) != sym)
+		massert(vec_push(*uses, sym), "OOM incr");
+}
+
+static struct SemaSymbol *track_reuse(struct SemaTracker *t, symbol_t name)
+{
+	SymbolVec *pool = ((struct ItemTracker *)t)->pool;
+
+	for (usize i = 0; i < vec_len(*pool); ++i) {
+		struct SemaSymbol *sym = vec_at(*pool, i);
+		if (sym->name.id == name.id) {
+			vec_at(*pool, i) = vec_at(*pool, vec_len(*pool) - 1);
+			pool->len--;
+			return sym;
+		}
+	}
+	return NULL;
+}
+
+static bool track_visible(struct SemaTracker *t, struct SemaSymbol *sym)
+{
+	struct ItemTracker *tr = (struct ItemTracker *)t;
+	return order_of(tr->d, sym) <= tr->it->order;
+}
+
+/**
+ * @brief Parse the next item into `it`, labelled `order`.
+ * @return false at end of input (`it` is then left without a node).
+ */
+static bool parse_one(struct Document *d, struct Parser *p,
+		      struct DocItem *it, usize start, u64 order,
+		      SymbolVec *pool)
+{
+	struct Context *ctx = d->ctx;
+
+	ctx->had_error = false;
+	ctx->panic_mode = false;
+	p->panic_mode = false;
+
+	it->order = order;
+	massert(vec_init(it->defs, p->alc, 2), "OOM item defs");
+	massert(vec_init(it->uses, p->alc, 4), "OOM item uses");
+
+	struct ItemTracker tr = {
+		.base = { track_define, track_use, track_reuse, track_visible },
+		.d = d,
+		.it = it,
+		.pool = pool,
+	};
+	p->sema.tracker = &tr.base;
+	it->node = parser_parse_item(p);
+	p->sema.tracker = NULL;
+
+	it->base = d->base;
+	it->start = start;
+	it->end = p->prev.span.end - d->base;
+	it->had_error = ctx->had_error;
+	return it->node != NULL;
+}
+
+/**
+ * @brief Take the globals of a replaced item out of effect, remembering
+ * them in `olds` and offering them for reuse through `pool`.
+ */
+static void retire(struct Document *d, struct DocItem *it, SymbolVec *pool,
+		   OldDefVec *olds)
+{
+	vec_foreach(sym, it->defs)
+	{
+		struct OldDef od = { *sym, (*sym)->ty, (*sym)->is_const,
+				     (*sym)->has_value, (*sym)->value };
+		massert(vec_push(*olds, od), "OOM incr");
+		massert(vec_push(*pool, *sym), "OOM incr");
+		set_order(d, *sym, ORDER_DEAD);
+	}
+}
+
+static bool contains(SymbolVec *v, struct SemaSymbol *sym)
+{
+	vec_foreach(s, *v)
+	{
+		if (*s == sym)
+			return true;
+	}
+	return false;
+}
+
+/* Uses fold a const's value: a new one changes their diagnostics. */
+static bool same_value(const struct OldDef *od)
+{
+	const struct SemaSymbol *sym = od->sym;
+	if (od->has_value != sym->has_value)
+		return false;
+	if (!sym->has_value)
+		return true;
+	if (od->value.ty != sym->value.ty)
+		return false;
+	if (sym->value.ty == ty_bool)
+		return od->value.b == sym->value.b;
+	if (sym->value.ty == ty_float)
+		return memcmp(&od->value.f, &sym->value.f, sizeof(f32)) == 0;
+	if (sym->value.ty == ty_double)
+		return memcmp(&od->value.d, &sym->value.d, sizeof(f64)) == 0;
+	return od->value.i == sym->value.i;
+}
+
+/**
+ * @brief Globals in `olds` that were not defined again, changed type
+ * or value, go to `dirty`.
+ */
+static void diff_olds(struct Document *d, OldDefVec *olds, SymbolVec *dirty)
+{
+	vec_foreach(od, *olds)
+	{
+		if (order_of(d, od->sym) == ORDER_DEAD ||
+		    !type_eq(od->ty, od->sym->ty) ||
+		    od->is_const != od->sym->is_const || !same_value(od))
+			massert(vec_push(*dirty, od->sym), "OOM incr");
+	}
+}
+
+/**
+ * @brief Globals of `it` that did not exist before the edit go to `added`.
+ */
+static void diff_new(OldDefVec *olds, struct DocItem *it, SymbolVec *added)
+{
+	vec_foreach(sym, it->defs)
+	{
+		bool existed = false;
+		vec_foreach(od, *olds)
+		{
+			existed = existed || od->sym == *sym;
+		}
+		if (!existed)
+			massert(vec_push(*added, *sym), "OOM incr");
+	}
+}
+
+static bool defines_any(struct DocItem *it, SymbolVec *names)
+{
+	vec_foreach(sym, it->defs)
+	{
+		vec_foreach(n, *names)
+		{
+			if ((*sym)->name.id == (*n)->name.id)
+				return true;
+		}
+	}
+	return false;
+}
+
+static bool uses_any(struct DocItem *it, SymbolVec *dirty)
+{
+	vec_foreach(sym, it->uses)
+	{
+		if (contains(dirty, *sym))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Replace items [k, resync) by `fresh` in place and move the items
+ * behind them by `delta` bytes.
+ */
+static void splice(DocItemVec *items, usize k, usize resync,
+		   DocItemVec *fresh, isize delta)
+{
+	usize n = vec_len(*items);
+	usize removed = resync - k;
+	usize added = vec_len(*fresh);
+
+	if (added > removed) {
+		struct DocItem pad = { 0 };
+		for (usize i = removed; i < added; ++i)
+			massert(vec_push(*items, pad), "OOM incr");
+	}
+	if (added != removed && resync < n)
+		memmove(&vec_at(*items, k + added), &vec_at(*items, resync),
+			(n - resync) * sizeof(struct DocItem));
+	if (added < removed)
+		items->len -= removed - added;
+
+	for (usize i = 0; i < added; ++i)
+		vec_at(*items, k + i) = vec_at(*fresh, i);
+
+	for (usize i = k + added; i < vec_len(*items); ++i) {
+		struct DocItem *it = &vec_at(*items, i);
+		it->start = (usize)((isize)it->start + delta);
+		it->end = (usize)((isize)it->end + delta);
+	}
+}
+
+/*
+ * ==========================================================================
+ * 2. Reparse
+ * ==========================================================================
+ */
+
+/**
+ * @brief Bring later items up to date after items [from, ..) changed the
+ * globals in `dirty` and `added`.
+ */
+static void recheck(struct Document *d, usize from, SymbolVec *dirty,
+		    SymbolVec *added)
+{
+	TRACE_SCOPE("incr_recheck");
+	allocer_t tmp = arena_allocer(&d->ctx->scratch);
+
+	for (usize i = from; i < vec_len(d->items); ++i) {
+		struct DocItem *it = &vec_at(d->items, i);
+		if (!it->had_error && !uses_any(it, dirty) &&
+		    !defines_any(it, added))
+			continue;
+
+		SymbolVec own;
+		OldDefVec olds;
+		massert(vec_init(own, tmp, 2), "OOM incr");
+		massert(vec_init(olds, tmp, 2), "OOM incr");
+		retire(d, it, &own, &olds);
+
+		struct Parser p;
+		struct Lexer lex;
+		item_parser_init(d, &p, &lex, it->start);
+
+		struct DocItem re;
+		parse_one(d, &p, &re, it->start, it->order, &own);
+		diff_olds(d, &olds, dirty);
+		diff_new(&olds, &re, added);
+		*it = re;
+		d->last.rechecked++;
+	}
+}
+
+/**
+ * @brief Reparse from item `k` on until item boundaries resynchronize.
+ * * The edit replaced old bytes [.., new_end - delta) by new bytes
+ * [.., new_end).
+ */
+static void reparse(struct Document *d, usize k, usize new_end, isize delta)
+{
+	TRACE_SCOPE("incr_reparse");
+	struct Context *ctx = d->ctx;
+	DocItemVec *items = &d->items;
+	usize n = vec_len(*items);
+	usize old_end = (usize)((isize)new_end - delta);
+	usize begin = k > 0 ? vec_at(*items, k - 1).end : 0;
+	u64 lo = k > 0 ? vec_at(*items, k - 1).order : 0;
+
+	/* Bookkeeping below lives only for this edit. */
+	struct ArenaMark scratch_mark = arena_mark(&ctx->scratch);
+	allocer_t tmp = arena_allocer(&ctx->scratch);
+
+	SymbolVec pool;
+	OldDefVec olds;
+	DocItemVec fresh;
+	massert(vec_init(pool, tmp, 8), "OOM incr");
+	massert(vec_init(olds, tmp, 8), "OOM incr");
+	massert(vec_init(fresh, tmp, 4), "OOM incr");
+
+	/* Old items [k, r) are replaced: at least all overlapping the edit. */
+	usize r = k;
+	if (r < n)
+		retire(d, &vec_at(*items, r++), &pool, &olds);
+	while (r < n && vec_at(*items, r - 1).end < old_end)
+		retire(d, &vec_at(*items, r++), &pool, &olds);
+
+	struct Parser p;
+	struct Lexer lex;
+	item_parser_init(d, &p, &lex, begin);
+
+	usize resync = n;
+	bool need_relabel = false;
+	usize pos = begin;
+	for (;;) {
+		u64 hi = r < n ? vec_at(*items, r).order : ORDER_DEAD;
+		u64 order = order_between(lo, hi, &need_relabel);
+
+		struct DocItem it;
+		if (!parse_one(d, &p, &it, pos, order, &pool)) {
+			d->tail_error = it.had_error;
+			while (r < n)
+				retire(d, &vec_at(*items, r++), &pool, &olds);
+			break;
+		}
+		massert(vec_push(fresh, it), "OOM incr");
+		pos = it.end;
+		lo = order;
+
+		if (it.end < new_end)
+			continue;
+
+		/* Past the edit: stop once we land on an old item boundary. */
+		usize old_pos = (usize)((isize)it.end - delta);
+		while (r > k && r < n && vec_at(*items, r - 1).end < old_pos)
+			retire(d, &vec_at(*items, r++), &pool, &olds);
+		if (r > k && vec_at(*items, r - 1).end == old_pos) {
+			resync = r;
+			break;
+		}
+	}
+
+	/* Which surviving globals changed, and which names are new? */
+	SymbolVec dirty, added;
+	massert(vec_init(dirty, tmp, 4), "OOM incr");
+	massert(vec_init(added, tmp, 4), "OOM incr");
+	diff_olds(d, &olds, &dirty);
+	vec_foreach(it, fresh)
+	{
+		diff_new(&olds, it, &added);
+	}
+
+	splice(items, k, resync, &fresh, delta);
+	if (need_relabel)
+		relabel(d);
+
+	d->last.reparsed = vec_len(fresh);
+	d->last.rechecked = 0;
+
+	usize first_after = k + vec_len(fresh);
+	bool any_later_error = false;
+	for (usize i = first_after; i < vec_len(*items); ++i)
+		any_later_error = any_later_error || vec_at(*items, i).had_error;
+
+	if (vec_len(dirty) > 0 || vec_len(added) > 0 || any_later_error)
+		recheck(d, first_after, &dirty, &added);
+
+	d->last.reused =
+		vec_len(*items) - d->last.reparsed - d->last.rechecked;
+
+	arena_release(&ctx->scratch, scratch_mark);
+}
+
+/*
+ * ==========================================================================
+ * 3. Public API
+ * ==========================================================================
+ */
+
+bool doc_open(struct Document *d, struct Context *ctx, const char *path,
+	      str_t text)
+{
+	d->ctx = ctx;
+	d->path = path;
+	d->tail_error = false;
+	massert(vec_init(d->items, ctx->alc, 16), "OOM document");
+	massert(map_init(d->orders, ctx->alc, MAP_OPS_PTR), "OOM document");
+	massert(vec_init(d->versions, ctx->alc, 4), "OOM document");
+
+	d->file_id = srcmanager_add(&ctx->mgr, str_from_cstr(path),
+				    str_from_parts("", 0));
+	new_version(d, text, str_from_cstr(""), str_from_cstr(""));
+
+	/* The global scope outlives every parser. */
+	struct Parser p;
+	struct Lexer lex;
+	lexer_init(&lex, ctx, d->file_id);
+	parser_init(&p, ctx, &lex);
+	parser_begin_unit(&p);
+	d->globals = p.sema.curr_scope;
+
+	reparse(d, 0, d->text.len, (isize)d->text.len);
+	return !doc_had_error(d);
+}
+
+bool doc_edit(struct Document *d, usize start, usize end, str_t text)
+{
+	if (start > end || end > d->text.len) {
+		log_error("Edit range [%zu, %zu) out of bounds", start, end);
+		return false;
+	}
+
+	str_t old = d->text;
+	new_version(d, str_from_parts(old.ptr, start), text,
+		    str_from_parts(old.ptr + end, old.len - end));
+
+	/* The first item reaching the edit (touching counts) is affected. */
+	usize k = 0, hi = vec_len(d->items);
+	while (k < hi) {
+		usize mid = k + (hi - k) / 2;
+		if (vec_at(d->items, mid).end < start)
+			k = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Where error recovery ended an item depends on the text after it. */
+	while (k > 0 && vec_at(d->items, k - 1).had_error)
+		k--;
+
+	isize delta = (isize)text.len - (isize)(end - start);
+	reparse(d, k, start + text.len, delta);
+	drop_versions(d);
+	return !doc_had_error(d);
+}
+
+bool doc_had_error(struct Document *d)
+{
+	if (d->tail_error)
+		return true;
+	vec_foreach(it, d->items)
+	{
+		if (it->had_error)
+			return true;
+	}
+	return false;
+}
+
+void doc_close(struct Document *d)
+{
+	vec_foreach(v, d->versions)
+	{
+		free_version(v);
+	}
+	d->versions.len = 0;
+	d->text = str_from_parts("", 0);
+}
+
+void doc_globals(struct Document *d, NodeVec *out)
+{
+	allocer_t tmp = arena_allocer(&d->ctx->scratch);
+	massert(vec_init(*out, tmp, vec_len(d->items) + 1), "OOM globals");
+	vec_foreach(it, d->items)
+	{
+		vec_push(*out, it->node);
+	}
+}
+
+bool doc_lookup(struct Document *d, usize offset, srcloc_t *loc,
+		str_t *line)
+{
+	struct DocVersion *v = find_version(d, offset);
+	if (!v)
+		return false;
+
+	usize pos = offset - v->base;
+	usize line_start = 0;
+	usize line_no = 1;
+	for (usize i = 0; i < pos; i++) {
+		if (v->text[i] == '\n') {
+			line_no++;
+			line_start = i + 1;
+		}
+	}
+
+	usize end = pos;
+	while (end < v->len && v->text[end] != '\n')
+		end++;
+
+	loc->filename = d->path;
+	loc->line = line_no;
+	loc->col = pos - line_start + 1;
+	*line = str_from_parts(v->text + line_start, end - line_start);
+	return true;
+}
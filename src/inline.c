@@ -0,0 +1,498 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * inline: copies the body of a callee into its caller in place of a
+ * call. ir_optimize takes functions callees first, so a callee is copied
+ * as already optimized, and the calls in it have had their turn; the
+ * copies of those are not considered again. Calls within one component
+ * of the call graph are recursion and stay calls, which is what bounds
+ * inlining.
+ *
+ * A call is inlined when its cost is at most the limit. The cost is the
+ * callee's size in instructions, less the call and return it saves and
+ * one for every use of a parameter that is passed a constant or the
+ * address of an array the caller owns, which the caller's passes can
+ * then fold or see through. The last call of a function does not pay for
+ * its body, which prune then deletes. A caller does not grow past
+ * IR_INLINE_CALLER_MAX instructions, and a recursive one takes no callee
+ * with arrays of its own, which would then sit in every frame of it.
+ */
+
+#include <pass.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Cost
+ * ==========================================================================
+ */
+
+struct Inliner {
+	struct IrModule *m;
+	struct IrFunc *fn;
+	struct IrCallGraph *calls;
+	const struct IrOptOptions *opts;
+	/* Instructions in fn, as it grows. */
+	u32 size;
+
+	/* The calls of fn to functions with bodies, taken up front. */
+	IrU32Vec sites;
+	/* Copy of each value and block of the callee being inlined. */
+	IrU32Vec map;
+	IrU32Vec blocks;
+	/* Blocks of the copy that returned, and what. */
+	IrU32Vec ret_blocks;
+	IrU32Vec ret_vals;
+	/* Inlined calls and the values that replace them. */
+	IrU32Vec done;
+	IrU32Vec results;
+};
+
+struct Cost {
+	i64 cost;
+	u32 size;
+	/* Bytes of ALLOCA. */
+	u32 frame;
+};
+
+static void remark(const struct Inliner *in, const char *fmt, ...)
+{
+	FILE *out = in->opts->remarks;
+	if (!out)
+		return;
+	va_list ap;
+	va_start(ap, fmt);
+	fputs("remark: ", out);
+	vfprintf(out, fmt, ap);
+	fputc('\n', out);
+	va_end(ap);
+}
+
+static u32 size_of(const struct IrFunc *fn)
+{
+	u32 n = 0;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb)
+		ir_foreach_inst(fn, bb, v)
+			++n;
+	return n;
+}
+
+static struct Cost cost_of(const struct Inliner *in, IrValue call, u32 index)
+{
+	const struct IrFunc *fn = in->fn;
+	const struct IrFunc *callee = &in->m->funcs.data[index];
+	const IrValue *args = ir_args(fn, call);
+	struct Cost c = { 0 };
+	i64 folds = 0;
+	for (u32 bb = 1; bb < vec_len(callee->blocks); ++bb) {
+		ir_foreach_inst(callee, bb, v)
+		{
+			const struct IrInst *inst = ir_inst(callee, v);
+			++c.size;
+			if (inst->op == IrOp_ALLOCA)
+				c.frame += inst->imm.mem.size;
+			const IrValue *ops = ir_args(callee, v);
+			ir_foreach_operand(callee, v, i)
+			{
+				IrValue u = ops[i];
+				if (ir_inst(callee, u)->op != IrOp_PARAM)
+					continue;
+				u32 k = ir_inst(callee, u)->imm.index;
+				IrOp arg = ir_inst(fn, args[k])->op;
+				folds += arg == IrOp_CONST ||
+					 arg == IrOp_ALLOCA ||
+					 arg == IrOp_GLOBAL;
+			}
+		}
+	}
+	c.cost = (i64)c.size - folds - 2 - ir_inst(fn, call)->nargs;
+	if (in->calls->sites[index] == 1 && strcmp(callee->name, "main") != 0)
+		c.cost -= c.size;
+	return c;
+}
+
+/*
+ * ==========================================================================
+ * 2. Copying the Callee
+ * ==========================================================================
+ */
+
+static void reset(IrU32Vec *v, u32 n)
+{
+	v->len = 0;
+	while (vec_len(*v) < n)
+		massert(vec_push(*v, 0), "OOM inline");
+}
+
+/* The copy of callee value `u`; constants and globals on first use. */
+static IrValue value_of(struct Inliner *in, const struct IrFunc *callee,
+			IrValue u)
+{
+	if (in->map.data[u])
+		return in->map.data[u];
+	const struct IrInst *inst = ir_inst(callee, u);
+	IrValue copy;
+	if (inst->op == IrOp_CONST)
+		copy = ir_const(in->fn, ir_const_value(callee, u));
+	else if (inst->op == IrOp_GLOBAL)
+		copy = ir_global_addr(in->fn, inst->imm.index);
+	else
+		massert(false, "inline: value used before its definition");
+	in->map.data[u] = copy;
+	return copy;
+}
+
+/* Moves what follows `call` to a new block and returns it. */
+static u32 split_after(struct IrFunc *fn, IrValue call)
+{
+	u32 bb = ir_inst(fn, call)->block;
+	u32 rest = ir_block_new(fn);
+	IrValue after = IR_NONE;
+	while (ir_inst(fn, call)->next) {
+		IrValue v = ir_inst(fn, call)->next;
+		ir_move_after(fn, v, rest, after);
+		after = v;
+	}
+
+	/* The successors' PHIs now come from `rest`. */
+	u32 succ[2];
+	u32 n = ir_succs(fn, rest, succ);
+	for (u32 s = 0; s < n; ++s) {
+		ir_foreach_inst(fn, succ[s], v)
+		{
+			if (ir_inst(fn, v)->op != IrOp_PHI)
+				break;
+			IrValue *args = ir_args(fn, v);
+			for (u32 i = 0; i < ir_inst(fn, v)->nargs; i += 2)
+				if (args[i] == bb)
+					args[i] = rest;
+		}
+	}
+	return rest;
+}
+
+/* Copies callee instruction `v` to the end of b->block; a RET becomes a
+ * branch to `rest`, an ALLOCA one in the caller's entry. */
+static void copy_inst(struct Inliner *in, const struct IrFunc *callee,
+		      IrValue v, struct IrBuilder *b, u32 rest)
+{
+	struct IrFunc *fn = in->fn;
+	const struct IrInst *inst = ir_inst(callee, v);
+	if (inst->op == IrOp_RET) {
+		IrValue val = inst->nargs ? ir_args(callee, v)[0] : IR_NONE;
+		massert(vec_push(in->ret_blocks, b->block), "OOM inline");
+		massert(vec_push(in->ret_vals, val), "OOM inline");
+		ir_emit_br(b, rest);
+		return;
+	}
+	if (inst->op == IrOp_ALLOCA) {
+		in->map.data[v] = ir_alloca(fn, inst->imm.mem.size,
+					    inst->imm.mem.align);
+		return;
+	}
+
+	IrValue copy = ir_emit(b, (IrOp)inst->op, (IrType)inst->ty,
+			       ir_args(callee, v), inst->nargs);
+	struct IrInst *out = ir_inst(fn, copy);
+	out->imm = inst->imm;
+	if (inst->op == IrOp_BR || inst->op == IrOp_CONDBR) {
+		out->imm.target[0] = in->blocks.data[inst->imm.target[0]];
+		out->imm.target[1] = in->blocks.data[inst->imm.target[1]];
+	}
+	if (inst->op == IrOp_CALL &&
+	    !in->m->funcs.data[inst->imm.index].is_extern)
+		in->calls->sites[inst->imm.index]++;
+	in->map.data[v] = copy;
+}
+
+/* Points the operands of copy `v` at the copies of theirs. */
+static void remap(struct Inliner *in, const struct IrFunc *callee, IrValue v)
+{
+	struct IrFunc *fn = in->fn;
+	IrValue *args = ir_args(fn, v);
+	u32 nargs = ir_inst(fn, v)->nargs;
+	if (ir_inst(fn, v)->op == IrOp_PHI)
+		for (u32 i = 0; i < nargs; i += 2)
+			args[i] = in->blocks.data[args[i]];
+	ir_foreach_operand(fn, v, i)
+		args[i] = value_of(in, callee, args[i]);
+}
+
+/* Copies every block of the callee. */
+static void copy_blocks(struct Inliner *in, const struct IrFunc *callee,
+			u32 rest)
+{
+	struct IrFunc *fn = in->fn;
+	u32 nblocks = (u32)vec_len(callee->blocks);
+	for (u32 bb = 1; bb < nblocks; ++bb)
+		in->blocks.data[bb] = ir_block_new(fn);
+
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		struct IrBuilder b = { .fn = fn, .block = in->blocks.data[bb] };
+		ir_foreach_inst(callee, bb, v)
+			copy_inst(in, callee, v, &b, rest);
+	}
+	/* Operands, now that every instruction has its copy. */
+	for (u32 bb = 1; bb < nblocks; ++bb)
+		ir_foreach_inst(fn, in->blocks.data[bb], v)
+			remap(in, callee, v);
+}
+
+/* What the call returned: a PHI in `rest` if it returns from several
+ * places. */
+static IrValue result_of(struct Inliner *in, const struct IrFunc *callee,
+			 u32 rest)
+{
+	u32 n = (u32)vec_len(in->ret_vals);
+	IrValue *vals = in->ret_vals.data;
+	if (callee->ret == IrType_VOID)
+		return IR_NONE;
+	/* It never returns; what would use the result is unreachable. */
+	if (!n)
+		return ir_const(in->fn, (struct IrConst){ .ty = callee->ret });
+	for (u32 i = 0; i < n; ++i)
+		vals[i] = value_of(in, callee, vals[i]);
+	if (n == 1)
+		return vals[0];
+	struct IrBuilder b = { .fn = in->fn, .block = rest };
+	return ir_emit_phi(&b, callee->ret, in->ret_blocks.data, vals, n);
+}
+
+static void inline_call(struct Inliner *in, IrValue call, u32 index)
+{
+	struct IrFunc *fn = in->fn;
+	const struct IrFunc *callee = &in->m->funcs.data[index];
+	u32 bb = ir_inst(fn, call)->block;
+	u32 rest = split_after(fn, call);
+
+	reset(&in->map, (u32)vec_len(callee->insts));
+	reset(&in->blocks, (u32)vec_len(callee->blocks));
+	in->ret_blocks.len = 0;
+	in->ret_vals.len = 0;
+	for (u32 i = 0; i < vec_len(callee->params); ++i)
+		in->map.data[callee->params.data[i]] = ir_args(fn, call)[i];
+	copy_blocks(in, callee, rest);
+
+	IrValue result = result_of(in, callee, rest);
+	ir_remove(fn, call);
+	struct IrBuilder b = { .fn = fn, .block = bb };
+	ir_emit_br(&b, in->blocks.data[1]);
+	in->calls->sites[index]--;
+	if (result) {
+		massert(vec_push(in->done, call), "OOM inline");
+		massert(vec_push(in->results, result), "OOM inline");
+	}
+}
+
+/*
+ * ==========================================================================
+ * 3. inline
+ * ==========================================================================
+ */
+
+/* Whether to inline `call`, which it reports either way. */
+static bool should_inline(struct Inliner *in, IrValue call, bool recursive)
+{
+	u32 index = ir_inst(in->fn, call)->imm.index;
+	const char *name = in->m->funcs.data[index].name;
+	const char *caller = in->fn->name;
+	u32 limit = in->opts->inline_limit;
+	u32 self = (u32)(in->fn - in->m->funcs.data);
+	if (in->calls->scc[index] == in->calls->scc[self]) {
+		remark(in, "not inlined '%s' into '%s': recursive", name,
+		       caller);
+		return false;
+	}
+
+	struct Cost c = cost_of(in, call, index);
+	if (c.cost > (i64)limit) {
+		remark(in, "not inlined '%s' into '%s': cost %lld over "
+			   "limit %u",
+		       name, caller, (long long)c.cost, limit);
+		return false;
+	}
+	if (in->size + c.size > IR_INLINE_CALLER_MAX) {
+		remark(in, "not inlined '%s' into '%s': '%s' would grow past "
+			   "%u instructions",
+		       name, caller, caller, IR_INLINE_CALLER_MAX);
+		return false;
+	}
+	if (recursive && c.frame) {
+		remark(in, "not inlined '%s' into '%s': its arrays would be "
+			   "in every frame of recursive '%s'",
+		       name, caller, caller);
+		return false;
+	}
+	remark(in, "inlined '%s' into '%s' (cost %lld, limit %u)", name,
+	       caller, (long long)c.cost, limit);
+	in->size += c.size;
+	return true;
+}
+
+IrAnalysisSet ir_inline(struct PassManager *pm)
+{
+	if (!pm->calls || !pm->opts->inline_limit)
+		return IR_PRESERVE_ALL;
+
+	struct IrFunc *fn = pm->fn;
+	struct Inliner in = {
+		.m = pm->m,
+		.fn = fn,
+		.calls = pm->calls,
+		.opts = pm->opts,
+		.size = size_of(fn),
+	};
+	allocer_t sys = allocer_system();
+	massert(vec_init(in.sites, sys, 16), "OOM inline");
+
+	u32 self = pm->calls->scc[fn - pm->m->funcs.data];
+	bool recursive = false;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			const struct IrInst *inst = ir_inst(fn, v);
+			if (inst->op != IrOp_CALL ||
+			    pm->m->funcs.data[inst->imm.index].is_extern)
+				continue;
+			recursive |= pm->calls->scc[inst->imm.index] == self;
+			massert(vec_push(in.sites, v), "OOM inline");
+		}
+	}
+	if (!vec_len(in.sites)) {
+		vec_deinit(in.sites);
+		return IR_PRESERVE_ALL;
+	}
+
+	massert(vec_init(in.map, sys, 64), "OOM inline");
+	massert(vec_init(in.blocks, sys, 16), "OOM inline");
+	massert(vec_init(in.ret_blocks, sys, 4), "OOM inline");
+	massert(vec_init(in.ret_vals, sys, 4), "OOM inline");
+	massert(vec_init(in.done, sys, 16), "OOM inline");
+	massert(vec_init(in.results, sys, 16), "OOM inline");
+	bool changed = false;
+	for (u32 i = 0; i < vec_len(in.sites); ++i) {
+		IrValue call = in.sites.data[i];
+		if (!should_inline(&in, call, recursive))
+			continue;
+		inline_call(&in, call, ir_inst(fn, call)->imm.index);
+		changed = true;
+	}
+
+	/* One pass for the uses of every inlined call. */
+	if (vec_len(in.done)) {
+		IrU32Vec repl;
+		massert(vec_init(repl, sys, vec_len(fn->insts)), "OOM inline");
+		reset(&repl, (u32)vec_len(fn->insts));
+		for (u32 i = 0; i < vec_len(in.done); ++i)
+			repl.data[in.done.data[i]] = in.results.data[i];
+		ir_replace_uses(fn, repl.data);
+		vec_deinit(repl);
+	}
+
+	vec_deinit(in.sites);
+	vec_deinit(in.map);
+	vec_deinit(in.blocks);
+	vec_deinit(in.ret_blocks);
+	vec_deinit(in.ret_vals);
+	vec_deinit(in.done);
+	vec_deinit(in.results);
+	return changed ? IR_PRESERVE_NONE : IR_PRESERVE_ALL;
+}
+
+/*
+ * ==========================================================================
+ * 4. Pruning
+ * ==========================================================================
+ */
+
+void ir_prune_funcs(struct IrModule *m, FILE *remarks)
+{
+	u32 n = (u32)vec_len(m->funcs);
+	u32 entry = n;
+	for (u32 f = 0; f < n && entry == n; ++f)
+		if (!m->funcs.data[f].is_extern &&
+		    strcmp(m->funcs.data[f].name, "main") == 0)
+			entry = f;
+	if (entry == n)
+		return;
+
+	/* renumber[f]: f's new index plus one once a call reaches it. */
+	allocer_t sys = allocer_system();
+	IrU32Vec renumber, stack;
+	massert(vec_init(renumber, sys, n), "OOM inline");
+	massert(vec_init(stack, sys, 16), "OOM inline");
+	reset(&renumber, n);
+	renumber.data[entry] = 1;
+	massert(vec_push(stack, entry), "OOM inline");
+	while (vec_len(stack)) {
+		u32 f = stack.data[--stack.len];
+		const struct IrFunc *fn = &m->funcs.data[f];
+		for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+			ir_foreach_inst(fn, bb, v)
+			{
+				const struct IrInst *inst = ir_inst(fn, v);
+				if (inst->op != IrOp_CALL ||
+				    renumber.data[inst->imm.index])
+					continue;
+				renumber.data[inst->imm.index] = 1;
+				massert(vec_push(stack, inst->imm.index),
+					"OOM inline");
+			}
+		}
+	}
+
+	u32 kept = 0;
+	for (u32 f = 0; f < n; ++f) {
+		struct IrFunc *fn = &m->funcs.data[f];
+		if (fn->is_extern || renumber.data[f]) {
+			renumber.data[f] = ++kept;
+			m->funcs.data[kept - 1] = *fn;
+			continue;
+		}
+		if (remarks)
+			fprintf(remarks, "remark: removed '%s': nothing calls "
+					 "it\n",
+				fn->name);
+		vec_deinit(fn->params);
+		vec_deinit(fn->insts);
+		vec_deinit(fn->args);
+		vec_deinit(fn->blocks);
+		vec_deinit(fn->locals);
+	}
+	m->funcs.len = kept;
+	u32 *to = renumber.data;
+	for (u32 f = 0; f < n; ++f)
+		to[f]--;
+
+	for (u32 f = 0; f < kept && kept < n; ++f) {
+		struct IrFunc *fn = &m->funcs.data[f];
+		for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+			ir_foreach_inst(fn, bb, v)
+			{
+				struct IrInst *inst = ir_inst(fn, v);
+				if (inst->op == IrOp_CALL)
+					inst->imm.index = to[inst->imm.index];
+			}
+		}
+	}
+	vec_deinit(renumber);
+	vec_deinit(stack);
+}
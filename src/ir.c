@@ -0,0 +1,815 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <ir.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <string.h>
+
+#define IR_CHUNK_SIZE (256 * 1024)
+
+/*
+ * ==========================================================================
+ * 1. Module, Globals & Functions
+ * ==========================================================================
+ */
+
+void ir_module_init(struct IrModule *m)
+{
+	arena_init(&m->arena, allocer_system(), IR_CHUNK_SIZE);
+	allocer_t alc = arena_allocer(&m->arena);
+	massert(vec_init(m->globals, alc, 16), "OOM ir");
+	massert(vec_init(m->funcs, alc, 16), "OOM ir");
+	massert(vec_init(m->names, alc, 16), "OOM ir");
+}
+
+void ir_module_deinit(struct IrModule *m)
+{
+	vec_foreach(fn, m->funcs)
+	{
+		vec_deinit(fn->params);
+		vec_deinit(fn->insts);
+		vec_deinit(fn->args);
+		vec_deinit(fn->blocks);
+		vec_deinit(fn->locals);
+	}
+	arena_deinit(&m->arena);
+}
+
+const char *ir_strdup(struct IrModule *m, const char *name)
+{
+	usize len = strlen(name);
+	char *copy = arena_alloc(&m->arena, layout(len + 1, 1));
+	massert(copy, "OOM ir");
+	memcpy(copy, name, len + 1);
+	return copy;
+}
+
+u32 ir_global_new(struct IrModule *m, const char *name, IrType elem,
+		  u32 count, bool is_const)
+{
+	struct IrGlobal g = {
+		.name = ir_strdup(m, name),
+		.elem = elem,
+		.count = count,
+		.is_const = is_const,
+		.init = NULL,
+	};
+	massert(vec_push(m->globals, g), "OOM ir");
+	return (u32)vec_len(m->globals) - 1;
+}
+
+u32 ir_func_new(struct IrModule *m, const char *name, IrType ret,
+		bool is_extern)
+{
+	allocer_t alc = allocer_system();
+	struct IrFunc fn = {
+		.name = ir_strdup(m, name),
+		.id = (u32)vec_len(m->names),
+		.ret = ret,
+		.is_extern = is_extern,
+		.last_alloca = IR_NONE,
+	};
+	usize cap = is_extern ? 1 : 16;
+	massert(vec_init(fn.params, alc, 4), "OOM ir");
+	massert(vec_init(fn.insts, alc, cap), "OOM ir");
+	massert(vec_init(fn.args, alc, cap), "OOM ir");
+	massert(vec_init(fn.blocks, alc, cap / 4 + 1), "OOM ir");
+	massert(vec_init(fn.locals, alc, cap / 4 + 1), "OOM ir");
+
+	/* Id 0 is IR_NONE for both values and blocks. */
+	massert(vec_push(fn.insts, (struct IrInst){ .op = IrOp_NOP }), "OOM ir");
+	massert(vec_push(fn.blocks, (struct IrBlock){ 0 }), "OOM ir");
+
+	massert(vec_push(m->names, fn.name), "OOM ir");
+	massert(vec_push(m->funcs, fn), "OOM ir");
+	return (u32)vec_len(m->funcs) - 1;
+}
+
+/*
+ * ==========================================================================
+ * 2. Values & Blocks
+ * ==========================================================================
+ */
+
+static IrValue new_value(struct IrFunc *fn, IrOp op, IrType ty)
+{
+	struct IrInst inst = { .op = (u8)op, .ty = (u8)ty };
+	massert(vec_push(fn->insts, inst), "OOM ir");
+	return (IrValue)vec_len(fn->insts) - 1;
+}
+
+static void set_args(struct IrFunc *fn, IrValue v, const IrValue *args,
+		     u32 nargs)
+{
+	struct IrInst *inst = ir_inst(fn, v);
+	inst->first_arg = (u32)vec_len(fn->args);
+	inst->nargs = nargs;
+	for (u32 i = 0; i < nargs; ++i)
+		massert(vec_push(fn->args, args[i]), "OOM ir");
+}
+
+IrValue ir_param_new(struct IrFunc *fn, IrType ty)
+{
+	IrValue v = new_value(fn, IrOp_PARAM, ty);
+	ir_inst(fn, v)->imm.index = (u32)vec_len(fn->params);
+	massert(vec_push(fn->params, v), "OOM ir");
+	return v;
+}
+
+u32 ir_block_new(struct IrFunc *fn)
+{
+	massert(vec_push(fn->blocks, (struct IrBlock){ 0 }), "OOM ir");
+	return (u32)vec_len(fn->blocks) - 1;
+}
+
+IrValue ir_const(struct IrFunc *fn, struct IrConst k)
+{
+	IrValue v = new_value(fn, IrOp_CONST, k.ty);
+	ir_inst(fn, v)->imm.k.d = k.d;
+	return v;
+}
+
+IrValue ir_const_i32(struct IrFunc *fn, i32 v)
+{
+	return ir_const(fn, (struct IrConst){ .ty = IrType_I32, .i = v });
+}
+
+IrValue ir_const_bool(struct IrFunc *fn, bool v)
+{
+	return ir_const(fn, (struct IrConst){ .ty = IrType_I1, .b = v });
+}
+
+IrValue ir_global_addr(struct IrFunc *fn, u32 global)
+{
+	IrValue v = new_value(fn, IrOp_GLOBAL, IrType_PTR);
+	ir_inst(fn, v)->imm.index = global;
+	return v;
+}
+
+/* Links `v` into `bb` after `after`, or first if `after` is IR_NONE. */
+static void link_after(struct IrFunc *fn, u32 bb, IrValue after, IrValue v)
+{
+	struct IrBlock *blk = &fn->blocks.data[bb];
+	struct IrInst *inst = ir_inst(fn, v);
+	IrValue next = after ? ir_inst(fn, after)->next : blk->first;
+
+	inst->block = bb;
+	inst->prev = after;
+	inst->next = next;
+	if (after)
+		ir_inst(fn, after)->next = v;
+	else
+		blk->first = v;
+	if (next)
+		ir_inst(fn, next)->prev = v;
+	else
+		blk->last = v;
+}
+
+/* Takes `v` out of its block's list, leaving it otherwise as it was. */
+static void unlink_inst(struct IrFunc *fn, IrValue v)
+{
+	struct IrInst *inst = ir_inst(fn, v);
+	struct IrBlock *blk = &fn->blocks.data[inst->block];
+	if (inst->prev)
+		ir_inst(fn, inst->prev)->next = inst->next;
+	else
+		blk->first = inst->next;
+	if (inst->next)
+		ir_inst(fn, inst->next)->prev = inst->prev;
+	else
+		blk->last = inst->prev;
+}
+
+void ir_remove(struct IrFunc *fn, IrValue v)
+{
+	struct IrInst *inst = ir_inst(fn, v);
+	if (inst->block)
+		unlink_inst(fn, v);
+	if (fn->last_alloca == v) {
+		IrValue prev = inst->prev;
+		fn->last_alloca = prev && ir_inst(fn, prev)->op == IrOp_ALLOCA
+					  ? prev
+					  : IR_NONE;
+	}
+	*inst = (struct IrInst){ .op = IrOp_NOP };
+}
+
+void ir_move_after(struct IrFunc *fn, IrValue v, u32 bb, IrValue after)
+{
+	unlink_inst(fn, v);
+	link_after(fn, bb, after, v);
+}
+
+void ir_move_before(struct IrFunc *fn, IrValue v, IrValue term)
+{
+	const struct IrInst *t = ir_inst(fn, term);
+	if (t->prev != v)
+		ir_move_after(fn, v, t->block, t->prev);
+}
+
+void ir_replace_uses(struct IrFunc *fn, IrValue *repl)
+{
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			IrValue *args = ir_args(fn, v);
+			ir_foreach_operand(fn, v, i)
+			{
+				IrValue u = args[i];
+				while (repl[u])
+					u = repl[u];
+				/* Shorten the chain for the next use. */
+				if (repl[args[i]])
+					repl[args[i]] = u;
+				args[i] = u;
+			}
+		}
+	}
+}
+
+IrValue ir_alloca(struct IrFunc *fn, u32 size, u32 align)
+{
+	IrValue v = new_value(fn, IrOp_ALLOCA, IrType_PTR);
+	ir_inst(fn, v)->imm.mem.size = size;
+	ir_inst(fn, v)->imm.mem.align = align;
+	link_after(fn, 1, fn->last_alloca, v);
+	fn->last_alloca = v;
+	return v;
+}
+
+/*
+ * ==========================================================================
+ * 3. Builder
+ * ==========================================================================
+ */
+
+IrValue ir_emit(struct IrBuilder *b, IrOp op, IrType ty, const IrValue *args,
+		u32 nargs)
+{
+	IrValue v = new_value(b->fn, op, ty);
+	set_args(b->fn, v, args, nargs);
+	link_after(b->fn, b->block, b->fn->blocks.data[b->block].last, v);
+	if ((op == IrOp_DIV || op == IrOp_MOD) && ty == IrType_I32)
+		ir_inst(b->fn, v)->imm.index = b->fn->id;
+	return v;
+}
+
+IrValue ir_emit_binary(struct IrBuilder *b, IrOp op, IrType ty, IrValue lhs,
+		       IrValue rhs)
+{
+	IrValue args[2] = { lhs, rhs };
+	return ir_emit(b, op, ty, args, 2);
+}
+
+IrValue ir_emit_load(struct IrBuilder *b, IrType ty, IrValue ptr)
+{
+	return ir_emit(b, IrOp_LOAD, ty, &ptr, 1);
+}
+
+void ir_emit_store(struct IrBuilder *b, IrValue ptr, IrValue val)
+{
+	IrValue args[2] = { ptr, val };
+	ir_emit(b, IrOp_STORE, IrType_VOID, args, 2);
+}
+
+IrValue ir_emit_index(struct IrBuilder *b, IrValue ptr, IrValue index,
+		      u32 stride)
+{
+	IrValue args[2] = { ptr, index };
+	IrValue v = ir_emit(b, IrOp_INDEX, IrType_PTR, args, 2);
+	ir_inst(b->fn, v)->imm.mem.size = stride;
+	return v;
+}
+
+void ir_emit_br(struct IrBuilder *b, u32 target)
+{
+	IrValue v = ir_emit(b, IrOp_BR, IrType_VOID, NULL, 0);
+	ir_inst(b->fn, v)->imm.target[0] = target;
+}
+
+void ir_emit_condbr(struct IrBuilder *b, IrValue cond, u32 then_bb,
+		    u32 else_bb)
+{
+	IrValue v = ir_emit(b, IrOp_CONDBR, IrType_VOID, &cond, 1);
+	ir_inst(b->fn, v)->imm.target[0] = then_bb;
+	ir_inst(b->fn, v)->imm.target[1] = else_bb;
+}
+
+void ir_emit_ret(struct IrBuilder *b, IrValue val)
+{
+	ir_emit(b, IrOp_RET, IrType_VOID, &val, val ? 1 : 0);
+}
+
+IrValue ir_emit_phi(struct IrBuilder *b, IrType ty, const u32 *blocks,
+		    const IrValue *vals, u32 n)
+{
+	struct IrFunc *fn = b->fn;
+	IrValue v = new_value(fn, IrOp_PHI, ty);
+	struct IrInst *inst = ir_inst(fn, v);
+	inst->first_arg = (u32)vec_len(fn->args);
+	inst->nargs = 2 * n;
+	for (u32 i = 0; i < n; ++i) {
+		massert(vec_push(fn->args, blocks[i]), "OOM ir");
+		massert(vec_push(fn->args, vals[i]), "OOM ir");
+	}
+
+	/* PHIs lead their block. */
+	IrValue after = IR_NONE;
+	ir_foreach_inst(fn, b->block, it)
+	{
+		if (ir_inst(fn, it)->op != IrOp_PHI)
+			break;
+		after = it;
+	}
+	link_after(fn, b->block, after, v);
+	return v;
+}
+
+/*
+ * ==========================================================================
+ * 4. Queries
+ * ==========================================================================
+ */
+
+bool ir_is_terminator(IrOp op)
+{
+	return op == IrOp_BR || op == IrOp_CONDBR || op == IrOp_RET;
+}
+
+bool ir_has_effect(const struct IrFunc *fn, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(fn, v);
+	switch (inst->op) {
+	case IrOp_STORE:
+	case IrOp_ZERO:
+	case IrOp_CALL:
+	case IrOp_BR:
+	case IrOp_CONDBR:
+	case IrOp_RET:
+		return true;
+	case IrOp_DIV:
+	case IrOp_MOD: {
+		if (inst->ty != IrType_I32)
+			return false;
+		/* Traps on zero. */
+		const struct IrInst *rhs = ir_inst(fn, ir_args(fn, v)[1]);
+		return rhs->op != IrOp_CONST || rhs->imm.k.i == 0;
+	}
+	default:
+		return false;
+	}
+}
+
+IrValue ir_terminator(const struct IrFunc *fn, u32 bb)
+{
+	IrValue last = fn->blocks.data[bb].last;
+	if (last && ir_is_terminator(ir_inst(fn, last)->op))
+		return last;
+	return IR_NONE;
+}
+
+u32 ir_succs(const struct IrFunc *fn, u32 bb, u32 out[2])
+{
+	IrValue term = ir_terminator(fn, bb);
+	if (!term)
+		return 0;
+
+	const struct IrInst *inst = ir_inst(fn, term);
+	switch (inst->op) {
+	case IrOp_BR:
+		out[0] = inst->imm.target[0];
+		return 1;
+	case IrOp_CONDBR:
+		out[0] = inst->imm.target[0];
+		out[1] = inst->imm.target[1];
+		return out[0] == out[1] ? 1 : 2;
+	default:
+		return 0;
+	}
+}
+
+u32 ir_frame_layout(const struct IrFunc *fn, u32 *offsets)
+{
+	u32 frame = 0;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			const struct IrInst *inst = ir_inst(fn, v);
+			if (inst->op != IrOp_ALLOCA)
+				continue;
+			u32 align = inst->imm.mem.align ? inst->imm.mem.align : 1;
+			frame = (frame + align - 1) / align * align;
+			offsets[v] = frame;
+			frame += inst->imm.mem.size;
+		}
+	}
+	return (frame + 15) & ~15u;
+}
+
+u32 ir_type_size(IrType ty)
+{
+	switch (ty) {
+	case IrType_I1:
+		return 1;
+	case IrType_I32:
+	case IrType_F32:
+		return 4;
+	case IrType_F64:
+	case IrType_PTR:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+const char *ir_type_name(IrType ty)
+{
+	static const char *const names[IrType_COUNT] = {
+		"void", "i1", "i32", "f32", "f64", "ptr",
+	};
+	return ty < IrType_COUNT ? names[ty] : "?";
+}
+
+const char *ir_op_name(IrOp op)
+{
+	static const char *const names[IrOp_COUNT] = {
+#define X(ID, NAME) NAME,
+		IR_OPS(X)
+#undef X
+	};
+	return op < IrOp_COUNT ? names[op] : "?";
+}
+
+/*
+ * ==========================================================================
+ * 5. CFG Cleanup
+ * ==========================================================================
+ */
+
+void ir_drop_incoming(struct IrFunc *fn, u32 bb, u32 from)
+{
+	ir_foreach_inst(fn, bb, v)
+	{
+		struct IrInst *inst = ir_inst(fn, v);
+		if (inst->op != IrOp_PHI)
+			break;
+		IrValue *args = ir_args(fn, v);
+		u32 kept = 0;
+		for (u32 i = 0; i < inst->nargs; i += 2) {
+			if (args[i] == from)
+				continue;
+			args[kept++] = args[i];
+			args[kept++] = args[i + 1];
+		}
+		inst->nargs = kept;
+	}
+}
+
+void ir_remove_unreachable(struct IrFunc *fn)
+{
+	u32 nblocks = (u32)vec_len(fn->blocks);
+	allocer_t sys = allocer_system();
+	layout_t lay = layout(2 * (usize)nblocks * sizeof(u32), 4);
+
+	/* remap[bb]: new id of a reachable block, IR_NONE otherwise. */
+	u32 *remap = allocer_alloc(sys, lay);
+	massert(remap, "OOM ir");
+	memset(remap, 0, nblocks * sizeof(u32));
+	u32 *stack = remap + nblocks;
+
+	u32 top = 0;
+	stack[top++] = 1;
+	remap[1] = 1;
+	while (top) {
+		u32 succ[2];
+		u32 n = ir_succs(fn, stack[--top], succ);
+		for (u32 i = 0; i < n; ++i) {
+			if (!remap[succ[i]]) {
+				remap[succ[i]] = 1;
+				stack[top++] = succ[i];
+			}
+		}
+	}
+
+	u32 next_id = 1;
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		if (remap[bb]) {
+			remap[bb] = next_id++;
+			continue;
+		}
+		/* Dead code: drop the instructions, keep the ids. */
+		IrValue v = fn->blocks.data[bb].first;
+		while (v) {
+			IrValue next = ir_inst(fn, v)->next;
+			*ir_inst(fn, v) = (struct IrInst){ .op = IrOp_NOP };
+			v = next;
+		}
+	}
+
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		if (!remap[bb])
+			continue;
+		struct IrBlock blk = fn->blocks.data[bb];
+		fn->blocks.data[remap[bb]] = blk;
+
+		for (IrValue v = blk.first; v; v = ir_inst(fn, v)->next) {
+			struct IrInst *inst = ir_inst(fn, v);
+			inst->block = remap[bb];
+
+			if (inst->op == IrOp_BR || inst->op == IrOp_CONDBR) {
+				inst->imm.target[0] = remap[inst->imm.target[0]];
+				inst->imm.target[1] = remap[inst->imm.target[1]];
+			} else if (inst->op == IrOp_PHI) {
+				IrValue *args = ir_args(fn, v);
+				u32 kept = 0;
+				for (u32 i = 0; i < inst->nargs; i += 2) {
+					if (!remap[args[i]])
+						continue;
+					args[kept++] = remap[args[i]];
+					args[kept++] = args[i + 1];
+				}
+				inst->nargs = kept;
+			}
+		}
+	}
+	fn->blocks.len = next_id;
+
+	allocer_free(sys, remap, lay);
+}
+
+/*
+ * ==========================================================================
+ * 6. Printing
+ * ==========================================================================
+ */
+
+/* Round-trips, and always reads as floating point: `2.0`, not `2`. */
+static void print_float(FILE *out, double v, const char *fmt)
+{
+	char buf[40];
+	snprintf(buf, sizeof(buf), fmt, v);
+	fputs(buf, out);
+	if (!strpbrk(buf, ".einf"))
+		fputs(".0", out);
+}
+
+static void print_const(FILE *out, struct IrConst k)
+{
+	switch (k.ty) {
+	case IrType_I1:
+		fputs(k.b ? "true" : "false", out);
+		break;
+	case IrType_I32:
+		fprintf(out, "%d", k.i);
+		break;
+	case IrType_F32:
+		print_float(out, (double)k.f, "%.9g");
+		fputc('f', out);
+		break;
+	case IrType_F64:
+		print_float(out, k.d, "%.17g");
+		break;
+	default:
+		fputs("?", out);
+	}
+}
+
+static void print_value(FILE *out, const struct IrModule *m,
+			const struct IrFunc *fn, IrValue v)
+{
+	if (v == IR_NONE || v >= vec_len(fn->insts)) {
+		fprintf(out, "<bad %u>", v);
+		return;
+	}
+	const struct IrInst *inst = ir_inst(fn, v);
+	if (inst->op == IrOp_CONST) {
+		print_const(out, ir_const_value(fn, v));
+	} else if (inst->op == IrOp_GLOBAL &&
+		   inst->imm.index < vec_len(m->globals)) {
+		fprintf(out, "@%s", vec_at(m->globals, inst->imm.index).name);
+	} else {
+		fprintf(out, "%%%u", v);
+	}
+}
+
+static void print_inst(FILE *out, const struct IrModule *m,
+		       const struct IrFunc *fn, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(fn, v);
+	const IrValue *args = ir_args(fn, v);
+
+	fputs("    ", out);
+	if (inst->ty != IrType_VOID)
+		fprintf(out, "%%%u = ", v);
+	fputs(ir_op_name(inst->op), out);
+
+	switch (inst->op) {
+	case IrOp_ALLOCA:
+		fprintf(out, " %u, align %u", inst->imm.mem.size,
+			inst->imm.mem.align);
+		break;
+	case IrOp_BR:
+		fprintf(out, " bb%u", inst->imm.target[0]);
+		break;
+	case IrOp_CONDBR:
+		fputc(' ', out);
+		print_value(out, m, fn, args[0]);
+		fprintf(out, ", bb%u, bb%u", inst->imm.target[0],
+			inst->imm.target[1]);
+		break;
+	case IrOp_PHI:
+		fprintf(out, " %s", ir_type_name(inst->ty));
+		for (u32 i = 0; i < inst->nargs; i += 2) {
+			fprintf(out, "%s[bb%u: ", i ? ", " : " ", args[i]);
+			print_value(out, m, fn, args[i + 1]);
+			fputc(']', out);
+		}
+		break;
+	case IrOp_CALL:
+		fprintf(out, " %s @%s(", ir_type_name(inst->ty),
+			inst->imm.index < vec_len(m->funcs)
+				? vec_at(m->funcs, inst->imm.index).name
+				: "?");
+		for (u32 i = 0; i < inst->nargs; ++i) {
+			if (i)
+				fputs(", ", out);
+			print_value(out, m, fn, args[i]);
+		}
+		fputc(')', out);
+		break;
+	default:
+		/* Compares show what they compare; the result is always i1. */
+		if (inst->op >= IrOp_EQ && inst->op <= IrOp_GE && inst->nargs)
+			fprintf(out, " %s",
+				ir_type_name(ir_inst(fn, args[0])->ty));
+		else if (inst->ty != IrType_VOID && inst->ty != IrType_PTR)
+			fprintf(out, " %s", ir_type_name(inst->ty));
+		for (u32 i = 0; i < inst->nargs; ++i) {
+			fputs(i ? ", " : " ", out);
+			print_value(out, m, fn, args[i]);
+		}
+		if (inst->op == IrOp_INDEX || inst->op == IrOp_ZERO)
+			fprintf(out, ", %u", inst->imm.mem.size);
+	}
+	fputc('\n', out);
+}
+
+static void print_signature(FILE *out, const struct IrFunc *fn)
+{
+	fprintf(out, "%s %s @%s(", fn->is_extern ? "declare" : "define",
+		ir_type_name(fn->ret), fn->name);
+	for (u32 i = 0; i < vec_len(fn->params); ++i) {
+		IrValue p = vec_at(fn->params, i);
+		fprintf(out, "%s%s", i ? ", " : "",
+			ir_type_name(ir_inst(fn, p)->ty));
+		if (!fn->is_extern)
+			fprintf(out, " %%%u", p);
+	}
+	fputc(')', out);
+}
+
+void ir_print_func(FILE *out, const struct IrModule *m,
+		   const struct IrFunc *fn)
+{
+	print_signature(out, fn);
+	if (fn->is_extern) {
+		fputc('\n', out);
+		return;
+	}
+	fputs(" {\n", out);
+
+	/* Predecessor lists for the block headers: start[bb] .. start[bb+1]. */
+	u32 nblocks = (u32)vec_len(fn->blocks);
+	allocer_t sys = allocer_system();
+	layout_t lay = layout((2 * (usize)nblocks + 1) * sizeof(u32), 4);
+	u32 *start = allocer_alloc(sys, lay);
+	massert(start, "OOM ir");
+	memset(start, 0, (2 * (usize)nblocks + 1) * sizeof(u32));
+	u32 *fill = start + nblocks + 1;
+
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		u32 succ[2];
+		u32 n = ir_succs(fn, bb, succ);
+		for (u32 i = 0; i < n; ++i)
+			if (succ[i] < nblocks)
+				start[succ[i] + 1]++;
+	}
+	for (u32 bb = 1; bb <= nblocks; ++bb)
+		start[bb] += start[bb - 1];
+	layout_t preds_lay = layout(((usize)start[nblocks] + 1) * sizeof(u32), 4);
+	u32 *preds = allocer_alloc(sys, preds_lay);
+	massert(preds, "OOM ir");
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		u32 succ[2];
+		u32 n = ir_succs(fn, bb, succ);
+		for (u32 i = 0; i < n; ++i)
+			if (succ[i] < nblocks)
+				preds[start[succ[i]] + fill[succ[i]]++] = bb;
+	}
+
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		fprintf(out, "bb%u:", bb);
+		const char *sep = "\t\t; preds = ";
+		for (u32 i = start[bb]; i < start[bb + 1]; ++i) {
+			fprintf(out, "%sbb%u", sep, preds[i]);
+			sep = ", ";
+		}
+		fputc('\n', out);
+		ir_foreach_inst(fn, bb, v)
+		{
+			print_inst(out, m, fn, v);
+		}
+	}
+	fputs("}\n", out);
+	allocer_free(sys, preds, preds_lay);
+	allocer_free(sys, start, lay);
+}
+
+static void print_global(FILE *out, const struct IrGlobal *g)
+{
+	fprintf(out, "%s @%s : ", g->is_const ? "const" : "global", g->name);
+	if (g->count == 1)
+		fputs(ir_type_name(g->elem), out);
+	else
+		fprintf(out, "[%u x %s]", g->count, ir_type_name(g->elem));
+
+	if (!g->init) {
+		fputs(" = zero\n", out);
+		return;
+	}
+
+	u32 size = ir_type_size(g->elem);
+	const u8 *bytes = g->init;
+	struct IrConst k = { .ty = g->elem };
+
+	/* Trailing zero elements are summarised. */
+	u32 used = g->count;
+	while (used > 0) {
+		u32 i;
+		for (i = 0; i < size && !bytes[(used - 1) * size + i]; ++i)
+			;
+		if (i < size)
+			break;
+		used--;
+	}
+
+	fputs(g->count == 1 ? " = " : " = [", out);
+	for (u32 i = 0; i < used; ++i) {
+		memcpy(&k.i, bytes + i * size, size);
+		if (i)
+			fputs(", ", out);
+		print_const(out, k);
+	}
+	if (used < g->count)
+		fprintf(out, "%s0 x %u", used ? ", " : "", g->count - used);
+	fputs(g->count == 1 ? "\n" : "]\n", out);
+}
+
+void ir_print_module(FILE *out, const struct IrModule *m)
+{
+	for (usize i = 0; i < vec_len(m->globals); ++i)
+		print_global(out, &m->globals.data[i]);
+	for (usize i = 0; i < vec_len(m->funcs); ++i) {
+		const struct IrFunc *fn = &m->funcs.data[i];
+		/* Declarations are listed as one group. */
+		if (!fn->is_extern || i == 0 || !fn[-1].is_extern)
+			fputc('\n', out);
+		ir_print_func(out, m, fn);
+	}
+}
+
+/*
+ * ==========================================================================
+ * 7. Scratch Memory
+ * ==========================================================================
+ */
+
+void *ir_grab(usize n)
+{
+	void *p = allocer_alloc(allocer_system(), layout(n ? n : 8, 8));
+	massert(p, "OOM scratch");
+	memset(p, 0, n);
+	return p;
+}
+
+void ir_drop(void *p, usize n)
+{
+	if (p)
+		allocer_free(allocer_system(), p, layout(n ? n : 8, 8));
+}
@@ -0,0 +1,565 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <ir.h>
+#include <cfg.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Verifier State
+ * ==========================================================================
+ */
+
+typedef struct Verifier {
+	const struct IrModule *m;
+	const struct IrFunc *fn;
+	FILE *err;
+	u32 errors;
+
+	u32 nblocks; /* including the unused slot 0 */
+	u32 ninsts;
+
+	/* Edges and reverse postorder, built once the targets are valid. */
+	struct IrCfg cfg;
+
+	/* Dominator tree; idom[bb] is IR_NONE for unreachable blocks. */
+	u32 *idom;
+	u32 *pre; /* dominator-tree preorder interval [pre, post] */
+	u32 *post;
+
+	/* Position of each instruction within its block. */
+	u32 *pos;
+	/* Per-block stamp for PHI incoming checks. */
+	u32 *seen;
+
+	/* Every array above is carved from this one zeroed block. */
+	u32 *buf;
+	usize used;
+	usize cap;
+} Verifier;
+
+static void fail(Verifier *vf, u32 bb, IrValue v, const char *fmt, ...)
+{
+	vf->errors++;
+	fprintf(vf->err, "ir verify: @%s", vf->fn->name);
+	if (bb)
+		fprintf(vf->err, " bb%u", bb);
+	if (v)
+		fprintf(vf->err, " %%%u (%s)", v,
+			ir_op_name(ir_inst(vf->fn, v)->op));
+	fputs(": ", vf->err);
+
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(vf->err, fmt, ap);
+	va_end(ap);
+	fputc('\n', vf->err);
+}
+
+static u32 *scratch(Verifier *vf, usize n)
+{
+	massert(vf->used + n <= vf->cap, "ir verify: scratch overflow");
+	u32 *p = vf->buf + vf->used;
+	vf->used += n;
+	return p;
+}
+
+/*
+ * ==========================================================================
+ * 2. CFG & Dominators
+ * ==========================================================================
+ * Dominators use the iterative algorithm of Cooper, Harvey and Kennedy
+ * over reverse postorder. Dominance queries are answered in O(1) from a
+ * preorder numbering of the resulting tree.
+ */
+
+static u32 intersect(const Verifier *vf, u32 a, u32 b)
+{
+	while (a != b) {
+		while (vf->cfg.rpo_index[a] > vf->cfg.rpo_index[b])
+			a = vf->idom[a];
+		while (vf->cfg.rpo_index[b] > vf->cfg.rpo_index[a])
+			b = vf->idom[b];
+	}
+	return a;
+}
+
+static void build_domtree(Verifier *vf)
+{
+	const struct IrCfg *cfg = &vf->cfg;
+	u32 n = vf->nblocks;
+	vf->idom = scratch(vf, n);
+	vf->idom[1] = 1;
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (u32 i = 1; i < cfg->nrpo; ++i) {
+			u32 bb = cfg->rpo[i];
+			u32 new_idom = IR_NONE;
+			for (u32 p = cfg->pred_start[bb];
+			     p < cfg->pred_start[bb + 1]; ++p) {
+				u32 pred = cfg->preds[p];
+				if (!vf->idom[pred])
+					continue;
+				new_idom = new_idom ? intersect(vf, pred, new_idom)
+						    : pred;
+			}
+			if (vf->idom[bb] != new_idom) {
+				vf->idom[bb] = new_idom;
+				changed = true;
+			}
+		}
+	}
+
+	/* Number the tree: children are the blocks whose idom is bb. */
+	u32 *child_start = scratch(vf, n + 1);
+	for (u32 i = 1; i < cfg->nrpo; ++i)
+		child_start[vf->idom[cfg->rpo[i]] + 1]++;
+	for (u32 bb = 1; bb <= n; ++bb)
+		child_start[bb] += child_start[bb - 1];
+	u32 *children = scratch(vf, n);
+	u32 *fill = scratch(vf, n);
+	for (u32 i = 1; i < cfg->nrpo; ++i) {
+		u32 bb = cfg->rpo[i], d = vf->idom[bb];
+		children[child_start[d] + fill[d]++] = bb;
+	}
+
+	vf->pre = scratch(vf, n);
+	vf->post = scratch(vf, n);
+	u32 *stack = scratch(vf, n);
+	u32 top = 0, clock = 0;
+	memset(fill, 0, n * sizeof(u32));
+
+	stack[top++] = 1;
+	vf->pre[1] = ++clock;
+	while (top) {
+		u32 bb = stack[top - 1];
+		u32 c = child_start[bb] + fill[bb];
+		if (c < child_start[bb + 1]) {
+			fill[bb]++;
+			stack[top++] = children[c];
+			vf->pre[children[c]] = ++clock;
+			continue;
+		}
+		vf->post[bb] = clock;
+		top--;
+	}
+}
+
+static bool reachable(const Verifier *vf, u32 bb)
+{
+	return vf->pre[bb] != 0;
+}
+
+static bool dominates(const Verifier *vf, u32 a, u32 b)
+{
+	return vf->pre[a] <= vf->pre[b] && vf->post[b] <= vf->post[a];
+}
+
+/*
+ * ==========================================================================
+ * 3. Instruction Checks
+ * ==========================================================================
+ */
+
+static bool is_numeric(IrType ty)
+{
+	return ty == IrType_I32 || ty == IrType_F32 || ty == IrType_F64;
+}
+
+/* The type of operand `i` of `v`, or VOID after reporting a bad id. */
+static IrType operand_type(Verifier *vf, IrValue v, u32 i)
+{
+	const struct IrFunc *fn = vf->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	IrValue a = ir_args(fn, v)[i];
+
+	if (a == IR_NONE || a >= vf->ninsts) {
+		fail(vf, inst->block, v, "operand %u is not a value", i);
+		return IrType_VOID;
+	}
+	const struct IrInst *def = ir_inst(fn, a);
+	if (def->op == IrOp_NOP || def->ty == IrType_VOID) {
+		fail(vf, inst->block, v, "operand %u (%%%u) has no value", i,
+		     a);
+		return IrType_VOID;
+	}
+	return (IrType)def->ty;
+}
+
+static void expect_args(Verifier *vf, IrValue v, u32 n)
+{
+	const struct IrInst *inst = ir_inst(vf->fn, v);
+	if (inst->nargs != n)
+		fail(vf, inst->block, v, "expected %u operands, got %u", n,
+		     inst->nargs);
+}
+
+static void expect_type(Verifier *vf, IrValue v, IrType got, IrType want,
+			const char *what)
+{
+	if (got != want)
+		fail(vf, ir_inst(vf->fn, v)->block, v, "%s is %s, expected %s",
+		     what, ir_type_name(got), ir_type_name(want));
+}
+
+static void check_target(Verifier *vf, IrValue v, u32 target)
+{
+	if (target == IR_NONE || target >= vf->nblocks)
+		fail(vf, ir_inst(vf->fn, v)->block, v,
+		     "branch to missing block %u", target);
+}
+
+static void check_call(Verifier *vf, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(vf->fn, v);
+	if (inst->imm.index >= vec_len(vf->m->funcs)) {
+		fail(vf, inst->block, v, "call of missing function %u",
+		     inst->imm.index);
+		return;
+	}
+
+	const struct IrFunc *callee = &vf->m->funcs.data[inst->imm.index];
+	expect_type(vf, v, inst->ty, callee->ret, "call result");
+	if (inst->nargs != vec_len(callee->params)) {
+		fail(vf, inst->block, v, "@%s takes %u arguments, got %u",
+		     callee->name, (u32)vec_len(callee->params), inst->nargs);
+		return;
+	}
+	for (u32 i = 0; i < inst->nargs; ++i) {
+		IrValue p = vec_at(callee->params, i);
+		expect_type(vf, v, operand_type(vf, v, i),
+			    ir_inst(callee, p)->ty, "argument");
+	}
+}
+
+static void check_phi(Verifier *vf, IrValue v)
+{
+	const struct IrFunc *fn = vf->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	const IrValue *args = ir_args(fn, v);
+	u32 bb = inst->block;
+	const struct IrCfg *cfg = &vf->cfg;
+	u32 npreds = cfg->pred_start[bb + 1] - cfg->pred_start[bb];
+
+	if (inst->nargs % 2 || inst->nargs / 2 != npreds) {
+		fail(vf, bb, v, "%u incoming values for %u predecessors",
+		     inst->nargs / 2, npreds);
+		return;
+	}
+	for (u32 p = cfg->pred_start[bb]; p < cfg->pred_start[bb + 1]; ++p)
+		vf->seen[cfg->preds[p]] = v;
+	for (u32 i = 0; i < inst->nargs; i += 2) {
+		u32 from = args[i];
+		if (from >= vf->nblocks || vf->seen[from] != v) {
+			fail(vf, bb, v, "incoming bb%u is not a predecessor",
+			     from);
+			continue;
+		}
+		/* Each predecessor appears once. */
+		vf->seen[from] = IR_NONE;
+		expect_type(vf, v, operand_type(vf, v, i + 1), inst->ty,
+			    "incoming value");
+	}
+}
+
+static void check_types(Verifier *vf, IrValue v)
+{
+	const struct IrFunc *fn = vf->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	IrType ty = inst->ty;
+	u32 bb = inst->block;
+
+	switch (inst->op) {
+	case IrOp_CONST:
+	case IrOp_PARAM:
+	case IrOp_GLOBAL:
+	case IrOp_NOP:
+		fail(vf, bb, v, "may not appear in a block");
+		break;
+	case IrOp_ALLOCA:
+		if (bb != 1)
+			fail(vf, bb, v, "alloca outside the entry block");
+		if (!inst->imm.mem.size || !inst->imm.mem.align ||
+		    (inst->imm.mem.align & (inst->imm.mem.align - 1)))
+			fail(vf, bb, v, "bad size or alignment");
+		expect_type(vf, v, ty, IrType_PTR, "result");
+		break;
+	case IrOp_LOAD:
+		expect_args(vf, v, 1);
+		if (ty == IrType_VOID)
+			fail(vf, bb, v, "load of void");
+		if (inst->nargs == 1)
+			expect_type(vf, v, operand_type(vf, v, 0), IrType_PTR,
+				    "address");
+		break;
+	case IrOp_STORE:
+		expect_args(vf, v, 2);
+		expect_type(vf, v, ty, IrType_VOID, "result");
+		if (inst->nargs == 2) {
+			expect_type(vf, v, operand_type(vf, v, 0), IrType_PTR,
+				    "address");
+			operand_type(vf, v, 1);
+		}
+		break;
+	case IrOp_ZERO:
+		expect_args(vf, v, 1);
+		expect_type(vf, v, ty, IrType_VOID, "result");
+		if (inst->nargs == 1)
+			expect_type(vf, v, operand_type(vf, v, 0), IrType_PTR,
+				    "address");
+		break;
+	case IrOp_INDEX:
+		expect_args(vf, v, 2);
+		expect_type(vf, v, ty, IrType_PTR, "result");
+		if (inst->nargs == 2) {
+			expect_type(vf, v, operand_type(vf, v, 0), IrType_PTR,
+				    "base");
+			expect_type(vf, v, operand_type(vf, v, 1), IrType_I32,
+				    "index");
+		}
+		break;
+	case IrOp_ADD:
+	case IrOp_SUB:
+	case IrOp_MUL:
+	case IrOp_DIV:
+	case IrOp_MOD:
+		expect_args(vf, v, 2);
+		if (inst->op == IrOp_MOD ? ty != IrType_I32 : !is_numeric(ty))
+			fail(vf, bb, v, "arithmetic on %s", ir_type_name(ty));
+		if ((inst->op == IrOp_DIV || inst->op == IrOp_MOD) &&
+		    ty == IrType_I32 && inst->imm.index >= vec_len(vf->m->names))
+			fail(vf, bb, v, "division of unknown function %u",
+			     inst->imm.index);
+		if (inst->nargs == 2) {
+			expect_type(vf, v, operand_type(vf, v, 0), ty, "lhs");
+			expect_type(vf, v, operand_type(vf, v, 1), ty, "rhs");
+		}
+		break;
+	case IrOp_NEG:
+	case IrOp_NOT:
+		expect_args(vf, v, 1);
+		if (inst->op == IrOp_NOT ? ty != IrType_I1 : !is_numeric(ty))
+			fail(vf, bb, v, "operand type %s", ir_type_name(ty));
+		if (inst->nargs == 1)
+			expect_type(vf, v, operand_type(vf, v, 0), ty,
+				    "operand");
+		break;
+	case IrOp_EQ:
+	case IrOp_NE:
+	case IrOp_LT:
+	case IrOp_LE:
+	case IrOp_GT:
+	case IrOp_GE:
+		expect_args(vf, v, 2);
+		expect_type(vf, v, ty, IrType_I1, "result");
+		if (inst->nargs == 2) {
+			IrType lhs = operand_type(vf, v, 0);
+			bool eq = inst->op == IrOp_EQ || inst->op == IrOp_NE;
+			if (!is_numeric(lhs) && lhs != IrType_PTR &&
+			    !(eq && lhs == IrType_I1))
+				fail(vf, bb, v, "comparison of %s",
+				     ir_type_name(lhs));
+			expect_type(vf, v, operand_type(vf, v, 1), lhs, "rhs");
+		}
+		break;
+	case IrOp_CALL:
+		check_call(vf, v);
+		break;
+	case IrOp_PHI:
+		if (ty == IrType_VOID)
+			fail(vf, bb, v, "phi of void");
+		check_phi(vf, v);
+		break;
+	case IrOp_BR:
+		expect_args(vf, v, 0);
+		break;
+	case IrOp_CONDBR:
+		expect_args(vf, v, 1);
+		if (inst->nargs == 1)
+			expect_type(vf, v, operand_type(vf, v, 0), IrType_I1,
+				    "condition");
+		break;
+	case IrOp_RET:
+		if (fn->ret == IrType_VOID) {
+			expect_args(vf, v, 0);
+		} else {
+			expect_args(vf, v, 1);
+			if (inst->nargs == 1)
+				expect_type(vf, v, operand_type(vf, v, 0),
+					    fn->ret, "return value");
+		}
+		break;
+	default:
+		fail(vf, bb, v, "unknown opcode %u", inst->op);
+	}
+}
+
+/* Whether the definition of `a` is available at the end of block `at`,
+ * or just before `user` if `user` is in `at`. */
+static bool available(const Verifier *vf, IrValue a, u32 at, IrValue user)
+{
+	const struct IrInst *def = ir_inst(vf->fn, a);
+	if (def->op == IrOp_CONST || def->op == IrOp_PARAM ||
+	    def->op == IrOp_GLOBAL)
+		return true;
+	if (def->block == IR_NONE)
+		return false;
+	if (def->block == at)
+		return !user || vf->pos[a] < vf->pos[user];
+	return dominates(vf, def->block, at);
+}
+
+static void check_dominance(Verifier *vf, IrValue v)
+{
+	const struct IrFunc *fn = vf->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	const IrValue *args = ir_args(fn, v);
+
+	if (inst->op == IrOp_PHI) {
+		for (u32 i = 0; i + 1 < inst->nargs; i += 2) {
+			IrValue a = args[i + 1];
+			u32 from = args[i];
+			if (a && a < vf->ninsts && from < vf->nblocks &&
+			    reachable(vf, from) && !available(vf, a, from, 0))
+				fail(vf, inst->block, v,
+				     "%%%u does not dominate the edge from bb%u",
+				     a, from);
+		}
+		return;
+	}
+	for (u32 i = 0; i < inst->nargs; ++i) {
+		IrValue a = args[i];
+		if (a && a < vf->ninsts && !available(vf, a, inst->block, v))
+			fail(vf, inst->block, v, "%%%u does not dominate this use",
+			     a);
+	}
+}
+
+/*
+ * ==========================================================================
+ * 4. Entry Points
+ * ==========================================================================
+ */
+
+/* Block layout: links are consistent, one terminator, PHIs first, and
+ * branches stay inside the function, so the CFG can be built. */
+static bool check_layout(Verifier *vf)
+{
+	const struct IrFunc *fn = vf->fn;
+	u32 before = vf->errors;
+
+	for (u32 bb = 1; bb < vf->nblocks; ++bb) {
+		const struct IrBlock *blk = &fn->blocks.data[bb];
+		IrValue prev = IR_NONE;
+		u32 pos = 0;
+		bool past_phis = false;
+
+		for (IrValue v = blk->first; v; v = ir_inst(fn, v)->next) {
+			if (v >= vf->ninsts || ir_inst(fn, v)->block != bb ||
+			    ir_inst(fn, v)->prev != prev || ++pos > vf->ninsts) {
+				fail(vf, bb, IR_NONE, "broken instruction list");
+				return false;
+			}
+			vf->pos[v] = pos;
+			prev = v;
+
+			IrOp op = ir_inst(fn, v)->op;
+			if (op == IrOp_PHI && past_phis)
+				fail(vf, bb, v, "phi after other instructions");
+			past_phis |= op != IrOp_PHI;
+			if (ir_is_terminator(op) && v != blk->last)
+				fail(vf, bb, v, "terminator in mid-block");
+		}
+		if (prev != blk->last) {
+			fail(vf, bb, IR_NONE, "broken instruction list");
+			return false;
+		}
+
+		IrValue term = ir_terminator(fn, bb);
+		if (!term) {
+			fail(vf, bb, IR_NONE, "missing terminator");
+			continue;
+		}
+		u32 succ[2];
+		u32 k = ir_succs(fn, bb, succ);
+		for (u32 i = 0; i < k; ++i)
+			check_target(vf, term, succ[i]);
+	}
+	return vf->errors == before;
+}
+
+bool ir_verify_func(const struct IrModule *m, const struct IrFunc *fn,
+		    FILE *err)
+{
+	if (fn->is_extern)
+		return true;
+
+	Verifier vf = {
+		.m = m,
+		.fn = fn,
+		.err = err,
+		.nblocks = (u32)vec_len(fn->blocks),
+		.ninsts = (u32)vec_len(fn->insts),
+	};
+	if (vf.nblocks < 2) {
+		fail(&vf, IR_NONE, IR_NONE, "no entry block");
+		return false;
+	}
+
+	/* Block arrays plus one slot per value. */
+	vf.cap = 8 * (usize)vf.nblocks + vf.ninsts + 4;
+	layout_t lay = layout(vf.cap * sizeof(u32), 4);
+	vf.buf = allocer_alloc(allocer_system(), lay);
+	massert(vf.buf, "OOM ir verify");
+	memset(vf.buf, 0, vf.cap * sizeof(u32));
+
+	vf.pos = scratch(&vf, vf.ninsts);
+	if (check_layout(&vf)) {
+		vf.seen = scratch(&vf, vf.nblocks);
+		ir_cfg_build(&vf.cfg, fn);
+		build_domtree(&vf);
+
+		if (vf.cfg.pred_start[2] != vf.cfg.pred_start[1])
+			fail(&vf, 1, IR_NONE, "entry block has predecessors");
+
+		for (u32 bb = 1; bb < vf.nblocks; ++bb) {
+			ir_foreach_inst(fn, bb, v)
+			{
+				check_types(&vf, v);
+				if (reachable(&vf, bb))
+					check_dominance(&vf, v);
+			}
+		}
+	}
+	ir_buf_deinit(&vf.cfg.buf);
+	allocer_free(allocer_system(), vf.buf, lay);
+	return vf.errors == 0;
+}
+
+bool ir_verify_module(const struct IrModule *m, FILE *err)
+{
+	bool ok = true;
+	for (usize i = 0; i < vec_len(m->funcs); ++i)
+		ok &= ir_verify_func(m, &m->funcs.data[i], err);
+	return ok;
+}
@@ -0,0 +1,543 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <jit.h>
+#include <trace.h>
+#include <std/allocers/system.h>
+#include <core/msg.h>
+
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * ==========================================================================
+ * 1. Memory
+ * ==========================================================================
+ * One mapping holds the data area, read-write, then the code, which is
+ * made writable only while a piece is copied in. Everything native code
+ * reaches rip-relative lives in the data area: the variables, the host's
+ * interpreter call, and one slot per function (the dispatch table: the
+ * native code, or a stub calling the interpreter), per runtime helper
+ * and per global.
+ *
+ * Native code runs on a machine stack of the JIT's own, reserved like
+ * the VM's stacks.
+ */
+
+#define JIT_CODE_BYTES ((usize)64 << 20)
+#define JIT_STACK_BYTES ((usize)1 << 30)
+/* Room below the stack limit for C code: builtins, traps, and the
+ * interpreter up to its own checks. */
+#define JIT_STACK_SLACK ((usize)1 << 20)
+
+/* Data slots after the X86Var ones. */
+enum { SLOT_CALL = X86_VAR_COUNT, SLOT_FIXED };
+
+struct Jit {
+	const struct VmProgram *p;
+	const struct IrModule *m;
+	struct JitHost host;
+
+	struct X86Gen gen;
+	struct X86Code code;
+	X86InstVec stub;
+	u32 *label_at;
+	usize label_cap;
+
+	u8 *region;
+	usize region_size;
+	usize page;
+	u64 *slots;
+	u64 *dispatch;
+	u64 *runtime;
+	u64 *globals;
+	u8 *code_base;
+	usize code_used;
+	usize code_cap;
+
+	u8 *stack;
+	void (*run_on)(void (*fn)(void *), void *arg, u8 *sp);
+
+	/* Per function. */
+	JitEntry *entry;
+	bool *failed;
+	/* Per block, indexed as VmProgram.block_at. */
+	JitEntry *loop;
+	usize nblocks;
+};
+
+static JitEntry as_entry(u8 *code)
+{
+	return (JitEntry)(void *)code;
+}
+
+/* Address a symbol of generated code refers to. */
+static u8 *resolve(struct Jit *j, struct X86Sym s)
+{
+	switch ((X86SymKind)s.kind) {
+	case X86Sym_VAR:
+		return (u8 *)&j->slots[s.index];
+	case X86Sym_FUNC:
+		return s.indirect ? (u8 *)&j->dispatch[s.index] : NULL;
+	case X86Sym_RUNTIME:
+		return s.indirect ? (u8 *)&j->runtime[s.index] : NULL;
+	case X86Sym_GLOBAL:
+		return s.indirect ? (u8 *)&j->globals[s.index] : NULL;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Encodes `insts` into the code area, labels at j->label_at.
+ * @return the code, or NULL if it does not encode or fit.
+ */
+static u8 *place(struct Jit *j, const struct X86Inst *insts, u32 n,
+		 u32 nlabels)
+{
+	if (nlabels > j->label_cap) {
+		ir_drop(j->label_at, j->label_cap * sizeof(u32));
+		j->label_cap = nlabels * 2;
+		j->label_at = ir_grab(j->label_cap * sizeof(u32));
+	}
+	j->code.bytes.len = 0;
+	j->code.relocs.len = 0;
+	if (!x86_encode(&j->code, insts, n, j->label_at))
+		return NULL;
+
+	usize size = vec_len(j->code.bytes);
+	usize at = (j->code_used + 15) & ~(usize)15;
+	if (size > j->code_cap - at)
+		return NULL;
+	u8 *dst = j->code_base + at;
+
+	for (usize i = 0; i < vec_len(j->code.relocs); ++i) {
+		struct X86Reloc r = j->code.relocs.data[i];
+		u8 *s = resolve(j, r.sym);
+		if (!s)
+			return NULL;
+		i64 rel = (i64)(s - (dst + r.at)) + r.addend;
+		massert(rel >= INT32_MIN && rel <= INT32_MAX,
+			"jit: out of reach");
+		i32 rel32 = (i32)rel;
+		memcpy(&j->code.bytes.data[r.at], &rel32, 4);
+	}
+
+	u8 *first = (u8 *)((uintptr_t)dst & ~(uintptr_t)(j->page - 1));
+	usize span = (usize)(dst + size - first);
+	if (mprotect(first, span, PROT_READ | PROT_WRITE) != 0)
+		return NULL;
+	memcpy(dst, j->code.bytes.data, size);
+	if (mprotect(first, span, PROT_READ | PROT_EXEC) != 0)
+		return NULL;
+	j->code_used = at + size;
+	return dst;
+}
+
+/*
+ * ==========================================================================
+ * 2. Stubs
+ * ==========================================================================
+ * Glue between the VM's calling convention (arguments and results as
+ * union VmReg) and System V.
+ */
+
+static const u8 INT_ARGS[] = { X86_RDI, X86_RSI, X86_RDX,
+			       X86_RCX, X86_R8,	 X86_R9 };
+#define FLOAT_ARGS 8
+
+#define NONE ((struct X86Operand){ .kind = X86Opnd_NONE })
+
+static void emit(struct Jit *j, X86Op op, u8 size, struct X86Operand dst,
+		 struct X86Operand src)
+{
+	struct X86Inst in = {
+		.op = (u8)op, .size = size, .dst = dst, .src = src
+	};
+	massert(vec_push(j->stub, in), "OOM jit");
+}
+
+static u8 *place_stub(struct Jit *j)
+{
+	u8 *at = place(j, j->stub.data, (u32)vec_len(j->stub), 0);
+	j->stub.len = 0;
+	return at;
+}
+
+static bool is_float(IrType ty)
+{
+	return ty == IrType_F32 || ty == IrType_F64;
+}
+
+static IrType param_type(const struct IrFunc *fn, u32 i)
+{
+	return (IrType)ir_inst(fn, fn->params.data[i])->ty;
+}
+
+static struct X86Sym sym(X86SymKind kind, u32 index, bool indirect)
+{
+	return (struct X86Sym){ .kind = (u8)kind,
+				.indirect = indirect,
+				.index = index };
+}
+
+/*
+ * Native to interpreter: spills the arguments to an array and calls the
+ * host, which runs `func` in the interpreter. Until `func` is compiled,
+ * its dispatch slot points here.
+ */
+static bool make_exit(struct Jit *j, u32 func)
+{
+	const struct IrFunc *fn = &j->m->funcs.data[func];
+	u32 n = (u32)vec_len(fn->params);
+	i32 area = (i32)(8 * n + 15) & ~15;
+
+	emit(j, X86_PUSH, 8, x86_reg(X86_RBP), NONE);
+	emit(j, X86_MOV, 8, x86_reg(X86_RBP), x86_reg(X86_RSP));
+	if (area)
+		emit(j, X86_SUB, 8, x86_reg(X86_RSP), x86_imm(area));
+	u32 ni = 0, nf = 0, stack = 0;
+	for (u32 i = 0; i < n; ++i) {
+		struct X86Operand to = x86_mem(X86_RSP, 8 * (i32)i);
+		bool fl = is_float(param_type(fn, i));
+		if (fl && nf < FLOAT_ARGS) {
+			emit(j, X86_MOVSD, 0, to, x86_reg(X86_XMM0 + nf++));
+		} else if (!fl && ni < sizeof(INT_ARGS)) {
+			emit(j, X86_MOV, 8, to,
+			     x86_reg((X86Reg)INT_ARGS[ni++]));
+		} else {
+			emit(j, X86_MOV, 8, x86_reg(X86_RAX),
+			     x86_mem(X86_RBP, 16 + 8 * (i32)stack++));
+			emit(j, X86_MOV, 8, to, x86_reg(X86_RAX));
+		}
+	}
+	emit(j, X86_MOV, 8, x86_reg(X86_RDI),
+	     x86_imm((i64)(uintptr_t)j->host.ctx));
+	emit(j, X86_MOV, 4, x86_reg(X86_RSI), x86_imm(func));
+	emit(j, X86_MOV, 8, x86_reg(X86_RDX), x86_reg(X86_RSP));
+	emit(j, X86_CALL, 0, x86_mem_sym(sym(X86Sym_VAR, SLOT_CALL, false)),
+	     NONE);
+	if (is_float(fn->ret))
+		emit(j, X86_MOVD, 8, x86_reg(X86_XMM0), x86_reg(X86_RAX));
+	emit(j, X86_MOV, 8, x86_reg(X86_RSP), x86_reg(X86_RBP));
+	emit(j, X86_POP, 8, x86_reg(X86_RBP), NONE);
+	emit(j, X86_RET, 0, NONE, NONE);
+
+	u8 *at = place_stub(j);
+	if (!at)
+		return false;
+	j->dispatch[func] = (u64)(uintptr_t)at;
+	return true;
+}
+
+/* Interpreter to native: a JitEntry loading the arguments from `regs`
+ * and calling `func` through its dispatch slot. */
+static u8 *make_entry(struct Jit *j, u32 func)
+{
+	const struct IrFunc *fn = &j->m->funcs.data[func];
+	u32 n = (u32)vec_len(fn->params);
+	u32 ni = 0, nf = 0, nstack = 0;
+	for (u32 i = 0; i < n; ++i) {
+		bool fl = is_float(param_type(fn, i));
+		if (fl ? nf < FLOAT_ARGS : ni < sizeof(INT_ARGS))
+			fl ? ++nf : ++ni;
+		else
+			++nstack;
+	}
+
+	/* rbp and rbx pushed: 8 more keeps rsp 16-aligned at the call. */
+	emit(j, X86_PUSH, 8, x86_reg(X86_RBP), NONE);
+	emit(j, X86_MOV, 8, x86_reg(X86_RBP), x86_reg(X86_RSP));
+	emit(j, X86_PUSH, 8, x86_reg(X86_RBX), NONE);
+	emit(j, X86_SUB, 8, x86_reg(X86_RSP),
+	     x86_imm(8 + ((8 * (i32)nstack + 15) & ~15)));
+	emit(j, X86_MOV, 8, x86_reg(X86_RBX), x86_reg(X86_RDI));
+	ni = nf = 0;
+	u32 stack = 0;
+	for (u32 i = 0; i < n; ++i) {
+		struct X86Operand from = x86_mem(X86_RBX, 8 * (i32)i);
+		bool fl = is_float(param_type(fn, i));
+		if (fl && nf < FLOAT_ARGS) {
+			emit(j, X86_MOVSD, 0, x86_reg(X86_XMM0 + nf++), from);
+		} else if (!fl && ni < sizeof(INT_ARGS)) {
+			emit(j, X86_MOV, 8, x86_reg((X86Reg)INT_ARGS[ni++]),
+			     from);
+		} else {
+			emit(j, X86_MOV, 8, x86_reg(X86_RAX), from);
+			emit(j, X86_MOV, 8, x86_mem(X86_RSP, 8 * (i32)stack++),
+			     x86_reg(X86_RAX));
+		}
+	}
+	emit(j, X86_CALL, 0, x86_mem_sym(sym(X86Sym_FUNC, func, true)), NONE);
+	if (is_float(fn->ret))
+		emit(j, X86_MOVD, 8, x86_reg(X86_RAX), x86_reg(X86_XMM0));
+	emit(j, X86_LEA, 8, x86_reg(X86_RSP), x86_mem(X86_RBP, -8));
+	emit(j, X86_POP, 8, x86_reg(X86_RBX), NONE);
+	emit(j, X86_POP, 8, x86_reg(X86_RBP), NONE);
+	emit(j, X86_RET, 0, NONE, NONE);
+	return place_stub(j);
+}
+
+/* A JitEntry for the loop entry at `code`, which already takes
+ * (regs, mem); only a float result needs moving to rax. */
+static u8 *make_loop_entry(struct Jit *j, u8 *code, IrType ret)
+{
+	emit(j, X86_PUSH, 8, x86_reg(X86_RBP), NONE);
+	emit(j, X86_MOV, 8, x86_reg(X86_RBP), x86_reg(X86_RSP));
+	emit(j, X86_MOV, 8, x86_reg(X86_RAX), x86_imm((i64)(uintptr_t)code));
+	emit(j, X86_CALL, 0, x86_reg(X86_RAX), NONE);
+	if (is_float(ret))
+		emit(j, X86_MOVD, 8, x86_reg(X86_RAX), x86_reg(X86_XMM0));
+	emit(j, X86_POP, 8, x86_reg(X86_RBP), NONE);
+	emit(j, X86_RET, 0, NONE, NONE);
+	return place_stub(j);
+}
+
+/* A trap as native code calls it, trap(func), adding the host's ctx. */
+static u8 *make_trap(struct Jit *j, void (*fn)(void))
+{
+	emit(j, X86_MOV, 8, x86_reg(X86_RSI),
+	     x86_imm((i64)(uintptr_t)j->host.ctx));
+	emit(j, X86_MOV, 8, x86_reg(X86_RAX), x86_imm((i64)(uintptr_t)fn));
+	emit(j, X86_JMP, 0, x86_reg(X86_RAX), NONE);
+	return place_stub(j);
+}
+
+/* run_on(fn, arg, sp): calls fn(arg) with the stack pointer at sp. */
+static u8 *make_run_on(struct Jit *j)
+{
+	emit(j, X86_PUSH, 8, x86_reg(X86_RBP), NONE);
+	emit(j, X86_MOV, 8, x86_reg(X86_RBP), x86_reg(X86_RSP));
+	emit(j, X86_MOV, 8, x86_reg(X86_RSP), x86_reg(X86_RDX));
+	emit(j, X86_MOV, 8, x86_reg(X86_RAX), x86_reg(X86_RDI));
+	emit(j, X86_MOV, 8, x86_reg(X86_RDI), x86_reg(X86_RSI));
+	emit(j, X86_CALL, 0, x86_reg(X86_RAX), NONE);
+	emit(j, X86_MOV, 8, x86_reg(X86_RSP), x86_reg(X86_RBP));
+	emit(j, X86_POP, 8, x86_reg(X86_RBP), NONE);
+	emit(j, X86_RET, 0, NONE, NONE);
+	return place_stub(j);
+}
+
+/*
+ * ==========================================================================
+ * 3. Compilation
+ * ==========================================================================
+ */
+
+static bool compile(struct Jit *j, u32 func)
+{
+	const struct IrFunc *fn = &j->m->funcs.data[func];
+	const struct VmFunc *vf = &j->p->funcs.data[func];
+
+	/* Every function it calls needs a dispatch slot first. */
+	for (IrValue v = 1; v < vec_len(fn->insts); ++v) {
+		const struct IrInst *inst = ir_inst(fn, v);
+		if (inst->op != IrOp_CALL || !inst->block)
+			continue;
+		u32 callee = inst->imm.index;
+		if (!j->m->funcs.data[callee].is_extern &&
+		    !j->dispatch[callee] && !make_exit(j, callee))
+			return false;
+	}
+
+	j->gen.osr_slots = j->p->value_reg.data + vf->first_value;
+	x86_gen_func(&j->gen, func);
+	u8 *code = place(j, j->gen.insts.data, (u32)vec_len(j->gen.insts),
+			 j->gen.nlabels);
+	if (!code)
+		return false;
+
+	/* Loop entries, before the stubs below reuse label_at. */
+	JitEntry *loop = j->loop + vf->first_block;
+	for (u32 bb = 1; bb < vf->nblocks; ++bb) {
+		u32 label = j->gen.osr_label[bb];
+		loop[bb] = label ? as_entry(code + j->label_at[label]) : NULL;
+	}
+	j->dispatch[func] = (u64)(uintptr_t)code;
+
+	for (u32 bb = 1; bb < vf->nblocks; ++bb)
+		if (loop[bb])
+			loop[bb] = as_entry(make_loop_entry(
+				j, (u8 *)(void *)loop[bb], fn->ret));
+	j->entry[func] = as_entry(make_entry(j, func));
+	return true;
+}
+
+/*
+ * ==========================================================================
+ * 4. Public API
+ * ==========================================================================
+ */
+
+struct Jit *jit_new(const struct VmProgram *p, const struct IrModule *m,
+		    const struct JitHost *host)
+{
+	struct Jit *j = ir_grab(sizeof(*j));
+	j->p = p;
+	j->m = m;
+	j->host = *host;
+	j->page = (usize)sysconf(_SC_PAGESIZE);
+
+	usize nfuncs = vec_len(p->funcs);
+	usize nslots = SLOT_FIXED + nfuncs + X86_RT_COUNT + p->nglobals;
+	usize data = (nslots * 8 + j->page - 1) & ~(j->page - 1);
+	j->region_size = data + JIT_CODE_BYTES;
+	void *region = mmap(NULL, j->region_size, PROT_NONE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	void *stack = mmap(NULL, JIT_STACK_BYTES, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	j->region = region == MAP_FAILED ? NULL : region;
+	j->stack = stack == MAP_FAILED ? NULL : stack;
+	if (!j->region || !j->stack ||
+	    mprotect(j->region, data, PROT_READ | PROT_WRITE) != 0) {
+		jit_free(j);
+		return NULL;
+	}
+
+	j->slots = (u64 *)j->region;
+	j->dispatch = j->slots + SLOT_FIXED;
+	j->runtime = j->dispatch + nfuncs;
+	j->globals = j->runtime + X86_RT_COUNT;
+	j->code_base = j->region + data;
+	j->code_cap = JIT_CODE_BYTES;
+
+	struct JitVars *vars = jit_vars(j);
+	vars->stack_limit = j->stack + JIT_STACK_SLACK;
+	vars->mem_end = host->mem_end;
+	j->slots[SLOT_CALL] = (u64)(uintptr_t)host->call;
+	for (usize i = 0; i < p->nglobals; ++i)
+		j->globals[i] = (u64)(uintptr_t)p->global_at[i];
+
+	j->entry = ir_grab(nfuncs * sizeof(JitEntry));
+	j->failed = ir_grab(nfuncs * sizeof(bool));
+	j->nblocks = vec_len(p->block_at);
+	j->loop = ir_grab(j->nblocks * sizeof(JitEntry));
+	x86_gen_init(&j->gen, m, X86Mode_JIT);
+	x86_code_init(&j->code);
+	massert(vec_init(j->stub, allocer_system(), 32), "OOM jit");
+
+	for (u32 rt = 0; rt < X86_RT_COUNT; ++rt) {
+		u8 *at = (u8 *)(uintptr_t)host->runtime[rt];
+		if (rt == X86_RT_DIV_ZERO || rt == X86_RT_OVERFLOW)
+			at = make_trap(j, host->runtime[rt]);
+		j->runtime[rt] = (u64)(uintptr_t)at;
+	}
+	u8 *run_on = make_run_on(j);
+	if (!run_on || !j->runtime[X86_RT_DIV_ZERO] ||
+	    !j->runtime[X86_RT_OVERFLOW]) {
+		jit_free(j);
+		return NULL;
+	}
+	j->run_on = (void (*)(void (*)(void *), void *, u8 *))(void *)run_on;
+	return j;
+}
+
+void jit_free(struct Jit *j)
+{
+	if (!j)
+		return;
+	usize nfuncs = vec_len(j->p->funcs);
+	if (j->entry) {
+		x86_gen_deinit(&j->gen);
+		x86_code_deinit(&j->code);
+		vec_deinit(j->stub);
+	}
+	ir_drop(j->entry, nfuncs * sizeof(JitEntry));
+	ir_drop(j->failed, nfuncs * sizeof(bool));
+	ir_drop(j->loop, j->nblocks * sizeof(JitEntry));
+	ir_drop(j->label_at, j->label_cap * sizeof(u32));
+	if (j->region)
+		munmap(j->region, j->region_size);
+	if (j->stack)
+		munmap(j->stack, JIT_STACK_BYTES);
+	ir_drop(j, sizeof(*j));
+}
+
+struct JitVars *jit_vars(struct Jit *j)
+{
+	return (struct JitVars *)j->slots;
+}
+
+void jit_enter(struct Jit *j, void (*fn)(void *), void *arg)
+{
+	j->run_on(fn, arg, j->stack + JIT_STACK_BYTES);
+}
+
+JitEntry jit_compile(struct Jit *j, u32 func)
+{
+	if (j->entry[func] || j->failed[func])
+		return j->entry[func];
+	const struct IrFunc *fn = &j->m->funcs.data[func];
+	TRACE_SCOPE_ARG("jit_compile", fn->name);
+	if (fn->is_extern || !compile(j, func) || !j->entry[func])
+		j->failed[func] = true;
+	return j->entry[func];
+}
+
+JitEntry jit_loop_entry(struct Jit *j, u32 func, u32 block)
+{
+	if (!jit_compile(j, func))
+		return NULL;
+	return j->loop[j->p->funcs.data[func].first_block + block];
+}
+
+#else /* no JIT for this host */
+
+struct Jit *jit_new(const struct VmProgram *p, const struct IrModule *m,
+		    const struct JitHost *host)
+{
+	(void)p;
+	(void)m;
+	(void)host;
+	return NULL;
+}
+
+void jit_free(struct Jit *j)
+{
+	(void)j;
+}
+
+struct JitVars *jit_vars(struct Jit *j)
+{
+	(void)j;
+	return NULL;
+}
+
+void jit_enter(struct Jit *j, void (*fn)(void *), void *arg)
+{
+	(void)j;
+	fn(arg);
+}
+
+JitEntry jit_compile(struct Jit *j, u32 func)
+{
+	(void)j;
+	(void)func;
+	return NULL;
+}
+
+JitEntry jit_loop_entry(struct Jit *j, u32 func, u32 block)
+{
+	(void)j;
+	(void)func;
+	(void)block;
+	return NULL;
+}
+
+#endif
@@ -17,6 +17,9 @@
 #include <lexer.h>
 #include <token.h>
 #include <context.h>
+#include <stats.h>
+#include <stream.h>
+#include <prelude.h>
 
 #include <core/msg.h>
 #include <core/macros.h>
@@ -43,6 +46,31 @@ void lexer_init(struct Lexer *lex, struct Context *ctx, usize file_id)
 	lex->content_start = file->content;
 	lex->content_len = file->len;
 	lex->cursor = 0;
+	lex->window_base = 0;
+	lex->stream = NULL;
+}
+
+void lexer_init_stream(struct Lexer *lex, struct Context *ctx, usize file_id,
+		       struct Stream *s)
+{
+	lexer_init(lex, ctx, file_id);
+
+	lex->stream = s;
+	lex->content_start = s->buf;
+	lex->content_len = s->len;
+	lex->window_base = s->base;
+}
+
+void lexer_release(struct Lexer *lex, usize offset)
+{
+	if (!lex->stream)
+		return;
+
+	usize moved = stream_release(lex->stream, offset);
+	lex->cursor -= moved;
+	lex->window_base += moved;
+	lex->content_start = lex->stream->buf;
+	lex->content_len = lex->stream->len;
 }
 
 /*
@@ -51,23 +79,48 @@ void lexer_init(struct Lexer *lex, struct Context *ctx, usize file_id)
  * ==========================================================================
  */
 
+/* The stream buffer may have moved (a fill, or a diagnostic reading ahead). */
+static inline void sync_window(struct Lexer *l)
+{
+	l->content_start = l->stream->buf;
+	l->content_len = l->stream->len;
+}
+
+/**
+ * @brief Slow path of the readers: pull input until `cursor + ahead` is in
+ * the window. Cursors into the window stay valid, so a token may straddle
+ * several chunks.
+ */
+static bool refill(struct Lexer *l, usize ahead)
+{
+	if (!l->stream)
+		return false;
+
+	while (l->cursor + ahead >= l->stream->len) {
+		if (!stream_fill(l->stream))
+			break;
+	}
+	sync_window(l);
+	return l->cursor + ahead < l->content_len;
+}
+
 static inline char peek(struct Lexer *l)
 {
-	if (l->cursor >= l->content_len)
+	if (l->cursor >= l->content_len && !refill(l, 0))
 		return '\0';
 	return l->content_start[l->cursor];
 }
 
 static inline char peek_next(struct Lexer *l)
 {
-	if (l->cursor + 1 >= l->content_len)
+	if (l->cursor + 1 >= l->content_len && !refill(l, 1))
 		return '\0';
 	return l->content_start[l->cursor + 1];
 }
 
 static inline char advance(struct Lexer *l)
 {
-	if (l->cursor >= l->content_len)
+	if (l->cursor >= l->content_len && !refill(l, 0))
 		return '\0';
 	return l->content_start[l->cursor++];
 }
@@ -89,7 +142,7 @@ static inline bool match(struct Lexer *l, char expected)
 static inline span_t make_span(struct Lexer *l, usize start_cursor)
 {
 	const srcfile_t *file = srcmanager_get_file(&l->ctx->mgr, l->file_id);
-	usize base = file->base_offset;
+	usize base = file->base_offset + l->window_base;
 	return span(base + start_cursor, base + l->cursor);
 }
 
@@ -104,6 +157,8 @@ static struct Token lexer_error_token(struct Lexer *l, const char *msg,
 	err_tok.span = make_span(l, start);
 
 	ctx_error(l->ctx, &err_tok, "%s", msg);
+	if (l->stream)
+		sync_window(l);
 
 	return err_tok;
 }
@@ -171,11 +226,12 @@ static struct Token scan_identifier(struct Lexer *l)
 	str_t s = str_from_parts(l->content_start + start, len);
 
 	symbol_t sym = intern(&l->ctx->itn, s);
+	if (sym.id >= compile_stats.strings)
+		compile_stats.strings = (u64)sym.id + 1;
 
-	TokenKind *kind_ptr = map_get(l->ctx->kw_map, sym);
-
-	if (kind_ptr) {
-		return (struct Token){ .kind = *kind_ptr, .span = sp };
+	TokenKind kind = prelude_keyword(sym);
+	if (kind != TokenKind_IDENT) {
+		return (struct Token){ .kind = kind, .span = sp };
 	}
 
 	return (struct Token){ .kind = TokenKind_IDENT,
@@ -277,6 +333,9 @@ static struct Token scan_number(struct Lexer *l)
 
 struct Token lexer_next(struct Lexer *l)
 {
+	if (l->stream)
+		sync_window(l);
+
 	skip_whitespace(l);
 
 	usize start = l->cursor;
@@ -0,0 +1,459 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * licm: loop-invariant code motion, inner loops first. An instruction
+ * whose operands are all defined outside the loop moves to the end of
+ * the preheader when running it there, once, cannot do anything the loop
+ * would not have done: pure instructions always, an integer DIV or MOD
+ * only by a nonzero constant, and a load only if nothing in the loop may
+ * write what it reads and its address is known to be valid or it would
+ * have run anyway.
+ *
+ * A memory location that the loop stores to and only ever accesses
+ * whole, at one fixed address, is given a new ALLOCA for the loop: it is
+ * loaded into that in the preheader and stored back on every exit, and
+ * mem2reg then turns the ALLOCA into SSA values, which sinks the stores
+ * out of the loop.
+ */
+
+#include <pass.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <stdlib.h>
+
+/*
+ * ==========================================================================
+ * 1. Memory
+ * ==========================================================================
+ * Which accesses may meet is the alias model of pass.h, as in gvn. The
+ * ALLOCAs this pass makes are roots of kind NEW.
+ */
+
+/* The kinds of access the loop being looked at makes, and of write. */
+struct Effects {
+	IrMemSet access;
+	IrMemSet write;
+};
+
+/* A load, store or ZERO in the loop of an ALLOCA or global, which
+ * covers bytes [off, end) of it; all of it unless the offset is fixed. */
+struct Access {
+	u32 id;
+	u8 ty;
+	bool write;
+	i64 off;
+	i64 end;
+	IrValue inst;
+};
+
+defVec(struct Access, AccessVec);
+
+struct Licm {
+	const struct IrModule *m;
+	struct IrFunc *fn;
+	const struct IrCfg *cfg;
+	const struct IrDomTree *dt;
+	const struct IrLoops *li;
+	u32 nvalues;
+	/* ALLOCAs whose address a call may see. */
+	bool *escaped;
+	/* The last loop found to write each ALLOCA and global. */
+	u32 *written;
+	struct Effects eff;
+	AccessVec accesses;
+	/* Blocks the current loop exits from. */
+	IrU32Vec exiting;
+	bool changed;
+};
+
+static struct IrRoot root_of(const struct Licm *c, IrValue addr)
+{
+	return ir_root_of(c->fn, c->nvalues, addr);
+}
+
+/* Whether `size` bytes at `r` lie inside what it is based on. */
+static bool in_bounds(const struct Licm *c, IrValue addr, struct IrRoot r,
+		      u32 size)
+{
+	if (!r.fixed || r.off < 0)
+		return false;
+	const struct IrFunc *fn = c->fn;
+	while (ir_inst(fn, addr)->op == IrOp_INDEX)
+		addr = ir_args(fn, addr)[0];
+	const struct IrInst *inst = ir_inst(fn, addr);
+	u64 total;
+	if (r.kind == IrRoot_ALLOCA || r.kind == IrRoot_NEW) {
+		total = inst->imm.mem.size;
+	} else if (r.kind == IrRoot_SCALAR || r.kind == IrRoot_ARRAY) {
+		const struct IrGlobal *g = &c->m->globals.data[inst->imm.index];
+		total = (u64)ir_type_size(g->elem) * g->count;
+	} else {
+		return false;
+	}
+	return (u64)r.off + size <= total;
+}
+
+/* Notes an access of `ty` by `inst` in loop `l`; VOID for all of it. */
+static void touch(struct Licm *c, u32 l, IrValue inst, IrType ty,
+		  bool write)
+{
+	struct Effects *e = &c->eff;
+	struct IrRoot r = root_of(c, ir_args(c->fn, inst)[0]);
+	if (r.kind == IrRoot_NEW)
+		return;
+	IrMemSet kinds = ir_mem_kinds(r);
+	e->access |= kinds;
+	if (write)
+		e->write |= kinds;
+	if (!(kinds & IR_MEM(SAME)))
+		return;
+	if (write)
+		c->written[r.id] = l;
+
+	struct Access a = { .id = r.id, .ty = (u8)ty, .write = write,
+			    .off = INT64_MIN, .end = INT64_MAX, .inst = inst };
+	if (r.fixed && ty != IrType_VOID) {
+		a.off = r.off;
+		a.end = r.off + ir_type_size(ty);
+	}
+	massert(vec_push(c->accesses, a), "OOM licm");
+}
+
+/* The builtins touch no memory of the program. */
+static bool calls_program(const struct Licm *c, IrValue call)
+{
+	u32 callee = ir_inst(c->fn, call)->imm.index;
+	return !c->m->funcs.data[callee].is_extern;
+}
+
+/* Gathers what loop `l` does to memory and the blocks it exits from. */
+static void scan_loop(struct Licm *c, u32 l)
+{
+	struct IrFunc *fn = c->fn;
+	const struct IrLoops *li = c->li;
+	const struct IrLoop *loop = &li->loops[l];
+	c->eff = (struct Effects){ 0 };
+	c->accesses.len = 0;
+	c->exiting.len = 0;
+
+	for (u32 i = loop->begin; i < loop->end; ++i) {
+		ir_foreach_inst(fn, li->blocks[i], v)
+		{
+			const struct IrInst *inst = ir_inst(fn, v);
+			const IrValue *args = ir_args(fn, v);
+			switch (inst->op) {
+			case IrOp_LOAD:
+				touch(c, l, v, (IrType)inst->ty, false);
+				break;
+			case IrOp_STORE:
+				touch(c, l, v, (IrType)ir_inst(fn, args[1])->ty,
+				      true);
+				break;
+			case IrOp_ZERO:
+				touch(c, l, v, IrType_VOID, true);
+				break;
+			case IrOp_CALL:
+				if (calls_program(c, v)) {
+					c->eff.access |= IR_MEM(CALL);
+					c->eff.write |= IR_MEM(CALL);
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	const struct IrCfg *cfg = c->cfg;
+	for (u32 e = loop->exit_begin; e < loop->exit_end; ++e) {
+		u32 exit = li->exits[e];
+		u32 end = cfg->pred_start[exit + 1];
+		for (u32 p = cfg->pred_start[exit]; p < end; ++p)
+			if (ir_loop_contains(li, l, cfg->preds[p]))
+				massert(vec_push(c->exiting, cfg->preds[p]),
+					"OOM licm");
+	}
+}
+
+/* Whether nothing loop `l` does may write what a load from `r` reads. */
+static bool unwritten(const struct Licm *c, u32 l, struct IrRoot r)
+{
+	if (r.kind == IrRoot_UNKNOWN || r.kind == IrRoot_NEW)
+		return false;
+	IrMemSet overlaps = ir_mem_overlaps(r, c->escaped);
+	if ((overlaps & IR_MEM(SAME)) && c->written[r.id] == l)
+		return false;
+	return !(overlaps & c->eff.write & ~IR_MEM(SAME));
+}
+
+/*
+ * ==========================================================================
+ * 2. Hoisting
+ * ==========================================================================
+ */
+
+static bool invariant(const struct Licm *c, u32 l, IrValue v)
+{
+	u32 bb = ir_inst(c->fn, v)->block;
+	return !bb || !ir_loop_contains(c->li, l, bb);
+}
+
+/* Whether `bb` runs before the loop is left, however that happens. */
+static bool always_runs(const struct Licm *c, u32 bb)
+{
+	if (!vec_len(c->exiting))
+		return false;
+	for (u32 i = 0; i < vec_len(c->exiting); ++i)
+		if (!ir_dominates(c->dt, bb, c->exiting.data[i]))
+			return false;
+	return true;
+}
+
+/* Whether `v` may run in the preheader of `l` instead. */
+static bool can_hoist(const struct Licm *c, u32 l, IrValue v)
+{
+	struct IrFunc *fn = c->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	const IrValue *args = ir_args(fn, v);
+	switch (inst->op) {
+	case IrOp_INDEX:
+	case IrOp_ADD:
+	case IrOp_SUB:
+	case IrOp_MUL:
+	case IrOp_NEG:
+	case IrOp_NOT:
+	case IrOp_EQ:
+	case IrOp_NE:
+	case IrOp_LT:
+	case IrOp_LE:
+	case IrOp_GT:
+	case IrOp_GE:
+		break;
+	case IrOp_DIV:
+	case IrOp_MOD: {
+		/* Division by zero traps only for int; the loop may never
+		 * have got there. */
+		const struct IrInst *d = ir_inst(fn, args[1]);
+		if (inst->ty == IrType_I32 &&
+		    (d->op != IrOp_CONST || d->imm.k.i == 0))
+			return false;
+		break;
+	}
+	case IrOp_LOAD: {
+		struct IrRoot r = root_of(c, args[0]);
+		if (!invariant(c, l, args[0]) || !unwritten(c, l, r))
+			return false;
+		u32 size = ir_type_size((IrType)inst->ty);
+		return in_bounds(c, args[0], r, size) ||
+		       always_runs(c, inst->block);
+	}
+	default:
+		return false;
+	}
+	ir_foreach_operand(fn, v, i)
+		if (!invariant(c, l, args[i]))
+			return false;
+	return true;
+}
+
+/* Definitions come before their uses in reverse postorder, so one sweep
+ * moves whole chains of invariant instructions. */
+static void hoist(struct Licm *c, u32 l)
+{
+	struct IrFunc *fn = c->fn;
+	const struct IrLoops *li = c->li;
+	const struct IrLoop *loop = &li->loops[l];
+	IrValue term = ir_terminator(fn, loop->preheader);
+	for (u32 i = loop->begin; i < loop->end; ++i) {
+		IrValue v = fn->blocks.data[li->blocks[i]].first;
+		while (v) {
+			IrValue next = ir_inst(fn, v)->next;
+			if (can_hoist(c, l, v)) {
+				ir_move_before(fn, v, term);
+				c->changed = true;
+			}
+			v = next;
+		}
+	}
+}
+
+/*
+ * ==========================================================================
+ * 3. Promotion
+ * ==========================================================================
+ */
+
+static int cmp_access(const void *pa, const void *pb)
+{
+	const struct Access *a = pa, *b = pb;
+	if (a->id != b->id)
+		return a->id < b->id ? -1 : 1;
+	if (a->off != b->off)
+		return a->off < b->off ? -1 : 1;
+	return (int)a->ty - (int)b->ty;
+}
+
+/* Whether the exits of `l` are only entered from it. */
+static bool dedicated_exits(const struct Licm *c, u32 l)
+{
+	const struct IrCfg *cfg = c->cfg;
+	const struct IrLoop *loop = &c->li->loops[l];
+	for (u32 x = loop->exit_begin; x < loop->exit_end; ++x) {
+		u32 exit = c->li->exits[x];
+		u32 end = cfg->pred_start[exit + 1];
+		for (u32 p = cfg->pred_start[exit]; p < end; ++p)
+			if (!ir_loop_contains(c->li, l, cfg->preds[p]))
+				return false;
+	}
+	return true;
+}
+
+/* Whether what `run` accesses, and nothing else in `l` does, can live in
+ * an ALLOCA while the loop runs; its accesses are the run's. */
+static IrValue promotable(const struct Licm *c, u32 l,
+			  const struct Access *run, u32 n)
+{
+	IrValue addr = IR_NONE;
+	bool write = false;
+	for (u32 i = 0; i < n; ++i) {
+		IrValue a = ir_args(c->fn, run[i].inst)[0];
+		if (!addr && invariant(c, l, a))
+			addr = a;
+		write |= run[i].write;
+	}
+	if (!write || !addr)
+		return IR_NONE;
+
+	/* Nothing else in the loop may get at it: a call, say, or a
+	 * parameter pointing into the array. */
+	struct IrRoot r = root_of(c, addr);
+	if (ir_mem_overlaps(r, c->escaped) & c->eff.access & ~IR_MEM(SAME))
+		return IR_NONE;
+	/* It is read before the loop even if the loop never gets to. */
+	if (!in_bounds(c, addr, r, ir_type_size((IrType)run->ty)))
+		return IR_NONE;
+	return addr;
+}
+
+/* Gives the run's accesses of `addr` an ALLOCA instead: loaded in the
+ * preheader, stored back on every exit. */
+static void promote(struct Licm *c, u32 l, const struct Access *run, u32 n,
+		    IrValue addr)
+{
+	struct IrFunc *fn = c->fn;
+	const struct IrLoops *li = c->li;
+	const struct IrLoop *loop = &li->loops[l];
+	IrType ty = (IrType)run->ty;
+	u32 size = ir_type_size(ty);
+	IrValue slot = ir_alloca(fn, size, size);
+	for (u32 i = 0; i < n; ++i)
+		ir_args(fn, run[i].inst)[0] = slot;
+
+	/* Emitted after the terminator, then moved before it. */
+	struct IrBuilder b = { .fn = fn, .block = loop->preheader };
+	IrValue term = ir_terminator(fn, b.block);
+	IrValue init = ir_emit_load(&b, ty, addr);
+	ir_emit_store(&b, slot, init);
+	IrValue store = fn->blocks.data[b.block].last;
+	ir_move_before(fn, init, term);
+	ir_move_before(fn, store, term);
+
+	for (u32 x = loop->exit_begin; x < loop->exit_end; ++x) {
+		b.block = li->exits[x];
+		IrValue after = IR_NONE;
+		ir_foreach_inst(fn, b.block, v)
+		{
+			if (ir_inst(fn, v)->op != IrOp_PHI)
+				break;
+			after = v;
+		}
+		IrValue val = ir_emit_load(&b, ty, slot);
+		ir_emit_store(&b, addr, val);
+		store = fn->blocks.data[b.block].last;
+		ir_move_after(fn, val, b.block, after);
+		ir_move_after(fn, store, b.block, val);
+	}
+	c->changed = true;
+}
+
+/*
+ * Sorted by root and offset, the accesses of one location are a run,
+ * and one that nothing before or after it overlaps is promoted.
+ */
+static void promote_all(struct Licm *c, u32 l)
+{
+	if ((c->eff.access & IR_MEM(UNKNOWN)) || !dedicated_exits(c, l))
+		return;
+	struct Access *acc = c->accesses.data;
+	u32 n = (u32)vec_len(c->accesses);
+	qsort(acc, n, sizeof(*acc), cmp_access);
+
+	i64 reach = INT64_MIN;
+	for (u32 i = 0, j; i < n; i = j) {
+		if (i && acc[i].id != acc[i - 1].id)
+			reach = INT64_MIN;
+		for (j = i + 1; j < n && cmp_access(&acc[i], &acc[j]) == 0; ++j)
+			;
+		bool alone = reach <= acc[i].off && acc[i].ty != IrType_VOID &&
+			     (j == n || acc[j].id != acc[i].id ||
+			      acc[j].off >= acc[i].end);
+		if (acc[i].end > reach)
+			reach = acc[i].end;
+		IrValue addr;
+		if (alone && (addr = promotable(c, l, &acc[i], j - i)))
+			promote(c, l, &acc[i], j - i, addr);
+	}
+}
+
+IrAnalysisSet ir_licm(struct PassManager *pm)
+{
+	const struct IrLoops *li = pm_loops(pm);
+	if (!li->nloops)
+		return IR_PRESERVE_ALL;
+
+	struct IrFunc *fn = pm->fn;
+	struct Licm c = {
+		.m = pm->m,
+		.fn = fn,
+		.cfg = pm_cfg(pm),
+		.dt = pm_domtree(pm),
+		.li = li,
+	};
+	u32 n = c.nvalues = (u32)vec_len(fn->insts);
+	u32 nroots = n + (u32)vec_len(pm->m->globals);
+	c.escaped = ir_grab(n);
+	c.written = ir_grab(nroots * sizeof(u32));
+	massert(vec_init(c.accesses, allocer_system(), 64), "OOM licm");
+	massert(vec_init(c.exiting, allocer_system(), 16), "OOM licm");
+	ir_find_escapes(fn, n, c.escaped);
+
+	/* Inner loops come first, so what leaves one may leave the next. */
+	for (u32 l = 1; l <= li->nloops; ++l) {
+		if (li->loops[l].preheader == IR_NONE)
+			continue;
+		scan_loop(&c, l);
+		hoist(&c, l);
+		promote_all(&c, l);
+	}
+
+	vec_deinit(c.accesses);
+	vec_deinit(c.exiting);
+	ir_drop(c.written, nroots * sizeof(u32));
+	ir_drop(c.escaped, n);
+	return c.changed ? IR_PRESERVE_CFG : IR_PRESERVE_ALL;
+}
@@ -0,0 +1,590 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * loop-reduce: induction-variable strength reduction, inner loops first.
+ * A basic induction variable is a header PHI that every latch steps by
+ * the same constant. An address the loop computes from one, through
+ * INDEX, ADD, SUB and multiplication by constants, moves by a fixed
+ * number of bytes per iteration: it becomes a pointer PHI of its own,
+ * computed once in the preheader and stepped by one INDEX on each latch,
+ * so a[i][j][k] costs an add per iteration instead of a multiply per
+ * dimension. The start value is the address with the variable's initial
+ * value put in, which is itself an address the enclosing loop may reduce.
+ *
+ * Linear-function test replacement then looks at a header that exits on
+ * `i < n` (or `i > n` counting down): if the loop's pointers are all that
+ * still reads i, the test compares one of them with the address i = n
+ * would give instead, and i itself is left for dce.
+ */
+
+#include <pass.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Induction Variables
+ * ==========================================================================
+ * An affine value is invariant in the loop, or moves by `scale` (bytes
+ * for an address) for each step of 1 of the basic variable `iv`. It is
+ * `exact` when `iv` only ever appears as an INDEX's index: then it is
+ * the same for every i32 value of `iv`, without the wrapping of i32
+ * arithmetic.
+ */
+
+/* Reduced pointers per loop; more live at once would only spill. */
+#define REDUCE_MAX 8
+/* Bound on steps and scales, so that products stay exact. */
+#define SCALE_MAX ((i64)1 << 30)
+
+typedef enum State {
+	State_UNKNOWN,
+	State_AFFINE,
+	State_NOT,
+} State;
+
+/* Per value, valid for the loop numbered `stamp`. */
+struct Info {
+	u32 stamp;
+	u8 state;
+	bool exact;
+	/* Used as the address of an affine INDEX in the loop. */
+	bool base;
+	IrValue iv;
+	i64 scale;
+	/* A basic variable's step and value on entry. */
+	i32 step;
+	IrValue init;
+	/* The pointer PHI that replaces this address. */
+	IrValue repl;
+};
+
+/* A header exit test on a variable, and one on a pointer that may take
+ * its place. */
+struct ExitTest {
+	IrValue iv;
+	IrValue cmp;
+	IrValue test;
+	IrValue branch;
+};
+
+defVec(struct ExitTest, ExitTestVec);
+
+struct Reduce {
+	struct IrFunc *fn;
+	const struct IrCfg *cfg;
+	const struct IrLoops *li;
+	/* The loop being looked at. */
+	u32 l;
+	struct Info *info;
+	u32 cap;
+	IrU32Vec cands;
+	/* A PHI's incoming values while it is built. */
+	IrU32Vec vals;
+	ExitTestVec tests;
+	bool changed;
+};
+
+static bool in_loop(const struct Reduce *c, IrValue v)
+{
+	u32 bb = ir_inst(c->fn, v)->block;
+	return bb && ir_loop_contains(c->li, c->l, bb);
+}
+
+/* The loop's entry for `v`, or NULL for values newer than the table. */
+static struct Info *info_of(struct Reduce *c, IrValue v)
+{
+	if (v >= c->cap)
+		return NULL;
+	struct Info *in = &c->info[v];
+	if (in->stamp != c->l)
+		*in = (struct Info){ .stamp = c->l };
+	return in;
+}
+
+/* The table covers every value there is when a loop is started on. */
+static void fit_info(struct Reduce *c)
+{
+	u32 n = (u32)vec_len(c->fn->insts);
+	if (n <= c->cap)
+		return;
+	ir_drop(c->info, c->cap * sizeof(*c->info));
+	c->info = ir_grab(n * sizeof(*c->info));
+	c->cap = n;
+}
+
+/* The step of `phi` if every latch adds the same constant to it. */
+static i32 step_of(struct Reduce *c, IrValue phi, IrValue *init)
+{
+	struct IrFunc *fn = c->fn;
+	const struct IrInst *inst = ir_inst(fn, phi);
+	const IrValue *args = ir_args(fn, phi);
+	u32 pre = c->li->loops[c->l].preheader;
+	IrValue next = IR_NONE;
+	*init = IR_NONE;
+	for (u32 i = 0; i < inst->nargs; i += 2) {
+		if (args[i] == pre)
+			*init = args[i + 1];
+		else if (!next)
+			next = args[i + 1];
+		else if (args[i + 1] != next)
+			return 0;
+	}
+	if (!*init || !next || !in_loop(c, next))
+		return 0;
+
+	const struct IrInst *add = ir_inst(fn, next);
+	const IrValue *ops = ir_args(fn, next);
+	if (add->op != IrOp_ADD && add->op != IrOp_SUB)
+		return 0;
+	IrValue k = ops[0] == phi ? ops[1] : ops[0];
+	if ((ops[0] != phi && (ops[1] != phi || add->op == IrOp_SUB)) ||
+	    ir_inst(fn, k)->op != IrOp_CONST)
+		return 0;
+	i64 step = ir_inst(fn, k)->imm.k.i;
+	if (add->op == IrOp_SUB)
+		step = -step;
+	return step && step < SCALE_MAX && step > -SCALE_MAX ? (i32)step : 0;
+}
+
+static void find_ivs(struct Reduce *c)
+{
+	struct IrFunc *fn = c->fn;
+	ir_foreach_inst(fn, c->li->loops[c->l].header, v)
+	{
+		const struct IrInst *inst = ir_inst(fn, v);
+		if (inst->op != IrOp_PHI)
+			break;
+		IrValue init;
+		i32 step = inst->ty == IrType_I32 ? step_of(c, v, &init) : 0;
+		struct Info *in = info_of(c, v);
+		if (!step || !in)
+			continue;
+		*in = (struct Info){ .stamp = c->l, .state = State_AFFINE,
+				     .exact = true, .iv = v, .scale = 1,
+				     .step = step, .init = init };
+	}
+}
+
+/* Adds `b` times `k` to `a`, if both move with the same variable. */
+static bool combine(struct Info *a, const struct Info *b, i64 k)
+{
+	if (a->iv && b->iv && a->iv != b->iv)
+		return false;
+	if (b->iv)
+		a->iv = b->iv;
+	a->scale += b->scale * k;
+	a->exact &= b->exact;
+	return a->scale < SCALE_MAX && a->scale > -SCALE_MAX;
+}
+
+static const struct Info INVARIANT = { .state = State_AFFINE, .exact = true };
+
+/* `v` in terms of the loop's basic variables, or NULL. */
+static const struct Info *affine(struct Reduce *c, IrValue v)
+{
+	if (!in_loop(c, v))
+		return &INVARIANT;
+	struct Info *in = info_of(c, v);
+	if (!in || in->state != State_UNKNOWN)
+		return in && in->state == State_AFFINE ? in : NULL;
+	/* Cycles run through PHIs, which only basic variables pass. */
+	in->state = State_NOT;
+
+	struct IrFunc *fn = c->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	const IrValue *args = ir_args(fn, v);
+	struct Info r = { .exact = true };
+	const struct Info *a, *b;
+	switch (inst->op) {
+	case IrOp_ADD:
+	case IrOp_SUB:
+		if (inst->ty != IrType_I32 || !(a = affine(c, args[0])) ||
+		    !(b = affine(c, args[1])) || !combine(&r, a, 1) ||
+		    !combine(&r, b, inst->op == IrOp_ADD ? 1 : -1))
+			return NULL;
+		r.exact = !r.iv;
+		break;
+	case IrOp_MUL: {
+		bool rhs = ir_inst(fn, args[1])->op == IrOp_CONST;
+		const struct IrInst *k = ir_inst(fn, args[rhs ? 1 : 0]);
+		if (inst->ty != IrType_I32 || k->op != IrOp_CONST ||
+		    !(a = affine(c, args[rhs ? 0 : 1])) ||
+		    !combine(&r, a, k->imm.k.i))
+			return NULL;
+		r.exact = !r.iv;
+		break;
+	}
+	case IrOp_INDEX:
+		if (!(a = affine(c, args[0])) || !(b = affine(c, args[1])) ||
+		    !combine(&r, a, 1) ||
+		    !combine(&r, b, inst->imm.mem.size))
+			return NULL;
+		/* An index is exact only as the variable itself. */
+		if (b->iv && args[1] != b->iv)
+			r.exact = false;
+		break;
+	default:
+		return NULL;
+	}
+	/* Computed in the loop from invariants, as a preheader clone is. */
+	if (r.iv && !r.scale)
+		return NULL;
+	in->state = State_AFFINE;
+	in->iv = r.iv;
+	in->scale = r.scale;
+	in->exact = r.exact;
+	return in;
+}
+
+/*
+ * ==========================================================================
+ * 2. Strength Reduction
+ * ==========================================================================
+ */
+
+/* Recomputes affine `v` before `term` with `to` in place of `iv`. */
+static IrValue clone(struct Reduce *c, IrValue v, IrValue iv, IrValue to,
+		     IrValue term)
+{
+	if (v == iv)
+		return to;
+	if (!in_loop(c, v))
+		return v;
+	struct IrFunc *fn = c->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	IrOp op = (IrOp)inst->op;
+	IrType ty = (IrType)inst->ty;
+	u32 stride = inst->imm.mem.size;
+	IrValue a = clone(c, ir_args(fn, v)[0], iv, to, term);
+	IrValue b = clone(c, ir_args(fn, v)[1], iv, to, term);
+	struct IrBuilder bld = { .fn = fn, .block = ir_inst(fn, term)->block };
+	IrValue r = op == IrOp_INDEX ? ir_emit_index(&bld, a, b, stride)
+				     : ir_emit_binary(&bld, op, ty, a, b);
+	ir_move_before(fn, r, term);
+	return r;
+}
+
+/* `v` without INDEXes by a constant 0, which start values are full of. */
+static IrValue strip(const struct IrFunc *fn, IrValue v)
+{
+	while (ir_inst(fn, v)->op == IrOp_INDEX) {
+		const struct IrInst *k = ir_inst(fn, ir_args(fn, v)[1]);
+		if (k->op != IrOp_CONST || k->imm.k.i)
+			break;
+		v = ir_args(fn, v)[0];
+	}
+	return v;
+}
+
+/* Whether `a` and `b` compute the same value the same way. */
+static bool same(const struct Reduce *c, IrValue a, IrValue b)
+{
+	const struct IrFunc *fn = c->fn;
+	a = strip(fn, a);
+	b = strip(fn, b);
+	if (a == b)
+		return true;
+	const struct IrInst *x = ir_inst(fn, a), *y = ir_inst(fn, b);
+	if (x->op != y->op || x->ty != y->ty)
+		return false;
+	switch (x->op) {
+	case IrOp_CONST:
+		return x->ty == IrType_I32 && x->imm.k.i == y->imm.k.i;
+	case IrOp_GLOBAL:
+		return x->imm.index == y->imm.index;
+	case IrOp_INDEX:
+		if (x->imm.mem.size != y->imm.mem.size)
+			return false;
+		/* fallthrough */
+	case IrOp_ADD:
+	case IrOp_SUB:
+	case IrOp_MUL:
+		return same(c, ir_args(fn, a)[0], ir_args(fn, b)[0]) &&
+		       same(c, ir_args(fn, a)[1], ir_args(fn, b)[1]);
+	default:
+		return false;
+	}
+}
+
+/* The header's exit test on `iv`, if it can compare a pointer. */
+static IrValue exit_test(const struct Reduce *c, IrValue iv, i32 step)
+{
+	struct IrFunc *fn = c->fn;
+	u32 header = c->li->loops[c->l].header;
+	IrValue term = ir_terminator(fn, header);
+	if (!term || ir_inst(fn, term)->op != IrOp_CONDBR)
+		return IR_NONE;
+	IrValue cmp = ir_args(fn, term)[0];
+	const struct IrInst *inst = ir_inst(fn, cmp);
+	if (inst->block != header || inst->op < IrOp_LT || inst->op > IrOp_GE)
+		return IR_NONE;
+	const IrValue *args = ir_args(fn, cmp);
+	bool lhs = args[0] == iv;
+	IrValue bound = lhs ? args[1] : args[0];
+	if ((!lhs && args[1] != iv) || in_loop(c, bound))
+		return IR_NONE;
+
+	/*
+	 * As i < n, stepping by 1, with n on the right: i cannot wrap before
+	 * the test fails, so it matches the pointer one step for step. i <= n
+	 * could wrap only for n = INT_MAX.
+	 */
+	static const IrOp flip[] = { IrOp_GT, IrOp_GE, IrOp_LT, IrOp_LE };
+	IrOp op = (IrOp)inst->op;
+	if (!lhs)
+		op = flip[op - IrOp_LT];
+	bool up = op == IrOp_LT || op == IrOp_LE;
+	if (step != (up ? 1 : -1))
+		return IR_NONE;
+	if (op == IrOp_LE || op == IrOp_GE) {
+		const struct IrInst *n = ir_inst(fn, bound);
+		i32 limit = up ? INT32_MAX : INT32_MIN;
+		if (n->op != IrOp_CONST || n->imm.k.i == limit)
+			return IR_NONE;
+	}
+	return cmp;
+}
+
+/* Whether the bytes `a` moves per step fit the stride of an INDEX. */
+static bool fits_stride(const struct Reduce *c, const struct Info *a)
+{
+	i64 bytes = a->scale * c->info[a->iv].step;
+	return bytes <= (i64)UINT32_MAX && bytes >= -(i64)UINT32_MAX;
+}
+
+/* Gives `addr` a pointer PHI in the header, stepped on every latch. */
+static IrValue reduce(struct Reduce *c, IrValue addr, const struct Info *a)
+{
+	struct IrFunc *fn = c->fn;
+	const struct IrCfg *cfg = c->cfg;
+	const struct IrLoop *loop = &c->li->loops[c->l];
+	const struct Info *iv = &c->info[a->iv];
+	IrValue start = clone(c, addr, a->iv, iv->init,
+			      ir_terminator(fn, loop->preheader));
+
+	u32 begin = cfg->pred_start[loop->header];
+	u32 n = cfg->pred_start[loop->header + 1] - begin;
+	c->vals.len = 0;
+	for (u32 i = 0; i < n; ++i)
+		massert(vec_push(c->vals, start), "OOM loop-reduce");
+	struct IrBuilder b = { .fn = fn, .block = loop->header };
+	IrValue ptr = ir_emit_phi(&b, IrType_PTR, &cfg->preds[begin],
+				  c->vals.data, n);
+
+	/* A PHI's operands are (block, value) pairs. */
+	i64 bytes = a->scale * iv->step;
+	IrValue dir = ir_const_i32(fn, bytes < 0 ? -1 : 1);
+	u32 stride = (u32)(bytes < 0 ? -bytes : bytes);
+	for (u32 i = 0; i < n; ++i) {
+		b.block = cfg->preds[begin + i];
+		if (b.block == loop->preheader)
+			continue;
+		IrValue term = ir_terminator(fn, b.block);
+		IrValue next = ir_emit_index(&b, ptr, dir, stride);
+		ir_move_before(fn, next, term);
+		ir_args(fn, ptr)[2 * i + 1] = next;
+	}
+	return ptr;
+}
+
+/*
+ * Builds the test on `ptr`, the PHI of exact `addr`, right away: the
+ * address the bound gives is one the enclosing loops may reduce too. It
+ * is only used if the variable turns out to be needed for nothing else.
+ */
+static void note_test(struct Reduce *c, IrValue addr, IrValue ptr,
+		      const struct Info *a)
+{
+	for (u32 i = 0; i < vec_len(c->tests); ++i)
+		if (c->tests.data[i].iv == a->iv)
+			return;
+	IrValue cmp = exit_test(c, a->iv, c->info[a->iv].step);
+	if (!cmp)
+		return;
+
+	struct IrFunc *fn = c->fn;
+	const struct IrLoop *loop = &c->li->loops[c->l];
+	IrValue lhs = ir_args(fn, cmp)[0], rhs = ir_args(fn, cmp)[1];
+	IrValue bound = lhs == a->iv ? rhs : lhs;
+	IrValue end = clone(c, addr, a->iv, bound,
+			    ir_terminator(fn, loop->preheader));
+	struct ExitTest t = { a->iv, cmp, IR_NONE,
+			      ir_terminator(fn, loop->header) };
+	struct IrBuilder b = { .fn = fn, .block = loop->header };
+	t.test = ir_emit_binary(&b, (IrOp)ir_inst(fn, cmp)->op, IrType_I1,
+				lhs == a->iv ? ptr : end,
+				lhs == a->iv ? end : ptr);
+	ir_move_before(fn, t.test, t.branch);
+	massert(vec_push(c->tests, t), "OOM loop-reduce");
+}
+
+/*
+ * The addresses reduced are the affine INDEXes that are not just the
+ * base of another one: those are computed along the way.
+ */
+static void reduce_loop(struct Reduce *c)
+{
+	struct IrFunc *fn = c->fn;
+	const struct IrLoops *li = c->li;
+	const struct IrLoop *loop = &li->loops[c->l];
+	c->cands.len = 0;
+	for (u32 i = loop->begin; i < loop->end; ++i) {
+		ir_foreach_inst(fn, li->blocks[i], v)
+		{
+			const struct Info *a;
+			if (ir_inst(fn, v)->op != IrOp_INDEX ||
+			    !(a = affine(c, v)) || !a->iv || !fits_stride(c, a))
+				continue;
+			massert(vec_push(c->cands, v), "OOM loop-reduce");
+			struct Info *base = info_of(c, ir_args(fn, v)[0]);
+			if (base)
+				base->base = true;
+		}
+	}
+
+	u32 done = 0;
+	for (u32 i = 0; i < vec_len(c->cands); ++i) {
+		IrValue v = c->cands.data[i];
+		struct Info *a = &c->info[v];
+		if (a->base)
+			continue;
+		for (u32 j = 0; j < i && !a->repl; ++j) {
+			const struct Info *o = &c->info[c->cands.data[j]];
+			if (o->repl && o->iv == a->iv && o->scale == a->scale &&
+			    same(c, v, c->cands.data[j]))
+				a->repl = o->repl;
+		}
+		if (!a->repl && done < REDUCE_MAX) {
+			a->repl = reduce(c, v, a);
+			if (a->exact)
+				note_test(c, v, a->repl, a);
+			++done;
+		}
+	}
+	if (!done)
+		return;
+
+	/* Uses after the loop keep the original. */
+	for (u32 i = loop->begin; i < loop->end; ++i) {
+		ir_foreach_inst(fn, li->blocks[i], v)
+		{
+			IrValue *args = ir_args(fn, v);
+			ir_foreach_operand(fn, v, k)
+			{
+				IrValue x = args[k];
+				if (x < c->cap && c->info[x].stamp == c->l &&
+				    c->info[x].repl)
+					args[k] = c->info[x].repl;
+			}
+		}
+	}
+	c->changed = true;
+}
+
+/*
+ * ==========================================================================
+ * 3. Exit Tests
+ * ==========================================================================
+ * A variable is only kept for its test if, with the new tests in use and
+ * the variables left out of the old ones, nothing that has an effect
+ * reaches it.
+ */
+
+static void replace_tests(struct Reduce *c)
+{
+	struct IrFunc *fn = c->fn;
+	u32 n = (u32)vec_len(fn->insts);
+	/* live[v]; the worklist after it; the variable a test reads. */
+	usize bytes = 3 * (usize)n * sizeof(u32);
+	u32 *live = ir_grab(bytes);
+	u32 *work = live + n;
+	u32 *skip = work + n;
+	u32 top = 0;
+	for (u32 i = 0; i < vec_len(c->tests); ++i) {
+		const struct ExitTest *t = &c->tests.data[i];
+		skip[t->cmp] = t->iv;
+		live[t->test] = 1;
+		work[top++] = t->test;
+	}
+
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			if (!live[v] && ir_has_effect(fn, v)) {
+				live[v] = 1;
+				work[top++] = v;
+			}
+		}
+	}
+	while (top) {
+		IrValue v = work[--top];
+		const IrValue *args = ir_args(fn, v);
+		ir_foreach_operand(fn, v, i)
+		{
+			IrValue u = args[i];
+			if (!live[u] && u != skip[v] && ir_inst(fn, u)->block) {
+				live[u] = 1;
+				work[top++] = u;
+			}
+		}
+	}
+
+	for (u32 i = 0; i < vec_len(c->tests); ++i) {
+		const struct ExitTest *t = &c->tests.data[i];
+		if (!live[t->iv])
+			ir_args(fn, t->branch)[0] = t->test;
+	}
+	ir_drop(live, bytes);
+}
+
+IrAnalysisSet ir_loop_reduce(struct PassManager *pm)
+{
+	const struct IrLoops *li = pm_loops(pm);
+	if (!li->nloops)
+		return IR_PRESERVE_ALL;
+
+	struct Reduce c = {
+		.fn = pm->fn,
+		.cfg = pm_cfg(pm),
+		.li = li,
+	};
+	massert(vec_init(c.cands, allocer_system(), 32), "OOM loop-reduce");
+	massert(vec_init(c.vals, allocer_system(), 8), "OOM loop-reduce");
+	massert(vec_init(c.tests, allocer_system(), 8), "OOM loop-reduce");
+
+	/* Inner loops first: the start of a pointer in an inner loop is an
+	 * address in the enclosing one. */
+	for (u32 l = 1; l <= li->nloops; ++l) {
+		if (li->loops[l].preheader == IR_NONE)
+			continue;
+		fit_info(&c);
+		c.l = l;
+		find_ivs(&c);
+		reduce_loop(&c);
+	}
+	if (vec_len(c.tests))
+		replace_tests(&c);
+
+	vec_deinit(c.cands);
+	vec_deinit(c.vals);
+	vec_deinit(c.tests);
+	ir_drop(c.info, c.cap * sizeof(*c.info));
+	return c.changed ? IR_PRESERVE_CFG : IR_PRESERVE_ALL;
+}
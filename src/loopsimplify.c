@@ -0,0 +1,207 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <pass.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Splitting Edges
+ * ==========================================================================
+ */
+
+struct Splitter {
+	struct IrFunc *fn;
+	/* moved[bb] while bb's edges are being moved, touched[bb] once
+	 * they were this round; blocks made since the marks were sized are
+	 * neither. */
+	bool *moved;
+	bool *touched;
+	u32 nmoved;
+	IrU32Vec blocks;
+	IrU32Vec vals;
+};
+
+static bool is_moved(const struct Splitter *s, u32 bb)
+{
+	return bb < s->nmoved && s->moved[bb];
+}
+
+/* Retargets the PHI entries of `v` from moved blocks to `split`. */
+static void split_phi(struct Splitter *s, IrValue v, u32 split, u32 n)
+{
+	struct IrFunc *fn = s->fn;
+	IrValue *args = ir_args(fn, v);
+	u32 nargs = ir_inst(fn, v)->nargs;
+	if (n == 1) {
+		for (u32 i = 0; i < nargs; i += 2)
+			if (is_moved(s, args[i]))
+				args[i] = split;
+		return;
+	}
+
+	s->blocks.len = 0;
+	s->vals.len = 0;
+	for (u32 i = 0; i < nargs; i += 2) {
+		if (!is_moved(s, args[i]))
+			continue;
+		massert(vec_push(s->blocks, args[i]), "OOM loop-simplify");
+		massert(vec_push(s->vals, args[i + 1]), "OOM loop-simplify");
+	}
+	struct IrBuilder b = { .fn = fn, .block = split };
+	IrValue merged = ir_emit_phi(&b, (IrType)ir_inst(fn, v)->ty,
+				     s->blocks.data, s->vals.data,
+				     (u32)vec_len(s->blocks));
+
+	/* The pool may have moved. */
+	args = ir_args(fn, v);
+	u32 kept = 0;
+	for (u32 i = 0; i < nargs; i += 2) {
+		if (is_moved(s, args[i]))
+			continue;
+		args[kept++] = args[i];
+		args[kept++] = args[i + 1];
+	}
+	args[kept++] = split;
+	args[kept++] = merged;
+	ir_inst(fn, v)->nargs = kept;
+}
+
+/*
+ * Moves the edges from `preds[0 .. n)` to `bb` onto a new block that
+ * branches to `bb`. Each PHI of `bb` takes one value from the new block,
+ * merged there by a new PHI if the edges brought several.
+ */
+static u32 split_preds(struct Splitter *s, u32 bb, const u32 *preds, u32 n)
+{
+	struct IrFunc *fn = s->fn;
+	u32 split = ir_block_new(fn);
+	for (u32 i = 0; i < n; ++i) {
+		struct IrInst *term = ir_inst(fn, ir_terminator(fn, preds[i]));
+		for (u32 k = 0; k < 2; ++k)
+			if (term->imm.target[k] == bb)
+				term->imm.target[k] = split;
+		s->moved[preds[i]] = true;
+	}
+
+	IrValue v = fn->blocks.data[bb].first;
+	while (v && ir_inst(fn, v)->op == IrOp_PHI) {
+		IrValue next = ir_inst(fn, v)->next;
+		split_phi(s, v, split, n);
+		v = next;
+	}
+	struct IrBuilder b = { .fn = fn, .block = split };
+	ir_emit_br(&b, bb);
+
+	for (u32 i = 0; i < n; ++i)
+		s->moved[preds[i]] = false;
+	return split;
+}
+
+/*
+ * ==========================================================================
+ * 2. loop-simplify
+ * ==========================================================================
+ * Each round splits edges on a fresh analysis, and leaves a block whose
+ * edges it already changed for the next round: a header that needed a
+ * preheader may also be an exit, and an exit of an inner loop may also
+ * be one of the loop around it.
+ */
+
+/* Predecessors of `bb` that are reachable and, as `inside` says, in `l`. */
+static u32 preds_in(const struct IrCfg *cfg, const struct IrLoops *li, u32 l,
+		    u32 bb, bool inside, IrU32Vec *out)
+{
+	out->len = 0;
+	for (u32 p = cfg->pred_start[bb]; p < cfg->pred_start[bb + 1]; ++p) {
+		u32 pred = cfg->preds[p];
+		if (ir_cfg_reachable(cfg, pred) &&
+		    ir_loop_contains(li, l, pred) == inside)
+			massert(vec_push(*out, pred), "OOM loop-simplify");
+	}
+	return (u32)vec_len(*out);
+}
+
+static bool simplify_round(struct PassManager *pm, struct Splitter *s,
+			   IrU32Vec *preds)
+{
+	const struct IrCfg *cfg = pm_cfg(pm);
+	const struct IrLoops *li = pm_loops(pm);
+	bool *touched = s->touched;
+	bool changed = false;
+
+	for (u32 l = 1; l <= li->nloops; ++l) {
+		u32 h = li->loops[l].header;
+		if (li->loops[l].preheader)
+			continue;
+		/* An entry block header has no edge to move. */
+		u32 n = preds_in(cfg, li, l, h, false, preds);
+		if (!n)
+			continue;
+		split_preds(s, h, preds->data, n);
+		touched[h] = changed = true;
+	}
+
+	for (u32 l = 1; l <= li->nloops; ++l) {
+		const struct IrLoop *loop = &li->loops[l];
+		for (u32 e = loop->exit_begin; e < loop->exit_end; ++e) {
+			u32 exit = li->exits[e];
+			if (touched[exit] || !preds_in(cfg, li, l, exit, false,
+						       preds))
+				continue;
+			u32 n = preds_in(cfg, li, l, exit, true, preds);
+			split_preds(s, exit, preds->data, n);
+			touched[exit] = changed = true;
+		}
+	}
+	return changed;
+}
+
+IrAnalysisSet ir_loop_simplify(struct PassManager *pm)
+{
+	allocer_t sys = allocer_system();
+	struct Splitter s = { .fn = pm->fn };
+	IrU32Vec preds;
+	massert(vec_init(s.blocks, sys, 8), "OOM loop-simplify");
+	massert(vec_init(s.vals, sys, 8), "OOM loop-simplify");
+	massert(vec_init(preds, sys, 8), "OOM loop-simplify");
+
+	bool changed = false;
+	for (bool again = true; again;) {
+		/* Marks for moved edges, then for touched blocks. */
+		u32 n = (u32)vec_len(pm->fn->blocks);
+		usize bytes = 2 * (usize)n;
+		s.moved = allocer_alloc(sys, layout(bytes, 8));
+		massert(s.moved, "OOM loop-simplify");
+		memset(s.moved, 0, bytes);
+		s.touched = s.moved + n;
+		s.nmoved = n;
+
+		again = simplify_round(pm, &s, &preds);
+		allocer_free(sys, s.moved, layout(bytes, 8));
+		if (again)
+			pm_invalidate(pm, IR_PRESERVE_NONE);
+		changed |= again;
+	}
+
+	vec_deinit(s.blocks);
+	vec_deinit(s.vals);
+	vec_deinit(preds);
+	return changed ? IR_PRESERVE_NONE : IR_PRESERVE_ALL;
+}
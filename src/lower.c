@@ -0,0 +1,777 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <lower.h>
+#include <context.h>
+#include <sema.h>
+#include <prelude.h>
+#include <type.h>
+#include <trace.h>
+#include <std/map.h>
+#include <std/allocers/system.h>
+#include <core/msg.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Lowering State
+ * ==========================================================================
+ */
+
+typedef enum LowerVarKind {
+	/* `index` is the IrValue of its address: an ALLOCA or array PARAM. */
+	LowerVar_ADDR,
+	/* `index` is a global. */
+	LowerVar_GLOBAL,
+	/* A const scalar folded into `k`; it has no storage. */
+	LowerVar_CONST,
+} LowerVarKind;
+
+struct LowerVar {
+	LowerVarKind kind;
+	u32 index;
+	struct IrConst k;
+};
+
+struct LowerLoop {
+	u32 cont;
+	u32 brk;
+};
+
+static u64 _ptr_hash(const void *key)
+{
+	uintptr_t addr = (uintptr_t)*(const void *const *)key;
+	return (u64)addr * 0x9e3779b97f4a7c15ull;
+}
+
+static bool _ptr_eq(const void *lhs, const void *rhs)
+{
+	return *(const void *const *)lhs == *(const void *const *)rhs;
+}
+
+static const map_ops_t MAP_OPS_PTR = { .hash = _ptr_hash, .equals = _ptr_eq };
+
+static u64 _sym_hash(const void *key)
+{
+	return (u64)((const symbol_t *)key)->id * 2654435761u;
+}
+
+static bool _sym_eq(const void *lhs, const void *rhs)
+{
+	return ((const symbol_t *)lhs)->id == ((const symbol_t *)rhs)->id;
+}
+
+static const map_ops_t MAP_OPS_SYM = { .hash = _sym_hash, .equals = _sym_eq };
+
+defMap(const void *, struct LowerVar, LowerVarMap);
+defMap(symbol_t, u32, LowerFuncMap);
+defVec(struct LowerLoop, LowerLoopVec);
+defVec(struct Type *, LowerTypeVec);
+
+typedef struct Lower {
+	struct Context *ctx;
+	struct IrModule *m;
+	struct IrBuilder b;
+
+	/* Storage of every variable, keyed by its SemaSymbol. */
+	LowerVarMap vars;
+	/* Function index by name, and the AST type of each function. */
+	LowerFuncMap funcs;
+	LowerTypeVec func_types;
+
+	/* Enclosing loops, innermost last. */
+	LowerLoopVec loops;
+} Lower;
+
+static void error(Lower *L, const struct Node *n, const char *msg)
+{
+	ctx_error(L->ctx, n ? n->tok : NULL, "%s", msg);
+}
+
+static IrType ir_type_of(const struct Type *ty)
+{
+	switch (ty->kind) {
+	case TypeKind_BOOL:
+		return IrType_I1;
+	case TypeKind_INT:
+		return IrType_I32;
+	case TypeKind_FLOAT:
+		return IrType_F32;
+	case TypeKind_DOUBLE:
+		return IrType_F64;
+	case TypeKind_ARRAY:
+		return IrType_PTR;
+	default:
+		return IrType_VOID;
+	}
+}
+
+/* Innermost element type of an array, or `ty` itself. */
+static const struct Type *elem_of(const struct Type *ty)
+{
+	while (ty->kind == TypeKind_ARRAY)
+		ty = ty->data.array.base;
+	return ty;
+}
+
+/* Number of scalars in an object of type `ty`. */
+static u32 count_of(const struct Type *ty)
+{
+	return (u32)(ty->size / elem_of(ty)->size);
+}
+
+static const char *name_of(Lower *L, symbol_t name)
+{
+	return intern_resolve_cstr(&L->ctx->itn, name);
+}
+
+/* Later code is unreachable until something branches here. */
+static void start_dead_block(Lower *L)
+{
+	L->b.block = ir_block_new(L->b.fn);
+}
+
+/*
+ * ==========================================================================
+ * 2. Constants
+ * ==========================================================================
+ * Sema decides what is constant and folds it (sema_const_eval); this only
+ * puts its values into IR form.
+ */
+
+static struct IrConst ir_const_of(const struct SemaConst *k)
+{
+	struct IrConst c = { .ty = ir_type_of(k->ty) };
+	switch (c.ty) {
+	case IrType_I1:
+		c.b = k->b;
+		break;
+	case IrType_I32:
+		c.i = k->i;
+		break;
+	case IrType_F32:
+		c.f = k->f;
+		break;
+	default:
+		c.d = k->d;
+	}
+	return c;
+}
+
+static bool const_eval(const struct Node *n, struct IrConst *out)
+{
+	struct SemaConst k;
+	if (!sema_const_eval(n, &k))
+		return false;
+	*out = ir_const_of(&k);
+	return true;
+}
+
+/*
+ * ==========================================================================
+ * 3. Expressions
+ * ==========================================================================
+ */
+
+static IrValue lower_expr(Lower *L, struct Node *n);
+static void lower_cond(Lower *L, struct Node *n, u32 then_bb, u32 else_bb);
+
+/* The address of a variable or array element. */
+static IrValue lower_addr(Lower *L, struct Node *n)
+{
+	if (n->kind == ND_VAR) {
+		struct LowerVar *v =
+			map_get(L->vars, (const void *)((struct NodeVar *)n)->var);
+		if (v->kind == LowerVar_GLOBAL)
+			return ir_global_addr(L->b.fn, v->index);
+		return v->index;
+	}
+
+	struct NodeBinary *a = (struct NodeBinary *)n;
+	IrValue base = lower_addr(L, a->lhs);
+	IrValue index = lower_expr(L, a->rhs);
+	return ir_emit_index(&L->b, base, index, (u32)n->ty->size);
+}
+
+static IrValue lower_assign(Lower *L, struct NodeBinary *n)
+{
+	IrValue addr = lower_addr(L, n->lhs);
+	IrValue val = lower_expr(L, n->rhs);
+	ir_emit_store(&L->b, addr, val);
+	return val;
+}
+
+static IrValue lower_call(Lower *L, struct NodeCall *n)
+{
+	symbol_t name = intern_cstr(&L->ctx->itn, n->func_name);
+	u32 index = *map_get(L->funcs, name);
+	struct Type *fty = vec_at(L->func_types, index);
+	u32 nargs = (u32)vec_len(n->args);
+
+	struct ArenaMark mark = arena_mark(&L->ctx->scratch);
+	IrValue *args = arena_alloc(&L->ctx->scratch,
+				    layout((nargs + 1) * sizeof(IrValue), 4));
+	massert(args, "OOM lower");
+	for (u32 i = 0; i < nargs; ++i)
+		args[i] = lower_expr(L, vec_at(n->args, i));
+
+	IrValue v = ir_emit(&L->b, IrOp_CALL, ir_type_of(fty->data.func.ret),
+			    args, nargs);
+	ir_inst(L->b.fn, v)->imm.index = index;
+	arena_release(&L->ctx->scratch, mark);
+	return fty->data.func.ret == ty_void ? IR_NONE : v;
+}
+
+/* `&&` / `||` as a value: a PHI of the short-circuit constant and rhs. */
+static IrValue lower_logic(Lower *L, struct NodeBinary *n)
+{
+	struct IrFunc *fn = L->b.fn;
+	bool is_and = n->base.kind == ND_LOG_AND;
+
+	IrValue lhs = lower_expr(L, n->lhs);
+	u32 blocks[2] = { L->b.block };
+	u32 rhs_bb = ir_block_new(fn);
+	u32 end_bb = ir_block_new(fn);
+	if (is_and)
+		ir_emit_condbr(&L->b, lhs, rhs_bb, end_bb);
+	else
+		ir_emit_condbr(&L->b, lhs, end_bb, rhs_bb);
+
+	L->b.block = rhs_bb;
+	IrValue rhs = lower_expr(L, n->rhs);
+	blocks[1] = L->b.block;
+	ir_emit_br(&L->b, end_bb);
+
+	L->b.block = end_bb;
+	IrValue vals[2] = { ir_const_bool(fn, !is_and), rhs };
+	return ir_emit_phi(&L->b, IrType_I1, blocks, vals, 2);
+}
+
+static IrOp binary_op(NodeKind kind)
+{
+	switch (kind) {
+	case ND_ADD:
+		return IrOp_ADD;
+	case ND_SUB:
+		return IrOp_SUB;
+	case ND_MUL:
+		return IrOp_MUL;
+	case ND_DIV:
+		return IrOp_DIV;
+	case ND_MOD:
+		return IrOp_MOD;
+	case ND_EQ:
+		return IrOp_EQ;
+	case ND_NE:
+		return IrOp_NE;
+	case ND_LT:
+		return IrOp_LT;
+	case ND_LE:
+		return IrOp_LE;
+	case ND_GT:
+		return IrOp_GT;
+	default:
+		return IrOp_GE;
+	}
+}
+
+static IrValue lower_binary(Lower *L, struct NodeBinary *n)
+{
+	NodeKind kind = n->base.kind;
+	IrType operand = ir_type_of(n->lhs->ty);
+	bool is_cmp = kind >= ND_EQ && kind <= ND_GE;
+
+	IrValue lhs = lower_expr(L, n->lhs);
+	IrValue rhs = lower_expr(L, n->rhs);
+	return ir_emit_binary(&L->b, binary_op(kind),
+			      is_cmp ? IrType_I1 : operand, lhs, rhs);
+}
+
+static IrValue lower_expr(Lower *L, struct Node *n)
+{
+	struct IrFunc *fn = L->b.fn;
+	struct IrConst k;
+
+	switch (n->kind) {
+	case ND_LIT_INT:
+	case ND_LIT_FLOAT:
+	case ND_LIT_DOUBLE:
+	case ND_LIT_BOOL:
+		const_eval(n, &k);
+		return ir_const(fn, k);
+
+	case ND_VAR: {
+		struct LowerVar *v =
+			map_get(L->vars, (const void *)((struct NodeVar *)n)->var);
+		if (v->kind == LowerVar_CONST)
+			return ir_const(fn, v->k);
+		IrValue addr = lower_addr(L, n);
+		if (n->ty->kind == TypeKind_ARRAY)
+			return addr;
+		return ir_emit_load(&L->b, ir_type_of(n->ty), addr);
+	}
+
+	case ND_ARRAY_ACCESS: {
+		IrValue addr = lower_addr(L, n);
+		/* A partly indexed array decays to the address of its row. */
+		if (n->ty->kind == TypeKind_ARRAY)
+			return addr;
+		return ir_emit_load(&L->b, ir_type_of(n->ty), addr);
+	}
+
+	case ND_FUNC_CALL:
+		return lower_call(L, (struct NodeCall *)n);
+
+	case ND_NEG: {
+		IrValue v = lower_expr(L, ((struct NodeUnary *)n)->lhs);
+		return ir_emit(&L->b, IrOp_NEG, ir_type_of(n->ty), &v, 1);
+	}
+
+	case ND_LOG_NOT: {
+		IrValue v = lower_expr(L, ((struct NodeUnary *)n)->lhs);
+		return ir_emit(&L->b, IrOp_NOT, IrType_I1, &v, 1);
+	}
+
+	case ND_ADD:
+	case ND_SUB:
+	case ND_MUL:
+	case ND_DIV:
+	case ND_MOD:
+	case ND_EQ:
+	case ND_NE:
+	case ND_LT:
+	case ND_LE:
+	case ND_GT:
+	case ND_GE:
+		return lower_binary(L, (struct NodeBinary *)n);
+
+	case ND_LOG_AND:
+	case ND_LOG_OR:
+		return lower_logic(L, (struct NodeBinary *)n);
+
+	case ND_ASSIGN:
+		return lower_assign(L, (struct NodeBinary *)n);
+
+	default:
+		error(L, n, "Expression cannot be compiled");
+		return IR_NONE;
+	}
+}
+
+/* Branches on a bool expression; `&&`, `||` and `!` become control flow. */
+static void lower_cond(Lower *L, struct Node *n, u32 then_bb, u32 else_bb)
+{
+	switch (n->kind) {
+	case ND_LOG_AND:
+	case ND_LOG_OR: {
+		struct NodeBinary *b = (struct NodeBinary *)n;
+		u32 rhs_bb = ir_block_new(L->b.fn);
+		if (n->kind == ND_LOG_AND)
+			lower_cond(L, b->lhs, rhs_bb, else_bb);
+		else
+			lower_cond(L, b->lhs, then_bb, rhs_bb);
+		L->b.block = rhs_bb;
+		lower_cond(L, b->rhs, then_bb, else_bb);
+		return;
+	}
+	case ND_LOG_NOT:
+		lower_cond(L, ((struct NodeUnary *)n)->lhs, else_bb, then_bb);
+		return;
+	case ND_LIT_BOOL:
+		ir_emit_br(&L->b,
+			   ((struct NodeLitBool *)n)->val ? then_bb : else_bb);
+		return;
+	default:
+		break;
+	}
+
+	IrValue cond = lower_expr(L, n);
+	ir_emit_condbr(&L->b, cond, then_bb, else_bb);
+}
+
+/*
+ * ==========================================================================
+ * 4. Initializers
+ * ==========================================================================
+ * Lists are flattened in row-major order with C's brace elision: a
+ * scalar where a sub-array is expected starts filling that sub-array.
+ * Elements that are not mentioned stay zero.
+ */
+
+struct InitSink {
+	const struct Type *elem;
+	/* Globals: constant bytes. Locals: stores relative to `base`. */
+	u8 *bytes;
+	IrValue base;
+};
+
+static void init_scalar(Lower *L, struct InitSink *s, struct Node *n, u32 pos)
+{
+	if (n->kind == ND_INIT_LIST)
+		n = vec_at(((struct NodeInitList *)n)->inits, 0);
+
+	u32 size = (u32)s->elem->size;
+	if (s->bytes) {
+		struct IrConst k;
+		const_eval(n, &k);
+		/* Every member of the union starts at the same address. */
+		memcpy(s->bytes + (usize)pos * size, &k.i, size);
+		return;
+	}
+
+	IrValue v = lower_expr(L, n);
+	IrValue at = s->base;
+	if (pos)
+		at = ir_emit_index(&L->b, at, ir_const_i32(L->b.fn, (i32)pos),
+				   size);
+	ir_emit_store(&L->b, at, v);
+}
+
+static void init_braced(Lower *L, const struct Type *ty,
+			struct NodeInitList *list, u32 pos, struct InitSink *s);
+
+/* Fills the array `ty` at element `pos` from items[*i ..]. */
+static void init_fill(Lower *L, const struct Type *ty, NodeVec items,
+		      usize *i, u32 pos, struct InitSink *s)
+{
+	const struct Type *et = ty->data.array.base;
+	/* Not count_of(): that walks every dimension below, at every level. */
+	u32 per = (u32)(et->size / s->elem->size);
+
+	for (int k = 0; k < ty->data.array.len && *i < vec_len(items); ++k) {
+		struct Node *item = vec_at(items, *i);
+		u32 at = pos + (u32)k * per;
+
+		if (et->kind != TypeKind_ARRAY) {
+			(*i)++;
+			init_scalar(L, s, item, at);
+		} else if (item->kind == ND_INIT_LIST) {
+			(*i)++;
+			init_braced(L, et, (struct NodeInitList *)item, at, s);
+		} else {
+			init_fill(L, et, items, i, at, s);
+		}
+	}
+}
+
+static void init_braced(Lower *L, const struct Type *ty,
+			struct NodeInitList *list, u32 pos, struct InitSink *s)
+{
+	usize i = 0;
+	init_fill(L, ty, list->inits, &i, pos, s);
+}
+
+static void lower_init(Lower *L, const struct Type *ty, struct Node *init,
+		       struct InitSink *s)
+{
+	if (ty->kind != TypeKind_ARRAY)
+		init_scalar(L, s, init, 0);
+	else
+		init_braced(L, ty, (struct NodeInitList *)init, 0, s);
+}
+
+/*
+ * ==========================================================================
+ * 5. Statements
+ * ==========================================================================
+ */
+
+static void lower_stmt(Lower *L, struct Node *n);
+
+/* A home for `sym`, listed among the function's locals. */
+static IrValue local_alloca(struct IrFunc *fn, struct SemaSymbol *sym,
+			    u32 size)
+{
+	IrValue addr = ir_alloca(fn, size, (u32)sym->ty->align);
+	struct IrLocal local = { .sym = sym, .addr = addr };
+	massert(vec_push(fn->locals, local), "OOM lower");
+	return addr;
+}
+
+static void lower_local(Lower *L, struct NodeVarDecl *n)
+{
+	struct SemaSymbol *sym = n->var;
+	struct Type *ty = sym->ty;
+	struct LowerVar var = { .kind = LowerVar_ADDR };
+
+	if (sym->has_value) {
+		var.kind = LowerVar_CONST;
+		var.k = ir_const_of(&sym->value);
+		massert(map_put(L->vars, (const void *)sym, var), "OOM lower");
+		return;
+	}
+
+	const struct Type *elem = elem_of(ty);
+	u32 size = ty->size > 0 ? (u32)ty->size : (u32)elem->size;
+	var.index = local_alloca(L->b.fn, sym, size);
+	massert(map_put(L->vars, (const void *)sym, var), "OOM lower");
+	if (!n->init)
+		return;
+
+	if (ty->kind == TypeKind_ARRAY && n->init->kind == ND_INIT_LIST) {
+		IrValue zero = ir_emit(&L->b, IrOp_ZERO, IrType_VOID,
+				       &var.index, 1);
+		ir_inst(L->b.fn, zero)->imm.mem.size = size;
+	}
+	struct InitSink sink = { .elem = elem, .base = var.index };
+	lower_init(L, ty, n->init, &sink);
+}
+
+static void lower_if(Lower *L, struct NodeIf *n)
+{
+	struct IrFunc *fn = L->b.fn;
+	u32 then_bb = ir_block_new(fn);
+	u32 else_bb = n->else_branch ? ir_block_new(fn) : IR_NONE;
+	u32 end_bb = ir_block_new(fn);
+
+	lower_cond(L, n->cond, then_bb, else_bb ? else_bb : end_bb);
+
+	L->b.block = then_bb;
+	lower_stmt(L, n->then_branch);
+	ir_emit_br(&L->b, end_bb);
+
+	if (else_bb) {
+		L->b.block = else_bb;
+		lower_stmt(L, n->else_branch);
+		ir_emit_br(&L->b, end_bb);
+	}
+	L->b.block = end_bb;
+}
+
+static void lower_while(Lower *L, struct NodeWhile *n)
+{
+	struct IrFunc *fn = L->b.fn;
+	u32 cond_bb = ir_block_new(fn);
+	u32 body_bb = ir_block_new(fn);
+	u32 end_bb = ir_block_new(fn);
+
+	ir_emit_br(&L->b, cond_bb);
+	L->b.block = cond_bb;
+	lower_cond(L, n->cond, body_bb, end_bb);
+
+	struct LowerLoop loop = { .cont = cond_bb, .brk = end_bb };
+	massert(vec_push(L->loops, loop), "OOM lower");
+	L->b.block = body_bb;
+	lower_stmt(L, n->body);
+	ir_emit_br(&L->b, cond_bb);
+	L->loops.len--;
+
+	L->b.block = end_bb;
+}
+
+static void lower_return(Lower *L, struct NodeUnary *n)
+{
+	IrValue v = n->lhs ? lower_expr(L, n->lhs) : IR_NONE;
+	ir_emit_ret(&L->b, L->b.fn->ret == IrType_VOID ? IR_NONE : v);
+	start_dead_block(L);
+}
+
+static void lower_jump(Lower *L, struct Node *n)
+{
+	struct LowerLoop loop = vec_at(L->loops, vec_len(L->loops) - 1);
+	ir_emit_br(&L->b, n->kind == ND_BREAK ? loop.brk : loop.cont);
+	start_dead_block(L);
+}
+
+static void lower_stmt(Lower *L, struct Node *n)
+{
+	if (!n)
+		return;
+
+	switch (n->kind) {
+	case ND_BLOCK:
+		vec_foreach(s, ((struct NodeBlock *)n)->stmts)
+		{
+			lower_stmt(L, *s);
+		}
+		break;
+	case ND_VAR_DECL:
+		lower_local(L, (struct NodeVarDecl *)n);
+		break;
+	case ND_IF:
+		lower_if(L, (struct NodeIf *)n);
+		break;
+	case ND_WHILE:
+		lower_while(L, (struct NodeWhile *)n);
+		break;
+	case ND_RETURN:
+		lower_return(L, (struct NodeUnary *)n);
+		break;
+	case ND_BREAK:
+	case ND_CONTINUE:
+		lower_jump(L, n);
+		break;
+	case ND_EXPR_STMT:
+		if (((struct NodeUnary *)n)->lhs)
+			lower_expr(L, ((struct NodeUnary *)n)->lhs);
+		break;
+	default:
+		lower_expr(L, n);
+	}
+}
+
+/*
+ * ==========================================================================
+ * 6. Top Level
+ * ==========================================================================
+ */
+
+static u32 declare_func(Lower *L, symbol_t name, struct Type *fty,
+			bool is_extern)
+{
+	u32 index = ir_func_new(L->m, name_of(L, name),
+				ir_type_of(fty->data.func.ret), is_extern);
+	struct IrFunc *fn = &L->m->funcs.data[index];
+	vec_foreach(pt, fty->data.func.params)
+	{
+		ir_param_new(fn, ir_type_of(*pt));
+	}
+	massert(map_put(L->funcs, name, index), "OOM lower");
+	massert(vec_push(L->func_types, fty), "OOM lower");
+	return index;
+}
+
+static void declare_builtins(Lower *L)
+{
+	allocer_t alc = arena_allocer(&L->m->arena);
+#define DECLARE_BUILTIN(NAME, RET, PARAM)                                   \
+	{                                                                   \
+		struct Type *fty = type_func_new(alc, ty_##RET);            \
+		if (ty_##PARAM != ty_void)                                  \
+			massert(vec_push(fty->data.func.params, ty_##PARAM), \
+				"OOM lower");                               \
+		declare_func(L, PRELUDE_BUILTIN_SYM(PreludeBuiltin_##NAME), \
+			     fty, true);                                    \
+	}
+	PRELUDE_BUILTINS(DECLARE_BUILTIN)
+#undef DECLARE_BUILTIN
+}
+
+static void lower_global(Lower *L, struct NodeVarDecl *n)
+{
+	struct SemaSymbol *sym = n->var;
+	struct Type *ty = sym->ty;
+	const struct Type *elem = elem_of(ty);
+	u32 count = count_of(ty);
+
+	u32 g = ir_global_new(L->m, name_of(L, sym->name), ir_type_of(elem),
+			      count, sym->is_const);
+	struct LowerVar var = { .kind = LowerVar_GLOBAL, .index = g };
+
+	if (n->init) {
+		usize bytes = (usize)count * (usize)elem->size;
+		u8 *init = arena_alloc(&L->m->arena, layout(bytes, 8));
+		massert(init, "OOM lower");
+		memset(init, 0, bytes);
+
+		struct InitSink sink = { .elem = elem, .bytes = init };
+		lower_init(L, ty, n->init, &sink);
+		for (usize i = 0; i < bytes; ++i) {
+			if (init[i]) {
+				L->m->globals.data[g].init = init;
+				break;
+			}
+		}
+
+		/* Const scalars are folded; the global stays for reference. */
+		if (sym->has_value) {
+			var.kind = LowerVar_CONST;
+			var.k = ir_const_of(&sym->value);
+		}
+	}
+	massert(map_put(L->vars, (const void *)sym, var), "OOM lower");
+}
+
+static void lower_func(Lower *L, struct NodeFunc *n)
+{
+	TRACE_SCOPE_ARG("lower_func", name_of(L, n->sym->name));
+	u32 index = *map_get(L->funcs, n->sym->name);
+	struct IrFunc *fn = &L->m->funcs.data[index];
+	L->b = (struct IrBuilder){ .fn = fn, .block = ir_block_new(fn) };
+
+	for (u32 i = 0; i < vec_len(n->params); ++i) {
+		struct SemaSymbol *sym = vec_at(n->params, i);
+		IrValue param = vec_at(fn->params, i);
+		struct LowerVar var = { .kind = LowerVar_ADDR, .index = param };
+
+		/* Arrays are passed by address; scalars get a home. */
+		if (sym->ty->kind != TypeKind_ARRAY) {
+			var.index = local_alloca(fn, sym, (u32)sym->ty->size);
+			ir_emit_store(&L->b, var.index, param);
+		}
+		massert(map_put(L->vars, (const void *)sym, var), "OOM lower");
+	}
+
+	lower_stmt(L, n->body);
+
+	/* Falling off the end returns zero. */
+	if (!ir_terminator(fn, L->b.block)) {
+		IrValue zero = IR_NONE;
+		if (fn->ret != IrType_VOID)
+			zero = ir_const(fn, (struct IrConst){ .ty = fn->ret });
+		ir_emit_ret(&L->b, zero);
+	}
+	ir_remove_unreachable(fn);
+}
+
+bool ir_lower(struct IrModule *m, struct Context *ctx, NodeVec globals)
+{
+	TRACE_SCOPE("ir_lower");
+	allocer_t sys = allocer_system();
+	Lower L = { .ctx = ctx, .m = m };
+	massert(map_init(L.vars, sys, MAP_OPS_PTR), "OOM lower");
+	massert(map_init(L.funcs, sys, MAP_OPS_SYM), "OOM lower");
+	massert(vec_init(L.func_types, sys, 64), "OOM lower");
+	massert(vec_init(L.loops, sys, 16), "OOM lower");
+
+	/* Every function exists before any body refers to it; the function
+	 * vector does not move after this. */
+	declare_builtins(&L);
+	vec_foreach(item, globals)
+	{
+		struct Node *n = *item;
+		if (n && n->kind == ND_FUNC) {
+			struct NodeFunc *f = (struct NodeFunc *)n;
+			declare_func(&L, f->sym->name, f->sym->ty, false);
+		}
+	}
+
+	vec_foreach(item, globals)
+	{
+		struct Node *n = *item;
+		if (!n)
+			continue;
+		if (n->kind == ND_FUNC) {
+			lower_func(&L, (struct NodeFunc *)n);
+		} else if (n->kind == ND_BLOCK) {
+			vec_foreach(d, ((struct NodeBlock *)n)->stmts)
+			{
+				if ((*d)->kind == ND_VAR_DECL)
+					lower_global(&L,
+						     (struct NodeVarDecl *)*d);
+			}
+		} else if (n->kind == ND_VAR_DECL) {
+			lower_global(&L, (struct NodeVarDecl *)n);
+		}
+	}
+
+	vec_deinit(L.loops);
+	vec_deinit(L.func_types);
+	map_deinit(L.funcs);
+	map_deinit(L.vars);
+	return !ctx->had_error;
+}
@@ -24,6 +24,28 @@
 #include <lexer.h>
 #include <parser.h>
 #include <ast.h>
+#include <cache.h>
+#include <astfile.h>
+#include <ir.h>
+#include <lower.h>
+#include <pass.h>
+#include <vm.h>
+#include <native.h>
+#include <cgen.h>
+#include <incr.h>
+#include <stats.h>
+#include <trace.h>
+#include <vmem.h>
+#include <stream.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 /*
  * ==========================================================================
@@ -31,40 +53,256 @@
  * ==========================================================================
  */
 
-#define CACTC_VERSION "0.1.0"
+/* Default upper bound for the on-disk cache directory. */
+#define CACHE_DEFAULT_MAX_MB 256
+
+/* Events kept per thread by --trace; older ones are overwritten. */
+#define TRACE_BUFFER_EVENTS (1u << 20)
+
+/* Read size for stdin and pipes, which are compiled as they arrive. */
+#define STREAM_CHUNK_SIZE ((usize)64 << 10)
+
+/* Streamed input has no size up front; reserve address space as if it
+ * were this big. Only the reservation grows, not what is committed. */
+#define STREAM_ASSUMED_INPUT ((u64)16 << 20)
 
 static const char *USAGE_INFO =
 	"cactc - The CACT Compiler\n"
 	"\n"
 	"Usage:\n"
 	"    cactc [options] <file>\n"
+	"    cactc [options] -         (read the program from stdin)\n"
 	"\n"
 	"Options:\n"
-	"    -o <file>      Output file (default: a.out)\n"
-	"    -h, --help     Show this help message\n"
+	"    -o <file>            Compile to an x86-64 executable, linked with\n"
+	"                         the runtime by the system C compiler (cc)\n"
+	"    -S                   Write x86-64 assembly instead (to -o, or to\n"
+	"                         stdout)\n"
+	"    -c                   Write an ELF object file instead (to -o)\n"
+	"    --emit=c             Write the program as C instead (to -o, or to\n"
+	"                         stdout), to build against cactrt.h\n"
+	"    -O<level>            Optimize the IR: 0 (default), 1 (cleanups) or\n"
+	"                         2 (everything); -O is -O1\n"
+	"    --print-after=<pass> Print each function's IR to stderr after every\n"
+	"                         run of <pass>, or of any pass for 'all'\n"
+	"    -fverify-each        Verify the IR after every optimization pass\n"
+	"    -finline-limit=<n>   Largest cost, about instructions added, of a\n"
+	"                         call -O2 inlines, up to 20000; 0 inlines none\n"
+	"                         (default: 40)\n"
+	"    -fopt-info           Report what the inliner did and did not do\n"
+	"    --cache-dir=<dir>    Reuse results of identical compilations\n"
+	"                         (also: $CACTC_CACHE_DIR)\n"
+	"    --cache-size=<MiB>   Cache size bound, LRU evicted (default: 256)\n"
+	"    --emit-ast=<file>    Save the checked AST in binary form\n"
+	"    --emit-ir=<file>     Write the SSA IR as text ('-': stdout)\n"
+	"    --load-ast=<file>    Map and verify a saved AST instead of compiling\n"
+	"    --run                Execute the program in the bytecode VM; its\n"
+	"                         output goes to stdout, compiler messages to\n"
+	"                         stderr, and main's result is the exit status\n"
+	"    --jit=<mode>         How --run uses the x86-64 JIT: off, tiered\n"
+	"                         (default: hot functions and loops) or eager\n"
+	"    --serve              Compile <file>, then apply edits read from\n"
+	"                         stdin incrementally (see below)\n"
+	"    -ftime-report        Print wall/CPU time per compiler phase\n"
+	"    -fmem-report         Print allocation and object statistics\n"
+	"    --stats-json=<file>  Write both reports as JSON ('-': stdout)\n"
+	"    --trace=<file>       Write a Chrome trace of compiler internals\n"
+	"    --arena=<kind>       Arena backing: mmap (default, reserved from\n"
+	"                         the input size, transparent huge pages),\n"
+	"                         hugetlb (explicit huge pages) or malloc\n"
+	"    -fmax-nesting=<n>    Maximum statement/block nesting (default: 1024)\n"
+	"    -fmax-expr-depth=<n> Maximum expression, initializer and array\n"
+	"                         type depth (default: 4096)\n"
+	"    -h, --help           Show this help message\n"
+	"\n"
+	"Serve protocol (one command per line):\n"
+	"    edit <start> <end> <n>   followed by n bytes replacing [start, end)\n"
+	"    dump                     print the top-level node summary\n"
+	"    quit\n"
 	"\n";
 
+struct Options {
+	const char *input_file;
+	const char *cache_dir;
+	u64 cache_max_bytes;
+	const char *emit_ast;
+	const char *emit_ir;
+	const char *load_ast;
+	const char *output;
+	bool emit_asm;
+	bool emit_obj;
+	bool emit_c;
+	u32 opt_level;
+	const char *print_after;
+	bool verify_each;
+	u32 inline_limit;
+	bool opt_info;
+	bool run;
+	VmJit jit;
+	bool serve;
+	bool time_report;
+	bool mem_report;
+	const char *stats_json;
+	const char *trace;
+	bool arena_mmap;
+	VMemPages arena_pages;
+	u32 max_nesting;
+	u32 max_expr_depth;
+
+	int argc;
+	char **argv;
+};
+
+static bool is_cache_flag(const char *arg)
+{
+	return strncmp(arg, "--cache-", 8) == 0;
+}
+
+static bool wants_stats(const struct Options *opts)
+{
+	return opts->time_report || opts->mem_report || opts->stats_json;
+}
+
+/* Runs that measure themselves must not be answered from the cache. */
+static bool is_instrumented(const struct Options *opts)
+{
+	return wants_stats(opts) || opts->trace;
+}
+
 /*
  * ==========================================================================
  * Compiler Pipeline
  * ==========================================================================
  */
 
-static bool run_compile(struct Context *ctx, const char *filepath)
+static void print_summary(FILE *out, NodeVec globals)
 {
-	string_t content;
-	if (!string_init(&content, ctx->alc, 0)) {
-		log_error("OOM reading file");
+	fprintf(out, "[INFO] Parsed %zu top-level nodes.\n", vec_len(globals));
+	vec_foreach(node_ptr, globals)
+	{
+		struct Node *n = *node_ptr;
+		fprintf(out, "  - Node Kind: %d\n", n->kind);
+	}
+}
+
+/*
+ * Compiler messages go to stdout, unless it belongs to the program
+ * (--run) or carries the compiled code (-S or --emit=c without -o).
+ */
+static FILE *report_stream(const struct Options *opts)
+{
+	bool code = (opts->emit_asm || opts->emit_c) && !opts->output;
+	return opts->run || code ? stderr : stdout;
+}
+
+/* What `main` returned under --run; the process exits with it. */
+static i32 program_status;
+
+/* `-` is the compiler's own output, so cached runs replay it too. */
+static bool write_ir(const char *path, const struct IrModule *m, FILE *out)
+{
+	if (strcmp(path, "-") == 0) {
+		ir_print_module(out, m);
+		return true;
+	}
+
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		log_error("Could not write IR to '%s'", path);
 		return false;
 	}
+	ir_print_module(f, m);
+	return fclose(f) == 0;
+}
 
-	if (!file_read_to_string(filepath, &content)) {
-		log_error("Could not read file '%s'", filepath);
+/* Everything after parsing, shared by file and streamed input. */
+static bool finish_compile(struct Context *ctx, const struct Options *opts,
+			   NodeVec globals, FILE *out)
+{
+	if (ctx->had_error) {
 		return false;
 	}
 
-	usize file_id = srcmanager_add(&ctx->mgr, str_from_cstr(filepath),
-				       string_as_str(&content));
+	stats_push(StatsPhase_LOWER);
+	struct IrModule m;
+	ir_module_init(&m);
+	bool ok = ir_lower(&m, ctx, globals);
+	if (ok && !ir_verify_module(&m, ctx->diag)) {
+		log_error("Internal error: lowering produced invalid IR");
+		ok = false;
+	}
+	stats_pop();
+
+	if (ok && opts->opt_level) {
+		stats_push(StatsPhase_OPT);
+		struct IrOptOptions opt = {
+			.level = opts->opt_level,
+			.print_after = opts->print_after,
+			.dump = stderr,
+			.verify_each = opts->verify_each,
+			.err = ctx->diag,
+			.inline_limit = opts->inline_limit,
+			.remarks = opts->opt_info ? ctx->diag : NULL,
+		};
+		ok = ir_optimize(&m, &opt);
+		if (ok && !ir_verify_module(&m, ctx->diag)) {
+			log_error("Internal error: optimization produced "
+				  "invalid IR");
+			ok = false;
+		}
+		stats_pop();
+	}
+	if (!ok) {
+		ir_module_deinit(&m);
+		return false;
+	}
+
+	stats_push(StatsPhase_EMIT);
+	print_summary(out, globals);
+
+	if (opts->emit_ir) {
+		ok = write_ir(opts->emit_ir, &m, out);
+	}
+	/* Before --emit-ast, which then records the locals' frame offsets. */
+	if (ok && opts->emit_c) {
+		ok = cgen_write(opts->output ? opts->output : "-", ctx, globals,
+				&m);
+	} else if (ok && (opts->output || opts->emit_asm)) {
+		NativeKind kind = opts->emit_asm   ? NativeKind_ASM
+				  : opts->emit_obj ? NativeKind_OBJ
+						   : NativeKind_EXE;
+		ok = native_write(&m, opts->output ? opts->output : "-", kind);
+	}
+	if (ok && opts->emit_ast) {
+		ok = astfile_write(opts->emit_ast, ctx, globals);
+	}
+
+	struct VmProgram prog = { 0 };
+	if (ok && opts->run && !vm_compile(&prog, &m)) {
+		log_error("--run: the program has no 'main' function");
+		ok = false;
+	}
+	stats_pop();
+
+	/* The program keeps pointing at the module's function names. */
+	if (ok && opts->run) {
+		stats_push(StatsPhase_RUN);
+		ok = vm_run(&prog, &m, opts->jit, &program_status, ctx->diag);
+		stats_pop();
+	}
+	if (opts->run)
+		vm_program_deinit(&prog);
+	ir_module_deinit(&m);
+	return ok;
+}
+
+static bool compile_source(struct Context *ctx, const struct Options *opts,
+			   str_t source, FILE *out)
+{
+	TRACE_SCOPE_ARG("compile", opts->input_file);
+	const char *filepath = opts->input_file;
+	usize file_id =
+		srcmanager_add(&ctx->mgr, str_from_cstr(filepath), source);
 
 	struct Lexer lex;
 	lexer_init(&lex, ctx, file_id);
@@ -72,29 +310,423 @@ static bool run_compile(struct Context *ctx, const char *filepath)
 	struct Parser p;
 	parser_init(&p, ctx, &lex);
 
-	printf("[INFO] Compiling '%s'...\n", filepath);
+	fprintf(out, "[INFO] Compiling '%s'...\n", filepath);
+	stats_push(StatsPhase_PARSE);
 	NodeVec globals = parser_parse(&p);
+	stats_pop();
 
-	if (ctx->had_error) {
+	return finish_compile(ctx, opts, globals, out);
+}
+
+/* stdin, pipes and FIFOs cannot be sized or re-read, so they are streamed. */
+static bool is_stream_input(const char *path)
+{
+	struct stat st;
+	if (strcmp(path, "-") == 0)
+		return true;
+	return stat(path, &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+/**
+ * @brief Compile input as it arrives: every top-level item is parsed and
+ * checked as soon as it is complete, then the text before it is released.
+ * * Memory for source text is bounded by the largest item plus a chunk,
+ * not by the input size.
+ */
+static bool run_stream(struct Context *ctx, const struct Options *opts)
+{
+	bool is_stdin = strcmp(opts->input_file, "-") == 0;
+	const char *name = is_stdin ? "<stdin>" : opts->input_file;
+	TRACE_SCOPE_ARG("compile", name);
+
+	int fd = is_stdin ? STDIN_FILENO : open(opts->input_file, O_RDONLY);
+	if (fd < 0) {
+		log_error("Could not read file '%s'", opts->input_file);
 		return false;
 	}
 
-	printf("[INFO] Parsed %zu top-level nodes.\n", vec_len(globals));
-	vec_foreach(node_ptr, globals)
-	{
-		struct Node *n = *node_ptr;
-		printf("  - Node Kind: %d\n", n->kind);
+	struct Stream s;
+	stream_init(&s, allocer_system(), fd, name, STREAM_CHUNK_SIZE);
+
+	usize file_id = srcmanager_add(&ctx->mgr, str_from_cstr(name),
+				       str_from_parts("", 0));
+	s.file_base = srcmanager_get_file(&ctx->mgr, file_id)->base_offset;
+	ctx->stream = &s;
+
+	struct Lexer lex;
+	lexer_init_stream(&lex, ctx, file_id, &s);
+
+	struct Parser p;
+	parser_init(&p, ctx, &lex);
+
+	NodeVec globals;
+	massert(vec_init(globals, ctx->alc, 16), "OOM globals");
+
+	FILE *out = report_stream(opts);
+	fprintf(out, "[INFO] Compiling '%s'...\n", name);
+	stats_push(StatsPhase_PARSE);
+	parser_begin_unit(&p);
+	struct Node *n;
+	while ((n = parser_parse_item(&p)) != NULL) {
+		vec_push(globals, n);
+		/* Keep the last token: the next diagnostic may point at it. */
+		lexer_release(&lex, p.prev.span.start);
+	}
+	parser_end_unit(&p);
+	stats_pop();
+
+	bool ok = finish_compile(ctx, opts, globals, out);
+
+	compile_stats.stream_read = s.read;
+	compile_stats.stream_peak = s.peak;
+	ctx->stream = NULL;
+	stream_deinit(&s);
+	if (!is_stdin)
+		close(fd);
+	return ok;
+}
+
+static bool run_load_ast(const char *path)
+{
+	struct AstFile f;
+	const char *err = NULL;
+	if (!astfile_map(&f, path, &err)) {
+		log_error("Invalid AST file '%s': %s", path, err);
+		return false;
 	}
 
+	u32 nroots = astfile_list_len(&f, f.hdr->roots);
+	const u32 *roots = astfile_list(&f, f.hdr->roots);
+
+	printf("[INFO] Loaded '%s' (%llu nodes, %llu symbols).\n", path,
+	       (unsigned long long)f.hdr->nodes.count,
+	       (unsigned long long)f.hdr->symbols.count);
+	printf("[INFO] Parsed %u top-level nodes.\n", nroots);
+	for (u32 i = 0; i < nroots; ++i) {
+		printf("  - Node Kind: %u\n", f.nodes[roots[i]].kind);
+	}
+
+	astfile_unmap(&f);
 	return true;
 }
 
+/* The compile writes code: -o, -S, -c or --emit=c. */
+static bool writes_code(const struct Options *opts)
+{
+	return opts->output || opts->emit_asm || opts->emit_c;
+}
+
+/* The code is an executable linked with the runtime. */
+static bool links(const struct Options *opts)
+{
+	return opts->output && !opts->emit_asm && !opts->emit_obj &&
+	       !opts->emit_c;
+}
+
+/*
+ * The binary stands for the compiler version: any rebuild that changes
+ * what it does also changes its bytes. Linked executables also depend on
+ * the runtime library.
+ */
+static bool compile_cache_key(const struct Options *opts, str_t source,
+			      struct CacheKey *key)
+{
+	*key = (struct CacheKey){ 0 };
+	if (!cache_key_feed_file(key, "/proc/self/exe"))
+		return false;
+	for (int i = 1; i < opts->argc; ++i) {
+		const char *arg = opts->argv[i];
+		if (arg[0] == '-' && !is_cache_flag(arg))
+			cache_key_feed(key, str_from_cstr(arg));
+	}
+	cache_key_feed(key, str_from_cstr(opts->input_file));
+	cache_key_feed(key, source);
+
+	char runtime[PATH_MAX + 32];
+	if (links(opts) && native_runtime(runtime, sizeof(runtime)))
+		return cache_key_feed_file(key, runtime);
+	return true;
+}
+
+/* Writes cached code where the compile would have: -o, else stdout. */
+static bool put_code(const struct Options *opts, str_t code)
+{
+	if (!opts->output) {
+		fwrite(code.ptr, 1, code.len, stdout);
+		return true;
+	}
+
+	int fd = open(opts->output, O_WRONLY | O_CREAT | O_TRUNC,
+		      links(opts) ? 0777 : 0666);
+	FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+	if (!f) {
+		if (fd >= 0)
+			close(fd);
+		log_error("Could not write '%s'", opts->output);
+		return false;
+	}
+	bool ok = fwrite(code.ptr, 1, code.len, f) == code.len;
+	return fclose(f) == 0 && ok;
+}
+
+/**
+ * @brief Compile with stdout/stderr captured so the result can be stored.
+ * * A hit replays the stored diagnostics and output byte-for-byte without
+ * lexing, parsing or checking anything. Code goes to a file in the cache
+ * directory first, so it can be stored with the rest. Failed compiles
+ * that write code are not stored: the linker's messages are not captured.
+ */
+static bool run_cached(struct Context *ctx, const struct Options *opts,
+		       str_t source)
+{
+	FILE *report = report_stream(opts);
+	struct Cache cache;
+	if (!cache_open(&cache, opts->cache_dir, opts->cache_max_bytes)) {
+		log_warn("cache: cannot create '%s', compiling uncached",
+			 opts->cache_dir);
+		return compile_source(ctx, opts, source, report);
+	}
+
+	struct CacheKey key;
+	if (!compile_cache_key(opts, source, &key)) {
+		log_warn("cache: cannot read the compiler binary, "
+			 "compiling uncached");
+		return compile_source(ctx, opts, source, report);
+	}
+	struct CacheEntry entry;
+
+	if (cache_lookup(&cache, key, ctx->alc, &entry)) {
+		fwrite(entry.output.ptr, 1, entry.output.len, report);
+		fwrite(entry.diag.ptr, 1, entry.diag.len, stderr);
+		if (entry.success && writes_code(opts))
+			return put_code(opts, entry.code);
+		return entry.success;
+	}
+
+	char *diag_buf = NULL, *out_buf = NULL;
+	size_t diag_len = 0, out_len = 0;
+	FILE *diag = open_memstream(&diag_buf, &diag_len);
+	FILE *out = open_memstream(&out_buf, &out_len);
+	if (!diag || !out) {
+		if (diag)
+			fclose(diag);
+		if (out)
+			fclose(out);
+		return compile_source(ctx, opts, source, report);
+	}
+
+	struct Options to_cache = *opts;
+	char code_path[PATH_MAX + 32];
+	if (writes_code(opts)) {
+		snprintf(code_path, sizeof(code_path), "%s/code.tmp.%ld",
+			 opts->cache_dir, (long)getpid());
+		to_cache.output = code_path;
+	}
+
+	ctx->diag = diag;
+	bool success = compile_source(ctx, &to_cache, source, out);
+	ctx->diag = stderr;
+	fclose(diag);
+	fclose(out);
+
+	fwrite(out_buf, 1, out_len, report);
+	fwrite(diag_buf, 1, diag_len, stderr);
+
+	entry.success = success;
+	entry.diag = str_from_parts(diag_buf, diag_len);
+	entry.output = str_from_parts(out_buf, out_len);
+	entry.code = str_from_parts("", 0);
+
+	string_t code;
+	bool have_code = false;
+	if (writes_code(opts)) {
+		have_code = string_init(&code, ctx->alc, 0) &&
+			    file_read_to_string(code_path, &code);
+		unlink(code_path);
+		if (success && !have_code)
+			log_error("Could not read back '%s'", code_path);
+		success = success && have_code &&
+			  put_code(opts, string_as_str(&code));
+		if (success)
+			entry.code = string_as_str(&code);
+	}
+	if (success || !writes_code(opts))
+		cache_store(&cache, key, &entry);
+
+	free(diag_buf);
+	free(out_buf);
+	return success;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/**
+ * @brief Editor integration: keep the compiled file in memory and update it
+ * incrementally for every edit read from stdin.
+ */
+static bool run_serve(struct Context *ctx, const struct Options *opts,
+		      str_t source)
+{
+	struct Document doc;
+	ctx->doc = &doc;
+	bool ok = doc_open(&doc, ctx, opts->input_file, source);
+	printf("ok errors=%d items=%zu\n", !ok, vec_len(doc.items));
+	fflush(stdout);
+
+	char line[256];
+	while (fgets(line, sizeof(line), stdin)) {
+		usize start, end, len;
+
+		if (strncmp(line, "quit", 4) == 0)
+			break;
+
+		if (strncmp(line, "dump", 4) == 0) {
+			struct ArenaMark mark = arena_mark(&ctx->scratch);
+			NodeVec globals;
+			doc_globals(&doc, &globals);
+			print_summary(stdout, globals);
+			arena_release(&ctx->scratch, mark);
+		} else if (sscanf(line, "edit %zu %zu %zu", &start, &end,
+				  &len) == 3) {
+			/* The payload is copied into the new text version. */
+			struct ArenaMark mark = arena_mark(&ctx->scratch);
+			char *buf = arena_alloc(&ctx->scratch,
+						layout(len + 1, 1));
+			if (fread(buf, 1, len, stdin) != len) {
+				log_error("serve: short edit payload");
+				arena_release(&ctx->scratch, mark);
+				ok = false;
+				break;
+			}
+
+			double t0 = now_us();
+			ok = doc_edit(&doc, start, end, str_from_parts(buf, len));
+			double t1 = now_us();
+
+			arena_release(&ctx->scratch, mark);
+
+			printf("ok errors=%d reparsed=%zu rechecked=%zu "
+			       "reused=%zu us=%.1f\n",
+			       !ok, doc.last.reparsed, doc.last.rechecked,
+			       doc.last.reused, t1 - t0);
+		} else {
+			printf("error unknown command\n");
+		}
+		fflush(stdout);
+	}
+
+	doc_close(&doc);
+	ctx->doc = NULL;
+	return ok;
+}
+
+static bool run_compile(struct Context *ctx, const struct Options *opts)
+{
+	if (is_stream_input(opts->input_file)) {
+		if (opts->serve) {
+			log_error("--serve needs a regular file");
+			return false;
+		}
+		if (opts->run && strcmp(opts->input_file, "-") == 0) {
+			log_error("--run reads the program's input from stdin; "
+				  "pass the source as a file");
+			return false;
+		}
+		return run_stream(ctx, opts);
+	}
+
+	string_t content;
+	if (!string_init(&content, ctx->alc, 0)) {
+		log_error("OOM reading file");
+		return false;
+	}
+
+	stats_push(StatsPhase_READ);
+	bool read_ok = file_read_to_string(opts->input_file, &content);
+	stats_pop();
+	if (!read_ok) {
+		log_error("Could not read file '%s'", opts->input_file);
+		return false;
+	}
+
+	if (opts->serve) {
+		return run_serve(ctx, opts, string_as_str(&content));
+	}
+
+	/*
+	 * Only code is stored with the messages; other files bypass the
+	 * cache. So does running the program, which may read input.
+	 */
+	bool side_output = opts->emit_ast || opts->run ||
+			   (opts->emit_ir && strcmp(opts->emit_ir, "-") != 0);
+	if (opts->cache_dir && !side_output && !is_instrumented(opts)) {
+		return run_cached(ctx, opts, string_as_str(&content));
+	}
+	FILE *out = report_stream(opts);
+	return compile_source(ctx, opts, string_as_str(&content), out);
+}
+
+static void report_stats(const struct Options *opts)
+{
+	if (opts->time_report)
+		stats_print_time(stderr);
+	if (opts->mem_report)
+		stats_print_mem(stderr);
+	if (!opts->stats_json)
+		return;
+
+	if (strcmp(opts->stats_json, "-") == 0) {
+		stats_write_json(stdout, opts->input_file);
+		return;
+	}
+	FILE *f = fopen(opts->stats_json, "w");
+	if (!f) {
+		log_error("Could not write '%s'", opts->stats_json);
+		return;
+	}
+	stats_write_json(f, opts->input_file);
+	fclose(f);
+}
+
+static u64 input_size(const char *path)
+{
+	struct stat st;
+	if (is_stream_input(path))
+		return STREAM_ASSUMED_INPUT;
+	return stat(path, &st) == 0 ? (u64)st.st_size : 0;
+}
+
 /*
  * ==========================================================================
  * Entry Point
  * ==========================================================================
  */
 
+/* The decimal number after `prefix` in `arg`, which must be in [min, max]. */
+static bool parse_count(const char *arg, usize prefix, u64 min, u64 max,
+			u64 *out)
+{
+	const char *text = arg + prefix;
+	char *end;
+	errno = 0;
+	unsigned long long n = strtoull(text, &end, 10);
+	if (text[0] < '0' || text[0] > '9' || *end != '\0' || errno != 0 ||
+	    n < min || n > max) {
+		fprintf(stderr,
+			"Error: invalid number in '%s' (expected %llu to "
+			"%llu).\n",
+			arg, (unsigned long long)min, (unsigned long long)max);
+		return false;
+	}
+	*out = n;
+	return true;
+}
+
 int main(int argc, char **argv)
 {
 	allocer_t sys = allocer_system();
@@ -104,34 +736,272 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	const char *input_file = NULL;
+	struct Options opts = { 0 };
+	opts.cache_dir = getenv("CACTC_CACHE_DIR");
+	opts.cache_max_bytes = (u64)CACHE_DEFAULT_MAX_MB << 20;
+	opts.arena_mmap = true;
+	opts.arena_pages = VMemPages_TRANSPARENT;
+	opts.max_nesting = CTX_DEFAULT_MAX_NESTING;
+	opts.inline_limit = IR_INLINE_LIMIT;
+	opts.jit = VmJit_TIERED;
+	opts.max_expr_depth = CTX_DEFAULT_MAX_EXPR_DEPTH;
+	opts.argc = argc;
+	opts.argv = argv;
+
 	for (int i = 1; i < argc; ++i) {
 		if (strcmp(argv[i], "-h") == 0 ||
 		    strcmp(argv[i], "--help") == 0) {
 			printf("%s", USAGE_INFO);
 			return 0;
 		}
-		if (argv[i][0] != '-') {
-			input_file = argv[i];
+		if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+			opts.cache_dir = argv[i] + 12;
+			continue;
+		}
+		if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+			u64 mib;
+			if (!parse_count(argv[i], 13, 1, UINT64_MAX >> 20, &mib))
+				return 1;
+			opts.cache_max_bytes = mib << 20;
+			continue;
+		}
+		if (strncmp(argv[i], "--emit-ast=", 11) == 0) {
+			opts.emit_ast = argv[i] + 11;
+			continue;
+		}
+		if (strncmp(argv[i], "--emit-ir=", 10) == 0) {
+			opts.emit_ir = argv[i] + 10;
+			continue;
+		}
+		if (strncmp(argv[i], "--load-ast=", 11) == 0) {
+			opts.load_ast = argv[i] + 11;
+			continue;
+		}
+		if (strcmp(argv[i], "-o") == 0) {
+			if (i + 1 == argc) {
+				fprintf(stderr, "Error: -o needs a file name.\n");
+				return 1;
+			}
+			opts.output = argv[++i];
+			continue;
+		}
+		if (strcmp(argv[i], "-S") == 0) {
+			opts.emit_asm = true;
+			continue;
+		}
+		if (strcmp(argv[i], "-c") == 0) {
+			opts.emit_obj = true;
+			continue;
+		}
+		if (strncmp(argv[i], "--emit=", 7) == 0) {
+			if (strcmp(argv[i] + 7, "c") != 0) {
+				fprintf(stderr,
+					"Error: unknown --emit format '%s' "
+					"(expected c).\n",
+					argv[i] + 7);
+				return 1;
+			}
+			opts.emit_c = true;
+			continue;
+		}
+		if (strncmp(argv[i], "-O", 2) == 0) {
+			const char *level = argv[i] + 2;
+			if (level[0] == '\0') {
+				opts.opt_level = 1;
+			} else if (level[0] >= '0' &&
+				   level[0] <= '0' + IR_OPT_MAX_LEVEL &&
+				   level[1] == '\0') {
+				opts.opt_level = (u32)(level[0] - '0');
+			} else {
+				fprintf(stderr,
+					"Error: unknown optimization level "
+					"'%s'.\n",
+					argv[i]);
+				return 1;
+			}
+			continue;
+		}
+		if (strncmp(argv[i], "--print-after=", 14) == 0) {
+			opts.print_after = argv[i] + 14;
+			if (strcmp(opts.print_after, "all") != 0 &&
+			    ir_pass_lookup(opts.print_after) == IrPass_COUNT) {
+				fprintf(stderr, "Error: unknown pass '%s'.\n",
+					opts.print_after);
+				return 1;
+			}
+			continue;
+		}
+		if (strcmp(argv[i], "-fverify-each") == 0) {
+			opts.verify_each = true;
+			continue;
+		}
+		if (strncmp(argv[i], "-finline-limit=", 15) == 0) {
+			u64 n;
+			if (!parse_count(argv[i], 15, 0, IR_INLINE_CALLER_MAX,
+					 &n))
+				return 1;
+			opts.inline_limit = (u32)n;
+			continue;
+		}
+		if (strcmp(argv[i], "-fopt-info") == 0) {
+			opts.opt_info = true;
+			continue;
+		}
+		if (strcmp(argv[i], "--run") == 0) {
+			opts.run = true;
+			continue;
+		}
+		if (strncmp(argv[i], "--jit=", 6) == 0) {
+			const char *mode = argv[i] + 6;
+			if (strcmp(mode, "off") == 0) {
+				opts.jit = VmJit_OFF;
+			} else if (strcmp(mode, "tiered") == 0) {
+				opts.jit = VmJit_TIERED;
+			} else if (strcmp(mode, "eager") == 0) {
+				opts.jit = VmJit_EAGER;
+			} else {
+				fprintf(stderr,
+					"Error: unknown JIT mode '%s'.\n",
+					mode);
+				return 1;
+			}
+			continue;
 		}
+		if (strcmp(argv[i], "--serve") == 0) {
+			opts.serve = true;
+			continue;
+		}
+		if (strcmp(argv[i], "-ftime-report") == 0) {
+			opts.time_report = true;
+			continue;
+		}
+		if (strcmp(argv[i], "-fmem-report") == 0) {
+			opts.mem_report = true;
+			continue;
+		}
+		if (strncmp(argv[i], "--stats-json=", 13) == 0) {
+			opts.stats_json = argv[i] + 13;
+			continue;
+		}
+		if (strncmp(argv[i], "--trace=", 8) == 0) {
+			opts.trace = argv[i] + 8;
+			continue;
+		}
+		if (strncmp(argv[i], "--arena=", 8) == 0) {
+			const char *kind = argv[i] + 8;
+			opts.arena_mmap = strcmp(kind, "malloc") != 0;
+			opts.arena_pages = strcmp(kind, "hugetlb") == 0
+						   ? VMemPages_HUGETLB
+						   : VMemPages_TRANSPARENT;
+			if (opts.arena_mmap && strcmp(kind, "mmap") != 0 &&
+			    strcmp(kind, "hugetlb") != 0) {
+				fprintf(stderr,
+					"Error: unknown arena kind '%s'.\n",
+					kind);
+				return 1;
+			}
+			continue;
+		}
+		if (strncmp(argv[i], "-fmax-nesting=", 14) == 0) {
+			u64 n;
+			if (!parse_count(argv[i], 14, 1, UINT32_MAX, &n))
+				return 1;
+			opts.max_nesting = (u32)n;
+			continue;
+		}
+		if (strncmp(argv[i], "-fmax-expr-depth=", 17) == 0) {
+			u64 n;
+			if (!parse_count(argv[i], 17, 1, UINT32_MAX, &n))
+				return 1;
+			opts.max_expr_depth = (u32)n;
+			continue;
+		}
+		if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
+			opts.input_file = argv[i];
+		}
+	}
+
+	if (opts.load_ast) {
+		return run_load_ast(opts.load_ast) ? 0 : 1;
 	}
 
-	if (!input_file) {
+	if (!opts.input_file) {
 		fprintf(stderr, "Error: No input file specified.\n");
 		return 1;
 	}
+	if (opts.emit_c && (opts.emit_asm || opts.emit_obj)) {
+		fprintf(stderr, "Error: --emit=c cannot be combined with -S "
+				"or -c.\n");
+		return 1;
+	}
+	if (opts.emit_obj && !opts.emit_asm && !opts.output) {
+		fprintf(stderr, "Error: -c needs -o <file>.\n");
+		return 1;
+	}
+	if (opts.cache_dir && opts.cache_dir[0] == '\0') {
+		opts.cache_dir = NULL;
+	}
+
+	if (opts.trace) {
+#ifdef CACT_TRACE
+		trace_start(TRACE_BUFFER_EVENTS);
+#else
+		fprintf(stderr, "Error: built without tracing (make TRACE=1).\n");
+		return 1;
+#endif
+	}
+
+	/*
+	 * The long-lived arena grows into one reservation sized from the
+	 * input, rather than from many small malloc'd chunks.
+	 */
+	struct VMem vmem = { 0 };
+	allocer_t backing = sys;
+	if (opts.arena_mmap &&
+	    vmem_init(&vmem, vmem_size_for_input(input_size(opts.input_file)),
+		      opts.arena_pages, sys)) {
+		backing = vmem_allocer(&vmem);
+		compile_stats.vmem = &vmem;
+	}
+
+	/* With stats on, count both what the arena hands out and reserves. */
+	struct CountingAlloc arena_count, backing_count;
+	if (wants_stats(&opts)) {
+		stats_enable();
+		backing = counting_allocer(&backing_count, backing, false);
+		compile_stats.arena_backing = &backing_count;
+	}
 
 	bump_t arena;
-	bump_init(&arena, sys, 8);
+	bump_init(&arena, backing, 8);
 	allocer_t arena_alc = bump_allocer(&arena);
+	if (wants_stats(&opts)) {
+		arena_alc = counting_allocer(&arena_count, arena_alc, true);
+		compile_stats.arena = &arena_count;
+	}
 
 	struct Context ctx;
 	context_init(&ctx, arena_alc);
+	ctx.max_nesting = opts.max_nesting;
+	ctx.max_expr_depth = opts.max_expr_depth;
+	compile_stats.scratch = &ctx.scratch;
+	compile_stats.scopes = &ctx.scopes;
 
-	bool success = run_compile(&ctx, input_file);
+	bool success = run_compile(&ctx, &opts);
+
+	if (wants_stats(&opts)) {
+		stats_finish();
+		report_stats(&opts);
+	}
+	if (opts.trace && !trace_write(opts.trace)) {
+		log_error("Could not write trace '%s'", opts.trace);
+	}
 
 	context_deinit(&ctx);
 	bump_deinit(&arena);
+	vmem_deinit(&vmem);
 
+	if (success && opts.run)
+		return program_status & 0xff;
 	return success ? 0 : 1;
 }
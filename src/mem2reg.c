@@ -0,0 +1,489 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * mem2reg: the ALLOCAs that only ever hold one scalar, and are only
+ * loaded from and stored to, become SSA values (Cytron et al.). PHIs go
+ * on the iterated dominance frontier of the stores, where the variable
+ * is live; a walk down the dominator tree then replaces each load with
+ * the value stored last on the way to it. A load no store reaches reads
+ * zero, as a fresh ALLOCA does. Arrays stay in memory.
+ */
+
+#include <pass.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Finding Variables
+ * ==========================================================================
+ */
+
+/* A promoted ALLOCA. */
+struct Var {
+	IrValue addr;
+	IrType ty;
+	/* Its zero, and the value stored last on the way down the tree. */
+	IrValue zero;
+	IrValue cur;
+};
+
+defVec(struct Var, VarVec);
+
+/* (variable, block) pairs, grouped by variable once all are in. */
+struct BlockLists {
+	IrU32Vec var;
+	IrU32Vec block;
+	u32 *start;
+	u32 *blocks;
+};
+
+struct Promoter {
+	struct IrFunc *fn;
+	const struct IrCfg *cfg;
+	VarVec vars;
+	/* var_of[v] - 1 is the variable an ALLOCA, or a PHI placed for
+	 * one, stands for; 0 for other values. Sized after placement. */
+	u32 *var_of;
+	u32 nvalues;
+
+	/* Blocks that store each variable, and blocks that load it before
+	 * any store. */
+	struct BlockLists defs;
+	struct BlockLists uses;
+};
+
+/* The variable the ALLOCA `addr` is, +1, or 0 if it is not one. */
+static u32 var_at(const struct Promoter *p, IrValue addr)
+{
+	return addr < p->nvalues ? p->var_of[addr] : 0;
+}
+
+/*
+ * An ALLOCA is promoted if every use loads or stores it whole, with one
+ * scalar type; storing its address anywhere, indexing it or passing it
+ * to a call keeps it in memory.
+ */
+static void find_vars(struct Promoter *p)
+{
+	struct IrFunc *fn = p->fn;
+	/* ty[a] + 1 for a candidate, 0 for none. */
+	u8 *ty = ir_grab(p->nvalues);
+	for (IrValue v = fn->blocks.data[1].first; v; v = ir_inst(fn, v)->next)
+		if (ir_inst(fn, v)->op == IrOp_ALLOCA)
+			ty[v] = IrType_COUNT + 1;
+
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			const struct IrInst *inst = ir_inst(fn, v);
+			const IrValue *args = ir_args(fn, v);
+			IrValue addr = IR_NONE;
+			u8 want = 0;
+			if (inst->op == IrOp_LOAD) {
+				addr = args[0];
+				want = inst->ty;
+			} else if (inst->op == IrOp_STORE && args[1] != args[0]) {
+				addr = args[0];
+				want = ir_inst(fn, args[1])->ty;
+			}
+			ir_foreach_operand(fn, v, i)
+			{
+				IrValue u = args[i];
+				if (!ty[u])
+					continue;
+				if (u != addr || (ty[u] <= IrType_COUNT &&
+						  ty[u] != want + 1))
+					ty[u] = 0;
+				else
+					ty[u] = want + 1;
+			}
+		}
+	}
+
+	for (IrValue v = fn->blocks.data[1].first; v; v = ir_inst(fn, v)->next) {
+		if (!ty[v])
+			continue;
+		/* Never used, or used at a type of another size. */
+		IrType t = ty[v] <= IrType_COUNT ? (IrType)(ty[v] - 1)
+						 : IrType_VOID;
+		if (t != IrType_VOID &&
+		    ir_type_size(t) != ir_inst(fn, v)->imm.mem.size)
+			continue;
+		struct Var var = { .addr = v, .ty = t };
+		massert(vec_push(p->vars, var), "OOM mem2reg");
+		p->var_of[v] = (u32)vec_len(p->vars);
+	}
+	ir_drop(ty, p->nvalues);
+}
+
+static void lists_add(struct BlockLists *l, u32 var, u32 bb)
+{
+	massert(vec_push(l->var, var), "OOM mem2reg");
+	massert(vec_push(l->block, bb), "OOM mem2reg");
+}
+
+/* Counting sort of the pairs by variable. */
+static void lists_group(struct BlockLists *l, u32 nvars)
+{
+	u32 n = (u32)vec_len(l->var);
+	l->start = ir_grab((nvars + 1) * sizeof(u32));
+	l->blocks = ir_grab(n * sizeof(u32));
+	for (u32 i = 0; i < n; ++i)
+		l->start[l->var.data[i] + 1]++;
+	for (u32 v = 0; v < nvars; ++v)
+		l->start[v + 1] += l->start[v];
+	u32 *at = ir_grab(nvars * sizeof(u32));
+	for (u32 i = 0; i < n; ++i) {
+		u32 var = l->var.data[i];
+		l->blocks[l->start[var] + at[var]++] = l->block.data[i];
+	}
+	ir_drop(at, nvars * sizeof(u32));
+}
+
+static void lists_deinit(struct BlockLists *l, u32 nvars)
+{
+	if (l->start) {
+		ir_drop(l->blocks, vec_len(l->var) * sizeof(u32));
+		ir_drop(l->start, (nvars + 1) * sizeof(u32));
+	}
+	vec_deinit(l->var);
+	vec_deinit(l->block);
+}
+
+/* Records, per variable, which blocks store it and which load it first. */
+static void find_blocks(struct Promoter *p)
+{
+	struct IrFunc *fn = p->fn;
+	u32 nvars = (u32)vec_len(p->vars);
+	/* The last block each variable was seen in. */
+	u32 *seen = ir_grab(nvars * sizeof(u32));
+	u32 *stored = ir_grab(nvars * sizeof(u32));
+
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			const struct IrInst *inst = ir_inst(fn, v);
+			if (inst->op != IrOp_LOAD && inst->op != IrOp_STORE)
+				continue;
+			u32 var = var_at(p, ir_args(fn, v)[0]);
+			if (!var--)
+				continue;
+			if (seen[var] != bb && inst->op == IrOp_LOAD)
+				lists_add(&p->uses, var, bb);
+			if (stored[var] != bb && inst->op == IrOp_STORE) {
+				lists_add(&p->defs, var, bb);
+				stored[var] = bb;
+			}
+			seen[var] = bb;
+		}
+	}
+	lists_group(&p->defs, nvars);
+	lists_group(&p->uses, nvars);
+	ir_drop(seen, nvars * sizeof(u32));
+	ir_drop(stored, nvars * sizeof(u32));
+}
+
+/*
+ * ==========================================================================
+ * 2. Placing PHIs
+ * ==========================================================================
+ * Per variable: the blocks it is live into, walking back from the loads
+ * to the stores, then its iterated dominance frontier among those.
+ * Marks hold the number of the variable they were made for, so they are
+ * never cleared.
+ */
+
+struct Marks {
+	/* var + 1 where the variable is live in. */
+	u32 *live;
+	/* 2 * var + 1 where it is stored, 2 * var + 2 once given a PHI. */
+	u32 *def;
+	u32 *work;
+};
+
+static void find_live(struct Promoter *p, struct Marks *mk, u32 var)
+{
+	const struct IrCfg *cfg = p->cfg;
+	u32 tag = var + 1, top = 0;
+	for (u32 i = p->defs.start[var]; i < p->defs.start[var + 1]; ++i)
+		mk->def[p->defs.blocks[i]] = 2 * var + 1;
+	for (u32 i = p->uses.start[var]; i < p->uses.start[var + 1]; ++i) {
+		u32 bb = p->uses.blocks[i];
+		mk->live[bb] = tag;
+		mk->work[top++] = bb;
+	}
+	while (top) {
+		u32 bb = mk->work[--top];
+		for (u32 e = cfg->pred_start[bb]; e < cfg->pred_start[bb + 1];
+		     ++e) {
+			u32 pred = cfg->preds[e];
+			/* A block that stores first kills the walk. */
+			if (mk->live[pred] == tag || mk->def[pred] == 2 * var + 1)
+				continue;
+			mk->live[pred] = tag;
+			mk->work[top++] = pred;
+		}
+	}
+}
+
+static void place_phis(struct Promoter *p, const struct IrDomFrontier *df,
+		       struct Marks *mk, u32 var, IrU32Vec *zeros)
+{
+	const struct IrCfg *cfg = p->cfg;
+	struct Var *v = &p->vars.data[var];
+	u32 top = 0;
+	for (u32 i = p->defs.start[var]; i < p->defs.start[var + 1]; ++i)
+		mk->work[top++] = p->defs.blocks[i];
+
+	while (top) {
+		u32 bb = mk->work[--top];
+		for (u32 k = df->start[bb]; k < df->start[bb + 1]; ++k) {
+			u32 f = df->blocks[k];
+			if (mk->live[f] != var + 1 || mk->def[f] == 2 * var + 2)
+				continue;
+			/* A PHI is a store too. */
+			if (mk->def[f] != 2 * var + 1)
+				mk->work[top++] = f;
+			mk->def[f] = 2 * var + 2;
+
+			u32 npreds = cfg->pred_start[f + 1] - cfg->pred_start[f];
+			zeros->len = 0;
+			for (u32 i = 0; i < npreds; ++i)
+				massert(vec_push(*zeros, v->zero), "OOM mem2reg");
+			struct IrBuilder b = { .fn = p->fn, .block = f };
+			ir_emit_phi(&b, v->ty, cfg->preds + cfg->pred_start[f],
+				    zeros->data, npreds);
+		}
+	}
+}
+
+/*
+ * ==========================================================================
+ * 3. Renaming
+ * ==========================================================================
+ */
+
+struct Undo {
+	u32 var;
+	IrValue cur;
+};
+
+defVec(struct Undo, UndoVec);
+
+static void set_cur(struct Promoter *p, UndoVec *log, u32 var, IrValue val)
+{
+	struct Undo u = { var, p->vars.data[var].cur };
+	massert(vec_push(*log, u), "OOM mem2reg");
+	p->vars.data[var].cur = val;
+}
+
+/* Rewrites the loads and stores of `bb`, then its successors' PHIs. */
+static void rename_block(struct Promoter *p, u32 bb, IrValue *repl,
+			 UndoVec *log)
+{
+	struct IrFunc *fn = p->fn;
+	IrValue v = fn->blocks.data[bb].first;
+	while (v) {
+		IrValue next = ir_inst(fn, v)->next;
+		const struct IrInst *inst = ir_inst(fn, v);
+		if (inst->op == IrOp_PHI) {
+			u32 var = var_at(p, v);
+			if (var)
+				set_cur(p, log, var - 1, v);
+		} else if (inst->op == IrOp_LOAD || inst->op == IrOp_STORE) {
+			const IrValue *args = ir_args(fn, v);
+			u32 var = var_at(p, args[0]);
+			if (var && inst->op == IrOp_LOAD) {
+				repl[v] = p->vars.data[var - 1].cur;
+				ir_remove(fn, v);
+			} else if (var) {
+				set_cur(p, log, var - 1, args[1]);
+				ir_remove(fn, v);
+			}
+		}
+		v = next;
+	}
+
+	const struct IrCfg *cfg = p->cfg;
+	for (u32 e = cfg->succ_start[bb]; e < cfg->succ_start[bb + 1]; ++e) {
+		u32 succ = cfg->succs[e];
+		ir_foreach_inst(fn, succ, phi)
+		{
+			if (ir_inst(fn, phi)->op != IrOp_PHI)
+				break;
+			u32 var = var_at(p, phi);
+			if (!var)
+				continue;
+			IrValue *args = ir_args(fn, phi);
+			for (u32 i = 0; i < ir_inst(fn, phi)->nargs; i += 2)
+				if (args[i] == bb)
+					args[i + 1] = p->vars.data[var - 1].cur;
+		}
+	}
+}
+
+/* A block on the way down the dominator tree: its next child, and the
+ * length of the log when it was entered. */
+struct Frame {
+	u32 bb;
+	u32 child;
+	u32 mark;
+};
+
+/* Down the dominator tree without recursion; each block's changes to
+ * `cur` are undone when the walk leaves it. */
+static void rename_vars(struct Promoter *p, const struct IrDomTree *dt,
+			IrValue *repl)
+{
+	usize bytes = (usize)p->cfg->nblocks * sizeof(struct Frame);
+	struct Frame *stack = ir_grab(bytes);
+	UndoVec log;
+	massert(vec_init(log, allocer_system(), 64), "OOM mem2reg");
+
+	u32 top = 0;
+	stack[top++] = (struct Frame){ 1, dt->child_start[1], 0 };
+	rename_block(p, 1, repl, &log);
+	while (top) {
+		struct Frame *it = &stack[top - 1];
+		if (it->child < dt->child_start[it->bb + 1]) {
+			u32 child = dt->children[it->child++];
+			stack[top++] = (struct Frame){ child,
+						       dt->child_start[child],
+						       (u32)vec_len(log) };
+			rename_block(p, child, repl, &log);
+			continue;
+		}
+		while (vec_len(log) > it->mark) {
+			struct Undo u = log.data[--log.len];
+			p->vars.data[u.var].cur = u.cur;
+		}
+		--top;
+	}
+	vec_deinit(log);
+	ir_drop(stack, bytes);
+}
+
+/* In a block the walk does not reach, loads read zero. */
+static void rename_unreached(struct Promoter *p, u32 bb, IrValue *repl)
+{
+	struct IrFunc *fn = p->fn;
+	IrValue v = fn->blocks.data[bb].first;
+	while (v) {
+		IrValue next = ir_inst(fn, v)->next;
+		u8 op = ir_inst(fn, v)->op;
+		u32 var = op == IrOp_LOAD || op == IrOp_STORE
+				  ? var_at(p, ir_args(fn, v)[0])
+				  : 0;
+		if (var) {
+			if (op == IrOp_LOAD)
+				repl[v] = p->vars.data[var - 1].zero;
+			ir_remove(fn, v);
+		}
+		v = next;
+	}
+}
+
+/*
+ * ==========================================================================
+ * 4. The Pass
+ * ==========================================================================
+ */
+
+IrAnalysisSet ir_mem2reg(struct PassManager *pm)
+{
+	struct IrFunc *fn = pm->fn;
+	allocer_t sys = allocer_system();
+	struct Promoter p = { .fn = fn, .cfg = pm_cfg(pm) };
+	const struct IrDomTree *dt = pm_domtree(pm);
+	const struct IrDomFrontier *df = pm_domfrontier(pm);
+
+	p.nvalues = (u32)vec_len(fn->insts);
+	p.var_of = ir_grab(p.nvalues * sizeof(u32));
+	massert(vec_init(p.vars, sys, 16), "OOM mem2reg");
+	find_vars(&p);
+	u32 nvars = (u32)vec_len(p.vars);
+	if (!nvars) {
+		ir_drop(p.var_of, p.nvalues * sizeof(u32));
+		vec_deinit(p.vars);
+		return IR_PRESERVE_ALL;
+	}
+
+	massert(vec_init(p.defs.var, sys, 64), "OOM mem2reg");
+	massert(vec_init(p.defs.block, sys, 64), "OOM mem2reg");
+	massert(vec_init(p.uses.var, sys, 64), "OOM mem2reg");
+	massert(vec_init(p.uses.block, sys, 64), "OOM mem2reg");
+	find_blocks(&p);
+	for (u32 i = 0; i < nvars; ++i) {
+		struct Var *v = &p.vars.data[i];
+		if (v->ty != IrType_VOID)
+			v->zero = ir_const(fn, (struct IrConst){ .ty = v->ty });
+		v->cur = v->zero;
+	}
+
+	u32 nblocks = p.cfg->nblocks;
+	usize mark_bytes = 3 * (usize)nblocks * sizeof(u32);
+	struct Marks mk;
+	mk.live = ir_grab(mark_bytes);
+	mk.def = mk.live + nblocks;
+	mk.work = mk.def + nblocks;
+	IrU32Vec zeros, phi_var;
+	massert(vec_init(zeros, sys, 8), "OOM mem2reg");
+	massert(vec_init(phi_var, sys, 64), "OOM mem2reg");
+	/* Nothing but PHIs is made from here on. */
+	u32 first_phi = (u32)vec_len(fn->insts);
+	for (u32 var = 0; var < nvars; ++var) {
+		if (p.uses.start[var] == p.uses.start[var + 1])
+			continue;
+		find_live(&p, &mk, var);
+		place_phis(&p, df, &mk, var, &zeros);
+		while (first_phi + vec_len(phi_var) < vec_len(fn->insts))
+			massert(vec_push(phi_var, var), "OOM mem2reg");
+	}
+	ir_drop(mk.live, mark_bytes);
+
+	u32 nvalues = (u32)vec_len(fn->insts);
+	u32 *var_of = ir_grab(nvalues * sizeof(u32));
+	memcpy(var_of, p.var_of, p.nvalues * sizeof(u32));
+	for (u32 i = 0; i < vec_len(phi_var); ++i)
+		var_of[first_phi + i] = phi_var.data[i] + 1;
+	ir_drop(p.var_of, p.nvalues * sizeof(u32));
+	p.var_of = var_of;
+	p.nvalues = nvalues;
+	vec_deinit(zeros);
+	vec_deinit(phi_var);
+
+	usize repl_bytes = nvalues * sizeof(IrValue);
+	IrValue *repl = ir_grab(repl_bytes);
+	rename_vars(&p, dt, repl);
+
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb)
+		if (!ir_cfg_reachable(p.cfg, bb))
+			rename_unreached(&p, bb, repl);
+	ir_replace_uses(fn, repl);
+	for (u32 i = 0; i < nvars; ++i)
+		ir_remove(fn, p.vars.data[i].addr);
+
+	ir_drop(repl, repl_bytes);
+	lists_deinit(&p.defs, nvars);
+	lists_deinit(&p.uses, nvars);
+	ir_drop(p.var_of, p.nvalues * sizeof(u32));
+	vec_deinit(p.vars);
+	return IR_PRESERVE_CFG;
+}
@@ -0,0 +1,142 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <native.h>
+#include <x86.h>
+#include <trace.h>
+#include <core/msg.h>
+
+#include <limits.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/*
+ * ==========================================================================
+ * 1. Toolchain
+ * ==========================================================================
+ */
+
+bool native_runtime(char *buf, usize size)
+{
+	buf[0] = '\0';
+	const char *env = getenv("CACTC_RUNTIME");
+	if (env && env[0]) {
+		snprintf(buf, size, "%s", env);
+		return access(buf, R_OK) == 0;
+	}
+
+	char exe[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (len <= 0)
+		return false;
+	exe[len] = '\0';
+	char *slash = strrchr(exe, '/');
+	if (slash)
+		*slash = '\0';
+	snprintf(buf, size, "%s/../lib/libcactrt.a", exe);
+	return access(buf, R_OK) == 0;
+}
+
+/* Runs argv[0] from PATH; true if it exits with status 0. */
+static bool run_tool(char *const argv[])
+{
+	TRACE_SCOPE_ARG("tool", argv[0]);
+	pid_t pid;
+	if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) != 0) {
+		log_error("Could not run '%s'", argv[0]);
+		return false;
+	}
+	int status;
+	if (waitpid(pid, &status, 0) < 0)
+		return false;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		return true;
+	log_error("'%s' failed (status %d)", argv[0],
+		  WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+	return false;
+}
+
+/*
+ * ==========================================================================
+ * 2. Public API
+ * ==========================================================================
+ */
+
+static bool write_file(const struct IrModule *m, const char *path,
+		       NativeKind kind)
+{
+	bool to_stdout = strcmp(path, "-") == 0;
+	FILE *f = to_stdout ? stdout
+			    : fopen(path, kind == NativeKind_ASM ? "w" : "wb");
+	if (!f) {
+		log_error("Could not write '%s'", path);
+		return false;
+	}
+	bool ok = kind == NativeKind_ASM ? x86_write_asm(f, m)
+					 : x86_write_elf(f, m);
+	return (to_stdout || fclose(f) == 0) && ok;
+}
+
+bool native_write(const struct IrModule *m, const char *path,
+		  NativeKind kind)
+{
+	if (kind != NativeKind_EXE)
+		return write_file(m, path, kind);
+
+	bool has_main = false;
+	for (usize i = 0; i < vec_len(m->funcs); ++i) {
+		const struct IrFunc *fn = &m->funcs.data[i];
+		has_main |= !fn->is_extern && strcmp(fn->name, "main") == 0;
+	}
+	if (!has_main) {
+		log_error("-o: the program has no 'main' function");
+		return false;
+	}
+
+	char runtime[PATH_MAX + 32];
+	if (!native_runtime(runtime, sizeof(runtime))) {
+		log_error("Runtime library not found at '%s' (set "
+			  "CACTC_RUNTIME)",
+			  runtime);
+		return false;
+	}
+
+	const char *tmpdir = getenv("TMPDIR");
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s/cactc-XXXXXX.o",
+		 tmpdir && tmpdir[0] ? tmpdir : "/tmp");
+	int fd = mkstemps(tmp, 2);
+	if (fd < 0) {
+		log_error("Could not create a temporary file in '%s'",
+			  tmpdir && tmpdir[0] ? tmpdir : "/tmp");
+		return false;
+	}
+	close(fd);
+
+	bool ok = write_file(m, tmp, NativeKind_OBJ);
+	if (ok) {
+		char *argv[] = { "cc", "-o", (char *)path, tmp, runtime, NULL };
+		ok = run_tool(argv);
+	}
+	unlink(tmp);
+	return ok;
+}
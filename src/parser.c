@@ -16,9 +16,13 @@
 
 #include <parser.h>
 #include <ast.h>
+#include <stats.h>
+#include <trace.h>
 #include <core/msg.h>
 #include <core/macros.h>
 
+#include <stdio.h>
+
 /*
  * ==========================================================================
  * 1. Infrastructure & Helpers
@@ -28,11 +32,14 @@
 static void advance(struct Parser *p)
 {
 	p->prev = p->curr;
+	double t = stats_leaf_begin(StatsPhase_LEX);
 	for (;;) {
 		p->curr = lexer_next(p->lex);
+		compile_stats.tokens++;
 		if (p->curr.kind != TokenKind_ERROR)
 			break;
 	}
+	stats_leaf_end(t);
 }
 
 static void parser_error_at(struct Parser *p, struct Token *tok,
@@ -97,6 +104,82 @@ static void synchronize(struct Parser *p)
 	}
 }
 
+/*
+ * Skips the construct starting at the current token without recursing, so
+ * that recovery stays cheap however deep the rest of it goes. Stops before
+ * a `;` or an unmatched closing bracket at depth zero, and after the `}`
+ * that closes a skipped brace.
+ */
+static void skip_nested(struct Parser *p)
+{
+	u32 depth = 0;
+
+	for (; p->curr.kind != TokenKind_EOF; advance(p)) {
+		switch (p->curr.kind) {
+		case TokenKind_L_PAREN:
+		case TokenKind_L_BRACKET:
+		case TokenKind_L_BRACE:
+			depth++;
+			break;
+		case TokenKind_R_PAREN:
+		case TokenKind_R_BRACKET:
+			if (depth == 0)
+				return;
+			depth--;
+			break;
+		case TokenKind_R_BRACE:
+			if (depth == 0)
+				return;
+			if (--depth == 0) {
+				advance(p);
+				return;
+			}
+			break;
+		case TokenKind_SEMICOLON:
+			if (depth == 0)
+				return;
+			break;
+		default:;
+		}
+	}
+}
+
+/**
+ * @brief Enters one more level of nesting, or rejects it.
+ *
+ * Every recursive walk over the AST is bounded by these limits, so input
+ * nested beyond them gets a single diagnostic instead of a stack overflow.
+ * The rejected construct is skipped and the caller returns NULL.
+ */
+static bool nest_enter(struct Parser *p, u32 *depth, u32 limit,
+		       const char *what, const char *flag)
+{
+	if (*depth < limit) {
+		(*depth)++;
+		return true;
+	}
+
+	char msg[128];
+	snprintf(msg, sizeof(msg),
+		 "%s nested too deeply (more than %u levels; raise with %s)",
+		 what, limit, flag);
+	parser_error(p, msg);
+	skip_nested(p);
+	return false;
+}
+
+static bool expr_enter(struct Parser *p)
+{
+	return nest_enter(p, &p->expr_depth, p->ctx->max_expr_depth,
+			  "Expression", "-fmax-expr-depth=");
+}
+
+static bool stmt_enter(struct Parser *p)
+{
+	return nest_enter(p, &p->stmt_depth, p->ctx->max_nesting, "Statement",
+			  "-fmax-nesting=");
+}
+
 static struct Node *new_node(struct Parser *p, NodeKind kind, size_t size)
 {
 	struct Node *n = allocer_alloc(p->alc, layout(size, 8));
@@ -104,12 +187,32 @@ static struct Node *new_node(struct Parser *p, NodeKind kind, size_t size)
 	n->tok = alloc_type(p->alc, struct Token);
 	*n->tok = p->prev;
 	n->ty = NULL;
+	compile_stats.nodes++;
 	return n;
 }
 
 #define NEW_NODE(p, StructType, Kind) \
 	((StructType *)new_node(p, Kind, sizeof(StructType)))
 
+/*
+ * Lists grow in ctx->scratch while they are parsed, so regrowing them
+ * leaves nothing behind in the AST; once complete, SEAL_LIST copies one
+ * into the AST at its final size.
+ */
+#define SEAL_LIST(p, v)                                                   \
+	do {                                                              \
+		typeof(v) sealed_;                                        \
+		usize n_ = vec_len(v);                                    \
+		massert(vec_init(sealed_, (p)->alc, n_ > 0 ? n_ : 1),     \
+			"OOM list");                                      \
+		vec_foreach(it_, v)                                       \
+		{                                                         \
+			vec_push(sealed_, *it_);                          \
+		}                                                         \
+		vec_deinit(v);                                            \
+		(v) = sealed_;                                            \
+	} while (0)
+
 static struct Type *token_to_type(TokenKind k)
 {
 	switch (k) {
@@ -187,7 +290,7 @@ static struct Node *parse_primary(struct Parser *p)
 		if (check_kind(p, TokenKind_L_PAREN)) {
 			consume(p, TokenKind_L_PAREN, "");
 
-			struct SemaSymbol *func_sym =
+			const struct SemaSymbol *func_sym =
 				sema_lookup(&p->sema, name);
 			if (!func_sym) {
 				parser_error(p, "Undefined function call");
@@ -198,7 +301,7 @@ static struct Node *parse_primary(struct Parser *p)
 
 			n->func_name = intern_resolve_cstr(&p->ctx->itn, name);
 
-			massert(vec_init(n->args, p->alc, 4),
+			massert(vec_init(n->args, p->tmp, 4),
 				"OOM in call args");
 
 			if (!check_kind(p, TokenKind_R_PAREN)) {
@@ -209,16 +312,13 @@ static struct Node *parse_primary(struct Parser *p)
 			}
 			consume(p, TokenKind_R_PAREN,
 				"Expect ')' after arguments");
+			SEAL_LIST(p, n->args);
 
-			if (func_sym && func_sym->ty->kind == TypeKind_FUNC) {
-				n->base.ty = func_sym->ty->data.func.ret;
-			} else {
-				n->base.ty = ty_int;
-			}
+			sema_analyze_call(&p->sema, n, func_sym);
 			return (struct Node *)n;
 		}
 
-		struct SemaSymbol *sym = sema_lookup(&p->sema, name);
+		const struct SemaSymbol *sym = sema_lookup(&p->sema, name);
 		if (!sym) {
 			parser_error(p, "Undefined variable");
 		}
@@ -228,7 +328,12 @@ static struct Node *parse_primary(struct Parser *p)
 		n->base.ty = sym ? sym->ty : ty_int;
 
 		struct Node *curr = (struct Node *)n;
-		while (match(p, TokenKind_L_BRACKET)) {
+		u32 saved_depth = p->expr_depth;
+		while (check_kind(p, TokenKind_L_BRACKET)) {
+			/* Each subscript wraps everything to its left. */
+			if (!expr_enter(p))
+				break;
+			advance(p);
 			struct Node *index = parse_expr(p);
 			consume(p, TokenKind_R_BRACKET, "Expect ']'");
 
@@ -237,15 +342,10 @@ static struct Node *parse_primary(struct Parser *p)
 			access->lhs = curr;
 			access->rhs = index;
 
-			if (curr->ty && curr->ty->kind == TypeKind_ARRAY) {
-				access->base.ty = curr->ty->data.array.base;
-			} else {
-				parser_error(
-					p, "Subscripted value is not an array");
-				access->base.ty = ty_int;
-			}
+			sema_analyze_index(&p->sema, access);
 			curr = (struct Node *)access;
 		}
+		p->expr_depth = saved_depth;
 		return curr;
 	}
 
@@ -253,7 +353,18 @@ static struct Node *parse_primary(struct Parser *p)
 	return NULL;
 }
 
+static struct Node *parse_unary_inner(struct Parser *p);
+
 static struct Node *parse_unary(struct Parser *p)
+{
+	if (!expr_enter(p))
+		return NULL;
+	struct Node *n = parse_unary_inner(p);
+	p->expr_depth--;
+	return n;
+}
+
+static struct Node *parse_unary_inner(struct Parser *p)
 {
 	if (match(p, TokenKind_PLUS))
 		return parse_unary(p);
@@ -261,16 +372,14 @@ static struct Node *parse_unary(struct Parser *p)
 	if (match(p, TokenKind_MINUS)) {
 		struct NodeUnary *n = NEW_NODE(p, struct NodeUnary, ND_NEG);
 		n->lhs = parse_unary(p);
-
-		if (n->lhs && n->lhs->ty)
-			n->base.ty = n->lhs->ty;
+		sema_analyze_unary(&p->sema, n);
 		return (struct Node *)n;
 	}
 
 	if (match(p, TokenKind_LOG_NOT)) {
 		struct NodeUnary *n = NEW_NODE(p, struct NodeUnary, ND_LOG_NOT);
 		n->lhs = parse_unary(p);
-		n->base.ty = ty_bool;
+		sema_analyze_unary(&p->sema, n);
 		return (struct Node *)n;
 	}
 
@@ -341,12 +450,17 @@ static NodeKind get_binary_kind(TokenKind k)
 static struct Node *parse_binary(struct Parser *p, int prec)
 {
 	struct Node *lhs = parse_unary(p);
+	u32 saved_depth = p->expr_depth;
 
 	for (;;) {
 		int current_prec = get_prec(p->curr.kind);
 		if (current_prec < prec)
 			break;
 
+		/* A left-associative chain deepens the tree once per operator. */
+		if (!expr_enter(p))
+			break;
+
 		TokenKind op_token = p->curr.kind;
 		advance(p);
 
@@ -361,6 +475,7 @@ static struct Node *parse_binary(struct Parser *p, int prec)
 
 		lhs = (struct Node *)n;
 	}
+	p->expr_depth = saved_depth;
 	return lhs;
 }
 
@@ -369,7 +484,10 @@ static struct Node *parse_assign(struct Parser *p)
 	struct Node *lhs = parse_binary(p, 0);
 
 	if (match(p, TokenKind_ASSIGN)) {
+		if (!expr_enter(p))
+			return lhs;
 		struct Node *rhs = parse_assign(p);
+		p->expr_depth--;
 
 		struct NodeBinary *n =
 			NEW_NODE(p, struct NodeBinary, ND_ASSIGN);
@@ -398,10 +516,11 @@ static struct Node *parse_decl(struct Parser *p);
 
 static struct Node *parse_block(struct Parser *p)
 {
+	TRACE_SCOPE("parse_block");
 	consume(p, TokenKind_L_BRACE, "Expect '{' to begin block");
 
 	struct NodeBlock *n = NEW_NODE(p, struct NodeBlock, ND_BLOCK);
-	massert(vec_init(n->stmts, p->alc, 8), "OOM block");
+	massert(vec_init(n->stmts, p->tmp, 8), "OOM block");
 
 	sema_scope_enter(&p->sema);
 
@@ -456,15 +575,28 @@ static struct Node *parse_block(struct Parser *p)
 
 	sema_scope_leave(&p->sema);
 	consume(p, TokenKind_R_BRACE, "Expect '}' to end block");
+	SEAL_LIST(p, n->stmts);
 	return (struct Node *)n;
 }
 
+static struct Node *parse_stmt_inner(struct Parser *p);
+
 static struct Node *parse_stmt(struct Parser *p)
+{
+	if (!stmt_enter(p))
+		return NULL;
+	struct Node *n = parse_stmt_inner(p);
+	p->stmt_depth--;
+	return n;
+}
+
+static struct Node *parse_stmt_inner(struct Parser *p)
 {
 	if (match(p, TokenKind_IF)) {
 		struct NodeIf *n = NEW_NODE(p, struct NodeIf, ND_IF);
 		consume(p, TokenKind_L_PAREN, "Expect '('");
 		n->cond = parse_expr(p);
+		sema_analyze_cond(&p->sema, n->cond);
 		consume(p, TokenKind_R_PAREN, "Expect ')'");
 		n->then_branch = parse_stmt(p);
 		if (match(p, TokenKind_ELSE)) {
@@ -477,8 +609,11 @@ static struct Node *parse_stmt(struct Parser *p)
 		struct NodeWhile *n = NEW_NODE(p, struct NodeWhile, ND_WHILE);
 		consume(p, TokenKind_L_PAREN, "Expect '('");
 		n->cond = parse_expr(p);
+		sema_analyze_cond(&p->sema, n->cond);
 		consume(p, TokenKind_R_PAREN, "Expect ')'");
+		p->sema.loop_depth++;
 		n->body = parse_stmt(p);
+		p->sema.loop_depth--;
 		return (struct Node *)n;
 	}
 
@@ -494,12 +629,14 @@ static struct Node *parse_stmt(struct Parser *p)
 
 	if (match(p, TokenKind_BREAK)) {
 		struct Node *n = new_node(p, ND_BREAK, sizeof(struct Node));
+		sema_analyze_jump(&p->sema, n);
 		consume(p, TokenKind_SEMICOLON, "Expect ';'");
 		return n;
 	}
 
 	if (match(p, TokenKind_CONTINUE)) {
 		struct Node *n = new_node(p, ND_CONTINUE, sizeof(struct Node));
+		sema_analyze_jump(&p->sema, n);
 		consume(p, TokenKind_SEMICOLON, "Expect ';'");
 		return n;
 	}
@@ -542,13 +679,45 @@ static struct Node *parse_stmt(struct Parser *p)
  * ==========================================================================
  */
 
-static struct Type *parse_array_dims(struct Parser *p, struct Type *base)
+/*
+ * Dimensions are read left to right, each wrapping the type so far, which
+ * leaves the last one outermost; flip the chain back down to `elem` so
+ * that `int a[2][3]` is an array of two `int[3]`.
+ */
+static struct Type *reverse_dims(struct Type *ty, struct Type *elem)
 {
+	struct Type *inner = elem;
+	while (ty != elem) {
+		struct Type *next = ty->data.array.base;
+		ty->data.array.base = inner;
+		ty->size = inner->size * ty->data.array.len;
+		inner = ty;
+		ty = next;
+	}
+	return inner;
+}
+
+/* Parses `[N]...` onto `base`, itself a (possibly empty) chain on `elem`. */
+static struct Type *parse_array_dims(struct Parser *p, struct Type *base,
+				     struct Type *elem)
+{
+	u32 dims = 0;
+
 	while (match(p, TokenKind_L_BRACKET)) {
 		if (match(p, TokenKind_LIT_INT)) {
 			int len = p->prev.value.as_int;
 			consume(p, TokenKind_R_BRACKET, "Expect ']'");
-			base = type_array_of(p->alc, base, len);
+			/* Types are walked recursively too; stop nesting them. */
+			if (dims++ == p->ctx->max_expr_depth) {
+				char msg[128];
+				snprintf(msg, sizeof(msg),
+					 "Array has more than %u dimensions "
+					 "(raise with -fmax-expr-depth=)",
+					 p->ctx->max_expr_depth);
+				parser_error_at(p, &p->prev, msg);
+			}
+			if (dims <= p->ctx->max_expr_depth)
+				base = type_array_of(p->ctx->alc, base, len);
 		} else {
 			parser_error(p, "Array size must be constant int");
 
@@ -556,16 +725,18 @@ static struct Type *parse_array_dims(struct Parser *p, struct Type *base)
 				advance(p);
 		}
 	}
-	return base;
+	return reverse_dims(base, elem);
 }
 
 static struct Node *parse_initializer_list(struct Parser *p)
 {
 	struct Token start_tok = p->curr;
+	if (!expr_enter(p))
+		return NULL;
 	consume(p, TokenKind_L_BRACE, "Expect '{'");
 
 	struct NodeInitList *n = NEW_NODE(p, struct NodeInitList, ND_INIT_LIST);
-	massert(vec_init(n->inits, p->alc, 4), "OOM init list");
+	massert(vec_init(n->inits, p->tmp, 4), "OOM init list");
 
 	if (!check_kind(p, TokenKind_R_BRACE)) {
 		do {
@@ -580,6 +751,8 @@ static struct Node *parse_initializer_list(struct Parser *p)
 	}
 
 	consume(p, TokenKind_R_BRACE, "Expect '}'");
+	SEAL_LIST(p, n->inits);
+	p->expr_depth--;
 	return (struct Node *)n;
 }
 
@@ -588,7 +761,7 @@ static struct Node *parse_var_decl_list(struct Parser *p, struct Type *base_ty,
 					bool is_global)
 {
 	struct NodeBlock *block = NEW_NODE(p, struct NodeBlock, ND_BLOCK);
-	massert(vec_init(block->stmts, p->alc, 2), "OOM decl");
+	massert(vec_init(block->stmts, p->tmp, 2), "OOM decl");
 
 	symbol_t name = first_name;
 	bool first = true;
@@ -604,7 +777,7 @@ static struct Node *parse_var_decl_list(struct Parser *p, struct Type *base_ty,
 		}
 		first = false;
 
-		struct Type *ty = parse_array_dims(p, base_ty);
+		struct Type *ty = parse_array_dims(p, base_ty, base_ty);
 
 		struct SemaSymbol *sym =
 			sema_define_var(&p->sema, name, ty, is_const);
@@ -617,15 +790,10 @@ static struct Node *parse_var_decl_list(struct Parser *p, struct Type *base_ty,
 		if (match(p, TokenKind_ASSIGN)) {
 			if (check_kind(p, TokenKind_L_BRACE)) {
 				n->init = parse_initializer_list(p);
-
 			} else {
 				n->init = parse_expr(p);
-
-				if (n->init && !type_eq(ty, n->init->ty)) {
-					ctx_error(p->ctx, n->base.tok,
-						  "Init type mismatch");
-				}
 			}
+			sema_analyze_var_decl(&p->sema, n);
 		} else if (is_const) {
 			parser_error(p, "Const variable must be initialized");
 		}
@@ -635,6 +803,7 @@ static struct Node *parse_var_decl_list(struct Parser *p, struct Type *base_ty,
 	} while (match(p, TokenKind_COMMA));
 
 	consume(p, TokenKind_SEMICOLON, "Expect ';'");
+	SEAL_LIST(p, block->stmts);
 	return (struct Node *)block;
 }
 
@@ -661,13 +830,16 @@ static struct Node *parse_decl(struct Parser *p)
 static struct Node *parse_func(struct Parser *p, struct Type *ret_ty,
 			       symbol_t name)
 {
+	TRACE_SCOPE_ARG("parse_func", intern_resolve_cstr(&p->ctx->itn, name));
+	struct NodeFunc *fn = NEW_NODE(p, struct NodeFunc, ND_FUNC);
+	massert(vec_init(fn->params, p->tmp, 4), "OOM func params");
+
 	consume(p, TokenKind_L_PAREN, "");
 
-	struct Type *func_ty = type_func_new(p->alc, ret_ty);
+	struct Type *func_ty = type_func_new(p->ctx->alc, ret_ty);
+	fn->base.ty = func_ty;
 
-	struct SemaSymbol *func_sym =
-		sema_define_var(&p->sema, name, func_ty, false);
-	unused(func_sym);
+	fn->sym = sema_define_var(&p->sema, name, func_ty, false);
 
 	p->sema.curr_func_ret = ret_ty;
 	sema_scope_enter(&p->sema);
@@ -675,42 +847,49 @@ static struct Node *parse_func(struct Parser *p, struct Type *ret_ty,
 	if (!check_kind(p, TokenKind_R_PAREN)) {
 		do {
 			struct Type *arg_ty = token_to_type(p->curr.kind);
-			if (!arg_ty)
+			if (!arg_ty) {
 				parser_error(p, "Expect param type");
+				arg_ty = ty_int;
+			}
 			advance(p);
 
 			consume(p, TokenKind_IDENT, "Expect param name");
 			symbol_t arg_name = p->prev.value.name;
 
+			struct Type *elem_ty = arg_ty;
 			if (match(p, TokenKind_L_BRACKET)) {
 				if (match(p, TokenKind_R_BRACKET)) {
-					arg_ty = type_array_of(p->alc, arg_ty,
-							       0);
+					arg_ty = type_array_of(p->ctx->alc,
+							       arg_ty, 0);
 				} else {
 					if (match(p, TokenKind_LIT_INT)) {
 						int len = p->prev.value.as_int;
 						consume(p, TokenKind_R_BRACKET,
 							"Expect ']'");
 						arg_ty = type_array_of(
-							p->alc, arg_ty, len);
+							p->ctx->alc, arg_ty,
+							len);
 					} else {
 						parser_error(
 							p, "Expect array size");
 					}
 				}
 
-				arg_ty = parse_array_dims(p, arg_ty);
+				arg_ty = parse_array_dims(p, arg_ty, elem_ty);
 			}
 
-			sema_define_var(&p->sema, arg_name, arg_ty, false);
+			struct SemaSymbol *arg_sym = sema_define_var(
+				&p->sema, arg_name, arg_ty, false);
+			vec_push(fn->params, arg_sym);
 			vec_push(func_ty->data.func.params, arg_ty);
 
 		} while (match(p, TokenKind_COMMA));
 	}
 	consume(p, TokenKind_R_PAREN, "Expect ')'");
+	SEAL_LIST(p, fn->params);
 
 	struct NodeBlock *body = NEW_NODE(p, struct NodeBlock, ND_BLOCK);
-	massert(vec_init(body->stmts, p->alc, 8), "OOM func body");
+	massert(vec_init(body->stmts, p->tmp, 8), "OOM func body");
 
 	consume(p, TokenKind_L_BRACE, "Expect '{'");
 
@@ -764,11 +943,13 @@ static struct Node *parse_func(struct Parser *p, struct Type *ret_ty,
 	}
 
 	consume(p, TokenKind_R_BRACE, "Expect '}'");
+	SEAL_LIST(p, body->stmts);
 
 	sema_scope_leave(&p->sema);
 	p->sema.curr_func_ret = NULL;
 
-	return (struct Node *)body;
+	fn->body = (struct Node *)body;
+	return (struct Node *)fn;
 }
 
 static struct Node *parse_top_level(struct Parser *p)
@@ -810,70 +991,69 @@ void parser_init(struct Parser *p, struct Context *ctx, struct Lexer *lex)
 	p->ctx = ctx;
 	p->lex = lex;
 	p->alc = ctx->alc;
+	p->tmp = arena_allocer(&ctx->scratch);
 	p->panic_mode = false;
+	p->stmt_depth = 0;
+	p->expr_depth = 0;
 	sema_init(&p->sema, ctx);
 	advance(p);
 }
 
-static void install_builtin(struct Parser *p, const char *name,
-			    struct Type *ret, struct Type *arg1_ty)
+void parser_begin_unit(struct Parser *p)
 {
-	struct Type *func_ty = type_func_new(p->alc, ret);
-	if (arg1_ty) {
-		massert(vec_push(func_ty->data.func.params, arg1_ty),
-			"OOM builtin");
-	}
-
-	symbol_t sym = intern_cstr(&p->ctx->itn, name);
-	sema_define_var(&p->sema, sym, func_ty, false);
+	sema_scope_enter(&p->sema);
 }
 
-static void install_builtins(struct Parser *p)
+void parser_end_unit(struct Parser *p)
 {
-	install_builtin(p, "print_int", ty_void, ty_int);
-	install_builtin(p, "print_float", ty_void, ty_float);
-	install_builtin(p, "print_double", ty_void, ty_double);
-	install_builtin(p, "print_bool", ty_void, ty_bool);
-
-	install_builtin(p, "get_int", ty_int, NULL);
-	install_builtin(p, "get_float", ty_float, NULL);
-	install_builtin(p, "get_double", ty_double, NULL);
+	sema_scope_leave(&p->sema);
 }
 
-NodeVec parser_parse(struct Parser *p)
+struct Node *parser_parse_item(struct Parser *p)
 {
-	NodeVec globals;
-	massert(vec_init(globals, p->alc, 16), "OOM globals");
-
-	sema_scope_enter(&p->sema);
-
-	install_builtins(p);
+	struct ArenaMark mark = arena_mark(&p->ctx->scratch);
 
 	while (!match(p, TokenKind_EOF)) {
 		struct Node *n = parse_top_level(p);
 
 		if (n) {
-			vec_push(globals, n);
-		} else {
-			if (!p->ctx->had_error && !p->panic_mode) {
-				parser_error(p,
-					     "Unexpected token at top level");
-			}
+			arena_release(&p->ctx->scratch, mark);
+			return n;
+		}
 
-			if (p->panic_mode) {
-				synchronize(p);
-			}
+		if (!p->ctx->had_error && !p->panic_mode) {
+			parser_error(p, "Unexpected token at top level");
+		}
 
-			struct Type *ty = token_to_type(p->curr.kind);
-			bool is_decl_start = (ty != NULL) ||
-					     (p->curr.kind == TokenKind_CONST);
+		if (p->panic_mode) {
+			synchronize(p);
+		}
 
-			if (!is_decl_start && p->curr.kind != TokenKind_EOF) {
-				advance(p);
-			}
+		struct Type *ty = token_to_type(p->curr.kind);
+		bool is_decl_start = (ty != NULL) ||
+				     (p->curr.kind == TokenKind_CONST);
+
+		if (!is_decl_start && p->curr.kind != TokenKind_EOF) {
+			advance(p);
 		}
 	}
+	arena_release(&p->ctx->scratch, mark);
+	return NULL;
+}
 
-	sema_scope_leave(&p->sema);
+NodeVec parser_parse(struct Parser *p)
+{
+	TRACE_SCOPE("parse");
+	NodeVec globals;
+	massert(vec_init(globals, p->alc, 16), "OOM globals");
+
+	parser_begin_unit(p);
+
+	struct Node *n;
+	while ((n = parser_parse_item(p)) != NULL) {
+		vec_push(globals, n);
+	}
+
+	parser_end_unit(p);
 	return globals;
 }
@@ -0,0 +1,307 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <pass.h>
+#include <stats.h>
+#include <trace.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Tables
+ * ==========================================================================
+ */
+
+static const char *const ANALYSIS_NAMES[] = {
+#define X(ID, NAME, DEPENDS) NAME,
+	IR_ANALYSES(X)
+#undef X
+};
+
+static const IrAnalysisSet ANALYSIS_DEPENDS[] = {
+#define X(ID, NAME, DEPENDS) DEPENDS,
+	IR_ANALYSES(X)
+#undef X
+};
+
+struct PassInfo {
+	const char *name;
+	IrAnalysisSet (*run)(struct PassManager *pm);
+	IrAnalysisSet requires;
+};
+
+static const struct PassInfo PASSES[] = {
+#define X(ID, NAME, FN, REQUIRES) { NAME, FN, REQUIRES },
+	IR_PASSES(X)
+#undef X
+};
+
+/*
+ * -O1 cleans up what lowering leaves behind, takes locals out of memory
+ * and folds what is then constant, tidying the CFG that leaves; -O2 first
+ * inlines the small callees, then removes redundant computations and
+ * loads, puts loops in the shape the loop passes expect, moves what does
+ * not change out of them and steps the addresses that move with a loop
+ * counter instead of recomputing them.
+ */
+static const IrPass PIPELINE_O1[] = {
+	IrPass_SIMPLIFYCFG,
+	IrPass_MEM2REG,
+	IrPass_SCCP,
+	IrPass_DCE,
+	IrPass_SIMPLIFYCFG,
+};
+
+static const IrPass PIPELINE_O2[] = {
+	IrPass_INLINE,
+	IrPass_SIMPLIFYCFG,
+	IrPass_MEM2REG,
+	IrPass_SCCP,
+	IrPass_DCE,
+	IrPass_SIMPLIFYCFG,
+	IrPass_GVN,
+	IrPass_LOOPSIMPLIFY,
+	IrPass_LICM,
+	IrPass_LOOPREDUCE,
+	IrPass_MEM2REG,
+	IrPass_DCE,
+};
+
+/* `prune`: delete the functions left unused afterwards. */
+static const struct {
+	const IrPass *passes;
+	u32 count;
+	bool prune;
+} PIPELINES[IR_OPT_MAX_LEVEL + 1] = {
+	{ NULL, 0, false },
+	{ PIPELINE_O1, sizeof(PIPELINE_O1) / sizeof(*PIPELINE_O1), false },
+	{ PIPELINE_O2, sizeof(PIPELINE_O2) / sizeof(*PIPELINE_O2), true },
+};
+
+IrPass ir_pass_lookup(const char *name)
+{
+	for (u32 i = 0; i < IrPass_COUNT; ++i)
+		if (strcmp(PASSES[i].name, name) == 0)
+			return (IrPass)i;
+	return IrPass_COUNT;
+}
+
+/*
+ * ==========================================================================
+ * 2. Analyses
+ * ==========================================================================
+ */
+
+static void compute(struct PassManager *pm, IrAnalysis a)
+{
+	switch (a) {
+	case IrAnalysis_CFG:
+		ir_cfg_build(&pm->cfg, pm->fn);
+		break;
+	case IrAnalysis_DOMTREE:
+		ir_domtree_build(&pm->domtree, &pm->cfg);
+		break;
+	case IrAnalysis_POSTDOMTREE:
+		ir_postdomtree_build(&pm->postdomtree, &pm->cfg);
+		break;
+	case IrAnalysis_DOMFRONTIER:
+		ir_domfrontier_build(&pm->domfrontier, &pm->cfg, &pm->domtree);
+		break;
+	case IrAnalysis_LOOPS:
+		ir_loops_build(&pm->loops, &pm->cfg, &pm->domtree);
+		break;
+	case IrAnalysis_LIVENESS:
+		ir_liveness_build(&pm->liveness, pm->fn, &pm->cfg);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Brings `a`, and first what it depends on, up to date. */
+static void require(struct PassManager *pm, IrAnalysis a)
+{
+	struct PassStats *st = compile_stats.enabled
+				       ? stats_pass(ANALYSIS_NAMES[a], true)
+				       : NULL;
+	if (pm->valid & (1u << a)) {
+		if (st)
+			st->hits++;
+		return;
+	}
+	for (u32 d = 0; d < IrAnalysis_COUNT; ++d)
+		if (ANALYSIS_DEPENDS[a] & (1u << d))
+			require(pm, (IrAnalysis)d);
+
+	TRACE_SCOPE(ANALYSIS_NAMES[a]);
+	double start = st ? stats_now_us() : 0;
+	compute(pm, a);
+	pm->valid |= 1u << a;
+	if (st) {
+		double took = stats_now_us() - start;
+		st->runs++;
+		st->wall_us += took;
+		pm->analysis_us += took;
+	}
+}
+
+const struct IrCfg *pm_cfg(struct PassManager *pm)
+{
+	require(pm, IrAnalysis_CFG);
+	return &pm->cfg;
+}
+
+const struct IrDomTree *pm_domtree(struct PassManager *pm)
+{
+	require(pm, IrAnalysis_DOMTREE);
+	return &pm->domtree;
+}
+
+const struct IrPostDomTree *pm_postdomtree(struct PassManager *pm)
+{
+	require(pm, IrAnalysis_POSTDOMTREE);
+	return &pm->postdomtree;
+}
+
+const struct IrDomFrontier *pm_domfrontier(struct PassManager *pm)
+{
+	require(pm, IrAnalysis_DOMFRONTIER);
+	return &pm->domfrontier;
+}
+
+const struct IrLoops *pm_loops(struct PassManager *pm)
+{
+	require(pm, IrAnalysis_LOOPS);
+	return &pm->loops;
+}
+
+const struct IrLiveness *pm_liveness(struct PassManager *pm)
+{
+	require(pm, IrAnalysis_LIVENESS);
+	return &pm->liveness;
+}
+
+void pm_invalidate(struct PassManager *pm, IrAnalysisSet preserved)
+{
+	pm->valid &= preserved;
+	/* Dependencies come first in the table, so one sweep settles it. */
+	for (u32 a = 0; a < IrAnalysis_COUNT; ++a)
+		if (ANALYSIS_DEPENDS[a] & ~pm->valid)
+			pm->valid &= ~(1u << a);
+}
+
+void pm_deinit(struct PassManager *pm)
+{
+	ir_buf_deinit(&pm->cfg.buf);
+	ir_buf_deinit(&pm->domtree.buf);
+	ir_buf_deinit(&pm->postdomtree.tree.buf);
+	ir_buf_deinit(&pm->postdomtree.buf);
+	ir_buf_deinit(&pm->domfrontier.buf);
+	ir_buf_deinit(&pm->domfrontier.list);
+	ir_buf_deinit(&pm->loops.buf);
+	ir_buf_deinit(&pm->loops.exit_buf);
+	ir_buf_deinit(&pm->liveness.buf);
+	ir_buf_deinit(&pm->liveness.bits);
+}
+
+/*
+ * ==========================================================================
+ * 3. Running Passes
+ * ==========================================================================
+ */
+
+static void ir_size(const struct IrFunc *fn, u64 *insts, u64 *blocks)
+{
+	*blocks = ir_block_count(fn);
+	*insts = 0;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb)
+		ir_foreach_inst(fn, bb, v)
+			++*insts;
+}
+
+static bool run_pass(struct PassManager *pm, IrPass id,
+		     const struct IrOptOptions *opts)
+{
+	const struct PassInfo *pass = &PASSES[id];
+	TRACE_SCOPE_ARG(pass->name, pm->fn->name);
+	struct PassStats *st = compile_stats.enabled
+				       ? stats_pass(pass->name, false)
+				       : NULL;
+	double start = 0;
+	if (st) {
+		u64 insts, blocks;
+		ir_size(pm->fn, &insts, &blocks);
+		st->insts_before += insts;
+		st->blocks_before += blocks;
+		pm->analysis_us = 0;
+		start = stats_now_us();
+	}
+
+	for (u32 a = 0; a < IrAnalysis_COUNT; ++a)
+		if (pass->requires & (1u << a))
+			require(pm, (IrAnalysis)a);
+	IrAnalysisSet preserved = pass->run(pm);
+	pm_invalidate(pm, preserved);
+
+	if (st) {
+		u64 insts, blocks;
+		st->wall_us += stats_now_us() - start - pm->analysis_us;
+		st->runs++;
+		st->changed += preserved != IR_PRESERVE_ALL;
+		ir_size(pm->fn, &insts, &blocks);
+		st->insts_after += insts;
+		st->blocks_after += blocks;
+	}
+
+	const char *after = opts->print_after;
+	if (after && (strcmp(after, "all") == 0 ||
+		      strcmp(after, pass->name) == 0)) {
+		fprintf(opts->dump, "; IR after %s\n", pass->name);
+		ir_print_func(opts->dump, pm->m, pm->fn);
+	}
+	if (opts->verify_each && !ir_verify_func(pm->m, pm->fn, opts->err)) {
+		fprintf(opts->err, "ir verify: after pass '%s'\n", pass->name);
+		return false;
+	}
+	return true;
+}
+
+bool ir_optimize(struct IrModule *m, const struct IrOptOptions *opts)
+{
+	u32 level = opts->level;
+	if (level > IR_OPT_MAX_LEVEL)
+		level = IR_OPT_MAX_LEVEL;
+	if (!PIPELINES[level].count)
+		return true;
+
+	TRACE_SCOPE("opt");
+	struct IrCallGraph calls = { 0 };
+	ir_callgraph_build(&calls, m);
+	struct PassManager pm = { .m = m, .calls = &calls, .opts = opts };
+	bool ok = true;
+	for (u32 i = 0; i < calls.norder && ok; ++i) {
+		pm.fn = &m->funcs.data[calls.order[i]];
+		pm.valid = IR_PRESERVE_NONE;
+		for (u32 p = 0; p < PIPELINES[level].count && ok; ++p)
+			ok = run_pass(&pm, PIPELINES[level].passes[p], opts);
+	}
+	pm_deinit(&pm);
+	ir_buf_deinit(&calls.buf);
+	if (ok && PIPELINES[level].prune)
+		ir_prune_funcs(m, opts->remarks);
+	return ok;
+}
@@ -0,0 +1,98 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <prelude.h>
+#include <sema.h>
+#include <type.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+#include <threads.h>
+
+/*
+ * ==========================================================================
+ * 1. Names
+ * ==========================================================================
+ */
+
+const TokenKind prelude_keyword_kinds[PreludeKeyword_COUNT] = {
+#define TOK(ID)
+#define PUNCT(ID, STR)
+#define KW(ID, STR) TokenKind_##ID,
+#include <token.def>
+};
+
+static const char *const prelude_names[PRELUDE_SYMBOLS] = {
+#define TOK(ID)
+#define PUNCT(ID, STR)
+#define KW(ID, STR) STR,
+#include <token.def>
+#define PRELUDE_NAME(NAME, RET, PARAM) #NAME,
+	PRELUDE_BUILTINS(PRELUDE_NAME)
+#undef PRELUDE_NAME
+};
+
+static void build_prelude(void);
+static once_flag prelude_once = ONCE_FLAG_INIT;
+
+void prelude_intern(interner_t *itn)
+{
+	/* Every Context comes through here before its first lookup. */
+	call_once(&prelude_once, build_prelude);
+
+	for (u32 i = 0; i < PRELUDE_SYMBOLS; ++i) {
+		symbol_t sym = intern_cstr(itn, prelude_names[i]);
+		massert(sym.id == i, "Prelude must be interned first (got %u)",
+			sym.id);
+	}
+}
+
+/*
+ * ==========================================================================
+ * 2. Builtins
+ * ==========================================================================
+ */
+
+static struct SemaSymbol prelude_builtins[PreludeBuiltin_COUNT];
+
+static void add_builtin(PreludeBuiltin b, struct Type *ret, struct Type *param)
+{
+	/* Shared by every compilation and never freed. */
+	struct Type *ty = type_func_new(allocer_system(), ret);
+	if (param != ty_void)
+		massert(vec_push(ty->data.func.params, param), "OOM prelude");
+
+	prelude_builtins[b] = (struct SemaSymbol){
+		.name = PRELUDE_BUILTIN_SYM(b),
+		.ty = ty,
+		.is_global = true,
+	};
+}
+
+static void build_prelude(void)
+{
+#define PRELUDE_ADD(NAME, RET, PARAM) \
+	add_builtin(PreludeBuiltin_##NAME, ty_##RET, ty_##PARAM);
+	PRELUDE_BUILTINS(PRELUDE_ADD)
+#undef PRELUDE_ADD
+}
+
+const struct SemaSymbol *prelude_lookup(symbol_t sym)
+{
+	u32 b = sym.id - (u32)PreludeKeyword_COUNT;
+	if (sym.id < (u32)PreludeKeyword_COUNT || b >= PreludeBuiltin_COUNT)
+		return NULL;
+	return &prelude_builtins[b];
+}
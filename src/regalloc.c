@@ -0,0 +1,398 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <regalloc.h>
+#include <trace.h>
+
+/*
+ * ==========================================================================
+ * 1. Scratch Storage
+ * ==========================================================================
+ * Per value: start, end, definition position and a link in the list of
+ * intervals that start at one position. Per block: start and end. Per
+ * position: the head of that list. `loc` is sized apart, and liveness
+ * comes from cfg.h.
+ */
+
+typedef struct Ra {
+	struct RaFunc *out;
+	const struct IrFunc *fn;
+	const struct RaTarget *t;
+	u32 ninsts;
+	u32 nblocks;
+	u32 npos;
+
+	u32 *at;
+	u32 *next;
+	u32 *first;
+
+	/* Positions of calls, ascending. */
+	u32 *calls;
+	u32 ncalls;
+} Ra;
+
+static usize buf_words(u32 ninsts, u32 nblocks, u32 npos)
+{
+	/* start, end, at, next; calls; block start / end; first. */
+	return 4 * (usize)ninsts + ninsts + 2 * (usize)nblocks + npos;
+}
+
+static void ra_reserve(struct RaFunc *out, Ra *ra)
+{
+	usize words = buf_words(ra->ninsts, ra->nblocks, ra->npos);
+	if (words > out->cap) {
+		if (out->buf) {
+			ir_drop(out->buf, out->cap * sizeof(u32));
+			ir_drop(out->loc, out->cap * sizeof(struct RaLoc));
+		}
+		out->cap = words * 2;
+		out->buf = ir_grab(out->cap * sizeof(u32));
+		/* loc needs ninsts entries; the cap bounds that too. */
+		out->loc = ir_grab(out->cap * sizeof(struct RaLoc));
+	}
+	u32 *p = out->buf;
+	out->start = p;
+	out->end = p += ra->ninsts;
+	ra->at = p += ra->ninsts;
+	ra->next = p += ra->ninsts;
+	ra->calls = p += ra->ninsts;
+	out->block_start = p += ra->ninsts;
+	out->block_end = p += ra->nblocks;
+	ra->first = p + ra->nblocks;
+}
+
+void ra_deinit(struct RaFunc *ra)
+{
+	ir_buf_deinit(&ra->cfg.buf);
+	ir_buf_deinit(&ra->liveness.buf);
+	ir_buf_deinit(&ra->liveness.bits);
+	if (ra->buf) {
+		ir_drop(ra->buf, ra->cap * sizeof(u32));
+		ir_drop(ra->loc, ra->cap * sizeof(struct RaLoc));
+	}
+	*ra = (struct RaFunc){ 0 };
+}
+
+/*
+ * ==========================================================================
+ * 2. Intervals
+ * ==========================================================================
+ */
+
+static bool is_remat(IrOp op)
+{
+	return op == IrOp_CONST || op == IrOp_GLOBAL || op == IrOp_ALLOCA;
+}
+
+static void widen(struct RaFunc *out, IrValue v, u32 pos)
+{
+	if (pos < out->start[v])
+		out->start[v] = pos;
+	if (pos > out->end[v])
+		out->end[v] = pos;
+}
+
+/*
+ * Numbers positions, decides which values need a location, and sets
+ * every interval to span its definition and the uses in its own block.
+ */
+static void number(Ra *ra)
+{
+	struct RaFunc *out = ra->out;
+	const struct IrFunc *fn = ra->fn;
+	u32 pos = 2;
+
+	for (u32 bb = 1; bb < ra->nblocks; ++bb) {
+		out->block_start[bb] = pos;
+		pos += 2;
+		ir_foreach_inst(fn, bb, v)
+		{
+			const struct IrInst *inst = ir_inst(fn, v);
+			ra->at[v] = pos;
+			if (inst->op == IrOp_CALL || inst->op == IrOp_ZERO)
+				ra->calls[ra->ncalls++] = pos;
+			out->block_end[bb] = pos;
+			pos += 2;
+		}
+	}
+
+	for (IrValue v = 1; v < ra->ninsts; ++v) {
+		const struct IrInst *inst = ir_inst(fn, v);
+		out->loc[v] = (struct RaLoc){ .kind = RaLoc_NONE };
+		out->start[v] = UINT32_MAX;
+		out->end[v] = 0;
+		if (is_remat((IrOp)inst->op))
+			out->loc[v].kind = RaLoc_REMAT;
+		else if (inst->op == IrOp_PARAM)
+			widen(out, v, 0);
+		else if (inst->op == IrOp_PHI)
+			widen(out, v, out->block_start[inst->block]);
+		else if (inst->block && inst->ty != IrType_VOID)
+			widen(out, v, ra->at[v] + 1);
+	}
+
+	for (u32 bb = 1; bb < ra->nblocks; ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			const struct IrInst *inst = ir_inst(fn, v);
+			const IrValue *args = ir_args(fn, v);
+			bool phi = inst->op == IrOp_PHI;
+			ir_foreach_operand(fn, v, i)
+			{
+				IrValue u = args[i];
+				const struct IrInst *def = ir_inst(fn, u);
+				if (is_remat((IrOp)def->op))
+					continue;
+				/* A PHI reads at the end of the incoming block. */
+				u32 use = phi ? out->block_end[args[i - 1]]
+					      : ra->at[v];
+				widen(out, u, use);
+				if (phi)
+					widen(out, v, use);
+			}
+		}
+	}
+	ra->npos = pos;
+}
+
+/* Widens values over the blocks they are live into or out of. */
+static void widen_live(Ra *ra, const struct IrLiveness *lv)
+{
+	struct RaFunc *out = ra->out;
+	u32 W = lv->words;
+	for (u32 bb = 1; bb < ra->nblocks; ++bb) {
+		for (u32 side = 0; side < 2; ++side) {
+			const u64 *set = (side ? lv->live_out : lv->live_in) +
+					 (usize)bb * W;
+			u32 pos = side ? out->block_end[bb] + 1
+				       : out->block_start[bb];
+			for (u32 w = 0; w < W; ++w) {
+				for (u64 bits = set[w]; bits; bits &= bits - 1) {
+					u32 k = w * 64 + (u32)__builtin_ctzll(bits);
+					IrValue v = lv->values[k];
+					if (out->loc[v].kind != RaLoc_REMAT)
+						widen(out, v, pos);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * ==========================================================================
+ * 3. Linear Scan
+ * ==========================================================================
+ */
+
+/* Spilled intervals by end, to give their slots back. */
+struct SlotEnd {
+	u32 end;
+	u32 slot;
+};
+
+typedef struct Scan {
+	/* Values holding registers. */
+	IrValue active[64];
+	u32 nactive;
+	IrValue owner[64];
+
+	struct SlotEnd *heap;
+	u32 nheap;
+	u32 *free_slots;
+	u32 nfree;
+	/* Per slot: end of its last holder. */
+	u32 *slot_end;
+} Scan;
+
+static void heap_push(Scan *s, struct SlotEnd x)
+{
+	u32 i = s->nheap++;
+	while (i && s->heap[(i - 1) / 2].end > x.end) {
+		s->heap[i] = s->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	s->heap[i] = x;
+}
+
+static struct SlotEnd heap_pop(Scan *s)
+{
+	struct SlotEnd top = s->heap[0], last = s->heap[--s->nheap];
+	u32 i = 0;
+	for (;;) {
+		u32 c = 2 * i + 1;
+		if (c >= s->nheap)
+			break;
+		if (c + 1 < s->nheap && s->heap[c + 1].end < s->heap[c].end)
+			++c;
+		if (s->heap[c].end >= last.end)
+			break;
+		s->heap[i] = s->heap[c];
+		i = c;
+	}
+	s->heap[i] = last;
+	return top;
+}
+
+static bool crosses_call(const Ra *ra, u32 start, u32 end)
+{
+	u32 lo = 0, hi = ra->ncalls;
+	while (lo < hi) {
+		u32 mid = (lo + hi) / 2;
+		if (ra->calls[mid] <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < ra->ncalls && ra->calls[lo] < end;
+}
+
+static bool is_float(const struct IrFunc *fn, IrValue v)
+{
+	IrType ty = (IrType)ir_inst(fn, v)->ty;
+	return ty == IrType_F32 || ty == IrType_F64;
+}
+
+/*
+ * A slot is v's for all of v's interval. An evicted v started before
+ * now, so it may only take a slot freed before it started.
+ */
+static void spill(Ra *ra, Scan *s, IrValue v)
+{
+	struct RaFunc *out = ra->out;
+	u32 slot = UINT32_MAX;
+	for (u32 i = s->nfree; i-- > 0;) {
+		if (s->slot_end[s->free_slots[i]] < out->start[v]) {
+			slot = s->free_slots[i];
+			s->free_slots[i] = s->free_slots[--s->nfree];
+			break;
+		}
+	}
+	if (slot == UINT32_MAX)
+		slot = out->nslots++;
+	out->loc[v] = (struct RaLoc){ .kind = RaLoc_SLOT, .slot = slot };
+	s->slot_end[slot] = out->end[v];
+	heap_push(s, (struct SlotEnd){ out->end[v], slot });
+}
+
+static void expire(Ra *ra, Scan *s, u32 pos)
+{
+	struct RaFunc *out = ra->out;
+	for (u32 i = 0; i < s->nactive;) {
+		IrValue v = s->active[i];
+		if (out->end[v] < pos) {
+			s->owner[out->loc[v].reg] = IR_NONE;
+			s->active[i] = s->active[--s->nactive];
+		} else {
+			++i;
+		}
+	}
+	while (s->nheap && s->heap[0].end < pos)
+		s->free_slots[s->nfree++] = heap_pop(s).slot;
+}
+
+static void allocate(Ra *ra, Scan *s, IrValue v)
+{
+	struct RaFunc *out = ra->out;
+	const struct RaTarget *t = ra->t;
+	bool fl = is_float(ra->fn, v);
+	const u8 *regs = fl ? t->float_regs : t->int_regs;
+	u32 nregs = fl ? t->nfloat : t->nint;
+	u64 allowed = 0;
+	bool call = crosses_call(ra, out->start[v], out->end[v]);
+	for (u32 i = 0; i < nregs; ++i)
+		if (!call || (t->callee_saved >> regs[i] & 1))
+			allowed |= 1ull << regs[i];
+
+	for (u32 i = 0; i < nregs; ++i) {
+		u8 r = regs[i];
+		if ((allowed >> r & 1) && !s->owner[r]) {
+			out->loc[v] = (struct RaLoc){ .kind = RaLoc_REG, .reg = r };
+			out->used_regs |= 1ull << r;
+			s->owner[r] = v;
+			s->active[s->nactive++] = v;
+			return;
+		}
+	}
+
+	/* Evict the allowed holder that lives longest, if it outlives v. */
+	u32 victim = UINT32_MAX;
+	for (u32 i = 0; i < s->nactive; ++i) {
+		IrValue a = s->active[i];
+		if (!(allowed >> out->loc[a].reg & 1))
+			continue;
+		if (victim == UINT32_MAX ||
+		    out->end[a] > out->end[s->active[victim]])
+			victim = i;
+	}
+	if (victim == UINT32_MAX || out->end[s->active[victim]] <= out->end[v]) {
+		spill(ra, s, v);
+		return;
+	}
+	IrValue a = s->active[victim];
+	u8 r = out->loc[a].reg;
+	spill(ra, s, a);
+	out->loc[v] = (struct RaLoc){ .kind = RaLoc_REG, .reg = r };
+	s->owner[r] = v;
+	s->active[victim] = v;
+}
+
+static void scan(Ra *ra)
+{
+	struct RaFunc *out = ra->out;
+	for (u32 p = 0; p < ra->npos; ++p)
+		ra->first[p] = IR_NONE;
+	/* Backwards, so each list comes out in value order. */
+	for (IrValue v = ra->ninsts - 1; v >= 1; --v) {
+		if (out->loc[v].kind != RaLoc_NONE || out->end[v] == 0)
+			continue;
+		u32 p = out->start[v];
+		ra->next[v] = ra->first[p];
+		ra->first[p] = v;
+	}
+
+	Scan s = { .heap = ir_grab(ra->ninsts * sizeof(struct SlotEnd)),
+		   .free_slots = ir_grab(ra->ninsts * sizeof(u32)),
+		   .slot_end = ir_grab(ra->ninsts * sizeof(u32)) };
+	for (u32 p = 0; p < ra->npos; ++p) {
+		if (!ra->first[p])
+			continue;
+		expire(ra, &s, p);
+		for (IrValue v = ra->first[p]; v; v = ra->next[v])
+			allocate(ra, &s, v);
+	}
+	ir_drop(s.heap, ra->ninsts * sizeof(struct SlotEnd));
+	ir_drop(s.free_slots, ra->ninsts * sizeof(u32));
+	ir_drop(s.slot_end, ra->ninsts * sizeof(u32));
+}
+
+void ra_run(struct RaFunc *out, const struct IrFunc *fn,
+	    const struct RaTarget *t)
+{
+	TRACE_SCOPE_ARG("regalloc", fn->name);
+	Ra ra = { .out = out, .fn = fn, .t = t };
+	ra.ninsts = (u32)vec_len(fn->insts);
+	ra.nblocks = (u32)vec_len(fn->blocks);
+	ra.npos = 2 * ra.ninsts + 2 * ra.nblocks + 2;
+	ra_reserve(out, &ra);
+	out->nslots = 0;
+	out->used_regs = 0;
+
+	number(&ra);
+	ir_cfg_build(&out->cfg, fn);
+	ir_liveness_build(&out->liveness, fn, &out->cfg);
+	widen_live(&ra, &out->liveness);
+	scan(&ra);
+}
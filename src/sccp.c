@@ -0,0 +1,553 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * sccp: sparse conditional constant propagation (Wegman and Zadeck).
+ * Each value sits on a lattice, unknown above constant above varying,
+ * and each CFG edge is executable or not; both only ever move down, from
+ * the entry, one worklist of blocks and one of values at a time. A PHI
+ * only meets what comes in over executable edges, so a branch that is
+ * never taken does not spoil the constants it would have brought.
+ *
+ * Then values found constant are replaced, branches with one executable
+ * edge become BR and blocks never reached are deleted.
+ */
+
+#include <pass.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. The Lattice
+ * ==========================================================================
+ */
+
+typedef enum CellState {
+	Cell_UNKNOWN,
+	Cell_CONST,
+	Cell_VARYING,
+} CellState;
+
+/*
+ * A scalar constant, or, for a PTR, an address in a const global:
+ * `global` + 1 and the byte offset in `k.i`.
+ */
+struct Cell {
+	u8 state;
+	u32 global;
+	union IrConstBits k;
+};
+
+static const struct Cell UNKNOWN = { Cell_UNKNOWN, 0, { 0 } };
+static const struct Cell VARYING = { Cell_VARYING, 0, { 0 } };
+
+static struct Cell constant(IrType ty, union IrConstBits k)
+{
+	struct Cell c = { Cell_CONST, 0, { 0 } };
+	switch (ty) {
+	case IrType_I1:
+		c.k.b = k.b;
+		break;
+	case IrType_I32:
+		c.k.i = k.i;
+		break;
+	case IrType_F32:
+		c.k.f = k.f;
+		break;
+	default:
+		c.k.d = k.d;
+	}
+	return c;
+}
+
+/* Bit for bit, so -0.0 is not 0.0 and a NaN is itself. */
+static bool cell_eq(struct Cell a, struct Cell b)
+{
+	return a.state == b.state && a.global == b.global &&
+	       memcmp(&a.k, &b.k, sizeof(a.k)) == 0;
+}
+
+static struct Cell meet(struct Cell a, struct Cell b)
+{
+	if (a.state == Cell_UNKNOWN)
+		return b;
+	if (b.state == Cell_UNKNOWN || cell_eq(a, b))
+		return a;
+	return VARYING;
+}
+
+/*
+ * ==========================================================================
+ * 2. Folding
+ * ==========================================================================
+ * With the semantics of the VM: i32 wraps, INT_MIN / -1 is INT_MIN and
+ * division by zero is left to fail at run time. f32 and f64 are folded in
+ * their own precision, which IEEE makes exact.
+ */
+
+static bool fold_i32(IrOp op, i32 a, i32 b, i32 *out)
+{
+	u32 x = (u32)a, y = (u32)b;
+	switch (op) {
+	case IrOp_ADD:
+		*out = (i32)(x + y);
+		return true;
+	case IrOp_SUB:
+		*out = (i32)(x - y);
+		return true;
+	case IrOp_MUL:
+		*out = (i32)(x * y);
+		return true;
+	case IrOp_DIV:
+		if (b == 0)
+			return false;
+		*out = b == -1 ? (i32)(0u - x) : a / b;
+		return true;
+	case IrOp_MOD:
+		if (b == 0)
+			return false;
+		*out = b == -1 ? 0 : a % b;
+		return true;
+	default:
+		return false;
+	}
+}
+
+#define FOLD_FLOAT(op, a, b, out)         \
+	switch (op) {                     \
+	case IrOp_ADD:                    \
+		*(out) = (a) + (b);       \
+		return true;              \
+	case IrOp_SUB:                    \
+		*(out) = (a) - (b);       \
+		return true;              \
+	case IrOp_MUL:                    \
+		*(out) = (a) * (b);       \
+		return true;              \
+	case IrOp_DIV:                    \
+		*(out) = (a) / (b);       \
+		return true;              \
+	default:                          \
+		return false;             \
+	}
+
+static bool fold_f32(IrOp op, f32 a, f32 b, f32 *out)
+{
+	FOLD_FLOAT(op, a, b, out)
+}
+
+static bool fold_f64(IrOp op, f64 a, f64 b, f64 *out)
+{
+	FOLD_FLOAT(op, a, b, out)
+}
+
+/* Ordered compares are false on a NaN, and NE true. */
+#define FOLD_COMPARE(op, a, b)                  \
+	((op) == IrOp_EQ   ? (a) == (b)         \
+	 : (op) == IrOp_NE ? (a) != (b)         \
+	 : (op) == IrOp_LT ? (a) < (b)          \
+	 : (op) == IrOp_LE ? (a) <= (b)         \
+	 : (op) == IrOp_GT ? (a) > (b)          \
+			   : (a) >= (b))
+
+static bool fold_compare(IrOp op, IrType ty, union IrConstBits a,
+			 union IrConstBits b)
+{
+	switch (ty) {
+	case IrType_I1:
+		return FOLD_COMPARE(op, (int)a.b, (int)b.b);
+	case IrType_I32:
+		return FOLD_COMPARE(op, a.i, b.i);
+	case IrType_F32:
+		return FOLD_COMPARE(op, a.f, b.f);
+	default:
+		return FOLD_COMPARE(op, a.d, b.d);
+	}
+}
+
+/* `op` on constants of type `ty`; false where that is not a constant. */
+static bool fold(IrOp op, IrType ty, union IrConstBits a, union IrConstBits b,
+		 union IrConstBits *out)
+{
+	switch (op) {
+	case IrOp_NEG:
+		if (ty == IrType_I32)
+			out->i = (i32)(0u - (u32)a.i);
+		else if (ty == IrType_F32)
+			out->f = -a.f;
+		else
+			out->d = -a.d;
+		return true;
+	case IrOp_NOT:
+		out->b = !a.b;
+		return true;
+	case IrOp_EQ:
+	case IrOp_NE:
+	case IrOp_LT:
+	case IrOp_LE:
+	case IrOp_GT:
+	case IrOp_GE:
+		out->b = fold_compare(op, ty, a, b);
+		return true;
+	default:
+		break;
+	}
+	if (ty == IrType_I32)
+		return fold_i32(op, a.i, b.i, &out->i);
+	if (ty == IrType_F32)
+		return fold_f32(op, a.f, b.f, &out->f);
+	if (ty == IrType_F64)
+		return fold_f64(op, a.d, b.d, &out->d);
+	return false;
+}
+
+/*
+ * ==========================================================================
+ * 3. Propagation
+ * ==========================================================================
+ */
+
+struct Sccp {
+	const struct IrModule *m;
+	struct IrFunc *fn;
+	const struct IrCfg *cfg;
+	struct Cell *cells;
+	/* Executable blocks, and edges by their index in cfg->succs. */
+	bool *reached;
+	bool *taken;
+	/* Users of each value, in blocks: users[user_start[v] ..). */
+	u32 *user_start;
+	u32 *users;
+	IrU32Vec blocks;
+	IrU32Vec values;
+};
+
+/* Operands that are in no block have their cell made up on the spot. */
+static struct Cell cell_of(const struct Sccp *s, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(s->fn, v);
+	switch (inst->op) {
+	case IrOp_CONST:
+		return constant((IrType)inst->ty, inst->imm.k);
+	case IrOp_GLOBAL:
+		if (!vec_at(s->m->globals, inst->imm.index).is_const)
+			return VARYING;
+		return (struct Cell){ Cell_CONST, inst->imm.index + 1, { 0 } };
+	case IrOp_PARAM:
+		return VARYING;
+	default:
+		return s->cells[v];
+	}
+}
+
+/* An element of a const global, if `addr` is one. */
+static struct Cell load_const(const struct Sccp *s, IrType ty,
+			      struct Cell addr)
+{
+	if (addr.state != Cell_CONST || !addr.global)
+		return addr.state == Cell_UNKNOWN ? UNKNOWN : VARYING;
+	const struct IrGlobal *g = &s->m->globals.data[addr.global - 1];
+	u32 size = ir_type_size(g->elem);
+	i32 off = addr.k.i;
+	if (g->elem != ty || off < 0 || (u32)off % size ||
+	    (u32)off / size >= g->count)
+		return VARYING;
+	union IrConstBits k = { 0 };
+	if (g->init)
+		memcpy(&k, (const u8 *)g->init + off, size);
+	return constant(ty, k);
+}
+
+static struct Cell evaluate(const struct Sccp *s, IrValue v)
+{
+	const struct IrFunc *fn = s->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	const IrValue *args = ir_args(fn, v);
+	IrOp op = (IrOp)inst->op;
+
+	if (op == IrOp_PHI) {
+		const struct IrCfg *cfg = s->cfg;
+		struct Cell c = UNKNOWN;
+		for (u32 i = 0; i < inst->nargs; i += 2) {
+			u32 pred = args[i];
+			for (u32 e = cfg->succ_start[pred];
+			     e < cfg->succ_start[pred + 1]; ++e)
+				if (cfg->succs[e] == inst->block && s->taken[e])
+					c = meet(c, cell_of(s, args[i + 1]));
+		}
+		return c;
+	}
+	if (op == IrOp_LOAD)
+		return load_const(s, (IrType)inst->ty, cell_of(s, args[0]));
+
+	if (op == IrOp_INDEX) {
+		struct Cell base = cell_of(s, args[0]);
+		struct Cell index = cell_of(s, args[1]);
+		if (base.state == Cell_UNKNOWN || index.state == Cell_UNKNOWN)
+			return UNKNOWN;
+		if (base.state != Cell_CONST || !base.global ||
+		    index.state != Cell_CONST)
+			return VARYING;
+		i64 off = (i64)base.k.i +
+			  (i64)index.k.i * (i64)inst->imm.mem.size;
+		if (off < 0 || off > INT32_MAX)
+			return VARYING;
+		base.k.i = (i32)off;
+		return base;
+	}
+
+	bool unary = op == IrOp_NEG || op == IrOp_NOT;
+	bool binary = op >= IrOp_ADD && op <= IrOp_GE && !unary;
+	if (!unary && !binary)
+		return VARYING;
+	struct Cell a = cell_of(s, args[0]);
+	struct Cell b = binary ? cell_of(s, args[1]) : a;
+	if (a.state == Cell_VARYING || b.state == Cell_VARYING)
+		return VARYING;
+	if (a.state == Cell_UNKNOWN || b.state == Cell_UNKNOWN)
+		return UNKNOWN;
+	/* Compares fold at the type of their operands. */
+	IrType ty = (IrType)ir_inst(fn, args[0])->ty;
+	union IrConstBits k = { 0 };
+	if (!fold(op, ty, a.k, b.k, &k))
+		return VARYING;
+	return constant((IrType)inst->ty, k);
+}
+
+static void mark_edge(struct Sccp *s, u32 e);
+
+/* Re-evaluates `v`, or the edges out of its block if it branches. */
+static void visit(struct Sccp *s, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(s->fn, v);
+	const struct IrCfg *cfg = s->cfg;
+	u32 bb = inst->block;
+
+	if (inst->op == IrOp_BR || inst->op == IrOp_CONDBR) {
+		struct Cell cond = inst->op == IrOp_CONDBR
+					   ? cell_of(s, ir_args(s->fn, v)[0])
+					   : VARYING;
+		if (cond.state == Cell_UNKNOWN)
+			return;
+		for (u32 e = cfg->succ_start[bb]; e < cfg->succ_start[bb + 1];
+		     ++e) {
+			u32 to = cfg->succs[e];
+			if (cond.state == Cell_VARYING ||
+			    to == inst->imm.target[cond.k.b ? 0 : 1])
+				mark_edge(s, e);
+		}
+		return;
+	}
+	if (inst->ty == IrType_VOID)
+		return;
+
+	struct Cell old = s->cells[v];
+	if (old.state == Cell_VARYING)
+		return;
+	struct Cell c = evaluate(s, v);
+	if (old.state == Cell_CONST && !cell_eq(old, c))
+		c = VARYING;
+	if (cell_eq(old, c))
+		return;
+	s->cells[v] = c;
+	massert(vec_push(s->values, v), "OOM sccp");
+}
+
+static void mark_edge(struct Sccp *s, u32 e)
+{
+	if (s->taken[e])
+		return;
+	s->taken[e] = true;
+	u32 to = s->cfg->succs[e];
+	if (!s->reached[to]) {
+		s->reached[to] = true;
+		massert(vec_push(s->blocks, to), "OOM sccp");
+		return;
+	}
+	/* Only the PHIs see the new edge. */
+	ir_foreach_inst(s->fn, to, v)
+	{
+		if (ir_inst(s->fn, v)->op != IrOp_PHI)
+			break;
+		visit(s, v);
+	}
+}
+
+static void build_users(struct Sccp *s)
+{
+	struct IrFunc *fn = s->fn;
+	u32 n = (u32)vec_len(fn->insts);
+	s->user_start = ir_grab((n + 1) * sizeof(u32));
+	for (int pass = 0; pass < 2; ++pass) {
+		for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+			ir_foreach_inst(fn, bb, v)
+			{
+				const IrValue *args = ir_args(fn, v);
+				ir_foreach_operand(fn, v, i)
+				{
+					if (pass == 0)
+						s->user_start[args[i] + 1]++;
+					else
+						s->users[s->user_start[args[i]]++] = v;
+				}
+			}
+		}
+		if (pass == 0) {
+			for (u32 v = 0; v < n; ++v)
+				s->user_start[v + 1] += s->user_start[v];
+			s->users = ir_grab(s->user_start[n] * sizeof(u32));
+		}
+	}
+	/* The fill moved each start to the next one's. */
+	for (u32 v = n; v > 0; --v)
+		s->user_start[v] = s->user_start[v - 1];
+	s->user_start[0] = 0;
+}
+
+static void propagate(struct Sccp *s)
+{
+	s->reached[1] = true;
+	massert(vec_push(s->blocks, 1), "OOM sccp");
+	while (vec_len(s->blocks) || vec_len(s->values)) {
+		while (vec_len(s->values)) {
+			IrValue v = s->values.data[--s->values.len];
+			for (u32 u = s->user_start[v]; u < s->user_start[v + 1];
+			     ++u) {
+				IrValue user = s->users[u];
+				if (s->reached[ir_inst(s->fn, user)->block])
+					visit(s, user);
+			}
+		}
+		if (vec_len(s->blocks)) {
+			u32 bb = s->blocks.data[--s->blocks.len];
+			ir_foreach_inst(s->fn, bb, v)
+				visit(s, v);
+		}
+	}
+}
+
+/*
+ * ==========================================================================
+ * 4. Rewriting
+ * ==========================================================================
+ */
+
+/* A CONDBR with one executable edge becomes a BR along it. */
+static bool fold_branches(struct Sccp *s)
+{
+	struct IrFunc *fn = s->fn;
+	const struct IrCfg *cfg = s->cfg;
+	bool changed = false;
+	for (u32 bb = 1; bb < cfg->nblocks; ++bb) {
+		IrValue term = ir_terminator(fn, bb);
+		if (!s->reached[bb] || !term ||
+		    ir_inst(fn, term)->op != IrOp_CONDBR)
+			continue;
+		u32 start = cfg->succ_start[bb];
+		if (cfg->succ_start[bb + 1] - start != 2 ||
+		    s->taken[start] == s->taken[start + 1])
+			continue;
+		u32 keep = cfg->succs[s->taken[start] ? start : start + 1];
+		u32 lose = cfg->succs[s->taken[start] ? start + 1 : start];
+		ir_drop_incoming(fn, lose, bb);
+		struct IrInst *inst = ir_inst(fn, term);
+		inst->op = IrOp_BR;
+		inst->nargs = 0;
+		inst->imm.target[0] = keep;
+		inst->imm.target[1] = IR_NONE;
+		changed = true;
+	}
+	return changed;
+}
+
+/* Replaces scalar values found constant; returns whether any was. */
+static bool replace_constants(struct Sccp *s)
+{
+	struct IrFunc *fn = s->fn;
+	u32 n = (u32)vec_len(fn->insts);
+	IrValue *folded = ir_grab(n * sizeof(IrValue));
+	bool changed = false;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		if (!s->reached[bb])
+			continue;
+		IrValue v = fn->blocks.data[bb].first;
+		while (v) {
+			IrValue next = ir_inst(fn, v)->next;
+			struct Cell c = s->cells[v];
+			IrType ty = (IrType)ir_inst(fn, v)->ty;
+			if (c.state == Cell_CONST && ty != IrType_PTR) {
+				struct IrConst k = { .ty = ty };
+				k.d = c.k.d;
+				folded[v] = ir_const(fn, k);
+				ir_remove(fn, v);
+				changed = true;
+			}
+			v = next;
+		}
+	}
+	if (changed) {
+		/* Sized for the new constants, which replace nothing. */
+		usize bytes = vec_len(fn->insts) * sizeof(IrValue);
+		IrValue *repl = ir_grab(bytes);
+		memcpy(repl, folded, n * sizeof(IrValue));
+		ir_replace_uses(fn, repl);
+		ir_drop(repl, bytes);
+	}
+	ir_drop(folded, n * sizeof(IrValue));
+	return changed;
+}
+
+IrAnalysisSet ir_sccp(struct PassManager *pm)
+{
+	struct IrFunc *fn = pm->fn;
+	allocer_t sys = allocer_system();
+	const struct IrCfg *cfg = pm_cfg(pm);
+	struct Sccp s = { .m = pm->m, .fn = fn, .cfg = cfg };
+	u32 n = (u32)vec_len(fn->insts);
+	u32 nedges = cfg->succ_start[cfg->nblocks];
+	s.cells = ir_grab(n * sizeof(struct Cell));
+	s.reached = ir_grab(cfg->nblocks);
+	s.taken = ir_grab(nedges);
+	massert(vec_init(s.blocks, sys, 64), "OOM sccp");
+	massert(vec_init(s.values, sys, 64), "OOM sccp");
+	build_users(&s);
+
+	propagate(&s);
+	bool folded = fold_branches(&s);
+	bool dead = false;
+	for (u32 bb = 1; bb < cfg->nblocks; ++bb)
+		dead |= !s.reached[bb];
+	bool replaced = replace_constants(&s);
+
+	u32 nusers = s.user_start[n];
+	u32 nblocks = cfg->nblocks;
+	if (dead)
+		ir_remove_unreachable(fn);
+
+	ir_drop(s.users, nusers * sizeof(u32));
+	ir_drop(s.user_start, (n + 1) * sizeof(u32));
+	ir_drop(s.taken, nedges);
+	ir_drop(s.reached, nblocks);
+	ir_drop(s.cells, n * sizeof(struct Cell));
+	vec_deinit(s.blocks);
+	vec_deinit(s.values);
+	if (folded || dead)
+		return IR_PRESERVE_NONE;
+	return replaced ? IR_PRESERVE_CFG : IR_PRESERVE_ALL;
+}
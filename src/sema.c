@@ -16,9 +16,15 @@
 
 #include <sema.h>
 #include <context.h>
+#include <stats.h>
+#include <trace.h>
+#include <prelude.h>
 #include <std/map.h>
+#include <std/allocers/system.h>
 #include <core/msg.h>
 
+#include <string.h>
+
 static u64 _sym_hash(const void *key)
 {
 	const symbol_t *s = (const symbol_t *)key;
@@ -35,63 +41,158 @@ void sema_init(struct Sema *s, struct Context *ctx)
 	s->ctx = ctx;
 	s->curr_scope = NULL;
 	s->curr_func_ret = NULL;
+	s->loop_depth = 0;
+	s->tracker = NULL;
+	s->alc = ctx->alc;
+}
+
+/*
+ * Locals are looked up through ctx->locals, which holds the innermost
+ * local binding of every name, rather than by probing each enclosing
+ * scope: the cost of a lookup must not grow with the nesting depth.
+ * Defining a local links it to the binding it hides, and leaving the
+ * scope puts that binding back.
+ */
+static struct SemaSymbol **local_slot(struct Context *ctx, symbol_t name)
+{
+	if (name.id >= ctx->locals_cap) {
+		usize old = ctx->locals_cap;
+		usize cap = old ? old : 256;
+		while (cap <= name.id)
+			cap *= 2;
+
+		usize esz = sizeof(*ctx->locals);
+		struct SemaSymbol **grown =
+			old ? allocer_realloc(allocer_system(), ctx->locals,
+					      layout(old * esz, 8), cap * esz)
+			    : allocer_alloc(allocer_system(),
+					    layout(cap * esz, 8));
+		massert(grown, "OOM local bindings");
+		memset(grown + old, 0, (cap - old) * esz);
+		ctx->locals = grown;
+		ctx->locals_cap = cap;
+	}
+	return &ctx->locals[name.id];
 }
 
+/*
+ * Scopes nest strictly and a symbol table only grows while its scope is
+ * the innermost one, so scope memory is a stack: leaving a scope releases
+ * the scope arena back to where it stood on entry. Symbols themselves are
+ * referenced from the AST and stay in the long-lived arena.
+ */
 void sema_scope_enter(struct Sema *s)
 {
-	struct Scope *sc = alloc_type(s->ctx->alc, struct Scope);
-	map_init(sc->symbols, s->ctx->alc, SEMA_MAP_OPS);
+	struct ArenaMark mark = arena_mark(&s->ctx->scopes);
+	allocer_t alc = arena_allocer(&s->ctx->scopes);
+
+	struct Scope *sc = alloc_type(alc, struct Scope);
+	map_init(sc->symbols, alc, SEMA_MAP_OPS);
+	massert(vec_init(sc->locals, alc, 4), "OOM scope");
+	sc->mark = mark;
 	sc->parent = s->curr_scope;
+	sc->global = sc->parent ? sc->parent->global : sc;
 	s->curr_scope = sc;
 }
 
 void sema_scope_leave(struct Sema *s)
 {
 	if (s->curr_scope) {
+		vec_foreach(it, s->curr_scope->locals)
+		{
+			*local_slot(s->ctx, (*it)->name) = (*it)->shadowed;
+		}
 		map_deinit(s->curr_scope->symbols);
 
 		struct Scope *parent = s->curr_scope->parent;
-		free_type(s->ctx->alc, s->curr_scope);
+		arena_release(&s->ctx->scopes, s->curr_scope->mark);
 
 		s->curr_scope = parent;
 	}
 }
 
+static bool is_visible(struct Sema *s, struct SemaSymbol *sym)
+{
+	return !sym->is_global || !s->tracker ||
+	       s->tracker->visible(s->tracker, sym);
+}
+
 struct SemaSymbol *sema_define_var(struct Sema *s, symbol_t name,
 				   struct Type *ty, bool is_const)
 {
+	STATS_LEAF(StatsPhase_SEMA);
 	if (!s->curr_scope)
 		return NULL;
 
-	if (map_get(s->curr_scope->symbols, name)) {
+	bool is_global = (s->curr_scope->parent == NULL);
+
+	/* Builtins count as part of the global scope. */
+	struct SemaSymbol **prev = map_get(s->curr_scope->symbols, name);
+	if ((prev && is_visible(s, *prev)) ||
+	    (is_global && prelude_lookup(name))) {
 		ctx_error(s->ctx, NULL,
 			  "Redefinition of symbol in the same scope");
 		return NULL;
 	}
+	struct SemaSymbol *sym = NULL;
+	if (is_global && s->tracker)
+		sym = s->tracker->reuse(s->tracker, name);
+	if (!sym)
+		sym = alloc_type(is_global ? s->ctx->alc : s->alc,
+				 struct SemaSymbol);
 
-	struct SemaSymbol *sym = alloc_type(s->ctx->alc, struct SemaSymbol);
 	sym->name = name;
 	sym->ty = ty;
 	sym->is_const = is_const;
-	sym->is_global = (s->curr_scope->parent == NULL);
+	sym->is_global = is_global;
 	sym->stack_offset = 0;
+	sym->has_value = false;
+	sym->shadowed = NULL;
+	compile_stats.symbols++;
 
 	map_put(s->curr_scope->symbols, name, sym);
+	if (!is_global) {
+		struct SemaSymbol **slot = local_slot(s->ctx, name);
+		sym->shadowed = *slot;
+		*slot = sym;
+		massert(vec_push(s->curr_scope->locals, sym), "OOM scope");
+	}
+	if (is_global && s->tracker)
+		s->tracker->on_define(s->tracker, sym);
 	return sym;
 }
 
-struct SemaSymbol *sema_lookup(struct Sema *s, symbol_t name)
+const struct SemaSymbol *sema_lookup(struct Sema *s, symbol_t name)
 {
-	for (struct Scope *sc = s->curr_scope; sc; sc = sc->parent) {
-		struct SemaSymbol **found = map_get(sc->symbols, name);
-		if (found)
-			return *found;
+	STATS_LEAF(StatsPhase_SEMA);
+	if (!s->curr_scope)
+		return prelude_lookup(name);
+
+	if (name.id < s->ctx->locals_cap && s->ctx->locals[name.id])
+		return s->ctx->locals[name.id];
+
+	struct SemaSymbol **found =
+		map_get(s->curr_scope->global->symbols, name);
+	if (found) {
+		if (!is_visible(s, *found))
+			return NULL;
+		if (s->tracker)
+			s->tracker->on_use(s->tracker, *found);
+		return *found;
 	}
-	return NULL;
+	return prelude_lookup(name);
 }
 
 void sema_analyze_binary(struct Sema *s, struct NodeBinary *node)
 {
+	TRACE_SCOPE("sema_analyze_binary");
+	STATS_LEAF(StatsPhase_SEMA);
+	/* A missing operand was already reported by the parser. */
+	if (!node->lhs || !node->rhs) {
+		node->base.ty = ty_void;
+		return;
+	}
+
 	struct Type *lhs = node->lhs->ty;
 	struct Type *rhs = node->rhs->ty;
 
@@ -128,6 +229,18 @@ void sema_analyze_binary(struct Sema *s, struct NodeBinary *node)
 	case ND_LE:
 	case ND_GT:
 	case ND_GE:
+		if (lhs->kind == TypeKind_ARRAY) {
+			ctx_error(s->ctx, node->base.tok,
+				  "Arrays cannot be used as operands");
+		} else if (lhs == ty_void) {
+			ctx_error(s->ctx, node->base.tok,
+				  "Void value used in an expression");
+		} else if (lhs == ty_bool && node->base.kind != ND_EQ &&
+			   node->base.kind != ND_NE) {
+			ctx_error(s->ctx, node->base.tok,
+				  "Relational operator requires numeric "
+				  "operands");
+		}
 		node->base.ty = ty_bool;
 		break;
 	case ND_LOG_AND:
@@ -145,15 +258,28 @@ void sema_analyze_binary(struct Sema *s, struct NodeBinary *node)
 
 void sema_analyze_assign(struct Sema *s, struct NodeBinary *node)
 {
-	if (node->lhs->kind == ND_VAR) {
-		struct NodeVar *v = (struct NodeVar *)node->lhs;
-		if (v->var && v->var->is_const) {
-			ctx_error(s->ctx, node->base.tok,
-				  "Cannot assign to const variable");
-		}
+	TRACE_SCOPE("sema_analyze_assign");
+	STATS_LEAF(StatsPhase_SEMA);
+	if (!node->lhs || !node->rhs) {
+		node->base.ty = ty_void;
+		return;
 	}
 
-	if (!type_eq(node->lhs->ty, node->rhs->ty)) {
+	/* The variable a chain of subscripts starts from. */
+	struct Node *root = node->lhs;
+	while (root->kind == ND_ARRAY_ACCESS)
+		root = ((struct NodeBinary *)root)->lhs;
+
+	if (root->kind != ND_VAR) {
+		ctx_error(s->ctx, node->base.tok,
+			  "Expression is not assignable");
+	} else if (((struct NodeVar *)root)->var &&
+		   ((struct NodeVar *)root)->var->is_const) {
+		ctx_error(s->ctx, node->base.tok,
+			  "Cannot assign to const variable");
+	} else if (node->lhs->ty->kind == TypeKind_ARRAY) {
+		ctx_error(s->ctx, node->base.tok, "Cannot assign to an array");
+	} else if (!type_eq(node->lhs->ty, node->rhs->ty)) {
 		ctx_error(s->ctx, node->base.tok,
 			  "Type mismatch in assignment");
 	}
@@ -163,6 +289,8 @@ void sema_analyze_assign(struct Sema *s, struct NodeBinary *node)
 
 void sema_analyze_return(struct Sema *s, struct NodeUnary *node)
 {
+	TRACE_SCOPE("sema_analyze_return");
+	STATS_LEAF(StatsPhase_SEMA);
 	struct Type *actual = node->lhs ? node->lhs->ty : ty_void;
 
 	if (s->curr_func_ret == ty_void) {
@@ -181,3 +309,401 @@ void sema_analyze_return(struct Sema *s, struct NodeUnary *node)
 	}
 	node->base.ty = ty_void;
 }
+
+void sema_analyze_unary(struct Sema *s, struct NodeUnary *node)
+{
+	TRACE_SCOPE("sema_analyze_unary");
+	STATS_LEAF(StatsPhase_SEMA);
+	if (!node->lhs) {
+		node->base.ty = ty_void;
+		return;
+	}
+
+	struct Type *ty = node->lhs->ty;
+	if (node->base.kind == ND_LOG_NOT) {
+		if (ty != ty_bool) {
+			ctx_error(s->ctx, node->base.tok,
+				  "'!' requires a bool operand");
+		}
+		node->base.ty = ty_bool;
+		return;
+	}
+	if (!type_is_arithmetic(ty)) {
+		ctx_error(s->ctx, node->base.tok,
+			  "Unary '-' requires a numeric operand");
+	}
+	node->base.ty = ty;
+}
+
+void sema_analyze_index(struct Sema *s, struct NodeBinary *node)
+{
+	TRACE_SCOPE("sema_analyze_index");
+	STATS_LEAF(StatsPhase_SEMA);
+	struct Type *base = node->lhs->ty;
+	if (!base || base->kind != TypeKind_ARRAY) {
+		ctx_error(s->ctx, node->base.tok,
+			  "Subscripted value is not an array");
+		node->base.ty = ty_int;
+		return;
+	}
+	node->base.ty = base->data.array.base;
+
+	if (node->rhs && node->rhs->ty != ty_int) {
+		ctx_error(s->ctx, node->rhs->tok,
+			  "Array index must be an int");
+	}
+}
+
+/* Arguments must match exactly; an array parameter's first dimension is
+ * not part of its type. */
+static bool arg_matches(struct Type *param, struct Type *arg)
+{
+	if (param->kind == TypeKind_ARRAY)
+		return arg->kind == TypeKind_ARRAY &&
+		       type_eq(param->data.array.base, arg->data.array.base);
+	return type_eq(param, arg);
+}
+
+void sema_analyze_call(struct Sema *s, struct NodeCall *node,
+		       const struct SemaSymbol *fn)
+{
+	TRACE_SCOPE("sema_analyze_call");
+	STATS_LEAF(StatsPhase_SEMA);
+	node->base.ty = ty_int;
+	/* An undefined name was already reported by the parser. */
+	if (!fn)
+		return;
+	if (fn->ty->kind != TypeKind_FUNC) {
+		ctx_error(s->ctx, node->base.tok, "'%s' is not a function",
+			  node->func_name);
+		return;
+	}
+
+	struct Type *fty = fn->ty;
+	node->base.ty = fty->data.func.ret;
+
+	u32 nargs = (u32)vec_len(node->args);
+	u32 nparams = (u32)vec_len(fty->data.func.params);
+	if (nargs != nparams) {
+		ctx_error(s->ctx, node->base.tok,
+			  "Function '%s' takes %u argument%s, got %u",
+			  node->func_name, nparams, nparams == 1 ? "" : "s",
+			  nargs);
+		return;
+	}
+	for (u32 i = 0; i < nargs; ++i) {
+		struct Node *arg = vec_at(node->args, i);
+		if (arg && !arg_matches(vec_at(fty->data.func.params, i),
+					arg->ty)) {
+			ctx_error(s->ctx, arg->tok,
+				  "Argument %u of '%s' has the wrong type",
+				  i + 1, node->func_name);
+		}
+	}
+}
+
+void sema_analyze_cond(struct Sema *s, struct Node *cond)
+{
+	STATS_LEAF(StatsPhase_SEMA);
+	if (cond && cond->ty != ty_bool)
+		ctx_error(s->ctx, cond->tok, "Condition must be a bool");
+}
+
+void sema_analyze_jump(struct Sema *s, struct Node *node)
+{
+	STATS_LEAF(StatsPhase_SEMA);
+	if (!s->loop_depth) {
+		ctx_error(s->ctx, node->tok,
+			  node->kind == ND_BREAK ? "'break' outside a loop"
+						 : "'continue' outside a loop");
+	}
+}
+
+/*
+ * Initializer lists are checked the way lowering reads them: row-major,
+ * with C's brace elision, so a scalar where a sub-array is expected
+ * starts filling that sub-array.
+ */
+
+static void check_init_list(struct Sema *s, struct Type *ty,
+			    struct NodeInitList *list, bool global);
+
+/* A scalar of type `elem`, possibly in braces of its own. */
+static void check_init_scalar(struct Sema *s, struct Type *elem,
+			      struct Node *n, bool global)
+{
+	if (n && n->kind == ND_INIT_LIST) {
+		NodeVec items = ((struct NodeInitList *)n)->inits;
+		if (vec_len(items) != 1 || !vec_at(items, 0) ||
+		    vec_at(items, 0)->kind == ND_INIT_LIST) {
+			ctx_error(s->ctx, n->tok,
+				  "Scalar initializer must be a single value");
+			return;
+		}
+		n = vec_at(items, 0);
+	}
+	/* A missing element was already reported by the parser. */
+	if (!n)
+		return;
+	if (!type_eq(elem, n->ty)) {
+		ctx_error(s->ctx, n->tok,
+			  "Initializer element has the wrong type");
+		return;
+	}
+	struct SemaConst k;
+	if (global && !sema_const_eval(n, &k)) {
+		ctx_error(s->ctx, n->tok,
+			  "Global initializer must be constant");
+	}
+}
+
+/* Fills the array `ty` from items[*i ..]. */
+static void check_init_fill(struct Sema *s, struct Type *ty, NodeVec items,
+			    usize *i, bool global)
+{
+	struct Type *et = ty->data.array.base;
+	for (int k = 0; k < ty->data.array.len && *i < vec_len(items); ++k) {
+		struct Node *item = vec_at(items, *i);
+		if (et->kind != TypeKind_ARRAY) {
+			(*i)++;
+			check_init_scalar(s, et, item, global);
+		} else if (item && item->kind == ND_INIT_LIST) {
+			(*i)++;
+			check_init_list(s, et, (struct NodeInitList *)item,
+					global);
+		} else {
+			check_init_fill(s, et, items, i, global);
+		}
+	}
+}
+
+static void check_init_list(struct Sema *s, struct Type *ty,
+			    struct NodeInitList *list, bool global)
+{
+	usize i = 0;
+	check_init_fill(s, ty, list->inits, &i, global);
+	if (i < vec_len(list->inits) && vec_at(list->inits, i)) {
+		ctx_error(s->ctx, vec_at(list->inits, i)->tok,
+			  "Excess elements in array initializer");
+	}
+}
+
+void sema_analyze_var_decl(struct Sema *s, struct NodeVarDecl *node)
+{
+	TRACE_SCOPE("sema_analyze_var_decl");
+	STATS_LEAF(StatsPhase_SEMA);
+	struct Node *init = node->init;
+	struct Type *ty = node->base.ty;
+	bool global = s->curr_scope && s->curr_scope->parent == NULL;
+	if (!init)
+		return;
+
+	if (ty->kind == TypeKind_ARRAY) {
+		if (init->kind != ND_INIT_LIST) {
+			ctx_error(s->ctx, node->base.tok,
+				  type_eq(ty, init->ty)
+					  ? "Array initializer must be a "
+					    "braced list"
+					  : "Init type mismatch");
+			return;
+		}
+		check_init_list(s, ty, (struct NodeInitList *)init, global);
+		return;
+	}
+
+	if (init->kind != ND_INIT_LIST && !type_eq(ty, init->ty)) {
+		ctx_error(s->ctx, node->base.tok, "Init type mismatch");
+		return;
+	}
+	check_init_scalar(s, ty, init, global);
+
+	struct SemaSymbol *sym = node->var;
+	if (sym && sym->is_const) {
+		if (init->kind == ND_INIT_LIST &&
+		    vec_len(((struct NodeInitList *)init)->inits) == 1)
+			init = vec_at(((struct NodeInitList *)init)->inits, 0);
+		sym->has_value = sema_const_eval(init, &sym->value);
+	}
+}
+
+/*
+ * Constant folding. Lowering folds through this too, so what sema accepts
+ * as a constant is exactly what becomes one.
+ */
+
+static bool const_binary(const struct NodeBinary *n, struct SemaConst *out)
+{
+	struct SemaConst a, b;
+	if (!sema_const_eval(n->lhs, &a) || !sema_const_eval(n->rhs, &b) ||
+	    a.ty != b.ty)
+		return false;
+
+	NodeKind kind = n->base.kind;
+	if (kind == ND_LOG_AND || kind == ND_LOG_OR) {
+		if (a.ty != ty_bool)
+			return false;
+		*out = (struct SemaConst){ .ty = ty_bool,
+					   .b = kind == ND_LOG_AND ? a.b && b.b
+								   : a.b || b.b };
+		return true;
+	}
+
+	if (kind >= ND_EQ && kind <= ND_GE) {
+		int cmp;
+		bool unordered = false;
+		if (a.ty == ty_bool) {
+			cmp = (int)a.b - (int)b.b;
+		} else if (a.ty == ty_int) {
+			cmp = (a.i > b.i) - (a.i < b.i);
+		} else if (a.ty == ty_float) {
+			cmp = (a.f > b.f) - (a.f < b.f);
+			unordered = a.f != a.f || b.f != b.f;
+		} else {
+			cmp = (a.d > b.d) - (a.d < b.d);
+			unordered = a.d != a.d || b.d != b.d;
+		}
+		/* NaN compares unequal to everything, itself included. */
+		bool r = unordered ? kind == ND_NE
+			 : kind == ND_EQ ? cmp == 0
+			 : kind == ND_NE ? cmp != 0
+			 : kind == ND_LT ? cmp < 0
+			 : kind == ND_LE ? cmp <= 0
+			 : kind == ND_GT ? cmp > 0
+					 : cmp >= 0;
+		*out = (struct SemaConst){ .ty = ty_bool, .b = r };
+		return true;
+	}
+
+	*out = (struct SemaConst){ .ty = a.ty };
+	if (a.ty == ty_int) {
+		u32 x = (u32)a.i, y = (u32)b.i;
+		switch (kind) {
+		case ND_ADD:
+			out->i = (i32)(x + y);
+			return true;
+		case ND_SUB:
+			out->i = (i32)(x - y);
+			return true;
+		case ND_MUL:
+			out->i = (i32)(x * y);
+			return true;
+		case ND_DIV:
+		case ND_MOD:
+			if (b.i == 0)
+				return false;
+			/* INT_MIN / -1 wraps to INT_MIN. */
+			if (b.i == -1)
+				out->i = kind == ND_DIV ? (i32)(0u - x) : 0;
+			else
+				out->i = kind == ND_DIV ? a.i / b.i : a.i % b.i;
+			return true;
+		default:
+			return false;
+		}
+	}
+	if (a.ty == ty_float) {
+		switch (kind) {
+		case ND_ADD:
+			out->f = a.f + b.f;
+			return true;
+		case ND_SUB:
+			out->f = a.f - b.f;
+			return true;
+		case ND_MUL:
+			out->f = a.f * b.f;
+			return true;
+		case ND_DIV:
+			out->f = a.f / b.f;
+			return true;
+		default:
+			return false;
+		}
+	}
+	if (a.ty == ty_double) {
+		switch (kind) {
+		case ND_ADD:
+			out->d = a.d + b.d;
+			return true;
+		case ND_SUB:
+			out->d = a.d - b.d;
+			return true;
+		case ND_MUL:
+			out->d = a.d * b.d;
+			return true;
+		case ND_DIV:
+			out->d = a.d / b.d;
+			return true;
+		default:
+			return false;
+		}
+	}
+	return false;
+}
+
+bool sema_const_eval(const struct Node *n, struct SemaConst *out)
+{
+	if (!n)
+		return false;
+
+	switch (n->kind) {
+	case ND_LIT_INT:
+		*out = (struct SemaConst){ .ty = ty_int,
+					   .i = ((struct NodeLitInt *)n)->val };
+		return true;
+	case ND_LIT_FLOAT:
+		*out = (struct SemaConst){
+			.ty = ty_float, .f = ((struct NodeLitFloat *)n)->val
+		};
+		return true;
+	case ND_LIT_DOUBLE:
+		*out = (struct SemaConst){
+			.ty = ty_double, .d = ((struct NodeLitDouble *)n)->val
+		};
+		return true;
+	case ND_LIT_BOOL:
+		*out = (struct SemaConst){ .ty = ty_bool,
+					   .b = ((struct NodeLitBool *)n)->val };
+		return true;
+	case ND_VAR: {
+		const struct SemaSymbol *sym = ((struct NodeVar *)n)->var;
+		if (!sym || !sym->has_value)
+			return false;
+		*out = sym->value;
+		return true;
+	}
+	case ND_NEG:
+		if (!sema_const_eval(((struct NodeUnary *)n)->lhs, out))
+			return false;
+		if (out->ty == ty_int)
+			out->i = (i32)(0u - (u32)out->i);
+		else if (out->ty == ty_float)
+			out->f = -out->f;
+		else if (out->ty == ty_double)
+			out->d = -out->d;
+		else
+			return false;
+		return true;
+	case ND_LOG_NOT:
+		if (!sema_const_eval(((struct NodeUnary *)n)->lhs, out) ||
+		    out->ty != ty_bool)
+			return false;
+		out->b = !out->b;
+		return true;
+	case ND_ADD:
+	case ND_SUB:
+	case ND_MUL:
+	case ND_DIV:
+	case ND_MOD:
+	case ND_EQ:
+	case ND_NE:
+	case ND_LT:
+	case ND_LE:
+	case ND_GT:
+	case ND_GE:
+	case ND_LOG_AND:
+	case ND_LOG_OR:
+		return const_binary((const struct NodeBinary *)n, out);
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,460 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stats.h>
+#include <core/msg.h>
+#include <time.h>
+#include <sys/resource.h>
+
+struct Stats compile_stats;
+
+static const char *PHASE_NAMES[] = {
+#define X(ID, NAME) NAME,
+	STATS_PHASES(X)
+#undef X
+};
+
+/*
+ * ==========================================================================
+ * 1. Clock
+ * ==========================================================================
+ */
+
+static double clock_us(clockid_t id)
+{
+	struct timespec ts;
+	clock_gettime(id, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static u64 minor_faults(void)
+{
+	struct rusage ru;
+	return getrusage(RUSAGE_SELF, &ru) == 0 ? (u64)ru.ru_minflt : 0;
+}
+
+/* Charge the time since the last switch to the innermost phase. */
+static void charge(void)
+{
+	double wall = clock_us(CLOCK_MONOTONIC);
+	double cpu = clock_us(CLOCK_PROCESS_CPUTIME_ID);
+	u64 faults = minor_faults();
+
+	if (compile_stats.depth > 0) {
+		StatsPhase top = compile_stats.stack[compile_stats.depth - 1];
+		struct PhaseStats *ph = &compile_stats.phases[top];
+		ph->wall_us += wall - compile_stats.last_wall;
+		ph->cpu_us += cpu - compile_stats.last_cpu;
+		ph->faults += faults - compile_stats.last_faults;
+	}
+	compile_stats.last_wall = wall;
+	compile_stats.last_cpu = cpu;
+	compile_stats.last_faults = faults;
+}
+
+static StatsPhase current_phase(void)
+{
+	if (compile_stats.leaf != StatsPhase_COUNT)
+		return compile_stats.leaf;
+	return compile_stats.depth > 0
+		       ? compile_stats.stack[compile_stats.depth - 1]
+		       : StatsPhase_INIT;
+}
+
+/*
+ * ==========================================================================
+ * 2. Phases
+ * ==========================================================================
+ */
+
+static double calibrate(void)
+{
+	enum { N = 256 };
+	double start = clock_us(CLOCK_MONOTONIC);
+	for (int i = 0; i < N - 1; ++i)
+		clock_us(CLOCK_MONOTONIC);
+	return (clock_us(CLOCK_MONOTONIC) - start) / N;
+}
+
+void stats_enable(void)
+{
+	compile_stats.clock_cost = calibrate();
+	compile_stats.enabled = true;
+	compile_stats.depth = 0;
+	compile_stats.leaf = StatsPhase_COUNT;
+	compile_stats.leaf_rng = 0x9e3779b97f4a7c15ull;
+	charge();
+	compile_stats.stack[compile_stats.depth++] = StatsPhase_INIT;
+}
+
+void stats_push_slow(StatsPhase phase)
+{
+	massert(compile_stats.depth < sizeof(compile_stats.stack) /
+					      sizeof(compile_stats.stack[0]),
+		"stats phase stack overflow");
+	charge();
+	compile_stats.stack[compile_stats.depth++] = phase;
+}
+
+void stats_pop_slow(void)
+{
+	massert(compile_stats.depth > 1, "stats phase stack underflow");
+	charge();
+	compile_stats.depth--;
+}
+
+double stats_leaf_begin_slow(StatsPhase phase)
+{
+	compile_stats.leaf = phase;
+
+	u64 x = compile_stats.leaf_rng;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	compile_stats.leaf_rng = x;
+	if ((x & (STATS_LEAF_SAMPLE - 1)) != 0)
+		return 0;
+	return clock_us(CLOCK_MONOTONIC);
+}
+
+void stats_leaf_end_slow(double start)
+{
+	StatsPhase leaf = compile_stats.leaf;
+	compile_stats.leaf = StatsPhase_COUNT;
+	if (start == 0)
+		return;
+
+	/* Leaves are compute-bound, so their CPU time is taken to be wall time. */
+	double took = clock_us(CLOCK_MONOTONIC) - start -
+		      compile_stats.clock_cost;
+	if (took > STATS_LEAF_OUTLIER_US)
+		return;
+	double est = (took > 0 ? took : 0) * STATS_LEAF_SAMPLE;
+	struct PhaseStats *outer = &compile_stats.phases[current_phase()];
+	compile_stats.phases[leaf].wall_us += est;
+	compile_stats.phases[leaf].cpu_us += est;
+	outer->wall_us -= est;
+	outer->cpu_us -= est;
+}
+
+struct PassStats *stats_pass(const char *name, bool analysis)
+{
+	for (u32 i = 0; i < compile_stats.npasses; ++i)
+		if (compile_stats.passes[i].name == name)
+			return &compile_stats.passes[i];
+	massert(compile_stats.npasses < STATS_MAX_PASSES,
+		"stats: too many passes");
+	struct PassStats *p = &compile_stats.passes[compile_stats.npasses++];
+	*p = (struct PassStats){ .name = name, .analysis = analysis };
+	return p;
+}
+
+double stats_now_us(void)
+{
+	return clock_us(CLOCK_MONOTONIC);
+}
+
+void stats_finish(void)
+{
+	if (!compile_stats.enabled)
+		return;
+	charge();
+	compile_stats.depth = 0;
+	compile_stats.enabled = false;
+}
+
+/*
+ * ==========================================================================
+ * 3. Counting Allocator
+ * ==========================================================================
+ */
+
+static void note_alloc(struct CountingAlloc *c, usize size)
+{
+	c->total += size;
+	c->allocs++;
+	c->live += size;
+	if (c->live > c->peak)
+		c->peak = c->live;
+
+	if (c->per_phase) {
+		struct PhaseStats *ph = &compile_stats.phases[current_phase()];
+		ph->bytes += size;
+		ph->allocs++;
+	}
+}
+
+static void *counting_alloc(void *self, layout_t l)
+{
+	struct CountingAlloc *c = self;
+	void *ptr = allocer_alloc(c->inner, l);
+	if (ptr)
+		note_alloc(c, l.size);
+	return ptr;
+}
+
+static void counting_free(void *self, void *ptr, layout_t l)
+{
+	struct CountingAlloc *c = self;
+	if (ptr)
+		c->live -= l.size < c->live ? l.size : c->live;
+	allocer_free(c->inner, ptr, l);
+}
+
+static void *counting_realloc(void *self, void *ptr, layout_t old,
+			      usize new_size)
+{
+	struct CountingAlloc *c = self;
+	void *res = allocer_realloc(c->inner, ptr, old, new_size);
+	if (res) {
+		if (ptr)
+			c->live -= old.size < c->live ? old.size : c->live;
+		note_alloc(c, new_size);
+	}
+	return res;
+}
+
+static const allocer_vtable_t COUNTING_VTABLE = {
+	.alloc = counting_alloc,
+	.free = counting_free,
+	.realloc = counting_realloc,
+};
+
+allocer_t counting_allocer(struct CountingAlloc *c, allocer_t inner,
+			   bool per_phase)
+{
+	*c = (struct CountingAlloc){ .inner = inner, .per_phase = per_phase };
+	return (allocer_t){ .self = c, .vtable = &COUNTING_VTABLE };
+}
+
+/*
+ * ==========================================================================
+ * 4. Reports
+ * ==========================================================================
+ */
+
+static struct PhaseStats total_stats(void)
+{
+	struct PhaseStats t = { 0 };
+	for (int i = 0; i < StatsPhase_COUNT; ++i) {
+		t.wall_us += compile_stats.phases[i].wall_us;
+		t.cpu_us += compile_stats.phases[i].cpu_us;
+		t.faults += compile_stats.phases[i].faults;
+		t.bytes += compile_stats.phases[i].bytes;
+		t.allocs += compile_stats.phases[i].allocs;
+	}
+	return t;
+}
+
+/* Within "opt": every pass with the IR size it left, then analyses. */
+static void print_passes(FILE *out)
+{
+	if (!compile_stats.npasses)
+		return;
+
+	fprintf(out, "\nOptimization passes (milliseconds)\n");
+	fprintf(out, " %-14s %8s %8s %12s %21s %19s\n", "pass", "runs",
+		"changed", "wall", "insts before/after", "blocks before/after");
+	for (u32 i = 0; i < compile_stats.npasses; ++i) {
+		const struct PassStats *p = &compile_stats.passes[i];
+		if (p->analysis)
+			continue;
+		fprintf(out,
+			" %-14s %8llu %8llu %12.3f %10llu/%-10llu %9llu/%llu\n",
+			p->name, (unsigned long long)p->runs,
+			(unsigned long long)p->changed, p->wall_us / 1e3,
+			(unsigned long long)p->insts_before,
+			(unsigned long long)p->insts_after,
+			(unsigned long long)p->blocks_before,
+			(unsigned long long)p->blocks_after);
+	}
+	fprintf(out, " %-14s %8s %8s %12s\n", "analysis", "computed", "cached",
+		"wall");
+	for (u32 i = 0; i < compile_stats.npasses; ++i) {
+		const struct PassStats *p = &compile_stats.passes[i];
+		if (!p->analysis)
+			continue;
+		fprintf(out, " %-14s %8llu %8llu %12.3f\n", p->name,
+			(unsigned long long)p->runs,
+			(unsigned long long)p->hits, p->wall_us / 1e3);
+	}
+}
+
+void stats_print_time(FILE *out)
+{
+	struct PhaseStats t = total_stats();
+	double total = t.wall_us > 0 ? t.wall_us : 1;
+
+	fprintf(out, "\nExecution times (milliseconds)\n");
+	fprintf(out, " %-14s %12s %7s %12s %10s\n", "phase", "wall", "", "cpu",
+		"faults");
+	for (int i = 0; i < StatsPhase_COUNT; ++i) {
+		const struct PhaseStats *ph = &compile_stats.phases[i];
+		fprintf(out, " %-14s %12.3f (%3.0f%%) %12.3f %10llu\n",
+			PHASE_NAMES[i], ph->wall_us / 1e3,
+			100.0 * ph->wall_us / total, ph->cpu_us / 1e3,
+			(unsigned long long)ph->faults);
+	}
+	fprintf(out, " %-14s %12.3f %7s %12.3f %10llu\n", "TOTAL",
+		t.wall_us / 1e3, "", t.cpu_us / 1e3,
+		(unsigned long long)t.faults);
+	print_passes(out);
+}
+
+void stats_print_mem(FILE *out)
+{
+	struct PhaseStats t = total_stats();
+
+	fprintf(out, "\nArena allocations per phase\n");
+	fprintf(out, " %-14s %14s %10s\n", "phase", "bytes", "allocs");
+	for (int i = 0; i < StatsPhase_COUNT; ++i) {
+		const struct PhaseStats *ph = &compile_stats.phases[i];
+		fprintf(out, " %-14s %14llu %10llu\n", PHASE_NAMES[i],
+			(unsigned long long)ph->bytes,
+			(unsigned long long)ph->allocs);
+	}
+	fprintf(out, " %-14s %14llu %10llu\n", "TOTAL",
+		(unsigned long long)t.bytes, (unsigned long long)t.allocs);
+
+	if (compile_stats.arena_backing) {
+		fprintf(out, " arena high-water mark: %llu bytes in %llu chunks\n",
+			(unsigned long long)compile_stats.arena_backing->peak,
+			(unsigned long long)compile_stats.arena_backing->allocs);
+	}
+
+	if (compile_stats.vmem) {
+		const struct VMem *v = compile_stats.vmem;
+		fprintf(out,
+			" arena reservation:     %llu bytes, %llu committed%s\n",
+			(unsigned long long)v->reserved,
+			(unsigned long long)v->committed,
+			v->hugetlb ? " (hugetlb)" : "");
+	}
+	if (compile_stats.scratch)
+		fprintf(out, " scratch arena peak:    %llu bytes\n",
+			(unsigned long long)compile_stats.scratch->peak);
+	if (compile_stats.scopes)
+		fprintf(out, " scope arena peak:      %llu bytes\n",
+			(unsigned long long)compile_stats.scopes->peak);
+	if (compile_stats.stream_read)
+		fprintf(out, " stream window peak:    %llu bytes of %llu read\n",
+			(unsigned long long)compile_stats.stream_peak,
+			(unsigned long long)compile_stats.stream_read);
+
+	fprintf(out, "\nObjects\n");
+	fprintf(out, " %-16s %12llu\n", "tokens",
+		(unsigned long long)compile_stats.tokens);
+	fprintf(out, " %-16s %12llu\n", "nodes",
+		(unsigned long long)compile_stats.nodes);
+	fprintf(out, " %-16s %12llu\n", "types",
+		(unsigned long long)compile_stats.types);
+	fprintf(out, " %-16s %12llu\n", "symbols",
+		(unsigned long long)compile_stats.symbols);
+	fprintf(out, " %-16s %12llu\n", "interned strings",
+		(unsigned long long)compile_stats.strings);
+}
+
+static void json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; ++s) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+static void json_phase(FILE *out, const struct PhaseStats *ph)
+{
+	fprintf(out,
+		"\"wall_us\": %.1f, \"cpu_us\": %.1f, \"faults\": %llu, "
+		"\"bytes\": %llu, \"allocs\": %llu",
+		ph->wall_us, ph->cpu_us, (unsigned long long)ph->faults,
+		(unsigned long long)ph->bytes, (unsigned long long)ph->allocs);
+}
+
+void stats_write_json(FILE *out, const char *input_file)
+{
+	struct PhaseStats t = total_stats();
+	const struct CountingAlloc *backing = compile_stats.arena_backing;
+
+	fprintf(out, "{\n  \"file\": ");
+	json_string(out, input_file ? input_file : "");
+	fprintf(out, ",\n  \"phases\": [\n");
+	for (int i = 0; i < StatsPhase_COUNT; ++i) {
+		fprintf(out, "    { \"name\": ");
+		json_string(out, PHASE_NAMES[i]);
+		fprintf(out, ", ");
+		json_phase(out, &compile_stats.phases[i]);
+		fprintf(out, " }%s\n", i + 1 < StatsPhase_COUNT ? "," : "");
+	}
+	fprintf(out, "  ],\n  \"total\": { ");
+	json_phase(out, &t);
+	fprintf(out, " },\n");
+
+	fprintf(out, "  \"passes\": [");
+	for (u32 i = 0; i < compile_stats.npasses; ++i) {
+		const struct PassStats *p = &compile_stats.passes[i];
+		fprintf(out, "%s\n    { \"name\": ", i ? "," : "");
+		json_string(out, p->name);
+		fprintf(out,
+			", \"analysis\": %s, \"runs\": %llu, \"%s\": %llu, "
+			"\"wall_us\": %.1f",
+			p->analysis ? "true" : "false",
+			(unsigned long long)p->runs,
+			p->analysis ? "cached" : "changed",
+			(unsigned long long)(p->analysis ? p->hits : p->changed),
+			p->wall_us);
+		if (!p->analysis)
+			fprintf(out,
+				", \"insts_before\": %llu, "
+				"\"insts_after\": %llu, "
+				"\"blocks_before\": %llu, "
+				"\"blocks_after\": %llu",
+				(unsigned long long)p->insts_before,
+				(unsigned long long)p->insts_after,
+				(unsigned long long)p->blocks_before,
+				(unsigned long long)p->blocks_after);
+		fprintf(out, " }");
+	}
+	fprintf(out, "%s],\n", compile_stats.npasses ? "\n  " : "");
+
+	fprintf(out,
+		"  \"arena\": { \"high_water\": %llu, \"chunks\": %llu, "
+		"\"scratch_peak\": %llu, \"scope_peak\": %llu },\n",
+		(unsigned long long)(backing ? backing->peak : 0),
+		(unsigned long long)(backing ? backing->allocs : 0),
+		(unsigned long long)(compile_stats.scratch
+					     ? compile_stats.scratch->peak
+					     : 0),
+		(unsigned long long)(compile_stats.scopes
+					     ? compile_stats.scopes->peak
+					     : 0));
+
+	fprintf(out,
+		"  \"counts\": { \"tokens\": %llu, \"nodes\": %llu, "
+		"\"types\": %llu, \"symbols\": %llu, \"strings\": %llu }\n}\n",
+		(unsigned long long)compile_stats.tokens,
+		(unsigned long long)compile_stats.nodes,
+		(unsigned long long)compile_stats.types,
+		(unsigned long long)compile_stats.symbols,
+		(unsigned long long)compile_stats.strings);
+}
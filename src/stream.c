@@ -0,0 +1,165 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <stream.h>
+#include <core/msg.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * ==========================================================================
+ * 1. Lifetime
+ * ==========================================================================
+ */
+
+void stream_init(struct Stream *s, allocer_t alc, int fd, const char *name,
+		 usize chunk)
+{
+	*s = (struct Stream){
+		.fd = fd, .name = name, .alc = alc, .chunk = chunk, .line = 1
+	};
+}
+
+void stream_deinit(struct Stream *s)
+{
+	if (s->buf)
+		allocer_free(s->alc, s->buf, layout(s->cap, 1));
+	s->buf = NULL;
+	s->len = s->cap = 0;
+}
+
+/*
+ * ==========================================================================
+ * 2. Reading
+ * ==========================================================================
+ */
+
+static usize count_lines(const char *p, usize n)
+{
+	usize lines = 0;
+	const char *end = p + n;
+	while ((p = memchr(p, '\n', (usize)(end - p))) != NULL) {
+		lines++;
+		p++;
+	}
+	return lines;
+}
+
+bool stream_fill(struct Stream *s)
+{
+	if (s->eof)
+		return false;
+
+	if (s->cap - s->len < s->chunk) {
+		usize cap = s->cap ? s->cap : s->chunk;
+		while (cap - s->len < s->chunk)
+			cap *= 2;
+
+		char *buf = s->buf ? allocer_realloc(s->alc, s->buf,
+						     layout(s->cap, 1), cap)
+				   : allocer_alloc(s->alc, layout(cap, 1));
+		massert(buf != NULL, "OOM stream buffer");
+		s->buf = buf;
+		s->cap = cap;
+	}
+
+	ssize_t n;
+	do {
+		n = read(s->fd, s->buf + s->len, s->chunk);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0) {
+		/* A read error ends the input like EOF; the parser reports it. */
+		s->eof = true;
+		return false;
+	}
+
+	s->len += (usize)n;
+	s->read += (usize)n;
+	if (s->len - s->head > s->peak)
+		s->peak = s->len - s->head;
+	return true;
+}
+
+/*
+ * ==========================================================================
+ * 3. Releasing
+ * ==========================================================================
+ */
+
+usize stream_release(struct Stream *s, usize offset)
+{
+	usize start = s->file_base + s->base;
+	if (offset <= start + s->head)
+		return 0;
+
+	usize pos = offset - start;
+	if (pos > s->len)
+		pos = s->len;
+	while (pos > s->head && s->buf[pos - 1] != '\n')
+		pos--;
+
+	s->line += count_lines(s->buf + s->head, pos - s->head);
+	s->head = pos;
+
+	if (s->head < s->len - s->head)
+		return 0;
+
+	usize moved = s->head;
+	memmove(s->buf, s->buf + moved, s->len - moved);
+	s->len -= moved;
+	s->base += moved;
+	s->head = 0;
+	return moved;
+}
+
+/*
+ * ==========================================================================
+ * 4. Diagnostics
+ * ==========================================================================
+ */
+
+bool stream_lookup(struct Stream *s, usize offset, srcloc_t *loc, str_t *line)
+{
+	usize start = s->file_base + s->base;
+	if (offset < start + s->head || offset > start + s->len)
+		return false;
+
+	usize pos = offset - start;
+	usize line_start = s->head;
+	usize line_no = s->line;
+	for (usize i = s->head; i < pos; i++) {
+		if (s->buf[i] == '\n') {
+			line_no++;
+			line_start = i + 1;
+		}
+	}
+
+	usize end = pos;
+	while (true) {
+		while (end < s->len && s->buf[end] != '\n')
+			end++;
+		if (end < s->len || !stream_fill(s))
+			break;
+	}
+
+	loc->filename = s->name;
+	loc->line = line_no;
+	loc->col = pos - line_start + 1;
+	*line = str_from_parts(s->buf + line_start, end - line_start);
+	return true;
+}
@@ -0,0 +1,196 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <trace.h>
+#include <arena.h>
+#include <core/mem/allocer.h>
+#include <core/msg.h>
+#include <std/allocers/system.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define DETAIL_CHUNK_SIZE (4 * 1024)
+
+/*
+ * ==========================================================================
+ * 1. Ring Buffers
+ * ==========================================================================
+ */
+
+struct TraceEvent {
+	const char *name;
+	const char *detail;
+	u64 start;
+	u64 end;
+};
+
+/**
+ * @brief Events of one thread. Only the owning thread writes to it, so
+ * recording needs no synchronization.
+ */
+struct TraceRing {
+	struct TraceEvent *events;
+	usize cap;
+	/* Events ever recorded; the newest `cap` of them are kept. */
+	u64 count;
+	/* Copies of event details, which may die before trace_write. Each lap
+	 * around `events` copies into its own arena; a lap overwrites all
+	 * events of the one before last, so that arena is reset for it. */
+	struct Arena details[2];
+	u32 tid;
+	struct TraceRing *next;
+};
+
+bool trace_on;
+
+static usize ring_capacity;
+static u64 epoch_ns;
+static _Atomic(struct TraceRing *) rings;
+static atomic_uint next_tid;
+static _Thread_local struct TraceRing *local_ring;
+
+static struct TraceRing *ring_new(void)
+{
+	allocer_t sys = allocer_system();
+	struct TraceRing *r = alloc_type(sys, struct TraceRing);
+	massert(r, "OOM trace ring");
+
+	r->cap = ring_capacity;
+	r->events = allocer_alloc(
+		sys, layout(r->cap * sizeof(struct TraceEvent),
+			    _Alignof(struct TraceEvent)));
+	massert(r->events, "OOM trace ring");
+	arena_init(&r->details[0], sys, DETAIL_CHUNK_SIZE);
+	arena_init(&r->details[1], sys, DETAIL_CHUNK_SIZE);
+	r->count = 0;
+	r->tid = atomic_fetch_add(&next_tid, 1) + 1;
+
+	/* Publish it for trace_write. */
+	r->next = atomic_load(&rings);
+	while (!atomic_compare_exchange_weak(&rings, &r->next, r))
+		;
+	return r;
+}
+
+static u64 clock_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+/*
+ * ==========================================================================
+ * 2. Recording
+ * ==========================================================================
+ */
+
+void trace_start(usize capacity)
+{
+	ring_capacity = capacity > 0 ? capacity : 1;
+	epoch_ns = clock_ns();
+	trace_on = true;
+}
+
+u64 trace_now(void)
+{
+	/* +1 keeps 0 free to mean "not recording" in TraceSpan. */
+	return clock_ns() - epoch_ns + 1;
+}
+
+void trace_record(const char *name, const char *detail, u64 start, u64 end)
+{
+	if (!local_ring)
+		local_ring = ring_new();
+
+	struct TraceRing *r = local_ring;
+	struct Arena *a = &r->details[(r->count / r->cap) % 2];
+	if (r->count % r->cap == 0)
+		arena_release(a, (struct ArenaMark){ 0 });
+	if (detail) {
+		usize len = strlen(detail) + 1;
+		char *copy = arena_alloc(a, layout(len, 1));
+		massert(copy, "OOM trace detail");
+		detail = memcpy(copy, detail, len);
+	}
+	r->events[r->count % r->cap] =
+		(struct TraceEvent){ name, detail, start, end };
+	r->count++;
+}
+
+/*
+ * ==========================================================================
+ * 3. Chrome Trace Output
+ * ==========================================================================
+ */
+
+static void json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; ++s) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+bool trace_write(const char *path)
+{
+	FILE *out = fopen(path, "w");
+	if (!out)
+		return false;
+
+	u64 dropped = 0;
+	bool first = true;
+	fprintf(out, "{\"traceEvents\":[\n");
+
+	for (struct TraceRing *r = atomic_load(&rings); r; r = r->next) {
+		u64 begin = r->count > r->cap ? r->count - r->cap : 0;
+		dropped += begin;
+
+		for (u64 i = begin; i < r->count; ++i) {
+			const struct TraceEvent *e = &r->events[i % r->cap];
+
+			fprintf(out, "%s{\"name\":", first ? "" : ",\n");
+			json_string(out, e->name);
+			fprintf(out,
+				",\"cat\":\"cactc\",\"ph\":\"X\",\"pid\":1,"
+				"\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+				r->tid, (double)(e->start - 1) / 1e3,
+				(double)(e->end - e->start) / 1e3);
+			if (e->detail) {
+				fprintf(out, ",\"args\":{\"detail\":");
+				json_string(out, e->detail);
+				fputc('}', out);
+			}
+			fputc('}', out);
+			first = false;
+		}
+	}
+
+	fprintf(out,
+		"\n],\"displayTimeUnit\":\"ns\","
+		"\"otherData\":{\"dropped_events\":%llu}}\n",
+		(unsigned long long)dropped);
+	return fclose(out) == 0;
+}
@@ -15,54 +15,24 @@
  */
 
 #include <type.h>
+#include <stats.h>
 #include <core/msg.h>
 
-struct Type *ty_void;
-struct Type *ty_bool;
-struct Type *ty_int;
-struct Type *ty_float;
-struct Type *ty_double;
+/* Primitive types are unique and immutable, so one copy serves every
+ * compilation in the process. */
+static struct Type prim_void = { .kind = TypeKind_VOID, .size = 0, .align = 0 };
+static struct Type prim_bool = { .kind = TypeKind_BOOL, .size = 1, .align = 1 };
+static struct Type prim_int = { .kind = TypeKind_INT, .size = 4, .align = 4 };
+static struct Type prim_float = { .kind = TypeKind_FLOAT, .size = 4, .align = 4 };
+static struct Type prim_double = { .kind = TypeKind_DOUBLE,
+				   .size = 8,
+				   .align = 8 };
 
-static struct Type *new_primitive(allocer_t alc, TypeKind kind, int size,
-				  int align)
-{
-	struct Type *ty = alloc_type(alc, struct Type);
-	ty->kind = kind;
-	ty->size = size;
-	ty->align = align;
-	return ty;
-}
-
-void types_init(allocer_t alc)
-{
-	ty_void = new_primitive(alc, TypeKind_VOID, 0, 0);
-	ty_bool = new_primitive(alc, TypeKind_BOOL, 1, 1);
-	ty_int = new_primitive(alc, TypeKind_INT, 4, 4);
-	ty_float = new_primitive(alc, TypeKind_FLOAT, 4, 4);
-	ty_double = new_primitive(alc, TypeKind_DOUBLE, 8, 8);
-}
-
-static void free_primitive(allocer_t alc, struct Type *ty)
-{
-	if (ty) {
-		free_type(alc, ty);
-	}
-}
-
-void types_deinit(allocer_t alc)
-{
-	free_primitive(alc, ty_void);
-	free_primitive(alc, ty_bool);
-	free_primitive(alc, ty_int);
-	free_primitive(alc, ty_float);
-	free_primitive(alc, ty_double);
-
-	ty_void = NULL;
-	ty_bool = NULL;
-	ty_int = NULL;
-	ty_float = NULL;
-	ty_double = NULL;
-}
+struct Type *const ty_void = &prim_void;
+struct Type *const ty_bool = &prim_bool;
+struct Type *const ty_int = &prim_int;
+struct Type *const ty_float = &prim_float;
+struct Type *const ty_double = &prim_double;
 
 struct Type *type_array_of(allocer_t alc, struct Type *base, int len)
 {
@@ -73,6 +43,7 @@ struct Type *type_array_of(allocer_t alc, struct Type *base, int len)
 
 	ty->size = base->size * len;
 	ty->align = base->align;
+	compile_stats.types++;
 	return ty;
 }
 
@@ -83,6 +54,7 @@ struct Type *type_func_new(allocer_t alc, struct Type *ret)
 	ty->data.func.ret = ret;
 	ty->size = 8;
 	ty->align = 8;
+	compile_stats.types++;
 
 	massert(vec_init(ty->data.func.params, alc, 4),
 		"Func params init failed");
@@ -0,0 +1,628 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <vm.h>
+#include <jit.h>
+#include <trace.h>
+#include <cactrt.h>
+#include <std/allocers/system.h>
+#include <core/msg.h>
+
+#include <setjmp.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * ==========================================================================
+ * 1. Stacks
+ * ==========================================================================
+ * Registers, ALLOCA storage and return addresses each grow in a stack of
+ * their own. They are reserved up front and only touched pages are ever
+ * backed, so deep recursion costs what it uses.
+ */
+
+#define VM_STACK_REGS ((usize)1 << 24)
+#define VM_STACK_BYTES ((usize)256 << 20)
+#define VM_MAX_DEPTH ((usize)1 << 20)
+
+struct VmFrame {
+	/* The CALL instruction to return to. */
+	const u32 *ip;
+	union VmReg *regs;
+	u8 *mem;
+	const struct VmFunc *func;
+};
+
+struct VmStacks {
+	union VmReg *regs;
+	u8 *mem;
+	struct VmFrame *frames;
+};
+
+static void *reserve(usize size)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+static void stacks_deinit(struct VmStacks *s)
+{
+	if (s->regs)
+		munmap(s->regs, VM_STACK_REGS * sizeof(union VmReg));
+	if (s->mem)
+		munmap(s->mem, VM_STACK_BYTES);
+	if (s->frames)
+		munmap(s->frames, VM_MAX_DEPTH * sizeof(struct VmFrame));
+}
+
+static bool stacks_init(struct VmStacks *s)
+{
+	s->regs = reserve(VM_STACK_REGS * sizeof(union VmReg));
+	s->mem = reserve(VM_STACK_BYTES);
+	s->frames = reserve(VM_MAX_DEPTH * sizeof(struct VmFrame));
+	if (s->regs && s->mem && s->frames)
+		return true;
+	stacks_deinit(s);
+	return false;
+}
+
+/*
+ * ==========================================================================
+ * 2. Runtime
+ * ==========================================================================
+ * The builtins and the runtime errors, shared by the interpreter and
+ * native code. A runtime error unwinds to vm_run with longjmp, from
+ * however deep in interpreted and native frames it happens.
+ */
+
+typedef struct VmState {
+	const struct VmProgram *p;
+	struct VmStacks st;
+	FILE *err;
+	jmp_buf stop;
+	bool ok;
+	i32 status;
+
+	struct Jit *jit;
+	struct JitVars *vars;
+	/* Per function: native entry, calls, and backward jumps. */
+	JitEntry *native;
+	u32 *calls;
+	u32 *loops;
+	/* Where the interpreter puts the next frame native code calls. */
+	union VmReg *regs_top;
+	struct VmFrame *frames_top;
+} VmState;
+
+static void vm_print_int(i32 v)
+{
+	printf("%d\n", v);
+}
+
+static void vm_print_float(f32 v)
+{
+	printf("%f\n", (double)v);
+}
+
+static void vm_print_double(f64 v)
+{
+	printf("%f\n", v);
+}
+
+static void vm_print_bool(i32 v)
+{
+	fputs(v ? "true\n" : "false\n", stdout);
+}
+
+/* Input that does not parse reads as zero. */
+static i32 vm_get_int(void)
+{
+	i32 v;
+	return scanf("%d", &v) == 1 ? v : 0;
+}
+
+static f32 vm_get_float(void)
+{
+	f32 v;
+	return scanf("%f", &v) == 1 ? v : 0;
+}
+
+static f64 vm_get_double(void)
+{
+	f64 v;
+	return scanf("%lf", &v) == 1 ? v : 0;
+}
+
+CACT_NORETURN static void stop(VmState *s, const char *what, const char *func)
+{
+	fflush(stdout);
+	fprintf(s->err, "Runtime error: %s in '%s'\n", what, func);
+	longjmp(s->stop, 1);
+}
+
+/* JIT traps; `func` is an IrFunc.id. */
+CACT_NORETURN static void div_zero(u32 func, void *ctx)
+{
+	VmState *s = ctx;
+	stop(s, "division by zero", s->p->names[func]);
+}
+
+CACT_NORETURN static void overflow(u32 func, void *ctx)
+{
+	VmState *s = ctx;
+	stop(s, "stack overflow", s->p->names[func]);
+}
+
+/*
+ * ==========================================================================
+ * 3. Interpreter
+ * ==========================================================================
+ * Threaded dispatch: every handler ends by jumping straight to the next
+ * one through the label table, so each opcode has its own indirect
+ * branch for the predictor to learn.
+ *
+ * interp runs `f` on the registers at R (arguments in place) until it
+ * returns, pushing its callees' frames above fp. Native code re-enters
+ * it for functions that are not compiled.
+ */
+
+static JitEntry hot_call(VmState *s, u32 func);
+static JitEntry hot_loop(VmState *s, const struct VmFunc *f, u32 at);
+
+static u64 interp(VmState *s, const struct VmFunc *f, union VmReg *R,
+		  u8 *mem, struct VmFrame *fp)
+{
+	static const void *const labels[VmOp_COUNT] = {
+#define X(ID, WORDS) [VmOp_##ID] = &&op_##ID,
+		VM_OPS(X)
+#undef X
+	};
+
+	const struct VmProgram *p = s->p;
+	union VmReg *const regs_end = s->st.regs + VM_STACK_REGS;
+	u8 *const mem_end = s->st.mem + VM_STACK_BYTES;
+	struct VmFrame *const frames_end = s->st.frames + VM_MAX_DEPTH;
+	struct VmFrame *const base = fp;
+
+	const u32 *const code = p->code.data;
+	const struct VmFunc *const funcs = p->funcs.data;
+	const union VmReg *const consts = p->consts.data;
+	const bool jit = s->jit != NULL;
+
+	const u32 *ip = code + f->entry;
+	union VmReg ret;
+
+	if (f->nregs > (usize)(regs_end - R) ||
+	    f->frame_bytes > (usize)(mem_end - mem))
+		stop(s, "stack overflow", f->name);
+	memcpy(R + f->nparams, consts + f->first_const,
+	       f->nconsts * sizeof(*R));
+
+#define DISPATCH() goto *labels[*ip]
+#define NEXT(n)             \
+	do {                \
+		ip += (n);  \
+		DISPATCH(); \
+	} while (0)
+#define RA R[ip[1]]
+#define RB R[ip[2]]
+#define RC R[ip[3]]
+/* i32 arithmetic wraps, as in the IR. */
+#define WRAP(op) (i32)((u32)RB.i op(u32) RC.i)
+
+	DISPATCH();
+
+op_MOV:
+	RA = RB;
+	NEXT(3);
+op_ALLOCA:
+	RA.p = mem + ip[2];
+	NEXT(3);
+op_ZERO:
+	memset(RA.p, 0, ip[2]);
+	NEXT(3);
+op_INDEX:
+	RA.p = RB.p + (isize)RC.i * ip[4];
+	NEXT(5);
+op_INDEX_K:
+	RA.p = RB.p + (i32)ip[3];
+	NEXT(4);
+
+op_LOAD_I8:
+	RA.i = *RB.p;
+	NEXT(3);
+op_LOAD_32:
+	memcpy(&RA.i, RB.p, 4);
+	NEXT(3);
+op_LOAD_64:
+	memcpy(&RA.d, RB.p, 8);
+	NEXT(3);
+op_STORE_I8:
+	*RA.p = (u8)RB.i;
+	NEXT(3);
+op_STORE_32:
+	memcpy(RA.p, &RB.i, 4);
+	NEXT(3);
+op_STORE_64:
+	memcpy(RA.p, &RB.d, 8);
+	NEXT(3);
+
+op_ADD_I32:
+	RA.i = WRAP(+);
+	NEXT(4);
+op_SUB_I32:
+	RA.i = WRAP(-);
+	NEXT(4);
+op_MUL_I32:
+	RA.i = WRAP(*);
+	NEXT(4);
+op_DIV_I32:
+	if (RC.i == 0)
+		stop(s, "division by zero", s->p->names[ip[4]]);
+	/* INT_MIN / -1 wraps instead of trapping. */
+	RA.i = RC.i == -1 ? (i32)(0u - (u32)RB.i) : RB.i / RC.i;
+	NEXT(5);
+op_MOD_I32:
+	if (RC.i == 0)
+		stop(s, "division by zero", s->p->names[ip[4]]);
+	RA.i = RC.i == -1 ? 0 : RB.i % RC.i;
+	NEXT(5);
+op_ADD_F32:
+	RA.f = RB.f + RC.f;
+	NEXT(4);
+op_SUB_F32:
+	RA.f = RB.f - RC.f;
+	NEXT(4);
+op_MUL_F32:
+	RA.f = RB.f * RC.f;
+	NEXT(4);
+op_DIV_F32:
+	RA.f = RB.f / RC.f;
+	NEXT(4);
+op_ADD_F64:
+	RA.d = RB.d + RC.d;
+	NEXT(4);
+op_SUB_F64:
+	RA.d = RB.d - RC.d;
+	NEXT(4);
+op_MUL_F64:
+	RA.d = RB.d * RC.d;
+	NEXT(4);
+op_DIV_F64:
+	RA.d = RB.d / RC.d;
+	NEXT(4);
+op_NEG_I32:
+	RA.i = (i32)(0u - (u32)RB.i);
+	NEXT(3);
+op_NEG_F32:
+	RA.f = -RB.f;
+	NEXT(3);
+op_NEG_F64:
+	RA.d = -RB.d;
+	NEXT(3);
+op_NOT:
+	RA.i = RB.i ^ 1;
+	NEXT(3);
+
+#define CMP(T, FIELD, NAME, op)          \
+	op_##NAME##_##T:                 \
+	RA.i = RB.FIELD op RC.FIELD;     \
+	NEXT(4);
+#define CMPS(T, FIELD)           \
+	CMP(T, FIELD, EQ, ==)    \
+	CMP(T, FIELD, NE, !=)    \
+	CMP(T, FIELD, LT, <)     \
+	CMP(T, FIELD, LE, <=)    \
+	CMP(T, FIELD, GT, >)     \
+	CMP(T, FIELD, GE, >=)
+	CMPS(I32, i)
+	CMPS(F32, f)
+	CMPS(F64, d)
+#undef CMPS
+#undef CMP
+
+/* Addresses compare as signed 64-bit integers, as INDEX offsets them. */
+#define CMP(NAME, op)                                  \
+	op_##NAME##_PTR:                               \
+	RA.i = (i64)RB.bits op (i64)RC.bits;           \
+	NEXT(4);
+	CMP(EQ, ==)
+	CMP(NE, !=)
+	CMP(LT, <)
+	CMP(LE, <=)
+	CMP(GT, >)
+	CMP(GE, >=)
+#undef CMP
+
+/* Loops close with a JMP back to their header: only JMP counts. */
+op_JMP: {
+	const u32 *to = code + ip[1];
+	if (jit && to < ip && ++s->loops[f - funcs] >= JIT_HOT_LOOPS) {
+		JitEntry e = hot_loop(s, f, ip[1]);
+		if (e) {
+			s->regs_top = R + f->nregs;
+			s->frames_top = fp;
+			ret.bits = e(R, mem);
+			if (f->is_void)
+				goto op_RET_VOID;
+			goto leave;
+		}
+	}
+	ip = to;
+	DISPATCH();
+}
+op_JNZ:
+	ip = code + (R[ip[1]].i ? ip[2] : ip[3]);
+	DISPATCH();
+
+#define JCC(NAME, op)                                          \
+	op_J##NAME##_I32:                                      \
+	ip = code + (R[ip[1]].i op R[ip[2]].i ? ip[3] : ip[4]); \
+	DISPATCH();
+	JCC(EQ, ==)
+	JCC(NE, !=)
+	JCC(LT, <)
+	JCC(LE, <=)
+	JCC(GT, >)
+	JCC(GE, >=)
+#undef JCC
+
+op_CALL: {
+	const struct VmFunc *callee = &funcs[ip[2]];
+	union VmReg *regs = R + f->nregs;
+	u8 *frame = mem + f->frame_bytes;
+	if (fp == frames_end || callee->nregs > (usize)(regs_end - regs) ||
+	    callee->frame_bytes > (usize)(mem_end - frame))
+		stop(s, "stack overflow", f->name);
+
+	u32 nargs = ip[3];
+	for (u32 i = 0; i < nargs; ++i)
+		regs[i] = R[ip[4 + i]];
+
+	if (jit) {
+		JitEntry e = s->native[ip[2]];
+		if (!e && ++s->calls[ip[2]] == JIT_HOT_CALLS)
+			e = hot_call(s, ip[2]);
+		if (e) {
+			s->regs_top = regs;
+			s->frames_top = fp;
+			s->vars->mem_top = frame;
+			ret.bits = e(regs, NULL);
+			if (!callee->is_void)
+				RA = ret;
+			NEXT(4 + nargs);
+		}
+	}
+
+	memcpy(regs + nargs, consts + callee->first_const,
+	       callee->nconsts * sizeof(*regs));
+	*fp++ = (struct VmFrame){ ip, R, mem, f };
+	R = regs;
+	mem = frame;
+	f = callee;
+	ip = code + callee->entry;
+	DISPATCH();
+}
+op_RET:
+	ret = RA;
+leave:
+	if (fp == base)
+		return ret.bits;
+	--fp;
+	ip = fp->ip;
+	R = fp->regs;
+	mem = fp->mem;
+	f = fp->func;
+	RA = ret;
+	NEXT(4 + ip[3]);
+op_RET_VOID:
+	if (fp == base)
+		return 0;
+	--fp;
+	ip = fp->ip;
+	R = fp->regs;
+	mem = fp->mem;
+	f = fp->func;
+	NEXT(4 + ip[3]);
+
+op_PRINT_INT:
+	vm_print_int(RA.i);
+	NEXT(2);
+op_PRINT_FLOAT:
+	vm_print_float(RA.f);
+	NEXT(2);
+op_PRINT_DOUBLE:
+	vm_print_double(RA.d);
+	NEXT(2);
+op_PRINT_BOOL:
+	vm_print_bool(RA.i);
+	NEXT(2);
+op_GET_INT:
+	RA.i = vm_get_int();
+	NEXT(2);
+op_GET_FLOAT:
+	RA.f = vm_get_float();
+	NEXT(2);
+op_GET_DOUBLE:
+	RA.d = vm_get_double();
+	NEXT(2);
+
+#undef WRAP
+#undef RC
+#undef RB
+#undef RA
+#undef NEXT
+#undef DISPATCH
+}
+
+/*
+ * ==========================================================================
+ * 4. Tiering
+ * ==========================================================================
+ */
+
+static JitEntry hot_call(VmState *s, u32 func)
+{
+	JitEntry e = jit_compile(s->jit, func);
+	s->native[func] = e;
+	return e;
+}
+
+/* A backward jump to code offset `at` in `f` turned hot: the loop entry
+ * at that block, if it has one. */
+static JitEntry hot_loop(VmState *s, const struct VmFunc *f, u32 at)
+{
+	const struct VmProgram *p = s->p;
+	u32 func = (u32)(f - p->funcs.data);
+	s->loops[func] = 0;
+
+	const u32 *block_at = p->block_at.data + f->first_block;
+	u32 lo = 1, hi = f->nblocks;
+	while (lo < hi) {
+		u32 mid = lo + (hi - lo) / 2;
+		if (block_at[mid] < at)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == f->nblocks || block_at[lo] != at)
+		return NULL;
+	JitEntry e = jit_loop_entry(s->jit, func, lo);
+	s->native[func] = jit_compile(s->jit, func);
+	return e;
+}
+
+/* Native code calling a function that is not compiled. */
+static u64 reenter(void *ctx, u32 func, union VmReg *args)
+{
+	VmState *s = ctx;
+	const struct VmFunc *f = &s->p->funcs.data[func];
+	union VmReg *regs = s->regs_top;
+	struct VmFrame *frames = s->frames_top;
+	u8 *mem = s->vars->mem_top;
+
+	u8 probe;
+	if ((uintptr_t)&probe < (uintptr_t)s->vars->stack_limit ||
+	    f->nparams > (usize)(s->st.regs + VM_STACK_REGS - regs))
+		stop(s, "stack overflow", f->name);
+	memcpy(regs, args, f->nparams * sizeof(*regs));
+
+	u64 bits;
+	if (++s->calls[func] >= JIT_HOT_CALLS && hot_call(s, func)) {
+		bits = s->native[func](regs, NULL);
+	} else {
+		s->regs_top = regs + f->nregs;
+		bits = interp(s, f, regs, mem, frames);
+	}
+	s->regs_top = regs;
+	s->frames_top = frames;
+	s->vars->mem_top = mem;
+	return bits;
+}
+
+static void run_main(void *arg)
+{
+	VmState *s = arg;
+	if (setjmp(s->stop))
+		return;
+	const struct VmFunc *f = &s->p->funcs.data[s->p->main];
+	union VmReg ret;
+	if (s->jit && s->native[s->p->main]) {
+		s->regs_top = s->st.regs;
+		s->frames_top = s->st.frames;
+		s->vars->mem_top = s->st.mem;
+		ret.bits = s->native[s->p->main](s->st.regs, NULL);
+	} else {
+		ret.bits = interp(s, f, s->st.regs, s->st.mem, s->st.frames);
+	}
+	s->status = f->is_void ? 0 : ret.i;
+	s->ok = true;
+}
+
+static bool jit_init(VmState *s, const struct IrModule *m, VmJit mode)
+{
+	struct JitHost host = {
+		.ctx = s,
+		.call = reenter,
+		.runtime = {
+			[X86_RT_PRINT_INT] = (void (*)(void))vm_print_int,
+			[X86_RT_PRINT_FLOAT] = (void (*)(void))vm_print_float,
+			[X86_RT_PRINT_DOUBLE] = (void (*)(void))vm_print_double,
+			[X86_RT_PRINT_BOOL] = (void (*)(void))vm_print_bool,
+			[X86_RT_GET_INT] = (void (*)(void))vm_get_int,
+			[X86_RT_GET_FLOAT] = (void (*)(void))vm_get_float,
+			[X86_RT_GET_DOUBLE] = (void (*)(void))vm_get_double,
+			[X86_RT_DIV_ZERO] = (void (*)(void))div_zero,
+			[X86_RT_OVERFLOW] = (void (*)(void))overflow,
+		},
+		.mem_end = s->st.mem + VM_STACK_BYTES,
+	};
+	s->jit = jit_new(s->p, m, &host);
+	if (!s->jit)
+		return false;
+	s->vars = jit_vars(s->jit);
+
+	usize nfuncs = vec_len(s->p->funcs);
+	allocer_t sys = allocer_system();
+	s->native = allocer_alloc(sys, layout((nfuncs + 1) * sizeof(JitEntry),
+					      _Alignof(JitEntry)));
+	s->calls = allocer_alloc(sys, layout((nfuncs + 1) * 2 * sizeof(u32), 4));
+	massert(s->native && s->calls, "OOM vm");
+	memset(s->native, 0, (nfuncs + 1) * sizeof(JitEntry));
+	memset(s->calls, 0, (nfuncs + 1) * 2 * sizeof(u32));
+	s->loops = s->calls + nfuncs + 1;
+
+	if (mode == VmJit_EAGER)
+		for (u32 i = 0; i < nfuncs; ++i)
+			if (!m->funcs.data[i].is_extern)
+				s->native[i] = jit_compile(s->jit, i);
+	return true;
+}
+
+static void jit_deinit(VmState *s)
+{
+	if (!s->jit)
+		return;
+	usize nfuncs = vec_len(s->p->funcs);
+	allocer_t sys = allocer_system();
+	allocer_free(sys, s->native,
+		     layout((nfuncs + 1) * sizeof(JitEntry), _Alignof(JitEntry)));
+	allocer_free(sys, s->calls, layout((nfuncs + 1) * 2 * sizeof(u32), 4));
+	jit_free(s->jit);
+}
+
+bool vm_run(const struct VmProgram *p, const struct IrModule *m, VmJit jit,
+	    i32 *status, FILE *err)
+{
+	TRACE_SCOPE("vm_run");
+	VmState s = { .p = p, .err = err };
+	if (!stacks_init(&s.st)) {
+		fprintf(err, "Runtime error: cannot reserve the VM stacks\n");
+		return false;
+	}
+
+	if (jit != VmJit_OFF && m && jit_init(&s, m, jit))
+		jit_enter(s.jit, run_main, &s);
+	else
+		run_main(&s);
+
+	fflush(stdout);
+	jit_deinit(&s);
+	stacks_deinit(&s.st);
+	*status = s.status;
+	return s.ok;
+}
@@ -0,0 +1,196 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <vmem.h>
+#include <core/msg.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define VMEM_HUGE_PAGE ((usize)2 << 20)
+#define VMEM_COMMIT_STEP VMEM_HUGE_PAGE
+
+/* Arena bytes per source byte seen on real inputs is ~25; leave headroom. */
+#define VMEM_BYTES_PER_INPUT_BYTE 48
+#define VMEM_MIN_RESERVE ((usize)64 << 20)
+
+static usize round_up(usize n, usize to)
+{
+	return (n + to - 1) & ~(to - 1);
+}
+
+/*
+ * ==========================================================================
+ * 1. Reservation
+ * ==========================================================================
+ */
+
+usize vmem_size_for_input(u64 input_bytes)
+{
+	u64 want = input_bytes * VMEM_BYTES_PER_INPUT_BYTE;
+	if (want < VMEM_MIN_RESERVE)
+		want = VMEM_MIN_RESERVE;
+	return round_up((usize)want, VMEM_HUGE_PAGE);
+}
+
+static void *reserve(usize size, bool hugetlb)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	if (!hugetlb)
+		return mmap(NULL, size, PROT_NONE, flags | MAP_NORESERVE, -1,
+			    0);
+
+	/*
+	 * Explicit huge pages must come out of the pool at mmap time: with
+	 * MAP_NORESERVE an empty pool would only show up as SIGBUS on first
+	 * touch. Without it, mmap fails cleanly and we fall back.
+	 */
+#ifdef MAP_HUGETLB
+	return mmap(NULL, size, PROT_NONE, flags | MAP_HUGETLB, -1, 0);
+#else
+	return MAP_FAILED;
+#endif
+}
+
+bool vmem_init(struct VMem *v, usize size, VMemPages pages,
+	       allocer_t fallback)
+{
+	*v = (struct VMem){ .fallback = fallback };
+	size = round_up(size, VMEM_HUGE_PAGE);
+
+	if (pages == VMemPages_HUGETLB) {
+		void *p = reserve(size, true);
+		if (p != MAP_FAILED) {
+			v->base = p;
+			v->reserved = size;
+			v->hugetlb = true;
+			return true;
+		}
+	}
+
+	/* Over-reserve by one huge page so the start can be aligned to one. */
+	u8 *p = reserve(size + VMEM_HUGE_PAGE, false);
+	if (p == MAP_FAILED)
+		return false;
+
+	u8 *base = (u8 *)round_up((usize)p, VMEM_HUGE_PAGE);
+	usize head = (usize)(base - p);
+	if (head > 0)
+		munmap(p, head);
+	munmap(base + size, VMEM_HUGE_PAGE - head);
+
+#ifdef MADV_HUGEPAGE
+	/* Advisory only: without THP support this fails harmlessly. */
+	madvise(base, size, MADV_HUGEPAGE);
+#endif
+
+	v->base = base;
+	v->reserved = size;
+	return true;
+}
+
+void vmem_deinit(struct VMem *v)
+{
+	if (v->base)
+		munmap(v->base, v->reserved);
+	v->base = NULL;
+}
+
+/* Make [0, end) readable and writable. */
+static bool commit(struct VMem *v, usize end)
+{
+	if (end <= v->committed)
+		return true;
+
+	usize to = round_up(end, VMEM_COMMIT_STEP);
+	if (to > v->reserved)
+		to = v->reserved;
+	if (mprotect(v->base + v->committed, to - v->committed,
+		     PROT_READ | PROT_WRITE) != 0)
+		return false;
+	v->committed = to;
+	return true;
+}
+
+/*
+ * ==========================================================================
+ * 2. Allocator
+ * ==========================================================================
+ */
+
+static bool owns(struct VMem *v, void *ptr)
+{
+	return v->base && (u8 *)ptr >= v->base &&
+	       (u8 *)ptr < v->base + v->reserved;
+}
+
+static void *vmem_alloc(void *self, layout_t l)
+{
+	struct VMem *v = self;
+	usize align = l.align ? l.align : 1;
+	usize off = round_up(v->used, align);
+
+	if (!v->base || off + l.size > v->reserved || !commit(v, off + l.size))
+		return allocer_alloc(v->fallback, l);
+
+	v->last = off;
+	v->used = off + l.size;
+	return v->base + off;
+}
+
+static void vmem_free(void *self, void *ptr, layout_t l)
+{
+	struct VMem *v = self;
+
+	if (!ptr)
+		return;
+	if (!owns(v, ptr)) {
+		allocer_free(v->fallback, ptr, l);
+		return;
+	}
+	if ((u8 *)ptr == v->base + v->last)
+		v->used = v->last;
+}
+
+static void *vmem_realloc(void *self, void *ptr, layout_t old,
+			  usize new_size)
+{
+	struct VMem *v = self;
+
+	if (ptr && !owns(v, ptr))
+		return allocer_realloc(v->fallback, ptr, old, new_size);
+
+	if (ptr && (u8 *)ptr == v->base + v->last &&
+	    v->last + new_size <= v->reserved && commit(v, v->last + new_size)) {
+		v->used = v->last + new_size;
+		return ptr;
+	}
+
+	void *res = vmem_alloc(v, layout(new_size, old.align));
+	if (res && ptr)
+		memcpy(res, ptr, old.size < new_size ? old.size : new_size);
+	return res;
+}
+
+static const allocer_vtable_t VMEM_VTABLE = {
+	.alloc = vmem_alloc,
+	.free = vmem_free,
+	.realloc = vmem_realloc,
+};
+
+allocer_t vmem_allocer(struct VMem *v)
+{
+	return (allocer_t){ .self = v, .vtable = &VMEM_VTABLE };
+}
@@ -0,0 +1,779 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <vm.h>
+#include <prelude.h>
+#include <trace.h>
+#include <std/map.h>
+#include <std/allocers/system.h>
+#include <core/msg.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Translation State
+ * ==========================================================================
+ * Values that live across blocks (and PHIs with their incoming values)
+ * get a register of their own for the whole function. Everything else
+ * dies in its block and takes a temporary, recycled after its last use,
+ * so frames stay small even for long straight-line functions.
+ */
+
+/* `live` of a value that needs a register for the whole function. */
+#define LIVE_GLOBAL UINT32_MAX
+/* `reg` of a value without one (yet). */
+#define NO_REG UINT32_MAX
+
+/* A branch operand to patch with a block's code offset. */
+struct VmFixup {
+	u32 at;
+	u32 block;
+};
+
+/* Constants are shared within a function, so the key names it too. */
+struct VmConstKey {
+	u32 func;
+	u32 ty;
+	u64 bits;
+};
+
+static u64 _const_hash(const void *key)
+{
+	const struct VmConstKey *k = key;
+	u64 h = k->bits * 0x9e3779b97f4a7c15ull;
+	return h ^ ((u64)k->func << 8 | k->ty) * 2654435761u;
+}
+
+static bool _const_eq(const void *lhs, const void *rhs)
+{
+	const struct VmConstKey *a = lhs, *b = rhs;
+	return a->func == b->func && a->ty == b->ty && a->bits == b->bits;
+}
+
+static const map_ops_t MAP_OPS_CONST = { .hash = _const_hash,
+					 .equals = _const_eq };
+
+defMap(struct VmConstKey, u32, VmConstMap);
+defVec(struct VmFixup, VmFixupVec);
+
+typedef struct VmGen {
+	struct VmProgram *p;
+	const struct IrModule *m;
+	/* Builtin opcode of each function, or VmOp_COUNT. */
+	u8 *builtin;
+	VmConstMap consts;
+
+	/* The function being translated. */
+	const struct IrFunc *fn;
+	u32 func;
+	struct VmFunc vf;
+
+	/* Per value: register, last use (a position, or LIVE_GLOBAL), number
+	 * of uses and ALLOCA offset. One buffer holds all. */
+	u32 *buf;
+	usize cap;
+	u32 *reg;
+	u32 *live;
+	u32 *uses;
+	u32 *alloca_at;
+	/* Per block: code offset, in p->block_at. */
+	u32 *block_at;
+
+	/* Temporaries free for reuse; `next_reg` is the first never used. */
+	u32 *free;
+	u32 nfree;
+	u32 next_reg;
+
+	VmFixupVec fixups;
+} VmGen;
+
+static const char *const BUILTIN_NAMES[PreludeBuiltin_COUNT] = {
+#define X(NAME, RET, PARAM) [PreludeBuiltin_##NAME] = #NAME,
+	PRELUDE_BUILTINS(X)
+#undef X
+};
+
+static const VmOp BUILTIN_OPS[PreludeBuiltin_COUNT] = {
+	[PreludeBuiltin_print_int] = VmOp_PRINT_INT,
+	[PreludeBuiltin_print_float] = VmOp_PRINT_FLOAT,
+	[PreludeBuiltin_print_double] = VmOp_PRINT_DOUBLE,
+	[PreludeBuiltin_print_bool] = VmOp_PRINT_BOOL,
+	[PreludeBuiltin_get_int] = VmOp_GET_INT,
+	[PreludeBuiltin_get_float] = VmOp_GET_FLOAT,
+	[PreludeBuiltin_get_double] = VmOp_GET_DOUBLE,
+};
+
+static u32 here(VmGen *g)
+{
+	return (u32)vec_len(g->p->code);
+}
+
+static void emit_words(VmGen *g, const u32 *words, u32 n)
+{
+	for (u32 i = 0; i < n; ++i)
+		massert(vec_push(g->p->code, words[i]), "OOM vm");
+}
+
+#define EMIT(g, ...)                                    \
+	emit_words((g), (const u32[]){ __VA_ARGS__ },    \
+		   sizeof((const u32[]){ __VA_ARGS__ }) / \
+			   sizeof(u32))
+
+/* Emits a reference to `bb`, patched once the function is laid out. */
+static void emit_target(VmGen *g, u32 bb)
+{
+	struct VmFixup fix = { .at = here(g), .block = bb };
+	massert(vec_push(g->fixups, fix), "OOM vm");
+	EMIT(g, 0);
+}
+
+/*
+ * ==========================================================================
+ * 2. Registers
+ * ==========================================================================
+ */
+
+static bool is_const(const struct IrFunc *fn, IrValue v)
+{
+	IrOp op = ir_inst(fn, v)->op;
+	return op == IrOp_CONST || op == IrOp_GLOBAL;
+}
+
+static void const_reg(VmGen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	union VmReg bits = { .bits = 0 };
+	if (inst->op == IrOp_GLOBAL) {
+		bits.p = g->p->global_at[inst->imm.index];
+	} else if (inst->ty == IrType_F64) {
+		bits.d = inst->imm.k.d;
+	} else if (inst->ty == IrType_F32) {
+		bits.f = inst->imm.k.f;
+	} else if (inst->ty == IrType_I1) {
+		bits.i = inst->imm.k.b;
+	} else {
+		bits.i = inst->imm.k.i;
+	}
+
+	struct VmConstKey key = { g->func, inst->ty, bits.bits };
+	u32 *known = map_get(g->consts, key);
+	if (known) {
+		g->reg[v] = *known;
+		return;
+	}
+	u32 r = g->vf.nparams + g->vf.nconsts++;
+	massert(vec_push(g->p->consts, bits), "OOM vm");
+	massert(map_put(g->consts, key, r), "OOM vm");
+	g->reg[v] = r;
+}
+
+/* An INDEX whose index is a constant folds into INDEX_K. */
+static bool index_offset(const struct IrFunc *fn, IrValue v, i32 *off)
+{
+	const struct IrInst *inst = ir_inst(fn, v);
+	IrValue idx = ir_args(fn, v)[1];
+	if (ir_inst(fn, idx)->op != IrOp_CONST)
+		return false;
+	i64 bytes = (i64)ir_inst(fn, idx)->imm.k.i * inst->imm.mem.size;
+	if (bytes < INT32_MIN || bytes > INT32_MAX)
+		return false;
+	*off = (i32)bytes;
+	return true;
+}
+
+static void note_use(VmGen *g, IrValue u, u32 bb, u32 pos, bool global)
+{
+	const struct IrInst *def = ir_inst(g->fn, u);
+	g->uses[u]++;
+	if (def->op == IrOp_PARAM)
+		return;
+	if (is_const(g->fn, u)) {
+		if (g->reg[u] == NO_REG)
+			const_reg(g, u);
+		return;
+	}
+	if (global || def->block != bb)
+		g->live[u] = LIVE_GLOBAL;
+	else if (g->live[u] != LIVE_GLOBAL && g->live[u] < pos)
+		g->live[u] = pos;
+}
+
+/*
+ * Numbers instructions in layout order, counts uses, finds the values
+ * that outlive their block and gives constants their registers.
+ */
+static void analyze(VmGen *g)
+{
+	const struct IrFunc *fn = g->fn;
+	u32 pos = 0;
+	for (u32 bb = 1; bb < vec_len(fn->blocks); ++bb) {
+		ir_foreach_inst(fn, bb, v)
+		{
+			const struct IrInst *inst = ir_inst(fn, v);
+			const IrValue *args = ir_args(fn, v);
+			++pos;
+			if (inst->op == IrOp_PHI) {
+				g->live[v] = LIVE_GLOBAL;
+				for (u32 i = 1; i < inst->nargs; i += 2)
+					note_use(g, args[i], bb, pos, true);
+				continue;
+			}
+
+			i32 off;
+			u32 n = inst->nargs;
+			if (inst->op == IrOp_INDEX && index_offset(fn, v, &off))
+				n = 1;
+			for (u32 i = 0; i < n; ++i)
+				note_use(g, args[i], bb, pos, false);
+		}
+	}
+
+	for (u32 i = 0; i < vec_len(fn->params); ++i)
+		g->reg[fn->params.data[i]] = i;
+
+	g->next_reg = g->vf.nparams + g->vf.nconsts;
+	for (IrValue v = 1; v < vec_len(fn->insts); ++v) {
+		if (g->live[v] == LIVE_GLOBAL && g->reg[v] == NO_REG)
+			g->reg[v] = g->next_reg++;
+	}
+}
+
+static u32 temp_new(VmGen *g)
+{
+	return g->nfree ? g->free[--g->nfree] : g->next_reg++;
+}
+
+static void temp_free(VmGen *g, u32 r)
+{
+	g->free[g->nfree++] = r;
+}
+
+/* Releases the temporaries of operands whose last use is at `pos`. */
+static void release_args(VmGen *g, IrValue v, u32 pos)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	const IrValue *args = ir_args(g->fn, v);
+	for (u32 i = 0; i < inst->nargs; ++i) {
+		IrValue u = args[i];
+		if (g->live[u] == pos && g->reg[u] != NO_REG) {
+			temp_free(g, g->reg[u]);
+			/* No position matches 0: repeats are freed once. */
+			g->live[u] = 0;
+		}
+	}
+}
+
+static u32 def_reg(VmGen *g, IrValue v)
+{
+	if (g->reg[v] == NO_REG)
+		g->reg[v] = temp_new(g);
+	return g->reg[v];
+}
+
+/*
+ * ==========================================================================
+ * 3. Instructions
+ * ==========================================================================
+ */
+
+static VmOp typed_op(VmOp i32_op, IrType ty)
+{
+	/* The I32, F32 and F64 forms of an operation are declared in that
+	 * order, a fixed distance apart. */
+	switch (ty) {
+	case IrType_F32:
+		return (VmOp)(i32_op + (VmOp_ADD_F32 - VmOp_ADD_I32));
+	case IrType_F64:
+		return (VmOp)(i32_op + (VmOp_ADD_F64 - VmOp_ADD_I32));
+	default:
+		return i32_op;
+	}
+}
+
+static VmOp arith_op(IrOp op, IrType ty)
+{
+	switch (op) {
+	case IrOp_ADD:
+		return typed_op(VmOp_ADD_I32, ty);
+	case IrOp_SUB:
+		return typed_op(VmOp_SUB_I32, ty);
+	case IrOp_MUL:
+		return typed_op(VmOp_MUL_I32, ty);
+	case IrOp_DIV:
+		return typed_op(VmOp_DIV_I32, ty);
+	default:
+		return VmOp_MOD_I32;
+	}
+}
+
+static VmOp neg_op(IrType ty)
+{
+	if (ty == IrType_F32)
+		return VmOp_NEG_F32;
+	return ty == IrType_F64 ? VmOp_NEG_F64 : VmOp_NEG_I32;
+}
+
+/* Compares of i1 use the i32 forms: booleans are 0 / 1 in registers. */
+static VmOp cmp_op(IrOp op, IrType operand)
+{
+	VmOp base = VmOp_EQ_I32 + (VmOp)(op - IrOp_EQ);
+	if (operand == IrType_F32)
+		return base + (VmOp_EQ_F32 - VmOp_EQ_I32);
+	if (operand == IrType_F64)
+		return base + (VmOp_EQ_F64 - VmOp_EQ_I32);
+	if (operand == IrType_PTR)
+		return base + (VmOp_EQ_PTR - VmOp_EQ_I32);
+	return base;
+}
+
+static bool is_cmp(IrOp op)
+{
+	return op >= IrOp_EQ && op <= IrOp_GE;
+}
+
+static VmOp mem_op(VmOp i8_op, IrType ty)
+{
+	if (ty == IrType_I1)
+		return i8_op;
+	return ty == IrType_F64 ? i8_op + 2 : i8_op + 1;
+}
+
+/*
+ * A compare used only by the CONDBR right after it becomes one
+ * compare-and-branch instruction for i32 and i1 operands.
+ */
+static bool fuses_into_branch(VmGen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	if (!is_cmp(inst->op) || g->uses[v] != 1 || !inst->next)
+		return false;
+	const struct IrInst *next = ir_inst(g->fn, inst->next);
+	IrType ty = ir_inst(g->fn, ir_args(g->fn, v)[0])->ty;
+	return next->op == IrOp_CONDBR && ir_args(g->fn, inst->next)[0] == v &&
+	       (ty == IrType_I32 || ty == IrType_I1);
+}
+
+static void emit_call(VmGen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	const IrValue *args = ir_args(g->fn, v);
+	u32 callee = inst->imm.index;
+
+	/* Arguments are read before the result is written, so the result
+	 * may reuse an argument's register. */
+	u32 nargs = inst->nargs;
+	u32 a0 = nargs ? g->reg[args[0]] : 0;
+	u32 *arg_regs = g->free + g->nfree;
+	for (u32 i = 0; i < nargs; ++i)
+		arg_regs[i] = g->reg[args[i]];
+
+	VmOp builtin = (VmOp)g->builtin[callee];
+	if (builtin != VmOp_COUNT) {
+		if (inst->ty == IrType_VOID) {
+			EMIT(g, builtin, a0);
+		} else {
+			EMIT(g, builtin, def_reg(g, v));
+		}
+		return;
+	}
+
+	EMIT(g, VmOp_CALL, 0, callee, nargs);
+	u32 dst_at = here(g) - 3;
+	emit_words(g, arg_regs, nargs);
+	if (inst->ty != IrType_VOID)
+		g->p->code.data[dst_at] = def_reg(g, v);
+}
+
+/* Copies for the PHIs of `to` on the edge from `from`, as one parallel
+ * assignment. */
+static void emit_phi_moves(VmGen *g, u32 from, u32 to)
+{
+	const struct IrFunc *fn = g->fn;
+	u32 n = 0;
+	u32 *dst = g->free + g->nfree;
+
+	ir_foreach_inst(fn, to, phi)
+	{
+		const struct IrInst *inst = ir_inst(fn, phi);
+		if (inst->op != IrOp_PHI)
+			break;
+		const IrValue *args = ir_args(fn, phi);
+		for (u32 i = 0; i < inst->nargs; i += 2) {
+			if (args[i] != from)
+				continue;
+			u32 s = g->reg[args[i + 1]];
+			if (s != g->reg[phi]) {
+				dst[2 * n] = g->reg[phi];
+				dst[2 * n + 1] = s;
+				++n;
+			}
+			break;
+		}
+	}
+
+	/* A PHI that reads another PHI of the block needs the old value:
+	 * stage everything through temporaries then. */
+	bool overlap = false;
+	for (u32 i = 0; i < n && !overlap; ++i)
+		for (u32 j = 0; j < n; ++j)
+			overlap |= i != j && dst[2 * i] == dst[2 * j + 1];
+
+	if (!overlap) {
+		for (u32 i = 0; i < n; ++i)
+			EMIT(g, VmOp_MOV, dst[2 * i], dst[2 * i + 1]);
+		return;
+	}
+	/* Popping temporaries leaves them in their slots and `dst` above
+	 * untouched; restoring the count frees them again. */
+	u32 top = g->nfree;
+	for (u32 i = 0; i < n; ++i) {
+		u32 t = temp_new(g);
+		EMIT(g, VmOp_MOV, t, dst[2 * i + 1]);
+		dst[2 * i + 1] = t;
+	}
+	for (u32 i = 0; i < n; ++i)
+		EMIT(g, VmOp_MOV, dst[2 * i], dst[2 * i + 1]);
+	g->nfree = top;
+}
+
+static bool has_phis(const struct IrFunc *fn, u32 bb)
+{
+	IrValue first = fn->blocks.data[bb].first;
+	return first && ir_inst(fn, first)->op == IrOp_PHI;
+}
+
+static void emit_condbr(VmGen *g, u32 bb, IrValue v, IrValue fused)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	u32 targets[2] = { inst->imm.target[0], inst->imm.target[1] };
+
+	u32 at;
+	if (fused) {
+		const IrValue *args = ir_args(g->fn, fused);
+		VmOp op = VmOp_JEQ_I32 +
+			  (VmOp)(ir_inst(g->fn, fused)->op - IrOp_EQ);
+		EMIT(g, op, g->reg[args[0]], g->reg[args[1]], 0, 0);
+		at = here(g) - 2;
+	} else {
+		EMIT(g, VmOp_JNZ, g->reg[ir_args(g->fn, v)[0]], 0, 0);
+		at = here(g) - 2;
+	}
+
+	/* Edges into PHIs go through a stub that does the copies. */
+	for (u32 i = 0; i < 2; ++i) {
+		if (!has_phis(g->fn, targets[i])) {
+			struct VmFixup fix = { at + i, targets[i] };
+			massert(vec_push(g->fixups, fix), "OOM vm");
+			continue;
+		}
+		g->p->code.data[at + i] = here(g);
+		emit_phi_moves(g, bb, targets[i]);
+		EMIT(g, VmOp_JMP);
+		emit_target(g, targets[i]);
+	}
+}
+
+static void emit_inst(VmGen *g, u32 bb, IrValue v, u32 pos)
+{
+	const struct IrFunc *fn = g->fn;
+	const struct IrInst *inst = ir_inst(fn, v);
+	const IrValue *args = ir_args(fn, v);
+	IrType ty = (IrType)inst->ty;
+	u32 r0 = inst->nargs > 0 ? g->reg[args[0]] : 0;
+	u32 r1 = inst->nargs > 1 ? g->reg[args[1]] : 0;
+	i32 off;
+
+	switch ((IrOp)inst->op) {
+	case IrOp_ALLOCA:
+		EMIT(g, VmOp_ALLOCA, def_reg(g, v), g->alloca_at[v]);
+		return;
+	case IrOp_PHI:
+	case IrOp_NOP:
+		return;
+	case IrOp_CALL:
+		release_args(g, v, pos);
+		emit_call(g, v);
+		if (g->uses[v] == 0 && ty != IrType_VOID)
+			temp_free(g, g->reg[v]);
+		return;
+	case IrOp_BR:
+		if (has_phis(fn, inst->imm.target[0]))
+			emit_phi_moves(g, bb, inst->imm.target[0]);
+		if (inst->imm.target[0] != bb + 1) {
+			EMIT(g, VmOp_JMP);
+			emit_target(g, inst->imm.target[0]);
+		}
+		return;
+	case IrOp_CONDBR: {
+		IrValue fused = inst->prev && fuses_into_branch(g, inst->prev)
+					? inst->prev
+					: IR_NONE;
+		release_args(g, v, pos);
+		emit_condbr(g, bb, v, fused);
+		return;
+	}
+	case IrOp_RET:
+		if (inst->nargs)
+			EMIT(g, VmOp_RET, r0);
+		else
+			EMIT(g, VmOp_RET_VOID);
+		return;
+	case IrOp_STORE:
+		release_args(g, v, pos);
+		EMIT(g, mem_op(VmOp_STORE_I8, ir_inst(fn, args[1])->ty), r0,
+		     r1);
+		return;
+	case IrOp_ZERO:
+		release_args(g, v, pos);
+		EMIT(g, VmOp_ZERO, r0, inst->imm.mem.size);
+		return;
+	default:
+		break;
+	}
+
+	/*
+	 * Pure instructions whose result is never read are dropped, but for
+	 * an int division that may still have to fail, and a compare fused
+	 * into the branch after it is emitted there; nothing in between can
+	 * take the registers of its operands.
+	 */
+	release_args(g, v, pos);
+	bool traps = (inst->op == IrOp_DIV || inst->op == IrOp_MOD) &&
+		     ty == IrType_I32;
+	if ((g->uses[v] == 0 && !traps) || fuses_into_branch(g, v))
+		return;
+	u32 d = def_reg(g, v);
+	if (g->uses[v] == 0)
+		temp_free(g, d);
+
+	switch ((IrOp)inst->op) {
+	case IrOp_LOAD:
+		EMIT(g, mem_op(VmOp_LOAD_I8, ty), d, r0);
+		break;
+	case IrOp_INDEX:
+		if (index_offset(fn, v, &off))
+			EMIT(g, VmOp_INDEX_K, d, r0, (u32)off);
+		else
+			EMIT(g, VmOp_INDEX, d, r0, r1, inst->imm.mem.size);
+		break;
+	case IrOp_ADD:
+	case IrOp_SUB:
+	case IrOp_MUL:
+	case IrOp_DIV:
+	case IrOp_MOD:
+		if (traps)
+			EMIT(g, arith_op((IrOp)inst->op, ty), d, r0, r1,
+			     inst->imm.index);
+		else
+			EMIT(g, arith_op((IrOp)inst->op, ty), d, r0, r1);
+		break;
+	case IrOp_NEG:
+		EMIT(g, neg_op(ty), d, r0);
+		break;
+	case IrOp_NOT:
+		EMIT(g, VmOp_NOT, d, r0);
+		break;
+	default:
+		massert(is_cmp((IrOp)inst->op), "vm: unexpected IR opcode");
+		EMIT(g, cmp_op((IrOp)inst->op, ir_inst(fn, args[0])->ty), d,
+		     r0, r1);
+		break;
+	}
+}
+
+/*
+ * ==========================================================================
+ * 4. Functions & Program
+ * ==========================================================================
+ */
+
+static void gen_func(VmGen *g, u32 index)
+{
+	const struct IrFunc *fn = &g->m->funcs.data[index];
+	u32 ninsts = (u32)vec_len(fn->insts);
+	u32 nblocks = (u32)vec_len(fn->blocks);
+	TRACE_SCOPE_ARG("vm_func", fn->name);
+
+	g->fn = fn;
+	g->func = index;
+	g->vf = (struct VmFunc){
+		.name = fn->name,
+		.entry = here(g),
+		.nparams = (u32)vec_len(fn->params),
+		.first_const = (u32)vec_len(g->p->consts),
+		.nblocks = nblocks,
+		.is_void = fn->ret == IrType_VOID,
+	};
+
+	/* reg, live, uses, alloca_at and the free list. Above its top, the
+	 * free list also holds the operand lists of calls and PHI copies. */
+	usize need = 5 * (usize)ninsts + 2 * vec_len(fn->args) + 4;
+	if (need > g->cap) {
+		if (g->buf)
+			allocer_free(allocer_system(), g->buf,
+				     layout(g->cap * sizeof(u32), 4));
+		g->cap = need * 2;
+		g->buf = allocer_alloc(allocer_system(),
+				       layout(g->cap * sizeof(u32), 4));
+		massert(g->buf, "OOM vm");
+	}
+	g->reg = g->buf;
+	g->live = g->reg + ninsts;
+	g->uses = g->live + ninsts;
+	g->alloca_at = g->uses + ninsts;
+	g->free = g->alloca_at + ninsts;
+	memset(g->reg, 0xff, ninsts * sizeof(u32));
+	memset(g->live, 0, 2 * (usize)ninsts * sizeof(u32));
+	g->nfree = 0;
+	g->fixups.len = 0;
+	g->vf.frame_bytes = ir_frame_layout(fn, g->alloca_at);
+
+	g->vf.first_block = (u32)vec_len(g->p->block_at);
+	for (u32 bb = 0; bb < nblocks; ++bb)
+		massert(vec_push(g->p->block_at, 0), "OOM vm");
+	g->block_at = g->p->block_at.data + g->vf.first_block;
+
+	analyze(g);
+
+	u32 pos = 0;
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		g->block_at[bb] = here(g);
+		ir_foreach_inst(fn, bb, v)
+		{
+			emit_inst(g, bb, v, ++pos);
+		}
+	}
+	for (usize i = 0; i < vec_len(g->fixups); ++i) {
+		struct VmFixup fix = g->fixups.data[i];
+		g->p->code.data[fix.at] = g->block_at[fix.block];
+	}
+
+	/* Registers that hold their value for the whole function. */
+	g->vf.first_value = (u32)vec_len(g->p->value_reg);
+	for (IrValue v = 0; v < ninsts; ++v) {
+		const struct IrInst *inst = ir_inst(fn, v);
+		bool whole = g->live[v] == LIVE_GLOBAL || inst->op == IrOp_PARAM;
+		u32 r = whole ? g->reg[v] : NO_REG;
+		massert(vec_push(g->p->value_reg, r), "OOM vm");
+	}
+
+	g->vf.nregs = g->next_reg;
+	g->p->funcs.data[index] = g->vf;
+}
+
+/* Lays out the globals in one zeroed block and copies initializers. */
+static void gen_globals(VmGen *g)
+{
+	const struct IrModule *m = g->m;
+	usize nglobals = vec_len(m->globals);
+	usize size = 0;
+	for (usize i = 0; i < nglobals; ++i) {
+		const struct IrGlobal *gl = &m->globals.data[i];
+		usize align = ir_type_size(gl->elem);
+		size = (size + align - 1) / align * align;
+		size += (usize)gl->count * align;
+	}
+
+	struct VmProgram *p = g->p;
+	p->globals_size = size ? size : 1;
+	p->globals =
+		allocer_alloc(allocer_system(), layout(p->globals_size, 8));
+	massert(p->globals, "OOM vm");
+	memset(p->globals, 0, p->globals_size);
+
+	usize at = 0;
+	for (usize i = 0; i < nglobals; ++i) {
+		const struct IrGlobal *gl = &m->globals.data[i];
+		usize align = ir_type_size(gl->elem);
+		at = (at + align - 1) / align * align;
+		p->global_at[i] = p->globals + at;
+		if (gl->init)
+			memcpy(p->globals + at, gl->init,
+			       (usize)gl->count * align);
+		at += (usize)gl->count * align;
+	}
+}
+
+static u8 builtin_of(const struct IrFunc *fn)
+{
+	for (u32 b = 0; fn->is_extern && b < PreludeBuiltin_COUNT; ++b)
+		if (strcmp(fn->name, BUILTIN_NAMES[b]) == 0)
+			return (u8)BUILTIN_OPS[b];
+	return VmOp_COUNT;
+}
+
+bool vm_compile(struct VmProgram *p, const struct IrModule *m)
+{
+	TRACE_SCOPE("vm_compile");
+	allocer_t sys = allocer_system();
+	usize nfuncs = vec_len(m->funcs);
+	usize nglobals = vec_len(m->globals);
+
+	*p = (struct VmProgram){ .main = UINT32_MAX,
+				 .nglobals = nglobals,
+				 .names = m->names.data };
+	massert(vec_init(p->code, sys, 1024), "OOM vm");
+	massert(vec_init(p->funcs, sys, nfuncs), "OOM vm");
+	massert(vec_init(p->consts, sys, 256), "OOM vm");
+	massert(vec_init(p->block_at, sys, 256), "OOM vm");
+	massert(vec_init(p->value_reg, sys, 1024), "OOM vm");
+	p->funcs.len = nfuncs;
+	p->global_at = allocer_alloc(sys, layout((nglobals + 1) * sizeof(u8 *),
+						 _Alignof(u8 *)));
+
+	VmGen g = { .p = p, .m = m };
+	g.builtin = allocer_alloc(sys, layout(nfuncs + 1, 1));
+	massert(p->global_at && g.builtin, "OOM vm");
+	massert(map_init(g.consts, sys, MAP_OPS_CONST), "OOM vm");
+	massert(vec_init(g.fixups, sys, 64), "OOM vm");
+
+	gen_globals(&g);
+	for (u32 i = 0; i < nfuncs; ++i) {
+		const struct IrFunc *fn = &m->funcs.data[i];
+		g.builtin[i] = builtin_of(fn);
+		p->funcs.data[i] = (struct VmFunc){ .name = fn->name };
+		if (strcmp(fn->name, "main") == 0 && !fn->is_extern)
+			p->main = i;
+	}
+	for (u32 i = 0; i < nfuncs; ++i) {
+		if (!m->funcs.data[i].is_extern)
+			gen_func(&g, i);
+	}
+
+	if (g.buf)
+		allocer_free(sys, g.buf, layout(g.cap * sizeof(u32), 4));
+	vec_deinit(g.fixups);
+	map_deinit(g.consts);
+	allocer_free(sys, g.builtin, layout(nfuncs + 1, 1));
+	return p->main != UINT32_MAX;
+}
+
+void vm_program_deinit(struct VmProgram *p)
+{
+	allocer_t sys = allocer_system();
+	if (p->globals)
+		allocer_free(sys, p->globals, layout(p->globals_size, 8));
+	if (p->global_at)
+		allocer_free(sys, p->global_at,
+			     layout((p->nglobals + 1) * sizeof(u8 *),
+				    _Alignof(u8 *)));
+	vec_deinit(p->code);
+	vec_deinit(p->funcs);
+	vec_deinit(p->consts);
+	vec_deinit(p->block_at);
+	vec_deinit(p->value_reg);
+}
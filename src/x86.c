@@ -0,0 +1,453 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <x86.h>
+#include <std/allocers/system.h>
+#include <core/msg.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Byte Output
+ * ==========================================================================
+ */
+
+/* A rel32 branch to a label, patched once every label is placed. */
+struct X86Fixup {
+	u32 at;
+	u32 label;
+};
+
+defVec(struct X86Fixup, X86FixupVec);
+
+typedef struct Enc {
+	struct X86Code *c;
+	u32 *label_at;
+	X86FixupVec fixups;
+} Enc;
+
+void x86_code_init(struct X86Code *c)
+{
+	massert(vec_init(c->bytes, allocer_system(), 256), "OOM x86");
+	massert(vec_init(c->relocs, allocer_system(), 16), "OOM x86");
+}
+
+void x86_code_deinit(struct X86Code *c)
+{
+	vec_deinit(c->bytes);
+	vec_deinit(c->relocs);
+}
+
+static u32 here(Enc *e)
+{
+	return (u32)vec_len(e->c->bytes);
+}
+
+static void byte(Enc *e, u8 b)
+{
+	massert(vec_push(e->c->bytes, b), "OOM x86");
+}
+
+static void le32(Enc *e, u32 v)
+{
+	for (u32 i = 0; i < 4; ++i)
+		byte(e, (u8)(v >> (8 * i)));
+}
+
+static void le64(Enc *e, u64 v)
+{
+	le32(e, (u32)v);
+	le32(e, (u32)(v >> 32));
+}
+
+static void imm(Enc *e, i64 v, u32 size)
+{
+	if (size == 1)
+		byte(e, (u8)v);
+	else
+		le32(e, (u32)v);
+}
+
+/* A 32-bit field referring to `sym`, `tail` bytes before the end of the
+ * instruction (which is where rip points). */
+static void sym_field(Enc *e, struct X86Sym sym, i32 disp, u32 tail)
+{
+	struct X86Reloc r = { .at = here(e),
+			      .addend = disp - 4 - (i32)tail,
+			      .sym = sym };
+	massert(vec_push(e->c->relocs, r), "OOM x86");
+	le32(e, 0);
+}
+
+static void label_field(Enc *e, u32 label)
+{
+	struct X86Fixup fix = { here(e), label };
+	massert(vec_push(e->fixups, fix), "OOM x86");
+	le32(e, 0);
+}
+
+/*
+ * ==========================================================================
+ * 2. Operand Encoding
+ * ==========================================================================
+ */
+
+/* Hardware number of a register: XMMn is n. */
+static u8 hw(u8 r)
+{
+	return X86_IS_XMM(r) ? (u8)(r - X86_XMM0) : r;
+}
+
+static bool fits8(i64 v)
+{
+	return v >= -128 && v <= 127;
+}
+
+static bool fits32(i64 v)
+{
+	return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+/* Byte registers 4-7 are spl..dil only with a REX prefix. */
+static bool needs_rex8(const struct X86Operand *o)
+{
+	return o->kind == X86Opnd_REG && o->reg >= X86_RSP && o->reg <= X86_RDI;
+}
+
+/**
+ * @brief Emits [prefix] [REX] opcode ModRM [SIB] [disp] for a register
+ * field `reg` and an r/m operand; the caller emits `tail` bytes of
+ * immediate after it.
+ * * `prefix` is a legacy prefix (0x66, 0xf2, 0xf3) or 0; `w` sets REX.W;
+ *   `byteop` forces REX where a byte register needs it.
+ */
+static void emit_rm(Enc *e, u8 prefix, bool w, bool byteop, const u8 *op,
+		    u32 oplen, u8 reg, const struct X86Operand *rm, u32 tail)
+{
+	u8 r = hw(reg);
+	u8 rex = (u8)(w << 3 | (r >> 3) << 2);
+	bool force = false;
+	if (rm->kind == X86Opnd_REG) {
+		rex |= hw(rm->reg) >> 3;
+		force = byteop && needs_rex8(rm);
+	} else {
+		if (rm->index != X86_NOREG)
+			rex |= (rm->index >> 3) << 1;
+		if (rm->reg != X86_RIP)
+			rex |= rm->reg >> 3;
+	}
+	if (byteop && reg >= X86_RSP && reg <= X86_RDI)
+		force = true;
+
+	if (prefix)
+		byte(e, prefix);
+	if (rex || force)
+		byte(e, 0x40 | rex);
+	for (u32 i = 0; i < oplen; ++i)
+		byte(e, op[i]);
+
+	if (rm->kind == X86Opnd_REG) {
+		byte(e, (u8)(0xc0 | (r & 7) << 3 | (hw(rm->reg) & 7)));
+		return;
+	}
+	if (rm->reg == X86_RIP) {
+		byte(e, (u8)((r & 7) << 3 | 5));
+		sym_field(e, rm->sym, rm->disp, tail);
+		return;
+	}
+
+	u8 base = rm->reg & 7;
+	u8 mod = rm->disp == 0 && base != 5 ? 0 : fits8(rm->disp) ? 1 : 2;
+	bool sib = rm->index != X86_NOREG || base == 4;
+	byte(e, (u8)(mod << 6 | (r & 7) << 3 | (sib ? 4 : base)));
+	if (sib) {
+		u8 scale = rm->scale == 8 ? 3 : rm->scale == 4 ? 2
+					   : rm->scale == 2 ? 1
+							    : 0;
+		u8 index = rm->index == X86_NOREG ? 4 : rm->index & 7;
+		byte(e, (u8)(scale << 6 | index << 3 | base));
+	}
+	if (mod == 1)
+		byte(e, (u8)rm->disp);
+	else if (mod == 2)
+		le32(e, (u32)rm->disp);
+}
+
+#define OP(...) (const u8[]){ __VA_ARGS__ }, sizeof((const u8[]){ __VA_ARGS__ })
+
+/* `op reg, r/m` (or `op r/m, reg`) of an integer size. */
+static void int_rm(Enc *e, u32 size, const u8 *op, u32 oplen, u8 reg,
+		   const struct X86Operand *rm, u32 tail)
+{
+	emit_rm(e, size == 2 ? 0x66 : 0, size == 8, size == 1, op, oplen, reg,
+		rm, tail);
+}
+
+/*
+ * ==========================================================================
+ * 3. Instructions
+ * ==========================================================================
+ */
+
+/* The /digit of the ALU group 1 opcodes 0x81 / 0x83. */
+static u8 alu_ext(X86Op op)
+{
+	switch (op) {
+	case X86_ADD:
+		return 0;
+	case X86_OR:
+		return 1;
+	case X86_AND:
+		return 4;
+	case X86_SUB:
+		return 5;
+	case X86_XOR:
+		return 6;
+	default:
+		return 7;
+	}
+}
+
+static bool encode_alu(Enc *e, const struct X86Inst *in)
+{
+	const struct X86Operand *d = &in->dst, *s = &in->src;
+	u8 ext = alu_ext((X86Op)in->op);
+	if (s->kind == X86Opnd_IMM) {
+		bool short_imm = fits8(s->imm);
+		u8 opc = short_imm ? 0x83 : 0x81;
+		int_rm(e, in->size, &opc, 1, ext, d, short_imm ? 1 : 4);
+		imm(e, s->imm, short_imm ? 1 : 4);
+		return true;
+	}
+	if (s->kind == X86Opnd_REG) {
+		u8 opc = (u8)(ext * 8 + 1);
+		int_rm(e, in->size, &opc, 1, s->reg, d, 0);
+		return true;
+	}
+	if (d->kind != X86Opnd_REG)
+		return false;
+	u8 opc = (u8)(ext * 8 + 3);
+	int_rm(e, in->size, &opc, 1, d->reg, s, 0);
+	return true;
+}
+
+static bool encode_mov(Enc *e, const struct X86Inst *in)
+{
+	const struct X86Operand *d = &in->dst, *s = &in->src;
+	u32 size = in->size;
+	if (s->kind == X86Opnd_IMM) {
+		if (d->kind == X86Opnd_REG && size == 8 && !fits32(s->imm) &&
+		    (u64)s->imm > UINT32_MAX) {
+			byte(e, (u8)(0x48 | d->reg >> 3));
+			byte(e, (u8)(0xb8 + (d->reg & 7)));
+			le64(e, (u64)s->imm);
+			return true;
+		}
+		if (d->kind == X86Opnd_REG && (size == 4 || !fits32(s->imm))) {
+			/* A 32-bit move zero-extends to 64 bits. */
+			if (d->reg >= X86_R8)
+				byte(e, 0x41);
+			byte(e, (u8)(0xb8 + (d->reg & 7)));
+			le32(e, (u32)s->imm);
+			return true;
+		}
+		u8 opc = size == 1 ? 0xc6 : 0xc7;
+		int_rm(e, size, &opc, 1, 0, d, size == 1 ? 1 : 4);
+		imm(e, s->imm, size == 1 ? 1 : 4);
+		return true;
+	}
+	if (s->kind == X86Opnd_REG) {
+		u8 opc = size == 1 ? 0x88 : 0x89;
+		int_rm(e, size, &opc, 1, s->reg, d, 0);
+		return true;
+	}
+	if (d->kind != X86Opnd_REG || size == 1)
+		return false;
+	int_rm(e, size, OP(0x8b), d->reg, s, 0);
+	return true;
+}
+
+static bool encode_branch(Enc *e, const struct X86Inst *in, u8 rel_op,
+			  u8 ext)
+{
+	const struct X86Operand *t = &in->dst;
+	if (t->kind == X86Opnd_LABEL) {
+		byte(e, rel_op);
+		label_field(e, t->label);
+	} else if (t->kind == X86Opnd_SYM) {
+		byte(e, rel_op);
+		sym_field(e, t->sym, 0, 0);
+	} else {
+		emit_rm(e, 0, false, false, OP(0xff), ext, t, 0);
+	}
+	return true;
+}
+
+/* SSE arithmetic: F3 (ss) or F2 (sd) 0F op. */
+static void sse(Enc *e, u8 prefix, u8 op, const struct X86Inst *in)
+{
+	emit_rm(e, prefix, false, false, OP(0x0f, op), in->dst.reg, &in->src,
+		0);
+}
+
+static bool encode_one(Enc *e, const struct X86Inst *in)
+{
+	const struct X86Operand *d = &in->dst, *s = &in->src;
+	switch ((X86Op)in->op) {
+	case X86_LABEL:
+		e->label_at[d->label] = here(e);
+		return true;
+	case X86_MOV:
+		return encode_mov(e, in);
+	case X86_MOVZX8:
+		emit_rm(e, 0, false, true, OP(0x0f, 0xb6), d->reg, s, 0);
+		return true;
+	case X86_MOVSXD:
+		emit_rm(e, 0, true, false, OP(0x63), d->reg, s, 0);
+		return true;
+	case X86_LEA:
+		int_rm(e, in->size, OP(0x8d), d->reg, s, 0);
+		return true;
+	case X86_ADD:
+	case X86_SUB:
+	case X86_AND:
+	case X86_OR:
+	case X86_XOR:
+	case X86_CMP:
+		return encode_alu(e, in);
+	case X86_TEST:
+		if (s->kind == X86Opnd_IMM) {
+			int_rm(e, in->size, OP(0xf7), 0, d, 4);
+			imm(e, s->imm, 4);
+		} else {
+			int_rm(e, in->size, OP(0x85), s->reg, d, 0);
+		}
+		return true;
+	case X86_IMUL:
+		if (s->kind == X86Opnd_IMM) {
+			bool short_imm = fits8(s->imm);
+			u8 opc = short_imm ? 0x6b : 0x69;
+			int_rm(e, in->size, &opc, 1, d->reg, d,
+			       short_imm ? 1 : 4);
+			imm(e, s->imm, short_imm ? 1 : 4);
+		} else {
+			int_rm(e, in->size, OP(0x0f, 0xaf), d->reg, s, 0);
+		}
+		return true;
+	case X86_IDIV:
+		int_rm(e, in->size, OP(0xf7), 7, d, 0);
+		return true;
+	case X86_NEG:
+		int_rm(e, in->size, OP(0xf7), 3, d, 0);
+		return true;
+	case X86_CDQ:
+		if (in->size == 8)
+			byte(e, 0x48);
+		byte(e, 0x99);
+		return true;
+	case X86_SETCC:
+		emit_rm(e, 0, false, true, OP(0x0f, (u8)(0x90 + in->cond)), 0,
+			d, 0);
+		return true;
+	case X86_JMP:
+		return encode_branch(e, in, 0xe9, 4);
+	case X86_JCC:
+		byte(e, 0x0f);
+		byte(e, (u8)(0x80 + in->cond));
+		label_field(e, d->label);
+		return true;
+	case X86_CALL:
+		return encode_branch(e, in, 0xe8, 2);
+	case X86_RET:
+		byte(e, 0xc3);
+		return true;
+	case X86_PUSH:
+	case X86_POP:
+		if (d->reg >= X86_R8)
+			byte(e, 0x41);
+		byte(e, (u8)((in->op == X86_PUSH ? 0x50 : 0x58) + (d->reg & 7)));
+		return true;
+	case X86_REP_STOSB:
+		byte(e, 0xf3);
+		byte(e, 0xaa);
+		return true;
+	case X86_MOVSS:
+	case X86_MOVSD: {
+		u8 prefix = in->op == X86_MOVSS ? 0xf3 : 0xf2;
+		if (d->kind == X86Opnd_REG)
+			sse(e, prefix, 0x10, in);
+		else
+			emit_rm(e, prefix, false, false, OP(0x0f, 0x11), s->reg,
+				d, 0);
+		return true;
+	}
+	case X86_MOVAPS:
+		sse(e, 0, 0x28, in);
+		return true;
+	case X86_ADDSS:
+	case X86_SUBSS:
+	case X86_MULSS:
+	case X86_DIVSS:
+	case X86_ADDSD:
+	case X86_SUBSD:
+	case X86_MULSD:
+	case X86_DIVSD: {
+		static const u8 ops[] = { 0x58, 0x5c, 0x59, 0x5e };
+		u32 i = (u32)(in->op - X86_ADDSS);
+		sse(e, i < 4 ? 0xf3 : 0xf2, ops[i % 4], in);
+		return true;
+	}
+	case X86_UCOMISS:
+		sse(e, 0, 0x2e, in);
+		return true;
+	case X86_UCOMISD:
+		sse(e, 0x66, 0x2e, in);
+		return true;
+	case X86_XORPS:
+		sse(e, 0, 0x57, in);
+		return true;
+	case X86_MOVD:
+		if (d->kind == X86Opnd_REG && X86_IS_XMM(d->reg))
+			emit_rm(e, 0x66, in->size == 8, false, OP(0x0f, 0x6e),
+				d->reg, s, 0);
+		else
+			emit_rm(e, 0x66, in->size == 8, false, OP(0x0f, 0x7e),
+				s->reg, d, 0);
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool x86_encode(struct X86Code *c, const struct X86Inst *insts, u32 n,
+		u32 *label_at)
+{
+	Enc e = { .c = c, .label_at = label_at };
+	massert(vec_init(e.fixups, allocer_system(), 64), "OOM x86");
+
+	bool ok = true;
+	for (u32 i = 0; i < n && ok; ++i)
+		ok = encode_one(&e, &insts[i]);
+	for (usize i = 0; ok && i < vec_len(e.fixups); ++i) {
+		struct X86Fixup fix = e.fixups.data[i];
+		u32 rel = e.label_at[fix.label] - (fix.at + 4);
+		memcpy(&c->bytes.data[fix.at], &rel, 4);
+	}
+
+	vec_deinit(e.fixups);
+	return ok;
+}
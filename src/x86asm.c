@@ -0,0 +1,369 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <x86.h>
+#include <ir.h>
+#include <trace.h>
+#include <core/msg.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Operands
+ * ==========================================================================
+ */
+
+static const char *const MNEMONICS[X86Op_COUNT] = {
+#define X(ID, MNEMONIC) [X86_##ID] = MNEMONIC,
+	X86_OPS(X)
+#undef X
+};
+
+static const char *const RUNTIME_NAMES[X86_RT_COUNT] = {
+#define X(ID, NAME) [X86_RT_##ID] = NAME,
+	X86_RUNTIME(X)
+#undef X
+};
+
+static const char CONDS[][3] = { "o", "no", "b",  "ae", "e", "ne",
+				 "be", "a", "s",  "ns", "p", "np",
+				 "l",  "ge", "le", "g" };
+
+static const char REGS64[][4] = { "rax", "rcx", "rdx", "rbx",
+				  "rsp", "rbp", "rsi", "rdi" };
+static const char REGS32[][4] = { "eax", "ecx", "edx", "ebx",
+				  "esp", "ebp", "esi", "edi" };
+static const char REGS8[][4] = { "al", "cl", "dl", "bl",
+				 "spl", "bpl", "sil", "dil" };
+
+typedef struct Asm {
+	FILE *out;
+	const struct IrModule *m;
+	/* Prefix of the function's local labels: .L<func>_<label>. */
+	u32 func;
+} Asm;
+
+static void reg(Asm *a, u8 r, u32 size)
+{
+	if (X86_IS_XMM(r)) {
+		fprintf(a->out, "%%xmm%d", r - X86_XMM0);
+		return;
+	}
+	if (r >= X86_R8) {
+		const char *suffix = size == 8 ? "" : size == 4 ? "d" : "b";
+		fprintf(a->out, "%%r%d%s", r, suffix);
+		return;
+	}
+	fprintf(a->out, "%%%s",
+		size == 8 ? REGS64[r] : size == 4 ? REGS32[r] : REGS8[r]);
+}
+
+static const char *sym_name(Asm *a, struct X86Sym s)
+{
+	massert(!s.indirect, "x86: indirect symbol in assembly");
+	switch ((X86SymKind)s.kind) {
+	case X86Sym_FUNC:
+		return a->m->funcs.data[s.index].name;
+	case X86Sym_GLOBAL:
+		return a->m->globals.data[s.index].name;
+	case X86Sym_RUNTIME:
+		return RUNTIME_NAMES[s.index];
+	case X86Sym_VAR:
+		massert(s.index == X86_VAR_STACK_LIMIT,
+			"x86: JIT variable in assembly");
+		return "__cact_stack_limit";
+	}
+	return "";
+}
+
+/* `size` is that of a register operand. */
+static void operand(Asm *a, const struct X86Operand *o, u32 size)
+{
+	switch ((X86OperandKind)o->kind) {
+	case X86Opnd_REG:
+		reg(a, o->reg, size);
+		return;
+	case X86Opnd_IMM:
+		fprintf(a->out, "$%lld", (long long)o->imm);
+		return;
+	case X86Opnd_LABEL:
+		fprintf(a->out, ".L%u_%u", a->func, o->label);
+		return;
+	case X86Opnd_SYM:
+		fputs(sym_name(a, o->sym), a->out);
+		return;
+	case X86Opnd_MEM:
+		break;
+	case X86Opnd_NONE:
+		return;
+	}
+	if (o->reg == X86_RIP) {
+		fputs(sym_name(a, o->sym), a->out);
+		if (o->disp)
+			fprintf(a->out, "%+d", o->disp);
+		fputs("(%rip)", a->out);
+		return;
+	}
+	if (o->disp)
+		fprintf(a->out, "%d", o->disp);
+	fputc('(', a->out);
+	reg(a, o->reg, 8);
+	if (o->index != X86_NOREG) {
+		fputc(',', a->out);
+		reg(a, o->index, 8);
+		fprintf(a->out, ",%d", o->scale);
+	}
+	fputc(')', a->out);
+}
+
+/*
+ * ==========================================================================
+ * 2. Instructions
+ * ==========================================================================
+ * AT&T order: source first. Integer mnemonics carry the operand size.
+ */
+
+static char suffix(u32 size)
+{
+	return size == 1 ? 'b' : size == 4 ? 'l' : 'q';
+}
+
+/* `op src, dst`, each operand printed at its register size. */
+static void two(Asm *a, const char *op, const struct X86Operand *src,
+		u32 src_size, const struct X86Operand *dst, u32 dst_size)
+{
+	fprintf(a->out, "\t%s\t", op);
+	operand(a, src, src_size);
+	fputs(", ", a->out);
+	operand(a, dst, dst_size);
+	fputc('\n', a->out);
+}
+
+static void one(Asm *a, const char *op, const struct X86Operand *o,
+		u32 size)
+{
+	fprintf(a->out, "\t%s\t", op);
+	operand(a, o, size);
+	fputc('\n', a->out);
+}
+
+/* JMP and CALL: direct to a label or symbol, or indirect with `*`. */
+static void branch(Asm *a, const char *op, const struct X86Operand *t)
+{
+	fprintf(a->out, "\t%s\t", op);
+	if (t->kind == X86Opnd_REG || t->kind == X86Opnd_MEM)
+		fputc('*', a->out);
+	operand(a, t, 8);
+	fputc('\n', a->out);
+}
+
+static void mov(Asm *a, const struct X86Inst *in)
+{
+	const struct X86Operand *d = &in->dst, *s = &in->src;
+	u32 size = in->size;
+	char op[8];
+	if (s->kind == X86Opnd_IMM && d->kind == X86Opnd_REG && size == 8 &&
+	    (s->imm < INT32_MIN || s->imm > INT32_MAX)) {
+		/* As the encoder does: zero-extending movl, or movabsq. */
+		if ((u64)s->imm <= UINT32_MAX)
+			two(a, "movl", s, 4, d, 4);
+		else
+			two(a, "movabsq", s, 8, d, 8);
+		return;
+	}
+	snprintf(op, sizeof(op), "mov%c", suffix(size));
+	two(a, op, s, size, d, size);
+}
+
+static void inst(Asm *a, const struct X86Inst *in)
+{
+	const struct X86Operand *d = &in->dst, *s = &in->src;
+	const char *name = MNEMONICS[in->op];
+	char op[16];
+	snprintf(op, sizeof(op), "%s%c", name, suffix(in->size));
+
+	switch ((X86Op)in->op) {
+	case X86_LABEL:
+		fprintf(a->out, ".L%u_%u:\n", a->func, d->label);
+		return;
+	case X86_MOV:
+		mov(a, in);
+		return;
+	case X86_MOVZX8:
+		two(a, op, s, 1, d, in->size);
+		return;
+	case X86_MOVSXD:
+		two(a, op, s, 4, d, 8);
+		return;
+	case X86_LEA:
+	case X86_ADD:
+	case X86_SUB:
+	case X86_AND:
+	case X86_OR:
+	case X86_XOR:
+	case X86_CMP:
+	case X86_TEST:
+		two(a, op, s, in->size, d, in->size);
+		return;
+	case X86_IMUL:
+		if (s->kind != X86Opnd_IMM) {
+			two(a, op, s, in->size, d, in->size);
+			return;
+		}
+		fprintf(a->out, "\t%s\t", op);
+		operand(a, s, in->size);
+		fputs(", ", a->out);
+		operand(a, d, in->size);
+		fputs(", ", a->out);
+		operand(a, d, in->size);
+		fputc('\n', a->out);
+		return;
+	case X86_IDIV:
+	case X86_NEG:
+	case X86_PUSH:
+	case X86_POP:
+		one(a, op, d, in->size);
+		return;
+	case X86_CDQ:
+		fprintf(a->out, "\t%s\n", in->size == 8 ? "cqto" : name);
+		return;
+	case X86_SETCC:
+		snprintf(op, sizeof(op), "%s%s", name, CONDS[in->cond]);
+		one(a, op, d, 1);
+		return;
+	case X86_JCC:
+		snprintf(op, sizeof(op), "%s%s", name, CONDS[in->cond]);
+		one(a, op, d, 8);
+		return;
+	case X86_JMP:
+	case X86_CALL:
+		branch(a, name, d);
+		return;
+	case X86_RET:
+	case X86_REP_STOSB:
+		fprintf(a->out, "\t%s\n", name);
+		return;
+	case X86_MOVD:
+		two(a, in->size == 8 ? "movq" : name, s, in->size, d, in->size);
+		return;
+	default:
+		/* SSE: the registers are XMM, except where noted above. */
+		two(a, name, s, 8, d, 8);
+		return;
+	}
+}
+
+/*
+ * ==========================================================================
+ * 3. Module
+ * ==========================================================================
+ */
+
+static void write_func(Asm *a, struct X86Gen *gen, u32 func)
+{
+	const struct IrFunc *fn = &a->m->funcs.data[func];
+	x86_gen_func(gen, func);
+	a->func = func;
+
+	fputs("\n\t.p2align 4\n", a->out);
+	if (strcmp(fn->name, "main") == 0)
+		fprintf(a->out, "\t.globl\t%s\n", fn->name);
+	fprintf(a->out, "\t.type\t%s, @function\n%s:\n", fn->name, fn->name);
+	vec_foreach(in, gen->insts)
+	{
+		inst(a, in);
+	}
+	fprintf(a->out, "\t.size\t%s, .-%s\n", fn->name, fn->name);
+}
+
+/* Elements of `g` as data directives, runs of zero bytes as .zero. */
+static void write_init(Asm *a, const struct IrGlobal *g, u32 size)
+{
+	const u8 *bytes = g->init;
+	u32 total = size * g->count;
+	for (u32 at = 0; at < total;) {
+		u32 zeros = 0;
+		while (at + zeros < total && bytes[at + zeros] == 0)
+			++zeros;
+		zeros -= zeros % size;
+		if (zeros) {
+			fprintf(a->out, "\t.zero\t%u\n", zeros);
+			at += zeros;
+			continue;
+		}
+		u64 v = 0;
+		memcpy(&v, bytes + at, size);
+		const char *dir = size == 1 ? "byte" : size == 4 ? "long" : "quad";
+		fprintf(a->out, "\t.%s\t%llu\n", dir, (unsigned long long)v);
+		at += size;
+	}
+}
+
+static void write_global(Asm *a, const struct IrGlobal *g)
+{
+	u32 size = ir_type_size(g->elem);
+	const char *section = !g->init	     ? ".bss"
+			      : g->is_const ? ".section\t.rodata"
+					    : ".data";
+	u32 align = 0;
+	while ((1u << align) < size)
+		++align;
+	fprintf(a->out, "\n\t%s\n\t.p2align %u\n", section, align);
+	fprintf(a->out, "\t.type\t%s, @object\n\t.size\t%s, %u\n%s:\n",
+		g->name, g->name, size * g->count, g->name);
+	if (g->init)
+		write_init(a, g, size);
+	else
+		fprintf(a->out, "\t.zero\t%u\n", size * g->count);
+}
+
+/* Pointers need relocating when the program is loaded: .data.rel.ro. */
+static void write_names(Asm *a)
+{
+	const struct IrModule *m = a->m;
+	fputs("\n\t.section\t.data.rel.ro,\"aw\"\n\t.p2align 3\n"
+	      "\t.globl\t__cact_func_names\n"
+	      "\t.hidden\t__cact_func_names\n"
+	      "__cact_func_names:\n",
+	      a->out);
+	for (u32 i = 0; i < vec_len(m->names); ++i)
+		fprintf(a->out, "\t.quad\t.Lname%u\n", i);
+	fputs("\n\t.section\t.rodata.str1.1,\"aMS\",@progbits,1\n", a->out);
+	for (u32 i = 0; i < vec_len(m->names); ++i)
+		fprintf(a->out, ".Lname%u:\n\t.asciz\t\"%s\"\n", i,
+			m->names.data[i]);
+}
+
+bool x86_write_asm(FILE *out, const struct IrModule *m)
+{
+	TRACE_SCOPE("x86_asm");
+	Asm a = { .out = out, .m = m };
+	struct X86Gen gen;
+	x86_gen_init(&gen, m, X86Mode_AOT);
+
+	fputs("\t.text\n", out);
+	for (u32 i = 0; i < vec_len(m->funcs); ++i)
+		if (!m->funcs.data[i].is_extern)
+			write_func(&a, &gen, i);
+	for (usize i = 0; i < vec_len(m->globals); ++i)
+		write_global(&a, &m->globals.data[i]);
+	write_names(&a);
+	fputs("\n\t.section\t.note.GNU-stack,\"\",@progbits\n", out);
+
+	x86_gen_deinit(&gen);
+	return !ferror(out);
+}
@@ -0,0 +1,470 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <x86.h>
+#include <ir.h>
+#include <trace.h>
+#include <std/allocers/system.h>
+#include <core/msg.h>
+
+#include <elf.h>
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Sections
+ * ==========================================================================
+ * Every object has the same sections, empty or not: X(ID, NAME, TYPE,
+ * FLAGS). The function names of runtime errors are pointers, so their
+ * table lives in .data.rel.ro, as the assembly path puts it.
+ */
+
+#define ELF_SECTIONS(X)                                                \
+	X(TEXT, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR)       \
+	X(DATA, ".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE)           \
+	X(BSS, ".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE)               \
+	X(RODATA, ".rodata", SHT_PROGBITS, SHF_ALLOC)                   \
+	X(NAMES, ".data.rel.ro", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE)   \
+	X(RELA_TEXT, ".rela.text", SHT_RELA, SHF_INFO_LINK)             \
+	X(RELA_NAMES, ".rela.data.rel.ro", SHT_RELA, SHF_INFO_LINK)     \
+	X(SYMTAB, ".symtab", SHT_SYMTAB, 0)                             \
+	X(STRTAB, ".strtab", SHT_STRTAB, 0)                             \
+	X(SHSTRTAB, ".shstrtab", SHT_STRTAB, 0)                         \
+	X(NOTE_STACK, ".note.GNU-stack", SHT_PROGBITS, 0)
+
+typedef enum Sec {
+	Sec_NULL,
+#define X(ID, NAME, TYPE, FLAGS) Sec_##ID,
+	ELF_SECTIONS(X)
+#undef X
+	Sec_COUNT
+} Sec;
+
+static const struct {
+	const char *name;
+	u32 type;
+	u64 flags;
+} SECTIONS[Sec_COUNT] = {
+#define X(ID, NAME, TYPE, FLAGS) [Sec_##ID] = { NAME, TYPE, FLAGS },
+	ELF_SECTIONS(X)
+#undef X
+};
+
+static const char *const RUNTIME_NAMES[X86_RT_COUNT] = {
+#define X(ID, NAME) [X86_RT_##ID] = NAME,
+	X86_RUNTIME(X)
+#undef X
+};
+
+defVec(Elf64_Sym, ElfSymVec);
+defVec(Elf64_Rela, ElfRelaVec);
+
+typedef struct Obj {
+	const struct IrModule *m;
+	/* Section contents; .text is in `text`, .bss has only a size. */
+	struct X86Code text;
+	X86ByteVec bytes[Sec_COUNT];
+	u64 bss_size;
+	u64 align[Sec_COUNT];
+
+	ElfSymVec syms;
+	ElfRelaVec rela_text;
+	ElfRelaVec rela_names;
+	u32 first_global;
+
+	/* Per function: .text offset and end; per global: its symbol. */
+	u32 *func_at;
+	u32 *func_end;
+	u32 *global_sym;
+	/* Symbols of the runtime, created when first referred to. */
+	u32 rt_sym[X86_RT_COUNT];
+	u32 stack_limit_sym;
+} Obj;
+
+static u64 align_up(u64 x, u64 align)
+{
+	return (x + align - 1) & ~(align - 1);
+}
+
+static u64 append(X86ByteVec *v, const void *data, usize n)
+{
+	u64 at = vec_len(*v);
+	for (usize i = 0; i < n; ++i)
+		massert(vec_push(*v, ((const u8 *)data)[i]), "OOM elf");
+	return at;
+}
+
+static void pad(X86ByteVec *v, u64 align, u8 fill)
+{
+	while (vec_len(*v) % align)
+		massert(vec_push(*v, fill), "OOM elf");
+}
+
+/* Offset of `s` in a string table. */
+static u32 str(X86ByteVec *table, const char *s)
+{
+	return (u32)append(table, s, strlen(s) + 1);
+}
+
+static u32 add_sym(Obj *o, const char *name, u8 bind, u8 type, Sec sec,
+		   u64 value, u64 size)
+{
+	Elf64_Sym s = {
+		.st_name = name ? str(&o->bytes[Sec_STRTAB], name) : 0,
+		.st_info = ELF64_ST_INFO(bind, type),
+		.st_shndx = (u16)sec,
+		.st_value = value,
+		.st_size = size,
+	};
+	massert(vec_push(o->syms, s), "OOM elf");
+	return (u32)vec_len(o->syms) - 1;
+}
+
+static void add_rela(ElfRelaVec *v, u64 at, u32 sym, u32 type, i64 addend)
+{
+	Elf64_Rela r = { .r_offset = at,
+			 .r_info = ELF64_R_INFO(sym, type),
+			 .r_addend = addend };
+	massert(vec_push(*v, r), "OOM elf");
+}
+
+/*
+ * ==========================================================================
+ * 2. Contents
+ * ==========================================================================
+ */
+
+/* Functions at 16-byte boundaries, padded with int3. */
+static bool add_code(Obj *o)
+{
+	const struct IrModule *m = o->m;
+	struct X86Gen gen;
+	x86_gen_init(&gen, m, X86Mode_AOT);
+	u32 label_cap = 0;
+	u32 *label_at = NULL;
+
+	bool ok = true;
+	for (u32 i = 0; ok && i < vec_len(m->funcs); ++i) {
+		if (m->funcs.data[i].is_extern)
+			continue;
+		pad(&o->text.bytes, 16, 0xcc);
+		o->func_at[i] = (u32)vec_len(o->text.bytes);
+		x86_gen_func(&gen, i);
+		if (gen.nlabels > label_cap) {
+			allocer_free(allocer_system(), label_at,
+				     layout(label_cap * sizeof(u32), 4));
+			label_cap = gen.nlabels * 2;
+			label_at = allocer_alloc(allocer_system(),
+						 layout(label_cap * sizeof(u32),
+							4));
+			massert(label_at, "OOM elf");
+		}
+		ok = x86_encode(&o->text, gen.insts.data,
+				(u32)vec_len(gen.insts), label_at);
+		if (!ok)
+			log_error("x86: could not encode '%s'",
+				  m->funcs.data[i].name);
+		o->func_end[i] = (u32)vec_len(o->text.bytes);
+	}
+
+	allocer_free(allocer_system(), label_at,
+		     layout(label_cap * sizeof(u32), 4));
+	x86_gen_deinit(&gen);
+	return ok;
+}
+
+/* Where each global goes: .bss if all zero, else .rodata or .data. */
+static void place_global(Obj *o, u32 index, Sec *sec, u64 *at)
+{
+	const struct IrGlobal *g = &o->m->globals.data[index];
+	u32 size = ir_type_size(g->elem);
+	u64 total = (u64)size * g->count;
+	u64 align = 1;
+	while (align < size)
+		align <<= 1;
+
+	*sec = !g->init ? Sec_BSS : g->is_const ? Sec_RODATA : Sec_DATA;
+	if (align > o->align[*sec])
+		o->align[*sec] = align;
+	if (*sec == Sec_BSS) {
+		*at = align_up(o->bss_size, align);
+		o->bss_size = *at + total;
+		return;
+	}
+	pad(&o->bytes[*sec], align, 0);
+	*at = append(&o->bytes[*sec], g->init, total);
+}
+
+/* __cact_func_names: pointers, by IrFunc.id, to strings in .rodata. */
+static void add_names(Obj *o, u32 rodata_sym)
+{
+	const struct IrModule *m = o->m;
+	u64 zero = 0;
+	for (u32 i = 0; i < vec_len(m->names); ++i) {
+		u64 name = str(&o->bytes[Sec_RODATA], m->names.data[i]);
+		u64 at = append(&o->bytes[Sec_NAMES], &zero, sizeof(zero));
+		add_rela(&o->rela_names, at, rodata_sym, R_X86_64_64,
+			 (i64)name);
+	}
+}
+
+static u32 runtime_sym(Obj *o, u32 rt)
+{
+	if (!o->rt_sym[rt])
+		o->rt_sym[rt] = add_sym(o, RUNTIME_NAMES[rt], STB_GLOBAL,
+					STT_NOTYPE, Sec_NULL, 0, 0);
+	return o->rt_sym[rt];
+}
+
+/*
+ * Calls between the program's functions are resolved here, as an
+ * assembler would; the rest become relocations.
+ */
+static void relocate_code(Obj *o)
+{
+	for (usize i = 0; i < vec_len(o->text.relocs); ++i) {
+		struct X86Reloc r = o->text.relocs.data[i];
+		massert(!r.sym.indirect, "x86: indirect symbol in object");
+		switch ((X86SymKind)r.sym.kind) {
+		case X86Sym_FUNC: {
+			i32 rel = (i32)o->func_at[r.sym.index] + r.addend -
+				  (i32)r.at;
+			memcpy(&o->text.bytes.data[r.at], &rel, 4);
+			break;
+		}
+		case X86Sym_RUNTIME:
+			add_rela(&o->rela_text, r.at,
+				 runtime_sym(o, r.sym.index), R_X86_64_PLT32,
+				 r.addend);
+			break;
+		case X86Sym_GLOBAL:
+			add_rela(&o->rela_text, r.at,
+				 o->global_sym[r.sym.index], R_X86_64_PC32,
+				 r.addend);
+			break;
+		case X86Sym_VAR:
+			massert(r.sym.index == X86_VAR_STACK_LIMIT,
+				"x86: JIT variable in object");
+			if (!o->stack_limit_sym)
+				o->stack_limit_sym =
+					add_sym(o, "__cact_stack_limit",
+						STB_GLOBAL, STT_NOTYPE,
+						Sec_NULL, 0, 0);
+			add_rela(&o->rela_text, r.at, o->stack_limit_sym,
+				 R_X86_64_PC32, r.addend);
+			break;
+		}
+	}
+}
+
+/*
+ * Symbols: locals first, as ELF requires: the sections, the functions
+ * but `main`, the globals. Then `main`, the name table and the runtime.
+ */
+static void add_symbols(Obj *o)
+{
+	const struct IrModule *m = o->m;
+	add_sym(o, NULL, STB_LOCAL, STT_NOTYPE, Sec_NULL, 0, 0);
+	u32 sec_sym[Sec_COUNT] = { 0 };
+	for (Sec s = Sec_TEXT; s <= Sec_NAMES; ++s)
+		sec_sym[s] = add_sym(o, NULL, STB_LOCAL, STT_SECTION, s, 0, 0);
+
+	u32 main = UINT32_MAX;
+	for (u32 i = 0; i < vec_len(m->funcs); ++i) {
+		const struct IrFunc *fn = &m->funcs.data[i];
+		if (fn->is_extern)
+			continue;
+		if (strcmp(fn->name, "main") == 0) {
+			main = i;
+			continue;
+		}
+		add_sym(o, fn->name, STB_LOCAL, STT_FUNC, Sec_TEXT,
+			o->func_at[i], o->func_end[i] - o->func_at[i]);
+	}
+	for (u32 i = 0; i < vec_len(m->globals); ++i) {
+		const struct IrGlobal *g = &m->globals.data[i];
+		Sec sec;
+		u64 at;
+		place_global(o, i, &sec, &at);
+		o->global_sym[i] =
+			add_sym(o, g->name, STB_LOCAL, STT_OBJECT, sec, at,
+				(u64)ir_type_size(g->elem) * g->count);
+	}
+
+	o->first_global = (u32)vec_len(o->syms);
+	if (main != UINT32_MAX)
+		add_sym(o, "main", STB_GLOBAL, STT_FUNC, Sec_TEXT,
+			o->func_at[main], o->func_end[main] - o->func_at[main]);
+	add_names(o, sec_sym[Sec_RODATA]);
+	u32 names = add_sym(o, "__cact_func_names", STB_GLOBAL, STT_OBJECT,
+			    Sec_NAMES, 0, vec_len(o->bytes[Sec_NAMES]));
+	o->syms.data[names].st_other = STV_HIDDEN;
+	relocate_code(o);
+}
+
+/*
+ * ==========================================================================
+ * 3. File
+ * ==========================================================================
+ * The ELF header, the contents of the sections in order, then the
+ * section header table.
+ */
+
+static bool put(FILE *out, u64 *at, const void *data, u64 n)
+{
+	*at += n;
+	return n == 0 || fwrite(data, 1, n, out) == n;
+}
+
+static bool pad_to(FILE *out, u64 *at, u64 to)
+{
+	static const u8 zeros[16];
+	bool ok = true;
+	while (ok && *at < to)
+		ok = put(out, at,
+			 zeros, to - *at < sizeof(zeros) ? to - *at
+							 : sizeof(zeros));
+	return ok;
+}
+
+static bool write_file(Obj *o, FILE *out)
+{
+	const void *data[Sec_COUNT] = { 0 };
+	u64 size[Sec_COUNT] = { 0 };
+	data[Sec_TEXT] = o->text.bytes.data;
+	size[Sec_TEXT] = vec_len(o->text.bytes);
+	for (Sec s = Sec_DATA; s < Sec_COUNT; ++s) {
+		data[s] = o->bytes[s].data;
+		size[s] = vec_len(o->bytes[s]);
+	}
+	size[Sec_BSS] = o->bss_size;
+	data[Sec_RELA_TEXT] = o->rela_text.data;
+	size[Sec_RELA_TEXT] = vec_len(o->rela_text) * sizeof(Elf64_Rela);
+	data[Sec_RELA_NAMES] = o->rela_names.data;
+	size[Sec_RELA_NAMES] = vec_len(o->rela_names) * sizeof(Elf64_Rela);
+	data[Sec_SYMTAB] = o->syms.data;
+	size[Sec_SYMTAB] = vec_len(o->syms) * sizeof(Elf64_Sym);
+
+	Elf64_Shdr sh[Sec_COUNT] = { 0 };
+	u64 end = sizeof(Elf64_Ehdr);
+	for (Sec s = Sec_TEXT; s < Sec_COUNT; ++s) {
+		sh[s].sh_name = str(&o->bytes[Sec_SHSTRTAB], SECTIONS[s].name);
+		sh[s].sh_type = SECTIONS[s].type;
+		sh[s].sh_flags = SECTIONS[s].flags;
+		sh[s].sh_addralign = o->align[s];
+	}
+	/* After the names above, which are part of .shstrtab. */
+	data[Sec_SHSTRTAB] = o->bytes[Sec_SHSTRTAB].data;
+	size[Sec_SHSTRTAB] = vec_len(o->bytes[Sec_SHSTRTAB]);
+	for (Sec s = Sec_TEXT; s < Sec_COUNT; ++s) {
+		sh[s].sh_size = size[s];
+		if (sh[s].sh_type == SHT_NOBITS)
+			continue;
+		sh[s].sh_offset = align_up(end, o->align[s]);
+		end = sh[s].sh_offset + size[s];
+	}
+	sh[Sec_RELA_TEXT].sh_link = Sec_SYMTAB;
+	sh[Sec_RELA_TEXT].sh_info = Sec_TEXT;
+	sh[Sec_RELA_TEXT].sh_entsize = sizeof(Elf64_Rela);
+	sh[Sec_RELA_NAMES].sh_link = Sec_SYMTAB;
+	sh[Sec_RELA_NAMES].sh_info = Sec_NAMES;
+	sh[Sec_RELA_NAMES].sh_entsize = sizeof(Elf64_Rela);
+	sh[Sec_SYMTAB].sh_link = Sec_STRTAB;
+	sh[Sec_SYMTAB].sh_info = o->first_global;
+	sh[Sec_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+
+	Elf64_Ehdr eh = {
+		.e_ident = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64,
+			     ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV },
+		.e_type = ET_REL,
+		.e_machine = EM_X86_64,
+		.e_version = EV_CURRENT,
+		.e_shoff = align_up(end, 8),
+		.e_ehsize = sizeof(Elf64_Ehdr),
+		.e_shentsize = sizeof(Elf64_Shdr),
+		.e_shnum = Sec_COUNT,
+		.e_shstrndx = Sec_SHSTRTAB,
+	};
+
+	u64 at = 0;
+	bool ok = put(out, &at, &eh, sizeof(eh));
+	for (Sec s = Sec_TEXT; ok && s < Sec_COUNT; ++s) {
+		if (sh[s].sh_type == SHT_NOBITS)
+			continue;
+		ok = pad_to(out, &at, sh[s].sh_offset) &&
+		     put(out, &at, data[s], size[s]);
+	}
+	return ok && pad_to(out, &at, eh.e_shoff) &&
+	       put(out, &at, sh, sizeof(sh));
+}
+
+/*
+ * ==========================================================================
+ * 4. Public API
+ * ==========================================================================
+ */
+
+bool x86_write_elf(FILE *out, const struct IrModule *m)
+{
+	TRACE_SCOPE("x86_elf");
+	Obj o = { .m = m };
+	x86_code_init(&o.text);
+	for (Sec s = Sec_DATA; s < Sec_COUNT; ++s)
+		massert(vec_init(o.bytes[s], allocer_system(), 64), "OOM elf");
+	massert(vec_init(o.syms, allocer_system(), 64), "OOM elf");
+	massert(vec_init(o.rela_text, allocer_system(), 64), "OOM elf");
+	massert(vec_init(o.rela_names, allocer_system(), 16), "OOM elf");
+	for (Sec s = Sec_NULL; s < Sec_COUNT; ++s)
+		o.align[s] = 1;
+	o.align[Sec_TEXT] = 16;
+	o.align[Sec_NAMES] = 8;
+	o.align[Sec_RELA_TEXT] = 8;
+	o.align[Sec_RELA_NAMES] = 8;
+	o.align[Sec_SYMTAB] = 8;
+	/* String tables start with the empty name. */
+	massert(vec_push(o.bytes[Sec_STRTAB], 0), "OOM elf");
+	massert(vec_push(o.bytes[Sec_SHSTRTAB], 0), "OOM elf");
+
+	usize nfuncs = vec_len(m->funcs) ? vec_len(m->funcs) : 1;
+	usize nglobals = vec_len(m->globals) ? vec_len(m->globals) : 1;
+	o.func_at = allocer_alloc(allocer_system(),
+				  layout(nfuncs * sizeof(u32), 4));
+	o.func_end = allocer_alloc(allocer_system(),
+				   layout(nfuncs * sizeof(u32), 4));
+	o.global_sym = allocer_alloc(allocer_system(),
+				     layout(nglobals * sizeof(u32), 4));
+	massert(o.func_at && o.func_end && o.global_sym, "OOM elf");
+
+	bool ok = add_code(&o);
+	if (ok) {
+		add_symbols(&o);
+		ok = write_file(&o, out) && !ferror(out);
+	}
+
+	allocer_free(allocer_system(), o.func_at,
+		     layout(nfuncs * sizeof(u32), 4));
+	allocer_free(allocer_system(), o.func_end,
+		     layout(nfuncs * sizeof(u32), 4));
+	allocer_free(allocer_system(), o.global_sym,
+		     layout(nglobals * sizeof(u32), 4));
+	vec_deinit(o.rela_names);
+	vec_deinit(o.rela_text);
+	vec_deinit(o.syms);
+	for (Sec s = Sec_DATA; s < Sec_COUNT; ++s)
+		vec_deinit(o.bytes[s]);
+	x86_code_deinit(&o.text);
+	return ok;
+}
@@ -0,0 +1,1313 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include <x86.h>
+#include <regalloc.h>
+#include <sema.h>
+#include <trace.h>
+#include <std/allocers/system.h>
+#include <core/msg.h>
+
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Registers and Frame
+ * ==========================================================================
+ * rax, rcx, rdx and r11 (and xmm0, xmm15) are never allocated: they are
+ * the scratch registers of instruction sequences, of division, and of
+ * parallel copies. In the JIT, r15 holds the ALLOCA storage of the frame.
+ *
+ * Frame, from rbp down: saved registers, ALLOCAs (AOT only), spill
+ * slots, outgoing stack arguments.
+ */
+
+static const u8 INT_REGS[] = {
+	X86_RSI, X86_RDI, X86_R8,  X86_R9,  X86_R10,
+	X86_RBX, X86_R12, X86_R13, X86_R14, X86_R15,
+};
+
+static const u8 FLOAT_REGS[] = {
+	X86_XMM0 + 1,  X86_XMM0 + 2,  X86_XMM0 + 3,  X86_XMM0 + 4,
+	X86_XMM0 + 5,  X86_XMM0 + 6,  X86_XMM0 + 7,  X86_XMM0 + 8,
+	X86_XMM0 + 9,  X86_XMM0 + 10, X86_XMM0 + 11, X86_XMM0 + 12,
+	X86_XMM0 + 13, X86_XMM0 + 14,
+};
+
+static const u8 INT_ARGS[] = { X86_RDI, X86_RSI, X86_RDX,
+			       X86_RCX, X86_R8,	 X86_R9 };
+#define FLOAT_ARGS 8
+
+#define CALLEE_SAVED                                                 \
+	(1ull << X86_RBX | 1ull << X86_R12 | 1ull << X86_R13 |      \
+	 1ull << X86_R14 | 1ull << X86_R15)
+
+#define SCRATCH_XMM X86_XMM15
+#define SCRATCH_XMM2 X86_XMM0
+
+/* Where a division reported in function `id` (IrFunc.id) traps. */
+struct DivTrap {
+	u32 id;
+	u32 label;
+};
+
+defVec(struct DivTrap, DivTrapVec);
+
+typedef struct Gen {
+	struct X86Gen *pub;
+	const struct IrModule *m;
+	bool jit;
+	/* X86Runtime of each extern function. */
+	u8 *runtime;
+	struct RaFunc ra;
+	struct RaTarget target;
+
+	const struct IrFunc *fn;
+	/* ALLOCA offsets, per value. */
+	u32 *alloca_at;
+	usize alloca_cap;
+	u32 frame_bytes;
+
+	u8 saved[8];
+	u32 nsaved;
+	/* rbp-relative offsets of the ALLOCA area and of spill slot 0. */
+	i32 alloca_base;
+	i32 slot_base;
+	/* Bytes below the saved registers. */
+	i32 frame_size;
+
+	u32 epilogue;
+	/* One per function whose divisions ended up here by inlining. */
+	DivTrapVec div_traps;
+	u32 overflow_trap;
+} Gen;
+
+static const char *const RUNTIME_NAMES[X86_RT_COUNT] = {
+#define X(ID, NAME) [X86_RT_##ID] = NAME,
+	X86_RUNTIME(X)
+#undef X
+};
+
+static void emit(Gen *g, X86Op op, u8 size, struct X86Operand dst,
+		 struct X86Operand src)
+{
+	struct X86Inst in = {
+		.op = (u8)op, .size = size, .dst = dst, .src = src
+	};
+	massert(vec_push(g->pub->insts, in), "OOM x86");
+}
+
+static void emit_cc(Gen *g, X86Op op, X86Cond cc, struct X86Operand dst)
+{
+	struct X86Inst in = { .op = (u8)op, .cond = (u8)cc, .dst = dst };
+	massert(vec_push(g->pub->insts, in), "OOM x86");
+}
+
+#define NONE ((struct X86Operand){ .kind = X86Opnd_NONE })
+
+static u32 new_label(Gen *g)
+{
+	return g->pub->nlabels++;
+}
+
+static void place(Gen *g, u32 label)
+{
+	emit(g, X86_LABEL, 0, x86_label(label), NONE);
+}
+
+static struct X86Sym sym(X86SymKind kind, u32 index, bool indirect)
+{
+	return (struct X86Sym){ .kind = (u8)kind,
+				.indirect = indirect,
+				.index = index };
+}
+
+static bool is_float(IrType ty)
+{
+	return ty == IrType_F32 || ty == IrType_F64;
+}
+
+/* Integer operand size of a type: pointers are 8 bytes, the rest 4. */
+static u8 int_size(IrType ty)
+{
+	return ty == IrType_PTR ? 8 : 4;
+}
+
+static IrType ty_of(Gen *g, IrValue v)
+{
+	return (IrType)ir_inst(g->fn, v)->ty;
+}
+
+static struct X86Operand slot(Gen *g, u32 s)
+{
+	return x86_mem(X86_RBP, g->slot_base - 8 * (i32)(s + 1));
+}
+
+/* Where `v` lives: a register or a spill slot. */
+static struct X86Operand loc(Gen *g, IrValue v)
+{
+	struct RaLoc l = g->ra.loc[v];
+	return l.kind == RaLoc_REG ? x86_reg((X86Reg)l.reg) : slot(g, l.slot);
+}
+
+static bool in_reg(Gen *g, IrValue v)
+{
+	return g->ra.loc[v].kind == RaLoc_REG;
+}
+
+static bool is_const(Gen *g, IrValue v)
+{
+	return ir_inst(g->fn, v)->op == IrOp_CONST;
+}
+
+static i32 const_int(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	return inst->ty == IrType_I1 ? inst->imm.k.b : inst->imm.k.i;
+}
+
+static u64 const_bits(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	if (inst->ty == IrType_F32) {
+		u32 bits;
+		memcpy(&bits, &inst->imm.k.f, 4);
+		return bits;
+	}
+	u64 bits;
+	memcpy(&bits, &inst->imm.k.d, 8);
+	return bits;
+}
+
+/*
+ * ==========================================================================
+ * 2. Operands
+ * ==========================================================================
+ */
+
+static struct X86Operand alloca_mem(Gen *g, IrValue v)
+{
+	i32 off = (i32)g->alloca_at[v];
+	return g->jit ? x86_mem(X86_R15, off)
+		      : x86_mem(X86_RBP, g->alloca_base + off);
+}
+
+/* Address of a global into `r`. */
+static void global_addr(Gen *g, u32 global, X86Reg r)
+{
+	if (g->jit)
+		emit(g, X86_MOV, 8, x86_reg(r),
+		     x86_mem_sym(sym(X86Sym_GLOBAL, global, true)));
+	else
+		emit(g, X86_LEA, 8, x86_reg(r),
+		     x86_mem_sym(sym(X86Sym_GLOBAL, global, false)));
+}
+
+/* The memory `ptr` points to; may load the pointer into `scratch`. */
+static struct X86Operand addr_of(Gen *g, IrValue ptr, X86Reg scratch)
+{
+	const struct IrInst *def = ir_inst(g->fn, ptr);
+	if (def->op == IrOp_ALLOCA)
+		return alloca_mem(g, ptr);
+	if (def->op == IrOp_GLOBAL && !g->jit)
+		return x86_mem_sym(sym(X86Sym_GLOBAL, def->imm.index, false));
+	if (def->op == IrOp_GLOBAL) {
+		global_addr(g, def->imm.index, scratch);
+		return x86_mem(scratch, 0);
+	}
+	if (in_reg(g, ptr))
+		return x86_mem((X86Reg)g->ra.loc[ptr].reg, 0);
+	emit(g, X86_MOV, 8, x86_reg(scratch), loc(g, ptr));
+	return x86_mem(scratch, 0);
+}
+
+/* Loads a float constant into an SSE register, through rax. */
+static void float_const(Gen *g, IrValue v, X86Reg x)
+{
+	u64 bits = const_bits(g, v);
+	u8 size = ty_of(g, v) == IrType_F32 ? 4 : 8;
+	if (bits == 0) {
+		emit(g, X86_XORPS, 0, x86_reg(x), x86_reg(x));
+		return;
+	}
+	emit(g, X86_MOV, size, x86_reg(X86_RAX), x86_imm((i64)bits));
+	emit(g, X86_MOVD, size, x86_reg(x), x86_reg(X86_RAX));
+}
+
+/* A register holding `v`, loading it into `scratch` if needed. */
+static X86Reg use_reg(Gen *g, IrValue v, X86Reg scratch)
+{
+	const struct IrInst *def = ir_inst(g->fn, v);
+	IrType ty = (IrType)def->ty;
+	switch ((IrOp)def->op) {
+	case IrOp_CONST:
+		if (is_float(ty))
+			float_const(g, v, scratch);
+		else
+			emit(g, X86_MOV, 4, x86_reg(scratch),
+			     x86_imm(const_int(g, v)));
+		return scratch;
+	case IrOp_ALLOCA:
+		emit(g, X86_LEA, 8, x86_reg(scratch), alloca_mem(g, v));
+		return scratch;
+	case IrOp_GLOBAL:
+		global_addr(g, def->imm.index, scratch);
+		return scratch;
+	default:
+		break;
+	}
+	if (in_reg(g, v))
+		return (X86Reg)g->ra.loc[v].reg;
+	X86Op op = ty == IrType_F32 ? X86_MOVSS
+		   : ty == IrType_F64 ? X86_MOVSD
+				      : X86_MOV;
+	emit(g, op, int_size(ty), x86_reg(scratch), loc(g, v));
+	return scratch;
+}
+
+/* An integer source operand: immediate, register or spill slot. */
+static struct X86Operand int_src(Gen *g, IrValue v, X86Reg scratch)
+{
+	if (is_const(g, v))
+		return x86_imm(const_int(g, v));
+	if (g->ra.loc[v].kind == RaLoc_REMAT)
+		return x86_reg(use_reg(g, v, scratch));
+	return loc(g, v);
+}
+
+/* An SSE source operand: register or spill slot. */
+static struct X86Operand float_src(Gen *g, IrValue v, X86Reg scratch)
+{
+	if (is_const(g, v))
+		return x86_reg(use_reg(g, v, scratch));
+	return loc(g, v);
+}
+
+static X86Reg reg_of(Gen *g, IrValue v)
+{
+	return in_reg(g, v) ? (X86Reg)g->ra.loc[v].reg : X86_NOREG;
+}
+
+/* Register to compute `v` in: its own, unless that would clobber `avoid`
+ * before it is read. */
+static X86Reg target(Gen *g, IrValue v, IrValue avoid, X86Reg scratch)
+{
+	X86Reg r = reg_of(g, v);
+	if (r == X86_NOREG || (avoid && reg_of(g, avoid) == r))
+		return scratch;
+	return r;
+}
+
+static void copy_reg(Gen *g, IrType ty, X86Reg dst, X86Reg src)
+{
+	if (dst == src)
+		return;
+	if (is_float(ty))
+		emit(g, X86_MOVAPS, 0, x86_reg(dst), x86_reg(src));
+	else
+		emit(g, X86_MOV, int_size(ty), x86_reg(dst), x86_reg(src));
+}
+
+/* Writes `r` to the location of `v`. */
+static void set_result(Gen *g, IrValue v, X86Reg r)
+{
+	IrType ty = ty_of(g, v);
+	struct RaLoc l = g->ra.loc[v];
+	if (l.kind == RaLoc_REG) {
+		copy_reg(g, ty, (X86Reg)l.reg, r);
+		return;
+	}
+	if (l.kind != RaLoc_SLOT)
+		return;
+	X86Op op = ty == IrType_F32 ? X86_MOVSS
+		   : ty == IrType_F64 ? X86_MOVSD
+				      : X86_MOV;
+	emit(g, op, int_size(ty), slot(g, l.slot), x86_reg(r));
+}
+
+/*
+ * ==========================================================================
+ * 3. Parallel Copies
+ * ==========================================================================
+ * PHI copies on an edge, arguments of a call and parameters on entry are
+ * each one simultaneous assignment. Copies whose destination nobody else
+ * reads go first; what remains are cycles, broken by saving one
+ * destination in a scratch register (every location has one writer, so
+ * a cycle is always resolved before the next is touched).
+ */
+
+struct Move {
+	struct X86Operand dst;
+	struct X86Operand src;
+	/* A value to compute instead of reading `src`. */
+	IrValue remat;
+	bool fl;
+};
+
+defVec(struct Move, MoveVec);
+
+static bool same_loc(const struct X86Operand *a, const struct X86Operand *b)
+{
+	if (a->kind != b->kind)
+		return false;
+	if (a->kind == X86Opnd_REG)
+		return a->reg == b->reg;
+	return a->kind == X86Opnd_MEM && a->reg == b->reg && a->disp == b->disp;
+}
+
+static void rematerialize(Gen *g, IrValue v, struct X86Operand dst)
+{
+	const struct IrInst *def = ir_inst(g->fn, v);
+	bool to_reg = dst.kind == X86Opnd_REG;
+	X86Reg r = to_reg ? (X86Reg)dst.reg : X86_RAX;
+	if (def->op == IrOp_CONST && is_float((IrType)def->ty)) {
+		if (to_reg) {
+			float_const(g, v, r);
+			return;
+		}
+		emit(g, X86_MOV, 8, x86_reg(X86_RAX),
+		     x86_imm((i64)const_bits(g, v)));
+	} else if (def->op == IrOp_CONST) {
+		emit(g, X86_MOV, to_reg ? 4 : 8, dst, x86_imm(const_int(g, v)));
+		return;
+	} else {
+		use_reg(g, v, r);
+		if (to_reg)
+			return;
+	}
+	emit(g, X86_MOV, 8, dst, x86_reg(X86_RAX));
+}
+
+static void emit_move(Gen *g, const struct Move *mv)
+{
+	if (mv->remat) {
+		rematerialize(g, mv->remat, mv->dst);
+		return;
+	}
+	bool dreg = mv->dst.kind == X86Opnd_REG;
+	bool sreg = mv->src.kind == X86Opnd_REG;
+	if (!dreg && !sreg) {
+		emit(g, X86_MOV, 8, x86_reg(X86_RAX), mv->src);
+		emit(g, X86_MOV, 8, mv->dst, x86_reg(X86_RAX));
+	} else if (!mv->fl) {
+		emit(g, X86_MOV, 8, mv->dst, mv->src);
+	} else if (dreg && sreg) {
+		emit(g, X86_MOVAPS, 0, mv->dst, mv->src);
+	} else {
+		emit(g, X86_MOVSD, 0, mv->dst, mv->src);
+	}
+}
+
+static void parallel_move(Gen *g, MoveVec *moves)
+{
+	struct Move *mv = moves->data;
+	usize n = vec_len(*moves);
+	for (usize i = 0; i < n;) {
+		if (!mv[i].remat && same_loc(&mv[i].dst, &mv[i].src))
+			mv[i] = mv[--n];
+		else
+			++i;
+	}
+
+	while (n) {
+		bool progress = false;
+		for (usize i = 0; i < n;) {
+			bool read = false;
+			for (usize j = 0; j < n && !read; ++j)
+				read = j != i && !mv[j].remat &&
+				       same_loc(&mv[j].src, &mv[i].dst);
+			if (read) {
+				++i;
+				continue;
+			}
+			emit_move(g, &mv[i]);
+			mv[i] = mv[--n];
+			progress = true;
+		}
+		if (progress || !n)
+			continue;
+
+		/* Only cycles are left: free the destination of mv[0]. */
+		struct X86Operand busy = mv[0].dst;
+		struct X86Operand tmp =
+			x86_reg(mv[0].fl ? SCRATCH_XMM : X86_R11);
+		struct Move save = { tmp, busy, IR_NONE, mv[0].fl };
+		emit_move(g, &save);
+		for (usize j = 0; j < n; ++j)
+			if (!mv[j].remat && same_loc(&mv[j].src, &busy))
+				mv[j].src = tmp;
+	}
+	moves->len = 0;
+}
+
+static void add_move(MoveVec *moves, struct X86Operand dst, Gen *g,
+		     IrValue v)
+{
+	struct Move mv = { .dst = dst, .fl = is_float(ty_of(g, v)) };
+	if (g->ra.loc[v].kind == RaLoc_REMAT)
+		mv.remat = v;
+	else
+		mv.src = loc(g, v);
+	massert(vec_push(*moves, mv), "OOM x86");
+}
+
+/*
+ * ==========================================================================
+ * 4. Instructions
+ * ==========================================================================
+ */
+
+static bool has_phis(const struct IrFunc *fn, u32 bb)
+{
+	IrValue first = fn->blocks.data[bb].first;
+	return first && ir_inst(fn, first)->op == IrOp_PHI;
+}
+
+static void phi_moves(Gen *g, MoveVec *moves, u32 from, u32 to)
+{
+	const struct IrFunc *fn = g->fn;
+	ir_foreach_inst(fn, to, phi)
+	{
+		const struct IrInst *inst = ir_inst(fn, phi);
+		if (inst->op != IrOp_PHI)
+			break;
+		struct RaLoc l = g->ra.loc[phi];
+		if (l.kind != RaLoc_REG && l.kind != RaLoc_SLOT)
+			continue;
+		const IrValue *args = ir_args(fn, phi);
+		for (u32 i = 0; i < inst->nargs; i += 2) {
+			if (args[i] == from) {
+				add_move(moves, loc(g, phi), g, args[i + 1]);
+				break;
+			}
+		}
+	}
+	parallel_move(g, moves);
+}
+
+static void emit_binary_int(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	const IrValue *args = ir_args(g->fn, v);
+	IrValue a = args[0], b = args[1];
+	bool commutes = inst->op == IrOp_ADD || inst->op == IrOp_MUL;
+	X86Reg dst = reg_of(g, v);
+	if (commutes &&
+	    (is_const(g, a) || (dst != X86_NOREG && reg_of(g, b) == dst))) {
+		IrValue t = a;
+		a = b;
+		b = t;
+	}
+	X86Reg r = target(g, v, b, X86_RAX);
+	X86Reg ra = use_reg(g, a, r);
+	copy_reg(g, IrType_I32, r, ra);
+	X86Op op = inst->op == IrOp_ADD ? X86_ADD
+		   : inst->op == IrOp_SUB ? X86_SUB
+					  : X86_IMUL;
+	emit(g, op, 4, x86_reg(r), int_src(g, b, X86_R11));
+	set_result(g, v, r);
+}
+
+static u32 div_trap(Gen *g, u32 id)
+{
+	vec_foreach(t, g->div_traps)
+	{
+		if (t->id == id)
+			return t->label;
+	}
+	struct DivTrap t = { id, new_label(g) };
+	massert(vec_push(g->div_traps, t), "OOM x86");
+	return t.label;
+}
+
+/*
+ * Division by zero stops the program; INT_MIN / -1 wraps (to INT_MIN,
+ * remainder 0) instead of faulting as idiv would.
+ */
+static void emit_divmod(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	const IrValue *args = ir_args(g->fn, v);
+	bool mod = inst->op == IrOp_MOD;
+	IrValue a = args[0], b = args[1];
+	u32 on_zero = div_trap(g, inst->imm.index);
+	u32 done = new_label(g);
+
+	if (is_const(g, b) && const_int(g, b) == 0) {
+		emit(g, X86_JMP, 0, x86_label(on_zero), NONE);
+		return;
+	}
+	X86Reg rb = use_reg(g, b, X86_R11);
+	if (!is_const(g, b)) {
+		u32 general = new_label(g);
+		emit(g, X86_TEST, 4, x86_reg(rb), x86_reg(rb));
+		emit_cc(g, X86_JCC, X86_CC_E, x86_label(on_zero));
+		emit(g, X86_CMP, 4, x86_reg(rb), x86_imm(-1));
+		emit_cc(g, X86_JCC, X86_CC_NE, x86_label(general));
+		if (mod) {
+			emit(g, X86_XOR, 4, x86_reg(X86_RAX), x86_reg(X86_RAX));
+		} else {
+			copy_reg(g, IrType_I32, X86_RAX,
+				 use_reg(g, a, X86_RAX));
+			emit(g, X86_NEG, 4, x86_reg(X86_RAX), NONE);
+		}
+		emit(g, X86_JMP, 0, x86_label(done), NONE);
+		place(g, general);
+	} else if (const_int(g, b) == -1) {
+		if (mod) {
+			emit(g, X86_XOR, 4, x86_reg(X86_RAX), x86_reg(X86_RAX));
+		} else {
+			copy_reg(g, IrType_I32, X86_RAX,
+				 use_reg(g, a, X86_RAX));
+			emit(g, X86_NEG, 4, x86_reg(X86_RAX), NONE);
+		}
+		set_result(g, v, X86_RAX);
+		return;
+	}
+	copy_reg(g, IrType_I32, X86_RAX, use_reg(g, a, X86_RAX));
+	emit(g, X86_CDQ, 4, NONE, NONE);
+	emit(g, X86_IDIV, 4, x86_reg(rb), NONE);
+	if (mod)
+		emit(g, X86_MOV, 4, x86_reg(X86_RAX), x86_reg(X86_RDX));
+	place(g, done);
+	set_result(g, v, X86_RAX);
+}
+
+static void emit_binary_float(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	const IrValue *args = ir_args(g->fn, v);
+	IrValue a = args[0], b = args[1];
+	bool f32 = inst->ty == IrType_F32;
+	X86Reg r = target(g, v, b, SCRATCH_XMM);
+	struct X86Operand src = float_src(g, b, SCRATCH_XMM2);
+	X86Reg ra = use_reg(g, a, r);
+	copy_reg(g, (IrType)inst->ty, r, ra);
+	u32 k = inst->op == IrOp_ADD   ? 0
+		: inst->op == IrOp_SUB ? 1
+		: inst->op == IrOp_MUL ? 2
+				       : 3;
+	emit(g, (X86Op)((f32 ? X86_ADDSS : X86_ADDSD) + k), 0, x86_reg(r), src);
+	set_result(g, v, r);
+}
+
+static void emit_neg(Gen *g, IrValue v)
+{
+	IrType ty = ty_of(g, v);
+	IrValue a = ir_args(g->fn, v)[0];
+	if (!is_float(ty)) {
+		X86Reg r = target(g, v, IR_NONE, X86_RAX);
+		copy_reg(g, ty, r, use_reg(g, a, r));
+		emit(g, X86_NEG, 4, x86_reg(r), NONE);
+		set_result(g, v, r);
+		return;
+	}
+	/* Flip the sign bit, as C's unary minus does (also for 0 and NaN). */
+	X86Reg r = target(g, v, IR_NONE, SCRATCH_XMM);
+	copy_reg(g, ty, r, use_reg(g, a, r));
+	u8 size = ty == IrType_F32 ? 4 : 8;
+	i64 sign = size == 4 ? (i64)0x80000000u : (i64)(1ull << 63);
+	emit(g, X86_MOV, size, x86_reg(X86_R11), x86_imm(sign));
+	emit(g, X86_MOVD, size, x86_reg(SCRATCH_XMM2), x86_reg(X86_R11));
+	emit(g, X86_XORPS, 0, x86_reg(r), x86_reg(SCRATCH_XMM2));
+	set_result(g, v, r);
+}
+
+static X86Cond int_cond(IrOp op)
+{
+	static const X86Cond conds[] = { X86_CC_E, X86_CC_NE, X86_CC_L,
+					 X86_CC_LE, X86_CC_G, X86_CC_GE };
+	return conds[op - IrOp_EQ];
+}
+
+/* Sets the flags for an integer compare and returns the condition. */
+static X86Cond int_compare(Gen *g, IrValue cmp)
+{
+	const IrValue *args = ir_args(g->fn, cmp);
+	IrValue a = args[0], b = args[1];
+	X86Reg ra = use_reg(g, a, X86_RAX);
+	emit(g, X86_CMP, int_size(ty_of(g, a)), x86_reg(ra),
+	     int_src(g, b, X86_R11));
+	return int_cond((IrOp)ir_inst(g->fn, cmp)->op);
+}
+
+static void emit_compare(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	const IrValue *args = ir_args(g->fn, v);
+	IrType ty = ty_of(g, args[0]);
+	X86Reg r = reg_of(g, v) != X86_NOREG ? reg_of(g, v) : X86_RAX;
+	if (!is_float(ty)) {
+		X86Cond cc = int_compare(g, v);
+		emit_cc(g, X86_SETCC, cc, x86_reg(X86_RAX));
+		emit(g, X86_MOVZX8, 4, x86_reg(r), x86_reg(X86_RAX));
+		set_result(g, v, r);
+		return;
+	}
+
+	/*
+	 * ucomis sets CF / ZF like an unsigned compare, and PF when either
+	 * side is NaN. a < b is tested as b > a so that "above" (CF = ZF =
+	 * 0) excludes NaN; == and != also look at PF.
+	 */
+	IrOp op = (IrOp)inst->op;
+	bool swap = op == IrOp_LT || op == IrOp_LE;
+	IrValue a = swap ? args[1] : args[0], b = swap ? args[0] : args[1];
+	struct X86Operand src = float_src(g, b, SCRATCH_XMM2);
+	X86Reg xa = use_reg(g, a, SCRATCH_XMM);
+	emit(g, ty == IrType_F32 ? X86_UCOMISS : X86_UCOMISD, 0, x86_reg(xa),
+	     src);
+	if (op == IrOp_EQ || op == IrOp_NE) {
+		bool eq = op == IrOp_EQ;
+		emit_cc(g, X86_SETCC, eq ? X86_CC_E : X86_CC_NE,
+			x86_reg(X86_RAX));
+		emit_cc(g, X86_SETCC, eq ? X86_CC_NP : X86_CC_P,
+			x86_reg(X86_RCX));
+		emit(g, X86_MOVZX8, 4, x86_reg(X86_RAX), x86_reg(X86_RAX));
+		emit(g, X86_MOVZX8, 4, x86_reg(X86_RCX), x86_reg(X86_RCX));
+		emit(g, eq ? X86_AND : X86_OR, 4, x86_reg(X86_RAX),
+		     x86_reg(X86_RCX));
+		set_result(g, v, X86_RAX);
+		return;
+	}
+	X86Cond cc = op == IrOp_GT || op == IrOp_LT ? X86_CC_A : X86_CC_AE;
+	emit_cc(g, X86_SETCC, cc, x86_reg(X86_RAX));
+	emit(g, X86_MOVZX8, 4, x86_reg(r), x86_reg(X86_RAX));
+	set_result(g, v, r);
+}
+
+static bool is_cmp(IrOp op)
+{
+	return op >= IrOp_EQ && op <= IrOp_GE;
+}
+
+/* An integer compare read only by the CONDBR right after it is
+ * emitted there, as a compare-and-branch. */
+static bool fuses_into_branch(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	if (!is_cmp((IrOp)inst->op) || !inst->next)
+		return false;
+	const struct IrInst *next = ir_inst(g->fn, inst->next);
+	if (next->op != IrOp_CONDBR || ir_args(g->fn, inst->next)[0] != v)
+		return false;
+	/* Its only reader: live no further than the branch. */
+	struct RaFunc *ra = &g->ra;
+	IrType ty = ty_of(g, ir_args(g->fn, v)[0]);
+	return ra->end[v] <= ra->start[v] + 1 && !is_float(ty);
+}
+
+static void emit_load(Gen *g, IrValue v)
+{
+	IrType ty = ty_of(g, v);
+	struct X86Operand m = addr_of(g, ir_args(g->fn, v)[0], X86_R11);
+	if (is_float(ty)) {
+		X86Reg r = target(g, v, IR_NONE, SCRATCH_XMM);
+		emit(g, ty == IrType_F32 ? X86_MOVSS : X86_MOVSD, 0, x86_reg(r),
+		     m);
+		set_result(g, v, r);
+		return;
+	}
+	X86Reg r = target(g, v, IR_NONE, X86_RAX);
+	if (ty == IrType_I1)
+		emit(g, X86_MOVZX8, 4, x86_reg(r), m);
+	else
+		emit(g, X86_MOV, int_size(ty), x86_reg(r), m);
+	set_result(g, v, r);
+}
+
+static void emit_store(Gen *g, IrValue v)
+{
+	const IrValue *args = ir_args(g->fn, v);
+	IrValue val = args[1];
+	IrType ty = ty_of(g, val);
+	/* The value first: constants may go through rax and r11. */
+	if (is_float(ty)) {
+		X86Reg r = use_reg(g, val, SCRATCH_XMM);
+		struct X86Operand m = addr_of(g, args[0], X86_R11);
+		emit(g, ty == IrType_F32 ? X86_MOVSS : X86_MOVSD, 0, m,
+		     x86_reg(r));
+		return;
+	}
+	u8 size = ty == IrType_I1 ? 1 : int_size(ty);
+	struct X86Operand src = is_const(g, val)
+					? x86_imm(const_int(g, val))
+					: x86_reg(use_reg(g, val, X86_RAX));
+	struct X86Operand m = addr_of(g, args[0], X86_R11);
+	emit(g, X86_MOV, size, m, src);
+}
+
+static void emit_zero(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	struct X86Operand m = addr_of(g, ir_args(g->fn, v)[0], X86_R11);
+	emit(g, X86_LEA, 8, x86_reg(X86_RDI), m);
+	emit(g, X86_XOR, 4, x86_reg(X86_RAX), x86_reg(X86_RAX));
+	emit(g, X86_MOV, 4, x86_reg(X86_RCX), x86_imm(inst->imm.mem.size));
+	emit(g, X86_REP_STOSB, 0, NONE, NONE);
+}
+
+static void emit_index(Gen *g, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	const IrValue *args = ir_args(g->fn, v);
+	u32 stride = inst->imm.mem.size;
+	X86Reg r = target(g, v, IR_NONE, X86_RAX);
+
+	if (is_const(g, args[1])) {
+		i64 off = (i64)const_int(g, args[1]) * stride;
+		if (off >= INT32_MIN / 2 && off <= INT32_MAX / 2) {
+			struct X86Operand m = addr_of(g, args[0], X86_R11);
+			m.disp += (i32)off;
+			emit(g, X86_LEA, 8, x86_reg(r), m);
+			set_result(g, v, r);
+			return;
+		}
+	}
+
+	/* The index is a signed i32: sign-extend it before scaling. */
+	if (is_const(g, args[1]))
+		emit(g, X86_MOV, 8, x86_reg(X86_RAX),
+		     x86_imm(const_int(g, args[1])));
+	else
+		emit(g, X86_MOVSXD, 8, x86_reg(X86_RAX), loc(g, args[1]));
+	u8 scale = 1;
+	if (stride == 1 || stride == 2 || stride == 4 || stride == 8)
+		scale = (u8)stride;
+	else
+		emit(g, X86_IMUL, 8, x86_reg(X86_RAX), x86_imm(stride));
+
+	struct X86Operand m = addr_of(g, args[0], X86_R11);
+	if (m.reg == X86_RIP) {
+		emit(g, X86_LEA, 8, x86_reg(X86_R11), m);
+		m = x86_mem(X86_R11, 0);
+	}
+	m.index = X86_RAX;
+	m.scale = scale;
+	emit(g, X86_LEA, 8, x86_reg(r), m);
+	set_result(g, v, r);
+}
+
+/* System V classification: which register or stack word each of `n`
+ * values of the given types travels in. Returns the stack words used. */
+static u32 classify(Gen *g, const IrValue *vals, u32 n,
+		    struct X86Operand *where, bool incoming)
+{
+	u32 ni = 0, nf = 0, stack = 0;
+	for (u32 i = 0; i < n; ++i) {
+		if (is_float(ty_of(g, vals[i])) ? nf < FLOAT_ARGS
+						 : ni < sizeof(INT_ARGS)) {
+			where[i] = is_float(ty_of(g, vals[i]))
+					   ? x86_reg(X86_XMM0 + nf++)
+					   : x86_reg(INT_ARGS[ni++]);
+			continue;
+		}
+		where[i] = incoming ? x86_mem(X86_RBP, 16 + 8 * (i32)stack)
+				    : x86_mem(X86_RSP, 8 * (i32)stack);
+		++stack;
+	}
+	return stack;
+}
+
+static struct X86Operand callee(Gen *g, u32 func)
+{
+	u8 rt = g->runtime[func];
+	if (rt != X86_RT_COUNT)
+		return g->jit ? x86_mem_sym(sym(X86Sym_RUNTIME, rt, true))
+			      : x86_sym(sym(X86Sym_RUNTIME, rt, false));
+	return g->jit ? x86_mem_sym(sym(X86Sym_FUNC, func, true))
+		      : x86_sym(sym(X86Sym_FUNC, func, false));
+}
+
+static void emit_call(Gen *g, IrValue v, MoveVec *moves, u32 *scratch)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	const IrValue *args = ir_args(g->fn, v);
+	struct X86Operand *where = (struct X86Operand *)scratch;
+	classify(g, args, inst->nargs, where, false);
+	for (u32 i = 0; i < inst->nargs; ++i)
+		add_move(moves, where[i], g, args[i]);
+	parallel_move(g, moves);
+
+	emit(g, X86_CALL, 0, callee(g, inst->imm.index), NONE);
+	if (inst->ty != IrType_VOID)
+		set_result(g, v, is_float((IrType)inst->ty) ? X86_XMM0
+							     : X86_RAX);
+}
+
+/* `next` is the block laid out after this one; the epilogue follows the
+ * last. */
+static void emit_ret(Gen *g, u32 next, IrValue v)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	if (inst->nargs) {
+		IrValue a = ir_args(g->fn, v)[0];
+		IrType ty = ty_of(g, a);
+		X86Reg r = is_float(ty) ? X86_XMM0 : X86_RAX;
+		copy_reg(g, ty, r, use_reg(g, a, r));
+	}
+	if (next != vec_len(g->fn->blocks))
+		emit(g, X86_JMP, 0, x86_label(g->epilogue), NONE);
+}
+
+static void emit_branch(Gen *g, u32 bb, u32 next, IrValue v, MoveVec *moves)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	if (inst->op == IrOp_BR) {
+		u32 to = inst->imm.target[0];
+		if (has_phis(g->fn, to))
+			phi_moves(g, moves, bb, to);
+		if (to != next)
+			emit(g, X86_JMP, 0, x86_label(to), NONE);
+		return;
+	}
+
+	X86Cond cc;
+	IrValue cond = ir_args(g->fn, v)[0];
+	if (inst->prev == cond && fuses_into_branch(g, cond)) {
+		cc = int_compare(g, cond);
+	} else if (is_const(g, cond)) {
+		emit(g, X86_MOV, 4, x86_reg(X86_RAX),
+		     x86_imm(const_int(g, cond)));
+		emit(g, X86_TEST, 4, x86_reg(X86_RAX), x86_reg(X86_RAX));
+		cc = X86_CC_NE;
+	} else if (in_reg(g, cond)) {
+		X86Reg r = reg_of(g, cond);
+		emit(g, X86_TEST, 4, x86_reg(r), x86_reg(r));
+		cc = X86_CC_NE;
+	} else {
+		emit(g, X86_CMP, 4, loc(g, cond), x86_imm(0));
+		cc = X86_CC_NE;
+	}
+
+	/*
+	 * Edges into PHIs go through a stub of copies right after the
+	 * branch. With a stub on one edge only, the branch takes the other
+	 * edge and the stub is the fall-through.
+	 */
+	u32 t = inst->imm.target[0], f = inst->imm.target[1];
+	bool st = has_phis(g->fn, t), sf = has_phis(g->fn, f);
+	if (!st && !sf) {
+		if (f == next) {
+			emit_cc(g, X86_JCC, cc, x86_label(t));
+		} else if (t == next) {
+			emit_cc(g, X86_JCC, (X86Cond)(cc ^ 1), x86_label(f));
+		} else {
+			emit_cc(g, X86_JCC, cc, x86_label(t));
+			emit(g, X86_JMP, 0, x86_label(f), NONE);
+		}
+		return;
+	}
+	if (!sf) {
+		/* Swap the edges: the stub is on the false one below. */
+		u32 to = t;
+		t = f;
+		f = to;
+		cc = (X86Cond)(cc ^ 1);
+		sf = true;
+		st = false;
+	}
+	u32 lt = st ? new_label(g) : t;
+	emit_cc(g, X86_JCC, cc, x86_label(lt));
+	phi_moves(g, moves, bb, f);
+	if (f != next || st)
+		emit(g, X86_JMP, 0, x86_label(f), NONE);
+	if (st) {
+		place(g, lt);
+		phi_moves(g, moves, bb, t);
+		if (t != next)
+			emit(g, X86_JMP, 0, x86_label(t), NONE);
+	}
+}
+
+static void emit_inst(Gen *g, u32 bb, u32 next, IrValue v, MoveVec *moves,
+		      u32 *scratch)
+{
+	const struct IrInst *inst = ir_inst(g->fn, v);
+	IrOp op = (IrOp)inst->op;
+	switch (op) {
+	case IrOp_ALLOCA:
+	case IrOp_PHI:
+	case IrOp_NOP:
+		return;
+	case IrOp_CALL:
+		emit_call(g, v, moves, scratch);
+		return;
+	case IrOp_STORE:
+		emit_store(g, v);
+		return;
+	case IrOp_ZERO:
+		emit_zero(g, v);
+		return;
+	case IrOp_BR:
+	case IrOp_CONDBR:
+		emit_branch(g, bb, next, v, moves);
+		return;
+	case IrOp_RET:
+		emit_ret(g, next, v);
+		return;
+	default:
+		break;
+	}
+
+	/* Pure instructions nothing reads are dropped, as the interpreter
+	 * drops them; so are compares that fuse into the branch after them. */
+	if (g->ra.loc[v].kind == RaLoc_NONE || fuses_into_branch(g, v))
+		return;
+
+	switch (op) {
+	case IrOp_LOAD:
+		emit_load(g, v);
+		break;
+	case IrOp_INDEX:
+		emit_index(g, v);
+		break;
+	case IrOp_ADD:
+	case IrOp_SUB:
+	case IrOp_MUL:
+		if (is_float((IrType)inst->ty))
+			emit_binary_float(g, v);
+		else
+			emit_binary_int(g, v);
+		break;
+	case IrOp_DIV:
+		if (is_float((IrType)inst->ty))
+			emit_binary_float(g, v);
+		else
+			emit_divmod(g, v);
+		break;
+	case IrOp_MOD:
+		emit_divmod(g, v);
+		break;
+	case IrOp_NEG:
+		emit_neg(g, v);
+		break;
+	case IrOp_NOT: {
+		X86Reg r = target(g, v, IR_NONE, X86_RAX);
+		copy_reg(g, IrType_I32, r,
+			 use_reg(g, ir_args(g->fn, v)[0], r));
+		emit(g, X86_XOR, 4, x86_reg(r), x86_imm(1));
+		set_result(g, v, r);
+		break;
+	}
+	default:
+		massert(is_cmp(op), "x86: unexpected IR opcode");
+		emit_compare(g, v);
+		break;
+	}
+}
+
+/*
+ * ==========================================================================
+ * 5. Functions
+ * ==========================================================================
+ */
+
+static void frame_layout(Gen *g)
+{
+	const struct IrFunc *fn = g->fn;
+	usize ninsts = vec_len(fn->insts);
+	if (ninsts > g->alloca_cap) {
+		if (g->alloca_at)
+			allocer_free(allocer_system(), g->alloca_at,
+				     layout(g->alloca_cap * sizeof(u32), 4));
+		g->alloca_cap = ninsts * 2;
+		g->alloca_at = allocer_alloc(
+			allocer_system(), layout(g->alloca_cap * sizeof(u32), 4));
+		massert(g->alloca_at, "OOM x86");
+	}
+	g->frame_bytes = ir_frame_layout(fn, g->alloca_at);
+
+	g->nsaved = 0;
+	u64 saved = g->ra.used_regs & CALLEE_SAVED;
+	if (g->jit)
+		saved |= 1ull << X86_R15;
+	for (u8 r = 0; r < 16; ++r)
+		if (saved >> r & 1)
+			g->saved[g->nsaved++] = r;
+
+	/* The largest stack argument area of any call. */
+	u32 out_words = 0;
+	for (IrValue v = 1; v < ninsts; ++v) {
+		const struct IrInst *inst = ir_inst(fn, v);
+		if (inst->op != IrOp_CALL || !inst->block)
+			continue;
+		u32 ni = 0, nf = 0;
+		for (u32 i = 0; i < inst->nargs; ++i) {
+			if (is_float(ty_of(g, ir_args(fn, v)[i])))
+				++nf;
+			else
+				++ni;
+		}
+		u32 words = (ni > 6 ? ni - 6 : 0) + (nf > 8 ? nf - 8 : 0);
+		if (words > out_words)
+			out_words = words;
+	}
+
+	i32 saved_area = (i32)(8 * g->nsaved + 15) & ~15;
+	i32 allocas = g->jit ? 0 : (i32)g->frame_bytes;
+	g->alloca_base = -(saved_area + allocas);
+	g->slot_base = g->alloca_base;
+	i32 total = saved_area + allocas + 8 * (i32)(g->ra.nslots + out_words);
+	total = (total + 15) & ~15;
+	g->frame_size = total - 8 * (i32)g->nsaved;
+}
+
+static void prologue(Gen *g)
+{
+	emit(g, X86_PUSH, 8, x86_reg(X86_RBP), NONE);
+	emit(g, X86_MOV, 8, x86_reg(X86_RBP), x86_reg(X86_RSP));
+	for (u32 i = 0; i < g->nsaved; ++i)
+		emit(g, X86_PUSH, 8, x86_reg((X86Reg)g->saved[i]), NONE);
+	if (g->frame_size)
+		emit(g, X86_SUB, 8, x86_reg(X86_RSP), x86_imm(g->frame_size));
+	emit(g, X86_CMP, 8, x86_reg(X86_RSP),
+	     x86_mem_sym(sym(X86Sym_VAR, X86_VAR_STACK_LIMIT, false)));
+	emit_cc(g, X86_JCC, X86_CC_B, x86_label(g->overflow_trap));
+}
+
+/* JIT: claims the frame's ALLOCA storage at r15 from the memory stack. */
+static void claim_storage(Gen *g)
+{
+	struct X86Operand top =
+		x86_mem_sym(sym(X86Sym_VAR, X86_VAR_MEM_TOP, false));
+	emit(g, X86_LEA, 8, x86_reg(X86_RAX),
+	     x86_mem(X86_R15, (i32)g->frame_bytes));
+	emit(g, X86_CMP, 8, x86_reg(X86_RAX),
+	     x86_mem_sym(sym(X86Sym_VAR, X86_VAR_MEM_END, false)));
+	emit_cc(g, X86_JCC, X86_CC_A, x86_label(g->overflow_trap));
+	emit(g, X86_MOV, 8, top, x86_reg(X86_RAX));
+}
+
+static void epilogue(Gen *g)
+{
+	place(g, g->epilogue);
+	if (g->jit)
+		emit(g, X86_MOV, 8,
+		     x86_mem_sym(sym(X86Sym_VAR, X86_VAR_MEM_TOP, false)),
+		     x86_reg(X86_R15));
+	if (g->nsaved)
+		emit(g, X86_LEA, 8, x86_reg(X86_RSP),
+		     x86_mem(X86_RBP, -8 * (i32)g->nsaved));
+	else
+		emit(g, X86_MOV, 8, x86_reg(X86_RSP), x86_reg(X86_RBP));
+	for (u32 i = g->nsaved; i-- > 0;)
+		emit(g, X86_POP, 8, x86_reg((X86Reg)g->saved[i]), NONE);
+	emit(g, X86_POP, 8, x86_reg(X86_RBP), NONE);
+	emit(g, X86_RET, 0, NONE, NONE);
+}
+
+/* Calls runtime error `rt` for function `id` (IrFunc.id). */
+static void trap(Gen *g, u32 label, X86Runtime rt, u32 id)
+{
+	place(g, label);
+	emit(g, X86_MOV, 4, x86_reg(X86_RDI), x86_imm(id));
+	emit(g, X86_CALL, 0,
+	     g->jit ? x86_mem_sym(sym(X86Sym_RUNTIME, rt, true))
+		    : x86_sym(sym(X86Sym_RUNTIME, rt, false)),
+	     NONE);
+}
+
+/*
+ * JIT: an entry at loop header `bb` for a frame the interpreter has been
+ * running. It builds the same frame as the function's own entry, adopts
+ * the interpreter's ALLOCA storage, loads every value live into `bb`
+ * from the register array, and jumps to the header.
+ */
+static void osr_entry(Gen *g, u32 bb)
+{
+	const struct IrFunc *fn = g->fn;
+	const u32 *slots = g->pub->osr_slots;
+	u32 pos = g->ra.block_start[bb];
+	for (IrValue v = 1; v < vec_len(fn->insts); ++v)
+		if (ra_live_at(&g->ra, v, pos) && slots[v] == UINT32_MAX)
+			return;
+
+	u32 label = new_label(g);
+	g->pub->osr_label[bb] = label;
+	place(g, label);
+	prologue(g);
+	emit(g, X86_MOV, 8, x86_reg(X86_R15), x86_reg(X86_RSI));
+	claim_storage(g);
+	emit(g, X86_MOV, 8, x86_reg(X86_RAX), x86_reg(X86_RDI));
+	for (IrValue v = 1; v < vec_len(fn->insts); ++v) {
+		if (!ra_live_at(&g->ra, v, pos))
+			continue;
+		struct X86Operand src = x86_mem(X86_RAX, 8 * (i32)slots[v]);
+		if (!in_reg(g, v)) {
+			emit(g, X86_MOV, 8, x86_reg(X86_R11), src);
+			emit(g, X86_MOV, 8, loc(g, v), x86_reg(X86_R11));
+		} else if (is_float(ty_of(g, v))) {
+			emit(g, X86_MOVSD, 0, loc(g, v), src);
+		} else {
+			emit(g, X86_MOV, 8, loc(g, v), src);
+		}
+	}
+	emit(g, X86_JMP, 0, x86_label(bb), NONE);
+}
+
+/* Loop headers: blocks entered from a block laid out after them. */
+static void osr_entries(Gen *g)
+{
+	const struct IrFunc *fn = g->fn;
+	u32 nblocks = (u32)vec_len(fn->blocks);
+	memset(g->pub->osr_label, 0, nblocks * sizeof(u32));
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		u32 succ[2];
+		u32 n = ir_succs(fn, bb, succ);
+		for (u32 i = 0; i < n; ++i)
+			if (succ[i] <= bb && !g->pub->osr_label[succ[i]])
+				osr_entry(g, succ[i]);
+	}
+}
+
+/* AOT: the frame offset of each local that keeps its ALLOCA. */
+static void record_locals(Gen *g)
+{
+	const struct IrFunc *fn = g->fn;
+	for (usize i = 0; i < vec_len(fn->locals); ++i) {
+		struct IrLocal local = fn->locals.data[i];
+		if (ir_inst(fn, local.addr)->op == IrOp_ALLOCA)
+			local.sym->stack_offset =
+				g->alloca_base + (i32)g->alloca_at[local.addr];
+	}
+}
+
+void x86_gen_func(struct X86Gen *pub, u32 func)
+{
+	Gen *g = pub->impl;
+	const struct IrFunc *fn = &g->m->funcs.data[func];
+	TRACE_SCOPE_ARG("x86_func", fn->name);
+	u32 nblocks = (u32)vec_len(fn->blocks);
+
+	g->fn = fn;
+	pub->insts.len = 0;
+	pub->nlabels = nblocks;
+	g->epilogue = new_label(g);
+	g->div_traps.len = 0;
+	g->overflow_trap = new_label(g);
+
+	ra_run(&g->ra, fn, &g->target);
+	frame_layout(g);
+
+	MoveVec moves;
+	massert(vec_init(moves, allocer_system(), 16), "OOM x86");
+	/* Room to classify the arguments of any call. */
+	usize nscratch = (vec_len(fn->args) + 1) * sizeof(struct X86Operand);
+	u32 *scratch = allocer_alloc(allocer_system(), layout(nscratch, 8));
+	massert(scratch, "OOM x86");
+
+	prologue(g);
+	if (g->jit) {
+		emit(g, X86_MOV, 8, x86_reg(X86_R15),
+		     x86_mem_sym(sym(X86Sym_VAR, X86_VAR_MEM_TOP, false)));
+		claim_storage(g);
+	}
+	struct X86Operand *where = (struct X86Operand *)scratch;
+	u32 nparams = (u32)vec_len(fn->params);
+	classify(g, fn->params.data, nparams, where, true);
+	for (u32 i = 0; i < nparams; ++i) {
+		IrValue p = fn->params.data[i];
+		struct RaLoc l = g->ra.loc[p];
+		if (l.kind != RaLoc_REG && l.kind != RaLoc_SLOT)
+			continue;
+		struct Move mv = { .dst = loc(g, p),
+				   .src = where[i],
+				   .fl = is_float(ty_of(g, p)) };
+		massert(vec_push(moves, mv), "OOM x86");
+	}
+	parallel_move(g, &moves);
+
+	for (u32 bb = 1; bb < nblocks; ++bb) {
+		place(g, bb);
+		ir_foreach_inst(fn, bb, v)
+		{
+			emit_inst(g, bb, bb + 1, v, &moves, scratch);
+		}
+	}
+	epilogue(g);
+	vec_foreach(t, g->div_traps)
+	{
+		trap(g, t->label, X86_RT_DIV_ZERO, t->id);
+	}
+	trap(g, g->overflow_trap, X86_RT_OVERFLOW, fn->id);
+	if (g->jit && pub->osr_slots)
+		osr_entries(g);
+	if (!g->jit)
+		record_locals(g);
+
+	allocer_free(allocer_system(), scratch, layout(nscratch, 8));
+	vec_deinit(moves);
+}
+
+void x86_gen_init(struct X86Gen *pub, const struct IrModule *m, X86Mode mode)
+{
+	allocer_t sys = allocer_system();
+	usize nfuncs = vec_len(m->funcs);
+	*pub = (struct X86Gen){ .m = m, .mode = mode };
+	Gen *g = allocer_alloc(sys, layout(sizeof(Gen), _Alignof(Gen)));
+	massert(g, "OOM x86");
+	*g = (Gen){ .pub = pub, .m = m, .jit = mode == X86Mode_JIT };
+	pub->impl = g;
+
+	g->target = (struct RaTarget){
+		.int_regs = INT_REGS,
+		/* r15 is the JIT's frame base. */
+		.nint = sizeof(INT_REGS) - (g->jit ? 1 : 0),
+		.float_regs = FLOAT_REGS,
+		.nfloat = sizeof(FLOAT_REGS),
+		.callee_saved = CALLEE_SAVED,
+	};
+	g->runtime = allocer_alloc(sys, layout(nfuncs + 1, 1));
+	massert(g->runtime, "OOM x86");
+	for (usize i = 0; i < nfuncs; ++i) {
+		const struct IrFunc *fn = &m->funcs.data[i];
+		g->runtime[i] = X86_RT_COUNT;
+		for (u8 rt = 0; fn->is_extern && rt < X86_RT_COUNT; ++rt)
+			if (strcmp(fn->name, RUNTIME_NAMES[rt]) == 0)
+				g->runtime[i] = rt;
+	}
+
+	usize maxblocks = 1;
+	for (usize i = 0; i < nfuncs; ++i)
+		if (vec_len(m->funcs.data[i].blocks) > maxblocks)
+			maxblocks = vec_len(m->funcs.data[i].blocks);
+	pub->osr_label = allocer_alloc(sys, layout(maxblocks * sizeof(u32), 4));
+	massert(pub->osr_label, "OOM x86");
+	massert(vec_init(pub->insts, sys, 256), "OOM x86");
+	massert(vec_init(g->div_traps, sys, 4), "OOM x86");
+}
+
+void x86_gen_deinit(struct X86Gen *pub)
+{
+	allocer_t sys = allocer_system();
+	Gen *g = pub->impl;
+	usize nfuncs = vec_len(g->m->funcs);
+	usize maxblocks = 1;
+	for (usize i = 0; i < nfuncs; ++i)
+		if (vec_len(g->m->funcs.data[i].blocks) > maxblocks)
+			maxblocks = vec_len(g->m->funcs.data[i].blocks);
+	allocer_free(sys, pub->osr_label, layout(maxblocks * sizeof(u32), 4));
+	if (g->alloca_at)
+		allocer_free(sys, g->alloca_at,
+			     layout(g->alloca_cap * sizeof(u32), 4));
+	allocer_free(sys, g->runtime, layout(nfuncs + 1, 1));
+	ra_deinit(&g->ra);
+	vec_deinit(g->div_traps);
+	vec_deinit(pub->insts);
+	allocer_free(sys, g, layout(sizeof(Gen), _Alignof(Gen)));
+	pub->impl = NULL;
+}
@@ -0,0 +1,483 @@
+/*
+ *    Copyright 2025 Karesis
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+ * Unit tests of the CFG analyses and loop-simplify, on functions built
+ * block by block. With `--bench <file.cact> [runs]` it times each
+ * analysis on the largest function of a program instead (see
+ * `make bench-cfg`).
+ */
+
+#include <cfg.h>
+#include <pass.h>
+#include <ir.h>
+#include <context.h>
+#include <lexer.h>
+#include <parser.h>
+#include <lower.h>
+#include <stats.h>
+#include <std/allocers/bump.h>
+#include <std/allocers/system.h>
+#include <std/fs.h>
+#include <std/strings/string.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * ==========================================================================
+ * 1. Harness
+ * ==========================================================================
+ */
+
+static int failures;
+
+#define CHECK(cond)                                                       \
+	do {                                                              \
+		if (!(cond)) {                                            \
+			fprintf(stderr, "%s:%d: check failed: %s\n",      \
+				__FILE__, __LINE__, #cond);               \
+			failures++;                                       \
+		}                                                         \
+	} while (0)
+
+/* A void function of one i1 parameter, the condition of every branch. */
+struct Fixture {
+	struct IrModule m;
+	struct IrFunc *fn;
+	IrValue cond;
+	struct PassManager pm;
+};
+
+static void fixture_init(struct Fixture *f, u32 nblocks)
+{
+	ir_module_init(&f->m);
+	u32 id = ir_func_new(&f->m, "f", IrType_VOID, false);
+	f->fn = &f->m.funcs.data[id];
+	f->cond = ir_param_new(f->fn, IrType_I1);
+	for (u32 i = 0; i < nblocks; ++i)
+		ir_block_new(f->fn);
+	f->pm = (struct PassManager){ .m = &f->m, .fn = f->fn };
+}
+
+static void fixture_deinit(struct Fixture *f)
+{
+	pm_deinit(&f->pm);
+	ir_module_deinit(&f->m);
+}
+
+static void br(struct Fixture *f, u32 from, u32 to)
+{
+	struct IrBuilder b = { .fn = f->fn, .block = from };
+	ir_emit_br(&b, to);
+}
+
+static void condbr(struct Fixture *f, u32 from, u32 then_bb, u32 else_bb)
+{
+	struct IrBuilder b = { .fn = f->fn, .block = from };
+	ir_emit_condbr(&b, f->cond, then_bb, else_bb);
+}
+
+static void ret(struct Fixture *f, u32 from)
+{
+	struct IrBuilder b = { .fn = f->fn, .block = from };
+	ir_emit_ret(&b, IR_NONE);
+}
+
+/* Whether the frontier of `bb` is exactly `want[0 .. n)`. */
+static bool frontier_is(const struct IrDomFrontier *df, u32 bb,
+			const u32 *want, u32 n)
+{
+	if (df->start[bb + 1] - df->start[bb] != n)
+		return false;
+	for (u32 i = 0; i < n; ++i) {
+		bool found = false;
+		for (u32 k = df->start[bb]; k < df->start[bb + 1]; ++k)
+			found |= df->blocks[k] == want[i];
+		if (!found)
+			return false;
+	}
+	return true;
+}
+
+static bool verify(struct Fixture *f)
+{
+	return ir_verify_func(&f->m, f->fn, stderr);
+}
+
+/*
+ * ==========================================================================
+ * 2. Tests
+ * ==========================================================================
+ */
+
+/* 1 -> {2, 3} -> 4 */
+static void test_diamond(void)
+{
+	struct Fixture f;
+	fixture_init(&f, 4);
+	condbr(&f, 1, 2, 3);
+	br(&f, 2, 4);
+	br(&f, 3, 4);
+	ret(&f, 4);
+	CHECK(verify(&f));
+
+	const struct IrCfg *cfg = pm_cfg(&f.pm);
+	CHECK(cfg->nrpo == 4);
+	CHECK(cfg->rpo[0] == 1 && cfg->rpo[3] == 4);
+	CHECK(cfg->pred_start[5] - cfg->pred_start[4] == 2);
+
+	const struct IrDomTree *dt = pm_domtree(&f.pm);
+	CHECK(dt->idom[1] == 1);
+	CHECK(dt->idom[2] == 1 && dt->idom[3] == 1 && dt->idom[4] == 1);
+	CHECK(ir_dominates(dt, 1, 4) && !ir_dominates(dt, 2, 4));
+	CHECK(ir_dominates(dt, 4, 4));
+
+	const struct IrPostDomTree *pdt = pm_postdomtree(&f.pm);
+	CHECK(pdt->tree.idom[1] == 4 && pdt->tree.idom[2] == 4);
+	CHECK(pdt->tree.idom[4] == 0);
+	CHECK(ir_postdominates(pdt, 4, 1) && !ir_postdominates(pdt, 2, 1));
+
+	const struct IrDomFrontier *df = pm_domfrontier(&f.pm);
+	CHECK(frontier_is(df, 1, NULL, 0));
+	CHECK(frontier_is(df, 2, (u32[]){ 4 }, 1));
+	CHECK(frontier_is(df, 3, (u32[]){ 4 }, 1));
+	CHECK(frontier_is(df, 4, NULL, 0));
+
+	CHECK(pm_loops(&f.pm)->nloops == 0);
+	fixture_deinit(&f);
+}
+
+/*
+ * An outer loop 2..6 around an inner loop 3..5 that 4 breaks out of:
+ *   1 -> 2; 2 -> {3, 7}; 3 -> {4, 6}; 4 -> {5, 6}; 5 -> 3; 6 -> 2
+ */
+static void build_nest(struct Fixture *f)
+{
+	fixture_init(f, 7);
+	br(f, 1, 2);
+	condbr(f, 2, 3, 7);
+	condbr(f, 3, 4, 6);
+	condbr(f, 4, 5, 6);
+	br(f, 5, 3);
+	br(f, 6, 2);
+	ret(f, 7);
+}
+
+static void test_loop_nest(void)
+{
+	struct Fixture f;
+	build_nest(&f);
+	CHECK(verify(&f));
+
+	const struct IrLoops *li = pm_loops(&f.pm);
+	CHECK(li->nloops == 2);
+	u32 inner = li->loop_of[4], outer = li->loop_of[6];
+	CHECK(inner && outer && inner < outer);
+	CHECK(li->loops[inner].header == 3 && li->loops[outer].header == 2);
+	CHECK(li->loops[inner].parent == outer);
+	CHECK(li->loops[outer].parent == 0);
+	CHECK(li->loops[inner].depth == 2 && li->loops[outer].depth == 1);
+	CHECK(ir_loop_depth(li, 1) == 0 && ir_loop_depth(li, 5) == 2);
+
+	CHECK(ir_loop_contains(li, outer, 5));
+	CHECK(!ir_loop_contains(li, inner, 6));
+	CHECK(!ir_loop_contains(li, outer, 7));
+	CHECK(ir_loop_contains(li, 0, 7));
+
+	const struct IrLoop *in = &li->loops[inner];
+	const struct IrLoop *out = &li->loops[outer];
+	CHECK(in->end - in->begin == 3 && out->end - out->begin == 5);
+	CHECK(out->begin <= in->begin && in->end <= out->end);
+	CHECK(li->blocks[in->begin] == 3 && li->blocks[out->begin] == 2);
+
+	CHECK(li->child_start[1] - li->child_start[0] == 1);
+	CHECK(li->children[li->child_start[0]] == outer);
+	CHECK(li->children[li->child_start[outer]] == inner);
+
+	CHECK(in->exit_end - in->exit_begin == 1);
+	CHECK(li->exits[in->exit_begin] == 6);
+	CHECK(out->exit_end - out->exit_begin == 1);
+	CHECK(li->exits[out->exit_begin] == 7);
+
+	/* 2 also branches to 7. */
+	CHECK(out->preheader == 1 && in->preheader == IR_NONE);
+
+	const struct IrDomFrontier *df = pm_domfrontier(&f.pm);
+	CHECK(frontier_is(df, 2, (u32[]){ 2 }, 1));
+	CHECK(frontier_is(df, 3, (u32[]){ 2, 3 }, 2));
+	CHECK(frontier_is(df, 4, (u32[]){ 3, 6 }, 2));
+	CHECK(frontier_is(df, 5, (u32[]){ 3 }, 1));
+	CHECK(frontier_is(df, 6, (u32[]){ 2 }, 1));
+
+	const struct IrPostDomTree *pdt = pm_postdomtree(&f.pm);
+	CHECK(pdt->tree.idom[6] == 2 && pdt->tree.idom[2] == 7);
+	CHECK(ir_postdominates(pdt, 2, 5));
+	fixture_deinit(&f);
+}
+
+/* A loop that never returns still has post-dominators: 2 <-> 3. */
+static void test_postdom_infinite(void)
+{
+	struct Fixture f;
+	fixture_init(&f, 4);
+	condbr(&f, 1, 2, 4);
+	br(&f, 2, 3);
+	br(&f, 3, 2);
+	ret(&f, 4);
+	CHECK(verify(&f));
+
+	const struct IrPostDomTree *pdt = pm_postdomtree(&f.pm);
+	for (u32 bb = 1; bb <= 4; ++bb)
+		CHECK(pdt->tree.pre[bb] != 0);
+	CHECK(pdt->tree.idom[1] == 0);
+	CHECK(pdt->tree.idom[2] == 3 && pdt->tree.idom[3] == 0);
+	CHECK(!ir_postdominates(pdt, 4, 1));
+	fixture_deinit(&f);
+}
+
+/* Two entries into one cycle (1 -> 2, 1 -> 3, 2 <-> 3): no natural
+ * loop; block 5 is unreachable. */
+static void test_irreducible(void)
+{
+	struct Fixture f;
+	fixture_init(&f, 5);
+	condbr(&f, 1, 2, 3);
+	br(&f, 2, 3);
+	condbr(&f, 3, 2, 4);
+	ret(&f, 4);
+	br(&f, 5, 2);
+
+	const struct IrCfg *cfg = pm_cfg(&f.pm);
+	CHECK(cfg->nrpo == 4);
+	CHECK(!ir_cfg_reachable(cfg, 5));
+
+	const struct IrDomTree *dt = pm_domtree(&f.pm);
+	CHECK(dt->idom[2] == 1 && dt->idom[3] == 1 && dt->idom[4] == 3);
+	CHECK(dt->idom[5] == IR_NONE && !ir_dominates(dt, 1, 5));
+
+	const struct IrDomFrontier *df = pm_domfrontier(&f.pm);
+	CHECK(frontier_is(df, 2, (u32[]){ 3 }, 1));
+	CHECK(frontier_is(df, 3, (u32[]){ 2 }, 1));
+	CHECK(frontier_is(df, 5, NULL, 0));
+
+	const struct IrLoops *li = pm_loops(&f.pm);
+	CHECK(li->nloops == 0);
+	CHECK(li->pos[5] == IR_UNREACHABLE);
+	fixture_deinit(&f);
+}
+
+static void test_analysis_cache(void)
+{
+	struct Fixture f;
+	build_nest(&f);
+	pm_loops(&f.pm);
+	CHECK(f.pm.valid == (IR_ANALYSIS(CFG) | IR_ANALYSIS(DOMTREE) |
+			     IR_ANALYSIS(LOOPS)));
+
+	pm_liveness(&f.pm);
+	pm_invalidate(&f.pm, IR_PRESERVE_ALL & ~IR_ANALYSIS(DOMTREE));
+	CHECK(f.pm.valid == (IR_ANALYSIS(CFG) | IR_ANALYSIS(LIVENESS)));
+
+	pm_invalidate(&f.pm, IR_PRESERVE_CFG);
+	CHECK(f.pm.valid == IR_ANALYSIS(CFG));
+	pm_invalidate(&f.pm, IR_PRESERVE_NONE);
+	CHECK(f.pm.valid == 0);
+	fixture_deinit(&f);
+}
+
+static void test_loop_simplify_nest(void)
+{
+	struct Fixture f;
+	build_nest(&f);
+	CHECK(ir_loop_simplify(&f.pm) == IR_PRESERVE_NONE);
+	pm_invalidate(&f.pm, IR_PRESERVE_NONE);
+	CHECK(verify(&f));
+
+	const struct IrLoops *li = pm_loops(&f.pm);
+	CHECK(li->nloops == 2);
+	u32 inner = li->loop_of[4];
+	u32 pre = li->loops[inner].preheader;
+	CHECK(pre == 8);
+	CHECK(ir_terminator(f.fn, pre) &&
+	      ir_inst(f.fn, ir_terminator(f.fn, pre))->op == IrOp_BR);
+	CHECK(ir_loop_contains(li, li->loops[inner].parent, pre));
+
+	/* Canonical now: a second run changes nothing. */
+	CHECK(ir_loop_simplify(&f.pm) == IR_PRESERVE_ALL);
+	fixture_deinit(&f);
+}
+
+/*
+ * Header 2 is entered from 1 and 3, with a PHI over both and the latch
+ * 4; the exit 5 is also reached from 1, outside the loop:
+ *   1 -> {2, 3}; 3 -> {2, 5}; 2 -> {4, 5}; 4 -> 2
+ */
+static void test_loop_simplify_phis(void)
+{
+	struct Fixture f;
+	fixture_init(&f, 5);
+	struct IrFunc *fn = f.fn;
+	IrValue k0 = ir_const_i32(fn, 0), k1 = ir_const_i32(fn, 1);
+	condbr(&f, 1, 2, 3);
+	condbr(&f, 3, 2, 5);
+	struct IrBuilder b = { .fn = fn, .block = 2 };
+	IrValue phi = ir_emit_phi(&b, IrType_I32, (u32[]){ 1, 3, 4 },
+				  (IrValue[]){ k0, k1, k0 }, 3);
+	ir_args(fn, phi)[5] = phi;
+	condbr(&f, 2, 4, 5);
+	br(&f, 4, 2);
+	b.block = 5;
+	IrValue out = ir_emit_phi(&b, IrType_I32, (u32[]){ 3, 2 },
+				  (IrValue[]){ k1, phi }, 2);
+	ret(&f, 5);
+	CHECK(verify(&f));
+
+	CHECK(ir_loop_simplify(&f.pm) == IR_PRESERVE_NONE);
+	pm_invalidate(&f.pm, IR_PRESERVE_NONE);
+	CHECK(verify(&f));
+
+	const struct IrLoops *li = pm_loops(&f.pm);
+	CHECK(li->nloops == 1);
+	const struct IrLoop *loop = &li->loops[1];
+	u32 pre = loop->preheader;
+	CHECK(pre > 5);
+
+	/* The header's PHI takes the preheader's merge and the latch. */
+	CHECK(ir_inst(fn, phi)->nargs == 4);
+	IrValue merged = IR_NONE;
+	for (u32 i = 0; i < 4; i += 2)
+		if (ir_args(fn, phi)[i] == pre)
+			merged = ir_args(fn, phi)[i + 1];
+	CHECK(merged && ir_inst(fn, merged)->op == IrOp_PHI);
+	CHECK(ir_inst(fn, merged)->block == pre);
+	CHECK(ir_inst(fn, merged)->nargs == 4);
+
+	/* The exit is only entered from the loop, through a new block
+	 * that takes over its PHI entry. */
+	CHECK(loop->exit_end - loop->exit_begin == 1);
+	u32 exit = li->exits[loop->exit_begin];
+	CHECK(exit != 5);
+	const struct IrCfg *cfg = pm_cfg(&f.pm);
+	CHECK(cfg->pred_start[exit + 1] - cfg->pred_start[exit] == 1);
+	CHECK(ir_inst(fn, out)->nargs == 4);
+	CHECK(ir_args(fn, out)[2] == exit && ir_args(fn, out)[3] == phi);
+	fixture_deinit(&f);
+}
+
+/*
+ * ==========================================================================
+ * 3. Benchmark
+ * ==========================================================================
+ */
+
+/* Best wall time of `runs` builds, in milliseconds. */
+#define TIME_BEST(runs, best, stmt)                            \
+	do {                                                   \
+		best = 1e300;                                  \
+		for (u32 r_ = 0; r_ < (runs); ++r_) {          \
+			double t_ = stats_now_us();            \
+			stmt;                                  \
+			t_ = (stats_now_us() - t_) / 1e3;      \
+			best = t_ < best ? t_ : best;          \
+		}                                              \
+	} while (0)
+
+static int bench(const char *path, u32 runs)
+{
+	bump_t arena;
+	bump_init(&arena, allocer_system(), 8);
+	struct Context ctx;
+	context_init(&ctx, bump_allocer(&arena));
+
+	string_t source;
+	if (!string_init(&source, ctx.alc, 0) ||
+	    !file_read_to_string(path, &source)) {
+		fprintf(stderr, "Could not read '%s'\n", path);
+		return 1;
+	}
+	usize file_id = srcmanager_add(&ctx.mgr, str_from_cstr(path),
+				       string_as_str(&source));
+	struct Lexer lex;
+	lexer_init(&lex, &ctx, file_id);
+	struct Parser p;
+	parser_init(&p, &ctx, &lex);
+	NodeVec globals = parser_parse(&p);
+
+	struct IrModule m;
+	ir_module_init(&m);
+	if (ctx.had_error || !ir_lower(&m, &ctx, globals)) {
+		fprintf(stderr, "'%s' does not compile\n", path);
+		return 1;
+	}
+
+	struct IrFunc *fn = NULL;
+	for (u32 i = 0; i < vec_len(m.funcs); ++i) {
+		struct IrFunc *g = &m.funcs.data[i];
+		if (!fn || vec_len(g->blocks) > vec_len(fn->blocks))
+			fn = g;
+	}
+
+	struct PassManager pm = { .m = &m, .fn = fn };
+	double cfg_ms, dom_ms, pdom_ms, df_ms, loop_ms;
+	TIME_BEST(runs, cfg_ms, ir_cfg_build(&pm.cfg, fn));
+	TIME_BEST(runs, dom_ms, ir_domtree_build(&pm.domtree, &pm.cfg));
+	TIME_BEST(runs, pdom_ms,
+		  ir_postdomtree_build(&pm.postdomtree, &pm.cfg));
+	TIME_BEST(runs, df_ms,
+		  ir_domfrontier_build(&pm.domfrontier, &pm.cfg, &pm.domtree));
+	TIME_BEST(runs, loop_ms,
+		  ir_loops_build(&pm.loops, &pm.cfg, &pm.domtree));
+
+	u32 n = ir_block_count(fn);
+	printf("function '%s': %u blocks, %u edges, %u loops\n", fn->name, n,
+	       pm.cfg.succ_start[pm.cfg.nblocks], pm.loops.nloops);
+	printf(" %-12s %10s %10s\n", "analysis", "ms", "ns/block");
+	const char *names[] = { "cfg", "domtree", "postdomtree", "domfrontier",
+				"loops" };
+	double ms[] = { cfg_ms, dom_ms, pdom_ms, df_ms, loop_ms };
+	for (u32 i = 0; i < 5; ++i)
+		printf(" %-12s %10.3f %10.1f\n", names[i], ms[i],
+		       ms[i] * 1e6 / n);
+
+	pm_deinit(&pm);
+	ir_module_deinit(&m);
+	context_deinit(&ctx);
+	bump_deinit(&arena);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc >= 3 && strcmp(argv[1], "--bench") == 0)
+		return bench(argv[2], argc >= 4 ? (u32)atoi(argv[3]) : 5);
+
+	test_diamond();
+	test_loop_nest();
+	test_postdom_infinite();
+	test_irreducible();
+	test_analysis_cache();
+	test_loop_simplify_nest();
+	test_loop_simplify_phis();
+
+	if (failures) {
+		fprintf(stderr, "test_cfg: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("test_cfg: all checks passed\n");
+	return 0;
+}